@@ -8,9 +8,24 @@
 #include "analyze_config.h"
 
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <cassert>
+#include <cerrno>
+#include <chrono>
+#include <deque>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
 #include <iostream>
+#include <limits>
 #include <memory>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/iostreams/filter/gzip.hpp>
@@ -24,6 +39,9 @@
 #include <boost/iostreams/filtering_stream.hpp>
 
 #include <boost/filesystem.hpp>
+#include <boost/functional/hash.hpp>
+
+#include <tsl/robin_map.h>
 
 #include "util/config.h"
 #include "util/linereader.h"
@@ -32,8 +50,40 @@
 
 #include "suppressions.h"
 
+#if ZSTD_FOUND
+#include "parallelzstddecompressor.h"
+#endif
+#include "pipelinedfilter.h"
+
 using namespace std;
 
+/**
+ * The decompressed data of an input file, see AccumulatedTraceData::cacheDecompressedData.
+ */
+struct DecompressedCache
+{
+    ~DecompressedCache()
+    {
+        if (fd != -1) {
+            close(fd);
+        }
+    }
+
+    std::string inputFile;
+    int fd = -1;
+    uint64_t size = 0;
+    bool complete = false;
+    bool failed = false;
+};
+
+/**
+ * The usable size per requested size, as announced by the 'U' records of HEAPTRACK_USABLE_SIZE.
+ */
+struct UsableSizes
+{
+    tsl::robin_map<uint64_t, uint64_t> sizes;
+};
+
 namespace {
 
 template <typename Base>
@@ -50,15 +100,22 @@ ostream& operator<<(ostream& out, const Index<Base> index)
 }
 
 // boost's counter filter uses an int for the count which overflows for large streams; so replace it with a work alike.
+// the count may get read while another thread reads through the counter, see PipelinedFilter
 class byte_counter
 {
 public:
     using char_type = char;
     using category = boost::iostreams::multichar_input_filter_tag;
 
+    byte_counter() = default;
+    byte_counter(const byte_counter& other)
+        : m_bytes(other.bytes())
+    {
+    }
+
     uint64_t bytes() const
     {
-        return m_bytes;
+        return m_bytes.load(std::memory_order_relaxed);
     }
 
     template <typename Source>
@@ -67,13 +124,267 @@ public:
         auto const readsize = boost::iostreams::read(src, str, size);
         if (readsize == -1)
             return -1;
-        m_bytes += readsize;
+        // there is only a single thread reading through the counter at any time
+        m_bytes.store(bytes() + readsize, std::memory_order_relaxed);
+        return readsize;
+    }
+
+private:
+    std::atomic<uint64_t> m_bytes {0};
+};
+
+std::atomic<bool> s_stopFollowing {false};
+
+/// @return true when the decompression can run on another core than the parsing, see PipelinedFilter
+bool decompressInBackground()
+{
+    static const bool multiCore = std::thread::hardware_concurrency() > 1;
+    return multiCore;
+}
+
+/// @return @p directory, or the default directory for scratch files when it is empty
+std::string scratchDirectoryOrDefault(const std::string& directory)
+{
+    if (!directory.empty()) {
+        return directory;
+    }
+    const auto tmpDir = getenv("TMPDIR");
+    return tmpDir && *tmpDir ? tmpDir : "/tmp";
+}
+
+/**
+ * Reads from a file descriptor and waits for more data at its end, like `tail -f` does.
+ *
+ * Regular files are polled until AccumulatedTraceData::stopFollowing() gets called, pipes
+ * are read until the writer closes them. Whenever new data arrived, @p update gets called
+ * at most once per @p interval while the data is consumed or waited for.
+ */
+class following_source
+{
+public:
+    using char_type = char;
+    using category = boost::iostreams::source_tag;
+
+    following_source(int fd, bool isPipe, std::chrono::milliseconds interval, std::function<void()> update)
+        : m_fd(fd)
+        , m_isPipe(isPipe)
+        , m_interval(interval)
+        , m_update(std::move(update))
+        , m_lastUpdate(std::chrono::steady_clock::now())
+    {
+    }
+
+    std::streamsize read(char* str, std::streamsize size)
+    {
+        while (true) {
+            const auto now = std::chrono::steady_clock::now();
+            if (m_hasNewData && now - m_lastUpdate >= m_interval) {
+                // everything read so far got parsed when the reader asks for more data
+                m_update();
+                m_lastUpdate = now;
+                m_hasNewData = false;
+            }
+
+            const auto ret = ::read(m_fd, str, size);
+            if (ret > 0) {
+                m_hasNewData = true;
+                return ret;
+            } else if (s_stopFollowing || (ret < 0 && errno != EINTR) || (ret == 0 && m_isPipe)) {
+                return -1;
+            } else if (ret == 0) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            }
+        }
+    }
+
+private:
+    int m_fd;
+    bool m_isPipe;
+    std::chrono::milliseconds m_interval;
+    std::function<void()> m_update;
+    std::chrono::steady_clock::time_point m_lastUpdate;
+    bool m_hasNewData = false;
+};
+
+/**
+ * Reads the decompressed data of several files one after the other, see AccumulatedTraceData::segments.
+ */
+class concatenated_source
+{
+public:
+    using char_type = char;
+    using category = boost::iostreams::source_tag;
+
+    explicit concatenated_source(std::vector<std::string> files)
+        : m_state(std::make_shared<State>())
+    {
+        m_state->files = std::move(files);
+    }
+
+    std::streamsize read(char* str, std::streamsize size)
+    {
+        auto& state = *m_state;
+        while (true) {
+            if (!state.in) {
+                if (state.next == state.files.size() || !open(state.files[state.next++])) {
+                    return -1;
+                }
+            }
+            state.in->read(str, size);
+            const auto ret = state.in->gcount();
+            if (ret > 0) {
+                return ret;
+            }
+            state.in.reset();
+            state.file.reset();
+        }
+    }
+
+private:
+    bool open(const std::string& fileName)
+    {
+        auto& state = *m_state;
+        state.file.reset(new ifstream(fileName, ios_base::in | ios_base::binary));
+        if (!state.file->is_open()) {
+            cerr << "Failed to open heaptrack log file: " << fileName << endl;
+            return false;
+        }
+        state.in.reset(new boost::iostreams::filtering_istream);
+        if (boost::algorithm::ends_with(fileName, ".gz")) {
+            state.in->push(boost::iostreams::gzip_decompressor());
+        } else if (boost::algorithm::ends_with(fileName, ".zst")) {
+#if ZSTD_FOUND
+            state.in->push(boost::iostreams::zstd_decompressor());
+#else
+            cerr << "Heaptrack was built without zstd support, cannot decompressed data file: " << fileName << endl;
+            return false;
+#endif
+        }
+        state.in->push(*state.file);
+        return true;
+    }
+
+    // sources get copied by boost, so all copies share the same state
+    struct State
+    {
+        std::vector<std::string> files;
+        size_t next = 0;
+        std::unique_ptr<ifstream> file;
+        std::unique_ptr<boost::iostreams::filtering_istream> in;
+    };
+    std::shared_ptr<State> m_state;
+};
+
+/**
+ * Writes a copy of the decompressed data that passes through it into a DecompressedCache.
+ */
+class caching_filter
+{
+public:
+    using char_type = char;
+    using category = boost::iostreams::multichar_input_filter_tag;
+
+    explicit caching_filter(std::shared_ptr<DecompressedCache> cache)
+        : m_cache(std::move(cache))
+    {
+    }
+
+    template <typename Source>
+    std::streamsize read(Source& src, char* str, std::streamsize size)
+    {
+        auto& cache = *m_cache;
+        const auto readsize = boost::iostreams::read(src, str, size);
+        if (readsize == -1) {
+            // only data that got read up to its end can replace the input file
+            cache.complete = !cache.failed;
+            return -1;
+        }
+        for (std::streamsize written = 0; !cache.failed && written < readsize;) {
+            const auto ret = ::write(cache.fd, str + written, readsize - written);
+            if (ret < 0 && errno == EINTR) {
+                continue;
+            } else if (ret <= 0) {
+                cerr << "failed to cache the decompressed data: " << strerror(errno) << endl;
+                cache.failed = true;
+            } else {
+                written += ret;
+            }
+        }
+        cache.size += readsize;
         return readsize;
     }
 
 private:
-    uint64_t m_bytes = 0;
+    std::shared_ptr<DecompressedCache> m_cache;
+};
+
+/**
+ * Reads the decompressed data from a DecompressedCache, starting at @p offset.
+ */
+class cached_source
+{
+public:
+    using char_type = char;
+    using category = boost::iostreams::source_tag;
+
+    cached_source(std::shared_ptr<const DecompressedCache> cache, uint64_t offset)
+        : m_cache(std::move(cache))
+        , m_offset(offset)
+    {
+    }
+
+    std::streamsize read(char* str, std::streamsize size)
+    {
+        while (true) {
+            const auto ret = pread(m_cache->fd, str, size, m_offset);
+            if (ret > 0) {
+                m_offset += ret;
+                return ret;
+            } else if (ret == 0 || errno != EINTR) {
+                return -1;
+            }
+        }
+    }
+
+private:
+    std::shared_ptr<const DecompressedCache> m_cache;
+    uint64_t m_offset;
 };
+
+/// @return a new cache for the decompressed data of @p inputFile in @p directory, or nullptr on failure
+std::shared_ptr<DecompressedCache> createDecompressedCache(const std::string& inputFile, const std::string& directory)
+{
+    std::string pathTemplate = directory + "/heaptrack.decompressed.XXXXXX";
+    std::vector<char> path(pathTemplate.begin(), pathTemplate.end());
+    path.push_back(0);
+    const auto fd = mkstemp(path.data());
+    if (fd == -1) {
+        cerr << "failed to create scratch file in " << directory << ": " << strerror(errno)
+             << ", the decompressed data does not get cached" << endl;
+        return nullptr;
+    }
+    // like for the other scratch files, nobody else needs to see it
+    unlink(path.data());
+    auto cache = std::make_shared<DecompressedCache>();
+    cache->inputFile = inputFile;
+    cache->fd = fd;
+    return cache;
+}
+
+/**
+ * Extrapolate the cost of a single sampled allocation of @p size bytes.
+ *
+ * The tracker samples allocations with a probability of 1 - exp(-size / sampleInterval),
+ * so every sample stands for the inverse of that many allocations.
+ */
+SampledCost sampledCost(uint64_t size, int64_t sampleInterval)
+{
+    if (!sampleInterval || !size) {
+        return {1, static_cast<int64_t>(size)};
+    }
+    const auto weight = -1. / std::expm1(-static_cast<double>(size) / sampleInterval);
+    return {std::llround(weight), std::llround(weight * size)};
+}
 }
 
 AccumulatedTraceData::AccumulatedTraceData()
@@ -82,28 +393,25 @@ AccumulatedTraceData::AccumulatedTraceData()
     traces.reserve(65536);
     strings.reserve(4096);
     allocations.reserve(16384);
-    traceIndexToAllocationIndex.reserve(16384);
+    traceIndexToAllocationIndex.reserve(65536);
     stopIndices.reserve(4);
     opNewIpIndices.reserve(16);
 }
 
 AccumulatedTraceData::~AccumulatedTraceData() = default;
 
-const string& AccumulatedTraceData::stringify(const StringIndex stringId) const
+boost::string_view AccumulatedTraceData::stringify(const StringIndex stringId) const
 {
     if (!stringId || stringId.index > strings.size()) {
-        static const string empty;
-        return empty;
+        return {};
     } else {
-        return strings.at(stringId.index - 1);
+        return strings[stringId.index - 1];
     }
 }
 
-string AccumulatedTraceData::prettyFunction(const string& function) const
+namespace {
+string shortenTemplateArguments(boost::string_view function)
 {
-    if (!shortenTemplates) {
-        return function;
-    }
     string ret;
     ret.reserve(function.size());
     int depth = 0;
@@ -140,10 +448,28 @@ string AccumulatedTraceData::prettyFunction(const string& function) const
     }
     return ret;
 }
+}
+
+boost::string_view AccumulatedTraceData::prettyFunction(FunctionIndex function) const
+{
+    const auto name = stringify(function);
+    if (!shortenTemplates || name.find('<') == boost::string_view::npos) {
+        return name;
+    }
+
+    if (shortenedFunctionIndices.size() < function.index) {
+        shortenedFunctionIndices.resize(strings.size());
+    }
+    auto& shortened = shortenedFunctionIndices[function.index - 1];
+    if (!shortened) {
+        shortened = shortenedFunctions.add(shortenTemplateArguments(name));
+    }
+    return shortenedFunctions[shortened.index - 1];
+}
 
 bool AccumulatedTraceData::read(const string& inputFile, bool isReparsing)
 {
-    return read(inputFile, FirstPass, isReparsing) && read(inputFile, SecondPass, isReparsing);
+    return read(inputFile, FirstPass, isReparsing);
 }
 
 bool AccumulatedTraceData::read(const string& inputFile, const ParsePass pass, bool isReparsing)
@@ -151,38 +477,170 @@ bool AccumulatedTraceData::read(const string& inputFile, const ParsePass pass, b
     const bool isGzCompressed = boost::algorithm::ends_with(inputFile, ".gz");
     const bool isZstdCompressed = boost::algorithm::ends_with(inputFile, ".zst");
     const bool isCompressed = isGzCompressed || isZstdCompressed;
-    ifstream file(inputFile, isCompressed ? ios_base::in | ios_base::binary : ios_base::in);
+    const bool follow = followInterval > 0 && pass == FirstPass && !isReparsing;
+
+    if (!segments.empty()) {
+        // the time index refers to offsets in the concatenated data, which cannot be skipped cheaply
+        vector<string> files = {inputFile};
+        files.insert(files.end(), segments.begin(), segments.end());
+        boost::iostreams::filtering_istream in;
+        in.push(byte_counter()); // caution, ::read dependant on filter order
+        if (decompressInBackground()) {
+            in.push(PipelinedFilter());
+        }
+        in.push(byte_counter());
+        in.push(concatenated_source(std::move(files)));
+        // the size of the decompressed data is unknown upfront
+        parsingState.fileSize = 0;
+        parsingState.skippedCompressedByte = 0;
+        return read(in, pass, isReparsing, nullptr);
+    }
 
-    if (!file.is_open()) {
+    // skip the data before the minimum time when we know where it starts, the part of it that
+    // cannot be skipped in the compressed data gets decompressed and ignored below
+    const TimeIndexEntry* resume = nullptr;
+    if (filterParameters.minTime && fileVersion >= 1 && !(pass == FirstPass && !isReparsing)) {
+        auto it = partition_point(timeIndex.begin(), timeIndex.end(), [this](const TimeIndexEntry& entry) {
+            return entry.timeStamp < filterParameters.minTime;
+        });
+        if (it != timeIndex.begin()) {
+            resume = &*(it - 1);
+        }
+    }
+
+    if (isCompressed && !follow && decompressedCache && decompressedCache->complete
+        && decompressedCache->inputFile == inputFile) {
+        // the cache holds the uncompressed data, so we can seek right to the offset we resume at
+        const uint64_t offset = resume ? resume->offset : 0;
+        boost::iostreams::filtering_istream in;
+        in.push(byte_counter()); // caution, ::read dependant on filter order
+        in.push(byte_counter());
+        in.push(cached_source(decompressedCache, offset));
+        parsingState.fileSize = decompressedCache->size;
+        parsingState.skippedCompressedByte = offset;
+        return read(in, pass, isReparsing, resume);
+    }
+
+    ifstream file;
+    int followFd = -1;
+    auto closeFollowFd = std::unique_ptr<int, void (*)(int*)>(&followFd, [](int* fd) {
+        if (*fd != -1) {
+            close(*fd);
+        }
+    });
+    if (follow) {
+        // a pipe must only get opened once, otherwise we would split its data between two readers
+        followFd = open(inputFile.c_str(), O_RDONLY | O_CLOEXEC);
+    } else {
+        file.open(inputFile, isCompressed ? ios_base::in | ios_base::binary : ios_base::in);
+    }
+
+    if (follow ? followFd == -1 : !file.is_open()) {
         cerr << "Failed to open heaptrack log file: " << inputFile << endl;
         return false;
     }
 
+    uint64_t compressedOffset = 0;
+    uint64_t uncompressedOffset = resume ? resume->offset : 0;
+
+#if ZSTD_FOUND
+    // files in the seekable format, as written by heaptrack_interpret, can be decompressed in parallel
+    // the seek table only gets written at the end, so growing files cannot be in that format yet
+    auto frames = follow || !isZstdCompressed ? std::vector<ParallelZstdDecompressor::Frame>()
+                                              : ParallelZstdDecompressor::readSeekTable(inputFile);
+    auto frame = frames.begin();
+    while (frame != frames.end() && uncompressedOffset >= frame->decompressedSize) {
+        uncompressedOffset -= frame->decompressedSize;
+        compressedOffset += frame->compressedSize;
+        ++frame;
+    }
+    frames.erase(frames.begin(), frame);
+    const bool decompressInParallel = frames.size() > 1 || compressedOffset;
+#else
+    const bool decompressInParallel = false;
+#endif
+
     boost::iostreams::filtering_istream in;
     in.push(byte_counter()); // caution, ::read dependant on filter order
+    if (cacheDecompressedData && isCompressed && pass == FirstPass && !follow && !resume) {
+        decompressedCache = createDecompressedCache(inputFile, scratchDirectoryOrDefault(scratchDirectory));
+        if (decompressedCache) {
+            in.push(caching_filter(decompressedCache));
+        }
+    }
+    if (isCompressed && !follow && !decompressInParallel && decompressInBackground()) {
+        // overlap the decompression with the parsing, ParallelZstdDecompressor does so on its own
+        in.push(PipelinedFilter());
+    }
     if (isGzCompressed) {
         in.push(boost::iostreams::gzip_decompressor());
     } else if (isZstdCompressed) {
 #if ZSTD_FOUND
-        in.push(boost::iostreams::zstd_decompressor());
+        if (decompressInParallel) {
+            in.push(ParallelZstdDecompressor(std::move(frames)));
+        } else {
+            in.push(boost::iostreams::zstd_decompressor());
+        }
 #else
         cerr << "Heaptrack was built without zstd support, cannot decompressed data file: " << inputFile << endl;
         return false;
 #endif
+    } else {
+        compressedOffset = uncompressedOffset;
+        uncompressedOffset = 0;
     }
     in.push(byte_counter()); // caution, ::read dependant on filter order
-    in.push(file);
+    if (follow) {
+        struct stat info;
+        const bool isPipe = fstat(followFd, &info) == 0 && S_ISFIFO(info.st_mode);
+        in.push(following_source(followFd, isPipe, std::chrono::milliseconds(followInterval), [this]() {
+            totalTime = parsingState.timestamp + 1;
+            finalizePeaks();
+            handleFollowUpdate();
+        }));
+    } else {
+        if (compressedOffset) {
+            file.seekg(compressedOffset);
+        }
+        in.push(file);
+    }
+
+    if (uncompressedOffset) {
+        in.ignore(uncompressedOffset);
+    }
 
-    parsingState.fileSize = boost::filesystem::file_size(inputFile);
+    boost::system::error_code error;
+    parsingState.fileSize = boost::filesystem::file_size(inputFile, error);
+    parsingState.skippedCompressedByte = compressedOffset;
 
-    return read(in, pass, isReparsing);
+    return read(in, pass, isReparsing, resume);
 }
 
-bool AccumulatedTraceData::read(boost::iostreams::filtering_istream& in, const ParsePass pass, bool isReparsing)
+bool AccumulatedTraceData::read(boost::iostreams::filtering_istream& in, const ParsePass pass, bool isReparsing,
+                                const TimeIndexEntry* resume)
 {
     LineReader reader;
     int64_t timeStamp = 0;
 
+    // add an entry to the time index for every TIME_INDEX_GRANULARITY bytes of data
+    const uint64_t TIME_INDEX_GRANULARITY = 1024 * 1024;
+    const bool buildTimeIndex = pass == FirstPass && !isReparsing;
+    uint64_t nextTimeIndexOffset = 0;
+    if (buildTimeIndex) {
+        timeIndex.clear();
+    }
+
+    // check the resident memory for every MEMORY_CHECK_GRANULARITY bytes of data
+    const uint64_t MEMORY_CHECK_GRANULARITY = 16 * 1024 * 1024;
+    uint64_t nextMemoryCheckOffset = MEMORY_CHECK_GRANULARITY;
+    if (memoryBudget && pass == FirstPass && !isReparsing) {
+        const auto directory = scratchDirectoryOrDefault(scratchDirectory);
+        if (!traces.spill(directory) || !allocationInfos.spill(directory) || !allocationInfoCosts.spill(directory)) {
+            cerr << "failed to create scratch file in " << directory << ": " << strerror(errno)
+                 << ", keeping all data in memory" << endl;
+        }
+    }
+
     vector<string> opNewStrings = {
         // 64 bit
         "operator new(unsigned long)",
@@ -196,11 +654,20 @@ bool AccumulatedTraceData::read(boost::iostreams::filtering_istream& in, const P
 
     vector<string> stopStrings = {"main", "__libc_start_main", "__static_initialization_and_destruction_0"};
 
-    const auto lastPeakCost = pass != FirstPass ? totalCost.peak : 0;
-    const auto lastPeakTime = pass != FirstPass ? peakTime : 0;
-
     totalCost = {};
     peakTime = 0;
+    sizeClasses.clear();
+    countedFrees = 0;
+    slackSizeClasses.clear();
+    peakSlack = 0;
+    pageOccupancy.clear();
+    peakSparseTime = 0;
+    for (auto& thread : threads) {
+        thread.cost = {};
+    }
+    for (auto& pool : pools) {
+        pool.cost = {};
+    }
     if (pass == FirstPass) {
         if (!filterParameters.disableBuiltinSuppressions) {
             suppressions = builtinSuppressions();
@@ -211,14 +678,33 @@ bool AccumulatedTraceData::read(boost::iostreams::filtering_istream& in, const P
                        [](const std::string& pattern) {
                            return Suppression {pattern, 0, 0};
                        });
+
+        if (!isReparsing) {
+            embeddedSuppressions.clear();
+        } else if (!filterParameters.disableEmbeddedSuppressions) {
+            for (const auto& pattern : embeddedSuppressions) {
+                suppressions.push_back({pattern, 0, 0});
+            }
+        }
     }
     peakRSS = 0;
     for (auto& allocation : allocations) {
         allocation.clearCost();
     }
-    unsigned int fileVersion = 0;
     bool debuggeeEncountered = false;
     bool inFilteredTime = !filterParameters.minTime;
+    // every segment starts with a 'v' record, see segments
+    int versionRecords = 0;
+    bool skipSegmentPrologue = false;
+    if (resume) {
+        // restore the state of the skipped data. the other records in it either got read in the initial
+        // pass already, like the embedded suppressions, or are ignored before the minimum time anyways
+        timeStamp = resume->previousTimeStamp;
+        debuggeeEncountered = true;
+        reader.setExpectedSizedStrings(fileVersion >= 3);
+    } else {
+        fileVersion = 0;
+    }
 
     // required for backwards compatibility
     // newer versions handle this in heaptrack_interpret already
@@ -228,6 +714,224 @@ bool AccumulatedTraceData::read(boost::iostreams::filtering_istream& in, const P
     // it holds the allocation info index. both can be used to find temporary
     // allocations, i.e. when a deallocation follows with the same data
     uint64_t lastAllocationPtr = 0;
+    // the allocation info index of the allocation directly preceding the current record, or -1
+    int64_t lastAllocationInfo = -1;
+
+    // the peak cost of the individual allocations is their leaked cost at the time of the total peak,
+    // which is only known once it got passed. to find it in a single pass, we count all changes of the
+    // leaked cost and remember when each allocation got changed last: when that happened before the
+    // latest total peak, the current leaked cost is the one at the peak
+    leakedChanges = {};
+    auto changeLeaked = [&](AllocationIndex index, int64_t delta) {
+        auto& lastChanges = leakedChanges.lastChanges;
+        if (index.index >= lastChanges.size()) {
+            lastChanges.resize(allocations.size(), 0);
+        }
+        auto& allocation = allocations[index.index];
+        auto& lastChange = lastChanges[index.index];
+        if (lastChange && lastChange <= leakedChanges.atPeak) {
+            allocation.peak = allocation.leaked;
+        }
+        lastChange = ++leakedChanges.count;
+        allocation.leaked += delta;
+        handleLeakedChange(index);
+    };
+    if (pass == FirstPass && !isReparsing) {
+        usableSizes.reset();
+    }
+    // the slack of the allocations that are currently alive
+    int64_t liveSlack = 0;
+    auto slackOf = [&](const AllocationInfo& info) -> int64_t {
+        if (!usableSizes) {
+            return 0;
+        }
+        auto it = usableSizes->sizes.find(info.size);
+        return it == usableSizes->sizes.end() ? 0 : static_cast<int64_t>(it->second - info.size);
+    };
+    auto updatePeak = [&]() {
+        if (totalCost.leaked > totalCost.peak) {
+            totalCost.peak = totalCost.leaked;
+            peakTime = timeStamp;
+            peakSlack = liveSlack;
+            leakedChanges.atPeak = leakedChanges.count;
+        }
+    };
+
+    const bool readStrings = materializedTables & StringsTable;
+    const bool readInstructionPointers = materializedTables & InstructionPointersTable;
+    const bool readTraces = materializedTables & TracesTable;
+    const bool readAllocations = materializedTables & AllocationsTable;
+
+    auto allocationCost = [&](AllocationInfoIndex index) {
+        return fileVersion >= 1 ? allocationInfoCost(index)
+                                : sampledCost(allocationInfos[index.index].size, sampleInterval);
+    };
+    // add the @p cost of @p count allocations, which may be zero for allocations that got reported already
+    auto addCost = [&](const AllocationInfo& info, AllocationInfoIndex allocationIndex, SampledCost cost,
+                       int64_t count) {
+        const auto slack = slackOf(info) * cost.allocations;
+        if (slack) {
+            const auto sizeClass = info.size ? 64 - __builtin_clzll(info.size) : 0;
+            if (sizeClass >= static_cast<int>(slackSizeClasses.size())) {
+                slackSizeClasses.resize(sizeClass + 1);
+            }
+            auto& sizeClassCost = slackSizeClasses[sizeClass];
+            sizeClassCost.allocations += cost.allocations;
+            sizeClassCost.requested += cost.size;
+            sizeClassCost.slack += slack;
+            liveSlack += slack;
+            totalCost.slack += slack;
+        }
+
+        if (readAllocations) {
+            changeLeaked(info.allocationIndex, cost.size);
+            allocations[info.allocationIndex.index].allocations += cost.allocations;
+            allocations[info.allocationIndex.index].slack += slack;
+        }
+
+        if (count == 1) {
+            handleAllocation(info, allocationIndex);
+        } else if (count) {
+            handleAllocations(info, allocationIndex, count);
+        }
+
+        if (info.thread && info.thread.index <= threads.size()) {
+            auto& threadCost = threads[info.thread.index - 1].cost;
+            threadCost.allocations += cost.allocations;
+            threadCost.leaked += cost.size;
+            threadCost.peak = std::max(threadCost.peak, threadCost.leaked);
+        }
+
+        if (info.pool && info.pool.index <= pools.size()) {
+            auto& poolCost = pools[info.pool.index - 1].cost;
+            poolCost.allocations += cost.allocations;
+            poolCost.leaked += cost.size;
+            poolCost.peak = std::max(poolCost.peak, poolCost.leaked);
+        }
+
+        totalCost.allocations += cost.allocations;
+        totalCost.leaked += cost.size;
+        updatePeak();
+    };
+    auto addAllocation = [&](const AllocationInfo& info, AllocationInfoIndex allocationIndex) {
+        addCost(info, allocationIndex, allocationCost(allocationIndex), 1);
+    };
+
+    // with a minimum lifetime, allocations only get accounted for once they reached that age. until then
+    // they are pending and get dropped when they are freed. the data only tells us which allocation info
+    // got freed, so like for temporary allocations the latest pending allocation of it is assumed to be freed
+    struct PendingAllocation
+    {
+        int64_t timeStamp;
+        AllocationInfoIndex index;
+        // the sequence number of the previous pending allocation of the same info, or zero
+        uint64_t previous;
+        bool freed;
+    };
+    std::deque<PendingAllocation> pendingAllocations;
+    // the sequence number of the first entry in pendingAllocations
+    uint64_t firstPendingAllocation = 1;
+    // the sequence number of the latest pending allocation per allocation info
+    std::vector<uint64_t> lastPendingAllocations;
+    auto commitPendingAllocations = [&](int64_t newStamp) {
+        while (!pendingAllocations.empty()
+               && (pendingAllocations.front().freed
+                   || pendingAllocations.front().timeStamp + filterParameters.minLifetime <= newStamp)) {
+            const auto pending = pendingAllocations.front();
+            pendingAllocations.pop_front();
+            ++firstPendingAllocation;
+            if (!pending.freed) {
+                addAllocation(allocationInfos[pending.index.index], pending.index);
+            }
+        }
+    };
+    const bool filterBySize = filterParameters.isFilteredBySize();
+    const bool filterByAllocation = filterParameters.isFilteredByAllocation();
+    // applies the size and lifetime filters to the allocations of '+' and 'r'
+    auto addFilteredAllocation = [&](const AllocationInfo& info, AllocationInfoIndex allocationIndex) {
+        if (filterBySize && !filterParameters.matchesSize(info.size)) {
+            return;
+        } else if (filterParameters.minLifetime) {
+            if (allocationIndex.index >= lastPendingAllocations.size()) {
+                lastPendingAllocations.resize(allocationInfos.size(), 0);
+            }
+            auto& lastPending = lastPendingAllocations[allocationIndex.index];
+            pendingAllocations.push_back({timeStamp, allocationIndex, lastPending, false});
+            lastPending = firstPendingAllocation + pendingAllocations.size() - 1;
+            return;
+        }
+        addAllocation(info, allocationIndex);
+    };
+
+    auto removeCost = [&](const AllocationInfo& info, int64_t size, int64_t temporary, int64_t growths,
+                          int64_t remoteFrees) {
+        const auto copied = growths ? size : 0;
+        totalCost.leaked -= size;
+        totalCost.temporary += temporary;
+        totalCost.growths += growths;
+        totalCost.copied += copied;
+        totalCost.remoteFrees += remoteFrees;
+
+        if (info.thread && info.thread.index <= threads.size()) {
+            auto& threadCost = threads[info.thread.index - 1].cost;
+            threadCost.leaked -= size;
+            threadCost.temporary += temporary;
+            threadCost.growths += growths;
+            threadCost.copied += copied;
+            threadCost.remoteFrees += remoteFrees;
+        }
+
+        if (info.pool && info.pool.index <= pools.size()) {
+            auto& poolCost = pools[info.pool.index - 1].cost;
+            poolCost.leaked -= size;
+            poolCost.temporary += temporary;
+            poolCost.growths += growths;
+            poolCost.copied += copied;
+            poolCost.remoteFrees += remoteFrees;
+        }
+
+        if (readAllocations) {
+            changeLeaked(info.allocationIndex, -size);
+            auto& allocation = allocations[info.allocationIndex.index];
+            allocation.temporary += temporary;
+            allocation.growths += growths;
+            allocation.copied += copied;
+            allocation.remoteFrees += remoteFrees;
+        }
+    };
+    // a free that directly follows a larger allocation from the same backtrace is the last step of growing a
+    // buffer, be it through realloc or by copying it over manually like std::vector and std::string do.
+    // without the per-backtrace allocations, we cannot tell whether the allocations come from the same place
+    auto isGrowth = [&](AllocationInfoIndex freedIndex) {
+        if (!readAllocations || lastAllocationInfo < 0 || lastAllocationInfo == freedIndex.index
+            || static_cast<uint64_t>(lastAllocationInfo) >= allocationInfos.size()) {
+            return false;
+        }
+        const auto& freed = allocationInfos[freedIndex.index];
+        const auto& last = allocationInfos[lastAllocationInfo];
+        return last.allocationIndex == freed.allocationIndex && last.size > freed.size;
+    };
+    auto removeAllocation = [&](AllocationInfoIndex allocationInfoIndex, bool temporary, bool growth, bool remote,
+                                int64_t lifetime) {
+        const auto& info = allocationInfos[allocationInfoIndex.index];
+        if (filterBySize && !filterParameters.matchesSize(info.size)) {
+            return;
+        } else if (filterParameters.minLifetime && allocationInfoIndex.index < lastPendingAllocations.size()) {
+            auto& lastPending = lastPendingAllocations[allocationInfoIndex.index];
+            if (lastPending >= firstPendingAllocation) {
+                // freed before it reached the minimum lifetime
+                auto& pending = pendingAllocations[lastPending - firstPendingAllocation];
+                pending.freed = true;
+                lastPending = pending.previous;
+                return;
+            }
+        }
+        const auto cost = allocationCost(allocationInfoIndex);
+        liveSlack -= slackOf(info) * cost.allocations;
+        removeCost(info, cost.size, temporary ? cost.allocations : 0, growth ? cost.allocations : 0,
+                   remote ? cost.allocations : 0);
+        handleDeallocation(info, allocationInfoIndex, lifetime);
+    };
 
     const auto uncompressedCount = in.component<byte_counter>(0);
     const auto compressedCount = in.component<byte_counter>(in.size() - 2);
@@ -235,28 +939,73 @@ bool AccumulatedTraceData::read(boost::iostreams::filtering_istream& in, const P
     parsingState.pass = pass;
     parsingState.reparsing = isReparsing;
 
+    // the records that get ignored in this pass, such that the loop below needs a single lookup to skip them
+    std::array<bool, 256> skippedRecords = {};
+    auto skipRecord = [&skippedRecords](char mode) { skippedRecords[static_cast<unsigned char>(mode)] = true; };
+    // comments and empty lines
+    skipRecord('#');
+    // module load address and build-id, only needed by heaptrack_symbolize
+    skipRecord('b');
+    // end of the prologue of a segment, see 'G'
+    skipRecord('g');
+    if (pass != FirstPass || isReparsing) {
+        // the strings, instruction pointers, traces, allocation infos, threads, pools and usable sizes got read
+        // already, a resumed pass would miss the ones before its offset otherwise
+        for (const auto mode : {'s', 'i', 't', 'a', 'H', 'Q', 'A', 'U'}) {
+            skipRecord(mode);
+        }
+    }
+    if (!readStrings) {
+        skipRecord('s');
+    }
+    if (!readInstructionPointers) {
+        skipRecord('i');
+    }
+    if (!readTraces) {
+        skipRecord('t');
+    }
+    if (pass != FirstPass || isReparsing) {
+        // see embeddedSuppressions
+        skipRecord('S');
+    }
+
+    // reused for all strings to not allocate a temporary for each of them
+    std::string stringBuffer;
     while (timeStamp < filterParameters.maxTime && reader.getLine(in)) {
-        parsingState.readCompressedByte = compressedCount->bytes();
+        parsingState.readCompressedByte = parsingState.skippedCompressedByte + compressedCount->bytes();
         parsingState.readUncompressedByte = uncompressedCount->bytes();
         parsingState.timestamp = timeStamp;
 
-        if (reader.mode() == 's') {
-            if (pass != FirstPass || isReparsing) {
-                continue;
+        if (!recordCallbacks.empty()) {
+            const auto& callback = recordCallbacks[static_cast<unsigned char>(reader.mode())];
+            if (callback) {
+                callback(reader.rawLine());
             }
+        }
+
+        if (skipSegmentPrologue) {
+            // a segment repeats the data of the previous one in its prologue, see 'G'
+            skipSegmentPrologue = reader.mode() != 'g';
+            continue;
+        }
+
+        if (skippedRecords[static_cast<unsigned char>(reader.mode())]) {
+            continue;
+        }
+
+        switch (reader.mode()) {
+        case 's': {
+            StringIndex index;
             if (fileVersion >= 3) {
                 // read sized string directly
-                std::string string;
-                reader >> string;
-                strings.push_back(std::move(string));
+                stringBuffer.clear();
+                reader >> stringBuffer;
+                index = strings.add(stringBuffer);
             } else {
                 // read remaining line as string, possibly including white spaces
-                strings.push_back(reader.line().substr(2));
+                index = strings.add(boost::string_view(reader.line()).substr(2));
             }
 
-            StringIndex index;
-            index.index = strings.size();
-
             auto opNewIt = find(opNewStrings.begin(), opNewStrings.end(), strings.back());
             if (opNewIt != opNewStrings.end()) {
                 opNewStrIndices.push_back(index);
@@ -268,10 +1017,9 @@ bool AccumulatedTraceData::read(boost::iostreams::filtering_istream& in, const P
                     stopStrings.erase(stopIt);
                 }
             }
-        } else if (reader.mode() == 't') {
-            if (pass != FirstPass || isReparsing) {
-                continue;
-            }
+            break;
+        }
+        case 't': {
             TraceNode node;
             reader >> node.ipIndex;
             reader >> node.parentIndex;
@@ -280,30 +1028,32 @@ bool AccumulatedTraceData::read(boost::iostreams::filtering_istream& in, const P
                 node = findTrace(node.parentIndex);
             }
             traces.push_back(node);
-        } else if (reader.mode() == 'i') {
-            if (pass != FirstPass || isReparsing) {
-                continue;
-            }
-            InstructionPointer ip;
-            reader >> ip.instructionPointer;
-            reader >> ip.moduleIndex;
+            break;
+        }
+        case 'i': {
+            uint64_t address = 0;
+            ModuleIndex moduleIndex;
+            reader >> address;
+            reader >> moduleIndex;
             auto readFrame = [&reader](Frame* frame) {
                 return (reader >> frame->functionIndex) && (reader >> frame->fileIndex) && (reader >> frame->line);
             };
-            if (readFrame(&ip.frame)) {
+            Frame frame;
+            const bool hasFrame = readFrame(&frame);
+            const auto index = instructionPointers.add(address, moduleIndex, frame);
+            if (hasFrame) {
                 Frame inlinedFrame;
                 while (readFrame(&inlinedFrame)) {
-                    ip.inlined.push_back(inlinedFrame);
+                    instructionPointers.addInlined(inlinedFrame);
                 }
             }
 
-            instructionPointers.push_back(ip);
-            if (find(opNewStrIndices.begin(), opNewStrIndices.end(), ip.frame.functionIndex) != opNewStrIndices.end()) {
-                IpIndex index;
-                index.index = instructionPointers.size();
+            if (find(opNewStrIndices.begin(), opNewStrIndices.end(), frame.functionIndex) != opNewStrIndices.end()) {
                 opNewIpIndices.push_back(index);
             }
-        } else if (reader.mode() == '+') {
+            break;
+        }
+        case '+': {
             if (!inFilteredTime) {
                 continue;
             }
@@ -320,6 +1070,7 @@ bool AccumulatedTraceData::read(boost::iostreams::filtering_istream& in, const P
                 }
                 info = allocationInfos[allocationIndex.index];
                 lastAllocationPtr = allocationIndex.index;
+                lastAllocationInfo = allocationIndex.index;
             } else { // backwards compatibility
                 uint64_t ptr = 0;
                 TraceIndex traceIndex;
@@ -327,7 +1078,9 @@ bool AccumulatedTraceData::read(boost::iostreams::filtering_istream& in, const P
                     cerr << "failed to parse line: " << reader.line() << ' ' << __LINE__ << endl;
                     continue;
                 }
-                info.allocationIndex = mapToAllocationIndex(traceIndex);
+                if (readAllocations) {
+                    info.allocationIndex = mapToAllocationIndex(traceIndex);
+                }
                 if (allocationInfoSet.add(info.size, traceIndex, &allocationIndex)) {
                     allocationInfos.push_back(info);
                 }
@@ -335,37 +1088,29 @@ bool AccumulatedTraceData::read(boost::iostreams::filtering_istream& in, const P
                 lastAllocationPtr = ptr;
             }
 
-            if (pass != FirstPass) {
-                auto& allocation = allocations[info.allocationIndex.index];
-                allocation.leaked += info.size;
-                ++allocation.allocations;
-
-                handleAllocation(info, allocationIndex);
-            }
-
-            ++totalCost.allocations;
-            totalCost.leaked += info.size;
-            if (totalCost.leaked > totalCost.peak) {
-                totalCost.peak = totalCost.leaked;
-                peakTime = timeStamp;
-
-                if (pass == SecondPass && totalCost.peak == lastPeakCost && peakTime == lastPeakTime) {
-                    for (auto& allocation : allocations) {
-                        allocation.peak = allocation.leaked;
-                    }
-                }
-            }
-        } else if (reader.mode() == '-') {
+            addFilteredAllocation(info, allocationIndex);
+            break;
+        }
+        case '-': {
             if (!inFilteredTime) {
                 continue;
             }
             AllocationInfoIndex allocationInfoIndex;
             bool temporary = false;
+            int64_t lifetime = -1;
+            uint32_t remote = 0;
             if (fileVersion >= 1) {
                 if (!(reader >> allocationInfoIndex)) {
                     cerr << "failed to parse line: " << reader.line() << endl;
                     continue;
                 }
+                // optional, only written by newer versions of heaptrack_interpret
+                uint32_t recordedLifetime = 0;
+                if (reader >> recordedLifetime) {
+                    lifetime = recordedLifetime;
+                    // optional too, only written for frees by another thread than the allocating one
+                    reader >> remote;
+                }
                 temporary = lastAllocationPtr == allocationInfoIndex.index;
             } else { // backwards compatibility
                 uint64_t ptr = 0;
@@ -381,49 +1126,255 @@ bool AccumulatedTraceData::read(boost::iostreams::filtering_istream& in, const P
                 allocationInfoIndex = taken.first;
                 temporary = lastAllocationPtr == ptr;
             }
+            const bool growth = isGrowth(allocationInfoIndex);
             lastAllocationPtr = 0;
+            lastAllocationInfo = -1;
 
-            const auto& info = allocationInfos[allocationInfoIndex.index];
-            totalCost.leaked -= info.size;
-            if (temporary) {
-                ++totalCost.temporary;
+            removeAllocation(allocationInfoIndex, temporary, growth, remote, lifetime);
+            break;
+        }
+        case 'r': {
+            // a reallocation, i.e. a '-' record for the freed allocation info directly followed by a '+' record,
+            // and whether the data had to be moved to a new address
+            if (!inFilteredTime) {
+                continue;
+            }
+            AllocationInfoIndex allocationIndex;
+            AllocationInfoIndex freedIndex;
+            uint32_t lifetime = 0;
+            uint32_t moved = 0;
+            if (!(reader >> allocationIndex) || !(reader >> freedIndex) || !(reader >> lifetime) || !(reader >> moved)
+                || allocationIndex.index >= allocationInfos.size() || freedIndex.index >= allocationInfos.size()) {
+                cerr << "failed to parse line: " << reader.line() << endl;
+                continue;
+            }
+            // optional, see '-'
+            uint32_t remote = 0;
+            reader >> remote;
+            lastAllocationInfo = allocationIndex.index;
+            // growing in place doesn't copy anything
+            removeAllocation(freedIndex, lastAllocationPtr == freedIndex.index, moved && isGrowth(freedIndex), remote,
+                             lifetime);
+            lastAllocationPtr = allocationIndex.index;
+            addFilteredAllocation(allocationInfos[allocationIndex.index], allocationIndex);
+            break;
+        }
+        case 'z': {
+            // a pool got destroyed, which freed the given number of allocations of one allocation info at once
+            if (!inFilteredTime) {
+                continue;
+            }
+            AllocationInfoIndex allocationInfoIndex;
+            uint64_t count = 0;
+            if (!(reader >> allocationInfoIndex) || !(reader >> count)
+                || allocationInfoIndex.index >= allocationInfos.size()) {
+                cerr << "failed to parse line: " << reader.line() << endl;
+                continue;
+            }
+            lastAllocationPtr = 0;
+            lastAllocationInfo = -1;
+            // the lifetimes of the individual allocations are unknown
+            for (uint64_t i = 0; i < count; ++i) {
+                removeAllocation(allocationInfoIndex, false, false, false, -1);
+            }
+            break;
+        }
+        case 'e': {
+            // the allocations and deallocations of one allocation info since the previous time stamp, as
+            // aggregated by HEAPTRACK_INTERPRET_AGGREGATE. unlike for 'd', the sizes are known, but not
+            // the lifetimes, so the lifetime filter doesn't apply and the peak is only known per time stamp
+            if (!inFilteredTime) {
+                continue;
+            }
+            AllocationInfoIndex allocationInfoIndex;
+            int64_t numAllocations = 0;
+            int64_t numDeallocations = 0;
+            int64_t numTemporary = 0;
+            if (!(reader >> allocationInfoIndex) || !(reader >> numAllocations) || !(reader >> numDeallocations)
+                || !(reader >> numTemporary) || allocationInfoIndex.index >= allocationInfos.size()) {
+                cerr << "failed to parse line: " << reader.line() << endl;
+                continue;
+            }
+            // optional, the number of deallocations by another thread than the allocating one
+            int64_t numRemote = 0;
+            reader >> numRemote;
+            lastAllocationPtr = 0;
+            lastAllocationInfo = -1;
+            const auto& info = allocationInfos[allocationInfoIndex.index];
+            if (filterBySize && !filterParameters.matchesSize(info.size)) {
+                continue;
+            }
+            const auto cost = allocationCost(allocationInfoIndex);
+            // free first, such that the allocations that got freed again don't make up a peak
+            liveSlack -= slackOf(info) * cost.allocations * numDeallocations;
+            removeCost(info, cost.size * numDeallocations, cost.allocations * numTemporary, 0,
+                       cost.allocations * numRemote);
+            addCost(info, allocationInfoIndex, {cost.allocations * numAllocations, cost.size * numAllocations},
+                    numAllocations);
+            break;
+        }
+        case 'd': {
+            // aggregated snapshot of the cost of a trace since the last snapshot
+            // the tracker already accounts for sampling here, but the sizes and lifetimes are unknown
+            if (!inFilteredTime || filterByAllocation) {
+                continue;
+            }
+            TraceIndex traceIndex;
+            int64_t numAllocations = 0;
+            int64_t numDeallocations = 0;
+            int64_t numTemporary = 0;
+            int64_t allocated = 0;
+            int64_t freed = 0;
+            if (!(reader >> traceIndex) || !(reader >> numAllocations) || !(reader >> numDeallocations)
+                || !(reader >> numTemporary) || !(reader >> allocated) || !(reader >> freed)) {
+                cerr << "failed to parse line: " << reader.line() << endl;
+                continue;
+            }
+            // the other costs are only known for the data written by writeAggregated
+            AllocationData otherCosts;
+            if (reader >> otherCosts.growths) {
+                reader >> otherCosts.copied;
+                reader >> otherCosts.slack;
+                reader >> otherCosts.remoteFrees;
+                reader >> otherCosts.pinned;
+            }
+            if (readAllocations) {
+                const auto allocationIndex = mapToAllocationIndex(traceIndex);
+                auto& allocation = allocations[allocationIndex.index];
+                allocation.allocations += numAllocations;
+                allocation.temporary += numTemporary;
+                allocation.growths += otherCosts.growths;
+                allocation.copied += otherCosts.copied;
+                allocation.slack += otherCosts.slack;
+                allocation.remoteFrees += otherCosts.remoteFrees;
+                allocation.pinned += otherCosts.pinned;
+                changeLeaked(allocationIndex, allocated - freed);
             }
 
-            if (pass != FirstPass) {
-                auto& allocation = allocations[info.allocationIndex.index];
-                allocation.leaked -= info.size;
-                if (temporary) {
-                    ++allocation.temporary;
-                }
+            totalCost.allocations += numAllocations;
+            totalCost.temporary += numTemporary;
+            totalCost.leaked += allocated - freed;
+            totalCost.growths += otherCosts.growths;
+            totalCost.copied += otherCosts.copied;
+            totalCost.slack += otherCosts.slack;
+            totalCost.remoteFrees += otherCosts.remoteFrees;
+            break;
+        }
+        case 'D': {
+            // peak of the aggregated data, the leaked cost of all traces got updated before
+            if (!inFilteredTime || filterByAllocation) {
+                continue;
+            }
+            int64_t peak = 0;
+            if (!(reader >> peak)) {
+                cerr << "failed to parse line: " << reader.line() << endl;
+                continue;
+            }
+            // the slack at the peak and the peak of the mappings are only known for the data of writeAggregated
+            int64_t slackAtPeak = 0;
+            int64_t peakMapped = 0;
+            if (reader >> slackAtPeak) {
+                reader >> peakMapped;
+            }
+            if (peak > totalCost.peak) {
+                totalCost.peak = peak;
+                peakTime = timeStamp;
+                peakSlack = liveSlack + slackAtPeak;
+                leakedChanges.atPeak = leakedChanges.count;
+            }
+            totalCost.peakMapped = max(totalCost.peakMapped, peakMapped);
+            break;
+        }
+        case 'k':
+        case 'K': {
+            // anonymous memory got mapped or unmapped
+            if (!inFilteredTime) {
+                continue;
             }
-        } else if (reader.mode() == 'a') {
-            if (pass != FirstPass || isReparsing) {
+            int64_t size = 0;
+            TraceIndex traceIndex;
+            if (!(reader >> size) || !(reader >> traceIndex)) {
+                cerr << "failed to parse line: " << reader.line() << endl;
                 continue;
             }
+            if (reader.mode() == 'K') {
+                size = -size;
+            }
+            if (readAllocations) {
+                const auto allocationIndex = mapToAllocationIndex(traceIndex);
+                auto& allocation = allocations[allocationIndex.index];
+                allocation.mapped += size;
+                allocation.peakMapped = max(allocation.peakMapped, allocation.mapped);
+            }
+            totalCost.mapped += size;
+            totalCost.peakMapped = max(totalCost.peakMapped, totalCost.mapped);
+            break;
+        }
+        case 'a': {
             AllocationInfo info;
             TraceIndex traceIndex;
             if (!(reader >> info.size) || !(reader >> traceIndex)) {
                 cerr << "failed to parse line: " << reader.line() << endl;
                 continue;
             }
-            info.allocationIndex = mapToAllocationIndex(traceIndex);
+            // optional, see HEAPTRACK_TRACK_THREADS and heaptrack_pool_malloc
+            reader >> info.thread;
+            reader >> info.pool;
+            if (readAllocations) {
+                info.allocationIndex = mapToAllocationIndex(traceIndex);
+            }
+            if (sampleInterval || !allocationInfoCosts.empty()) {
+                // the costs of allocations that got recorded before sampling started are exact
+                allocationInfoCosts.reserve(allocationInfos.size() + 1);
+                for (size_t i = allocationInfoCosts.size(); i < allocationInfos.size(); ++i) {
+                    allocationInfoCosts.push_back(sampledCost(allocationInfos[i].size, 0));
+                }
+                allocationInfoCosts.push_back(sampledCost(info.size, sampleInterval));
+            }
             allocationInfos.push_back(info);
-
-        } else if (reader.mode() == '#') {
-            // comment or empty line
-            continue;
-        } else if (reader.mode() == 'c') {
+            break;
+        }
+        case 'H': {
+            ThreadInfo thread;
+            if (!(reader >> thread.tid) || !(reader >> thread.name)) {
+                cerr << "failed to parse line: " << reader.line() << endl;
+                continue;
+            }
+            threads.push_back(thread);
+            break;
+        }
+        case 'Q': {
+            PoolInfo pool;
+            if (!(reader >> pool.handle)) {
+                cerr << "failed to parse line: " << reader.line() << endl;
+                continue;
+            }
+            pools.push_back(pool);
+            break;
+        }
+        case 'c': {
             int64_t newStamp = 0;
             if (!(reader >> newStamp)) {
                 cerr << "Failed to read time stamp: " << reader.line() << endl;
                 continue;
             }
+            if (buildTimeIndex && reader.lineOffset() >= nextTimeIndexOffset) {
+                timeIndex.push_back({reader.lineOffset(), timeStamp, newStamp});
+                nextTimeIndexOffset = reader.lineOffset() + TIME_INDEX_GRANULARITY;
+            }
+            if (memoryBudget && reader.lineOffset() >= nextMemoryCheckOffset) {
+                enforceMemoryBudget();
+                nextMemoryCheckOffset = reader.lineOffset() + MEMORY_CHECK_GRANULARITY;
+            }
+            commitPendingAllocations(newStamp);
             inFilteredTime = newStamp >= filterParameters.minTime && newStamp <= filterParameters.maxTime;
             if (inFilteredTime) {
                 handleTimeStamp(timeStamp, newStamp, false, pass);
             }
             timeStamp = newStamp;
-        } else if (reader.mode() == 'R') { // RSS timestamp
+            break;
+        }
+        case 'R': { // RSS timestamp
             if (!inFilteredTime) {
                 continue;
             }
@@ -432,21 +1383,167 @@ bool AccumulatedTraceData::read(boost::iostreams::filtering_istream& in, const P
             if (rss > peakRSS) {
                 peakRSS = rss;
             }
-        } else if (reader.mode() == 'X') {
+            handleRss(rss);
+            break;
+        }
+        case 'O': { // overhead of heaptrack, the totals so far
+            TracerOverhead overhead;
+            if (!(reader >> overhead.events) || !(reader >> overhead.unwindNs) || !(reader >> overhead.lockSpins)
+                || !(reader >> overhead.lockWaitNs) || !(reader >> overhead.flushes)
+                || !(reader >> overhead.flushedBytes) || !(reader >> overhead.blockedWriteNs)) {
+                cerr << "Failed to read overhead: " << reader.line() << endl;
+                continue;
+            }
+            tracerOverhead = overhead;
+            break;
+        }
+        case 'U': {
+            // the usable size of the allocations of the given requested size
+            uint64_t size = 0;
+            uint64_t usableSize = 0;
+            if (!(reader >> size) || !(reader >> usableSize) || usableSize < size) {
+                cerr << "failed to parse line: " << reader.line() << endl;
+                continue;
+            }
+            if (!usableSizes) {
+                usableSizes = std::make_shared<UsableSizes>();
+            }
+            usableSizes->sizes[size] = usableSize;
+            break;
+        }
+        case 'Z': { // allocations per size class, the totals so far
+            int64_t frees = 0;
+            if (!(reader >> frees)) {
+                cerr << "Failed to read size classes: " << reader.line() << endl;
+                continue;
+            }
+            int64_t previousAllocations = 0;
+            for (const auto& sizeClass : sizeClasses) {
+                previousAllocations += sizeClass.allocations;
+            }
+            sizeClasses.clear();
+            int64_t newAllocations = 0;
+            uint32_t index = 0;
+            SizeClassCost cost;
+            while ((reader >> index) && (reader >> cost.allocations) && (reader >> cost.bytes)) {
+                if (index >= sizeClasses.size()) {
+                    sizeClasses.resize(index + 1);
+                }
+                sizeClasses[index] = cost;
+                newAllocations += cost.allocations;
+            }
+            // no individual allocations got recorded, but the number of calls is known nevertheless
+            totalCost.allocations += newAllocations - previousAllocations;
+            countedFrees = frees;
+            break;
+        }
+        case 'u': { // allocator slack per size class, the totals so far, only written by writeAggregated
+            slackSizeClasses.clear();
+            uint32_t index = 0;
+            SlackSizeClassCost cost;
+            while ((reader >> index) && (reader >> cost.allocations) && (reader >> cost.requested)
+                   && (reader >> cost.slack)) {
+                if (index >= slackSizeClasses.size()) {
+                    slackSizeClasses.resize(index + 1);
+                }
+                slackSizeClasses[index] = cost;
+            }
+            break;
+        }
+        case 'o': { // page occupancy, see HEAPTRACK_INTERPRET_OCCUPANCY
+            if (!inFilteredTime) {
+                continue;
+            }
+            PageOccupancy occupancy;
+            occupancy.time = timeStamp;
+            int64_t pageSize = 0;
+            uint32_t numBuckets = 0;
+            if (!(reader >> pageSize) || !(reader >> numBuckets) || !numBuckets || numBuckets > 256) {
+                cerr << "Failed to read page occupancy: " << reader.line() << endl;
+                continue;
+            }
+            occupancy.pages.resize(numBuckets);
+            if (!std::all_of(occupancy.pages.begin(), occupancy.pages.end(),
+                             [&reader](int64_t& pages) { return static_cast<bool>(reader >> pages); })) {
+                cerr << "Failed to read page occupancy: " << reader.line() << endl;
+                continue;
+            }
+            occupancyPageSize = pageSize;
+            const auto pinned = occupancy.sparsePages() * pageSize;
+            if (pinned > totalCost.pinned) {
+                // the most sparse pages so far, the allocations pinning them follow
+                totalCost.pinned = pinned;
+                peakSparseTime = timeStamp;
+                if (readAllocations) {
+                    for (auto& allocation : allocations) {
+                        allocation.pinned = 0;
+                    }
+                }
+                AllocationInfoIndex allocationIndex;
+                int64_t bytes = 0;
+                while ((reader >> allocationIndex) && (reader >> bytes)) {
+                    if (!readAllocations || allocationIndex.index >= allocationInfos.size()) {
+                        continue;
+                    }
+                    const auto& info = allocationInfos[allocationIndex.index];
+                    if (!filterBySize || filterParameters.matchesSize(info.size)) {
+                        allocations[info.allocationIndex.index].pinned += bytes;
+                    }
+                }
+            }
+            pageOccupancy.push_back(std::move(occupancy));
+            break;
+        }
+        case 'X': {
             if (debuggeeEncountered) {
                 cerr << "Duplicated debuggee entry - corrupt data file?" << endl;
                 return false;
             }
             debuggeeEncountered = true;
-            if (pass != FirstPass && !isReparsing) {
+            if (pass == FirstPass && !isReparsing) {
                 handleDebuggee(reader.line().c_str() + 2);
             }
-        } else if (reader.mode() == 'A') {
-            if (pass != FirstPass || isReparsing)
+            break;
+        }
+        case 'G': { // start of the prologue of a segment
+            // when the segment is not the first file we read, its prologue got read already
+            skipSegmentPrologue = versionRecords > 1;
+            break;
+        }
+        case 'L': { // allocations that are still alive when a segment starts
+            if (!inFilteredTime) {
+                continue;
+            }
+            AllocationInfoIndex allocationIndex;
+            int64_t count = 0;
+            if (!(reader >> allocationIndex) || !(reader >> count)) {
+                cerr << "failed to parse line: " << reader.line() << endl;
+                continue;
+            } else if (allocationIndex.index >= allocationInfos.size()) {
+                cerr << "allocation index out of bounds: " << allocationIndex
+                     << ", maximum is: " << allocationInfos.size() << endl;
+                continue;
+            }
+            const auto& info = allocationInfos[allocationIndex.index];
+            if (filterBySize && !filterParameters.matchesSize(info.size)) {
                 continue;
+            }
+            // these got allocated in an earlier segment, so only their consumption is known
+            addCost(info, allocationIndex, {0, allocationCost(allocationIndex).size * count}, 0);
+            break;
+        }
+        case 'A': {
             totalCost = {};
             fromAttached = true;
-        } else if (reader.mode() == 'v') {
+            break;
+        }
+        case 'E': {
+            // the frees that follow did not get recorded, what is still alive is leaked
+            stoppedAtExit = true;
+            break;
+        }
+        case 'v': {
+            ++versionRecords;
             unsigned int heaptrackVersion = 0;
             reader >> heaptrackVersion;
             if (!(reader >> fileVersion) && heaptrackVersion == 0x010200) {
@@ -467,22 +1564,44 @@ bool AccumulatedTraceData::read(boost::iostreams::filtering_istream& in, const P
             if (fileVersion >= 3) {
                 reader.setExpectedSizedStrings(true);
             }
-        } else if (reader.mode() == 'I') { // system information
+            break;
+        }
+        case 'I': { // system information
             reader >> systemInfo.pageSize;
             reader >> systemInfo.pages;
-        } else if (reader.mode() == 'S') { // embedded suppression
-            if (pass != FirstPass || filterParameters.disableEmbeddedSuppressions) {
-                continue;
-            }
+            break;
+        }
+        case 'N': { // start time
+            reader >> startTimeNs;
+            break;
+        }
+        case 'P': { // sampling interval
+            reader >> sampleInterval;
+            break;
+        }
+        case 'S': { // embedded suppression
             auto suppression = parseSuppression(reader.line().substr(2));
             if (!suppression.empty()) {
-                suppressions.push_back({std::move(suppression), 0, 0});
+                if (!filterParameters.disableEmbeddedSuppressions) {
+                    suppressions.push_back({suppression, 0, 0});
+                }
+                embeddedSuppressions.push_back(std::move(suppression));
             }
-        } else {
+            break;
+        }
+        default:
             cerr << "failed to parse line: " << reader.line() << endl;
+            break;
         }
     }
 
+    // the allocations that are still alive at the end have no known lifetime, treat them as long lived
+    commitPendingAllocations(std::numeric_limits<int64_t>::max() - filterParameters.minLifetime);
+    finalizePeaks();
+    if (memoryBudget) {
+        enforceMemoryBudget();
+    }
+
     if (pass == FirstPass && !isReparsing) {
         totalTime = timeStamp + 1;
         filterParameters.maxTime = totalTime;
@@ -493,31 +1612,78 @@ bool AccumulatedTraceData::read(boost::iostreams::filtering_istream& in, const P
     return true;
 }
 
-namespace { // helpers for diffing
+void AccumulatedTraceData::setRecordCallback(char mode, RecordCallback callback)
+{
+    if (recordCallbacks.empty()) {
+        if (!callback) {
+            return;
+        }
+        recordCallbacks.resize(256);
+    }
+    recordCallbacks[static_cast<unsigned char>(mode)] = std::move(callback);
+}
+
+void AccumulatedTraceData::finalizePeaks()
+{
+    // allocations that did not change after the total peak still have their cost at that time
+    const auto& lastChanges = leakedChanges.lastChanges;
+    for (size_t i = 0, c = min(lastChanges.size(), allocations.size()); i < c; ++i) {
+        if (lastChanges[i] && lastChanges[i] <= leakedChanges.atPeak) {
+            allocations[i].peak = allocations[i].leaked;
+        }
+    }
+}
 
-template <typename IndexT, typename SortF>
-vector<IndexT> sortedIndices(size_t numIndices, SortF sorter)
+void AccumulatedTraceData::stopFollowing()
 {
-    vector<IndexT> indices;
-    indices.resize(numIndices);
-    for (size_t i = 0; i < numIndices; ++i) {
-        indices[i].index = (i + 1);
+    s_stopFollowing = true;
+}
+
+void AccumulatedTraceData::enforceMemoryBudget()
+{
+    static const int64_t pageSize = sysconf(_SC_PAGESIZE);
+    int64_t size = 0;
+    int64_t resident = 0;
+    ifstream statm("/proc/self/statm");
+    // when we cannot tell how much memory we use, better assume the worst
+    if ((statm >> size >> resident) && resident * pageSize <= memoryBudget) {
+        return;
     }
-    sort(indices.begin(), indices.end(), sorter);
-    return indices;
+    traces.dropResidentPages();
+    allocationInfos.dropResidentPages();
+    allocationInfoCosts.dropResidentPages();
 }
 
-vector<StringIndex> remapStrings(vector<string>& lhs, const vector<string>& rhs)
+SampledCost AccumulatedTraceData::allocationInfoCost(AllocationInfoIndex index) const
 {
-    tsl::robin_map<string, StringIndex> stringRemapping;
+    if (allocationInfoCosts.empty()) {
+        return sampledCost(allocationInfos[index.index].size, 0);
+    }
+    return allocationInfoCosts[index.index];
+}
+
+namespace { // helpers for diffing
+
+struct StringViewHasher
+{
+    size_t operator()(boost::string_view string) const
+    {
+        return boost::hash_range(string.begin(), string.end());
+    }
+};
+
+vector<StringIndex> remapStrings(StringTable& lhs, const StringTable& rhs)
+{
+    // the views stay valid while we add more strings to lhs
+    tsl::robin_map<boost::string_view, StringIndex, StringViewHasher> stringRemapping;
 
     // insert known strings in lhs into the map for lookup below
     StringIndex stringIndex;
     {
         stringRemapping.reserve(lhs.size());
-        for (const auto& string : lhs) {
+        for (size_t i = 0; i < lhs.size(); ++i) {
             ++stringIndex.index;
-            stringRemapping.insert(make_pair(string, stringIndex));
+            stringRemapping.insert(make_pair(lhs[i], stringIndex));
         }
     }
 
@@ -528,13 +1694,14 @@ vector<StringIndex> remapStrings(vector<string>& lhs, const vector<string>& rhs)
     {
         map.reserve(rhs.size() + 1);
         map.push_back({});
-        for (const auto& string : rhs) {
+        for (size_t i = 0; i < rhs.size(); ++i) {
+            const auto string = rhs[i];
             auto it = stringRemapping.find(string);
             if (it == stringRemapping.end()) {
                 // a string that only occurs in rhs, but not lhs
                 // add it to lhs to make sure we can find it again later on
                 ++stringIndex.index;
-                lhs.push_back(string);
+                lhs.add(string);
                 map.push_back(stringIndex);
             } else {
                 map.push_back(it->second);
@@ -544,53 +1711,37 @@ vector<StringIndex> remapStrings(vector<string>& lhs, const vector<string>& rhs)
     return map;
 }
 
-// replace by std::identity once we can leverage C++20
-struct identity
+/// the parts of an instruction pointer that get compared when unifying traces, i.e. all but its address
+struct IpKey
 {
-    template <typename T>
-    const T& operator()(const T& t) const
-    {
-        return t;
-    }
+    ModuleIndex moduleIndex;
+    Frame frame;
 
-    template <typename T>
-    T operator()(T&& t) const
+    bool operator==(const IpKey& rhs) const
     {
-        return std::move(t);
+        return moduleIndex == rhs.moduleIndex && frame == rhs.frame;
     }
 };
 
-template <typename IpMapper>
-int compareTraceIndices(const TraceIndex& lhs, const AccumulatedTraceData& lhsData, const TraceIndex& rhs,
-                        const AccumulatedTraceData& rhsData, IpMapper ipMapper)
+struct IpKeyHasher
 {
-    if (!lhs && !rhs) {
-        return 0;
-    } else if (lhs && !rhs) {
-        return 1;
-    } else if (rhs && !lhs) {
-        return -1;
-    } else if (&lhsData == &rhsData && lhs == rhs) {
-        // fast-path if both indices are equal and we compare the same data
-        return 0;
+    size_t operator()(const IpKey& key) const
+    {
+        return boost::hash_value(
+            std::tie(key.moduleIndex.index, key.frame.functionIndex.index, key.frame.fileIndex.index, key.frame.line));
     }
+};
 
-    const auto& lhsTrace = lhsData.findTrace(lhs);
-    const auto& rhsTrace = rhsData.findTrace(rhs);
-
-    const int parentComparsion =
-        compareTraceIndices(lhsTrace.parentIndex, lhsData, rhsTrace.parentIndex, rhsData, ipMapper);
-    if (parentComparsion != 0) {
-        return parentComparsion;
-    } // else fall-through to below, parents are equal
+/// a trace is identified by its unified parent trace and its unified instruction pointer
+using TraceKey = pair<TraceIndex, IpIndex>;
 
-    const auto& lhsIp = lhsData.findIp(lhsTrace.ipIndex);
-    const auto& rhsIp = ipMapper(rhsData.findIp(rhsTrace.ipIndex));
-    if (lhsIp.equalWithoutAddress(rhsIp)) {
-        return 0;
+struct TraceKeyHasher
+{
+    size_t operator()(const TraceKey& key) const
+    {
+        return boost::hash_value(std::tie(key.first.index, key.second.index));
     }
-    return lhsIp.compareWithoutAddress(rhsIp) ? -1 : 1;
-}
+};
 
 POTENTIALLY_UNUSED void printCost(const AllocationData& data)
 {
@@ -613,23 +1764,6 @@ POTENTIALLY_UNUSED void printTrace(const AccumulatedTraceData& data, TraceIndex
     } while (index);
     cerr << "---\n";
 }
-
-template <class ForwardIt, class BinaryPredicateCompare, class BinaryOpReduce>
-ForwardIt inplace_unique_reduce(ForwardIt first, ForwardIt last, BinaryPredicateCompare cmp, BinaryOpReduce reduce)
-{
-    if (first == last)
-        return last;
-
-    ForwardIt result = first;
-    while (++first != last) {
-        if (cmp(*result, *first)) {
-            reduce(*result, *first);
-        } else if (++result != first) {
-            *result = std::move(*first);
-        }
-    }
-    return ++result;
-}
 }
 
 void AccumulatedTraceData::diff(const AccumulatedTraceData& base)
@@ -637,173 +1771,399 @@ void AccumulatedTraceData::diff(const AccumulatedTraceData& base)
     totalCost -= base.totalCost;
     totalTime -= base.totalTime;
     peakRSS -= base.peakRSS;
+    tracerOverhead -= base.tracerOverhead;
     systemInfo.pages -= base.systemInfo.pages;
     systemInfo.pageSize -= base.systemInfo.pageSize;
 
-    // step 1: sort allocations for efficient lookup and to prepare for merging equal allocations
+    combine(base, [](Allocation& lhs, const Allocation& rhs) { lhs -= rhs; });
 
-    std::sort(allocations.begin(), allocations.end(), [this](const Allocation& lhs, const Allocation& rhs) {
-        return compareTraceIndices(lhs.traceIndex, *this, rhs.traceIndex, *this, identity {}) < 0;
-    });
+    // remove allocations that don't show any differences
+    // note that when there are differences in the backtraces,
+    // we can still end up with merged backtraces that have a total
+    // of 0, but different "tails" of different origin with non-zero cost
+    allocations.erase(remove_if(allocations.begin(), allocations.end(),
+                                [&](const Allocation& allocation) -> bool { return allocation == AllocationData(); }),
+                      allocations.end());
+}
 
-    // step 2: now merge equal allocations
+void AccumulatedTraceData::merge(const AccumulatedTraceData& other)
+{
+    totalCost += other.totalCost;
+    // the recordings ran concurrently, e.g. on different hosts
+    totalTime = max(totalTime, other.totalTime);
+    peakTime = max(peakTime, other.peakTime);
+    peakRSS += other.peakRSS;
+    tracerOverhead += other.tracerOverhead;
+    if (sizeClasses.size() < other.sizeClasses.size()) {
+        sizeClasses.resize(other.sizeClasses.size());
+    }
+    for (size_t i = 0; i < other.sizeClasses.size(); ++i) {
+        sizeClasses[i].allocations += other.sizeClasses[i].allocations;
+        sizeClasses[i].bytes += other.sizeClasses[i].bytes;
+    }
+    if (slackSizeClasses.size() < other.slackSizeClasses.size()) {
+        slackSizeClasses.resize(other.slackSizeClasses.size());
+    }
+    for (size_t i = 0; i < other.slackSizeClasses.size(); ++i) {
+        slackSizeClasses[i].allocations += other.slackSizeClasses[i].allocations;
+        slackSizeClasses[i].requested += other.slackSizeClasses[i].requested;
+        slackSizeClasses[i].slack += other.slackSizeClasses[i].slack;
+    }
+    peakSlack += other.peakSlack;
+    if (!occupancyPageSize) {
+        occupancyPageSize = other.occupancyPageSize;
+    }
+    countedFrees += other.countedFrees;
+    systemInfo.pages += other.systemInfo.pages;
+    if (!systemInfo.pageSize) {
+        systemInfo.pageSize = other.systemInfo.pageSize;
+    }
+    sampleInterval = max(sampleInterval, other.sampleInterval);
+    fromAttached = fromAttached || other.fromAttached;
+    stoppedAtExit = stoppedAtExit || other.stoppedAtExit;
 
-    allocations.erase(inplace_unique_reduce(
-                          allocations.begin(), allocations.end(),
-                          [this](const Allocation& lhs, const Allocation& rhs) {
-                              return compareTraceIndices(lhs.traceIndex, *this, rhs.traceIndex, *this, identity {})
-                                  == 0;
-                          },
-                          [](Allocation& lhs, const Allocation& rhs) { lhs += rhs; }),
-                      allocations.end());
+    const auto stringMap = combine(other, [](Allocation& lhs, const Allocation& rhs) { lhs += rhs; });
 
-    // step 3: map string indices from rhs to lhs data
+    for (auto thread : other.threads) {
+        if (thread.name) {
+            thread.name = stringMap[thread.name.index];
+        }
+        threads.push_back(thread);
+    }
+    pools.insert(pools.end(), other.pools.begin(), other.pools.end());
 
-    const auto& stringMap = remapStrings(strings, base.strings);
-    auto remapString = [&stringMap](StringIndex& index) {
-        if (index) {
-            index.index = stringMap[index.index].index;
+    for (const auto& suppression : other.suppressions) {
+        auto it = find_if(suppressions.begin(), suppressions.end(),
+                          [&](const Suppression& known) { return known.pattern == suppression.pattern; });
+        if (it == suppressions.end()) {
+            suppressions.push_back(suppression);
+        } else {
+            it->matches += suppression.matches;
+            it->leaked += suppression.leaked;
         }
+    }
+}
+
+bool AccumulatedTraceData::writeAggregated(const string& outputFile, const string& debuggee) const
+{
+    const bool isZstdCompressed = boost::algorithm::ends_with(outputFile, ".zst");
+    const bool isGzCompressed = boost::algorithm::ends_with(outputFile, ".gz");
+#if !ZSTD_FOUND
+    if (isZstdCompressed) {
+        cerr << "Heaptrack was built without zstd support, cannot compress data file: " << outputFile << endl;
+        return false;
+    }
+#endif
+
+    ofstream file(outputFile, ios_base::out | ios_base::binary | ios_base::trunc);
+    if (!file.is_open()) {
+        cerr << "Failed to open output file: " << outputFile << endl;
+        return false;
+    }
+
+    boost::iostreams::filtering_ostream out;
+    if (isGzCompressed) {
+        out.push(boost::iostreams::gzip_compressor());
+    } else if (isZstdCompressed) {
+#if ZSTD_FOUND
+        out.push(boost::iostreams::zstd_compressor());
+#endif
+    }
+    out.push(file);
+
+    out << hex;
+    out << "v " << HEAPTRACK_VERSION << ' ' << HEAPTRACK_FILE_FORMAT_VERSION << '\n';
+    out << "X " << debuggee << '\n';
+    if (systemInfo.pageSize) {
+        out << "I " << systemInfo.pageSize << ' ' << systemInfo.pages << '\n';
+    }
+    if (sampleInterval) {
+        // the costs got extrapolated already, this only keeps the results flagged as being sampled
+        out << "P " << sampleInterval << '\n';
+    }
+
+    for (size_t i = 0; i < strings.size(); ++i) {
+        const auto string = strings[i];
+        out << "s " << string.size() << ' ' << string << '\n';
+    }
+
+    auto writeFrame = [&out](const Frame& frame) {
+        out << ' ' << frame.functionIndex.index << ' ' << frame.fileIndex.index << ' ' << frame.line;
     };
-    auto remapFrame = [&remapString](Frame frame) -> Frame {
-        remapString(frame.functionIndex);
-        remapString(frame.fileIndex);
-        return frame;
+    for (size_t i = 0; i < instructionPointers.size(); ++i) {
+        const auto ip = instructionPointers[i];
+        out << "i " << ip.instructionPointer << ' ' << ip.moduleIndex.index;
+        if (ip.frame.functionIndex) {
+            writeFrame(ip.frame);
+            for (const auto& inlined : ip.inlined) {
+                writeFrame(inlined);
+            }
+        }
+        out << '\n';
+    }
+
+    for (size_t i = 0; i < traces.size(); ++i) {
+        const auto& trace = traces[i];
+        out << "t " << trace.ipIndex.index << ' ' << trace.parentIndex.index << '\n';
+    }
+
+    // the cost of each trace at the total peak, and everything that got allocated until the end
+    // in a second snapshot, such that reading it back yields the same peak and leaked costs
+    auto writeSnapshot = [&out](TraceIndex trace, int64_t allocations, int64_t temporary, int64_t allocated,
+                                int64_t freed) {
+        out << "d " << trace.index << ' ' << allocations << " 0 " << temporary << ' ' << allocated << ' ' << freed;
     };
-    auto remapIp = [&remapString, &remapFrame](InstructionPointer ip) -> InstructionPointer {
-        remapString(ip.moduleIndex);
-        ip.frame = remapFrame(ip.frame);
-        for (auto& inlined : ip.inlined) {
-            inlined = remapFrame(inlined);
+    // the page occupancy without the allocations on the sparse pages, their pinned cost is part of the snapshots
+    auto occupancy = pageOccupancy.begin();
+    auto writeOccupancy = [&out, &occupancy, this](int64_t until) {
+        for (; occupancy != pageOccupancy.end() && occupancy->time < until; ++occupancy) {
+            out << "c " << occupancy->time << '\n';
+            out << "o " << occupancyPageSize << ' ' << occupancy->pages.size();
+            for (const auto pages : occupancy->pages) {
+                out << ' ' << pages;
+            }
+            out << '\n';
         }
-        return ip;
     };
+    writeOccupancy(peakTime);
+    out << "c " << peakTime << '\n';
+    for (const auto& allocation : allocations) {
+        writeSnapshot(allocation.traceIndex, allocation.allocations, allocation.temporary,
+                      max<int64_t>(0, allocation.peak), 0);
+        out << '\n';
+    }
+    out << "D " << max<int64_t>(0, totalCost.peak);
+    if (peakSlack || totalCost.peakMapped) {
+        out << ' ' << peakSlack << ' ' << totalCost.peakMapped;
+    }
+    out << '\n';
+    writeOccupancy(std::numeric_limits<int64_t>::max());
+    out << "c " << max(peakTime, totalTime - 1) << '\n';
+    for (const auto& allocation : allocations) {
+        const auto peak = max<int64_t>(0, allocation.peak);
+        const auto leaked = max<int64_t>(0, allocation.leaked);
+        const bool hasOtherCosts = allocation.growths || allocation.copied || allocation.slack
+            || allocation.remoteFrees || allocation.pinned;
+        if (leaked == peak && !hasOtherCosts) {
+            continue;
+        }
+        writeSnapshot(allocation.traceIndex, 0, 0, max<int64_t>(0, leaked - peak), max<int64_t>(0, peak - leaked));
+        if (hasOtherCosts) {
+            out << ' ' << allocation.growths << ' ' << allocation.copied << ' ' << allocation.slack << ' '
+                << allocation.remoteFrees << ' ' << allocation.pinned;
+        }
+        out << '\n';
+    }
+    // first map the peak of each trace and unmap it again, such that the total never exceeds its peak of the 'D'
+    // record, then map what is still mapped at the end
+    for (const auto& allocation : allocations) {
+        if (allocation.peakMapped > 0) {
+            out << "k " << allocation.peakMapped << ' ' << allocation.traceIndex.index << '\n';
+            out << "K " << allocation.peakMapped << ' ' << allocation.traceIndex.index << '\n';
+        }
+    }
+    for (const auto& allocation : allocations) {
+        if (allocation.mapped > 0) {
+            out << "k " << allocation.mapped << ' ' << allocation.traceIndex.index << '\n';
+        }
+    }
+    if (peakRSS) {
+        out << "R " << peakRSS << '\n';
+    }
+    if (tracerOverhead.events) {
+        const auto& overhead = tracerOverhead;
+        out << "O " << overhead.events << ' ' << overhead.unwindNs << ' ' << overhead.lockSpins << ' '
+            << overhead.lockWaitNs << ' ' << overhead.flushes << ' ' << overhead.flushedBytes << ' '
+            << overhead.blockedWriteNs << '\n';
+    }
+    if (!sizeClasses.empty()) {
+        out << "Z " << countedFrees;
+        for (size_t i = 0; i < sizeClasses.size(); ++i) {
+            if (sizeClasses[i].allocations) {
+                out << ' ' << i << ' ' << sizeClasses[i].allocations << ' ' << sizeClasses[i].bytes;
+            }
+        }
+        out << '\n';
+    }
+    if (!slackSizeClasses.empty()) {
+        out << 'u';
+        for (size_t i = 0; i < slackSizeClasses.size(); ++i) {
+            const auto& sizeClass = slackSizeClasses[i];
+            if (sizeClass.allocations) {
+                out << ' ' << i << ' ' << sizeClass.allocations << ' ' << sizeClass.requested << ' '
+                    << sizeClass.slack;
+            }
+        }
+        out << '\n';
+    }
+
+    out.reset();
+    if (!file) {
+        cerr << "Failed to write output file: " << outputFile << endl;
+        return false;
+    }
+    return true;
+}
 
-    // step 4: iterate over rhs data and find matching traces
-    //         if no match is found, copy the data over
+vector<StringIndex> AccumulatedTraceData::combine(const AccumulatedTraceData& base,
+                                                  const function<void(Allocation&, const Allocation&)>& reduce)
+{
+    // everything gets unified through hashed keys in linear passes, a trace is equal to another one when
+    // both have equal parents and instruction pointers that only differ in their address
+
+    // step 1: unify our instruction pointers, the first one of each key represents all of them
+
+    tsl::robin_map<IpKey, IpIndex, IpKeyHasher> ipIds;
+    ipIds.reserve(instructionPointers.size());
+    vector<IpIndex> ipMap(instructionPointers.size() + 1);
+    for (size_t i = 1; i < ipMap.size(); ++i) {
+        IpIndex ipIndex;
+        ipIndex.index = i;
+        const auto ip = findIp(ipIndex);
+        ipMap[i] = ipIds.insert({{ip.moduleIndex, ip.frame}, ipIndex}).first->second;
+    }
 
-    auto sortedIps = sortedIndices<IpIndex>(instructionPointers.size(), [this](const IpIndex& lhs, const IpIndex& rhs) {
-        return findIp(lhs).compareWithoutAddress(findIp(rhs));
-    });
+    // step 2: unify our traces, the parents are usually known already as they precede their children
 
-    // map an IpIndex from the rhs data into the lhs data space, or copy the data
-    // if it does not exist yet
-    auto remapIpIndex = [&sortedIps, this, &base, &remapIp](IpIndex rhsIndex) -> IpIndex {
-        if (!rhsIndex) {
-            return rhsIndex;
+    tsl::robin_map<TraceKey, TraceIndex, TraceKeyHasher> traceIds;
+    traceIds.reserve(traces.size());
+    vector<TraceIndex> traceMap(traces.size() + 1);
+    function<TraceIndex(TraceIndex)> unifyTrace = [this, &ipMap, &traceIds, &traceMap,
+                                                   &unifyTrace](TraceIndex index) -> TraceIndex {
+        if (!index || index.index >= traceMap.size() || traceMap[index.index]) {
+            return index.index < traceMap.size() ? traceMap[index.index] : TraceIndex();
         }
+        const auto trace = findTrace(index);
+        const auto ipIndex = trace.ipIndex.index < ipMap.size() ? ipMap[trace.ipIndex.index] : IpIndex();
+        const TraceKey key = {unifyTrace(trace.parentIndex), ipIndex};
+        traceMap[index.index] = traceIds.insert({key, index}).first->second;
+        return traceMap[index.index];
+    };
+
+    // step 3: merge our allocations of equal traces, keeping the order in which they occur first
+
+    ScratchVector<Allocation> merged;
+    merged.reserve(allocations.size());
+    tsl::robin_map<TraceIndex, size_t, IndexHasher> allocationIds;
+    allocationIds.reserve(allocations.size());
+    auto findAllocation = [&merged, &allocationIds](TraceIndex traceIndex) -> Allocation& {
+        auto it = allocationIds.insert({traceIndex, merged.size()}).first;
+        if (it->second == merged.size()) {
+            Allocation allocation;
+            allocation.traceIndex = traceIndex;
+            merged.push_back(allocation);
+        }
+        return merged[it->second];
+    };
+    for (const auto& allocation : allocations) {
+        findAllocation(unifyTrace(allocation.traceIndex)) += allocation;
+    }
 
-        const auto& rhsIp = base.findIp(rhsIndex);
-        const auto& lhsIp = remapIp(rhsIp);
+    // step 4: map string indices from rhs to lhs data
 
-        auto it = lower_bound(sortedIps.begin(), sortedIps.end(), lhsIp,
-                              [this](const IpIndex& lhs, const InstructionPointer& rhs) {
-                                  return findIp(lhs).compareWithoutAddress(rhs);
-                              });
-        if (it != sortedIps.end() && findIp(*it).equalWithoutAddress(lhsIp)) {
-            return *it;
+    const auto stringMap = remapStrings(strings, base.strings);
+    auto remapString = [&stringMap](StringIndex& index) {
+        if (index) {
+            index.index = stringMap[index.index].index;
         }
+    };
+    auto remapFrame = [&remapString](Frame frame) -> Frame {
+        remapString(frame.functionIndex);
+        remapString(frame.fileIndex);
+        return frame;
+    };
 
-        instructionPointers.push_back(lhsIp);
+    // step 5: map the instruction pointers and traces of rhs into our data through the same keys,
+    //         copying the ones we do not know yet
 
-        IpIndex ret;
-        ret.index = instructionPointers.size();
-        sortedIps.insert(it, ret);
+    vector<IpIndex> rhsIpMap(base.instructionPointers.size() + 1);
+    auto remapIpIndex = [this, &base, &ipIds, &rhsIpMap, &remapString, &remapFrame](IpIndex rhsIndex) -> IpIndex {
+        if (!rhsIndex || rhsIndex.index >= rhsIpMap.size()) {
+            return {};
+        }
+        auto& mapped = rhsIpMap[rhsIndex.index];
+        if (mapped) {
+            return mapped;
+        }
 
-        return ret;
+        const auto rhsIp = base.findIp(rhsIndex);
+        IpKey key = {rhsIp.moduleIndex, remapFrame(rhsIp.frame)};
+        remapString(key.moduleIndex);
+        auto it = ipIds.find(key);
+        if (it != ipIds.end()) {
+            mapped = it->second;
+        } else {
+            mapped = instructionPointers.add(rhsIp.instructionPointer, key.moduleIndex, key.frame);
+            for (const auto& inlined : rhsIp.inlined) {
+                instructionPointers.addInlined(remapFrame(inlined));
+            }
+            ipIds.insert({key, mapped});
+        }
+        return mapped;
     };
 
-    // copy the rhs trace index and the data it references into the lhs data,
-    // recursively
-    function<TraceIndex(TraceIndex)> copyTrace = [this, &base, remapIpIndex,
-                                                  &copyTrace](TraceIndex rhsIndex) -> TraceIndex {
-        if (!rhsIndex) {
-            return rhsIndex;
+    vector<TraceIndex> rhsTraceMap(base.traces.size() + 1);
+    function<TraceIndex(TraceIndex)> remapTrace = [this, &base, &traceIds, &rhsTraceMap, &remapIpIndex,
+                                                   &remapTrace](TraceIndex rhsIndex) -> TraceIndex {
+        if (!rhsIndex || rhsIndex.index >= rhsTraceMap.size()) {
+            return {};
+        }
+        if (rhsTraceMap[rhsIndex.index]) {
+            return rhsTraceMap[rhsIndex.index];
         }
 
-        // new location, add it
         const auto& rhsTrace = base.findTrace(rhsIndex);
-
-        TraceNode node;
-        node.parentIndex = copyTrace(rhsTrace.parentIndex);
-        node.ipIndex = remapIpIndex(rhsTrace.ipIndex);
-
-        traces.push_back(node);
-        TraceIndex ret;
-        ret.index = traces.size();
-
-        return ret;
+        const TraceKey key = {remapTrace(rhsTrace.parentIndex), remapIpIndex(rhsTrace.ipIndex)};
+        auto it = traceIds.find(key);
+        TraceIndex mapped;
+        if (it != traceIds.end()) {
+            mapped = it->second;
+        } else {
+            // new location, add it
+            TraceNode node;
+            node.parentIndex = key.first;
+            node.ipIndex = key.second;
+            traces.push_back(node);
+            mapped.index = traces.size();
+            traceIds.insert({key, mapped});
+        }
+        rhsTraceMap[rhsIndex.index] = mapped;
+        return mapped;
     };
 
-    // find an equivalent trace or copy the data over if it does not exist yet
-    // a trace is equivalent if the complete backtrace has equal InstructionPointer
-    // data while ignoring the actual pointer address
     for (const auto& rhsAllocation : base.allocations) {
-
         assert(rhsAllocation.traceIndex);
-        auto it = lower_bound(allocations.begin(), allocations.end(), rhsAllocation.traceIndex,
-                              [&base, this, remapIp](const Allocation& lhs, const TraceIndex& rhs) -> bool {
-                                  return compareTraceIndices(lhs.traceIndex, *this, rhs, base, remapIp) < 0;
-                              });
-
-        if (it == allocations.end()
-            || compareTraceIndices(it->traceIndex, *this, rhsAllocation.traceIndex, base, remapIp) != 0) {
-            Allocation lhsAllocation;
-            lhsAllocation.traceIndex = copyTrace(rhsAllocation.traceIndex);
-            it = allocations.insert(it, lhsAllocation);
-        }
-
-        (*it) -= rhsAllocation;
+        reduce(findAllocation(remapTrace(rhsAllocation.traceIndex)), rhsAllocation);
     }
+    allocations = std::move(merged);
 
-    // step 5: remove allocations that don't show any differences
-    //         note that when there are differences in the backtraces,
-    //         we can still end up with merged backtraces that have a total
-    //         of 0, but different "tails" of different origin with non-zero cost
-    allocations.erase(remove_if(allocations.begin(), allocations.end(),
-                                [&](const Allocation& allocation) -> bool { return allocation == AllocationData(); }),
-                      allocations.end());
+    return stringMap;
 }
 
 AllocationIndex AccumulatedTraceData::mapToAllocationIndex(const TraceIndex traceIndex)
 {
-    AllocationIndex allocationIndex;
-    if (traceIndex < m_maxAllocationTraceIndex) {
-        // only need to search when the trace index is previously known
-        auto it = lower_bound(traceIndexToAllocationIndex.begin(), traceIndexToAllocationIndex.end(), traceIndex,
-                              [](const pair<TraceIndex, AllocationIndex>& indexMap,
-                                 const TraceIndex traceIndex) -> bool { return indexMap.first < traceIndex; });
-        if (it != traceIndexToAllocationIndex.end() && it->first == traceIndex) {
-            return it->second;
-        }
-        // new allocation
-        allocationIndex.index = allocations.size();
-        traceIndexToAllocationIndex.insert(it, make_pair(traceIndex, allocationIndex));
-        Allocation allocation;
-        allocation.traceIndex = traceIndex;
-        allocations.push_back(allocation);
-    } else if (traceIndex == m_maxAllocationTraceIndex && !allocations.empty()) {
-        // reuse the last allocation
-        assert(allocations[m_maxAllocationIndex.index].traceIndex == traceIndex);
-        allocationIndex = m_maxAllocationIndex;
-    } else {
+    if (traceIndex.index >= traceIndexToAllocationIndex.size()) {
+        traceIndexToAllocationIndex.resize(max<size_t>(traceIndex.index + 1, traceIndexToAllocationIndex.size() * 2));
+    }
+
+    auto& mapped = traceIndexToAllocationIndex[traceIndex.index];
+    if (!mapped) {
         // new allocation
-        allocationIndex.index = allocations.size();
-        traceIndexToAllocationIndex.push_back(make_pair(traceIndex, allocationIndex));
         Allocation allocation;
         allocation.traceIndex = traceIndex;
-        m_maxAllocationIndex.index = allocations.size();
         allocations.push_back(allocation);
-        m_maxAllocationTraceIndex = traceIndex;
+        mapped = allocations.size();
     }
+
+    AllocationIndex allocationIndex;
+    allocationIndex.index = mapped - 1;
     return allocationIndex;
 }
 
-const InstructionPointer& AccumulatedTraceData::findIp(const IpIndex ipIndex) const
+InstructionPointer AccumulatedTraceData::findIp(const IpIndex ipIndex) const
 {
-    static const InstructionPointer invalid;
     if (!ipIndex || ipIndex.index > instructionPointers.size()) {
-        return invalid;
+        return {};
     } else {
         return instructionPointers[ipIndex.index - 1];
     }
@@ -850,18 +2210,15 @@ void AccumulatedTraceData::applyLeakSuppressions()
 
     // match all strings once against all suppression rules
     bool hasAnyMatch = false;
+    SuppressionMatcher matcher(suppressions);
     std::vector<SuppressionStringMatch> suppressedStrings(strings.size());
-    std::transform(strings.begin(), strings.end(), suppressedStrings.begin(), [&](const auto& string) {
-        auto it = std::find_if(suppressions.begin(), suppressions.end(), [&string](const Suppression& suppression) {
-            return matchesSuppression(suppression.pattern, string);
-        });
-        if (it == suppressions.end()) {
-            return SuppressionStringMatch();
-        } else {
+    for (size_t i = 0; i < suppressedStrings.size(); ++i) {
+        const auto match = matcher.match(strings[i]);
+        if (match != SuppressionMatcher::NO_MATCH) {
             hasAnyMatch = true;
-            return SuppressionStringMatch(static_cast<std::size_t>(std::distance(suppressions.begin(), it)));
+            suppressedStrings[i] = SuppressionStringMatch(match);
         }
-    });
+    }
     if (!hasAnyMatch) {
         // nothing matched the suppressions, we can return early
         return;
@@ -883,8 +2240,7 @@ void AccumulatedTraceData::applyLeakSuppressions()
     };
 
     // now match all instruction pointers against the suppressed strings
-    std::vector<SuppressionStringMatch> suppressedIps(instructionPointers.size());
-    std::transform(instructionPointers.begin(), instructionPointers.end(), suppressedIps.begin(), [&](const auto& ip) {
+    auto isSuppressedInstructionPointer = [&](const InstructionPointer& ip) {
         auto match = isSuppressedString(ip.moduleIndex);
         if (match) {
             return match;
@@ -900,7 +2256,11 @@ void AccumulatedTraceData::applyLeakSuppressions()
             }
         }
         return SuppressionStringMatch();
-    });
+    };
+    std::vector<SuppressionStringMatch> suppressedIps(instructionPointers.size());
+    for (size_t i = 0; i < suppressedIps.size(); ++i) {
+        suppressedIps[i] = isSuppressedInstructionPointer(instructionPointers[i]);
+    }
     suppressedStrings = {};
     auto isSuppressedIp = [&suppressedIps](IpIndex index) {
         if (index && index.index <= suppressedIps.size()) {
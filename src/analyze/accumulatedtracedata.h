@@ -7,7 +7,9 @@
 #ifndef ACCUMULATEDTRACEDATA_H
 #define ACCUMULATEDTRACEDATA_H
 
+#include <functional>
 #include <iosfwd>
+#include <memory>
 #include <tuple>
 #include <vector>
 
@@ -17,6 +19,8 @@
 
 #include "allocationdata.h"
 #include "filterparameters.h"
+#include "scratchvector.h"
+#include "stringtable.h"
 #include "util/indices.h"
 
 struct Frame
@@ -36,12 +40,43 @@ struct Frame
     }
 };
 
+/**
+ * A range of inlined frames, pointing into the pool of AccumulatedTraceData::instructionPointers.
+ *
+ * It stays valid until new instruction pointers get added.
+ */
+struct InlinedFrames
+{
+    const Frame* first = nullptr;
+    const Frame* last = nullptr;
+
+    const Frame* begin() const
+    {
+        return first;
+    }
+
+    const Frame* end() const
+    {
+        return last;
+    }
+
+    bool empty() const
+    {
+        return first == last;
+    }
+
+    size_t size() const
+    {
+        return last - first;
+    }
+};
+
 struct InstructionPointer
 {
     uint64_t instructionPointer = 0;
     ModuleIndex moduleIndex;
     Frame frame;
-    std::vector<Frame> inlined;
+    InlinedFrames inlined;
 
     bool compareWithoutAddress(const InstructionPointer& other) const
     {
@@ -54,6 +89,66 @@ struct InstructionPointer
     }
 };
 
+/**
+ * Storage for all instruction pointers of a data file.
+ *
+ * The fields are kept in separate arrays so that walking traces only touches the modules and
+ * frames, and the inlined frames of all instruction pointers share a single pool.
+ */
+class InstructionPointers
+{
+public:
+    void reserve(size_t size)
+    {
+        m_addresses.reserve(size);
+        m_modules.reserve(size);
+        m_frames.reserve(size);
+        m_inlinedEnd.reserve(size);
+    }
+
+    size_t size() const
+    {
+        return m_addresses.size();
+    }
+
+    /// append a new instruction pointer and return its index
+    IpIndex add(uint64_t address, ModuleIndex moduleIndex, Frame frame)
+    {
+        m_addresses.push_back(address);
+        m_modules.push_back(moduleIndex);
+        m_frames.push_back(frame);
+        m_inlinedEnd.push_back(m_inlined.size());
+        IpIndex index;
+        index.index = m_addresses.size();
+        return index;
+    }
+
+    /// append an inlined frame to the instruction pointer that was added last
+    void addInlined(Frame frame)
+    {
+        m_inlined.push_back(frame);
+        m_inlinedEnd.back() = m_inlined.size();
+    }
+
+    /// @p index is zero based, unlike IpIndex
+    InstructionPointer operator[](size_t index) const
+    {
+        const auto inlinedBegin = index ? m_inlinedEnd[index - 1] : 0;
+        return {m_addresses[index],
+                m_modules[index],
+                m_frames[index],
+                {m_inlined.data() + inlinedBegin, m_inlined.data() + m_inlinedEnd[index]}};
+    }
+
+private:
+    std::vector<uint64_t> m_addresses;
+    std::vector<ModuleIndex> m_modules;
+    std::vector<Frame> m_frames;
+    // end offset into m_inlined for each instruction pointer, the begin is the end of the previous one
+    std::vector<uint32_t> m_inlinedEnd;
+    std::vector<Frame> m_inlined;
+};
+
 struct TraceNode
 {
     IpIndex ipIndex;
@@ -74,13 +169,51 @@ struct AllocationInfo
     uint64_t size = 0;
     // index into AccumulatedTraceData::allocations
     AllocationIndex allocationIndex;
+    // the allocating thread, see AccumulatedTraceData::threads, or zero when threads were not tracked
+    ThreadIndex thread;
+    // the pool it got allocated from, see AccumulatedTraceData::pools, or zero for plain allocations
+    PoolIndex pool;
     bool operator==(const AllocationInfo& rhs) const
     {
-        return rhs.allocationIndex == allocationIndex && rhs.size == size;
+        return rhs.allocationIndex == allocationIndex && rhs.size == size && rhs.thread == thread
+            && rhs.pool == pool;
     }
 };
 
+/**
+ * A thread of the debuggee, only recorded with HEAPTRACK_TRACK_THREADS.
+ */
+struct ThreadInfo
+{
+    uint64_t tid = 0;
+    StringIndex name;
+    // the allocations of this thread, where peak is the largest amount of memory allocated by it at any time
+    AllocationData cost;
+};
+
+/**
+ * A memory pool of the debuggee, reported via heaptrack_pool_malloc.
+ */
+struct PoolInfo
+{
+    // the opaque handle the debuggee passed for the pool
+    uint64_t handle = 0;
+    // the allocations out of this pool, where peak is the largest amount of memory allocated from it at any time
+    AllocationData cost;
+};
+
+/**
+ * The cost a single recorded allocation stands for, which is extrapolated when allocations got sampled.
+ */
+struct SampledCost
+{
+    int64_t allocations;
+    int64_t size;
+};
+
 struct Suppression;
+struct DecompressedCache;
+struct UsableSizes;
 
 struct AccumulatedTraceData
 {
@@ -89,37 +222,184 @@ struct AccumulatedTraceData
 
     enum ParsePass
     {
-        // find time of total peak cost
+        // parse the traces and the individual allocations, including their cost at the time of the total peak
         FirstPass,
-        // parse individual allocations
-        SecondPass,
         // GUI only: graph-building
-        ThirdPass
+        SecondPass
     };
 
     virtual void handleTimeStamp(int64_t oldStamp, int64_t newStamp, bool isFinalTimeStamp, const ParsePass pass) = 0;
     virtual void handleAllocation(const AllocationInfo& info, const AllocationInfoIndex index) = 0;
+    /// called for @p count allocations of the same allocation info at once, see HEAPTRACK_INTERPRET_AGGREGATE
+    virtual void handleAllocations(const AllocationInfo& info, const AllocationInfoIndex index, int64_t count)
+    {
+        for (int64_t i = 0; i < count; ++i) {
+            handleAllocation(info, index);
+        }
+    }
     virtual void handleDebuggee(const char* command) = 0;
+    /// called when an allocation got freed, with its @p lifetime in milliseconds or -1 when the data file lacks it
+    virtual void handleDeallocation(const AllocationInfo& /*info*/, const AllocationInfoIndex /*index*/,
+                                    int64_t /*lifetime*/)
+    {
+    }
+    /// called whenever the leaked cost of an allocation changed, e.g. to update snapshots incrementally
+    virtual void handleLeakedChange(const AllocationIndex /*index*/) {}
+    /// called for every RSS sample in the filtered time range, with the @p rss in pages
+    virtual void handleRss(int64_t /*rss*/) {}
+    /// called regularly while following the input, see followInterval
+    virtual void handleFollowUpdate() {}
+
+    enum
+    {
+        // the lifetimes in the data files are stored with 32bit
+        NumLifetimeBuckets = 33
+    };
+    /// the log2 bucket of @p lifetime: zero for lifetimes below 1ms, n for lifetimes from 2^(n-1) to 2^n ms
+    static uint32_t lifetimeBucket(uint32_t lifetime)
+    {
+        return lifetime ? 32 - __builtin_clz(lifetime) : 0;
+    }
 
-    const std::string& stringify(const StringIndex stringId) const;
+    boost::string_view stringify(const StringIndex stringId) const;
 
-    std::string prettyFunction(const std::string& function) const;
+    /**
+     * @return the name of @p function, without its template arguments when shortenTemplates is set
+     *
+     * The shortened names get cached, so this must not be called from multiple threads at once.
+     */
+    boost::string_view prettyFunction(FunctionIndex function) const;
+
+    /**
+     * Position of a time stamp record in the uncompressed data, see timeIndex.
+     */
+    struct TimeIndexEntry
+    {
+        // offset of the 'c' record
+        uint64_t offset = 0;
+        // the time stamp before and the one of that record
+        int64_t previousTimeStamp = 0;
+        int64_t timeStamp = 0;
+    };
 
     bool read(const std::string& inputFile, bool isReparsing);
     bool read(const std::string& inputFile, const ParsePass pass, bool isReparsing);
-    bool read(boost::iostreams::filtering_istream& in, const ParsePass pass, bool isReparsing);
+    /**
+     * When @p resume is given, @p in must start at the offset of that entry in the uncompressed data
+     */
+    bool read(boost::iostreams::filtering_istream& in, const ParsePass pass, bool isReparsing,
+              const TimeIndexEntry* resume = nullptr);
 
     void diff(const AccumulatedTraceData& base);
 
+    /**
+     * Add the costs of @p other, e.g. the recording of the same application on another host.
+     *
+     * Like for diff, traces get unified by the symbols of their frames, ignoring the instruction
+     * pointer addresses. The time line does not get merged, only the totals and the peaks.
+     */
+    void merge(const AccumulatedTraceData& other);
+
+    /**
+     * Write the accumulated costs as a compact heaptrack data file, compressed according to
+     * the extension of @p outputFile.
+     *
+     * Only the aggregated costs per trace get written, not the individual allocations nor the threads.
+     * The costs that the 'd' snapshots don't cover get appended to them, see the 'D', 'k', 'o' and 'u' records.
+     */
+    bool writeAggregated(const std::string& outputFile, const std::string& debuggee) const;
+
+    /**
+     * Stop following the input, see followInterval. This is async-signal-safe.
+     */
+    static void stopFollowing();
+
+    /**
+     * Keep reading at the end of the input file when this is set, e.g. for the growing
+     * data file of a running recording or a named pipe that gets fed by heaptrack_interpret.
+     *
+     * Reading then only finishes when the pipe gets closed or stopFollowing() is called.
+     * Until then, handleFollowUpdate() gets called at most every followInterval ms when
+     * new data got parsed, with the costs being up to date.
+     */
+    int64_t followInterval = 0;
+
+    /**
+     * The segments of a recording split up by heaptrack_interpret, see HEAPTRACK_SEGMENT_OUTPUT,
+     * that get read after the input file as if they were a single file.
+     *
+     * Every segment can be read on its own. When one follows the previous segment, its prologue
+     * with the data that got read already is skipped. This doesn't work together with following.
+     */
+    std::vector<std::string> segments;
+
+    /**
+     * Limit for the resident memory while reading, in bytes, or zero for no limit.
+     *
+     * When set, the tables that grow with the number of records, i.e. traces and allocationInfos,
+     * get stored in unlinked scratch files in scratchDirectory instead of on the heap. Unlike heap
+     * memory, the kernel can evict their pages under memory pressure, and they get dropped
+     * explicitly whenever the resident memory exceeds the budget.
+     */
+    int64_t memoryBudget = 0;
+    /// the directory for the scratch files, defaults to TMPDIR or /tmp
+    std::string scratchDirectory;
+
+    /**
+     * Keep the decompressed data of a compressed input file once it got read completely.
+     *
+     * The data goes into an unlinked scratch file in scratchDirectory, which the kernel keeps in
+     * its page cache as long as there is enough memory. Later passes and reparsing then read from
+     * there instead of decompressing the file again, and skip right to the minimum time.
+     */
+    bool cacheDecompressedData = false;
+
+    /// drop the resident pages of the spilled tables when we use more memory than the memoryBudget
+    void enforceMemoryBudget();
+
+    enum Table
+    {
+        StringsTable = 0x1,
+        InstructionPointersTable = 0x2,
+        TracesTable = 0x4,
+        // the costs per trace, i.e. allocations
+        AllocationsTable = 0x8,
+        AllTables = StringsTable | InstructionPointersTable | TracesTable | AllocationsTable
+    };
+    /**
+     * The tables that get built while reading, a combination of Table flags.
+     *
+     * Tools that only look at the total costs can skip all of them, which leaves little more
+     * to do than decompressing the data. Without the strings, instruction pointers and traces,
+     * the costs still get accumulated per trace index, but backtraces and suppressions
+     * cannot be resolved.
+     */
+    int materializedTables = AllTables;
+
+    /// gets passed the current line, including the record type at its start
+    using RecordCallback = std::function<void(boost::string_view line)>;
+    /**
+     * Call @p callback for all records of type @p mode, before they get handled while reading.
+     *
+     * Pass an empty callback to remove it again.
+     */
+    void setRecordCallback(char mode, RecordCallback callback);
+
     bool shortenTemplates = false;
     bool fromAttached = false;
+    /// the recording ended when the process started to exit, see HEAPTRACK_FAST_EXIT
+    bool stoppedAtExit = false;
     FilterParameters filterParameters;
 
-    std::vector<Allocation> allocations;
+    // grows without copying the data, see ScratchStorage
+    ScratchVector<Allocation> allocations;
     AllocationData totalCost;
     int64_t totalTime = 0;
     int64_t peakTime = 0;
     int64_t peakRSS = 0;
+    /// when the recording started in nanoseconds of CLOCK_BOOTTIME, or zero when unknown
+    /// the time stamps are in milliseconds since then
+    int64_t startTimeNs = 0;
 
     struct SystemInfo
     {
@@ -128,21 +408,120 @@ struct AccumulatedTraceData
     };
     SystemInfo systemInfo;
 
-    // our indices are sequentially increasing thus a new allocation can only ever
-    // occur with an index larger than any other we encountered so far
-    // this can be used to our advantage in speeding up the mapToAllocationIndex calls.
-    TraceIndex m_maxAllocationTraceIndex;
-    AllocationIndex m_maxAllocationIndex;
-    // we don't want to shuffle allocations around, so instead keep a secondary
-    // vector around for efficient index lookup
-    std::vector<std::pair<TraceIndex, AllocationIndex>> traceIndexToAllocationIndex;
+    /// the work heaptrack itself did while recording, the totals of the last 'O' record
+    struct TracerOverhead
+    {
+        int64_t events = 0;
+        int64_t unwindNs = 0;
+        int64_t lockSpins = 0;
+        int64_t lockWaitNs = 0;
+        int64_t flushes = 0;
+        int64_t flushedBytes = 0;
+        int64_t blockedWriteNs = 0;
+
+        TracerOverhead& operator+=(const TracerOverhead& rhs)
+        {
+            events += rhs.events;
+            unwindNs += rhs.unwindNs;
+            lockSpins += rhs.lockSpins;
+            lockWaitNs += rhs.lockWaitNs;
+            flushes += rhs.flushes;
+            flushedBytes += rhs.flushedBytes;
+            blockedWriteNs += rhs.blockedWriteNs;
+            return *this;
+        }
+
+        TracerOverhead& operator-=(const TracerOverhead& rhs)
+        {
+            events -= rhs.events;
+            unwindNs -= rhs.unwindNs;
+            lockSpins -= rhs.lockSpins;
+            lockWaitNs -= rhs.lockWaitNs;
+            flushes -= rhs.flushes;
+            flushedBytes -= rhs.flushedBytes;
+            blockedWriteNs -= rhs.blockedWriteNs;
+            return *this;
+        }
+    };
+    TracerOverhead tracerOverhead;
+
+    /// the allocations of a size class, see sizeClasses
+    struct SizeClassCost
+    {
+        int64_t allocations = 0;
+        int64_t bytes = 0;
+    };
+    /// the totals of the last 'Z' record, only written with HEAPTRACK_COUNT_ONLY
+    /// size class i holds the allocations of [2^(i-1), 2^i) bytes, size class zero the empty ones
+    std::vector<SizeClassCost> sizeClasses;
+    /// the number of frees counted with HEAPTRACK_COUNT_ONLY, their sizes are unknown
+    int64_t countedFrees = 0;
+
+    /// the allocations of a size class whose usable size is known, see slackSizeClasses
+    struct SlackSizeClassCost
+    {
+        int64_t allocations = 0;
+        int64_t requested = 0;
+        int64_t slack = 0;
+    };
+    /// the slack of the allocator per size class of the requested size, only known with HEAPTRACK_USABLE_SIZE
+    /// the size classes are the same as for sizeClasses
+    std::vector<SlackSizeClassCost> slackSizeClasses;
+    /// the slack of the allocations that were alive at the time of the peak heap memory consumption
+    int64_t peakSlack = 0;
+
+    /// how full the pages of the heap were at a time stamp, see pageOccupancy
+    struct PageOccupancy
+    {
+        int64_t time = 0;
+        /// the number of pages per bucket, bucket i of n holds the pages of which i/n to (i+1)/n of the bytes
+        /// are occupied by live allocations
+        std::vector<int64_t> pages;
+
+        /// the pages of the first bucket, which are kept from being returned to the system by a few allocations
+        int64_t sparsePages() const
+        {
+            return pages.empty() ? 0 : pages.front();
+        }
+    };
+    /// the page occupancy over the filtered time range, only written with HEAPTRACK_INTERPRET_OCCUPANCY
+    /// the pinned cost of the allocations is the one at the time with the most sparse pages, see peakSparseTime
+    std::vector<PageOccupancy> pageOccupancy;
+    /// the size of the pages in bytes, they are the pages of the pointer map instead of the ones of the system
+    int64_t occupancyPageSize = 0;
+    int64_t peakSparseTime = 0;
+
+    /// mean number of bytes between two sampled allocations, or zero when all allocations got recorded
+    /// when this is set, all costs are estimates extrapolated from the sampled allocations
+    int64_t sampleInterval = 0;
+
+    /// indexed by the record type, empty unless a callback got set
+    std::vector<RecordCallback> recordCallbacks;
+
+    /// see cacheDecompressedData
+    std::shared_ptr<DecompressedCache> decompressedCache;
+
+    /// the 'U' records are only written once per size, so they get read in the initial pass only
+    std::shared_ptr<UsableSizes> usableSizes;
+
+    // trace indices are dense and sequentially increasing, so we can use them directly
+    // to look up the allocation, even when the threads of the debuggee make them arrive
+    // out of order. we don't want to shuffle allocations around, so instead keep a
+    // secondary table that stores the allocation index plus one, or zero for traces
+    // that didn't allocate anything so far
+    ScratchVector<uint32_t> traceIndexToAllocationIndex;
 
     /// find and return the index into the @c allocations vector for the given trace index.
     /// if the trace index wasn't mapped before, an empty Allocation will be added
     /// and its index returned.
     AllocationIndex mapToAllocationIndex(const TraceIndex traceIndex);
 
-    const InstructionPointer& findIp(const IpIndex ipIndex) const;
+    InstructionPointer findIp(const IpIndex ipIndex) const;
+
+    /// unify the traces of @p base with ours, calling @p reduce for all of its allocations
+    /// @return the mapping of the string indices of @p base to ours
+    std::vector<StringIndex> combine(const AccumulatedTraceData& base,
+                                     const std::function<void(Allocation&, const Allocation&)>& reduce);
 
     TraceNode findTrace(const TraceIndex traceIndex) const;
 
@@ -151,17 +530,38 @@ struct AccumulatedTraceData
     // indices of functions that should stop the backtrace, e.g. main or static
     // initialization
     std::vector<StringIndex> stopIndices;
-    std::vector<InstructionPointer> instructionPointers;
-    std::vector<TraceNode> traces;
-    std::vector<std::string> strings;
+    InstructionPointers instructionPointers;
+    ScratchVector<TraceNode> traces;
+    StringTable strings;
+    // the shortened function names and their index in there by the index of the original name, see prettyFunction
+    mutable StringTable shortenedFunctions;
+    mutable std::vector<StringIndex> shortenedFunctionIndices;
     std::vector<IpIndex> opNewIpIndices;
 
-    std::vector<AllocationInfo> allocationInfos;
+    ScratchVector<AllocationInfo> allocationInfos;
+    /// the cost of the allocation infos, computed with the sampling interval that was active for them
+    /// this stays empty unless the allocations got sampled, use allocationInfoCost() to access it
+    ScratchVector<SampledCost> allocationInfoCosts;
+
+    SampledCost allocationInfoCost(AllocationInfoIndex index) const;
+
+    /// sparse index of the time stamps, built while reading a file for the first time
+    /// reparsing it with a minimum time then skips the data before the corresponding entry
+    std::vector<TimeIndexEntry> timeIndex;
+    unsigned int fileVersion = 0;
+
+    /// the threads of the debuggee, indexed by ThreadIndex - 1, empty unless recorded with HEAPTRACK_TRACK_THREADS
+    std::vector<ThreadInfo> threads;
+
+    /// the pools of the debuggee, indexed by PoolIndex - 1, empty unless it used heaptrack_pool_malloc
+    std::vector<PoolInfo> pools;
 
     struct ParsingState
     {
         int64_t fileSize = 0; // bytes
         int64_t readCompressedByte = 0;
+        // compressed data skipped via the timeIndex
+        int64_t skippedCompressedByte = 0;
         int64_t readUncompressedByte = 0;
         int64_t timestamp = 0; // ms
         ParsePass pass = ParsePass::FirstPass;
@@ -170,8 +570,25 @@ struct AccumulatedTraceData
 
     ParsingState parsingState;
 
+    /// the peak cost of the allocations gets updated lazily while parsing, catch up with that
+    void finalizePeaks();
+
+    /// see changeLeaked in read()
+    struct LeakedChanges
+    {
+        uint64_t count = 0;
+        // the count at the time of the total peak
+        uint64_t atPeak = 0;
+        // the count at the last change of the leaked cost per allocation
+        std::vector<uint64_t> lastChanges;
+    };
+    LeakedChanges leakedChanges;
+
     void applyLeakSuppressions();
     std::vector<Suppression> suppressions;
+    /// the patterns of the 'S' records, which only get read in the initial pass as they precede the
+    /// offsets that a reparse resumes at. they are known also when disableEmbeddedSuppressions is set
+    std::vector<std::string> embeddedSuppressions;
     int64_t totalLeakedSuppressed = 0;
 };
 
@@ -19,6 +19,24 @@ struct AllocationData
     int64_t leaked = 0;
     // largest amount of bytes allocated
     int64_t peak = 0;
+    // amount of bytes in anonymous memory mappings, see HEAPTRACK_TRACK_MMAP
+    int64_t mapped = 0;
+    // largest amount of bytes in anonymous memory mappings at any time
+    int64_t peakMapped = 0;
+    // number of allocations that got freed right after a larger allocation from the same backtrace,
+    // like the old buffer of a growing std::vector or a realloc that had to move the data
+    int64_t growths = 0;
+    // amount of bytes in the allocations that got grown, i.e. that had to be copied over
+    int64_t copied = 0;
+    // amount of bytes the allocator reserved on top of the requested sizes, over all allocations,
+    // only known with HEAPTRACK_USABLE_SIZE
+    int64_t slack = 0;
+    // number of allocations that got freed by another thread than the allocating one,
+    // only known with HEAPTRACK_TRACK_THREADS
+    int64_t remoteFrees = 0;
+    // amount of bytes of sparsely occupied pages that the allocations keep from being returned to the system,
+    // at the time when the most pages were sparse, only known with HEAPTRACK_INTERPRET_OCCUPANCY
+    int64_t pinned = 0;
 
     void clearCost()
     {
@@ -29,7 +47,9 @@ struct AllocationData
 inline bool operator==(const AllocationData& lhs, const AllocationData& rhs)
 {
     return lhs.allocations == rhs.allocations && lhs.temporary == rhs.temporary && lhs.leaked == rhs.leaked
-        && lhs.peak == rhs.peak;
+        && lhs.peak == rhs.peak && lhs.mapped == rhs.mapped && lhs.peakMapped == rhs.peakMapped
+        && lhs.growths == rhs.growths && lhs.copied == rhs.copied && lhs.slack == rhs.slack
+        && lhs.remoteFrees == rhs.remoteFrees && lhs.pinned == rhs.pinned;
 }
 
 inline bool operator!=(const AllocationData& lhs, const AllocationData& rhs)
@@ -43,6 +63,13 @@ inline AllocationData& operator+=(AllocationData& lhs, const AllocationData& rhs
     lhs.temporary += rhs.temporary;
     lhs.peak += rhs.peak;
     lhs.leaked += rhs.leaked;
+    lhs.mapped += rhs.mapped;
+    lhs.peakMapped += rhs.peakMapped;
+    lhs.growths += rhs.growths;
+    lhs.copied += rhs.copied;
+    lhs.slack += rhs.slack;
+    lhs.remoteFrees += rhs.remoteFrees;
+    lhs.pinned += rhs.pinned;
     return lhs;
 }
 
@@ -52,6 +79,13 @@ inline AllocationData& operator-=(AllocationData& lhs, const AllocationData& rhs
     lhs.temporary -= rhs.temporary;
     lhs.peak -= rhs.peak;
     lhs.leaked -= rhs.leaked;
+    lhs.mapped -= rhs.mapped;
+    lhs.peakMapped -= rhs.peakMapped;
+    lhs.growths -= rhs.growths;
+    lhs.copied -= rhs.copied;
+    lhs.slack -= rhs.slack;
+    lhs.remoteFrees -= rhs.remoteFrees;
+    lhs.pinned -= rhs.pinned;
     return lhs;
 }
 
@@ -19,10 +19,27 @@ struct FilterParameters
     std::vector<std::string> suppressions;
     bool disableEmbeddedSuppressions = false;
     bool disableBuiltinSuppressions = false;
+    // the allocations outside of this size range are ignored
+    uint64_t minSize = 0;
+    uint64_t maxSize = std::numeric_limits<uint64_t>::max();
+    // in milliseconds, allocations that get freed earlier are ignored
+    int64_t minLifetime = 0;
     bool isFilteredByTime(int64_t totalTime) const
     {
         return minTime != 0 || maxTime < totalTime;
     }
+    bool isFilteredBySize() const
+    {
+        return minSize != 0 || maxSize != std::numeric_limits<uint64_t>::max();
+    }
+    bool isFilteredByAllocation() const
+    {
+        return isFilteredBySize() || minLifetime != 0;
+    }
+    bool matchesSize(uint64_t size) const
+    {
+        return size >= minSize && size <= maxSize;
+    }
 };
 
 #endif // FILTERPARAMETERS_H
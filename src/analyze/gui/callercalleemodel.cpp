@@ -179,7 +179,7 @@ QVariant CallerCalleeModel::cell(int column, int role, const Symbol& symbol, con
     } else if (role == Qt::ToolTipRole) {
         return Util::formatTooltip(symbol, entry.selfCost, entry.inclusiveCost, *m_results.resultData);
     } else if (role == ResultDataRole) {
-        return QVariant::fromValue(m_results.resultData.get());
+        return QVariant::fromValue(m_results.resultData);
     }
 
     return {};
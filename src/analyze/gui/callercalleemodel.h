@@ -13,12 +13,13 @@
 #include <KLocalizedString>
 
 #include "../allocationdata.h"
+#include "flatmap.h"
 #include "hashmodel.h"
 #include "locationdata.h"
 #include "resultdata.h"
 #include "util.h"
 
-using SymbolCostMap = QHash<Symbol, AllocationData>;
+using SymbolCostMap = FlatMap<Symbol, AllocationData>;
 Q_DECLARE_METATYPE(SymbolCostMap)
 
 using CalleeMap = SymbolCostMap;
@@ -31,7 +32,7 @@ struct EntryCost
 };
 Q_DECLARE_TYPEINFO(EntryCost, Q_MOVABLE_TYPE);
 
-using LocationCostMap = QHash<FileLine, EntryCost>;
+using LocationCostMap = FlatMap<FileLine, EntryCost>;
 Q_DECLARE_METATYPE(LocationCostMap)
 
 struct CallerCalleeEntry : EntryCost
@@ -44,7 +45,7 @@ struct CallerCalleeEntry : EntryCost
     LocationCostMap sourceMap;
 };
 
-using CallerCalleeEntryMap = QHash<Symbol, CallerCalleeEntry>;
+using CallerCalleeEntryMap = FlatMap<Symbol, CallerCalleeEntry>;
 struct CallerCalleeResults
 {
     CallerCalleeEntryMap entries;
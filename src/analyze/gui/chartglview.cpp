@@ -0,0 +1,601 @@
+/*
+    SPDX-FileCopyrightText: 2026 Milian Wolff <mail@milianw.de>
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#include "chartglview.h"
+
+#include <QMatrix4x4>
+#include <QMouseEvent>
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <QOpenGLShaderProgram>
+#include <QPainter>
+#include <QSurfaceFormat>
+
+#include "chartmodel.h"
+#include "util.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+const qreal PADDING = 4;
+const qreal TICK_LENGTH = 4;
+
+// the same sizes as the fonts of the KChart axes
+QFont tickFont(QFont font)
+{
+    font.setPointSizeF(qMax(qreal(1), font.pointSizeF() - 2));
+    return font;
+}
+
+QFont titleFont(QFont font)
+{
+    font.setPointSizeF(font.pointSizeF() + 2);
+    return font;
+}
+
+/// @return a step of 1, 2 or 5 times a power of ten, such that @p range gets split into at most @p maxTicks steps
+qint64 niceStep(qint64 range, double maxTicks)
+{
+    const auto rough = std::max(1., range / std::max(1., maxTicks));
+    const auto magnitude = std::pow(10., std::floor(std::log10(rough)));
+    for (const auto factor : {1., 2., 5.}) {
+        if (factor * magnitude >= rough) {
+            return std::llround(factor * magnitude);
+        }
+    }
+    return std::llround(10 * magnitude);
+}
+
+qreal localX(QMouseEvent* event)
+{
+#if QT_VERSION < QT_VERSION_CHECK(6, 0, 0)
+    return event->localPos().x();
+#else
+    return event->position().x();
+#endif
+}
+}
+
+ChartGLView::ChartGLView(QWidget* parent)
+    : QOpenGLWidget(parent)
+{
+    auto format = QSurfaceFormat::defaultFormat();
+    // antialiasing for the lines along the top of the series
+    format.setSamples(4);
+    setFormat(format);
+}
+
+ChartGLView::~ChartGLView()
+{
+    cleanupGL();
+}
+
+bool ChartGLView::isSupported()
+{
+    static const bool supported = []() {
+        QOpenGLContext context;
+        if (!context.create()) {
+            return false;
+        }
+        QOffscreenSurface surface;
+        surface.setFormat(context.format());
+        surface.create();
+        if (!context.makeCurrent(&surface)) {
+            return false;
+        }
+        context.doneCurrent();
+        return true;
+    }();
+    return supported;
+}
+
+void ChartGLView::setModel(ChartModel* model)
+{
+    if (m_model) {
+        disconnect(m_model, nullptr, this, nullptr);
+    }
+    m_model = model;
+    if (m_model) {
+        // changes of the time range get announced via setTimeRange, which doesn't require new vertices
+        connect(m_model, &ChartModel::seriesChanged, this, [this]() {
+            resetLevels();
+            updateAxes();
+        });
+    }
+    resetLevels();
+    updateAxes();
+}
+
+void ChartGLView::setSummaryData(const SummaryData& summaryData)
+{
+    m_summaryData = summaryData;
+    updateAxes();
+}
+
+void ChartGLView::setAxisTitles(const QString& timeTitle, const QString& costTitle)
+{
+    m_timeTitle = timeTitle;
+    m_costTitle = costTitle;
+    update();
+}
+
+void ChartGLView::setShowTotal(bool show)
+{
+    m_showTotal = show;
+    updateAxes();
+}
+
+void ChartGLView::setShowDetailed(bool show)
+{
+    m_showDetailed = show;
+    updateAxes();
+}
+
+void ChartGLView::setShowLegend(bool show)
+{
+    m_showLegend = show;
+    update();
+}
+
+void ChartGLView::setTimeRange(qint64 startTime, qint64 endTime)
+{
+    m_startTime = startTime;
+    m_endTime = endTime;
+    updateAxes();
+}
+
+qreal ChartGLView::timeAt(qreal x) const
+{
+    const auto& plot = m_axes.plot;
+    if (!plot.isValid()) {
+        return 0;
+    }
+    return m_axes.startTime + (x - plot.left()) / plot.width() * (m_axes.endTime - m_axes.startTime);
+}
+
+qreal ChartGLView::positionOf(qreal time) const
+{
+    const auto& plot = m_axes.plot;
+    if (!plot.isValid()) {
+        return 0;
+    }
+    return plot.left() + (time - m_axes.startTime) / (m_axes.endTime - m_axes.startTime) * plot.width();
+}
+
+qreal ChartGLView::costPosition(qreal cost) const
+{
+    const auto& plot = m_axes.plot;
+    return plot.bottom() - (cost - m_axes.minCost) / (m_axes.maxCost - m_axes.minCost) * plot.height();
+}
+
+void ChartGLView::paintChart(QPainter* painter)
+{
+    painter->fillRect(rect(), palette().window());
+
+    if (m_model && m_axes.plot.isValid()) {
+        const auto& level = this->level(m_model->visibleLevel());
+        const auto first = m_model->firstVisibleRow();
+        const auto numRows = m_model->rowCount();
+        auto map = [&](const float* vertex) {
+            return QPointF(positionOf(level.timeOffset + vertex[0]), costPosition(vertex[1]));
+        };
+
+        painter->save();
+        painter->setClipRect(m_axes.plot);
+        painter->setRenderHint(QPainter::Antialiasing);
+        for (const auto series : visibleSeries()) {
+            const auto vertices = &level.vertices[(size_t(series) * level.numRows + first) * 4];
+            QPolygonF top;
+            top.reserve(numRows);
+            for (int i = 0; i < numRows; ++i) {
+                top.append(map(vertices + i * 4 + 2));
+            }
+            auto area = top;
+            for (int i = numRows - 1; i >= 0; --i) {
+                area.append(map(vertices + i * 4));
+            }
+
+            auto color = m_model->seriesColor(series);
+            color.setAlpha(series == 0 ? 50 : 127);
+            painter->setPen(Qt::NoPen);
+            painter->setBrush(color);
+            painter->drawPolygon(area);
+            color.setAlpha(255);
+            painter->setPen(color);
+            painter->setBrush(Qt::NoBrush);
+            painter->drawPolyline(top);
+        }
+        painter->restore();
+    }
+
+    paintOverlay(painter);
+}
+
+void ChartGLView::initializeGL()
+{
+    initializeOpenGLFunctions();
+    // the context gets replaced when the widget gets moved into another window
+    connect(context(), &QOpenGLContext::aboutToBeDestroyed, this, &ChartGLView::cleanupGL, Qt::UniqueConnection);
+
+    // the precision qualifiers are required by OpenGL ES, Qt defines them away for desktop OpenGL
+    m_program = std::make_unique<QOpenGLShaderProgram>();
+    m_program->addShaderFromSourceCode(QOpenGLShader::Vertex,
+                                       "attribute highp vec2 vertex;\n"
+                                       "uniform highp mat4 matrix;\n"
+                                       "void main() { gl_Position = matrix * vec4(vertex, 0.0, 1.0); }\n");
+    m_program->addShaderFromSourceCode(QOpenGLShader::Fragment,
+                                       "uniform lowp vec4 color;\n"
+                                       "void main() { gl_FragColor = color; }\n");
+    m_program->bindAttributeLocation("vertex", 0);
+    if (!m_program->link()) {
+        qWarning("failed to link the shaders of the chart: %ls", qUtf16Printable(m_program->log()));
+        m_program.reset();
+        return;
+    }
+    m_matrixLocation = m_program->uniformLocation("matrix");
+    m_colorLocation = m_program->uniformLocation("color");
+}
+
+void ChartGLView::resizeGL(int /*width*/, int /*height*/)
+{
+    updateAxes();
+}
+
+void ChartGLView::paintGL()
+{
+    QPainter painter(this);
+    painter.fillRect(rect(), palette().window());
+
+    if (m_model && m_program && m_axes.plot.isValid()) {
+        painter.beginNativePainting();
+        paintSeries(level(m_model->visibleLevel()));
+        painter.endNativePainting();
+    }
+
+    paintOverlay(&painter);
+}
+
+void ChartGLView::mouseMoveEvent(QMouseEvent* event)
+{
+    m_hoverPosition = localX(event);
+    update();
+    QOpenGLWidget::mouseMoveEvent(event);
+}
+
+void ChartGLView::leaveEvent(QEvent* event)
+{
+    m_hoverPosition = -1;
+    update();
+    QOpenGLWidget::leaveEvent(event);
+}
+
+void ChartGLView::resetLevels()
+{
+    // the buffers can only be destroyed while their context is current
+    makeCurrent();
+    for (auto& level : m_levels) {
+        level.buffer.destroy();
+    }
+    doneCurrent();
+
+    m_levels.clear();
+    if (m_model) {
+        m_levels.resize(m_model->levelCount() + 1);
+    }
+}
+
+ChartGLView::Level& ChartGLView::level(int index)
+{
+    auto& ret = m_levels[index + 1];
+    if (!ret.vertices.empty()) {
+        return ret;
+    }
+
+    const auto& rows = m_model->levelRows(index);
+    const auto numSeries = m_model->seriesCount();
+    ret.numRows = rows.size();
+    ret.timeOffset = rows.isEmpty() ? 0 : rows.constFirst().timeStamp;
+    ret.vertices.resize(size_t(numSeries) * ret.numRows * 4);
+    for (int i = 0; i < ret.numRows; ++i) {
+        const auto& row = rows[i];
+        const auto time = static_cast<float>(row.timeStamp - ret.timeOffset);
+        qint64 stacked = 0;
+        for (int series = 0; series < numSeries; ++series) {
+            // like for the plotters, the total doesn't get stacked with the other series
+            const auto bottom = series == 0 ? 0 : stacked;
+            const auto top = bottom + row.cost(series);
+            if (series != 0) {
+                stacked = top;
+            }
+            auto vertex = &ret.vertices[(size_t(series) * ret.numRows + i) * 4];
+            vertex[0] = time;
+            vertex[1] = bottom;
+            vertex[2] = time;
+            vertex[3] = top;
+        }
+    }
+    return ret;
+}
+
+void ChartGLView::updateAxes()
+{
+    m_axes = {};
+    update();
+    if (!m_model || !m_model->rowCount() || !m_model->seriesCount()) {
+        emit axesChanged();
+        return;
+    }
+
+    const auto& rows = m_model->levelRows(m_model->visibleLevel());
+    const auto& level = this->level(m_model->visibleLevel());
+    const auto first = m_model->firstVisibleRow();
+    const auto numRows = m_model->rowCount();
+
+    Axes axes;
+    if (m_startTime < m_endTime) {
+        axes.startTime = m_startTime;
+        axes.endTime = m_endTime;
+    } else {
+        axes.startTime = rows[first].timeStamp;
+        axes.endTime = rows[first + numRows - 1].timeStamp;
+    }
+    axes.endTime = std::max(axes.endTime, axes.startTime + 1);
+
+    double minCost = 0;
+    double maxCost = 0;
+    for (const auto series : visibleSeries()) {
+        const auto vertices = &level.vertices[(size_t(series) * level.numRows + first) * 4];
+        for (int i = 1; i < numRows * 4; i += 2) {
+            minCost = std::min(minCost, double(vertices[i]));
+            maxCost = std::max(maxCost, double(vertices[i]));
+        }
+    }
+
+    const QFontMetricsF tickMetrics(tickFont(font()));
+    const QFontMetricsF titleMetrics(titleFont(font()));
+    const auto timeLines = m_summaryData.filterParameters.isFilteredByTime(m_summaryData.totalTime) ? 2 : 1;
+    const auto top = PADDING + tickMetrics.height() / 2;
+    const auto bottom = height() - 2 * PADDING - titleMetrics.height() - timeLines * tickMetrics.height() - TICK_LENGTH;
+    if (bottom - top < 1) {
+        emit axesChanged();
+        return;
+    }
+
+    // like the KChart plotters, round the cost axis to the grid, but not the time axis
+    axes.costStep = niceStep(std::llround(maxCost - minCost), (bottom - top) / (4 * tickMetrics.height()));
+    axes.minCost = std::llround(std::floor(minCost / axes.costStep) * axes.costStep);
+    axes.maxCost = std::llround(std::ceil(maxCost / axes.costStep) * axes.costStep);
+    if (axes.maxCost == axes.minCost) {
+        axes.maxCost += axes.costStep;
+    }
+
+    qreal labelWidth = 0;
+    for (auto cost = axes.minCost; cost <= axes.maxCost; cost += axes.costStep) {
+        labelWidth = std::max(labelWidth, tickMetrics.boundingRect(costLabel(cost)).width());
+    }
+    const auto right = width() - 3 * PADDING - TICK_LENGTH - labelWidth - titleMetrics.height();
+    if (right - PADDING < 1) {
+        emit axesChanged();
+        return;
+    }
+    axes.plot = QRectF(QPointF(PADDING, top), QPointF(right, bottom));
+
+    const auto timeLabelWidth = tickMetrics.boundingRect(timeLabel(axes.endTime)).width() + 4 * PADDING;
+    axes.timeStep = niceStep(axes.endTime - axes.startTime, axes.plot.width() / timeLabelWidth);
+
+    m_axes = axes;
+    emit axesChanged();
+}
+
+QString ChartGLView::timeLabel(qint64 time) const
+{
+    // see TimeAxis of the ChartWidget
+    if (m_summaryData.filterParameters.isFilteredByTime(m_summaryData.totalTime)) {
+        return Util::formatTime(time) + QLatin1Char('\n')
+            + Util::formatTime(time - m_summaryData.filterParameters.minTime);
+    }
+    return Util::formatTime(time);
+}
+
+QString ChartGLView::costLabel(qint64 cost) const
+{
+    if (m_model->type() == ChartModel::Allocations || m_model->type() == ChartModel::Temporary
+        || m_model->type() == ChartModel::AllocationRate) {
+        return QString::number(cost);
+    }
+    return Util::formatBytes(cost);
+}
+
+std::vector<int> ChartGLView::visibleSeries() const
+{
+    std::vector<int> series;
+    const auto numSeries = m_model ? m_model->seriesCount() : 0;
+    if (m_showTotal && numSeries > 0) {
+        series.push_back(0);
+    }
+    if (m_showDetailed) {
+        for (int i = 1; i < numSeries; ++i) {
+            series.push_back(i);
+        }
+    }
+    return series;
+}
+
+void ChartGLView::paintSeries(Level& level)
+{
+    if (!level.buffer.isCreated()) {
+        level.buffer.create();
+        level.buffer.bind();
+        level.buffer.allocate(level.vertices.data(), static_cast<int>(level.vertices.size() * sizeof(float)));
+    } else {
+        level.buffer.bind();
+    }
+
+    // the viewport clips the series to the plot area, note that its origin is at the bottom left
+    const auto ratio = devicePixelRatioF();
+    const auto& plot = m_axes.plot;
+    glViewport(qRound(plot.left() * ratio), qRound((height() - plot.bottom()) * ratio), qRound(plot.width() * ratio),
+               qRound(plot.height() * ratio));
+    glDisable(GL_DEPTH_TEST);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    QMatrix4x4 matrix;
+    matrix.ortho(m_axes.startTime - level.timeOffset, m_axes.endTime - level.timeOffset, m_axes.minCost,
+                 m_axes.maxCost, -1, 1);
+
+    m_program->bind();
+    m_program->setUniformValue(m_matrixLocation, matrix);
+    m_program->enableAttributeArray(0);
+
+    const auto first = m_model->firstVisibleRow();
+    const auto numRows = m_model->rowCount();
+    for (const auto series : visibleSeries()) {
+        const auto offset = static_cast<int>((size_t(series) * level.numRows + first) * 4 * sizeof(float));
+        auto color = m_model->seriesColor(series);
+
+        // the same transparency as in the LineAttributes of the ChartModel
+        color.setAlpha(series == 0 ? 50 : 127);
+        m_program->setUniformValue(m_colorLocation, color);
+        m_program->setAttributeBuffer(0, GL_FLOAT, offset, 2);
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, numRows * 2);
+
+        // the line along the top of the area only uses every second vertex
+        color.setAlpha(255);
+        m_program->setUniformValue(m_colorLocation, color);
+        m_program->setAttributeBuffer(0, GL_FLOAT, offset + 2 * sizeof(float), 2, 4 * sizeof(float));
+        glDrawArrays(GL_LINE_STRIP, 0, numRows);
+    }
+
+    m_program->disableAttributeArray(0);
+    m_program->release();
+    level.buffer.release();
+}
+
+void ChartGLView::paintOverlay(QPainter* painter)
+{
+    const auto& plot = m_axes.plot;
+    if (!m_model || !plot.isValid()) {
+        return;
+    }
+
+    painter->save();
+
+    const auto foreground = palette().color(QPalette::WindowText);
+    auto grid = foreground;
+    grid.setAlpha(40);
+
+    painter->setFont(tickFont(font()));
+    const QFontMetricsF tickMetrics(painter->font());
+    for (auto cost = m_axes.minCost; cost <= m_axes.maxCost; cost += m_axes.costStep) {
+        const auto y = costPosition(cost);
+        painter->setPen(grid);
+        painter->drawLine(QPointF(plot.left(), y), QPointF(plot.right(), y));
+        painter->setPen(foreground);
+        painter->drawLine(QPointF(plot.right(), y), QPointF(plot.right() + TICK_LENGTH, y));
+        const auto labelLeft = plot.right() + TICK_LENGTH + PADDING;
+        painter->drawText(QRectF(labelLeft, y - tickMetrics.height(), width() - labelLeft, 2 * tickMetrics.height()),
+                          Qt::AlignLeft | Qt::AlignVCenter, costLabel(cost));
+    }
+
+    const auto tickWidth = positionOf(m_axes.startTime + m_axes.timeStep) - plot.left();
+    const auto firstTick = (m_axes.startTime + m_axes.timeStep - 1) / m_axes.timeStep * m_axes.timeStep;
+    for (auto time = firstTick; time <= m_axes.endTime; time += m_axes.timeStep) {
+        const auto x = positionOf(time);
+        painter->setPen(grid);
+        painter->drawLine(QPointF(x, plot.top()), QPointF(x, plot.bottom()));
+        painter->setPen(foreground);
+        painter->drawLine(QPointF(x, plot.bottom()), QPointF(x, plot.bottom() + TICK_LENGTH));
+        painter->drawText(QRectF(x - tickWidth / 2, plot.bottom() + TICK_LENGTH, tickWidth, 2 * tickMetrics.height()),
+                          Qt::AlignHCenter | Qt::AlignTop, timeLabel(time));
+    }
+
+    painter->setPen(foreground);
+    painter->setBrush(Qt::NoBrush);
+    painter->drawRect(plot);
+
+    if (m_hoverPosition >= plot.left() && m_hoverPosition <= plot.right()) {
+        painter->setPen(palette().color(QPalette::Highlight));
+        painter->drawLine(QPointF(m_hoverPosition, plot.top()), QPointF(m_hoverPosition, plot.bottom()));
+        painter->setPen(foreground);
+    }
+
+    painter->setFont(titleFont(font()));
+    const QFontMetricsF titleMetrics(painter->font());
+    const auto titleTop = height() - PADDING - titleMetrics.height();
+    painter->drawText(QRectF(plot.left(), titleTop, plot.width(), titleMetrics.height()), Qt::AlignCenter, m_timeTitle);
+    painter->save();
+    painter->translate(width() - PADDING - titleMetrics.height() / 2, plot.center().y());
+    painter->rotate(90);
+    painter->drawText(QRectF(-plot.height() / 2, -titleMetrics.height() / 2, plot.height(), titleMetrics.height()),
+                      Qt::AlignCenter, m_costTitle);
+    painter->restore();
+
+    if (m_showLegend) {
+        paintLegend(painter);
+    }
+
+    painter->restore();
+}
+
+void ChartGLView::paintLegend(QPainter* painter)
+{
+    QFont legendFont(QStringLiteral("monospace"));
+    legendFont.setStyleHint(QFont::TypeWriter);
+    legendFont.setPointSizeF(tickFont(font()).pointSizeF());
+    painter->setFont(legendFont);
+    const QFontMetricsF metrics(legendFont);
+
+    // like the KChart legend, the last series comes first
+    auto series = visibleSeries();
+    std::reverse(series.begin(), series.end());
+    const auto lineHeight = metrics.height();
+    const auto maxLines = static_cast<size_t>(qMax(qreal(0), (m_axes.plot.height() - 2 * PADDING) / lineHeight));
+    series.resize(std::min(series.size(), maxLines));
+    if (series.empty()) {
+        return;
+    }
+
+    QStringList labels;
+    qreal labelWidth = 0;
+    for (const auto i : series) {
+        labels.append(m_model->headerData(i * 2).toString());
+        labelWidth = std::max(labelWidth, metrics.boundingRect(labels.constLast()).width());
+    }
+
+    const auto legend = QRectF(m_axes.plot.topLeft() + QPointF(3, 3),
+                               QSizeF(3 * PADDING + lineHeight + labelWidth, 2 * PADDING + series.size() * lineHeight));
+    auto background = palette().color(QPalette::AlternateBase);
+    background.setAlpha(200);
+    painter->fillRect(legend, background);
+
+    for (size_t i = 0; i < series.size(); ++i) {
+        const auto lineTop = legend.top() + PADDING + i * lineHeight;
+        painter->fillRect(QRectF(legend.left() + PADDING, lineTop + 2, lineHeight - 4, lineHeight - 4),
+                          m_model->seriesColor(series[i]));
+        painter->setPen(palette().color(QPalette::WindowText));
+        painter->drawText(QRectF(legend.left() + 2 * PADDING + lineHeight, lineTop, labelWidth, lineHeight),
+                          Qt::AlignLeft | Qt::AlignVCenter, labels.at(i));
+    }
+}
+
+void ChartGLView::cleanupGL()
+{
+    if (!context()) {
+        return;
+    }
+    makeCurrent();
+    for (auto& level : m_levels) {
+        level.buffer.destroy();
+    }
+    m_program.reset();
+    doneCurrent();
+    // otherwise we would get called from the destructor of QOpenGLWidget, when we are gone already
+    disconnect(context(), &QOpenGLContext::aboutToBeDestroyed, this, &ChartGLView::cleanupGL);
+}
+
+#include "moc_chartglview.cpp"
@@ -0,0 +1,124 @@
+/*
+    SPDX-FileCopyrightText: 2026 Milian Wolff <mail@milianw.de>
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#ifndef CHARTGLVIEW_H
+#define CHARTGLVIEW_H
+
+#include <QOpenGLBuffer>
+#include <QOpenGLFunctions>
+#include <QOpenGLWidget>
+
+#include <memory>
+#include <vector>
+
+#include "summarydata.h"
+
+class QOpenGLShaderProgram;
+
+class ChartModel;
+
+/**
+ * Draws the series of a ChartModel with OpenGL, as an alternative to the KChart plotters.
+ *
+ * The plotters query the item model for every data point whenever they repaint. Here, the stacked
+ * series of a level of the ChartData get uploaded into a vertex buffer once, when the level first
+ * gets displayed. Zooming only picks the level and the range of its vertices, and repainting e.g.
+ * for the hover line draws straight from the buffers. The axes and the legend get painted on top
+ * with QPainter.
+ */
+class ChartGLView : public QOpenGLWidget, protected QOpenGLFunctions
+{
+    Q_OBJECT
+public:
+    explicit ChartGLView(QWidget* parent = nullptr);
+    ~ChartGLView() override;
+
+    /// @return true when we can create an OpenGL context
+    static bool isSupported();
+
+    void setModel(ChartModel* model);
+    void setSummaryData(const SummaryData& summaryData);
+    void setAxisTitles(const QString& timeTitle, const QString& costTitle);
+    void setShowTotal(bool show);
+    void setShowDetailed(bool show);
+    void setShowLegend(bool show);
+
+    /// show the time range from @p startTime to @p endTime, or all of the data when it is empty
+    void setTimeRange(qint64 startTime, qint64 endTime);
+
+    /// map between the x coordinates of this widget and the time in ms
+    qreal timeAt(qreal x) const;
+    qreal positionOf(qreal time) const;
+
+    /// paint the chart without OpenGL, i.e. for the export as a vector image
+    void paintChart(QPainter* painter);
+
+signals:
+    /// the mapping between positions and times changed
+    void axesChanged();
+
+protected:
+    void initializeGL() override;
+    void resizeGL(int width, int height) override;
+    void paintGL() override;
+    void mouseMoveEvent(QMouseEvent* event) override;
+    void leaveEvent(QEvent* event) override;
+
+private:
+    struct Level
+    {
+        /// the time of the first row, the vertices are relative to it to keep the precision of the floats
+        qint64 timeOffset = 0;
+        int numRows = 0;
+        /// two vertices per row and series, for the bottom and the top of its stacked area, grouped by series
+        std::vector<float> vertices;
+        /// created when the level gets displayed for the first time
+        QOpenGLBuffer buffer;
+    };
+
+    struct Axes
+    {
+        QRectF plot;
+        qint64 startTime = 0;
+        qint64 endTime = 0;
+        qint64 minCost = 0;
+        qint64 maxCost = 0;
+        qint64 timeStep = 0;
+        qint64 costStep = 0;
+    };
+
+    void resetLevels();
+    Level& level(int index);
+    void updateAxes();
+    qreal costPosition(qreal cost) const;
+    QString timeLabel(qint64 time) const;
+    QString costLabel(qint64 cost) const;
+    /// the series that get drawn, in the order in which they get drawn
+    std::vector<int> visibleSeries() const;
+    void paintSeries(Level& level);
+    void paintOverlay(QPainter* painter);
+    void paintLegend(QPainter* painter);
+    void cleanupGL();
+
+    ChartModel* m_model = nullptr;
+    SummaryData m_summaryData;
+    QString m_timeTitle;
+    QString m_costTitle;
+    bool m_showTotal = true;
+    bool m_showDetailed = true;
+    bool m_showLegend = false;
+    qint64 m_startTime = 0;
+    qint64 m_endTime = 0;
+    qreal m_hoverPosition = -1;
+    /// indexed by the level of the model plus one, such that the rows at full resolution come first
+    std::vector<Level> m_levels;
+    Axes m_axes;
+    std::unique_ptr<QOpenGLShaderProgram> m_program;
+    int m_matrixLocation = -1;
+    int m_colorLocation = -1;
+};
+
+#endif // CHARTGLVIEW_H
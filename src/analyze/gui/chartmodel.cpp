@@ -54,6 +54,10 @@ QString ChartModel::typeString() const
         return i18n("Memory Consumed");
     case Temporary:
         return i18n("Temporary Allocations");
+    case Mapped:
+        return i18n("Memory Mapped");
+    case AllocationRate:
+        return i18n("Allocations per Second");
     default:
         return QString();
     }
@@ -85,6 +89,10 @@ QVariant ChartModel::headerData(int section, Qt::Orientation orientation, int ro
                 return i18n("Total Memory Consumption");
             case Temporary:
                 return i18n("Total Temporary Allocations");
+            case Mapped:
+                return i18n("Total Memory Mapped");
+            case AllocationRate:
+                return i18n("Total Allocations per Second");
             }
         } else {
             auto id = m_data.labels.value(section / 2).functionId;
@@ -147,16 +155,14 @@ QVariant ChartModel::data(const QModelIndex& index, int role) const
         return {};
     }
 
-    const auto& data = m_data.rows.at(index.row());
+    const auto& data = levelRows(m_level).at(m_firstRow + index.row());
 
     int column = index.column();
     if (role != Qt::ToolTipRole && column % 2 == 0) {
         return data.timeStamp;
     }
     column = column / 2;
-    Q_ASSERT(column < ChartRows::MAX_NUM_COST);
-
-    const auto cost = data.cost[column];
+    const auto cost = data.cost(column);
     if (role == Qt::ToolTipRole) {
         const QString time = Util::formatTime(data.timeStamp);
         auto byteCost = [cost]() -> QString {
@@ -176,6 +182,10 @@ QVariant ChartModel::data(const QModelIndex& index, int role) const
                 return i18n("<qt>%1 temporary allocations in total after %2</qt>", cost, time);
             case Consumed:
                 return i18n("<qt>%1 consumed in total after %2</qt>", byteCost(), time);
+            case Mapped:
+                return i18n("<qt>%1 mapped in total after %2</qt>", byteCost(), time);
+            case AllocationRate:
+                return i18n("<qt>%1 allocations per second in total before %2</qt>", cost, time);
             }
         } else {
             auto label = Util::toString(m_data.labels.value(column), *m_data.resultData, Util::Long);
@@ -192,6 +202,14 @@ QVariant ChartModel::data(const QModelIndex& index, int role) const
                 return i18n("<qt>%2 consumed after %3 from:<p "
                             "style='margin-left:10px'>%1</p></qt>",
                             label, byteCost(), time);
+            case Mapped:
+                return i18n("<qt>%2 mapped after %3 from:<p "
+                            "style='margin-left:10px'>%1</p></qt>",
+                            label, byteCost(), time);
+            case AllocationRate:
+                return i18n("<qt>%2 allocations per second before %3 from:<p "
+                            "style='margin-left:10px'>%1</p></qt>",
+                            label, cost, time);
             }
         }
         return {};
@@ -210,7 +228,7 @@ int ChartModel::rowCount(const QModelIndex& parent) const
     if (parent.isValid()) {
         return 0;
     } else {
-        return m_data.rows.size();
+        return m_numRows;
     }
 }
 
@@ -238,6 +256,12 @@ void ChartModel::setMaximumDatasetCount(int count)
         endInsertColumns();
     }
     Q_ASSERT(columnCount() == newColumnCount * 2);
+    emit seriesChanged();
+}
+
+QColor ChartModel::seriesColor(int series) const
+{
+    return m_columnDataSetBrushes.value(series * 2).color();
 }
 
 void ChartModel::resetColors()
@@ -255,11 +279,12 @@ void ChartModel::resetColors()
 void ChartModel::resetData(const ChartData& data)
 {
     Q_ASSERT(data.resultData);
-    Q_ASSERT(data.labels.size() < ChartRows::MAX_NUM_COST);
     beginResetModel();
     m_data = data;
     resetColors();
+    updateVisibleRows();
     endResetModel();
+    emit seriesChanged();
 }
 
 void ChartModel::clearData()
@@ -268,7 +293,9 @@ void ChartModel::clearData()
     m_data = {};
     m_columnDataSetBrushes = {};
     m_columnDataSetPens = {};
+    updateVisibleRows();
     endResetModel();
+    emit seriesChanged();
 }
 
 struct CompareClosestToTime
@@ -288,7 +315,44 @@ qint64 ChartModel::totalCostAt(qint64 timeStamp) const
     auto it = std::lower_bound(m_data.rows.rbegin(), m_data.rows.rend(), timeStamp, CompareClosestToTime());
     if (it == m_data.rows.rend())
         return 0;
-    return it->cost[0];
+    return it->total;
+}
+
+void ChartModel::setTimeRange(qint64 startTime, qint64 endTime)
+{
+    beginResetModel();
+    m_startTime = startTime;
+    m_endTime = endTime;
+    updateVisibleRows();
+    endResetModel();
+}
+
+const QVector<ChartRows>& ChartModel::levelRows(int level) const
+{
+    return level == -1 ? m_data.rows : m_data.levels.at(level);
+}
+
+void ChartModel::updateVisibleRows()
+{
+    auto byTime = [](const ChartRows& row, qint64 time) { return row.timeStamp < time; };
+    for (int level = -1, lastLevel = m_data.levels.size() - 1; level <= lastLevel; ++level) {
+        const auto& rows = levelRows(level);
+        auto begin = std::lower_bound(rows.begin(), rows.end(), m_startTime, byTime);
+        auto end = std::lower_bound(begin, rows.end(), m_endTime, byTime);
+        // include the rows around the range, such that the lines reach the borders of the chart
+        if (begin != rows.begin()) {
+            --begin;
+        }
+        if (end != rows.end()) {
+            ++end;
+        }
+        if (end - begin <= ChartData::MAX_DISPLAYED_ROWS || level == lastLevel) {
+            m_level = level;
+            m_firstRow = begin - rows.begin();
+            m_numRows = end - begin;
+            return;
+        }
+    }
 }
 
 #include "moc_chartmodel.cpp"
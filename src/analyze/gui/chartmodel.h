@@ -7,34 +7,83 @@
 #ifndef CHARTMODEL_H
 #define CHARTMODEL_H
 
-#include <array>
+#include <algorithm>
+#include <limits>
 
 #include <QAbstractTableModel>
+#include <QColor>
 #include <QVector>
 
 #include "resultdata.h"
 
 #include <memory>
 
+struct ChartCost
+{
+    int label;
+    qint64 cost;
+};
+Q_DECLARE_TYPEINFO(ChartCost, Q_PRIMITIVE_TYPE);
+
 struct ChartRows
 {
-    ChartRows()
-    {
-        cost.fill(0);
-    }
     enum
     {
-        MAX_NUM_COST = 21
+        // the number of symbols that get their own series by default, next to the total
+        DEFAULT_NUM_SERIES = 20
     };
     // time in ms
     qint64 timeStamp = 0;
-    std::array<qint64, MAX_NUM_COST> cost;
+    qint64 total = 0;
+    // the costs of the series that have a cost at this time, sorted by label
+    // most rows only see a few of the series, so they don't pay for the others
+    QVector<ChartCost> costs;
+
+    /// @return the cost of the series with the given @p label, zero is the total
+    qint64 cost(int label) const
+    {
+        if (label == 0) {
+            return total;
+        }
+        auto it = std::lower_bound(costs.begin(), costs.end(), label, byLabel);
+        return (it != costs.end() && it->label == label) ? it->cost : 0;
+    }
+
+    void addCost(int label, qint64 cost)
+    {
+        if (label == 0) {
+            total += cost;
+            return;
+        }
+        auto it = std::lower_bound(costs.begin(), costs.end(), label, byLabel);
+        if (it != costs.end() && it->label == label) {
+            it->cost += cost;
+        } else {
+            costs.insert(it, {label, cost});
+        }
+    }
+
+private:
+    static bool byLabel(const ChartCost& cost, int label)
+    {
+        return cost.label < label;
+    }
 };
 Q_DECLARE_TYPEINFO(ChartRows, Q_MOVABLE_TYPE);
 
 struct ChartData
 {
+    enum
+    {
+        // the charts show at most that many rows at once, independent of the zoom level
+        MAX_DISPLAYED_ROWS = 500,
+        // the rows get recorded at that many times the displayed resolution, for zooming in
+        ZOOM_RESOLUTION = 32,
+    };
+    // the rows at full resolution
     QVector<ChartRows> rows;
+    // successively downsampled copies of rows, the last one has at most about MAX_DISPLAYED_ROWS
+    QVector<QVector<ChartRows>> levels;
     QHash<int, Symbol> labels;
     std::shared_ptr<const ResultData> resultData;
 };
@@ -50,6 +99,9 @@ public:
         Consumed,
         Allocations,
         Temporary,
+        Mapped,
+        // the allocations per second in the interval before each row
+        AllocationRate,
     };
     explicit ChartModel(Type type, QObject* parent = nullptr);
     virtual ~ChartModel();
@@ -71,14 +123,52 @@ public:
 
     qint64 totalCostAt(qint64 timeStamp) const;
 
+    /// only show the rows between @p startTime and @p endTime, using the finest level that keeps the
+    /// number of rows below ChartData::MAX_DISPLAYED_ROWS
+    void setTimeRange(qint64 startTime, qint64 endTime);
+
+    /// the number of displayed series, including the total
+    int seriesCount() const
+    {
+        return columnCount() / 2;
+    }
+    QColor seriesColor(int series) const;
+
+    /// the rows of the given @p level, -1 for the full resolution rows
+    const QVector<ChartRows>& levelRows(int level) const;
+    int levelCount() const
+    {
+        return m_data.levels.size();
+    }
+    /// the level and its range of rows that got picked by setTimeRange
+    int visibleLevel() const
+    {
+        return m_level;
+    }
+    int firstVisibleRow() const
+    {
+        return m_firstRow;
+    }
+
 public slots:
     void resetData(const ChartData& data);
     void clearData();
 
+signals:
+    /// the data or the number of displayed series changed, unlike for a change of the time range
+    void seriesChanged();
+
 private:
     void resetColors();
+    void updateVisibleRows();
 
     ChartData m_data;
+    qint64 m_startTime = 0;
+    qint64 m_endTime = std::numeric_limits<qint64>::max();
+    // -1 for the full resolution rows, otherwise an index into ChartData::levels
+    int m_level = -1;
+    int m_firstRow = 0;
+    int m_numRows = 0;
     Type m_type;
     // we cache the pens and brushes as constructing them requires allocations
     // otherwise
@@ -38,14 +38,21 @@
 
 #include "chartmodel.h"
 #include "chartproxy.h"
+#include "gui_config.h"
 #include "util.h"
 
+#if HAVE_OPENGL_CHARTS
+#include "chartglview.h"
+#endif
+
 #include <cmath>
 #include <limits>
 
 using namespace KChart;
 
 namespace {
+bool openGLEnabled = true;
+
 KChart::TextAttributes fixupTextAttributes(KChart::TextAttributes attributes, const QPen& foreground, float pointSize)
 {
     attributes.setPen(foreground);
@@ -157,6 +164,15 @@ ChartWidget::ChartWidget(QWidget* parent)
     , m_legend(new Legend(m_chart))
     , m_rubberBand(new ChartRubberBand(this))
 {
+#if HAVE_OPENGL_CHARTS
+    if (openGLEnabled && ChartGLView::isSupported()) {
+        m_glView = new ChartGLView(this);
+        m_chart->hide();
+        // the rubber band must stay on top of the view
+        m_rubberBand->raise();
+    }
+#endif
+
     auto m_chartToolBar = new QToolBar(this);
 
     auto m_exportAsButton = new QPushButton(i18n("Export As..."), this);
@@ -172,16 +188,20 @@ ChartWidget::ChartWidget(QWidget* parent)
     auto m_showTotal = new QCheckBox(i18n("Show total cost graph"), this);
     m_showTotal->setChecked(true);
     connect(m_showTotal, &QCheckBox::toggled, this, [=](bool show) {
-        m_totalPlotter->setHidden(!show);
-        m_chart->update();
+        if (m_totalPlotter) {
+            m_totalPlotter->setHidden(!show);
+            m_chart->update();
+        }
     });
     m_legend->setVisible(m_showLegend->checkState());
 
     auto m_showDetailed = new QCheckBox(i18n("Show detailed cost graph"), this);
     m_showDetailed->setChecked(true);
     connect(m_showDetailed, &QCheckBox::toggled, this, [=](bool show) {
-        m_detailedPlotter->setHidden(!show);
-        m_chart->update();
+        if (m_detailedPlotter) {
+            m_detailedPlotter->setHidden(!show);
+            m_chart->update();
+        }
     });
 
     auto stackedLabel = new QLabel(i18n("Stacked diagrams:"));
@@ -206,6 +226,15 @@ ChartWidget::ChartWidget(QWidget* parent)
     layout->setSpacing(0);
     layout->addWidget(m_chartToolBar);
     layout->addWidget(m_chart);
+#if HAVE_OPENGL_CHARTS
+    if (m_glView) {
+        layout->addWidget(m_glView);
+        connect(m_showLegend, &QCheckBox::toggled, m_glView, &ChartGLView::setShowLegend);
+        connect(m_showTotal, &QCheckBox::toggled, m_glView, &ChartGLView::setShowTotal);
+        connect(m_showDetailed, &QCheckBox::toggled, m_glView, &ChartGLView::setShowDetailed);
+        connect(m_glView, &ChartGLView::axesChanged, this, &ChartWidget::updateRubberBand);
+    }
+#endif
     setLayout(layout);
 
     auto* coordinatePlane = dynamic_cast<CartesianCoordinatePlane*>(m_chart->coordinatePlane());
@@ -213,17 +242,18 @@ ChartWidget::ChartWidget(QWidget* parent)
     coordinatePlane->setAutoAdjustGridToZoom(true);
     connect(coordinatePlane, &CartesianCoordinatePlane::needUpdate, this, &ChartWidget::updateRubberBand);
 
-    m_chart->setCursor(Qt::IBeamCursor);
-    m_chart->setMouseTracking(true);
-    m_chart->installEventFilter(this);
+    auto* view = chartView();
+    view->setCursor(Qt::IBeamCursor);
+    view->setMouseTracking(true);
+    view->installEventFilter(this);
 
-    m_chart->setContextMenuPolicy(Qt::CustomContextMenu);
-    connect(m_chart, &QWidget::customContextMenuRequested, this, [this](const QPoint& point) {
+    view->setContextMenuPolicy(Qt::CustomContextMenu);
+    connect(view, &QWidget::customContextMenuRequested, this, [this](const QPoint& point) {
         if (!m_model)
             return;
 
         const auto isFiltered = m_summaryData.filterParameters.isFilteredByTime(m_summaryData.totalTime);
-        if (!m_selection && !isFiltered)
+        if (!m_selection && !isFiltered && !m_zoom)
             return;
 
         auto* menu = new QMenu(this);
@@ -237,6 +267,14 @@ ChartWidget::ChartWidget(QWidget* parent)
                 const auto endTime = std::max(m_selection.start, m_selection.end);
                 emit filterRequested(startTime, endTime);
             });
+
+            auto* zoom = menu->addAction(QIcon::fromTheme(QStringLiteral("zoom-in")), i18n("Zoom In On Selection"));
+            connect(zoom, &QAction::triggered, this, [this]() { setZoom(m_selection); });
+        }
+
+        if (m_zoom) {
+            auto* resetZoom = menu->addAction(QIcon::fromTheme(QStringLiteral("zoom-original")), i18n("Reset Zoom"));
+            connect(resetZoom, &QAction::triggered, this, [this]() { setZoom({}); });
         }
 
         if (isFiltered) {
@@ -246,12 +284,17 @@ ChartWidget::ChartWidget(QWidget* parent)
                     [this]() { emit filterRequested(0, std::numeric_limits<int64_t>::max()); });
         }
 
-        menu->popup(m_chart->mapToGlobal(point));
+        menu->popup(chartView()->mapToGlobal(point));
     });
 }
 
 ChartWidget::~ChartWidget() = default;
 
+void ChartWidget::setOpenGLEnabled(bool enabled)
+{
+    openGLEnabled = enabled;
+}
+
 void ChartWidget::setSummaryData(const SummaryData& summaryData)
 {
     m_summaryData = summaryData;
@@ -259,6 +302,11 @@ void ChartWidget::setSummaryData(const SummaryData& summaryData)
     if (m_bottomAxis) {
         static_cast<TimeAxis*>(m_bottomAxis)->setSummaryData(summaryData);
     }
+#if HAVE_OPENGL_CHARTS
+    if (m_glView) {
+        m_glView->setSummaryData(summaryData);
+    }
+#endif
 }
 
 void ChartWidget::setModel(ChartModel* model, bool minimalMode)
@@ -267,6 +315,27 @@ void ChartWidget::setModel(ChartModel* model, bool minimalMode)
         return;
     m_model = model;
 
+#if HAVE_OPENGL_CHARTS
+    if (m_glView) {
+        m_glView->setModel(model);
+    } else
+#endif
+    {
+        setupPlotters(model, minimalMode);
+    }
+
+    // If the dataset has 10 entries, one is for the total plot and the
+    // remaining ones are for the detailed plot. We want to only change
+    // the number of detailed plots, so we have to correct it.
+    int maximumDatasetCount = m_model->maximumDatasetCount();
+    m_stackedDiagrams->setValue(maximumDatasetCount - 1);
+
+    updateToolTip();
+    updateAxesTitle();
+}
+
+void ChartWidget::setupPlotters(ChartModel* model, bool minimalMode)
+{
     auto* coordinatePlane = dynamic_cast<CartesianCoordinatePlane*>(m_chart->coordinatePlane());
     Q_ASSERT(coordinatePlane);
     const auto diagrams = coordinatePlane->diagrams();
@@ -340,6 +409,7 @@ void ChartWidget::setModel(ChartModel* model, bool minimalMode)
         m_totalPlotter->addAxis(m_bottomAxis);
 
         m_rightAxis = model->type() == ChartModel::Allocations || model->type() == ChartModel::Temporary
+                || model->type() == ChartModel::AllocationRate
             ? new CartesianAxis(m_totalPlotter)
             : new SizeAxis(m_totalPlotter);
         m_rightAxis->setTextAttributes(axisTextAttributes);
@@ -366,15 +436,38 @@ void ChartWidget::setModel(ChartModel* model, bool minimalMode)
     }
 
     m_legend->hide();
+}
 
-    // If the dataset has 10 entries, one is for the total plot and the
-    // remaining ones are for the detailed plot. We want to only change
-    // the number of detailed plots, so we have to correct it.
-    int maximumDatasetCount = m_model->maximumDatasetCount();
-    m_stackedDiagrams->setValue(maximumDatasetCount - 1);
+QWidget* ChartWidget::chartView() const
+{
+#if HAVE_OPENGL_CHARTS
+    if (m_glView) {
+        return m_glView;
+    }
+#endif
+    return m_chart;
+}
 
-    updateToolTip();
-    updateAxesTitle();
+qreal ChartWidget::timeAt(qreal x) const
+{
+#if HAVE_OPENGL_CHARTS
+    if (m_glView) {
+        return m_glView->timeAt(x);
+    }
+#endif
+    auto* coordinatePlane = static_cast<CartesianCoordinatePlane*>(m_chart->coordinatePlane());
+    return coordinatePlane->translateBack({x, 0}).x();
+}
+
+qreal ChartWidget::positionOf(qreal time) const
+{
+#if HAVE_OPENGL_CHARTS
+    if (m_glView) {
+        return m_glView->positionOf(time);
+    }
+#endif
+    auto* coordinatePlane = static_cast<CartesianCoordinatePlane*>(m_chart->coordinatePlane());
+    return coordinatePlane->translate({time, 0}).x();
 }
 
 void ChartWidget::saveAs()
@@ -388,14 +481,21 @@ void ChartWidget::saveAs()
             // vector graphic format
             QSvgGenerator generator;
             generator.setFileName(saveFilename);
-            generator.setSize(m_chart->size());
-            generator.setViewBox(m_chart->rect());
+            generator.setSize(chartView()->size());
+            generator.setViewBox(chartView()->rect());
 
             QPainter painter;
             painter.begin(&generator);
-            m_chart->paint(&painter, m_chart->rect());
+#if HAVE_OPENGL_CHARTS
+            if (m_glView) {
+                m_glView->paintChart(&painter);
+            } else
+#endif
+            {
+                m_chart->paint(&painter, m_chart->rect());
+            }
             painter.end();
-        } else if (!m_chart->grab().save(saveFilename)) {
+        } else if (!chartView()->grab().save(saveFilename)) {
             // other format
             KMessageBox::error(this, i18n("Failed to save the image to %1", saveFilename));
         }
@@ -433,6 +533,14 @@ void ChartWidget::updateToolTip()
             stream << i18n("<tr><th>Temporary Allocations</th><td>%1</td><td>%2</td><td>%3</td></tr>", startCost,
                            endCost, (endCost - startCost));
             break;
+        case ChartModel::Mapped:
+            stream << i18n("<tr><th>Mapped</th><td>%1</td><td>%2</td><td>%3</td></tr>", Util::formatBytes(startCost),
+                           Util::formatBytes(endCost), Util::formatBytes(endCost - startCost));
+            break;
+        case ChartModel::AllocationRate:
+            stream << i18n("<tr><th>Allocations per Second</th><td>%1</td><td>%2</td><td>%3</td></tr>", startCost,
+                           endCost, (endCost - startCost));
+            break;
         }
         stream << "</table></qt>";
     } else {
@@ -451,6 +559,14 @@ void ChartWidget::updateToolTip()
                            "corresponding deallocation, without other allocations happening "
                            "in-between.<br>Click and drag to select a time range for filtering.</qt>");
             break;
+        case ChartModel::Mapped:
+            toolTip = i18n("<qt>Shows the memory in anonymous memory mappings over time.<br>Click and drag to select a "
+                           "time range for filtering.</qt>");
+            break;
+        case ChartModel::AllocationRate:
+            toolTip = i18n("<qt>Shows the number of memory allocations per second over time, which reveals the phases "
+                           "with a high churn.<br>Click and drag to select a time range for filtering.</qt>");
+            break;
         }
     }
 
@@ -462,18 +578,27 @@ void ChartWidget::updateAxesTitle()
     if (!m_model)
         return;
 
-    // m_bottomAxis is always time, so we can just write it here instead of in headerData().
-    m_bottomAxis->setTitleText(i18n("Elapsed Time"));
-    m_rightAxis->setTitleText(m_model->typeString());
+    // the bottom axis is always time, so we can just write it here instead of in headerData().
+    auto timeTitle = i18n("Elapsed Time");
+    auto costTitle = m_model->typeString();
 
     if (m_summaryData.filterParameters.isFilteredByTime(m_summaryData.totalTime)) {
-        m_bottomAxis->setTitleText(
-            i18n("%1 (filtered from %2 to %3, Δ%4)", m_bottomAxis->titleText(),
+        timeTitle =
+            i18n("%1 (filtered from %2 to %3, Δ%4)", timeTitle,
                  Util::formatTime(m_summaryData.filterParameters.minTime),
                  Util::formatTime(m_summaryData.filterParameters.maxTime),
-                 Util::formatTime(m_summaryData.filterParameters.maxTime - m_summaryData.filterParameters.minTime)));
-        m_rightAxis->setTitleText(i18n("%1 (filtered delta)", m_rightAxis->titleText()));
+                 Util::formatTime(m_summaryData.filterParameters.maxTime - m_summaryData.filterParameters.minTime));
+        costTitle = i18n("%1 (filtered delta)", costTitle);
+    }
+
+#if HAVE_OPENGL_CHARTS
+    if (m_glView) {
+        m_glView->setAxisTitles(timeTitle, costTitle);
+        return;
     }
+#endif
+    m_bottomAxis->setTitleText(timeTitle);
+    m_rightAxis->setTitleText(costTitle);
 }
 
 QSize ChartWidget::sizeHint() const
@@ -494,6 +619,35 @@ void ChartWidget::setSelection(const Range& selection)
     emit selectionChanged(m_selection);
 }
 
+void ChartWidget::setZoom(const Range& zoom)
+{
+    if (!m_model)
+        return;
+
+    m_zoom = zoom;
+
+    // the model picks the resolution for the visible time range, no reparse required
+    auto* coordinatePlane = static_cast<CartesianCoordinatePlane*>(m_chart->coordinatePlane());
+    qint64 startTime = 0;
+    qint64 endTime = 0;
+    if (m_zoom) {
+        startTime = std::min(m_zoom.start, m_zoom.end);
+        endTime = std::max(m_zoom.start, m_zoom.end);
+        m_model->setTimeRange(startTime, endTime);
+    } else {
+        m_model->setTimeRange(0, std::numeric_limits<qint64>::max());
+    }
+    // without a zoom, the empty range lets the plane adjust to the data again
+    coordinatePlane->setHorizontalRange(qMakePair(qreal(startTime), qreal(endTime)));
+#if HAVE_OPENGL_CHARTS
+    if (m_glView) {
+        m_glView->setTimeRange(startTime, endTime);
+    }
+#endif
+
+    updateRubberBand();
+}
+
 void ChartWidget::updateRubberBand()
 {
     if (!m_selection || !m_model) {
@@ -501,10 +655,9 @@ void ChartWidget::updateRubberBand()
         return;
     }
 
-    auto* coordinatePlane = static_cast<CartesianCoordinatePlane*>(m_chart->coordinatePlane());
-    const auto delta = m_chart->pos().x();
-    const auto pixelStart = coordinatePlane->translate({m_selection.start, 0}).x() + delta;
-    const auto pixelEnd = coordinatePlane->translate({m_selection.end, 0}).x() + delta;
+    const auto delta = chartView()->pos().x();
+    const auto pixelStart = positionOf(m_selection.start) + delta;
+    const auto pixelEnd = positionOf(m_selection.end) + delta;
     auto selectionRect = QRect(QPoint(pixelStart, 0), QPoint(pixelEnd, height() - 1));
     m_rubberBand->setGeometry(selectionRect.normalized());
     m_rubberBand->show();
@@ -512,15 +665,12 @@ void ChartWidget::updateRubberBand()
 
 bool ChartWidget::eventFilter(QObject* watched, QEvent* event)
 {
-    Q_ASSERT(watched == m_chart);
+    Q_ASSERT(watched == chartView());
 
     if (!m_model)
         return false;
 
-    auto mapPosToTime = [this](const QPointF& pos) {
-        auto* coordinatePlane = static_cast<CartesianCoordinatePlane*>(m_chart->coordinatePlane());
-        return coordinatePlane->translateBack(pos).x();
-    };
+    auto mapPosToTime = [this](const QPointF& pos) { return timeAt(pos.x()); };
 
     if (auto* mouseEvent = dynamic_cast<QMouseEvent*>(event)) {
         if (mouseEvent->button() == Qt::LeftButton || mouseEvent->buttons() == Qt::LeftButton) {
@@ -530,10 +680,13 @@ bool ChartWidget::eventFilter(QObject* watched, QEvent* event)
             selection.end = time;
             if (event->type() == QEvent::MouseButtonPress) {
                 selection.start = time;
-                m_chart->setCursor(Qt::SizeHorCursor);
-                m_cachedChart = m_chart->grab();
+                chartView()->setCursor(Qt::SizeHorCursor);
+                // the OpenGL view repaints from its buffers, which is fast enough already
+                if (watched == m_chart) {
+                    m_cachedChart = m_chart->grab();
+                }
             } else if (event->type() == QEvent::MouseButtonRelease) {
-                m_chart->setCursor(Qt::IBeamCursor);
+                chartView()->setCursor(Qt::IBeamCursor);
                 m_cachedChart = {};
             }
 
@@ -578,6 +731,14 @@ void ChartWidget::updateStatusTip(qint64 time)
             return i18n("T = %1, Temporary Allocations: %2. Click and drag to select time range for filtering.",
                         Util::formatTime(time), cost);
             break;
+        case ChartModel::Mapped:
+            return i18n("T = %1, Mapped: %2. Click and drag to select time range for filtering.",
+                        Util::formatTime(time), Util::formatBytes(cost));
+            break;
+        case ChartModel::AllocationRate:
+            return i18n("T = %1, Allocations per Second: %2. Click and drag to select time range for filtering.",
+                        Util::formatTime(time), cost);
+            break;
         }
         Q_UNREACHABLE();
     }();
@@ -15,6 +15,7 @@ class QRubberBand;
 class QAbstractItemModel;
 class QSpinBox;
 
+class ChartGLView;
 class ChartModel;
 
 namespace KChart {
@@ -56,8 +57,14 @@ public:
         return m_selection;
     }
 
+    /// show only the time range of @p zoom, or the whole time range when it is empty
+    void setZoom(const Range& zoom);
+
     void setSummaryData(const SummaryData& summaryData);
 
+    /// draw the charts that get created afterwards with OpenGL when it is available, which is the default
+    static void setOpenGLEnabled(bool enabled);
+
 signals:
     void selectionChanged(const Range& range);
     void filterRequested(int64_t minTime, int64_t maxTime);
@@ -66,6 +73,11 @@ public slots:
     void saveAs();
 
 private:
+    void setupPlotters(ChartModel* model, bool minimalMode);
+    /// either the KChart chart or the OpenGL view
+    QWidget* chartView() const;
+    qreal timeAt(qreal x) const;
+    qreal positionOf(qreal time) const;
     void updateToolTip();
     void updateStatusTip(qint64 time);
     void updateAxesTitle();
@@ -79,9 +91,12 @@ private:
     KChart::Legend* m_legend = nullptr;
     KChart::CartesianAxis* m_bottomAxis = nullptr;
     KChart::CartesianAxis* m_rightAxis = nullptr;
+    /// replaces the plotters of m_chart, which then stays hidden, when OpenGL is available
+    ChartGLView* m_glView = nullptr;
     ChartModel* m_model = nullptr;
     QRubberBand* m_rubberBand = nullptr;
     Range m_selection;
+    Range m_zoom;
     SummaryData m_summaryData;
     QPixmap m_cachedChart;
 };
@@ -6,7 +6,9 @@
 
 #include "flamegraph.h"
 
+#include <algorithm>
 #include <cmath>
+#include <limits>
 
 #include <QAction>
 #include <QApplication>
@@ -17,14 +19,14 @@
 #include <QDebug>
 #include <QDoubleSpinBox>
 #include <QEvent>
-#include <QGraphicsRectItem>
-#include <QGraphicsScene>
-#include <QGraphicsView>
 #include <QLabel>
 #include <QLineEdit>
 #include <QMenu>
+#include <QMouseEvent>
+#include <QPainter>
+#include <QPaintEvent>
 #include <QPushButton>
-#include <QStyleOption>
+#include <QScrollArea>
 #include <QToolTip>
 #include <QVBoxLayout>
 #include <QWheelEvent>
@@ -56,298 +58,162 @@ enum SearchMatchType
 };
 }
 
-class FrameGraphicsItem : public QGraphicsRectItem
-{
-public:
-    FrameGraphicsItem(const qint64 cost, CostType costType, const Symbol& symbol,
-                      std::shared_ptr<const ResultData> resultData, FrameGraphicsItem* parent = nullptr);
-    FrameGraphicsItem(const qint64 cost, const Symbol& symbol, std::shared_ptr<const ResultData> resultData,
-                      FrameGraphicsItem* parent);
-
-    qint64 cost() const;
-    void setCost(qint64 cost);
-    Symbol symbol() const;
-
-    void paint(QPainter* painter, const QStyleOptionGraphicsItem* option, QWidget* widget = nullptr) override;
-
-    QString description() const;
-
-    bool match(const QString& searchValue) const;
-    void setSearchMatchType(SearchMatchType matchType);
-
-protected:
-    void hoverEnterEvent(QGraphicsSceneHoverEvent* event) override;
-    void hoverLeaveEvent(QGraphicsSceneHoverEvent* event) override;
-
-private:
-    std::shared_ptr<const ResultData> m_resultData;
-    qint64 m_cost;
-    Symbol m_symbol;
-    CostType m_costType;
-    bool m_isHovered;
-    SearchMatchType m_searchMatch = NoSearch;
+/**
+ * A single frame of the flame graph.
+ *
+ * The frames are stored in a flat array, with the root at index zero. Children always come
+ * after their parent and are chained through nextSibling, in the order they got added.
+ */
+struct FlameGraphFrame
+{
+    Symbol symbol;
+    qint64 cost = 0;
+    int parent = -1;
+    int firstChild = -1;
+    int nextSibling = -1;
+    int depth = 0;
+    quint8 brush = 0;
 };
 
-Q_DECLARE_METATYPE(FrameGraphicsItem*)
-
-FrameGraphicsItem::FrameGraphicsItem(const qint64 cost, CostType costType, const Symbol& symbol,
-                                     std::shared_ptr<const ResultData> resultData, FrameGraphicsItem* parent)
-    : QGraphicsRectItem(parent)
-    , m_resultData(std::move(resultData))
-    , m_cost(cost)
-    , m_symbol(symbol)
-    , m_costType(costType)
-    , m_isHovered(false)
+struct FlameGraphData
 {
-    setFlag(QGraphicsItem::ItemIsSelectable);
-    setAcceptHoverEvents(true);
-}
-
-FrameGraphicsItem::FrameGraphicsItem(const qint64 cost, const Symbol& symbol,
-                                     std::shared_ptr<const ResultData> resultData, FrameGraphicsItem* parent)
-    : FrameGraphicsItem(cost, parent->m_costType, symbol, std::move(resultData), parent)
-{
-}
+    std::shared_ptr<const ResultData> resultData;
+    CostType costType = Allocations;
+    std::vector<FlameGraphFrame> frames;
+    // the lower case function and module names of the frames, indexed by StringIndex::index,
+    // such that a search only needs to match every unique string once
+    QVector<QString> searchStrings;
+    // the search match of every frame, empty when no search is running
+    std::vector<SearchMatchType> searchMatches;
+};
 
-qint64 FrameGraphicsItem::cost() const
-{
-    return m_cost;
-}
+Q_DECLARE_METATYPE(FlameGraphData*)
 
-void FrameGraphicsItem::setCost(qint64 cost)
-{
-    m_cost = cost;
-}
+namespace {
 
-Symbol FrameGraphicsItem::symbol() const
+/**
+ * Generate the brushes from the "mem" color space used in upstream FlameGraph.pl
+ */
+const QVector<QBrush>& brushes()
 {
-    return m_symbol;
+    // intern the brushes, the frames only store an index into this list
+    static const QVector<QBrush> brushes = []() -> QVector<QBrush> {
+        QVector<QBrush> brushes;
+        std::generate_n(std::back_inserter(brushes), 100, []() {
+            return QColor(0, 190 + 50 * qreal(rand()) / RAND_MAX, 210 * qreal(rand()) / RAND_MAX, 125);
+        });
+        return brushes;
+    }();
+    return brushes;
 }
 
-void FrameGraphicsItem::paint(QPainter* painter, const QStyleOptionGraphicsItem* option, QWidget* /*widget*/)
+QString frameLabel(const FlameGraphData& data, int index)
 {
-    if (isSelected() || m_isHovered || m_searchMatch == DirectMatch) {
-        auto selectedColor = brush().color();
-        selectedColor.setAlpha(255);
-        painter->fillRect(rect(), selectedColor);
-    } else if (m_searchMatch == NoMatch) {
-        auto noMatchColor = brush().color();
-        noMatchColor.setAlpha(50);
-        painter->fillRect(rect(), noMatchColor);
-    } else { // default, when no search is running, or a sub-item is matched
-        painter->fillRect(rect(), brush());
-    }
-
-    const QPen oldPen = painter->pen();
-    auto pen = oldPen;
-    if (m_searchMatch != NoMatch) {
-        pen.setColor(brush().color());
-        if (isSelected()) {
-            pen.setWidth(2);
-        }
-        painter->setPen(pen);
-        painter->drawRect(rect());
-        painter->setPen(oldPen);
-    }
-
-    const int margin = 4;
-    const int width = rect().width() - 2 * margin;
-    if (width < option->fontMetrics.averageCharWidth() * 6) {
-        // text is too wide for the current LOD, don't paint it
-        return;
+    const auto& frame = data.frames[index];
+    if (frame.symbol.isValid()) {
+        return data.resultData->string(frame.symbol.functionId);
     }
 
-    if (m_searchMatch == NoMatch) {
-        auto color = oldPen.color();
-        color.setAlpha(125);
-        pen.setColor(color);
-        painter->setPen(pen);
-    }
-
-    auto label = [this]() {
-        if (m_symbol.isValid()) {
-            return m_resultData->string(m_symbol.functionId);
-        }
-
-        // root
-        switch (m_costType) {
-        case Allocations:
-            return i18n("%1 allocations in total", m_cost);
-        case Temporary:
-            return i18n("%1 temporary allocations in total", m_cost);
-        case Peak:
-            return i18n("%1 peak memory consumption", Util::formatBytes(m_cost));
-        case Leaked:
-            return i18n("%1 leaked in total", Util::formatBytes(m_cost));
-        }
-        Q_UNREACHABLE();
-    }();
-
-    const int height = rect().height();
-    painter->drawText(margin + rect().x(), rect().y(), width, height,
-                      Qt::AlignVCenter | Qt::AlignLeft | Qt::TextSingleLine,
-                      option->fontMetrics.elidedText(label, Qt::ElideRight, width));
-
-    if (m_searchMatch == NoMatch) {
-        painter->setPen(oldPen);
+    // root
+    switch (data.costType) {
+    case Allocations:
+        return i18n("%1 allocations in total", frame.cost);
+    case Temporary:
+        return i18n("%1 temporary allocations in total", frame.cost);
+    case Peak:
+        return i18n("%1 peak memory consumption", Util::formatBytes(frame.cost));
+    case Leaked:
+        return i18n("%1 leaked in total", Util::formatBytes(frame.cost));
     }
+    Q_UNREACHABLE();
 }
 
-void FrameGraphicsItem::hoverEnterEvent(QGraphicsSceneHoverEvent* event)
-{
-    QGraphicsRectItem::hoverEnterEvent(event);
-    m_isHovered = true;
-    update();
-}
-
-void FrameGraphicsItem::hoverLeaveEvent(QGraphicsSceneHoverEvent* event)
-{
-    QGraphicsRectItem::hoverLeaveEvent(event);
-    m_isHovered = false;
-    update();
-}
-
-QString FrameGraphicsItem::description() const
+QString frameDescription(const FlameGraphData& data, int index)
 {
-    const auto symbol = Util::toString(m_symbol, *m_resultData, Util::Short);
+    const auto& frame = data.frames[index];
+    const auto symbol = Util::toString(frame.symbol, *data.resultData, Util::Short);
 
     // we build the tooltip text on demand, which is much faster than doing that
-    // for potentially thousands of items when we load the data
-    if (!parentItem()) {
+    // for potentially thousands of frames when we load the data
+    if (index == 0) {
         return symbol;
     }
 
-    qint64 totalCost = 0;
-    {
-        auto item = this;
-        while (item->parentItem()) {
-            item = static_cast<const FrameGraphicsItem*>(item->parentItem());
-        }
-        totalCost = item->cost();
-    }
-    const auto fraction = Util::formatCostRelative(m_cost, totalCost);
+    const auto fraction = Util::formatCostRelative(frame.cost, data.frames.front().cost);
 
     QString tooltip;
-    switch (m_costType) {
+    switch (data.costType) {
     case Allocations:
         tooltip = i18nc("%1: number of allocations, %2: relative number, %3: function label",
-                        "%1 (%2%) allocations in %3 and below.", m_cost, fraction, symbol);
+                        "%1 (%2%) allocations in %3 and below.", frame.cost, fraction, symbol);
         break;
     case Temporary:
         tooltip = i18nc("%1: number of temporary allocations, %2: relative number, "
                         "%3 function label",
-                        "%1 (%2%) temporary allocations in %3 and below.", m_cost, fraction, symbol);
+                        "%1 (%2%) temporary allocations in %3 and below.", frame.cost, fraction, symbol);
         break;
     case Peak:
         tooltip = i18nc("%1: peak consumption in bytes, %2: relative number, %3: "
                         "function label",
-                        "%1 (%2%) contribution to peak consumption in %3 and below.", Util::formatBytes(m_cost),
+                        "%1 (%2%) contribution to peak consumption in %3 and below.", Util::formatBytes(frame.cost),
                         fraction, symbol);
         break;
     case Leaked:
         tooltip = i18nc("%1: leaked bytes, %2: relative number, %3: function label", "%1 (%2%) leaked in %3 and below.",
-                        Util::formatBytes(m_cost), fraction, symbol);
+                        Util::formatBytes(frame.cost), fraction, symbol);
         break;
     }
 
     return tooltip;
 }
 
-bool FrameGraphicsItem::match(const QString& searchValue) const
-{
-    auto match = [&](StringIndex index) {
-        return m_resultData->string(index).contains(searchValue, Qt::CaseInsensitive);
-    };
-    return match(m_symbol.functionId) || match(m_symbol.moduleId);
-}
-
-void FrameGraphicsItem::setSearchMatchType(SearchMatchType matchType)
-{
-    if (m_searchMatch != matchType) {
-        m_searchMatch = matchType;
-        update();
-    }
-}
-
-namespace {
-
-/**
- * Generate a brush from the "mem" color space used in upstream FlameGraph.pl
- */
-QBrush brush()
-{
-    // intern the brushes, to reuse them across items which can be thousands
-    // otherwise we'd end up with dozens of allocations and higher memory
-    // consumption
-    static const QVector<QBrush> brushes = []() -> QVector<QBrush> {
-        QVector<QBrush> brushes;
-        std::generate_n(std::back_inserter(brushes), 100, []() {
-            return QColor(0, 190 + 50 * qreal(rand()) / RAND_MAX, 210 * qreal(rand()) / RAND_MAX, 125);
-        });
-        return brushes;
-    }();
-    return brushes.at(rand() % brushes.size());
-}
-
 /**
- * Layout the flame graph and hide tiny items.
+ * Find the child of @p parent with the given @p symbol and add @p cost to it,
+ * or append a new child when there is none yet.
  */
-void layoutItems(FrameGraphicsItem* parent)
-{
-    const auto& parentRect = parent->rect();
-    const auto pos = parentRect.topLeft();
-    const qreal maxWidth = parentRect.width();
-    const qreal h = parentRect.height();
-    const qreal y_margin = 2.;
-    const qreal y = pos.y() - h - y_margin;
-    qreal x = pos.x();
-
-    const auto children = parent->childItems();
-    for (auto child : children) {
-        auto frameChild = static_cast<FrameGraphicsItem*>(child);
-        const qreal w = maxWidth * double(frameChild->cost()) / parent->cost();
-        frameChild->setVisible(w > 1);
-        if (frameChild->isVisible()) {
-            frameChild->setRect(QRectF(x, y, w, h));
-            layoutItems(frameChild);
-            x += w;
+int addFrame(FlameGraphData* data, int parent, const Symbol& symbol, qint64 cost)
+{
+    auto& frames = data->frames;
+    int lastChild = -1;
+    for (int child = frames[parent].firstChild; child != -1; child = frames[child].nextSibling) {
+        if (frames[child].symbol == symbol) {
+            frames[child].cost += cost;
+            return child;
         }
+        lastChild = child;
     }
-}
 
-FrameGraphicsItem* findItemBySymbol(const QList<QGraphicsItem*>& items, const Symbol& symbol)
-{
-    for (auto item_ : items) {
-        auto item = static_cast<FrameGraphicsItem*>(item_);
-        if (item->symbol() == symbol) {
-            return item;
-        }
+    FlameGraphFrame frame;
+    frame.symbol = symbol;
+    frame.cost = cost;
+    frame.parent = parent;
+    frame.depth = frames[parent].depth + 1;
+    frame.brush = rand() % brushes().size();
+
+    const int index = frames.size();
+    frames.push_back(frame);
+    if (lastChild == -1) {
+        frames[parent].firstChild = index;
+    } else {
+        frames[lastChild].nextSibling = index;
     }
-    return nullptr;
+    return index;
 }
 
 /**
- * Convert the top-down graph into a tree of FrameGraphicsItem.
+ * Convert the top-down graph into the flat list of frames.
  */
-void toGraphicsItems(const std::shared_ptr<const ResultData>& resultData, const QVector<RowData>& data,
-                     FrameGraphicsItem* parent, int64_t AllocationData::*member, const double costThreshold,
-                     bool collapseRecursion)
+void toFrames(FlameGraphData* data, const QVector<RowData>& rows, int parent, int64_t AllocationData::*member,
+              const double costThreshold, bool collapseRecursion)
 {
-    for (const auto& row : data) {
-        if (collapseRecursion && row.symbol.functionId && row.symbol == parent->symbol()) {
-            toGraphicsItems(resultData, row.children, parent, member, costThreshold, collapseRecursion);
+    for (const auto& row : rows) {
+        if (collapseRecursion && row.symbol.functionId && row.symbol == data->frames[parent].symbol) {
+            toFrames(data, row.children, parent, member, costThreshold, collapseRecursion);
             continue;
         }
-        auto item = findItemBySymbol(parent->childItems(), row.symbol);
-        if (!item) {
-            item = new FrameGraphicsItem(row.cost.*member, row.symbol, resultData, parent);
-            item->setPen(parent->pen());
-            item->setBrush(brush());
-        } else {
-            item->setCost(item->cost() + row.cost.*member);
-        }
-        if (item->cost() > costThreshold) {
-            toGraphicsItems(resultData, row.children, item, member, costThreshold, collapseRecursion);
+        const auto frame = addFrame(data, parent, row.symbol, row.cost.*member);
+        if (data->frames[frame].cost > costThreshold) {
+            toFrames(data, row.children, frame, member, costThreshold, collapseRecursion);
         }
     }
 }
@@ -367,63 +233,371 @@ int64_t AllocationData::*memberForType(CostType type)
     Q_UNREACHABLE();
 }
 
-FrameGraphicsItem* parseData(const TreeData& data, CostType type, double costThreshold, bool collapseRecursion)
+void buildSearchStrings(FlameGraphData* data)
+{
+    uint32_t maxIndex = 0;
+    for (const auto& frame : data->frames) {
+        maxIndex = std::max({maxIndex, frame.symbol.functionId.index, frame.symbol.moduleId.index});
+    }
+
+    auto& strings = data->searchStrings;
+    strings.resize(maxIndex + 1);
+    auto add = [&](StringIndex index) {
+        if (index && strings[index.index].isNull()) {
+            strings[index.index] = data->resultData->string(index).toLower();
+        }
+    };
+    for (const auto& frame : data->frames) {
+        add(frame.symbol.functionId);
+        add(frame.symbol.moduleId);
+    }
+}
+
+FlameGraphData* parseData(const TreeData& data, CostType type, double costThreshold, bool collapseRecursion)
 {
     auto member = memberForType(type);
 
     const auto totalCost = data.resultData->totalCosts().*member;
 
-    KColorScheme scheme(QPalette::Active);
-    const QPen pen(scheme.foreground().color());
-
-    auto rootItem = new FrameGraphicsItem(totalCost, type, {}, data.resultData);
-    rootItem->setBrush(scheme.background());
-    rootItem->setPen(pen);
-    toGraphicsItems(data.resultData, data.rows, rootItem, member, totalCost * costThreshold / 100., collapseRecursion);
-    return rootItem;
+    auto parsedData = new FlameGraphData;
+    parsedData->resultData = data.resultData;
+    parsedData->costType = type;
+    parsedData->frames.emplace_back();
+    parsedData->frames.front().cost = totalCost;
+    toFrames(parsedData, data.rows, 0, member, totalCost * costThreshold / 100., collapseRecursion);
+    buildSearchStrings(parsedData);
+    return parsedData;
 }
 
 struct SearchResults
 {
     SearchMatchType matchType = NoMatch;
     qint64 directCost = 0;
+    std::vector<SearchMatchType> matches;
 };
 
-SearchResults applySearch(FrameGraphicsItem* item, const QString& searchValue)
+SearchResults findMatches(const FlameGraphData& data, const QString& searchValue)
 {
-    SearchResults result;
+    SearchResults results;
     if (searchValue.isEmpty()) {
-        result.matchType = NoSearch;
-    } else if (item->match(searchValue)) {
-        result.directCost += item->cost();
-        result.matchType = DirectMatch;
-    }
-
-    // recurse into the child items, we always need to update all items
-    for (auto* child : item->childItems()) {
-        auto* childFrame = static_cast<FrameGraphicsItem*>(child);
-        auto childMatch = applySearch(childFrame, searchValue);
-        if (result.matchType != DirectMatch
-            && (childMatch.matchType == DirectMatch || childMatch.matchType == ChildMatch)) {
-            result.matchType = ChildMatch;
-            result.directCost += childMatch.directCost;
-        }
+        results.matchType = NoSearch;
+        return results;
     }
 
-    item->setSearchMatchType(result.matchType);
-    return result;
+    const auto needle = searchValue.toLower();
+    const auto& strings = data.searchStrings;
+    std::vector<bool> matchedStrings(strings.size(), false);
+    for (int i = 0, c = strings.size(); i < c; ++i) {
+        matchedStrings[i] = !strings[i].isEmpty() && strings[i].contains(needle);
+    }
+    auto match = [&](StringIndex index) { return matchedStrings[index.index]; };
+
+    // children always come after their parent, so a single reverse pass
+    // propagates the matches up to the root
+    const auto& frames = data.frames;
+    auto& matches = results.matches;
+    matches.assign(frames.size(), NoMatch);
+    std::vector<qint64> directCosts(frames.size(), 0);
+    for (auto i = frames.size(); i > 0; --i) {
+        const auto index = i - 1;
+        const auto& frame = frames[index];
+        if (match(frame.symbol.functionId) || match(frame.symbol.moduleId)) {
+            matches[index] = DirectMatch;
+            directCosts[index] = frame.cost;
+        }
+        if (frame.parent != -1 && matches[index] != NoMatch) {
+            matches[frame.parent] = ChildMatch;
+            directCosts[frame.parent] += directCosts[index];
+        }
+    }
+    results.matchType = matches.front();
+    results.directCost = directCosts.front();
+    return results;
 }
 }
 
+/**
+ * Paints the frames of a FlameGraphData.
+ *
+ * Instead of creating one item per frame, the layout is computed while painting and hit testing.
+ * Only frames that are at least one pixel wide and intersect the exposed area are visited, such
+ * that the costs depend on the visible pixels rather than the size of the tree.
+ */
+class FlameGraphView : public QWidget
+{
+public:
+    explicit FlameGraphView(QWidget* parent = nullptr)
+        : QWidget(parent)
+    {
+        setMouseTracking(true);
+        setFont(QFont(QStringLiteral("monospace")));
+        setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding);
+    }
+
+    void setFrames(const FlameGraphData* data)
+    {
+        m_data = data;
+        m_selectedFrame = data ? 0 : -1;
+        m_hoveredFrame = -1;
+        updateMinimumHeight();
+        update();
+    }
+
+    void setSelectedFrame(int frame)
+    {
+        m_selectedFrame = frame;
+        updateMinimumHeight();
+        update();
+    }
+
+    /// @return the frame at @p pos, or -1 when there is none
+    int frameAt(const QPoint& pos) const
+    {
+        if (!m_data || m_selectedFrame == -1 || pos.x() < 0 || pos.x() >= width() || pos.y() >= height()) {
+            return -1;
+        }
+
+        const int depth = (height() - 1 - pos.y()) / rowPitch();
+        if (pos.y() >= rowY(depth) + itemHeight()) {
+            // the margin between two rows
+            return -1;
+        }
+
+        const auto& frames = m_data->frames;
+        int frame = m_selectedFrame;
+        if (depth <= frames[frame].depth) {
+            // the parents of the selected frame cover the full width
+            while (frames[frame].depth > depth) {
+                frame = frames[frame].parent;
+            }
+            return frame;
+        }
+
+        qreal x = 0;
+        qreal w = width();
+        while (frames[frame].depth < depth) {
+            const auto& parent = frames[frame];
+            if (parent.cost <= 0) {
+                return -1;
+            }
+            int found = -1;
+            for (int child = parent.firstChild; child != -1; child = frames[child].nextSibling) {
+                const qreal childWidth = w * double(frames[child].cost) / parent.cost;
+                if (childWidth >= 1 && pos.x() >= x && pos.x() < x + childWidth) {
+                    found = child;
+                    w = childWidth;
+                    break;
+                }
+                x += childWidth;
+            }
+            if (found == -1) {
+                return -1;
+            }
+            frame = found;
+        }
+        return frame;
+    }
+
+    QRect frameRect(int frame) const
+    {
+        return QRect(0, rowY(m_data->frames[frame].depth), width(), itemHeight());
+    }
+
+protected:
+    void paintEvent(QPaintEvent* event) override
+    {
+        QPainter painter(this);
+        if (!m_data) {
+            painter.drawText(rect(), Qt::AlignCenter, i18n("generating flame graph..."));
+            return;
+        }
+
+        KColorScheme scheme(QPalette::Active);
+        const auto rootColor = scheme.background().color();
+        painter.setPen(scheme.foreground().color());
+        forEachVisibleFrame(event->rect(), [&](int frame, const QRectF& rect) {
+            const auto color = frame == 0 ? rootColor : brushes().at(m_data->frames[frame].brush).color();
+            paintFrame(&painter, frame, rect, color);
+        });
+    }
+
+    void resizeEvent(QResizeEvent* event) override
+    {
+        QWidget::resizeEvent(event);
+        if (event->oldSize().width() != width()) {
+            updateMinimumHeight();
+        }
+    }
+
+    void mouseMoveEvent(QMouseEvent* event) override
+    {
+        setHoveredFrame(frameAt(event->pos()));
+        QWidget::mouseMoveEvent(event);
+    }
+
+    void leaveEvent(QEvent* event) override
+    {
+        setHoveredFrame(-1);
+        QWidget::leaveEvent(event);
+    }
+
+private:
+    int itemHeight() const
+    {
+        return fontMetrics().height() + 4;
+    }
+
+    int rowPitch() const
+    {
+        const int yMargin = 2;
+        return itemHeight() + yMargin;
+    }
+
+    /// the root is at the bottom, children are stacked above their parents
+    int rowY(int depth) const
+    {
+        return height() - (depth + 1) * rowPitch();
+    }
+
+    void setHoveredFrame(int frame)
+    {
+        if (m_hoveredFrame != frame) {
+            m_hoveredFrame = frame;
+            update();
+        }
+    }
+
+    void updateMinimumHeight()
+    {
+        int depth = 0;
+        if (m_data) {
+            const int limit = std::numeric_limits<int>::max() / 2;
+            forEachVisibleFrame(QRect(QPoint(0, -limit), QPoint(width(), limit)), [&](int frame, const QRectF&) {
+                depth = std::max(depth, m_data->frames[frame].depth);
+            });
+        }
+        setMinimumHeight((depth + 1) * rowPitch());
+    }
+
+    /**
+     * Invoke @p callback for every frame that intersects @p clip and is at least one pixel wide.
+     *
+     * The selected frame and its parents span the full width, all frames below it are laid out
+     * relative to their cost.
+     */
+    template <typename Callback>
+    void forEachVisibleFrame(const QRect& clip, Callback callback) const
+    {
+        if (m_selectedFrame == -1) {
+            return;
+        }
+
+        const auto& frames = m_data->frames;
+        const QRectF clipRect(clip);
+        for (int frame = m_selectedFrame; frame != -1; frame = frames[frame].parent) {
+            const QRectF rect(0, rowY(frames[frame].depth), width(), itemHeight());
+            if (rect.intersects(clipRect)) {
+                callback(frame, rect);
+            }
+        }
+        forEachVisibleChild(m_selectedFrame, 0, width(), clipRect, callback);
+    }
+
+    template <typename Callback>
+    void forEachVisibleChild(int parent, qreal x, qreal w, const QRectF& clip, Callback& callback) const
+    {
+        const auto& frames = m_data->frames;
+        const auto& parentFrame = frames[parent];
+        if (parentFrame.firstChild == -1 || parentFrame.cost <= 0) {
+            return;
+        }
+
+        const qreal y = rowY(parentFrame.depth + 1);
+        if (y + itemHeight() < clip.top()) {
+            // all children are further up and thus not visible either
+            return;
+        }
+
+        for (int child = parentFrame.firstChild; child != -1; child = frames[child].nextSibling) {
+            const qreal childWidth = w * double(frames[child].cost) / parentFrame.cost;
+            if (childWidth >= 1 && x <= clip.right() && x + childWidth >= clip.left()) {
+                const QRectF rect(x, y, childWidth, itemHeight());
+                if (rect.intersects(clip)) {
+                    callback(child, rect);
+                }
+                forEachVisibleChild(child, x, childWidth, clip, callback);
+            }
+            x += childWidth;
+        }
+    }
+
+    void paintFrame(QPainter* painter, int index, const QRectF& rect, QColor color) const
+    {
+        const auto searchMatch = m_data->searchMatches.empty() ? NoSearch : m_data->searchMatches[index];
+        const bool isSelected = index == m_selectedFrame;
+
+        if (isSelected || index == m_hoveredFrame || searchMatch == DirectMatch) {
+            auto selectedColor = color;
+            selectedColor.setAlpha(255);
+            painter->fillRect(rect, selectedColor);
+        } else if (searchMatch == NoMatch) {
+            auto noMatchColor = color;
+            noMatchColor.setAlpha(50);
+            painter->fillRect(rect, noMatchColor);
+        } else { // default, when no search is running, or a sub-item is matched
+            painter->fillRect(rect, color);
+        }
+
+        const QPen oldPen = painter->pen();
+        auto pen = oldPen;
+        if (searchMatch != NoMatch) {
+            pen.setColor(color);
+            if (isSelected) {
+                pen.setWidth(2);
+            }
+            painter->setPen(pen);
+            painter->drawRect(rect);
+            painter->setPen(oldPen);
+        }
+
+        const int margin = 4;
+        const int width = rect.width() - 2 * margin;
+        const auto metrics = fontMetrics();
+        if (width < metrics.averageCharWidth() * 6) {
+            // text is too wide for the current LOD, don't paint it
+            return;
+        }
+
+        if (searchMatch == NoMatch) {
+            auto textColor = oldPen.color();
+            textColor.setAlpha(125);
+            pen.setColor(textColor);
+            painter->setPen(pen);
+        }
+
+        painter->drawText(QRectF(margin + rect.x(), rect.y(), width, rect.height()),
+                          Qt::AlignVCenter | Qt::AlignLeft | Qt::TextSingleLine,
+                          metrics.elidedText(frameLabel(*m_data, index), Qt::ElideRight, width));
+
+        if (searchMatch == NoMatch) {
+            painter->setPen(oldPen);
+        }
+    }
+
+    const FlameGraphData* m_data = nullptr;
+    int m_selectedFrame = -1;
+    int m_hoveredFrame = -1;
+};
+
 FlameGraph::FlameGraph(QWidget* parent)
     : QWidget(parent)
     , m_costSource(new QComboBox(this))
-    , m_scene(new QGraphicsScene(this))
-    , m_view(new QGraphicsView(this))
+    , m_scrollArea(new QScrollArea(this))
+    , m_view(new FlameGraphView(m_scrollArea))
     , m_displayLabel(new QLabel)
     , m_searchResultsLabel(new QLabel)
 {
-    qRegisterMetaType<FrameGraphicsItem*>();
+    qRegisterMetaType<FlameGraphData*>();
 
     m_costSource->addItem(i18n("Memory Peak"), QVariant::fromValue(Peak));
     m_costSource->setItemData(2,
@@ -451,11 +625,10 @@ FlameGraph::FlameGraph(QWidget* parent)
             &FlameGraph::showData);
     m_costSource->setToolTip(i18n("Select the data source that should be visualized in the flame graph."));
 
-    m_scene->setItemIndexMethod(QGraphicsScene::NoIndex);
-    m_view->setScene(m_scene);
-    m_view->viewport()->installEventFilter(this);
-    m_view->viewport()->setMouseTracking(true);
-    m_view->setFont(QFont(QStringLiteral("monospace")));
+    m_scrollArea->setWidgetResizable(true);
+    m_scrollArea->setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
+    m_scrollArea->setWidget(m_view);
+    m_view->installEventFilter(this);
 
     m_backButton = new QPushButton(this);
     m_backButton->setIcon(QIcon::fromTheme(QStringLiteral("go-previous")));
@@ -530,7 +703,7 @@ FlameGraph::FlameGraph(QWidget* parent)
     layout()->setContentsMargins(0, 0, 0, 0);
     layout()->setSpacing(0);
     layout()->addWidget(controls);
-    layout()->addWidget(m_view);
+    layout()->addWidget(m_scrollArea);
     layout()->addWidget(m_displayLabel);
     layout()->addWidget(m_searchResultsLabel);
 
@@ -551,13 +724,15 @@ FlameGraph::FlameGraph(QWidget* parent)
     connect(m_view, &QWidget::customContextMenuRequested, this, [this](const QPoint& point) {
         auto* menu = new QMenu(this);
         menu->setAttribute(Qt::WA_DeleteOnClose, true);
-        if (auto item = static_cast<const FrameGraphicsItem*>(m_view->itemAt(point))) {
+        const auto frame = m_view->frameAt(point);
+        if (frame != -1) {
+            const auto symbol = m_data->frames[frame].symbol;
             auto* action = menu->addAction(i18n("View Caller/Callee"));
-            connect(action, &QAction::triggered, this,
-                    [this, item]() { emit callerCalleeViewRequested(item->symbol()); });
+            connect(action, &QAction::triggered, this, [this, symbol]() { emit callerCalleeViewRequested(symbol); });
 
+            const auto description = frameDescription(*m_data, frame);
             auto* copy = menu->addAction(QIcon::fromTheme(QStringLiteral("edit-copy")), tr("Copy"));
-            connect(copy, &QAction::triggered, this, [item]() { qApp->clipboard()->setText(item->description()); });
+            connect(copy, &QAction::triggered, this, [description]() { qApp->clipboard()->setText(description); });
 
             menu->addSeparator();
         }
@@ -575,36 +750,32 @@ bool FlameGraph::eventFilter(QObject* object, QEvent* event)
     if (event->type() == QEvent::MouseButtonRelease) {
         QMouseEvent* mouseEvent = static_cast<QMouseEvent*>(event);
         if (mouseEvent->button() == Qt::LeftButton) {
-            auto item = static_cast<FrameGraphicsItem*>(m_view->itemAt(mouseEvent->pos()));
-            if (item && item != m_selectionHistory.at(m_selectedItem)) {
-                selectItem(item);
+            const auto frame = m_view->frameAt(mouseEvent->pos());
+            if (frame != -1 && frame != m_selectionHistory.at(m_selectedItem)) {
+                selectFrame(frame);
                 if (m_selectedItem != m_selectionHistory.size() - 1) {
                     m_selectionHistory.remove(m_selectedItem + 1, m_selectionHistory.size() - m_selectedItem - 1);
                 }
                 m_selectedItem = m_selectionHistory.size();
-                m_selectionHistory.push_back(item);
+                m_selectionHistory.push_back(frame);
                 updateNavigationActions();
             }
         }
     } else if (event->type() == QEvent::MouseMove) {
         QMouseEvent* mouseEvent = static_cast<QMouseEvent*>(event);
-        auto item = static_cast<FrameGraphicsItem*>(m_view->itemAt(mouseEvent->pos()));
-        setTooltipItem(item);
+        setTooltipItem(m_view->frameAt(mouseEvent->pos()));
     } else if (event->type() == QEvent::Leave) {
-        setTooltipItem(nullptr);
+        setTooltipItem(-1);
     } else if (event->type() == QEvent::Resize || event->type() == QEvent::Show) {
-        if (!m_rootItem) {
-            if (!m_buildingScene) {
-                showData();
-            }
-        } else {
-            selectItem(m_selectionHistory.at(m_selectedItem));
+        // the frames are laid out while painting, so only the initial data needs to be requested here
+        if (!m_data && !m_buildingScene) {
+            showData();
         }
         updateTooltip();
     } else if (event->type() == QEvent::ToolTip) {
         auto tooltip = m_displayLabel->toolTip();
 
-        if (m_tooltipItem != m_view->itemAt(m_view->mapFromGlobal(QCursor::pos()))) {
+        if (m_tooltipItem != m_view->frameAt(m_view->mapFromGlobal(QCursor::pos()))) {
             // don't show a tooltip when the cursor is in the empty region
             tooltip.clear();
         }
@@ -658,59 +829,53 @@ void FlameGraph::showData()
     auto threshold = m_costThreshold;
     stream() << make_job([data, source, threshold, collapseRecursion, this]() {
         auto parsedData = parseData(data, source, threshold, collapseRecursion);
-        QMetaObject::invokeMethod(this, "setData", Qt::QueuedConnection, Q_ARG(FrameGraphicsItem*, parsedData));
+        QMetaObject::invokeMethod(this, "setData", Qt::QueuedConnection, Q_ARG(FlameGraphData*, parsedData));
     });
 }
 
-void FlameGraph::setTooltipItem(const FrameGraphicsItem* item)
+void FlameGraph::setTooltipItem(int frame)
 {
-    if (!item && m_selectedItem != -1 && m_selectionHistory.at(m_selectedItem)) {
-        item = m_selectionHistory.at(m_selectedItem);
+    if (frame == -1 && m_data && m_selectedItem != -1) {
+        frame = m_selectionHistory.at(m_selectedItem);
         m_view->setCursor(Qt::ArrowCursor);
     } else {
         m_view->setCursor(Qt::PointingHandCursor);
     }
-    m_tooltipItem = item;
+    m_tooltipItem = frame;
     updateTooltip();
 }
 
 void FlameGraph::updateTooltip()
 {
-    const auto text = m_tooltipItem ? m_tooltipItem->description() : QString();
+    const auto text = (m_data && m_tooltipItem != -1) ? frameDescription(*m_data, m_tooltipItem) : QString();
     m_displayLabel->setToolTip(text);
     const auto metrics = m_displayLabel->fontMetrics();
     m_displayLabel->setText(metrics.elidedText(text, Qt::ElideRight, m_displayLabel->width()));
 }
 
-void FlameGraph::setData(FrameGraphicsItem* rootItem)
+void FlameGraph::setData(FlameGraphData* data)
 {
-    m_scene->clear();
+    m_view->setFrames(data);
+    m_data.reset(data);
     m_buildingScene = false;
-    m_tooltipItem = nullptr;
-    m_rootItem = rootItem;
+    m_tooltipItem = -1;
     m_selectionHistory.clear();
-    m_selectionHistory.push_back(rootItem);
+    m_selectionHistory.push_back(0);
     m_selectedItem = 0;
     updateNavigationActions();
-    if (!rootItem) {
-        auto text = m_scene->addText(i18n("generating flame graph..."));
-        m_view->centerOn(text);
+    if (!data) {
         m_view->setCursor(Qt::BusyCursor);
         return;
     }
 
     m_view->setCursor(Qt::ArrowCursor);
-    // layouting needs a root item with a given height, the rest will be
-    // overwritten later
-    rootItem->setRect(0, 0, 800, m_view->fontMetrics().height() + 4);
-    m_scene->addItem(rootItem);
 
     if (!m_searchInput->text().isEmpty()) {
         setSearchValue(m_searchInput->text());
     }
 
     if (isVisible()) {
-        selectItem(m_rootItem);
+        selectFrame(0);
     }
 }
 
@@ -718,65 +883,82 @@ void FlameGraph::selectItem(int item)
 {
     m_selectedItem = item;
     updateNavigationActions();
-    selectItem(m_selectionHistory.at(m_selectedItem));
+    selectFrame(m_selectionHistory.at(m_selectedItem));
 }
 
-void FlameGraph::selectItem(FrameGraphicsItem* item)
+void FlameGraph::selectFrame(int frame)
 {
-    if (!item) {
+    if (!m_data) {
         return;
     }
 
-    // scale item and its parents to the maximum available width
-    // also hide all siblings of the parent items
-    const auto rootWidth = m_view->viewport()->width() - 40;
-    auto parent = item;
-    while (parent) {
-        auto rect = parent->rect();
-        rect.setLeft(0);
-        rect.setWidth(rootWidth);
-        parent->setRect(rect);
-        if (parent->parentItem()) {
-            const auto children = parent->parentItem()->childItems();
-            for (auto sibling : children) {
-                sibling->setVisible(sibling == parent);
-            }
-        }
-        parent = static_cast<FrameGraphicsItem*>(parent->parentItem());
-    }
-
-    // then layout all items below the selected on
-    layoutItems(item);
+    m_view->setSelectedFrame(frame);
 
-    // and make sure it's visible
-    m_view->centerOn(item);
+    // make sure it's visible once the scroll area picked up the new minimum height
+    QMetaObject::invokeMethod(
+        this,
+        [this, frame]() {
+            if (m_data && frame < static_cast<int>(m_data->frames.size())) {
+                const auto rect = m_view->frameRect(frame);
+                m_scrollArea->ensureVisible(rect.center().x(), rect.center().y(), 0, rect.height());
+            }
+        },
+        Qt::QueuedConnection);
 
-    setTooltipItem(item);
+    setTooltipItem(frame);
 }
 
 void FlameGraph::setSearchValue(const QString& value)
 {
-    if (!m_rootItem) {
+    if (!m_data) {
+        return;
+    }
+
+    const auto generation = ++m_searchGeneration;
+    if (value.isEmpty()) {
+        m_data->searchMatches.clear();
+        setSearchResults(value, 0);
         return;
     }
 
-    auto match = applySearch(m_rootItem, value);
+    // match on a worker thread to keep the UI responsive while typing
+    using namespace ThreadWeaver;
+    std::shared_ptr<const FlameGraphData> data = m_data;
+    stream() << make_job([this, data, value, generation]() {
+        auto results = findMatches(*data, value);
+        QMetaObject::invokeMethod(
+            this,
+            [this, data, value, generation, results]() {
+                // ignore outdated results, when the user kept on typing or the data changed meanwhile
+                if (generation == m_searchGeneration && data == m_data) {
+                    m_data->searchMatches = results.matches;
+                    setSearchResults(value, results.directCost);
+                }
+            },
+            Qt::QueuedConnection);
+    });
+}
+
+void FlameGraph::setSearchResults(const QString& value, qint64 directCost)
+{
+    m_view->update();
 
+    const auto totalCost = m_data->frames.front().cost;
     if (value.isEmpty()) {
         m_searchResultsLabel->hide();
     } else {
         QString label;
-        const auto costFraction = Util::formatCostRelative(match.directCost, m_rootItem->cost());
+        const auto costFraction = Util::formatCostRelative(directCost, totalCost);
         switch (m_costSource->currentData().value<CostType>()) {
         case Allocations:
         case Temporary:
-            label = i18n("%1 (%2% of total of %3) allocations matched by search.", match.directCost, costFraction,
-                         m_rootItem->cost());
+            label = i18n("%1 (%2% of total of %3) allocations matched by search.", directCost, costFraction,
+                         totalCost);
             break;
         case Peak:
         case Leaked:
-            label = i18n("%1 (%2% of total of %3) matched by search.", Util::formatBytes(match.directCost),
-                         costFraction, Util::formatBytes(m_rootItem->cost()));
+            label = i18n("%1 (%2% of total of %3) matched by search.", Util::formatBytes(directCost), costFraction,
+                         Util::formatBytes(totalCost));
             break;
         }
         m_searchResultsLabel->setText(label);
@@ -7,19 +7,21 @@
 #ifndef FLAMEGRAPH_H
 #define FLAMEGRAPH_H
 
+#include <memory>
+
 #include <QVector>
 #include <QWidget>
 
 #include "treemodel.h"
 
-class QGraphicsScene;
-class QGraphicsView;
 class QComboBox;
 class QLabel;
 class QLineEdit;
 class QPushButton;
+class QScrollArea;
 
-class FrameGraphicsItem;
+struct FlameGraphData;
+class FlameGraphView;
 
 class FlameGraph : public QWidget
 {
@@ -37,7 +39,7 @@ protected:
     bool eventFilter(QObject* object, QEvent* event) override;
 
 private slots:
-    void setData(FrameGraphicsItem* rootItem);
+    void setData(FlameGraphData* data);
     void setSearchValue(const QString& value);
     void navigateBack();
     void navigateForward();
@@ -46,19 +48,20 @@ signals:
     void callerCalleeViewRequested(const Symbol& symbol);
 
 private:
-    void setTooltipItem(const FrameGraphicsItem* item);
+    void setTooltipItem(int frame);
     void updateTooltip();
+    void setSearchResults(const QString& value, qint64 directCost);
     void showData();
     void selectItem(int item);
-    void selectItem(FrameGraphicsItem* item);
+    void selectFrame(int frame);
     void updateNavigationActions();
 
     TreeData m_topDownData;
     TreeData m_bottomUpData;
 
     QComboBox* m_costSource;
-    QGraphicsScene* m_scene;
-    QGraphicsView* m_view;
+    QScrollArea* m_scrollArea;
+    FlameGraphView* m_view;
     QLabel* m_displayLabel;
     QLabel* m_searchResultsLabel;
     QLineEdit* m_searchInput = nullptr;
@@ -67,13 +70,16 @@ private:
     QAction* m_resetAction = nullptr;
     QPushButton* m_backButton = nullptr;
     QPushButton* m_forwardButton = nullptr;
-    const FrameGraphicsItem* m_tooltipItem = nullptr;
-    FrameGraphicsItem* m_rootItem = nullptr;
-    QVector<FrameGraphicsItem*> m_selectionHistory;
+    // frames are referenced by their index in m_data
+    int m_tooltipItem = -1;
+    std::shared_ptr<FlameGraphData> m_data;
+    QVector<int> m_selectionHistory;
     int m_selectedItem = -1;
     bool m_showBottomUpData = false;
     bool m_collapseRecursion = true;
     bool m_buildingScene = false;
+    // incremented for every search, to discard results of outdated searches
+    uint m_searchGeneration = 0;
     // cost threshold in percent, items below that value will not be shown
     double m_costThreshold = 0.1;
 };
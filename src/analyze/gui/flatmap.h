@@ -0,0 +1,92 @@
+/*
+    SPDX-FileCopyrightText: 2026 Milian Wolff <mail@milianw.de>
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#ifndef FLATMAP_H
+#define FLATMAP_H
+
+#include <QVector>
+
+#include <algorithm>
+#include <utility>
+
+/**
+ * A read-only map that stores its keys and its values in two vectors, sorted by key.
+ *
+ * Unlike QHash, it doesn't allocate a node per entry, and the models can show the keys and the values
+ * without copying them. Like the Qt containers, copies share the data implicitly.
+ */
+template <typename Key, typename Value>
+class FlatMap
+{
+public:
+    using key_type = Key;
+    using mapped_type = Value;
+
+    FlatMap() = default;
+
+    /// @p keys must be sorted and unique, @p values holds the value of every key at the same position
+    FlatMap(QVector<Key> keys, QVector<Value> values)
+        : m_keys(std::move(keys))
+        , m_values(std::move(values))
+    {
+        Q_ASSERT(m_keys.size() == m_values.size());
+    }
+
+    int size() const
+    {
+        return m_keys.size();
+    }
+
+    int count() const
+    {
+        return m_keys.size();
+    }
+
+    bool isEmpty() const
+    {
+        return m_keys.isEmpty();
+    }
+
+    const QVector<Key>& keys() const
+    {
+        return m_keys;
+    }
+
+    const QVector<Value>& values() const
+    {
+        return m_values;
+    }
+
+    /// @return the position of @p key in keys() and values(), or -1 when the map doesn't contain it
+    int indexOf(const Key& key) const
+    {
+        auto it = std::lower_bound(m_keys.begin(), m_keys.end(), key);
+        return (it != m_keys.end() && *it == key) ? static_cast<int>(std::distance(m_keys.begin(), it)) : -1;
+    }
+
+    bool contains(const Key& key) const
+    {
+        return indexOf(key) != -1;
+    }
+
+    /// @return the value of @p key, or a default constructed value when the map doesn't contain it
+    Value value(const Key& key) const
+    {
+        const auto index = indexOf(key);
+        return index == -1 ? Value() : m_values[index];
+    }
+
+    Value operator[](const Key& key) const
+    {
+        return value(key);
+    }
+
+private:
+    QVector<Key> m_keys;
+    QVector<Value> m_values;
+};
+
+#endif // FLATMAP_H
@@ -14,8 +14,13 @@
 #include "analyze/suppressions.h"
 #include "util/config.h"
 
+#include "chartmodel.h"
 #include "gui_config.h"
+#if KChart_FOUND
+#include "chartwidget.h"
+#endif
 #include "mainwindow.h"
+#include "parser.h"
 #include "proxystyle.h"
 
 #include <KIconTheme>
@@ -105,6 +110,42 @@ int main(int argc, char** argv)
             "Ignore suppression definitions that are built into heaptrack. By default, heaptrack will suppress certain "
             "known leaks in common system libraries.")};
     parser.addOption(disableBuiltinSuppressionsOption);
+    QCommandLineOption minSizeOption {{QStringLiteral("min-size")},
+                                      i18n("Only account for allocations of at least the given number of bytes."),
+                                      QStringLiteral("<bytes>")};
+    parser.addOption(minSizeOption);
+    QCommandLineOption maxSizeOption {{QStringLiteral("max-size")},
+                                      i18n("Only account for allocations of at most the given number of bytes."),
+                                      QStringLiteral("<bytes>")};
+    parser.addOption(maxSizeOption);
+    QCommandLineOption minLifetimeOption {
+        {QStringLiteral("min-lifetime")},
+        i18n("Only account for allocations that stay alive for at least the given number of milliseconds. The "
+             "allocations then show up in the data once they reached that age."),
+        QStringLiteral("<ms>")};
+    parser.addOption(minLifetimeOption);
+    QCommandLineOption chartSeriesOption {
+        {QStringLiteral("chart-series")},
+        i18n("The number of symbols that get their own series in the charts, defaults to %1.",
+             int(ChartRows::DEFAULT_NUM_SERIES)),
+        QStringLiteral("<count>")};
+    parser.addOption(chartSeriesOption);
+    QCommandLineOption sizeHistogramOption {
+        {QStringLiteral("size-histogram-buckets")},
+        i18n("A comma separated, ascending list of the largest allocation size in bytes of each row in the size "
+             "histogram, defaults to 8,16,32,64,128,256,512,1024. Larger allocations get a final row of their own."),
+        QStringLiteral("<bytes,...>")};
+    parser.addOption(sizeHistogramOption);
+    QCommandLineOption noCacheOption {
+        {QStringLiteral("no-cache")},
+        i18n("Neither load the results from nor store them in the cache file next to the data file. By default, the "
+             "results of parsing a file get stored in a .cache file next to it, which makes opening it again fast.")};
+    parser.addOption(noCacheOption);
+    QCommandLineOption noOpenGLChartsOption {
+        {QStringLiteral("no-opengl-charts")},
+        i18n("Draw the charts with KChart instead of OpenGL, e.g. when the OpenGL driver causes trouble. By default, "
+             "OpenGL gets used when it is available.")};
+    parser.addOption(noOpenGLChartsOption);
     parser.addPositionalArgument(QStringLiteral("files"), i18n("Files to load"), i18n("[FILE...]"));
 
     parser.process(app);
@@ -116,12 +157,59 @@ int main(int argc, char** argv)
         return 1;
     }
 
+    FilterParameters allocationFilter;
+    auto parseFilterOption = [&](const QCommandLineOption& option, auto* value) {
+        if (!parser.isSet(option)) {
+            return true;
+        }
+        bool ok = false;
+        const auto parsed = parser.value(option).toLongLong(&ok);
+        if (!ok || parsed < 0) {
+            qWarning("Invalid value for --%ls: %ls", qUtf16Printable(option.names().constFirst()),
+                     qUtf16Printable(parser.value(option)));
+            return false;
+        }
+        *value = parsed;
+        return true;
+    };
+    if (!parseFilterOption(minSizeOption, &allocationFilter.minSize)
+        || !parseFilterOption(maxSizeOption, &allocationFilter.maxSize)
+        || !parseFilterOption(minLifetimeOption, &allocationFilter.minLifetime)) {
+        return 1;
+    }
+    int chartSeriesCount = ChartRows::DEFAULT_NUM_SERIES;
+    if (!parseFilterOption(chartSeriesOption, &chartSeriesCount)) {
+        return 1;
+    }
+    auto sizeHistogramBuckets = Parser::defaultSizeHistogramBuckets();
+    if (parser.isSet(sizeHistogramOption)) {
+        sizeHistogramBuckets.clear();
+        const auto buckets = parser.value(sizeHistogramOption).split(QLatin1Char(','));
+        for (const auto& bucket : buckets) {
+            bool ok = false;
+            const auto size = bucket.trimmed().toULongLong(&ok);
+            if (!ok || (!sizeHistogramBuckets.isEmpty() && size <= sizeHistogramBuckets.last())) {
+                qWarning("Invalid value for --%ls: %ls", qUtf16Printable(sizeHistogramOption.names().constFirst()),
+                         qUtf16Printable(parser.value(sizeHistogramOption)));
+                return 1;
+            }
+            sizeHistogramBuckets.push_back(size);
+        }
+    }
+#if KChart_FOUND
+    ChartWidget::setOpenGLEnabled(!parser.isSet(noOpenGLChartsOption));
+#endif
+
     auto createWindow = [&]() -> MainWindow* {
         auto window = new MainWindow;
         window->setAttribute(Qt::WA_DeleteOnClose);
         window->setSuppressions(suppressions);
         window->setDisableEmbeddedSuppressions(parser.isSet(disableEmbeddedSuppressionsOption));
         window->setDisableBuiltinSuppressions(parser.isSet(disableBuiltinSuppressionsOption));
+        window->setAllocationFilter(allocationFilter.minSize, allocationFilter.maxSize, allocationFilter.minLifetime);
+        window->setChartSeriesCount(chartSeriesCount);
+        window->setSizeHistogramBuckets(sizeHistogramBuckets);
+        window->setResultCacheEnabled(!parser.isSet(noCacheOption));
         window->show();
         return window;
     };
@@ -9,6 +9,8 @@
 
 #cmakedefine01 KChart_FOUND
 
+#cmakedefine01 HAVE_OPENGL_CHARTS
+
 #cmakedefine01 APPIMAGE_BUILD
 
 #endif // HEAPTRACK_CONFIG_H
@@ -13,6 +13,8 @@
 #include <QHash>
 #include <QVector>
 
+#include <algorithm>
+
 template <typename Rows, typename ModelImpl>
 class HashModel : public QAbstractTableModel
 {
@@ -57,8 +59,9 @@ public:
 
     QModelIndex indexForKey(const typename Rows::key_type& key, int column = 0) const
     {
-        auto it = std::find(m_keys.begin(), m_keys.end(), key);
-        if (it == m_keys.end()) {
+        // the rows are sorted by their keys
+        auto it = std::lower_bound(m_keys.begin(), m_keys.end(), key);
+        if (it == m_keys.end() || !(*it == key)) {
             return {};
         }
         const int row = std::distance(m_keys.begin(), it);
@@ -69,14 +72,9 @@ protected:
     void setRows(const Rows& rows)
     {
         beginResetModel();
-        m_keys.reserve(rows.size());
-        m_values.reserve(rows.size());
-        m_keys.clear();
-        m_values.clear();
-        for (auto it = rows.constBegin(), end = rows.constEnd(); it != end; ++it) {
-            m_keys.push_back(it.key());
-            m_values.push_back(it.value());
-        }
+        // the rows already store their keys and values as sorted vectors, share them
+        m_keys = rows.keys();
+        m_values = rows.values();
         endResetModel();
     }
 
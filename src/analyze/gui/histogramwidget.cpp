@@ -75,6 +75,7 @@ HistogramWidget::HistogramWidget(QWidget* parent)
     , m_chart(new KChart::Chart(this))
     , m_total(new BarDiagram(this))
     , m_detailed(new BarDiagram(this))
+    , m_bucketAxis(nullptr)
 {
     auto layout = new QVBoxLayout(this);
     layout->addWidget(m_chart);
@@ -98,6 +99,7 @@ HistogramWidget::HistogramWidget(QWidget* parent)
         bottomAxis->setPosition(KChart::CartesianAxis::Bottom);
         bottomAxis->setTitleText(i18n("Requested Allocation Size"));
         m_total->addAxis(bottomAxis);
+        m_bucketAxis = bottomAxis;
 
         auto* rightAxis = new CartesianAxis(m_total);
         rightAxis->setTextAttributes(axisTextAttributes);
@@ -136,6 +138,11 @@ void HistogramWidget::setModel(QAbstractItemModel* model)
     }
 }
 
+void HistogramWidget::setBucketAxisTitle(const QString& title)
+{
+    m_bucketAxis->setTitleText(title);
+}
+
 #include "histogramwidget.moc"
 
 #include "moc_histogramwidget.cpp"
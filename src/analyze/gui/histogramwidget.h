@@ -12,6 +12,7 @@
 namespace KChart {
 class Chart;
 class BarDiagram;
+class CartesianAxis;
 }
 
 class QAbstractItemModel;
@@ -24,11 +25,14 @@ public:
     virtual ~HistogramWidget();
 
     void setModel(QAbstractItemModel* model);
+    /// the title of the axis of the rows, i.e. what the histogram buckets stand for
+    void setBucketAxisTitle(const QString& title);
 
 private:
     KChart::Chart* m_chart;
     KChart::BarDiagram* m_total;
     KChart::BarDiagram* m_detailed;
+    KChart::CartesianAxis* m_bucketAxis;
 };
 
 #endif // HISTOGRAMWIDGET_H
@@ -58,6 +58,11 @@ struct FileLine
     {
         return fileId == rhs.fileId && line == rhs.line;
     }
+
+    bool operator<(const FileLine& rhs) const
+    {
+        return std::tie(fileId, line) < std::tie(rhs.fileId, rhs.line);
+    }
 };
 Q_DECLARE_TYPEINFO(FileLine, Q_MOVABLE_TYPE);
 Q_DECLARE_METATYPE(FileLine)
@@ -73,6 +78,15 @@ struct hash<Symbol>
         return boost::hash_value(std::tie(symbol.functionId.index, symbol.moduleId.index));
     }
 };
+
+template <>
+struct hash<FileLine>
+{
+    std::size_t operator()(const FileLine location) const
+    {
+        return boost::hash_value(std::tie(location.fileId.index, location.line));
+    }
+};
 }
 
 inline uint qHash(const Symbol& symbol, uint seed = 0)
@@ -33,6 +33,7 @@
 #include "callercalleemodel.h"
 #include "costdelegate.h"
 #include "costheaderview.h"
+#include "pageoccupancywidget.h"
 #include "parser.h"
 #include "stacksmodel.h"
 #include "suppressionsmodel.h"
@@ -221,10 +222,14 @@ ChartWidget* addChartTab(QTabWidget* tabWidget, const QString& title, ChartModel
     tab->setModel(model);
     QObject::connect(parser, dataReady, tab, [=](const ChartData& data) {
         model->resetData(data);
+        tab->setZoom({});
         tabWidget->setTabEnabled(tabWidget->indexOf(tab), true);
     });
     QObject::connect(window, &MainWindow::clearData, model, &ChartModel::clearData);
-    QObject::connect(window, &MainWindow::clearData, tab, [tab]() { tab->setSelection({}); });
+    QObject::connect(window, &MainWindow::clearData, tab, [tab]() {
+        tab->setSelection({});
+        tab->setZoom({});
+    });
     QObject::connect(tab, &ChartWidget::filterRequested, window, &MainWindow::reparse);
     return tab;
 }
@@ -244,6 +249,8 @@ void setupTreeModel(TreeModel* model, QTreeView* view, CostDelegate* costDelegat
     view->setItemDelegateForColumn(TreeModel::LeakedColumn, costDelegate);
     view->setItemDelegateForColumn(TreeModel::AllocationsColumn, costDelegate);
     view->setItemDelegateForColumn(TreeModel::TemporaryColumn, costDelegate);
+    view->setItemDelegateForColumn(TreeModel::CopiedColumn, costDelegate);
+    view->setItemDelegateForColumn(TreeModel::PinnedColumn, costDelegate);
     view->setHeader(new CostHeaderView(view));
 
     QObject::connect(filterFunction, &QLineEdit::textChanged, proxy, &TreeProxy::setFunctionFilter);
@@ -360,10 +367,13 @@ MainWindow::MainWindow(QWidget* parent)
         if (!m_diffMode) {
             m_ui->flameGraphTab->setBottomUpData(data);
         }
-        m_ui->progressLabel->setAlignment(Qt::AlignVCenter | Qt::AlignRight);
-        statusBar()->addWidget(m_ui->progressLabel, 1);
-        statusBar()->addWidget(m_ui->loadingProgress);
-        m_ui->pages->setCurrentWidget(m_ui->resultsPage);
+        // partial results may have shown the results page already
+        if (m_ui->pages->currentWidget() != m_ui->resultsPage) {
+            m_ui->progressLabel->setAlignment(Qt::AlignVCenter | Qt::AlignRight);
+            statusBar()->addWidget(m_ui->progressLabel, 1);
+            statusBar()->addWidget(m_ui->loadingProgress);
+            m_ui->pages->setCurrentWidget(m_ui->resultsPage);
+        }
         m_ui->tabWidget->setTabEnabled(m_ui->tabWidget->indexOf(m_ui->bottomUpTab), true);
     });
     connect(m_parser, &Parser::callerCalleeDataAvailable, this, [=](const CallerCalleeResults& data) {
@@ -405,8 +415,32 @@ MainWindow::MainWindow(QWidget* parent)
             } else {
                 stream << i18n("<dt><b>total runtime</b>:</dt><dd>%1</dd>", Util::formatTime(data.totalTime));
             }
-            stream << i18n("<dt><b>total system memory</b>:</dt><dd>%1</dd>", Util::formatBytes(data.totalSystemMemory))
-                   << "</dl></qt>";
+            if (data.filterParameters.isFilteredByAllocation()) {
+                QStringList filters;
+                if (data.filterParameters.minSize) {
+                    filters << i18n("at least %1",
+                                        Util::formatBytes(static_cast<qint64>(data.filterParameters.minSize)));
+                }
+                if (data.filterParameters.maxSize != std::numeric_limits<uint64_t>::max()) {
+                    filters << i18n("at most %1",
+                                        Util::formatBytes(static_cast<qint64>(data.filterParameters.maxSize)));
+                }
+                if (data.filterParameters.minLifetime) {
+                    filters << i18n("alive for at least %1", Util::formatTime(data.filterParameters.minLifetime));
+                }
+                stream << i18n("<dt><b>allocations filtered to</b>:</dt><dd>%1</dd>",
+                               filters.join(QStringLiteral(", ")));
+            }
+            if (data.partial) {
+                stream << i18n("<dt><b>partial results</b>:</dt><dd>the file is still being parsed</dd>");
+            }
+            stream << i18n("<dt><b>total system memory</b>:</dt><dd>%1</dd>",
+                           Util::formatBytes(data.totalSystemMemory));
+            if (data.sampleInterval) {
+                stream << i18n("<dt><b>sampling interval</b>:</dt><dd>%1, costs are estimated</dd>",
+                               Util::formatBytes(data.sampleInterval));
+            }
+            stream << "</dl></qt>";
         }
         {
             QTextStream stream(&textCenter);
@@ -419,8 +453,12 @@ MainWindow::MainWindow(QWidget* parent)
                            "%3/s)</dd>",
                            data.cost.temporary,
                            std::round(float(data.cost.temporary) * 100.f * 100.f / data.cost.allocations) / 100.f,
-                           qint64(data.cost.temporary / totalTimeS))
-                   << "</dl></qt>";
+                           qint64(data.cost.temporary / totalTimeS));
+            if (data.cost.growths) {
+                stream << i18n("<dt><b>allocations grown step by step</b>:</dt><dd>%1, copying %2</dd>",
+                               data.cost.growths, Util::formatBytes(data.cost.copied));
+            }
+            stream << "</dl></qt>";
         }
         {
             QTextStream stream(&textRight);
@@ -431,6 +469,14 @@ MainWindow::MainWindow(QWidget* parent)
                    << i18n("<dt><b>peak RSS</b> (including heaptrack "
                            "overhead):</dt><dd>%1</dd>",
                            Util::formatBytes(data.peakRSS));
+            if (data.cost.peakMapped) {
+                stream << i18n("<dt><b>peak memory in anonymous mappings</b>:</dt><dd>%1</dd>",
+                               Util::formatBytes(data.cost.peakMapped));
+            }
+            if (data.cost.pinned) {
+                stream << i18n("<dt><b>memory in sparse pages</b>:</dt><dd>%1 at most</dd>",
+                               Util::formatBytes(data.cost.pinned));
+            }
             if (isFiltered) {
                 stream << i18n("<dt><b>memory consumption delta</b>:</dt><dd>%1</dd>",
                                Util::formatBytes(data.cost.leaked));
@@ -478,14 +524,22 @@ MainWindow::MainWindow(QWidget* parent)
                                       &Parser::allocationsChartDataAvailable, this);
     auto temporaryAllocationsTab = addChartTab(m_ui->tabWidget, i18n("Temporary Allocations"), ChartModel::Temporary,
                                                m_parser, &Parser::temporaryChartDataAvailable, this);
+    auto mappedTab = addChartTab(m_ui->tabWidget, i18n("Mapped"), ChartModel::Mapped, m_parser,
+                                 &Parser::mappedChartDataAvailable, this);
+    auto allocationRateTab = addChartTab(m_ui->tabWidget, i18n("Allocation Rate"), ChartModel::AllocationRate,
+                                         m_parser, &Parser::allocationRateChartDataAvailable, this);
     auto syncSelection = [=](const ChartWidget::Range& selection) {
         consumedTab->setSelection(selection);
         allocationsTab->setSelection(selection);
         temporaryAllocationsTab->setSelection(selection);
+        mappedTab->setSelection(selection);
+        allocationRateTab->setSelection(selection);
     };
     connect(consumedTab, &ChartWidget::selectionChanged, syncSelection);
     connect(allocationsTab, &ChartWidget::selectionChanged, syncSelection);
     connect(temporaryAllocationsTab, &ChartWidget::selectionChanged, syncSelection);
+    connect(mappedTab, &ChartWidget::selectionChanged, syncSelection);
+    connect(allocationRateTab, &ChartWidget::selectionChanged, syncSelection);
 
     auto sizesTab = new HistogramWidget(this);
     m_ui->tabWidget->addTab(sizesTab, i18n("Sizes"));
@@ -498,8 +552,34 @@ MainWindow::MainWindow(QWidget* parent)
         sizeHistogramModel->resetData(data);
         m_ui->tabWidget->setTabEnabled(m_ui->tabWidget->indexOf(sizesTab), true);
     });
+
+    auto lifetimesTab = new HistogramWidget(this);
+    lifetimesTab->setBucketAxisTitle(i18n("Allocation Lifetime"));
+    m_ui->tabWidget->addTab(lifetimesTab, i18n("Lifetimes"));
+    m_ui->tabWidget->setTabEnabled(m_ui->tabWidget->indexOf(lifetimesTab), false);
+    auto lifetimeHistogramModel = new HistogramModel(this);
+    lifetimesTab->setModel(lifetimeHistogramModel);
+    connect(this, &MainWindow::clearData, lifetimeHistogramModel, &HistogramModel::clearData);
+
+    connect(m_parser, &Parser::lifetimeHistogramDataAvailable, this, [=](const HistogramData& data) {
+        // keep the tab disabled for older data files, which don't know the lifetimes
+        if (!data.rows.isEmpty()) {
+            lifetimeHistogramModel->resetData(data);
+            m_ui->tabWidget->setTabEnabled(m_ui->tabWidget->indexOf(lifetimesTab), true);
+        }
+    });
 #endif
 
+    auto fragmentationTab = new PageOccupancyWidget(this);
+    m_ui->tabWidget->addTab(fragmentationTab, i18n("Fragmentation"));
+    m_ui->tabWidget->setTabEnabled(m_ui->tabWidget->indexOf(fragmentationTab), false);
+    connect(this, &MainWindow::clearData, fragmentationTab, &PageOccupancyWidget::clearData);
+    connect(m_parser, &Parser::pageOccupancyDataAvailable, this, [=](const PageOccupancyData& data) {
+        fragmentationTab->setData(data);
+        // only data files recorded with HEAPTRACK_INTERPRET_OCCUPANCY know the page occupancy
+        m_ui->tabWidget->setTabEnabled(m_ui->tabWidget->indexOf(fragmentationTab), !data.rows.isEmpty());
+    });
+
     auto calleesModel = setupModelAndProxyForView<CalleeModel>(m_ui->calleeView);
     auto callersModel = setupModelAndProxyForView<CallerModel>(m_ui->callerView);
     auto sourceMapModel = setupModelAndProxyForView<SourceMapModel>(m_ui->locationView);
@@ -694,7 +774,8 @@ void MainWindow::loadFile(const QString& file, const QString& diffBase)
 
 void MainWindow::reparse(int64_t minTime, int64_t maxTime)
 {
-    if (m_ui->pages->currentWidget() != m_ui->resultsPage) {
+    // the close action stays disabled while the file is still being parsed, e.g. with partial results
+    if (m_ui->pages->currentWidget() != m_ui->resultsPage || !m_closeAction->isEnabled()) {
         return;
     }
 
@@ -714,6 +795,11 @@ void MainWindow::openNewFile()
     window->show();
     window->setDisableEmbeddedSuppressions(m_lastFilterParameters.disableEmbeddedSuppressions);
     window->setSuppressions(m_lastFilterParameters.suppressions);
+    window->setAllocationFilter(m_lastFilterParameters.minSize, m_lastFilterParameters.maxSize,
+                                m_lastFilterParameters.minLifetime);
+    window->setChartSeriesCount(m_parser->chartSeriesCount());
+    window->setSizeHistogramBuckets(m_parser->sizeHistogramBuckets());
+    window->setResultCacheEnabled(m_parser->isResultCacheEnabled());
 }
 
 void MainWindow::closeFile()
@@ -758,7 +844,8 @@ void MainWindow::setupStacks()
             auto proxy = qobject_cast<const TreeProxy*>(current.model());
             Q_ASSERT(proxy);
             auto leaf = proxy->mapToSource(current);
-            stacksModel->fillFromIndex(leaf);
+            // the most expensive stacks in the cost the view is sorted by come first
+            stacksModel->fillFromIndex(leaf, proxy->sortColumn());
         }
     };
     connect(m_ui->bottomUpResults->selectionModel(), &QItemSelectionModel::currentChanged, this, fillFromIndex);
@@ -897,4 +984,26 @@ void MainWindow::setSuppressions(std::vector<std::string> suppressions)
     m_lastFilterParameters.suppressions = std::move(suppressions);
 }
 
+void MainWindow::setAllocationFilter(uint64_t minSize, uint64_t maxSize, int64_t minLifetime)
+{
+    m_lastFilterParameters.minSize = minSize;
+    m_lastFilterParameters.maxSize = maxSize;
+    m_lastFilterParameters.minLifetime = minLifetime;
+}
+
+void MainWindow::setChartSeriesCount(int count)
+{
+    m_parser->setChartSeriesCount(count);
+}
+
+void MainWindow::setSizeHistogramBuckets(const QVector<quint64>& buckets)
+{
+    m_parser->setSizeHistogramBuckets(buckets);
+}
+
+void MainWindow::setResultCacheEnabled(bool enabled)
+{
+    m_parser->setResultCacheEnabled(enabled);
+}
+
 #include "moc_mainwindow.cpp"
@@ -41,6 +41,10 @@ public slots:
     void setDisableEmbeddedSuppressions(bool disable);
     void setDisableBuiltinSuppressions(bool disable);
     void setSuppressions(std::vector<std::string> suppressions);
+    void setAllocationFilter(uint64_t minSize, uint64_t maxSize, int64_t minLifetime);
+    void setChartSeriesCount(int count);
+    void setSizeHistogramBuckets(const QVector<quint64>& buckets);
+    void setResultCacheEnabled(bool enabled);
 
 signals:
     void clearData();
@@ -0,0 +1,31 @@
+/*
+    SPDX-FileCopyrightText: 2026 Milian Wolff <mail@milianw.de>
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#ifndef PAGEOCCUPANCYDATA_H
+#define PAGEOCCUPANCYDATA_H
+
+#include <QMetaType>
+#include <QVector>
+
+/// how full the pages of the heap were at a time stamp, see AccumulatedTraceData::PageOccupancy
+struct PageOccupancyRow
+{
+    qint64 time = 0;
+    /// the number of pages per bucket, bucket i of n holds the pages of which i/n to (i+1)/n are occupied
+    QVector<qint64> pages;
+};
+Q_DECLARE_TYPEINFO(PageOccupancyRow, Q_MOVABLE_TYPE);
+
+struct PageOccupancyData
+{
+    /// the size of the pages in bytes
+    qint64 pageSize = 0;
+    /// sorted by time, empty unless the data got recorded with HEAPTRACK_INTERPRET_OCCUPANCY
+    QVector<PageOccupancyRow> rows;
+};
+Q_DECLARE_METATYPE(PageOccupancyData)
+
+#endif // PAGEOCCUPANCYDATA_H
@@ -0,0 +1,173 @@
+/*
+    SPDX-FileCopyrightText: 2026 Milian Wolff <mail@milianw.de>
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#include "pageoccupancywidget.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <QEvent>
+#include <QHelpEvent>
+#include <QPaintEvent>
+#include <QPainter>
+#include <QToolTip>
+
+#include <KLocalizedString>
+
+#include "util.h"
+
+namespace {
+const int MARGIN = 4;
+const int NUM_TIME_LABELS = 5;
+}
+
+PageOccupancyWidget::PageOccupancyWidget(QWidget* parent)
+    : QWidget(parent)
+{
+    setMouseTracking(true);
+}
+
+PageOccupancyWidget::~PageOccupancyWidget() = default;
+
+void PageOccupancyWidget::setData(const PageOccupancyData& data)
+{
+    m_data = data;
+    m_maxPages = 0;
+    for (const auto& row : m_data.rows) {
+        for (const auto pages : row.pages) {
+            m_maxPages = std::max(m_maxPages, pages);
+        }
+    }
+    update();
+}
+
+void PageOccupancyWidget::clearData()
+{
+    setData({});
+}
+
+QRect PageOccupancyWidget::plotRect() const
+{
+    const auto metrics = fontMetrics();
+    const int left = metrics.boundingRect(QStringLiteral("100%")).width() + 2 * MARGIN;
+    const int top = metrics.height() + 2 * MARGIN;
+    const int bottom = metrics.height() + 2 * MARGIN;
+    return rect().adjusted(left, top, -MARGIN - metrics.boundingRect(QStringLiteral("00.0s")).width() / 2, -bottom);
+}
+
+int PageOccupancyWidget::numBuckets() const
+{
+    return m_data.rows.isEmpty() ? 0 : m_data.rows.first().pages.size();
+}
+
+int PageOccupancyWidget::rowAt(int x, const QRect& plot) const
+{
+    if (m_data.rows.isEmpty() || x < plot.left() || x > plot.right()) {
+        return -1;
+    }
+    const auto startTime = m_data.rows.first().time;
+    const auto timeSpan = std::max(qint64(1), m_data.rows.last().time - startTime);
+    const auto time = startTime + static_cast<qint64>(qreal(x - plot.left()) * timeSpan / std::max(1, plot.width()));
+    // the snapshot stays valid until the next one got taken
+    auto it = std::upper_bound(m_data.rows.cbegin(), m_data.rows.cend(), time,
+                               [](qint64 time, const PageOccupancyRow& row) { return time < row.time; });
+    return std::max(0, static_cast<int>(std::distance(m_data.rows.cbegin(), it)) - 1);
+}
+
+QColor PageOccupancyWidget::color(qint64 pages) const
+{
+    if (!pages || !m_maxPages) {
+        return palette().color(QPalette::Base);
+    }
+    // the square root keeps the buckets with few pages visible next to the ones with many
+    const auto ratio = std::sqrt(qreal(pages) / m_maxPages);
+    return QColor::fromHsvF((1 - ratio) * 240. / 360., 0.8, 0.9);
+}
+
+void PageOccupancyWidget::paintEvent(QPaintEvent* /*event*/)
+{
+    QPainter painter(this);
+    const auto metrics = fontMetrics();
+    const auto plot = plotRect();
+    const auto buckets = numBuckets();
+    if (!buckets || plot.width() <= 0 || plot.height() <= 0) {
+        return;
+    }
+
+    painter.drawText(QRect(0, MARGIN, width(), metrics.height()), Qt::AlignCenter,
+                     i18n("Occupancy of the %1 pages of the heap over time, the sparsest pages at the bottom",
+                          Util::formatBytes(m_data.pageSize)));
+
+    const qreal bucketHeight = qreal(plot.height()) / buckets;
+    int x = plot.left();
+    while (x <= plot.right()) {
+        // paint all columns that show the same snapshot at once
+        const auto row = rowAt(x, plot);
+        int end = x + 1;
+        while (end <= plot.right() && rowAt(end, plot) == row) {
+            ++end;
+        }
+        const auto& pages = m_data.rows[row].pages;
+        for (int bucket = 0, c = std::min(buckets, static_cast<int>(pages.size())); bucket < c; ++bucket) {
+            const QRectF cell(x, plot.bottom() + 1 - (bucket + 1) * bucketHeight, end - x, bucketHeight);
+            painter.fillRect(cell, color(pages[bucket]));
+        }
+        x = end;
+    }
+
+    painter.setPen(palette().color(QPalette::Text));
+    painter.drawRect(plot.adjusted(0, 0, -1, -1));
+
+    // label the bucket boundaries, skipping some when they would overlap
+    const int bucketStep = std::max(1, static_cast<int>(std::ceil(metrics.height() / bucketHeight)));
+    for (int bucket = 0; bucket <= buckets; bucket += bucketStep) {
+        const int y = plot.bottom() + 1 - static_cast<int>(bucket * bucketHeight);
+        const auto label = i18n("%1%", bucket * 100 / buckets);
+        painter.drawText(QRect(0, y - metrics.height() / 2, plot.left() - MARGIN, metrics.height()),
+                         Qt::AlignRight | Qt::AlignVCenter, label);
+    }
+
+    const auto startTime = m_data.rows.first().time;
+    const auto timeSpan = m_data.rows.last().time - startTime;
+    for (int i = 0; i < NUM_TIME_LABELS; ++i) {
+        const int labelX = plot.left() + plot.width() * i / (NUM_TIME_LABELS - 1);
+        const auto label = Util::formatTime(startTime + timeSpan * i / (NUM_TIME_LABELS - 1));
+        const int labelWidth = metrics.boundingRect(label).width();
+        painter.drawText(QRect(labelX - labelWidth / 2, plot.bottom() + MARGIN, labelWidth, metrics.height()),
+                         Qt::AlignCenter, label);
+    }
+}
+
+bool PageOccupancyWidget::event(QEvent* event)
+{
+    if (event->type() != QEvent::ToolTip) {
+        return QWidget::event(event);
+    }
+
+    const auto helpEvent = static_cast<QHelpEvent*>(event);
+    const auto plot = plotRect();
+    const auto buckets = numBuckets();
+    const auto row = rowAt(helpEvent->pos().x(), plot);
+    if (row == -1 || !plot.contains(helpEvent->pos())) {
+        QToolTip::hideText();
+        event->ignore();
+        return true;
+    }
+
+    const auto bucket = std::min(buckets - 1, static_cast<int>((plot.bottom() + 1 - helpEvent->pos().y())
+                                                                * buckets / std::max(1, plot.height())));
+    const auto& snapshot = m_data.rows[row];
+    qint64 total = 0;
+    for (const auto pages : snapshot.pages) {
+        total += pages;
+    }
+    const auto pages = bucket < snapshot.pages.size() ? snapshot.pages[bucket] : 0;
+    QToolTip::showText(helpEvent->globalPos(),
+                       i18n("%1 of %2 pages are %3% to %4% occupied at %5", pages, total, bucket * 100 / buckets,
+                            (bucket + 1) * 100 / buckets, Util::formatTime(snapshot.time)),
+                       this);
+    return true;
+}
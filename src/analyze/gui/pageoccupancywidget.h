@@ -0,0 +1,48 @@
+/*
+    SPDX-FileCopyrightText: 2026 Milian Wolff <mail@milianw.de>
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#ifndef PAGEOCCUPANCYWIDGET_H
+#define PAGEOCCUPANCYWIDGET_H
+
+#include <QWidget>
+
+#include "pageoccupancydata.h"
+
+/**
+ * Draws the page occupancy over time as a heat map.
+ *
+ * Time runs along the x axis, the occupancy buckets are stacked along the y axis with the
+ * sparsest pages at the bottom. The color of a cell grows with the number of pages in the
+ * bucket. Every pixel column gets painted from the last snapshot before its time, so the
+ * costs of a repaint are bounded by the width of the widget and not by the number of snapshots.
+ */
+class PageOccupancyWidget : public QWidget
+{
+    Q_OBJECT
+public:
+    explicit PageOccupancyWidget(QWidget* parent = nullptr);
+    ~PageOccupancyWidget() override;
+
+    void setData(const PageOccupancyData& data);
+    void clearData();
+
+protected:
+    bool event(QEvent* event) override;
+    void paintEvent(QPaintEvent* event) override;
+
+private:
+    /// the area of the heat map, without the axes and the title
+    QRect plotRect() const;
+    int numBuckets() const;
+    /// @return the index of the row that covers @p x in the plot, or -1
+    int rowAt(int x, const QRect& plot) const;
+    QColor color(qint64 pages) const;
+
+    PageOccupancyData m_data;
+    qint64 m_maxPages = 0;
+};
+
+#endif // PAGEOCCUPANCYWIDGET_H
@@ -14,8 +14,11 @@
 #include <QThread>
 
 #include "analyze/accumulatedtracedata.h"
+#include "resultcache.h"
 
+#include <atomic>
 #include <future>
+#include <thread>
 #include <tuple>
 #include <utility>
 #include <vector>
@@ -72,13 +75,74 @@ struct ChartMergeData
     qint64 consumed;
     qint64 allocations;
     qint64 temporary;
+    qint64 mapped;
     bool operator<(const IpIndex rhs) const
     {
         return ip < rhs;
     }
 };
 
-const uint64_t MAX_CHART_DATAPOINTS = 500; // TODO: make this configurable via the GUI
+// TODO: make this configurable via the GUI
+const uint64_t MAX_CHART_DATAPOINTS = ChartData::MAX_DISPLAYED_ROWS * ChartData::ZOOM_RESOLUTION;
+
+/// halve @p rows by keeping the rows with the minimum and maximum total cost out of every four rows
+QVector<ChartRows> downsampleChartRows(const QVector<ChartRows>& rows)
+{
+    QVector<ChartRows> downsampled;
+    downsampled.reserve(rows.size() / 2 + 2);
+    // always keep the first and last row, such that the time range stays the same
+    downsampled.push_back(rows.front());
+    const int last = rows.size() - 1;
+    for (int i = 1; i < last; i += 4) {
+        const int end = std::min(i + 4, last);
+        int minRow = i;
+        int maxRow = i;
+        for (int j = i + 1; j < end; ++j) {
+            if (rows[j].total < rows[minRow].total) {
+                minRow = j;
+            }
+            if (rows[j].total > rows[maxRow].total) {
+                maxRow = j;
+            }
+        }
+        downsampled.push_back(rows[std::min(minRow, maxRow)]);
+        if (minRow != maxRow) {
+            downsampled.push_back(rows[std::max(minRow, maxRow)]);
+        }
+    }
+    downsampled.push_back(rows.back());
+    return downsampled;
+}
+
+/// @return the costs per second that got added between @p previous and @p current, which hold the accumulated costs
+ChartRows rateRow(const ChartRows& previous, const ChartRows& current)
+{
+    ChartRows rate;
+    rate.timeStamp = current.timeStamp;
+    const auto interval = std::max(qint64(1), current.timeStamp - previous.timeStamp);
+    auto perSecond = [interval](qint64 cost) { return cost * 1000 / interval; };
+    rate.total = perSecond(current.total - previous.total);
+    rate.costs.reserve(current.costs.size());
+    // both are sorted by label, and so is the rate then
+    for (const auto& cost : current.costs) {
+        const auto delta = cost.cost - previous.cost(cost.label);
+        if (delta) {
+            rate.costs.push_back({cost.label, perSecond(delta)});
+        }
+    }
+    return rate;
+}
+
+void buildChartLevels(ChartData* data)
+{
+    data->levels.clear();
+    auto rows = &data->rows;
+    while (rows->size() > ChartData::MAX_DISPLAYED_ROWS) {
+        auto level = downsampleChartRows(*rows);
+        data->levels.push_back(std::move(level));
+        rows = &data->levels.back();
+    }
+}
 
 QVector<Suppression> toQt(const std::vector<Suppression>& suppressions)
 {
@@ -91,9 +155,12 @@ QVector<Suppression> toQt(const std::vector<Suppression>& suppressions)
 struct ParserData final : public AccumulatedTraceData
 {
     using TimestampCallback = std::function<void(const ParserData& data)>;
+    using SnapshotCallback = std::function<void(ParserData& data)>;
     ParserData(TimestampCallback timestampCallback)
         : timestampCallback(std::move(timestampCallback))
     {
+        // the charts and every change of the filters read the file again
+        cacheDecompressedData = true;
     }
 
     void prepareBuildCharts(const std::shared_ptr<const ResultData>& resultData)
@@ -107,6 +174,10 @@ struct ParserData final : public AccumulatedTraceData
         allocationsChartData.rows.reserve(MAX_CHART_DATAPOINTS);
         temporaryChartData.resultData = resultData;
         temporaryChartData.rows.reserve(MAX_CHART_DATAPOINTS);
+        mappedChartData.resultData = resultData;
+        mappedChartData.rows.reserve(MAX_CHART_DATAPOINTS);
+        allocationRateChartData.resultData = resultData;
+        allocationRateChartData.rows.reserve(MAX_CHART_DATAPOINTS);
         // start off with null data at the origin
         lastTimeStamp = filterParameters.minTime;
         ChartRows origin;
@@ -114,10 +185,13 @@ struct ParserData final : public AccumulatedTraceData
         consumedChartData.rows.push_back(origin);
         allocationsChartData.rows.push_back(origin);
         temporaryChartData.rows.push_back(origin);
+        mappedChartData.rows.push_back(origin);
+        allocationRateChartData.rows.push_back(origin);
         // index 0 indicates the total row
         consumedChartData.labels[0] = {};
         allocationsChartData.labels[0] = {};
         temporaryChartData.labels[0] = {};
+        mappedChartData.labels[0] = {};
 
         buildCharts = true;
         maxConsumedSinceLastTimeStamp = 0;
@@ -129,11 +203,12 @@ struct ParserData final : public AccumulatedTraceData
             const auto ip = findTrace(alloc.traceIndex).ipIndex;
             auto it = lower_bound(merged.begin(), merged.end(), ip);
             if (it == merged.end() || it->ip != ip) {
-                it = merged.insert(it, {ip, 0, 0, 0});
+                it = merged.insert(it, {ip, 0, 0, 0, 0});
             }
             it->consumed += alloc.peak; // we want to track the top peaks in the chart
             it->allocations += alloc.allocations;
             it->temporary += alloc.temporary;
+            it->mapped += alloc.peakMapped;
         }
         // find the top hot spots for the individual data members and remember their
         // IP and store the label
@@ -142,20 +217,22 @@ struct ParserData final : public AccumulatedTraceData
             sort(merged.begin(), merged.end(), [=](const ChartMergeData& left, const ChartMergeData& right) {
                 return std::abs(left.*member) > std::abs(right.*member);
             });
-            for (size_t i = 0; i < min(size_t(ChartRows::MAX_NUM_COST - 2), merged.size()); ++i) {
+            for (size_t i = 0; i < min(size_t(chartSeriesCount), merged.size()); ++i) {
                 const auto& alloc = merged[i];
                 if (!(alloc.*member)) {
                     break;
                 }
                 (ipToLabelIds[alloc.ip].*label) = i + 1;
                 data->labels[i + 1] = symbol(findIp(alloc.ip));
-                Q_ASSERT(data->labels.size() < ChartRows::MAX_NUM_COST);
             }
         };
-        ipToLabelIds.reserve(3 * ChartRows::MAX_NUM_COST);
+        ipToLabelIds.reserve(4 * chartSeriesCount);
         findTopChartEntries(&ChartMergeData::consumed, &LabelIds::consumed, &consumedChartData);
         findTopChartEntries(&ChartMergeData::allocations, &LabelIds::allocations, &allocationsChartData);
         findTopChartEntries(&ChartMergeData::temporary, &LabelIds::temporary, &temporaryChartData);
+        findTopChartEntries(&ChartMergeData::mapped, &LabelIds::mapped, &mappedChartData);
+        // the rates get computed from the rows of the allocations, so they show the same call sites
+        allocationRateChartData.labels = allocationsChartData.labels;
 
         // now iterate the allocations once to build the list of allocations
         // we need to look at when we are building the charts in handleTimeStamp
@@ -171,12 +248,25 @@ struct ParserData final : public AccumulatedTraceData
         }
     }
 
+    /// build the zoom levels of the charts, once all rows got added
+    void finishBuildCharts()
+    {
+        buildChartLevels(&consumedChartData);
+        buildChartLevels(&allocationsChartData);
+        buildChartLevels(&temporaryChartData);
+        buildChartLevels(&mappedChartData);
+        buildChartLevels(&allocationRateChartData);
+    }
+
     void handleTimeStamp(int64_t /*oldStamp*/, int64_t newStamp, bool isFinalTimeStamp, ParsePass pass) override
     {
         if (timestampCallback) {
             timestampCallback(*this);
         }
         if (pass == ParsePass::FirstPass) {
+            if (snapshotCallback && !isFinalTimeStamp) {
+                maybeTakeSnapshot();
+            }
             return;
         }
         if (!buildCharts || diffMode) {
@@ -196,12 +286,13 @@ struct ParserData final : public AccumulatedTraceData
         auto createRow = [newStamp](int64_t totalCost) {
             ChartRows row;
             row.timeStamp = newStamp;
-            row.cost[0] = totalCost;
+            row.total = totalCost;
             return row;
         };
         auto consumed = createRow(nowConsumed);
         auto allocs = createRow(totalCost.allocations);
         auto temporary = createRow(totalCost.temporary);
+        auto mapped = createRow(totalCost.mapped);
 
         // if the cost is non-zero and the ip corresponds to a hotspot function
         // selected in the labels, we add the cost to the rows column
@@ -209,28 +300,44 @@ struct ParserData final : public AccumulatedTraceData
             if (!cost || labelId == -1) {
                 return;
             }
-            rows->cost[labelId] += cost;
+            rows->addCost(labelId, cost);
         };
         for (const auto& ids : labelIds) {
             const auto alloc = allocations[ids.allocationIndex.index];
             addDataToRow(alloc.leaked, ids.consumed, &consumed);
             addDataToRow(alloc.allocations, ids.allocations, &allocs);
             addDataToRow(alloc.temporary, ids.temporary, &temporary);
+            addDataToRow(alloc.mapped, ids.mapped, &mapped);
         }
         // add the rows for this time stamp
+        allocationRateChartData.rows << rateRow(allocationsChartData.rows.constLast(), allocs);
         consumedChartData.rows << consumed;
         allocationsChartData.rows << allocs;
         temporaryChartData.rows << temporary;
+        mappedChartData.rows << mapped;
     }
 
     void handleAllocation(const AllocationInfo& info, const AllocationInfoIndex index) override
+    {
+        handleAllocations(info, index, 1);
+    }
+
+    void handleAllocations(const AllocationInfo& /*info*/, const AllocationInfoIndex index, int64_t count) override
     {
         maxConsumedSinceLastTimeStamp = max(maxConsumedSinceLastTimeStamp, totalCost.leaked);
 
-        if (index.index == allocationInfoCounter.size()) {
-            allocationInfoCounter.push_back({info, 1});
-        } else {
-            ++allocationInfoCounter[index.index].allocations;
+        // the allocations that got filtered out never get reported, but keep the direct access by index
+        while (index.index >= allocationInfoCounter.size()) {
+            allocationInfoCounter.push_back({allocationInfos[allocationInfoCounter.size()], 0});
+        }
+        allocationInfoCounter[index.index].allocations += count;
+    }
+
+    void handleDeallocation(const AllocationInfo& /*info*/, const AllocationInfoIndex index,
+                            int64_t lifetime) override
+    {
+        if (lifetime >= 0 && parsingState.pass == FirstPass) {
+            ++lifetimeCounter[(uint64_t(index.index) << 8) | lifetimeBucket(static_cast<uint32_t>(lifetime))];
         }
     }
 
@@ -241,48 +348,94 @@ struct ParserData final : public AccumulatedTraceData
 
     void clearForReparse()
     {
-        // data moved to size histogram
-        {
-            // we have to reset the allocation count
-            for (auto& info : allocationInfoCounter)
-                info.allocations = 0;
-            // and restore the order to allow fast direct access
-            std::sort(allocationInfoCounter.begin(), allocationInfoCounter.end(),
-                      [](const ParserData::CountedAllocationInfo& lhs, const ParserData::CountedAllocationInfo& rhs) {
-                          return lhs.info.allocationIndex < rhs.info.allocationIndex;
-                      });
+        // data moved to size histogram, which keeps the order for the direct access by index
+        for (auto& info : allocationInfoCounter) {
+            info.allocations = 0;
         }
+        // data moved to lifetime histogram
+        lifetimeCounter.clear();
         // data moved to chart models
         consumedChartData = {};
         allocationsChartData = {};
         temporaryChartData = {};
+        mappedChartData = {};
+        allocationRateChartData = {};
         labelIds.clear();
         maxConsumedSinceLastTimeStamp = 0;
         lastTimeStamp = 0;
         buildCharts = false;
     }
 
+    /// remember the leaked costs before the suppressions get applied to them, see reapplySuppressions
+    void saveUnsuppressedCosts()
+    {
+        unsuppressedLeaked.resize(allocations.size());
+        std::transform(allocations.begin(), allocations.end(), unsuppressedLeaked.begin(),
+                       [](const Allocation& allocation) { return allocation.leaked; });
+        unsuppressedTotalLeaked = totalCost.leaked;
+        hasUnsuppressedCosts = true;
+    }
+
+    /// @return true when reparsing with @p parameters only changes the suppressions,
+    /// which then get applied to the costs of the last read instead
+    bool canReapplySuppressions(const FilterParameters& parameters) const
+    {
+        return hasUnsuppressedCosts && parameters.minTime == filterParameters.minTime
+            && parameters.maxTime == filterParameters.maxTime && parameters.minSize == filterParameters.minSize
+            && parameters.maxSize == filterParameters.maxSize && parameters.minLifetime == filterParameters.minLifetime;
+    }
+
+    /// restore the costs saved by saveUnsuppressedCosts and collect the suppressions like read() does,
+    /// such that applyLeakSuppressions can apply the current filterParameters to them
+    void reapplySuppressions()
+    {
+        for (size_t i = 0, c = std::min(allocations.size(), unsuppressedLeaked.size()); i < c; ++i) {
+            allocations[i].leaked = unsuppressedLeaked[i];
+        }
+        totalCost.leaked = unsuppressedTotalLeaked;
+
+        suppressions.clear();
+        if (!filterParameters.disableBuiltinSuppressions) {
+            suppressions = builtinSuppressions();
+        }
+        for (const auto& pattern : filterParameters.suppressions) {
+            suppressions.push_back({pattern, 0, 0});
+        }
+        if (!filterParameters.disableEmbeddedSuppressions) {
+            for (const auto& pattern : embeddedSuppressions) {
+                suppressions.push_back({pattern, 0, 0});
+            }
+        }
+    }
+
     string debuggee;
 
+    // the leaked costs of the last read, before applying the suppressions to them
+    vector<int64_t> unsuppressedLeaked;
+    int64_t unsuppressedTotalLeaked = 0;
+    bool hasUnsuppressedCosts = false;
+
     struct CountedAllocationInfo
     {
         AllocationInfo info;
         int64_t allocations;
-        bool operator<(const CountedAllocationInfo& rhs) const
-        {
-            return tie(info.size, allocations) < tie(rhs.info.size, rhs.allocations);
-        }
     };
     /// counts how often a given allocation info is encountered based on its index
     /// used to build the size histogram
     vector<CountedAllocationInfo> allocationInfoCounter;
+    /// counts how often the allocations of a given allocation info got freed per lifetime bucket
+    /// the keys are the allocation info indices shifted by 8 bits, combined with the lifetime buckets
+    /// used to build the lifetime histogram
+    tsl::robin_map<uint64_t, int64_t> lifetimeCounter;
 
     ChartData consumedChartData;
     ChartData allocationsChartData;
     ChartData temporaryChartData;
+    ChartData mappedChartData;
+    ChartData allocationRateChartData;
     // here we store the indices into ChartRows::cost for those IpIndices that
     // are within the top hotspots. This way, we can do one hash lookup in the
-    // handleTimeStamp function instead of three when we'd store this data
+    // handleTimeStamp function instead of four when we'd store this data
     // in a per-ChartData hash.
     struct LabelIds
     {
@@ -290,6 +443,7 @@ struct ParserData final : public AccumulatedTraceData
         int consumed = -1;
         int allocations = -1;
         int temporary = -1;
+        int mapped = -1;
     };
     vector<LabelIds> labelIds;
     int64_t maxConsumedSinceLastTimeStamp = 0;
@@ -297,11 +451,31 @@ struct ParserData final : public AccumulatedTraceData
 
     bool buildCharts = false;
     bool diffMode = false;
+    // the number of symbols that get their own series in the charts
+    int chartSeriesCount = ChartRows::DEFAULT_NUM_SERIES;
+
+    /// publish intermediate results whenever another tenth of the file got read,
+    /// but not more often than every two seconds
+    void maybeTakeSnapshot()
+    {
+        if (parsingState.fileSize <= 0) {
+            return;
+        }
+        const auto completion = double(parsingState.readCompressedByte) / parsingState.fileSize;
+        if (completion < nextSnapshotCompletion || parseTimer.elapsed() < nextSnapshotTime) {
+            return;
+        }
+        snapshotCallback(*this);
+        nextSnapshotCompletion = completion + 0.1;
+        nextSnapshotTime = parseTimer.elapsed() + 2000;
+    }
 
     TimestampCallback timestampCallback;
+    // only set for the first pass over a new file
+    SnapshotCallback snapshotCallback;
+    double nextSnapshotCompletion = 0.1;
+    qint64 nextSnapshotTime = 2000;
     QElapsedTimer parseTimer;
-
-    QVector<QString> qtStrings;
 };
 
 namespace {
@@ -314,15 +488,30 @@ void setParents(QVector<RowData>& children, const RowData* parent)
     }
 }
 
+using SymbolCostBuilder = tsl::robin_map<Symbol, AllocationData>;
+
+/// the caller/callee data of a symbol while it gets built, see CallerCalleeEntry
+struct CallerCalleeBuilderEntry
+{
+    AllocationData inclusiveCost;
+    AllocationData selfCost;
+    SymbolCostBuilder callers;
+    SymbolCostBuilder callees;
+    tsl::robin_map<FileLine, EntryCost> sourceMap;
+};
+
+/// the open addressing maps are much cheaper to fill than QHash, the models get sorted arrays built from it
+using CallerCalleeBuilder = tsl::robin_map<Symbol, CallerCalleeBuilderEntry>;
+
 void addCallerCalleeEvent(const Location& location, const AllocationData& cost, tsl::robin_set<Symbol>* recursionGuard,
-                          CallerCalleeResults* callerCalleeResult)
+                          CallerCalleeBuilder* callerCalleeResult)
 {
     const auto isLeaf = recursionGuard->empty();
     if (!recursionGuard->insert(location.symbol).second) {
         return;
     }
 
-    auto& entry = callerCalleeResult->entries[location.symbol];
+    auto& entry = (*callerCalleeResult)[location.symbol];
     auto& locationCost = entry.sourceMap[location.fileLine];
 
     locationCost.inclusiveCost += cost;
@@ -332,33 +521,111 @@ void addCallerCalleeEvent(const Location& location, const AllocationData& cost,
     }
 }
 
-std::pair<TreeData, CallerCalleeResults> mergeAllocations(Parser* parser, const ParserData& data,
-                                                          std::shared_ptr<const ResultData> resultData)
+/**
+ * The locations of all instruction pointers and their inlined frames, resolved once up front
+ * such that walking the traces of the allocations only needs to look them up by index.
+ */
+class IpLocations
 {
-    CallerCalleeResults callerCalleeResults;
-    TreeData topRows;
+public:
+    /// the location of an instruction pointer, followed by the ones of its inlined frames
+    struct Range
+    {
+        const Location* first;
+        const Location* last;
+
+        const Location* begin() const
+        {
+            return first;
+        }
+
+        const Location* end() const
+        {
+            return last;
+        }
+    };
+
+    explicit IpLocations(const ParserData& data)
+    {
+        const auto size = data.instructionPointers.size();
+        m_end.reserve(size + 1);
+        m_locations.reserve(size + 1);
+        m_isStop.reserve(size + 1);
+        // index zero is the invalid instruction pointer, as in AccumulatedTraceData::findIp
+        add({}, data);
+        for (size_t i = 0; i < size; ++i) {
+            add(data.instructionPointers[i], data);
+        }
+    }
+
+    Range locations(IpIndex ipIndex) const
+    {
+        const auto index = validIndex(ipIndex);
+        const auto begin = index ? m_end[index - 1] : 0;
+        return {m_locations.data() + begin, m_locations.data() + m_end[index]};
+    }
+
+    /// whether the trace walk should stop at the instruction pointer, e.g. in main
+    bool isStop(IpIndex ipIndex) const
+    {
+        return m_isStop[validIndex(ipIndex)];
+    }
+
+private:
+    void add(const InstructionPointer& ip, const ParserData& data)
+    {
+        m_locations.push_back(location(ip));
+        for (const auto& inlined : ip.inlined) {
+            m_locations.push_back(frameLocation(inlined, ip.moduleIndex));
+        }
+        m_end.push_back(m_locations.size());
+        m_isStop.push_back(data.isStopIndex(ip.frame.functionIndex));
+    }
+
+    size_t validIndex(IpIndex ipIndex) const
+    {
+        return ipIndex.index < m_end.size() ? ipIndex.index : 0;
+    }
+
+    // end offset into m_locations for each instruction pointer, the begin is the end of the previous one
+    std::vector<uint32_t> m_end;
+    std::vector<Location> m_locations;
+    std::vector<bool> m_isStop;
+};
+
+/// the bottom-up tree and the source maps of the caller/callee data of some of the allocations
+struct MergedAllocations
+{
+    QVector<RowData> rows;
+    CallerCalleeBuilder callerCalleeResults;
+};
+
+/// merge the allocations in the range from @p begin to @p end, leave parent pointers invalid
+MergedAllocations mergeAllocationRange(Parser* parser, const ParserData& data, const IpLocations& ipLocations,
+                                       size_t begin, size_t end, std::atomic<size_t>* progress)
+{
+    MergedAllocations merged;
     tsl::robin_set<TraceIndex> traceRecursionGuard;
     traceRecursionGuard.reserve(128);
     tsl::robin_set<Symbol> symbolRecursionGuard;
     symbolRecursionGuard.reserve(128);
-    auto addRow = [&symbolRecursionGuard, &callerCalleeResults](QVector<RowData>* rows, const Location& location,
-                                                                const Allocation& cost) -> QVector<RowData>* {
+    auto addRow = [&symbolRecursionGuard, &merged](QVector<RowData>* rows, const Location& location,
+                                                   const Allocation& cost) -> QVector<RowData>* {
         auto it = lower_bound(rows->begin(), rows->end(), location.symbol);
         if (it != rows->end() && it->symbol == location.symbol) {
             it->cost += cost;
         } else {
             it = rows->insert(it, {cost, location.symbol, nullptr, {}});
         }
-        addCallerCalleeEvent(location, cost, &symbolRecursionGuard, &callerCalleeResults);
+        addCallerCalleeEvent(location, cost, &symbolRecursionGuard, &merged.callerCalleeResults);
         return &it->children;
     };
     const auto allocationCount = data.allocations.size();
     const auto onePercent = std::max<size_t>(1, allocationCount / 100);
-    auto progress = 0;
-    // merge allocations, leave parent pointers invalid (their location may change)
-    for (const auto& allocation : data.allocations) {
+    for (size_t i = begin; i < end; ++i) {
+        const auto& allocation = data.allocations[i];
         auto traceIndex = allocation.traceIndex;
-        auto rows = &topRows.rows;
+        auto rows = &merged.rows;
         traceRecursionGuard.clear();
         traceRecursionGuard.insert(traceIndex);
         symbolRecursionGuard.clear();
@@ -366,13 +633,10 @@ std::pair<TreeData, CallerCalleeResults> mergeAllocations(Parser* parser, const
         while (traceIndex || first) {
             first = false;
             const auto& trace = data.findTrace(traceIndex);
-            const auto& ip = data.findIp(trace.ipIndex);
-            rows = addRow(rows, location(ip), allocation);
-            for (const auto& inlined : ip.inlined) {
-                const auto& inlinedLocation = frameLocation(inlined, ip.moduleIndex);
-                rows = addRow(rows, inlinedLocation, allocation);
+            for (const auto& location : ipLocations.locations(trace.ipIndex)) {
+                rows = addRow(rows, location, allocation);
             }
-            if (data.isStopIndex(ip.frame.functionIndex)) {
+            if (ipLocations.isStop(trace.ipIndex)) {
                 break;
             }
             traceIndex = trace.parentIndex;
@@ -381,17 +645,126 @@ std::pair<TreeData, CallerCalleeResults> mergeAllocations(Parser* parser, const
                 break;
             }
         }
-        ++progress;
-        if ((progress % onePercent) == 0) {
-            const int percent = progress * 100 / allocationCount;
+        const auto done = ++(*progress);
+        if ((done % onePercent) == 0) {
+            const int percent = done * 100 / allocationCount;
             emit parser->progressMessageAvailable(i18n("merging allocations... %1%", percent));
         }
     }
+    return merged;
+}
+
+/// add the rows of @p other to @p rows, both are sorted by their symbols
+void mergeRows(QVector<RowData>* rows, QVector<RowData>* other)
+{
+    if (other->isEmpty()) {
+        return;
+    } else if (rows->isEmpty()) {
+        rows->swap(*other);
+        return;
+    }
+    QVector<RowData> merged;
+    merged.reserve(rows->size() + other->size());
+    auto it = rows->begin();
+    auto otherIt = other->begin();
+    while (it != rows->end() && otherIt != other->end()) {
+        if (it->symbol < otherIt->symbol) {
+            merged.push_back(std::move(*it));
+            ++it;
+        } else if (otherIt->symbol < it->symbol) {
+            merged.push_back(std::move(*otherIt));
+            ++otherIt;
+        } else {
+            it->cost += otherIt->cost;
+            mergeRows(&it->children, &otherIt->children);
+            merged.push_back(std::move(*it));
+            ++it;
+            ++otherIt;
+        }
+    }
+    std::move(it, rows->end(), std::back_inserter(merged));
+    std::move(otherIt, other->end(), std::back_inserter(merged));
+    rows->swap(merged);
+}
+
+void mergeSymbolCosts(SymbolCostBuilder* costs, const SymbolCostBuilder& other)
+{
+    for (const auto& cost : other) {
+        (*costs)[cost.first] += cost.second;
+    }
+}
+
+void mergeCallerCalleeResults(CallerCalleeBuilder* results, const CallerCalleeBuilder& other)
+{
+    for (const auto& otherEntry : other) {
+        auto& entry = (*results)[otherEntry.first];
+        entry.inclusiveCost += otherEntry.second.inclusiveCost;
+        entry.selfCost += otherEntry.second.selfCost;
+        mergeSymbolCosts(&entry.callers, otherEntry.second.callers);
+        mergeSymbolCosts(&entry.callees, otherEntry.second.callees);
+        for (const auto& location : otherEntry.second.sourceMap) {
+            auto& cost = entry.sourceMap[location.first];
+            cost.inclusiveCost += location.second.inclusiveCost;
+            cost.selfCost += location.second.selfCost;
+        }
+    }
+}
+
+/// the caller/callee source maps are shared by the jobs that build the views
+std::pair<TreeData, std::shared_ptr<const CallerCalleeBuilder>>
+mergeAllocations(Parser* parser, const ParserData& data, std::shared_ptr<const ResultData> resultData)
+{
+    // every worker merges a contiguous range of the allocations, the partial results get reduced pairwise
+    // the costs are integers and the rows stay sorted by symbol, so the result does not depend on the split
+    const auto allocationCount = data.allocations.size();
+    const size_t minAllocationsPerWorker = 10000;
+    const auto numWorkers = std::max<size_t>(
+        1, std::min<size_t>(std::thread::hardware_concurrency(), allocationCount / minAllocationsPerWorker));
+    std::atomic<size_t> progress {0};
+    // new instruction pointers get added while taking snapshots, so this can't be kept around
+    const IpLocations ipLocations(data);
+    vector<future<MergedAllocations>> workers;
+    for (size_t i = 1; i < numWorkers; ++i) {
+        const auto begin = allocationCount * i / numWorkers;
+        const auto end = allocationCount * (i + 1) / numWorkers;
+        workers.push_back(async(launch::async, [parser, &data, &ipLocations, begin, end, &progress]() {
+            return mergeAllocationRange(parser, data, ipLocations, begin, end, &progress);
+        }));
+    }
+    vector<MergedAllocations> partials;
+    partials.push_back(
+        mergeAllocationRange(parser, data, ipLocations, 0, allocationCount / numWorkers, &progress));
+    for (auto& worker : workers) {
+        partials.push_back(worker.get());
+    }
+
+    while (partials.size() > 1) {
+        vector<future<void>> merges;
+        for (size_t i = 0; i + 1 < partials.size(); i += 2) {
+            merges.push_back(async(launch::async, [&partials, i]() {
+                auto& lhs = partials[i];
+                auto& rhs = partials[i + 1];
+                mergeRows(&lhs.rows, &rhs.rows);
+                mergeCallerCalleeResults(&lhs.callerCalleeResults, rhs.callerCalleeResults);
+                rhs = {};
+            }));
+        }
+        for (auto& merge : merges) {
+            merge.get();
+        }
+        for (size_t i = 1, j = 2; j < partials.size(); ++i, j += 2) {
+            partials[i] = std::move(partials[j]);
+        }
+        partials.resize((partials.size() + 1) / 2);
+    }
+
+    TreeData topRows;
+    topRows.rows.swap(partials.front().rows);
     // now set the parents, the data is constant from here on
     setParents(topRows.rows, nullptr);
 
     topRows.resultData = std::move(resultData);
-    return {topRows, callerCalleeResults};
+    return {topRows, std::make_shared<const CallerCalleeBuilder>(std::move(partials.front().callerCalleeResults))};
 }
 
 RowData* findBySymbol(Symbol symbol, QVector<RowData>* data)
@@ -400,12 +773,52 @@ RowData* findBySymbol(Symbol symbol, QVector<RowData>* data)
     return it == data->end() ? nullptr : &(*it);
 }
 
-AllocationData buildTopDown(const QVector<RowData>& bottomUpData, QVector<RowData>* topDownData)
+/**
+ * Run @p job on about equally sized, contiguous ranges of the indices up to @p count concurrently,
+ * with at least @p minCountPerWorker indices per range.
+ *
+ * @return the results of the job for each range, in the order of the ranges
+ */
+template <typename Result, typename Job>
+vector<Result> mapRanges(size_t count, size_t minCountPerWorker, Job job)
+{
+    const auto numWorkers =
+        std::max<size_t>(1, std::min<size_t>(std::thread::hardware_concurrency(), count / minCountPerWorker));
+    vector<future<Result>> workers;
+    for (size_t i = 1; i < numWorkers; ++i) {
+        const auto begin = count * i / numWorkers;
+        const auto end = count * (i + 1) / numWorkers;
+        workers.push_back(async(launch::async, [&job, begin, end]() { return job(begin, end); }));
+    }
+    vector<Result> results;
+    results.push_back(job(0, count / numWorkers));
+    for (auto& worker : workers) {
+        results.push_back(worker.get());
+    }
+    return results;
+}
+
+/**
+ * Run @p job on about equally sized, contiguous ranges of @p rows concurrently.
+ *
+ * @return the results of the job for each range, in the order of the ranges
+ */
+template <typename Result, typename Job>
+vector<Result> mapRowRanges(const QVector<RowData>& rows, Job job)
+{
+    const auto data = rows.constData();
+    return mapRanges<Result>(rows.size(), 1,
+                             [&job, data](size_t begin, size_t end) { return job(data + begin, data + end); });
+}
+
+AllocationData buildTopDown(const RowData* begin, const RowData* end, QVector<RowData>* topDownData)
 {
     AllocationData totalCost;
-    for (const auto& row : bottomUpData) {
+    for (auto it = begin; it != end; ++it) {
+        const auto& row = *it;
         // recurse and find the cost attributed to children
-        const auto childCost = buildTopDown(row.children, topDownData);
+        const auto childCost =
+            buildTopDown(row.children.constData(), row.children.constData() + row.children.size(), topDownData);
         if (childCost != row.cost) {
             // this row is (partially) a leaf
             const auto cost = row.cost - childCost;
@@ -432,13 +845,37 @@ AllocationData buildTopDown(const QVector<RowData>& bottomUpData, QVector<RowDat
     return totalCost;
 }
 
+/// add the rows of the top-down tree @p other to @p rows, new rows get appended like in buildTopDown
+void mergeTopDown(QVector<RowData>* rows, const QVector<RowData>& other)
+{
+    for (const auto& row : other) {
+        auto data = findBySymbol(row.symbol, rows);
+        if (!data) {
+            *rows << row;
+        } else {
+            data->cost += row.cost;
+            mergeTopDown(&data->children, row.children);
+        }
+    }
+}
+
 TreeData toTopDownData(const TreeData& bottomUpData)
 {
     TreeData topRows;
     topRows.resultData = bottomUpData.resultData;
-    buildTopDown(bottomUpData.rows, &topRows.rows);
-    // now set the parents, the data is constant from here on
-    setParents(topRows.rows, nullptr);
+    // the subtrees of the top-level rows are independent, merging their top-down trees in order
+    // yields the same tree as building it sequentially
+    auto buildPartial = [](const RowData* begin, const RowData* end) {
+        QVector<RowData> topDownData;
+        buildTopDown(begin, end, &topDownData);
+        return topDownData;
+    };
+    auto partials = mapRowRanges<QVector<RowData>>(bottomUpData.rows, buildPartial);
+    topRows.rows.swap(partials.front());
+    for (size_t i = 1; i < partials.size(); ++i) {
+        mergeTopDown(&topRows.rows, partials[i]);
+    }
+    // the parents are only needed to walk the bottom-up tree, the tree model finds them on demand
     return topRows;
 }
 
@@ -460,13 +897,16 @@ struct ReusableGuardBuffer
     tsl::robin_set<std::pair<Symbol, Symbol>> callerCalleeRecursionGuard;
 };
 
-AllocationData buildCallerCallee(const QVector<RowData>& bottomUpData, CallerCalleeResults* callerCalleeResults,
+AllocationData buildCallerCallee(const RowData* begin, const RowData* end, CallerCalleeBuilder* callerCalleeResults,
                                  ReusableGuardBuffer* guardBuffer)
 {
     AllocationData totalCost;
-    for (const auto& row : bottomUpData) {
+    for (auto it = begin; it != end; ++it) {
+        const auto& row = *it;
         // recurse to find a leaf
-        const auto childCost = buildCallerCallee(row.children, callerCalleeResults, guardBuffer);
+        const auto childCost = buildCallerCallee(row.children.constData(),
+                                                 row.children.constData() + row.children.size(),
+                                                 callerCalleeResults, guardBuffer);
         if (childCost != row.cost) {
             // this row is (partially) a leaf
             const auto cost = row.cost - childCost;
@@ -481,12 +921,12 @@ AllocationData buildCallerCallee(const QVector<RowData>& bottomUpData, CallerCal
             auto node = &row;
 
             Symbol lastSymbol;
-            CallerCalleeEntry* lastEntry = nullptr;
+            bool hasLastEntry = false;
 
             while (node) {
                 const auto symbol = node->symbol;
                 // aggregate caller-callee data
-                auto& entry = callerCalleeResults->entries[symbol];
+                auto& entry = (*callerCalleeResults)[symbol];
                 if (recursionGuard.insert(symbol).second) {
                     // only increment inclusive cost once for a given stack
                     entry.inclusiveCost += cost;
@@ -497,16 +937,17 @@ AllocationData buildCallerCallee(const QVector<RowData>& bottomUpData, CallerCal
                 }
                 // add current entry as callee to last entry
                 // and last entry as caller to current entry
-                if (lastEntry) {
+                if (hasLastEntry) {
                     if (callerCalleeRecursionGuard.insert({symbol, lastSymbol}).second) {
-                        lastEntry->callees[symbol] += cost;
                         entry.callers[lastSymbol] += cost;
+                        // look the last entry up again, inserting the current one may have moved it
+                        callerCalleeResults->find(lastSymbol).value().callees[symbol] += cost;
                     }
                 }
 
                 node = node->parent;
                 lastSymbol = symbol;
-                lastEntry = &entry;
+                hasLastEntry = true;
             }
         }
         totalCost += row.cost;
@@ -514,119 +955,286 @@ AllocationData buildCallerCallee(const QVector<RowData>& bottomUpData, CallerCal
     return totalCost;
 }
 
-CallerCalleeResults toCallerCalleeData(const TreeData& bottomUpData, const CallerCalleeResults& results, bool diffMode)
+/// @return the entries of @p map sorted by key, with the values converted by @p convert
+template <typename Key, typename BuilderValue, typename Convert>
+auto toFlatMap(const tsl::robin_map<Key, BuilderValue>& map, Convert convert)
+    -> FlatMap<Key, decltype(convert(std::declval<const BuilderValue&>()))>
+{
+    using Value = decltype(convert(std::declval<const BuilderValue&>()));
+    vector<const std::pair<Key, BuilderValue>*> sorted;
+    sorted.reserve(map.size());
+    for (const auto& entry : map) {
+        sorted.push_back(&entry);
+    }
+    std::sort(sorted.begin(), sorted.end(), [](const auto* lhs, const auto* rhs) { return lhs->first < rhs->first; });
+    QVector<Key> keys;
+    QVector<Value> values;
+    keys.reserve(sorted.size());
+    values.reserve(sorted.size());
+    for (const auto* entry : sorted) {
+        keys.push_back(entry->first);
+        values.push_back(convert(entry->second));
+    }
+    return {std::move(keys), std::move(values)};
+}
+
+CallerCalleeResults toCallerCalleeData(const TreeData& bottomUpData, const CallerCalleeBuilder& sourceMaps,
+                                       bool diffMode)
 {
     // copy the source map and continue from there
-    auto callerCalleeResults = results;
-    ReusableGuardBuffer guardBuffer;
-    buildCallerCallee(bottomUpData.rows, &callerCalleeResults, &guardBuffer);
+    auto builder = sourceMaps;
+    // every leaf gets handled on its own, so the subtrees of the top-level rows can be handled concurrently
+    auto buildPartial = [](const RowData* begin, const RowData* end) {
+        CallerCalleeBuilder partial;
+        ReusableGuardBuffer guardBuffer;
+        buildCallerCallee(begin, end, &partial, &guardBuffer);
+        return partial;
+    };
+    const auto partials = mapRowRanges<CallerCalleeBuilder>(bottomUpData.rows, buildPartial);
+    for (const auto& partial : partials) {
+        mergeCallerCalleeResults(&builder, partial);
+    }
 
     if (diffMode) {
         // remove rows without cost
-        for (auto it = callerCalleeResults.entries.begin(); it != callerCalleeResults.entries.end();) {
-            if (it->inclusiveCost == AllocationData() && it->selfCost == AllocationData()) {
-                it = callerCalleeResults.entries.erase(it);
+        for (auto it = builder.begin(); it != builder.end();) {
+            if (it->second.inclusiveCost == AllocationData() && it->second.selfCost == AllocationData()) {
+                it = builder.erase(it);
             } else {
                 ++it;
             }
         }
     }
 
+    auto identity = [](const auto& value) { return value; };
+    CallerCalleeResults callerCalleeResults;
+    callerCalleeResults.entries = toFlatMap(builder, [&identity](const CallerCalleeBuilderEntry& builderEntry) {
+        CallerCalleeEntry entry;
+        entry.inclusiveCost = builderEntry.inclusiveCost;
+        entry.selfCost = builderEntry.selfCost;
+        entry.callers = toFlatMap(builderEntry.callers, identity);
+        entry.callees = toFlatMap(builderEntry.callees, identity);
+        entry.sourceMap = toFlatMap(builderEntry.sourceMap, identity);
+        return entry;
+    });
     callerCalleeResults.resultData = bottomUpData.resultData;
     return callerCalleeResults;
 }
 
-struct MergedHistogramColumnData
+/// the costs of the allocations in one row of a histogram, per symbol
+struct HistogramBucket
 {
-    Symbol symbol;
-    int64_t allocations;
-    int64_t totalAllocated;
-    bool operator<(const Symbol& rhs) const
+    int64_t allocations = 0;
+    int64_t totalAllocated = 0;
+    tsl::robin_map<Symbol, std::pair<int64_t, int64_t>> symbols;
+
+    void add(const Symbol& symbol, int64_t symbolAllocations, int64_t symbolTotalAllocated)
     {
-        return symbol < rhs;
+        allocations += symbolAllocations;
+        totalAllocated += symbolTotalAllocated;
+        auto& cost = symbols[symbol];
+        cost.first += symbolAllocations;
+        cost.second += symbolTotalAllocated;
+    }
+
+    void merge(const HistogramBucket& other)
+    {
+        allocations += other.allocations;
+        totalAllocated += other.totalAllocated;
+        for (const auto& symbol : other.symbols) {
+            auto& cost = symbols[symbol.first];
+            cost.first += symbol.second.first;
+            cost.second += symbol.second.second;
+        }
     }
 };
 
-HistogramData buildSizeHistogram(ParserData& data, std::shared_ptr<const ResultData> resultData)
+/// fill the columns of @p row with the total of @p bucket and the symbols that contribute most to it
+void insertHistogramColumns(const HistogramBucket& bucket, HistogramRow* row)
+{
+    row->columns[0] = {bucket.allocations, bucket.totalAllocated, {}};
+    vector<HistogramColumn> columns;
+    columns.reserve(bucket.symbols.size());
+    for (const auto& symbol : bucket.symbols) {
+        columns.push_back({symbol.second.first, symbol.second.second, symbol.first});
+    }
+    // -1 to account for total row
+    const auto numColumns = min(columns.size(), size_t(HistogramRow::NUM_COLUMNS - 1));
+    partial_sort(columns.begin(), columns.begin() + numColumns, columns.end(),
+                 [](const HistogramColumn& lhs, const HistogramColumn& rhs) {
+                     // the symbols break ties, the map iterates in no particular order
+                     return std::tie(lhs.allocations, lhs.totalAllocated, rhs.symbol)
+                         > std::tie(rhs.allocations, rhs.totalAllocated, lhs.symbol);
+                 });
+    std::copy(columns.begin(), columns.begin() + numColumns, row->columns.begin() + 1);
+}
+
+Symbol allocationSymbol(const ParserData& data, AllocationIndex allocationIndex)
+{
+    const auto& allocation = data.allocations[allocationIndex.index];
+    const auto& ipIndex = data.findTrace(allocation.traceIndex).ipIndex;
+    return symbol(data.findIp(ipIndex));
+}
+
+HistogramData buildSizeHistogram(const ParserData& data, const QVector<quint64>& bucketSizes,
+                                 std::shared_ptr<const ResultData> resultData)
 {
     HistogramData ret;
     if (data.allocationInfoCounter.empty()) {
         return ret;
     }
-    sort(data.allocationInfoCounter.begin(), data.allocationInfoCounter.end());
-    const auto totalLabel = i18n("total");
-    HistogramRow row;
-    const pair<uint64_t, QString> buckets[] = {{8, i18n("0B to 8B")},
-                                               {16, i18n("9B to 16B")},
-                                               {32, i18n("17B to 32B")},
-                                               {64, i18n("33B to 64B")},
-                                               {128, i18n("65B to 128B")},
-                                               {256, i18n("129B to 256B")},
-                                               {512, i18n("257B to 512B")},
-                                               {1024, i18n("512B to 1KB")},
-                                               {numeric_limits<uint64_t>::max(), i18n("more than 1KB")}};
-    uint bucketIndex = 0;
-    row.size = buckets[bucketIndex].first;
-    row.sizeLabel = buckets[bucketIndex].second;
-    vector<MergedHistogramColumnData> columnData;
-    columnData.reserve(128);
-    auto insertColumns = [&]() {
-        sort(columnData.begin(), columnData.end(),
-             [](const MergedHistogramColumnData& lhs, const MergedHistogramColumnData& rhs) {
-                 return std::tie(lhs.allocations, lhs.totalAllocated) > std::tie(rhs.allocations, rhs.totalAllocated);
-             });
-        // -1 to account for total row
-        for (size_t i = 0; i < min(columnData.size(), size_t(HistogramRow::NUM_COLUMNS - 1)); ++i) {
-            const auto& column = columnData[i];
-            row.columns[i + 1] = {column.allocations, column.totalAllocated, column.symbol};
+    // every allocation info lands in the first bucket that is large enough for it, or the last one
+    const auto numBuckets = bucketSizes.size() + 1;
+    auto buildPartial = [&data, &bucketSizes, numBuckets](size_t begin, size_t end) {
+        vector<HistogramBucket> buckets(numBuckets);
+        for (size_t i = begin; i < end; ++i) {
+            const auto& info = data.allocationInfoCounter[i];
+            if (!info.allocations) {
+                continue;
+            }
+            const auto bucket = std::distance(bucketSizes.begin(),
+                                              std::lower_bound(bucketSizes.begin(), bucketSizes.end(), info.info.size));
+            buckets[bucket].add(allocationSymbol(data, info.info.allocationIndex), info.allocations,
+                                static_cast<int64_t>(info.info.size * info.allocations));
         }
+        return buckets;
     };
-    for (const auto& info : data.allocationInfoCounter) {
-        if (info.info.size > row.size) {
-            insertColumns();
-            columnData.clear();
-            ret.rows << row;
-            ++bucketIndex;
-            row.size = buckets[bucketIndex].first;
-            row.sizeLabel = buckets[bucketIndex].second;
-            row.columns[0] = {info.allocations, static_cast<qint64>(info.info.size * info.allocations), {}};
+    const size_t minInfosPerWorker = 10000;
+    auto partials = mapRanges<vector<HistogramBucket>>(data.allocationInfoCounter.size(), minInfosPerWorker,
+                                                       buildPartial);
+    auto& buckets = partials.front();
+    for (size_t i = 1; i < partials.size(); ++i) {
+        for (int bucket = 0; bucket < numBuckets; ++bucket) {
+            buckets[bucket].merge(partials[i][bucket]);
+        }
+    }
+
+    // skip the empty buckets at the end
+    auto numRows = numBuckets;
+    while (numRows > 1 && !buckets[numRows - 1].allocations) {
+        --numRows;
+    }
+    ret.rows.reserve(numRows);
+    for (int bucket = 0; bucket < numRows; ++bucket) {
+        HistogramRow row;
+        if (bucket == bucketSizes.size()) {
+            row.size = numeric_limits<quint64>::max();
+            row.sizeLabel = i18n("more than %1", Util::formatBytes(bucketSizes.last()));
         } else {
-            auto& column = row.columns[0];
-            column.allocations += info.allocations;
-            column.totalAllocated += info.info.size * info.allocations;
-        }
-        const auto& allocation = data.allocations[info.info.allocationIndex.index];
-        const auto& ipIndex = data.findTrace(allocation.traceIndex).ipIndex;
-        const auto& ip = data.findIp(ipIndex);
-        const auto& sym = symbol(ip);
-        auto it = lower_bound(columnData.begin(), columnData.end(), sym);
-        if (it == columnData.end() || it->symbol != sym) {
-            columnData.insert(it, {sym, info.allocations, static_cast<qint64>(info.info.size * info.allocations)});
+            row.size = bucketSizes[bucket];
+            const quint64 minSize = bucket ? bucketSizes[bucket - 1] + 1 : 0;
+            row.sizeLabel = i18n("%1 to %2", Util::formatBytes(minSize), Util::formatBytes(row.size));
+        }
+        insertHistogramColumns(buckets[bucket], &row);
+        ret.rows << row;
+    }
+    ret.resultData = std::move(resultData);
+    return ret;
+}
+
+HistogramData buildLifetimeHistogram(const ParserData& data, std::shared_ptr<const ResultData> resultData)
+{
+    HistogramData ret;
+    if (data.lifetimeCounter.empty()) {
+        return ret;
+    }
+    // group the counters by their bucket
+    vector<pair<uint64_t, int64_t>> counters(data.lifetimeCounter.begin(), data.lifetimeCounter.end());
+    sort(counters.begin(), counters.end(), [](const pair<uint64_t, int64_t>& lhs, const pair<uint64_t, int64_t>& rhs) {
+        return std::make_pair(lhs.first & 0xff, lhs.first) < std::make_pair(rhs.first & 0xff, rhs.first);
+    });
+    const uint32_t lastBucket = counters.back().first & 0xff;
+    auto counter = counters.cbegin();
+    for (uint32_t bucket = 0; bucket <= lastBucket; ++bucket) {
+        HistogramRow row;
+        if (bucket == 0) {
+            row.sizeLabel = i18n("below 1ms");
         } else {
-            it->allocations += info.allocations;
-            it->totalAllocated += static_cast<qint64>(info.info.size * info.allocations);
+            row.sizeLabel = i18n("%1 to %2", Util::formatTime(qint64(1) << (bucket - 1)),
+                                 Util::formatTime(qint64(1) << bucket));
+        }
+        row.size = bucket;
+        HistogramBucket costs;
+        for (; counter != counters.cend() && (counter->first & 0xff) == bucket; ++counter) {
+            const auto& info = data.allocationInfos[counter->first >> 8];
+            costs.add(allocationSymbol(data, info.allocationIndex), counter->second,
+                      static_cast<int64_t>(info.size * counter->second));
         }
+        insertHistogramColumns(costs, &row);
+        ret.rows << row;
     }
-    insertColumns();
-    ret.rows << row;
     ret.resultData = std::move(resultData);
     return ret;
 }
+
+PageOccupancyData buildPageOccupancy(const ParserData& data)
+{
+    PageOccupancyData ret;
+    ret.pageSize = data.occupancyPageSize;
+    ret.rows.reserve(data.pageOccupancy.size());
+    for (const auto& occupancy : data.pageOccupancy) {
+        PageOccupancyRow row;
+        row.time = occupancy.time;
+        row.pages.reserve(occupancy.pages.size());
+        for (const auto pages : occupancy.pages) {
+            row.pages.append(pages);
+        }
+        ret.rows.append(std::move(row));
+    }
+    return ret;
+}
 }
 
 Parser::Parser(QObject* parent)
     : QObject(parent)
 {
     qRegisterMetaType<SummaryData>();
+    qRegisterMetaType<PageOccupancyData>();
 }
 
 Parser::~Parser() = default;
 
+void Parser::setChartSeriesCount(int count)
+{
+    m_chartSeriesCount = count;
+}
+
+int Parser::chartSeriesCount() const
+{
+    return m_chartSeriesCount;
+}
+
+QVector<quint64> Parser::defaultSizeHistogramBuckets()
+{
+    return {8, 16, 32, 64, 128, 256, 512, 1024};
+}
+
+void Parser::setSizeHistogramBuckets(const QVector<quint64>& buckets)
+{
+    Q_ASSERT(!buckets.isEmpty() && std::is_sorted(buckets.begin(), buckets.end()));
+    m_sizeHistogramBuckets = buckets;
+}
+
+QVector<quint64> Parser::sizeHistogramBuckets() const
+{
+    return m_sizeHistogramBuckets;
+}
+
+void Parser::setResultCacheEnabled(bool enabled)
+{
+    m_resultCacheEnabled = enabled;
+}
+
+bool Parser::isResultCacheEnabled() const
+{
+    return m_resultCacheEnabled;
+}
+
 bool Parser::isFiltered() const
 {
-    if (!m_data)
+    if (m_path.isEmpty())
         return false;
-    return m_data->filterParameters.isFilteredByTime(m_data->totalTime);
+    return m_filterParameters.isFilteredByTime(m_totalTime);
 }
 
 void Parser::parse(const QString& path, const QString& diffBase, const FilterParameters& filterParameters,
@@ -639,11 +1247,56 @@ void Parser::parseImpl(const QString& path, const QString& diffBase, const Filte
                        StopAfter stopAfter)
 {
     auto oldData = std::move(m_data);
+    const auto chartSeriesCount = m_chartSeriesCount;
+    const auto sizeHistogramBuckets = m_sizeHistogramBuckets;
+    const auto resultCacheEnabled = m_resultCacheEnabled;
     using namespace ThreadWeaver;
-    stream() << make_job([this, oldData, path, diffBase, filterParameters, stopAfter]() {
-        const auto isReparsing = (path == m_path && oldData && diffBase.isEmpty());
+    stream() << make_job([this, oldData, path, diffBase, filterParameters, stopAfter, chartSeriesCount,
+                          sizeHistogramBuckets, resultCacheEnabled]() {
+        auto isReparsing = (path == m_path && oldData && diffBase.isEmpty());
+        // the results of this file got loaded from the cache, which leaves no data to reparse
+        const auto needsInitialRead = (path == m_path && !oldData && diffBase.isEmpty());
         auto parsingMsg = isReparsing ? i18n("reparsing data") : i18n("parsing data");
 
+        // only cache the complete results of the initial parse, filtering by time reparses the file instead
+        const auto useResultCache = resultCacheEnabled && !isReparsing && diffBase.isEmpty()
+            && stopAfter == StopAfter::Finished && filterParameters.minTime == 0
+            && filterParameters.maxTime == std::numeric_limits<int64_t>::max();
+        const auto cacheKey =
+            useResultCache ? ResultCache::cacheKey(path, filterParameters, chartSeriesCount, sizeHistogramBuckets)
+                           : QByteArray();
+        auto cachedResults = std::make_shared<CachedResults>();
+        if (!cacheKey.isEmpty() && ResultCache::load(path, cacheKey, cachedResults.get())) {
+            emit progressMessageAvailable(i18n("loading cached results"));
+            setParents(cachedResults->bottomUp.rows, nullptr);
+            emit summaryAvailable(cachedResults->summary);
+            emit bottomUpDataAvailable(cachedResults->bottomUp);
+            emit sizeHistogramDataAvailable(cachedResults->sizeHistogram);
+            emit lifetimeHistogramDataAvailable(cachedResults->lifetimeHistogram);
+            emit pageOccupancyDataAvailable(cachedResults->pageOccupancy);
+            emit topDownDataAvailable(cachedResults->topDown);
+            emit callerCalleeDataAvailable(cachedResults->callerCallee);
+            emit consumedChartDataAvailable(cachedResults->consumedChart);
+            emit allocationsChartDataAvailable(cachedResults->allocationsChart);
+            emit temporaryChartDataAvailable(cachedResults->temporaryChart);
+            if (cachedResults->summary.cost.peakMapped) {
+                emit mappedChartDataAvailable(cachedResults->mappedChart);
+            }
+            emit allocationRateChartDataAvailable(cachedResults->allocationRateChart);
+            emit progress(0);
+            const auto summary = cachedResults->summary;
+            QMetaObject::invokeMethod(this, [this, path, summary]() {
+                Q_ASSERT(QThread::currentThread() == thread());
+                // the next reparse has to read the file anew
+                m_data.reset();
+                m_path = path;
+                m_filterParameters = summary.filterParameters;
+                m_totalTime = summary.totalTime;
+                emit finished();
+            });
+            return;
+        }
+
         auto updateProgress = [this, parsingMsg, lastPassCompletion = 0.f](const ParserData& data) mutable {
             auto passCompletion = 1.0 * data.parsingState.readCompressedByte / data.parsingState.fileSize;
             if (std::abs(lastPassCompletion - passCompletion) < 0.001) {
@@ -652,7 +1305,7 @@ void Parser::parseImpl(const QString& path, const QString& diffBase, const Filte
             }
 
             lastPassCompletion = passCompletion;
-            const auto numPasses = data.diffMode ? 2 : 3;
+            const auto numPasses = data.diffMode ? 1 : 2;
             auto totalCompletion = (data.parsingState.pass + passCompletion) / numPasses;
             auto spentTime_ms = data.parseTimer.elapsed();
             auto totalRemainingTime_ms = (spentTime_ms / totalCompletion) * (1.0 - totalCompletion);
@@ -665,12 +1318,28 @@ void Parser::parseImpl(const QString& path, const QString& diffBase, const Filte
 
         const auto stdPath = path.toStdString();
         auto data = isReparsing ? oldData : make_shared<ParserData>(updateProgress);
+        // toggling the suppressions doesn't change the histograms and the charts either, so they stay as they are
+        const auto onlySuppressionsChanged = isReparsing && data->canReapplySuppressions(filterParameters);
+        if (needsInitialRead) {
+            data->filterParameters = filterParameters;
+            data->filterParameters.minTime = 0;
+            data->filterParameters.maxTime = std::numeric_limits<int64_t>::max();
+            if (!data->read(stdPath, false)) {
+                emit failedToOpen(path);
+                return;
+            }
+            data->clearForReparse();
+            isReparsing = true;
+        }
         data->filterParameters = filterParameters;
+        data->chartSeriesCount = chartSeriesCount;
 
-        emit progressMessageAvailable(parsingMsg);
+        emit progressMessageAvailable(onlySuppressionsChanged ? i18n("applying suppressions") : parsingMsg);
         data->parseTimer.start();
 
-        if (!diffBase.isEmpty()) {
+        if (onlySuppressionsChanged) {
+            data->reapplySuppressions();
+        } else if (!diffBase.isEmpty()) {
             ParserData diffData(nullptr); // currently we don't track the progress of diff parsing
             auto readBase = async(launch::async, [&diffData, diffBase, isReparsing]() {
                 return diffData.read(diffBase.toStdString(), isReparsing);
@@ -686,46 +1355,101 @@ void Parser::parseImpl(const QString& path, const QString& diffBase, const Filte
             data->diff(diffData);
             data->diffMode = true;
         } else {
-            if (!data->read(stdPath, isReparsing)) {
+            if (!isReparsing && stopAfter != StopAfter::Summary) {
+                data->snapshotCallback = [this](ParserData& data) {
+                    // the strings keep growing while parsing, the partial results need a copy of them
+                    data.finalizePeaks();
+                    const auto resultData = std::make_shared<const ResultData>(
+                        data.totalCost, std::make_shared<const StringTable>(data.strings.copy()));
+                    auto filterParameters = data.filterParameters;
+                    const auto totalTime = data.parsingState.timestamp + 1;
+                    filterParameters.maxTime = std::min(filterParameters.maxTime, totalTime);
+                    SummaryData summary(QString::fromStdString(data.debuggee), data.totalCost, totalTime,
+                                        filterParameters, data.peakTime, data.peakRSS * data.systemInfo.pageSize,
+                                        data.systemInfo.pages * data.systemInfo.pageSize, data.fromAttached, 0, {},
+                                        data.sampleInterval);
+                    summary.partial = true;
+                    emit summaryAvailable(summary);
+                    emit bottomUpDataAvailable(mergeAllocations(this, data, resultData).first);
+                };
+            }
+            const auto success = data->read(stdPath, isReparsing);
+            data->snapshotCallback = nullptr;
+            if (!success) {
                 emit failedToOpen(path);
                 return;
             }
         }
 
-        if (!isReparsing) {
-            data->qtStrings.resize(data->strings.size());
-            std::transform(data->strings.begin(), data->strings.end(), data->qtStrings.begin(),
-                           [](const std::string& string) { return QString::fromStdString(string); });
+        if (!data->diffMode) {
+            data->saveUnsuppressedCosts();
         }
-
         data->applyLeakSuppressions();
 
-        const auto resultData = std::make_shared<const ResultData>(data->totalCost, data->qtStrings);
+        // the strings don't change anymore after the first pass, share them with the results
+        // without copying, which also keeps the data alive as long as the results need it
+        const auto resultData = std::make_shared<const ResultData>(
+            data->totalCost, std::shared_ptr<const StringTable>(data, &data->strings));
 
-        emit summaryAvailable({QString::fromStdString(data->debuggee), data->totalCost, data->totalTime,
-                               data->filterParameters, data->peakTime, data->peakRSS * data->systemInfo.pageSize,
-                               data->systemInfo.pages * data->systemInfo.pageSize, data->fromAttached,
-                               data->totalLeakedSuppressed, toQt(data->suppressions)});
+        cachedResults->summary = {QString::fromStdString(data->debuggee), data->totalCost, data->totalTime,
+                                  data->filterParameters, data->peakTime, data->peakRSS * data->systemInfo.pageSize,
+                                  data->systemInfo.pages * data->systemInfo.pageSize, data->fromAttached,
+                                  data->totalLeakedSuppressed, toQt(data->suppressions), data->sampleInterval};
+        emit summaryAvailable(cachedResults->summary);
 
         if (stopAfter == StopAfter::Summary) {
             emit finished();
             return;
         }
 
+        // the histograms only read the data too, so build them while merging the allocations
+        const auto buildHistograms = !onlySuppressionsChanged && stopAfter != StopAfter::BottomUp;
+        auto histograms = async(buildHistograms ? launch::async : launch::deferred,
+                                [data, sizeHistogramBuckets, resultData]() {
+                                    return std::make_pair(buildSizeHistogram(*data, sizeHistogramBuckets, resultData),
+                                                          buildLifetimeHistogram(*data, resultData));
+                                });
+
         emit progressMessageAvailable(i18n("merging allocations..."));
         // merge allocations before modifying the data again
         const auto mergedAllocations = mergeAllocations(this, *data, resultData);
         emit bottomUpDataAvailable(mergedAllocations.first);
+        cachedResults->bottomUp = mergedAllocations.first;
 
         if (stopAfter == StopAfter::BottomUp) {
             emit finished();
             return;
         }
 
-        // also calculate the size histogram
-        emit progressMessageAvailable(i18n("building size histogram..."));
-        const auto sizeHistogram = buildSizeHistogram(*data, resultData);
-        emit sizeHistogramDataAvailable(sizeHistogram);
+        if (onlySuppressionsChanged) {
+            auto parallel = new Collection;
+            *parallel << make_job([this, mergedAllocations]() {
+                emit topDownDataAvailable(toTopDownData(mergedAllocations.first));
+            }) << make_job([this, mergedAllocations]() {
+                emit callerCalleeDataAvailable(
+                    toCallerCalleeData(mergedAllocations.first, *mergedAllocations.second, false));
+            });
+            auto sequential = new Sequence;
+            *sequential << parallel << make_job([this, data, path]() {
+                QMetaObject::invokeMethod(this, [this, data, path]() {
+                    Q_ASSERT(QThread::currentThread() == thread());
+                    m_data = data;
+                    m_path = path;
+                    m_filterParameters = m_data->filterParameters;
+                    emit finished();
+                });
+            });
+            stream() << sequential;
+            return;
+        }
+
+        emit progressMessageAvailable(i18n("building histograms..."));
+        std::tie(cachedResults->sizeHistogram, cachedResults->lifetimeHistogram) = histograms.get();
+        emit sizeHistogramDataAvailable(cachedResults->sizeHistogram);
+        emit lifetimeHistogramDataAvailable(cachedResults->lifetimeHistogram);
+        // the second pass below reads the page occupancy anew
+        cachedResults->pageOccupancy = buildPageOccupancy(*data);
+        emit pageOccupancyDataAvailable(cachedResults->pageOccupancy);
         // now data can be modified again for the chart data evaluation
 
         if (stopAfter == StopAfter::SizeHistogram) {
@@ -737,36 +1461,54 @@ void Parser::parseImpl(const QString& path, const QString& diffBase, const Filte
 
         const auto diffMode = data->diffMode;
         emit progressMessageAvailable(i18n("building charts..."));
+        // every job fills a different member of cachedResults
         auto parallel = new Collection;
-        *parallel << make_job([this, mergedAllocations, resultData]() {
-            const auto topDownData = toTopDownData(mergedAllocations.first);
-            emit topDownDataAvailable(topDownData);
-        }) << make_job([this, mergedAllocations, diffMode]() {
-            emit callerCalleeDataAvailable(
-                toCallerCalleeData(mergedAllocations.first, mergedAllocations.second, diffMode));
+        *parallel << make_job([this, mergedAllocations, cachedResults]() {
+            cachedResults->topDown = toTopDownData(mergedAllocations.first);
+            emit topDownDataAvailable(cachedResults->topDown);
+        }) << make_job([this, mergedAllocations, diffMode, cachedResults]() {
+            cachedResults->callerCallee =
+                toCallerCalleeData(mergedAllocations.first, *mergedAllocations.second, diffMode);
+            emit callerCalleeDataAvailable(cachedResults->callerCallee);
         });
         if (!data->diffMode && stopAfter != StopAfter::TopDownAndCallerCallee) {
             // only build charts when we are not diffing
-            *parallel << make_job([this, data, stdPath, isReparsing, resultData]() {
+            *parallel << make_job([this, data, stdPath, isReparsing, resultData, cachedResults]() {
                 // this mutates data, and thus anything running in parallel must
                 // not access data
                 data->prepareBuildCharts(resultData);
-                data->read(stdPath, AccumulatedTraceData::ThirdPass, isReparsing);
+                data->read(stdPath, AccumulatedTraceData::SecondPass, isReparsing);
+                data->finishBuildCharts();
+                cachedResults->consumedChart = data->consumedChartData;
+                cachedResults->allocationsChart = data->allocationsChartData;
+                cachedResults->temporaryChart = data->temporaryChartData;
+                cachedResults->mappedChart = data->mappedChartData;
+                cachedResults->allocationRateChart = data->allocationRateChartData;
                 emit consumedChartDataAvailable(data->consumedChartData);
                 emit allocationsChartDataAvailable(data->allocationsChartData);
                 emit temporaryChartDataAvailable(data->temporaryChartData);
+                if (data->totalCost.peakMapped) {
+                    // keep the tab disabled when the recording didn't track memory mappings
+                    emit mappedChartDataAvailable(data->mappedChartData);
+                }
+                emit allocationRateChartDataAvailable(data->allocationRateChartData);
             });
         }
 
         emit progress(0);
 
         auto sequential = new Sequence;
-        *sequential << parallel << make_job([this, data, path]() {
+        *sequential << parallel << make_job([this, data, path, cacheKey, cachedResults]() {
+            if (!cacheKey.isEmpty()) {
+                ResultCache::save(path, cacheKey, *cachedResults);
+            }
             QMetaObject::invokeMethod(this, [this, data, path]() {
                 Q_ASSERT(QThread::currentThread() == thread());
                 m_data = data;
                 m_data->clearForReparse();
                 m_path = path;
+                m_filterParameters = m_data->filterParameters;
+                m_totalTime = m_data->totalTime;
                 emit finished();
             });
         });
@@ -777,12 +1519,12 @@ void Parser::parseImpl(const QString& path, const QString& diffBase, const Filte
 
 void Parser::reparse(const FilterParameters& parameters_)
 {
-    if (!m_data || m_data->diffMode)
+    if (m_path.isEmpty() || (m_data && m_data->diffMode))
         return;
 
     auto filterParameters = parameters_;
     filterParameters.minTime = std::max(int64_t(0), filterParameters.minTime);
-    filterParameters.maxTime = std::min(m_data->totalTime, filterParameters.maxTime);
+    filterParameters.maxTime = std::min(m_totalTime, filterParameters.maxTime);
 
     parseImpl(m_path, {}, filterParameters, StopAfter::Finished);
 }
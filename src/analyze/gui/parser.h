@@ -13,6 +13,7 @@
 #include "callercalleemodel.h"
 #include "chartmodel.h"
 #include "histogrammodel.h"
+#include "pageoccupancydata.h"
 #include "treemodel.h"
 
 #include <memory>
@@ -28,6 +29,20 @@ public:
 
     bool isFiltered() const;
 
+    /// set the number of symbols that get their own series in the charts, on top of the total
+    void setChartSeriesCount(int count);
+    int chartSeriesCount() const;
+
+    /// set the largest allocation size in bytes of each row of the size histogram, in ascending order
+    /// the larger allocations get a final row of their own
+    void setSizeHistogramBuckets(const QVector<quint64>& buckets);
+    QVector<quint64> sizeHistogramBuckets() const;
+    static QVector<quint64> defaultSizeHistogramBuckets();
+
+    /// store the results of parsing a new file next to it, and use them instead of parsing the same file again
+    void setResultCacheEnabled(bool enabled);
+    bool isResultCacheEnabled() const;
+
     enum class StopAfter
     {
         Summary,
@@ -51,7 +66,11 @@ signals:
     void consumedChartDataAvailable(const ChartData& data);
     void allocationsChartDataAvailable(const ChartData& data);
     void temporaryChartDataAvailable(const ChartData& data);
+    void mappedChartDataAvailable(const ChartData& data);
+    void allocationRateChartDataAvailable(const ChartData& data);
     void sizeHistogramDataAvailable(const HistogramData& data);
+    void lifetimeHistogramDataAvailable(const HistogramData& data);
+    void pageOccupancyDataAvailable(const PageOccupancyData& data);
     void finished();
     void failedToOpen(const QString& path);
 
@@ -61,6 +80,12 @@ private:
 
     QString m_path;
     std::shared_ptr<ParserData> m_data;
+    // these stay valid when the results got loaded from the cache, without any m_data
+    FilterParameters m_filterParameters;
+    int64_t m_totalTime = 0;
+    int m_chartSeriesCount = ChartRows::DEFAULT_NUM_SERIES;
+    QVector<quint64> m_sizeHistogramBuckets = defaultSizeHistogramBuckets();
+    bool m_resultCacheEnabled = false;
 };
 
 #endif // PARSER_H
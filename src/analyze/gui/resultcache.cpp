@@ -0,0 +1,569 @@
+/*
+    SPDX-FileCopyrightText: 2026 Milian Wolff <mail@milianw.de>
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#include "resultcache.h"
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+
+#include <algorithm>
+#include <type_traits>
+
+namespace {
+const quint32 CACHE_MAGIC = 0x48544743; // HTGC
+// bump this whenever the layout of the cached data changes
+const quint32 CACHE_VERSION = 7;
+// the key covers the start and the end of the file, next to its size and modification time
+const qint64 KEY_CHUNK_SIZE = 1024 * 1024;
+
+// all numbers get stored as 64bit, qCompress takes care of the waste
+template <typename T>
+typename std::enable_if<std::is_arithmetic<T>::value>::type write(QDataStream& stream, T value)
+{
+    static_assert(sizeof(T) <= sizeof(qint64), "value does not fit into the cache");
+    stream << static_cast<qint64>(value);
+}
+
+template <typename T>
+typename std::enable_if<std::is_arithmetic<T>::value>::type read(QDataStream& stream, T* value)
+{
+    qint64 storedValue = 0;
+    stream >> storedValue;
+    *value = static_cast<T>(storedValue);
+}
+
+void write(QDataStream& stream, const QString& string)
+{
+    stream << string;
+}
+
+void read(QDataStream& stream, QString* string)
+{
+    stream >> *string;
+}
+
+void write(QDataStream& stream, const std::string& string)
+{
+    stream << QByteArray::fromRawData(string.data(), string.size());
+}
+
+void read(QDataStream& stream, std::string* string)
+{
+    QByteArray data;
+    stream >> data;
+    string->assign(data.constData(), data.size());
+}
+
+void write(QDataStream& stream, const AllocationData& cost)
+{
+    write(stream, cost.allocations);
+    write(stream, cost.temporary);
+    write(stream, cost.leaked);
+    write(stream, cost.peak);
+    write(stream, cost.mapped);
+    write(stream, cost.peakMapped);
+    write(stream, cost.growths);
+    write(stream, cost.copied);
+    write(stream, cost.slack);
+    write(stream, cost.remoteFrees);
+    write(stream, cost.pinned);
+}
+
+void read(QDataStream& stream, AllocationData* cost)
+{
+    read(stream, &cost->allocations);
+    read(stream, &cost->temporary);
+    read(stream, &cost->leaked);
+    read(stream, &cost->peak);
+    read(stream, &cost->mapped);
+    read(stream, &cost->peakMapped);
+    read(stream, &cost->growths);
+    read(stream, &cost->copied);
+    read(stream, &cost->slack);
+    read(stream, &cost->remoteFrees);
+    read(stream, &cost->pinned);
+}
+
+void write(QDataStream& stream, const Symbol& symbol)
+{
+    write(stream, symbol.functionId.index);
+    write(stream, symbol.moduleId.index);
+}
+
+void read(QDataStream& stream, Symbol* symbol)
+{
+    read(stream, &symbol->functionId.index);
+    read(stream, &symbol->moduleId.index);
+}
+
+void write(QDataStream& stream, const FileLine& fileLine)
+{
+    write(stream, fileLine.fileId.index);
+    write(stream, fileLine.line);
+}
+
+void read(QDataStream& stream, FileLine* fileLine)
+{
+    read(stream, &fileLine->fileId.index);
+    read(stream, &fileLine->line);
+}
+
+void write(QDataStream& stream, const EntryCost& cost)
+{
+    write(stream, cost.inclusiveCost);
+    write(stream, cost.selfCost);
+}
+
+void read(QDataStream& stream, EntryCost* cost)
+{
+    read(stream, &cost->inclusiveCost);
+    read(stream, &cost->selfCost);
+}
+
+void write(QDataStream& stream, const Suppression& suppression)
+{
+    write(stream, suppression.pattern);
+    write(stream, suppression.matches);
+    write(stream, suppression.leaked);
+}
+
+void read(QDataStream& stream, Suppression* suppression)
+{
+    read(stream, &suppression->pattern);
+    read(stream, &suppression->matches);
+    read(stream, &suppression->leaked);
+}
+
+void write(QDataStream& stream, const ChartCost& cost)
+{
+    write(stream, cost.label);
+    write(stream, cost.cost);
+}
+
+void read(QDataStream& stream, ChartCost* cost)
+{
+    read(stream, &cost->label);
+    read(stream, &cost->cost);
+}
+
+void write(QDataStream& stream, const HistogramColumn& column)
+{
+    write(stream, column.allocations);
+    write(stream, column.totalAllocated);
+    write(stream, column.symbol);
+}
+
+void read(QDataStream& stream, HistogramColumn* column)
+{
+    read(stream, &column->allocations);
+    read(stream, &column->totalAllocated);
+    read(stream, &column->symbol);
+}
+
+// these contain containers of themselves or of each other
+void write(QDataStream& stream, const RowData& row);
+void read(QDataStream& stream, RowData* row);
+void write(QDataStream& stream, const CallerCalleeEntry& entry);
+void read(QDataStream& stream, CallerCalleeEntry* entry);
+void write(QDataStream& stream, const ChartRows& rows);
+void read(QDataStream& stream, ChartRows* rows);
+void write(QDataStream& stream, const HistogramRow& row);
+void read(QDataStream& stream, HistogramRow* row);
+void write(QDataStream& stream, const PageOccupancyRow& row);
+void read(QDataStream& stream, PageOccupancyRow* row);
+
+/// every element takes at least a byte, which catches bogus sizes before allocating for them
+bool readSize(QDataStream& stream, int* size)
+{
+    read(stream, size);
+    if (stream.status() != QDataStream::Ok || *size < 0 || *size > stream.device()->bytesAvailable()) {
+        stream.setStatus(QDataStream::ReadCorruptData);
+        return false;
+    }
+    return true;
+}
+
+template <typename T>
+void write(QDataStream& stream, const QVector<T>& vector)
+{
+    write(stream, vector.size());
+    for (const auto& value : vector) {
+        write(stream, value);
+    }
+}
+
+template <typename T>
+void read(QDataStream& stream, QVector<T>* vector)
+{
+    int size = 0;
+    if (!readSize(stream, &size)) {
+        return;
+    }
+    vector->resize(size);
+    for (auto& value : *vector) {
+        read(stream, &value);
+    }
+}
+
+template <typename Key, typename Value>
+void write(QDataStream& stream, const QHash<Key, Value>& hash)
+{
+    write(stream, hash.size());
+    for (auto it = hash.begin(), end = hash.end(); it != end; ++it) {
+        write(stream, it.key());
+        write(stream, it.value());
+    }
+}
+
+template <typename Key, typename Value>
+void read(QDataStream& stream, QHash<Key, Value>* hash)
+{
+    int size = 0;
+    if (!readSize(stream, &size)) {
+        return;
+    }
+    hash->reserve(size);
+    for (int i = 0; i < size && stream.status() == QDataStream::Ok; ++i) {
+        Key key;
+        read(stream, &key);
+        read(stream, &(*hash)[key]);
+    }
+}
+
+template <typename Key, typename Value>
+void write(QDataStream& stream, const FlatMap<Key, Value>& map)
+{
+    write(stream, map.keys());
+    write(stream, map.values());
+}
+
+template <typename Key, typename Value>
+void read(QDataStream& stream, FlatMap<Key, Value>* map)
+{
+    QVector<Key> keys;
+    QVector<Value> values;
+    read(stream, &keys);
+    read(stream, &values);
+    // the lookups rely on the keys being sorted and unique
+    auto isUnsorted = [](const Key& lhs, const Key& rhs) { return !(lhs < rhs); };
+    if (keys.size() != values.size() || std::adjacent_find(keys.begin(), keys.end(), isUnsorted) != keys.end()) {
+        stream.setStatus(QDataStream::ReadCorruptData);
+        return;
+    }
+    *map = {std::move(keys), std::move(values)};
+}
+
+void write(QDataStream& stream, const RowData& row)
+{
+    write(stream, row.cost);
+    write(stream, row.symbol);
+    write(stream, row.children);
+}
+
+void read(QDataStream& stream, RowData* row)
+{
+    read(stream, &row->cost);
+    read(stream, &row->symbol);
+    read(stream, &row->children);
+}
+
+void write(QDataStream& stream, const CallerCalleeEntry& entry)
+{
+    write(stream, static_cast<const EntryCost&>(entry));
+    write(stream, entry.callers);
+    write(stream, entry.callees);
+    write(stream, entry.sourceMap);
+}
+
+void read(QDataStream& stream, CallerCalleeEntry* entry)
+{
+    read(stream, static_cast<EntryCost*>(entry));
+    read(stream, &entry->callers);
+    read(stream, &entry->callees);
+    read(stream, &entry->sourceMap);
+}
+
+void write(QDataStream& stream, const ChartRows& rows)
+{
+    write(stream, rows.timeStamp);
+    write(stream, rows.total);
+    write(stream, rows.costs);
+}
+
+void read(QDataStream& stream, ChartRows* rows)
+{
+    read(stream, &rows->timeStamp);
+    read(stream, &rows->total);
+    read(stream, &rows->costs);
+}
+
+void write(QDataStream& stream, const HistogramRow& row)
+{
+    write(stream, row.sizeLabel);
+    write(stream, row.size);
+    for (const auto& column : row.columns) {
+        write(stream, column);
+    }
+}
+
+void read(QDataStream& stream, HistogramRow* row)
+{
+    read(stream, &row->sizeLabel);
+    read(stream, &row->size);
+    for (auto& column : row->columns) {
+        read(stream, &column);
+    }
+}
+
+void write(QDataStream& stream, const PageOccupancyRow& row)
+{
+    write(stream, row.time);
+    write(stream, row.pages);
+}
+
+void read(QDataStream& stream, PageOccupancyRow* row)
+{
+    read(stream, &row->time);
+    read(stream, &row->pages);
+}
+
+void write(QDataStream& stream, const FilterParameters& parameters)
+{
+    write(stream, parameters.minTime);
+    write(stream, parameters.maxTime);
+    write(stream, static_cast<int>(parameters.suppressions.size()));
+    for (const auto& suppression : parameters.suppressions) {
+        write(stream, suppression);
+    }
+    write(stream, parameters.disableEmbeddedSuppressions);
+    write(stream, parameters.disableBuiltinSuppressions);
+    write(stream, parameters.minSize);
+    write(stream, parameters.maxSize);
+    write(stream, parameters.minLifetime);
+}
+
+void read(QDataStream& stream, FilterParameters* parameters)
+{
+    read(stream, &parameters->minTime);
+    read(stream, &parameters->maxTime);
+    int size = 0;
+    if (!readSize(stream, &size)) {
+        return;
+    }
+    parameters->suppressions.resize(size);
+    for (auto& suppression : parameters->suppressions) {
+        read(stream, &suppression);
+    }
+    read(stream, &parameters->disableEmbeddedSuppressions);
+    read(stream, &parameters->disableBuiltinSuppressions);
+    read(stream, &parameters->minSize);
+    read(stream, &parameters->maxSize);
+    read(stream, &parameters->minLifetime);
+}
+
+void write(QDataStream& stream, const SummaryData& summary)
+{
+    write(stream, summary.debuggee);
+    write(stream, summary.cost);
+    write(stream, summary.totalLeakedSuppressed);
+    write(stream, summary.totalTime);
+    write(stream, summary.filterParameters);
+    write(stream, summary.peakTime);
+    write(stream, summary.peakRSS);
+    write(stream, summary.totalSystemMemory);
+    write(stream, summary.fromAttached);
+    write(stream, summary.suppressions);
+    write(stream, summary.sampleInterval);
+}
+
+void read(QDataStream& stream, SummaryData* summary)
+{
+    read(stream, &summary->debuggee);
+    read(stream, &summary->cost);
+    read(stream, &summary->totalLeakedSuppressed);
+    read(stream, &summary->totalTime);
+    read(stream, &summary->filterParameters);
+    read(stream, &summary->peakTime);
+    read(stream, &summary->peakRSS);
+    read(stream, &summary->totalSystemMemory);
+    read(stream, &summary->fromAttached);
+    read(stream, &summary->suppressions);
+    read(stream, &summary->sampleInterval);
+}
+
+void write(QDataStream& stream, const ChartData& chart)
+{
+    write(stream, chart.rows);
+    write(stream, chart.levels);
+    write(stream, chart.labels);
+}
+
+void read(QDataStream& stream, ChartData* chart)
+{
+    read(stream, &chart->rows);
+    read(stream, &chart->levels);
+    read(stream, &chart->labels);
+}
+
+void write(QDataStream& stream, const ResultData& resultData)
+{
+    write(stream, resultData.totalCosts());
+    const auto& strings = resultData.strings();
+    write(stream, static_cast<int>(strings.size()));
+    for (size_t i = 0, c = strings.size(); i < c; ++i) {
+        const auto string = strings[i];
+        stream << QByteArray::fromRawData(string.data(), string.size());
+    }
+}
+
+std::shared_ptr<const ResultData> readResultData(QDataStream& stream)
+{
+    AllocationData totalCosts;
+    read(stream, &totalCosts);
+    int size = 0;
+    if (!readSize(stream, &size)) {
+        return {};
+    }
+    auto strings = std::make_shared<StringTable>();
+    strings->reserve(size);
+    QByteArray string;
+    for (int i = 0; i < size; ++i) {
+        stream >> string;
+        strings->add({string.constData(), static_cast<size_t>(string.size())});
+    }
+    return std::make_shared<const ResultData>(totalCosts, std::move(strings));
+}
+}
+
+QString ResultCache::cachePath(const QString& path)
+{
+    return path + QLatin1String(".cache");
+}
+
+QByteArray ResultCache::cacheKey(const QString& path, const FilterParameters& filterParameters, int chartSeriesCount,
+                                 const QVector<quint64>& sizeHistogramBuckets)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return {};
+    }
+
+    // hashing all of a large file would take a noticeable fraction of the time it takes to parse it
+    QByteArray key;
+    {
+        QDataStream stream(&key, QIODevice::WriteOnly);
+        write(stream, CACHE_VERSION);
+        write(stream, file.size());
+        write(stream, QFileInfo(file).lastModified().toMSecsSinceEpoch());
+        write(stream, filterParameters);
+        write(stream, chartSeriesCount);
+        write(stream, sizeHistogramBuckets);
+    }
+
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(key);
+    hash.addData(file.read(KEY_CHUNK_SIZE));
+    if (file.size() > KEY_CHUNK_SIZE) {
+        file.seek(std::max(KEY_CHUNK_SIZE, file.size() - KEY_CHUNK_SIZE));
+        hash.addData(file.read(KEY_CHUNK_SIZE));
+    }
+    return hash.result();
+}
+
+bool ResultCache::save(const QString& path, const QByteArray& key, const CachedResults& results)
+{
+    QByteArray data;
+    {
+        QDataStream stream(&data, QIODevice::WriteOnly);
+        stream.setVersion(QDataStream::Qt_5_10);
+        write(stream, *results.bottomUp.resultData);
+        write(stream, results.summary);
+        write(stream, results.bottomUp.rows);
+        write(stream, results.topDown.rows);
+        write(stream, results.callerCallee.entries);
+        write(stream, results.sizeHistogram.rows);
+        write(stream, results.lifetimeHistogram.rows);
+        write(stream, results.consumedChart);
+        write(stream, results.allocationsChart);
+        write(stream, results.temporaryChart);
+        write(stream, results.mappedChart);
+        write(stream, results.allocationRateChart);
+        write(stream, results.pageOccupancy.pageSize);
+        write(stream, results.pageOccupancy.rows);
+    }
+
+    QSaveFile file(cachePath(path));
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_10);
+    stream << CACHE_MAGIC << CACHE_VERSION << key << qCompress(data);
+    return stream.status() == QDataStream::Ok && file.commit();
+}
+
+bool ResultCache::load(const QString& path, const QByteArray& key, CachedResults* results)
+{
+    QFile file(cachePath(path));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QDataStream fileStream(&file);
+    fileStream.setVersion(QDataStream::Qt_5_10);
+    quint32 magic = 0;
+    quint32 version = 0;
+    QByteArray storedKey;
+    fileStream >> magic >> version >> storedKey;
+    if (magic != CACHE_MAGIC || version != CACHE_VERSION || storedKey != key) {
+        return false;
+    }
+    QByteArray compressed;
+    fileStream >> compressed;
+    const auto data = qUncompress(compressed);
+    if (fileStream.status() != QDataStream::Ok || data.isEmpty()) {
+        return false;
+    }
+
+    QDataStream stream(data);
+    stream.setVersion(QDataStream::Qt_5_10);
+    const auto resultData = readResultData(stream);
+    if (!resultData) {
+        return false;
+    }
+    read(stream, &results->summary);
+    read(stream, &results->bottomUp.rows);
+    read(stream, &results->topDown.rows);
+    read(stream, &results->callerCallee.entries);
+    read(stream, &results->sizeHistogram.rows);
+    read(stream, &results->lifetimeHistogram.rows);
+    read(stream, &results->consumedChart);
+    read(stream, &results->allocationsChart);
+    read(stream, &results->temporaryChart);
+    read(stream, &results->mappedChart);
+    read(stream, &results->allocationRateChart);
+    read(stream, &results->pageOccupancy.pageSize);
+    read(stream, &results->pageOccupancy.rows);
+    if (stream.status() != QDataStream::Ok) {
+        return false;
+    }
+
+    results->bottomUp.resultData = resultData;
+    results->topDown.resultData = resultData;
+    results->callerCallee.resultData = resultData;
+    results->sizeHistogram.resultData = resultData;
+    results->lifetimeHistogram.resultData = resultData;
+    results->consumedChart.resultData = resultData;
+    results->allocationsChart.resultData = resultData;
+    results->temporaryChart.resultData = resultData;
+    results->mappedChart.resultData = resultData;
+    results->allocationRateChart.resultData = resultData;
+    return true;
+}
@@ -0,0 +1,61 @@
+/*
+    SPDX-FileCopyrightText: 2026 Milian Wolff <mail@milianw.de>
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#ifndef RESULTCACHE_H
+#define RESULTCACHE_H
+
+#include <QByteArray>
+#include <QString>
+
+#include "../filterparameters.h"
+#include "callercalleemodel.h"
+#include "chartmodel.h"
+#include "histogrammodel.h"
+#include "pageoccupancydata.h"
+#include "summarydata.h"
+#include "treemodel.h"
+
+/**
+ * Everything the parser computes for a file, all of it sharing the same ResultData.
+ */
+struct CachedResults
+{
+    SummaryData summary;
+    TreeData bottomUp;
+    TreeData topDown;
+    CallerCalleeResults callerCallee;
+    HistogramData sizeHistogram;
+    HistogramData lifetimeHistogram;
+    ChartData consumedChart;
+    ChartData allocationsChart;
+    ChartData temporaryChart;
+    ChartData mappedChart;
+    ChartData allocationRateChart;
+    PageOccupancyData pageOccupancy;
+};
+
+/**
+ * Stores the results of parsing a data file in a compressed file next to it, such that opening the same
+ * file again doesn't need to parse it anew.
+ */
+namespace ResultCache {
+/// @return the path of the cache file for the data file at @p path
+QString cachePath(const QString& path);
+
+/// @return the key of the results for parsing the data file at @p path with the given parameters,
+/// or an empty key when the file cannot be read
+QByteArray cacheKey(const QString& path, const FilterParameters& filterParameters, int chartSeriesCount,
+                    const QVector<quint64>& sizeHistogramBuckets);
+
+/// write @p results to the cache file of @p path, silently giving up when e.g. the directory is read-only
+bool save(const QString& path, const QByteArray& key, const CachedResults& results);
+
+/// @return true when the cache file of @p path exists, matches @p key and got read into @p results
+/// the bottom-up rows are not linked to their parents yet
+bool load(const QString& path, const QByteArray& key, CachedResults* results);
+}
+
+#endif // RESULTCACHE_H
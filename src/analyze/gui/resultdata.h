@@ -8,26 +8,40 @@
 #define RESULTDATA_H
 
 #include <analyze/allocationdata.h>
+#include <analyze/stringtable.h>
 
 #include "locationdata.h"
 #include "util.h"
 
-#include <QVector>
+#include <QString>
 
 #include <memory>
+#include <mutex>
 
 class ResultData
 {
 public:
-    ResultData(AllocationData totalCosts, QVector<QString> strings)
+    /// @p strings must not change anymore, the QStrings get created lazily from it on first use
+    ResultData(AllocationData totalCosts, std::shared_ptr<const StringTable> strings)
         : m_totalCosts(std::move(totalCosts))
         , m_strings(std::move(strings))
+        , m_qtStrings(new QString[m_strings->size()])
+        , m_converted(new std::once_flag[m_strings->size()])
     {
     }
 
     QString string(StringIndex stringId) const
     {
-        return m_strings.value(stringId.index - 1);
+        if (!stringId || stringId.index > m_strings->size()) {
+            return {};
+        }
+        const auto index = stringId.index - 1;
+        // the models and the flame graph access the strings from different threads
+        std::call_once(m_converted[index], [this, index]() {
+            const auto string = (*m_strings)[index];
+            m_qtStrings[index] = QString::fromUtf8(string.data(), string.size());
+        });
+        return m_qtStrings[index];
     }
 
     QString string(FunctionIndex functionIndex) const
@@ -40,11 +54,19 @@ public:
         return m_totalCosts;
     }
 
+    const StringTable& strings() const
+    {
+        return *m_strings;
+    }
+
 private:
     AllocationData m_totalCosts;
-    QVector<QString> m_strings;
+    std::shared_ptr<const StringTable> m_strings;
+    std::unique_ptr<QString[]> m_qtStrings;
+    std::unique_ptr<std::once_flag[]> m_converted;
 };
 
 Q_DECLARE_METATYPE(const ResultData*)
+Q_DECLARE_METATYPE(std::shared_ptr<const ResultData>)
 
 #endif // RESULTDATA_H
@@ -11,6 +11,13 @@
 
 #include <QDebug>
 
+#include <algorithm>
+
+namespace {
+// the number of leafs that get sorted at once, i.e. for every that many stacks someone looks at
+const int SORTED_LEAFS_CHUNK = 64;
+}
+
 StacksModel::StacksModel(QObject* parent)
     : QAbstractListModel(parent)
 {
@@ -22,6 +29,7 @@ void StacksModel::setStackIndex(int index)
 {
     beginResetModel();
     m_stackIndex = index - 1;
+    updateStack();
     endResetModel();
 }
 
@@ -39,50 +47,82 @@ static void findLeafs(const QModelIndex& index, QVector<QModelIndex>* leafs)
     }
 }
 
-void StacksModel::fillFromIndex(const QModelIndex& index)
+void StacksModel::fillFromIndex(const QModelIndex& index, int costColumn)
 {
     if (index.column() != 0) {
         // only the first column has children
-        fillFromIndex(index.sibling(index.row(), 0));
+        fillFromIndex(index.sibling(index.row(), 0), costColumn);
         return;
     }
+    if (costColumn <= TreeModel::LocationColumn || costColumn >= TreeModel::NUM_COLUMNS) {
+        costColumn = TreeModel::PeakColumn;
+    }
 
     QVector<QModelIndex> leafs;
     findLeafs(index, &leafs);
 
     beginResetModel();
-    m_data.clear();
-    m_data.resize(leafs.size());
-    m_stackIndex = 0;
-    int stackIndex = 0;
-    for (auto leaf : leafs) {
-        auto& stack = m_data[stackIndex];
-        while (leaf.isValid()) {
-            stack << leaf.sibling(leaf.row(), TreeModel::LocationColumn);
-            leaf = leaf.parent();
-        }
-        std::reverse(stack.begin(), stack.end());
-        ++stackIndex;
+    m_leafs.clear();
+    m_leafs.reserve(leafs.size());
+    for (int i = 0, c = leafs.size(); i < c; ++i) {
+        const auto& leaf = leafs[i];
+        m_leafs.append({leaf, leaf.sibling(leaf.row(), costColumn).data(TreeModel::SortRole).toLongLong(), i});
     }
+    m_numSortedLeafs = 0;
+    m_stackIndex = 0;
+    updateStack();
     endResetModel();
 
-    emit stacksFound(m_data.size());
+    emit stacksFound(m_leafs.size());
 }
 
 void StacksModel::clear()
 {
     beginResetModel();
-    m_data.clear();
+    m_leafs.clear();
+    m_numSortedLeafs = 0;
+    m_stack.clear();
     endResetModel();
     emit stacksFound(0);
 }
 
+void StacksModel::sortLeafs(int index)
+{
+    if (index < m_numSortedLeafs) {
+        return;
+    }
+    // the sorted leafs are the most expensive ones, so sorting the rest extends them
+    const auto numSorted =
+        std::min(static_cast<int>(m_leafs.size()), std::max(index + 1, m_numSortedLeafs + SORTED_LEAFS_CHUNK));
+    std::partial_sort(m_leafs.begin() + m_numSortedLeafs, m_leafs.begin() + numSorted, m_leafs.end(),
+                      [](const Leaf& lhs, const Leaf& rhs) {
+                          return lhs.cost > rhs.cost || (lhs.cost == rhs.cost && lhs.position < rhs.position);
+                      });
+    m_numSortedLeafs = numSorted;
+}
+
+void StacksModel::updateStack()
+{
+    m_stack.clear();
+    if (m_stackIndex < 0 || m_stackIndex >= m_leafs.size()) {
+        return;
+    }
+
+    sortLeafs(m_stackIndex);
+    auto leaf = m_leafs[m_stackIndex].index;
+    while (leaf.isValid()) {
+        m_stack << leaf.sibling(leaf.row(), TreeModel::LocationColumn);
+        leaf = leaf.parent();
+    }
+    std::reverse(m_stack.begin(), m_stack.end());
+}
+
 int StacksModel::rowCount(const QModelIndex& parent) const
 {
-    if (parent.isValid() || m_data.isEmpty()) {
+    if (parent.isValid()) {
         return 0;
     }
-    return m_data.value(m_stackIndex).size();
+    return m_stack.size();
 }
 
 QVariant StacksModel::data(const QModelIndex& index, int role) const
@@ -90,7 +130,7 @@ QVariant StacksModel::data(const QModelIndex& index, int role) const
     if (!hasIndex(index.row(), index.column(), index.parent())) {
         return {};
     }
-    return m_data.value(m_stackIndex).value(index.row()).data(role);
+    return m_stack.value(index.row()).data(role);
 }
 
 QVariant StacksModel::headerData(int section, Qt::Orientation orientation, int role) const
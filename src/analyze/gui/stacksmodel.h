@@ -17,7 +17,9 @@ public:
     ~StacksModel();
 
     void setStackIndex(int index);
-    void fillFromIndex(const QModelIndex& leaf);
+    /// show the stacks of the leafs below @p leaf, the most expensive ones in the given @p costColumn of the
+    /// TreeModel come first
+    void fillFromIndex(const QModelIndex& leaf, int costColumn);
     void clear();
 
     int rowCount(const QModelIndex& parent) const override;
@@ -28,8 +30,25 @@ signals:
     void stacksFound(int stacks);
 
 private:
-    QVector<QVector<QModelIndex>> m_data;
+    struct Leaf
+    {
+        QModelIndex index;
+        qint64 cost;
+        /// the position in the tree, which orders the leafs of equal cost
+        int position;
+    };
+
+    /// sort the leafs at least up to @p index
+    void sortLeafs(int index);
+    void updateStack();
+
+    /// only the leafs get collected up front, the stacks are built when they get displayed
+    QVector<Leaf> m_leafs;
+    /// the first leafs are sorted by their cost, the remaining ones only get sorted when they are needed
+    int m_numSortedLeafs = 0;
     int m_stackIndex = 0;
+    /// the stack of the leaf at m_stackIndex, starting at the root
+    QVector<QModelIndex> m_stack;
 };
 
 #endif // STACKSMODEL_H
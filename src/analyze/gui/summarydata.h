@@ -20,7 +20,8 @@ struct SummaryData
     SummaryData() = default;
     SummaryData(const QString& debuggee, const AllocationData& cost, int64_t totalTime,
                 const FilterParameters& filterParameters, int64_t peakTime, int64_t peakRSS, int64_t totalSystemMemory,
-                bool fromAttached, int64_t totalLeakedSuppressed, QVector<Suppression> suppressions)
+                bool fromAttached, int64_t totalLeakedSuppressed, QVector<Suppression> suppressions,
+                int64_t sampleInterval)
         : debuggee(debuggee)
         , cost(cost)
         , totalLeakedSuppressed(totalLeakedSuppressed)
@@ -31,6 +32,7 @@ struct SummaryData
         , totalSystemMemory(totalSystemMemory)
         , fromAttached(fromAttached)
         , suppressions(std::move(suppressions))
+        , sampleInterval(sampleInterval)
     {
     }
     QString debuggee;
@@ -43,6 +45,10 @@ struct SummaryData
     int64_t totalSystemMemory = 0;
     bool fromAttached = false;
     QVector<Suppression> suppressions;
+    // non-zero when the costs are extrapolated from sampled allocations
+    int64_t sampleInterval = 0;
+    // true for the intermediate summaries that get published while the file is still being parsed
+    bool partial = false;
 };
 Q_DECLARE_METATYPE(SummaryData)
 
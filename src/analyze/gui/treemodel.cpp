@@ -18,13 +18,6 @@
 
 namespace {
 
-int indexOf(const RowData* row, const QVector<RowData>& siblings)
-{
-    Q_ASSERT(siblings.data() <= row);
-    Q_ASSERT(siblings.data() + siblings.size() > row);
-    return row - siblings.data();
-}
-
 const RowData* rowAt(const QVector<RowData>& rows, int row)
 {
     Q_ASSERT(rows.size() > row);
@@ -55,7 +48,7 @@ QVariant TreeModel::headerData(int section, Qt::Orientation orientation, int rol
     }
     if (role == Qt::InitialSortOrderRole) {
         if (section == AllocationsColumn || section == PeakColumn || section == LeakedColumn
-            || section == TemporaryColumn) {
+            || section == TemporaryColumn || section == CopiedColumn || section == PinnedColumn) {
             return Qt::DescendingOrder;
         }
     }
@@ -65,6 +58,10 @@ QVariant TreeModel::headerData(int section, Qt::Orientation orientation, int rol
             return i18n("Allocations");
         case TemporaryColumn:
             return i18n("Temporary");
+        case CopiedColumn:
+            return i18n("Copied");
+        case PinnedColumn:
+            return i18n("Pinned");
         case PeakColumn:
             return i18n("Peak");
         case LeakedColumn:
@@ -83,6 +80,14 @@ QVariant TreeModel::headerData(int section, Qt::Orientation orientation, int rol
             return i18n("<qt>The number of temporary allocations. These allocations "
                         "are directly followed by a free "
                         "without any other allocations in-between.</qt>");
+        case CopiedColumn:
+            return i18n("<qt>The bytes copied when growing buffers step by step. These allocations "
+                        "are freed directly after a larger allocation from the same location, like "
+                        "when a std::vector grows. Reserving the final size upfront avoids the copies.</qt>");
+        case PinnedColumn:
+            return i18n("<qt>The bytes of sparsely occupied pages that the allocations from this location keep "
+                        "from being returned to the system, at the time when the most pages were sparse. "
+                        "Only known when recorded with HEAPTRACK_INTERPRET_OCCUPANCY.</qt>");
         case PeakColumn:
             return i18n("<qt>The contributions from a given location to the maximum heap "
                         "memory consumption in bytes. This takes deallocations "
@@ -123,6 +128,18 @@ QVariant TreeModel::data(const QModelIndex& index, int role) const
                 return static_cast<qint64>(abs(row->cost.temporary));
             }
             return static_cast<qint64>(row->cost.temporary);
+        case CopiedColumn:
+            if (role == SortRole || role == MaxCostRole) {
+                return static_cast<qint64>(abs(row->cost.copied));
+            } else {
+                return Util::formatBytes(row->cost.copied);
+            }
+        case PinnedColumn:
+            if (role == SortRole || role == MaxCostRole) {
+                return static_cast<qint64>(abs(row->cost.pinned));
+            } else {
+                return Util::formatBytes(row->cost.pinned);
+            }
         case PeakColumn:
             if (role == SortRole || role == MaxCostRole) {
                 return static_cast<qint64>(abs(row->cost.peak));
@@ -161,6 +178,16 @@ QVariant TreeModel::data(const QModelIndex& index, int role) const
         stream << i18n("allocations: %1 (%2% of total)\n", row->cost.allocations, allocationsFraction);
         stream << i18n("temporary: %1 (%2% of allocations, %3% of total)\n", row->cost.temporary, temporaryFraction,
                        temporaryFractionTotal);
+        if (row->cost.growths) {
+            const auto copiedFraction = Util::formatCostRelative(row->cost.copied, m_maxCost.cost.copied);
+            stream << i18n("copied: %1 in %2 growth steps (%3% of total)\n", Util::formatBytes(row->cost.copied),
+                           row->cost.growths, copiedFraction);
+        }
+        if (row->cost.pinned) {
+            const auto pinnedFraction = Util::formatCostRelative(row->cost.pinned, m_maxCost.cost.pinned);
+            stream << i18n("pinned: %1 of sparse pages (%2% of total)\n", Util::formatBytes(row->cost.pinned),
+                           pinnedFraction);
+        }
         if (!row->children.isEmpty()) {
             auto child = row;
             int max = 5;
@@ -185,7 +212,7 @@ QVariant TreeModel::data(const QModelIndex& index, int role) const
     } else if (role == SymbolRole) {
         return QVariant::fromValue(row->symbol);
     } else if (role == ResultDataRole) {
-        return QVariant::fromValue(m_data.resultData.get());
+        return QVariant::fromValue(m_data.resultData);
     }
     return {};
 }
@@ -195,7 +222,11 @@ QModelIndex TreeModel::index(int row, int column, const QModelIndex& parent) con
     if (row < 0 || column < 0 || column >= NUM_COLUMNS || row >= rowCount(parent)) {
         return QModelIndex();
     }
-    return createIndex(row, column, const_cast<void*>(reinterpret_cast<const void*>(toRow(parent))));
+    const auto parentRow = toRow(parent);
+    if (parentRow && !m_parents.contains(parentRow)) {
+        m_parents.insert(parentRow, {toParentRow(parent), parent.row()});
+    }
+    return createIndex(row, column, const_cast<void*>(reinterpret_cast<const void*>(parentRow)));
 }
 
 QModelIndex TreeModel::parent(const QModelIndex& child) const
@@ -207,7 +238,9 @@ QModelIndex TreeModel::parent(const QModelIndex& child) const
     if (!parent) {
         return {};
     }
-    return createIndex(rowOf(parent), 0, const_cast<void*>(reinterpret_cast<const void*>(parent->parent)));
+    const auto link = m_parents.constFind(parent);
+    Q_ASSERT(link != m_parents.constEnd());
+    return createIndex(link->row, 0, const_cast<void*>(reinterpret_cast<const void*>(link->parent)));
 }
 
 int TreeModel::rowCount(const QModelIndex& parent) const
@@ -232,6 +265,7 @@ void TreeModel::resetData(const TreeData& data)
     Q_ASSERT(data.resultData);
     beginResetModel();
     m_data = data;
+    m_parents.clear();
     endResetModel();
 }
 
@@ -247,6 +281,7 @@ void TreeModel::clearData()
     beginResetModel();
     m_data = {};
     m_maxCost = {};
+    m_parents.clear();
     endResetModel();
 }
 
@@ -262,13 +297,4 @@ const RowData* TreeModel::toRow(const QModelIndex& index) const
     }
 }
 
-int TreeModel::rowOf(const RowData* row) const
-{
-    if (auto parent = row->parent) {
-        return indexOf(row, parent->children);
-    } else {
-        return indexOf(row, m_data.rows);
-    }
-}
-
 #include "moc_treemodel.cpp"
@@ -8,6 +8,7 @@
 #define TREEMODEL_H
 
 #include <QAbstractItemModel>
+#include <QHash>
 #include <QVector>
 
 #include "../allocationdata.h"
@@ -22,6 +23,7 @@ struct RowData
 {
     AllocationData cost;
     Symbol symbol;
+    // only set for the bottom-up tree, which gets walked from the leaves up when deriving the other views
     const RowData* parent;
     QVector<RowData> children;
     bool operator<(const Symbol& rhs) const
@@ -52,6 +54,8 @@ public:
         LeakedColumn,
         AllocationsColumn,
         TemporaryColumn,
+        CopiedColumn,
+        PinnedColumn,
         NUM_COLUMNS
     };
 
@@ -78,11 +82,18 @@ public slots:
 private:
     /// @return the row resembled by @p index
     const RowData* toRow(const QModelIndex& index) const;
-    /// @return the row number of @p row in its parent
-    int rowOf(const RowData* row) const;
+
+    struct ParentLink
+    {
+        const RowData* parent;
+        int row;
+    };
 
     TreeData m_data;
     RowData m_maxCost;
+    // the position of every row whose children got requested through index(), filled on demand
+    // such that the rows don't need to be linked to their parents before the data can be shown
+    mutable QHash<const RowData*, ParentLink> m_parents;
 };
 
 #endif // TREEMODEL_H
@@ -10,10 +10,26 @@
 #include <resultdata.h>
 #include <QDebug>
 
+#include <ThreadWeaver/ThreadWeaver>
+
+namespace {
+bool matches(const std::vector<bool>& matches, StringIndex index)
+{
+    return index.index < matches.size() && matches[index.index];
+}
+}
+
+bool TreeProxy::Matches::accepts(const Symbol& symbol) const
+{
+    return (functions.empty() || matches(functions, symbol.functionId))
+        && (modules.empty() || matches(modules, symbol.moduleId));
+}
+
 TreeProxy::TreeProxy(int symbolRole, int resultDataRole, QObject* parent)
     : QSortFilterProxyModel(parent)
     , m_symbolRole(symbolRole)
     , m_resultDataRole(resultDataRole)
+    , m_matches(std::make_shared<const Matches>())
 {
     setRecursiveFilteringEnabled(true);
     setSortLocaleAware(false);
@@ -21,16 +37,97 @@ TreeProxy::TreeProxy(int symbolRole, int resultDataRole, QObject* parent)
 
 TreeProxy::~TreeProxy() = default;
 
+void TreeProxy::setSourceModel(QAbstractItemModel* sourceModel)
+{
+    disconnect(m_sourceResetConnection);
+    // connect before the base class does, such that the new results are known when it reapplies the filter
+    if (sourceModel) {
+        m_sourceResetConnection =
+            connect(sourceModel, &QAbstractItemModel::modelReset, this, &TreeProxy::updateResultData);
+    }
+    QSortFilterProxyModel::setSourceModel(sourceModel);
+    updateResultData();
+}
+
 void TreeProxy::setFunctionFilter(const QString& functionFilter)
 {
     m_functionFilter = functionFilter;
-    invalidate();
+    updateMatches();
 }
 
 void TreeProxy::setModuleFilter(const QString& moduleFilter)
 {
     m_moduleFilter = moduleFilter;
-    invalidate();
+    updateMatches();
+}
+
+bool TreeProxy::hasFilter() const
+{
+    return !m_functionFilter.isEmpty() || !m_moduleFilter.isEmpty();
+}
+
+void TreeProxy::updateResultData()
+{
+    auto source = sourceModel();
+    m_resultData = source && source->rowCount()
+        ? source->index(0, 0).data(m_resultDataRole).value<std::shared_ptr<const ResultData>>()
+        : nullptr;
+
+    // the base class reapplies the filter itself right after this
+    ++m_matchGeneration;
+    if (hasFilter()) {
+        m_matches = nullptr;
+        updateMatches();
+    } else {
+        m_matches = std::make_shared<const Matches>();
+    }
+}
+
+void TreeProxy::updateMatches()
+{
+    const auto generation = ++m_matchGeneration;
+    if (!hasFilter() || !m_resultData) {
+        m_matches = std::make_shared<const Matches>();
+        invalidateFilter();
+        return;
+    }
+
+    using namespace ThreadWeaver;
+    stream() << make_job([this, resultData = m_resultData, functionFilter = m_functionFilter,
+                          moduleFilter = m_moduleFilter, generation]() {
+        auto matchStrings = [&](const QString& filter, std::vector<bool>* matches) {
+            if (filter.isEmpty()) {
+                return true;
+            }
+            // index zero is no string at all, which never matches
+            matches->resize(resultData->strings().size() + 1);
+            for (size_t i = 1, c = matches->size(); i < c; ++i) {
+                if ((i % 1024) == 0 && generation != m_matchGeneration) {
+                    return false;
+                }
+                StringIndex index;
+                index.index = i;
+                (*matches)[i] = resultData->string(index).contains(filter, Qt::CaseInsensitive);
+            }
+            return true;
+        };
+
+        auto matches = std::make_shared<Matches>();
+        if (!matchStrings(functionFilter, &matches->functions) || !matchStrings(moduleFilter, &matches->modules)) {
+            return;
+        }
+
+        QMetaObject::invokeMethod(
+            this,
+            [this, generation, matches]() {
+                // ignore outdated matches, when the user kept on typing or the results changed meanwhile
+                if (generation == m_matchGeneration) {
+                    m_matches = matches;
+                    invalidateFilter();
+                }
+            },
+            Qt::QueuedConnection);
+    });
 }
 
 bool TreeProxy::filterAcceptsRow(int sourceRow, const QModelIndex& sourceParent) const
@@ -40,23 +137,17 @@ bool TreeProxy::filterAcceptsRow(int sourceRow, const QModelIndex& sourceParent)
         return false;
     }
 
-    if (m_functionFilter.isEmpty() && m_moduleFilter.isEmpty()) {
+    if (!m_matches) {
+        // still matching the filter against new results
+        return false;
+    }
+
+    if (m_matches->functions.empty() && m_matches->modules.empty()) {
         return true;
     }
 
     const auto index = source->index(sourceRow, 0, sourceParent);
-    const auto* resultData = index.data(m_resultDataRole).value<const ResultData*>();
-    Q_ASSERT(resultData);
-
-    auto filterOut = [&](StringIndex stringId, const QString& filter) {
-        return !filter.isEmpty() && !resultData->string(stringId).contains(filter, Qt::CaseInsensitive);
-    };
-
-    const auto symbol = index.data(m_symbolRole).value<Symbol>();
-    if (filterOut(symbol.functionId, m_functionFilter) || filterOut(symbol.moduleId, m_moduleFilter)) {
-        return false;
-    }
-    return true;
+    return m_matches->accepts(index.data(m_symbolRole).value<Symbol>());
 }
 
 bool TreeProxy::lessThan(const QModelIndex& source_left, const QModelIndex& source_right) const
@@ -65,7 +156,8 @@ bool TreeProxy::lessThan(const QModelIndex& source_left, const QModelIndex& sour
         return QSortFilterProxyModel::lessThan(source_left, source_right);
     }
 
-    const auto* resultData = source_left.data(m_resultDataRole).value<const ResultData*>();
+    const auto* resultData = m_resultData.get();
+    Q_ASSERT(resultData);
 
     const auto symbol_left = source_left.data(m_symbolRole).value<Symbol>();
     const auto symbol_right = source_right.data(m_symbolRole).value<Symbol>();
@@ -9,13 +9,23 @@
 
 #include <QSortFilterProxyModel>
 
+#include <atomic>
+#include <memory>
+#include <vector>
+
+class ResultData;
+struct Symbol;
+
 class TreeProxy final : public QSortFilterProxyModel
 {
     Q_OBJECT
 public:
+    /// @p resultDataRole must return the std::shared_ptr<const ResultData> of the source model
     explicit TreeProxy(int symbolRole, int resultDataRole, QObject* parent = nullptr);
     virtual ~TreeProxy();
 
+    void setSourceModel(QAbstractItemModel* sourceModel) override;
+
 public slots:
     void setFunctionFilter(const QString& functionFilter);
     void setModuleFilter(const QString& moduleFilter);
@@ -24,11 +34,33 @@ private:
     bool filterAcceptsRow(int source_row, const QModelIndex& source_parent) const override;
     bool lessThan(const QModelIndex& source_left, const QModelIndex& source_right) const override;
 
+    bool hasFilter() const;
+    void updateResultData();
+    /// match the filters against all strings of the results on a worker thread, the view keeps
+    /// showing the previous matches until then
+    void updateMatches();
+
+    struct Matches
+    {
+        // indexed by StringIndex::index, empty when the respective filter is empty
+        std::vector<bool> functions;
+        std::vector<bool> modules;
+
+        bool accepts(const Symbol& symbol) const;
+    };
+
     const int m_symbolRole;
     const int m_resultDataRole;
 
     QString m_functionFilter;
     QString m_moduleFilter;
+
+    std::shared_ptr<const ResultData> m_resultData;
+    // null while the matches for new results are not known yet
+    std::shared_ptr<const Matches> m_matches;
+    // outdated matching jobs stop once this changed
+    std::atomic<uint> m_matchGeneration {0};
+    QMetaObject::Connection m_sourceResetConnection;
 };
 
 #endif // TREEPROXY_H
@@ -113,6 +113,10 @@ QString Util::formatTooltip(const Symbol& symbol, const AllocationData& costs, c
     toolTip += formatCost(i18n("Leaked"), &AllocationData::leaked);
     toolTip += formatCost(i18n("Allocations"), &AllocationData::allocations);
     toolTip += formatCost(i18n("Temporary Allocations"), &AllocationData::temporary);
+    toolTip += formatCost(i18n("Copied When Growing"), &AllocationData::copied);
+    toolTip += formatCost(i18n("Allocator Slack"), &AllocationData::slack);
+    toolTip += formatCost(i18n("Freed By Another Thread"), &AllocationData::remoteFrees);
+    toolTip += formatCost(i18n("Pinned Sparse Pages"), &AllocationData::pinned);
     return QString(QLatin1String("<qt>") + toolTip + QLatin1String("</qt>"));
 }
 
@@ -142,6 +146,10 @@ QString Util::formatTooltip(const Symbol& symbol, const AllocationData& selfCost
     toolTip += formatCost(i18n("Leaked"), &AllocationData::leaked);
     toolTip += formatCost(i18n("Allocations"), &AllocationData::allocations);
     toolTip += formatCost(i18n("Temporary Allocations"), &AllocationData::temporary);
+    toolTip += formatCost(i18n("Copied When Growing"), &AllocationData::copied);
+    toolTip += formatCost(i18n("Allocator Slack"), &AllocationData::slack);
+    toolTip += formatCost(i18n("Freed By Another Thread"), &AllocationData::remoteFrees);
+    toolTip += formatCost(i18n("Pinned Sparse Pages"), &AllocationData::pinned);
     return QString(QLatin1String("<qt>") + toolTip + QLatin1String("</qt>"));
 }
 
@@ -171,6 +179,10 @@ QString Util::formatTooltip(const FileLine& location, const AllocationData& self
     toolTip += formatCost(i18n("Leaked"), &AllocationData::leaked);
     toolTip += formatCost(i18n("Allocations"), &AllocationData::allocations);
     toolTip += formatCost(i18n("Temporary Allocations"), &AllocationData::temporary);
+    toolTip += formatCost(i18n("Copied When Growing"), &AllocationData::copied);
+    toolTip += formatCost(i18n("Allocator Slack"), &AllocationData::slack);
+    toolTip += formatCost(i18n("Freed By Another Thread"), &AllocationData::remoteFrees);
+    toolTip += formatCost(i18n("Pinned Sparse Pages"), &AllocationData::pinned);
     return QString(QLatin1String("<qt>") + toolTip + QLatin1String("</qt>"));
 }
 
@@ -0,0 +1,152 @@
+/*
+    SPDX-FileCopyrightText: 2026 Milian Wolff <mail@milianw.de>
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#include "parallelzstddecompressor.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+
+#include <zstd.h>
+
+namespace {
+enum : uint32_t
+{
+    // see zstd's contrib/seekable_format/zstd_seekable_compression_format.md
+    SKIPPABLE_MAGIC = 0x184D2A5E,
+    SEEKABLE_MAGIC = 0x8F92EAB1,
+    SKIPPABLE_HEADER_SIZE = 8,
+    SEEK_TABLE_FOOTER_SIZE = 9,
+    CHECKSUM_FLAG = 0x80,
+};
+
+uint32_t readLittleEndian(const char* data)
+{
+    uint32_t value = 0;
+    for (int i = 0; i < 4; ++i) {
+        value |= static_cast<uint32_t>(static_cast<unsigned char>(data[i])) << (8 * i);
+    }
+    return value;
+}
+
+std::vector<char> decompress(const std::vector<char>& input, uint32_t decompressedSize)
+{
+    std::vector<char> output(decompressedSize);
+    const auto ret = ZSTD_decompress(output.data(), output.size(), input.data(), input.size());
+    if (ZSTD_isError(ret)) {
+        throw std::runtime_error(ZSTD_getErrorName(ret));
+    } else if (ret != decompressedSize) {
+        throw std::runtime_error("frame size does not match the seek table");
+    }
+    return output;
+}
+}
+
+std::vector<ParallelZstdDecompressor::Frame> ParallelZstdDecompressor::readSeekTable(const std::string& path)
+{
+    std::ifstream file(path, std::ios_base::in | std::ios_base::binary | std::ios_base::ate);
+    if (!file.is_open()) {
+        return {};
+    }
+    const uint64_t fileSize = file.tellg();
+    if (fileSize < SKIPPABLE_HEADER_SIZE + SEEK_TABLE_FOOTER_SIZE) {
+        return {};
+    }
+
+    char footer[SEEK_TABLE_FOOTER_SIZE];
+    file.seekg(fileSize - SEEK_TABLE_FOOTER_SIZE);
+    if (!file.read(footer, sizeof(footer)) || readLittleEndian(footer + 5) != SEEKABLE_MAGIC) {
+        return {};
+    }
+    const uint64_t numFrames = readLittleEndian(footer);
+    const uint64_t entrySize = (footer[4] & CHECKSUM_FLAG) ? 12 : 8;
+    const uint64_t tableSize = numFrames * entrySize + SEEK_TABLE_FOOTER_SIZE;
+    if (tableSize + SKIPPABLE_HEADER_SIZE > fileSize) {
+        return {};
+    }
+
+    std::vector<char> table(tableSize + SKIPPABLE_HEADER_SIZE);
+    file.seekg(fileSize - table.size());
+    if (!file.read(table.data(), table.size()) || readLittleEndian(table.data()) != SKIPPABLE_MAGIC
+        || readLittleEndian(table.data() + 4) != tableSize) {
+        return {};
+    }
+
+    std::vector<Frame> frames(numFrames);
+    uint64_t compressedSize = 0;
+    for (uint64_t i = 0; i < numFrames; ++i) {
+        const auto entry = table.data() + SKIPPABLE_HEADER_SIZE + i * entrySize;
+        frames[i] = {readLittleEndian(entry), readLittleEndian(entry + 4)};
+        compressedSize += frames[i].compressedSize;
+    }
+    // the frames must cover the whole file, otherwise it got written by something else
+    if (compressedSize + table.size() != fileSize) {
+        return {};
+    }
+    return frames;
+}
+
+ParallelZstdDecompressor::ParallelZstdDecompressor(std::vector<Frame> frames, unsigned threads)
+    : m_state(std::make_shared<State>(std::move(frames), threads))
+{
+}
+
+ParallelZstdDecompressor::State::State(std::vector<Frame> frames, unsigned threads)
+    : m_frames(std::move(frames))
+    , m_maxQueued(std::max(1u, threads ? threads : std::thread::hardware_concurrency()))
+{
+}
+
+std::vector<char>* ParallelZstdDecompressor::State::nextInput()
+{
+    if (m_failed || m_nextFrame == m_frames.size() || m_queue.size() >= m_maxQueued) {
+        return nullptr;
+    }
+    m_input.resize(m_frames[m_nextFrame].compressedSize);
+    return &m_input;
+}
+
+void ParallelZstdDecompressor::State::submitInput()
+{
+    const auto decompressedSize = m_frames[m_nextFrame].decompressedSize;
+    m_queue.push_back(std::async(std::launch::async, decompress, std::move(m_input), decompressedSize));
+    m_input = {};
+    ++m_nextFrame;
+}
+
+std::streamsize ParallelZstdDecompressor::State::output(char* str, std::streamsize size)
+{
+    while (m_outputPos == m_output.size()) {
+        if (m_failed || m_queue.empty()) {
+            return -1;
+        }
+        try {
+            m_output = m_queue.front().get();
+        } catch (const std::exception& error) {
+            m_queue.pop_front();
+            return fail(error.what());
+        }
+        m_queue.pop_front();
+        m_outputPos = 0;
+    }
+
+    const auto available = std::min<std::streamsize>(size, m_output.size() - m_outputPos);
+    memcpy(str, m_output.data() + m_outputPos, available);
+    m_outputPos += available;
+    return available;
+}
+
+std::streamsize ParallelZstdDecompressor::State::fail(const char* error)
+{
+    if (!m_failed) {
+        std::cerr << "failed to decompress frame " << (m_nextFrame - m_queue.size()) << ": " << error << std::endl;
+        m_failed = true;
+    }
+    return -1;
+}
@@ -0,0 +1,96 @@
+/*
+    SPDX-FileCopyrightText: 2026 Milian Wolff <mail@milianw.de>
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#ifndef PARALLELZSTDDECOMPRESSOR_H
+#define PARALLELZSTDDECOMPRESSOR_H
+
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/iostreams/categories.hpp>
+#include <boost/iostreams/operations.hpp>
+
+/**
+ * Decompresses zstd files in the seekable format on multiple threads.
+ *
+ * heaptrack_interpret splits its compressed output into independent frames and appends
+ * a seek table listing their sizes. This filter reads the compressed frames in order,
+ * decompresses several of them in the background and returns their data in order again.
+ */
+class ParallelZstdDecompressor
+{
+public:
+    using char_type = char;
+    using category = boost::iostreams::multichar_input_filter_tag;
+
+    struct Frame
+    {
+        uint32_t compressedSize;
+        uint32_t decompressedSize;
+    };
+
+    /**
+     * @return the frames listed in the seek table of the zstd file at @p path,
+     *         or an empty list when the file is not in the seekable format
+     */
+    static std::vector<Frame> readSeekTable(const std::string& path);
+
+    /**
+     * @p threads is the maximum number of frames that get decompressed concurrently,
+     * 0 picks one per core
+     */
+    explicit ParallelZstdDecompressor(std::vector<Frame> frames, unsigned threads = 0);
+
+    template <typename Source>
+    std::streamsize read(Source& src, char* str, std::streamsize size)
+    {
+        while (auto* input = m_state->nextInput()) {
+            for (std::streamsize read = 0, total = input->size(); read < total;) {
+                const auto ret = boost::iostreams::read(src, input->data() + read, total - read);
+                if (ret == -1) {
+                    return m_state->fail("unexpected end of compressed data");
+                }
+                read += ret;
+            }
+            m_state->submitInput();
+        }
+        return m_state->output(str, size);
+    }
+
+private:
+    class State
+    {
+    public:
+        State(std::vector<Frame> frames, unsigned threads);
+
+        /// @return the buffer for the compressed data of the next frame, or nullptr when enough frames are queued
+        std::vector<char>* nextInput();
+        /// start decompressing the frame returned by nextInput()
+        void submitInput();
+        /// copy up to @p size bytes of decompressed data to @p str, waiting for the next frame if needed
+        std::streamsize output(char* str, std::streamsize size);
+        std::streamsize fail(const char* error);
+
+    private:
+        std::vector<Frame> m_frames;
+        size_t m_nextFrame = 0;
+        size_t m_maxQueued = 0;
+        bool m_failed = false;
+        std::vector<char> m_input;
+        std::deque<std::future<std::vector<char>>> m_queue;
+        std::vector<char> m_output;
+        size_t m_outputPos = 0;
+    };
+
+    // filters get copied by boost::iostreams, share the state between the copies
+    std::shared_ptr<State> m_state;
+};
+
+#endif // PARALLELZSTDDECOMPRESSOR_H
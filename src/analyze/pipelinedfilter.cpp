@@ -0,0 +1,124 @@
+/*
+    SPDX-FileCopyrightText: 2026 Milian Wolff <mail@milianw.de>
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#include "pipelinedfilter.h"
+
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <iostream>
+
+PipelinedFilter::PipelinedFilter(size_t bufferSize, size_t buffers)
+    : m_state(std::make_shared<State>(bufferSize, buffers))
+{
+}
+
+PipelinedFilter::State::State(size_t bufferSize, size_t buffers)
+    : m_free(std::max<size_t>(2, buffers), std::vector<char>(bufferSize))
+{
+}
+
+PipelinedFilter::State::~State()
+{
+    stop();
+}
+
+void PipelinedFilter::State::start(Producer producer)
+{
+    m_thread = std::thread(&State::produce, this, std::move(producer));
+}
+
+void PipelinedFilter::State::stop()
+{
+    if (!m_thread.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_freeCondition.notify_all();
+    m_thread.join();
+}
+
+void PipelinedFilter::State::produce(Producer producer)
+{
+    while (true) {
+        std::vector<char> buffer;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_freeCondition.wait(lock, [this]() { return m_stopping || !m_free.empty(); });
+            if (m_stopping) {
+                break;
+            }
+            buffer = std::move(m_free.back());
+            m_free.pop_back();
+        }
+
+        // fill the buffer completely, such that the consumer gets woken up rarely
+        const std::streamsize capacity = buffer.capacity();
+        buffer.resize(capacity);
+        std::streamsize size = 0;
+        bool atEnd = false;
+        try {
+            while (size < capacity) {
+                const auto ret = producer(buffer.data() + size, capacity - size);
+                if (ret == -1) {
+                    atEnd = true;
+                    break;
+                }
+                size += ret;
+            }
+        } catch (const std::exception& error) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_error = error.what();
+            atEnd = true;
+        }
+        buffer.resize(size);
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (size) {
+                m_filled.push_back(std::move(buffer));
+            }
+            m_finished = atEnd;
+        }
+        m_filledCondition.notify_one();
+        if (atEnd) {
+            break;
+        }
+    }
+}
+
+std::streamsize PipelinedFilter::State::output(char* str, std::streamsize size)
+{
+    while (m_outputPos == m_output.size()) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_output.capacity()) {
+            // hand the consumed buffer back to the producer
+            m_free.push_back(std::move(m_output));
+            m_output = {};
+            m_outputPos = 0;
+            m_freeCondition.notify_one();
+        }
+        m_filledCondition.wait(lock, [this]() { return m_finished || !m_filled.empty(); });
+        if (m_filled.empty()) {
+            if (!m_error.empty()) {
+                std::cerr << "failed to read input: " << m_error << std::endl;
+                m_error.clear();
+            }
+            return -1;
+        }
+        m_output = std::move(m_filled.front());
+        m_filled.pop_front();
+        m_outputPos = 0;
+    }
+
+    const auto available = std::min<std::streamsize>(size, m_output.size() - m_outputPos);
+    memcpy(str, m_output.data() + m_outputPos, available);
+    m_outputPos += available;
+    return available;
+}
@@ -0,0 +1,101 @@
+/*
+    SPDX-FileCopyrightText: 2026 Milian Wolff <mail@milianw.de>
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#ifndef PIPELINEDFILTER_H
+#define PIPELINEDFILTER_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/iostreams/categories.hpp>
+#include <boost/iostreams/operations.hpp>
+
+/**
+ * Reads the rest of the filter chain on a background thread, such that e.g. decompression
+ * overlaps with the parsing of the data that got decompressed already.
+ *
+ * The data is handed over in a bounded ring of large buffers. All filters and the device
+ * after this one in the chain get used on the background thread only, until the chain closes
+ * this filter.
+ */
+class PipelinedFilter
+{
+public:
+    using char_type = char;
+    struct category : boost::iostreams::multichar_input_filter_tag, boost::iostreams::closable_tag
+    {
+    };
+
+    /// @p buffers of @p bufferSize bytes each are used to hand over the data
+    explicit PipelinedFilter(size_t bufferSize = 1024 * 1024, size_t buffers = 4);
+
+    template <typename Source>
+    std::streamsize read(Source& src, char* str, std::streamsize size)
+    {
+        if (!m_state->isStarted()) {
+            // the source is the next link of the chain, which lives as long as the chain
+            m_state->start(
+                [&src](char* data, std::streamsize size) { return boost::iostreams::read(src, data, size); });
+        }
+        return m_state->output(str, size);
+    }
+
+    template <typename Source>
+    void close(Source& /*src*/)
+    {
+        m_state->stop();
+    }
+
+private:
+    class State
+    {
+    public:
+        using Producer = std::function<std::streamsize(char* data, std::streamsize size)>;
+
+        State(size_t bufferSize, size_t buffers);
+        ~State();
+
+        bool isStarted() const
+        {
+            return m_thread.joinable();
+        }
+
+        void start(Producer producer);
+        /// wait for the background thread to finish, i.e. when the chain gets closed
+        void stop();
+        /// copy up to @p size bytes to @p str, waiting for the next buffer if needed
+        std::streamsize output(char* str, std::streamsize size);
+
+    private:
+        void produce(Producer producer);
+
+        std::thread m_thread;
+        std::mutex m_mutex;
+        std::condition_variable m_filledCondition;
+        std::condition_variable m_freeCondition;
+        std::deque<std::vector<char>> m_filled;
+        std::vector<std::vector<char>> m_free;
+        // set once the producer reached the end of its input
+        bool m_finished = false;
+        bool m_stopping = false;
+        std::string m_error;
+
+        // the buffer that gets consumed currently, only accessed by the consumer
+        std::vector<char> m_output;
+        size_t m_outputPos = 0;
+    };
+
+    // filters get copied by boost::iostreams, share the state between the copies
+    std::shared_ptr<State> m_state;
+};
+
+#endif // PIPELINEDFILTER_H
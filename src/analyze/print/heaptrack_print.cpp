@@ -10,15 +10,24 @@
  * @brief Evaluate and print the collected heaptrack data.
  */
 
+#include <boost/iostreams/filter/gzip.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
 #include <boost/program_options.hpp>
 
 #include "analyze/accumulatedtracedata.h"
 #include "analyze/suppressions.h"
 
+#include <array>
+#include <csignal>
+#include <cstring>
+#include <functional>
 #include <future>
 #include <iomanip>
 #include <iostream>
+#include <numeric>
+#include <sstream>
 
+#include <tsl/robin_map.h>
 #include <tsl/robin_set.h>
 
 #include "util/config.h"
@@ -95,6 +104,101 @@ enum CostType
     Peak
 };
 
+/**
+ * Encodes protobuf messages in the wire format, which is all we need to write pprof's profile.proto.
+ */
+class ProtobufMessage
+{
+public:
+    void varint(int field, uint64_t value)
+    {
+        key(field, 0);
+        writeVarint(value);
+    }
+
+    void string(int field, boost::string_view value)
+    {
+        key(field, 2);
+        writeVarint(value.size());
+        m_data.append(value.data(), value.size());
+    }
+
+    void message(int field, const ProtobufMessage& message)
+    {
+        string(field, message.m_data);
+    }
+
+    template <typename T>
+    void packed(int field, const vector<T>& values)
+    {
+        ProtobufMessage packed;
+        for (const auto value : values) {
+            packed.writeVarint(static_cast<uint64_t>(value));
+        }
+        message(field, packed);
+    }
+
+    void clear()
+    {
+        m_data.clear();
+    }
+
+    friend ostream& operator<<(ostream& out, const ProtobufMessage& message)
+    {
+        return out.write(message.m_data.data(), message.m_data.size());
+    }
+
+private:
+    void key(int field, int wireType)
+    {
+        writeVarint((static_cast<uint64_t>(field) << 3) | wireType);
+    }
+
+    void writeVarint(uint64_t value)
+    {
+        while (value >= 0x80) {
+            m_data.push_back(static_cast<char>(value | 0x80));
+            value >>= 7;
+        }
+        m_data.push_back(static_cast<char>(value));
+    }
+
+    std::string m_data;
+};
+
+/**
+ * The allocations whose leaked cost changed since they got looked at last, see Printer::handleLeakedChange.
+ */
+class ChangedAllocations
+{
+public:
+    void add(uint32_t index)
+    {
+        if (index >= m_isChanged.size()) {
+            m_isChanged.resize(max<size_t>(index + 1, m_isChanged.size() * 2));
+        }
+        if (!m_isChanged[index]) {
+            m_isChanged[index] = true;
+            m_indices.push_back(index);
+        }
+    }
+
+    /// call @p callback with the index of every changed allocation, which are unchanged afterwards
+    template <typename Callback>
+    void take(Callback callback)
+    {
+        for (const auto index : m_indices) {
+            m_isChanged[index] = false;
+            callback(index);
+        }
+        m_indices.clear();
+    }
+
+private:
+    vector<uint32_t> m_indices;
+    vector<bool> m_isChanged;
+};
+
 std::istream& operator>>(std::istream& in, CostType& type)
 {
     std::string token;
@@ -114,55 +218,79 @@ std::istream& operator>>(std::istream& in, CostType& type)
 
 struct Printer final : public AccumulatedTraceData
 {
+    /// merge the costs of @p other, including the data that only gets collected by the printer
+    void mergePrinter(const Printer& other)
+    {
+        merge(other);
+        for (const auto& entry : other.sizeHistogram) {
+            sizeHistogram[entry.first] += entry.second;
+        }
+        for (size_t i = 0; i < lifetimeHistogram.size(); ++i) {
+            lifetimeHistogram[i] += other.lifetimeHistogram[i];
+        }
+    }
+
     void finalize()
     {
+        if (!(materializedTables & AllocationsTable)) {
+            // nothing to report on besides the totals
+            return;
+        }
         applyLeakSuppressions();
         filterAllocations();
         mergedAllocations = mergeAllocations(allocations);
     }
 
-    void mergeAllocation(vector<MergedAllocation>* mergedAllocations, const Allocation& allocation) const
-    {
-        const auto trace = findTrace(allocation.traceIndex);
-        const auto traceIp = findIp(trace.ipIndex);
-        auto it = lower_bound(mergedAllocations->begin(), mergedAllocations->end(), traceIp,
-                              [this](const MergedAllocation& allocation, const InstructionPointer traceIp) -> bool {
-                                  // Compare meta data without taking the instruction pointer address into account.
-                                  // This is useful since sometimes, esp. when we lack debug symbols, the same
-                                  // function allocates memory at different IP addresses which is pretty useless
-                                  // information most of the time
-                                  // TODO: make this configurable, but on-by-default
-                                  const auto allocationIp = findIp(allocation.ipIndex);
-                                  return allocationIp.compareWithoutAddress(traceIp);
-                              });
-        if (it == mergedAllocations->end() || !findIp(it->ipIndex).equalWithoutAddress(traceIp)) {
-            MergedAllocation merged;
-            merged.ipIndex = trace.ipIndex;
-            it = mergedAllocations->insert(it, merged);
-        }
-        it->traces.push_back(allocation);
-    }
-
     // merge allocations so that different traces that point to the same
     // instruction pointer at the end where the allocation function is
     // called are combined
-    vector<MergedAllocation> mergeAllocations(const vector<Allocation>& allocations) const
+    template <typename Allocations>
+    vector<MergedAllocation> mergeAllocations(const Allocations& allocations) const
     {
         // TODO: merge deeper traces, i.e. A,B,C,D and A,B,C,F
         //       should be merged to A,B,C: D & F
         //       currently the below will only merge it to: A: B,C,D & B,C,F
-        vector<MergedAllocation> ret;
-        ret.reserve(allocations.size());
-        for (const Allocation& allocation : allocations) {
-            mergeAllocation(&ret, allocation);
+
+        // Compare meta data without taking the instruction pointer address into account.
+        // This is useful since sometimes, esp. when we lack debug symbols, the same
+        // function allocates memory at different IP addresses which is pretty useless
+        // information most of the time
+        // TODO: make this configurable, but on-by-default
+        vector<pair<InstructionPointer, uint32_t>> sorted;
+        sorted.reserve(allocations.size());
+        for (uint32_t i = 0; i < allocations.size(); ++i) {
+            const auto trace = findTrace(allocations[i].traceIndex);
+            sorted.emplace_back(findIp(trace.ipIndex), i);
         }
-        for (MergedAllocation& merged : ret) {
-            for (const Allocation& allocation : merged.traces) {
+        // stable, such that the first trace of a location is the one that got recorded first
+        stable_sort(sorted.begin(), sorted.end(), [](const auto& lhs, const auto& rhs) {
+            return lhs.first.compareWithoutAddress(rhs.first);
+        });
+
+        vector<MergedAllocation> ret;
+        for (auto it = sorted.begin(); it != sorted.end();) {
+            auto end = find_if(it + 1, sorted.end(), [it](const auto& entry) {
+                return !entry.first.equalWithoutAddress(it->first);
+            });
+            MergedAllocation merged;
+            merged.ipIndex = findTrace(allocations[it->second].traceIndex).ipIndex;
+            merged.traces.reserve(distance(it, end));
+            for (; it != end; ++it) {
+                const auto& allocation = allocations[it->second];
+                merged.traces.push_back(allocation);
                 merged.allocations += allocation.allocations;
                 merged.leaked += allocation.leaked;
                 merged.peak += allocation.peak;
                 merged.temporary += allocation.temporary;
+                merged.mapped += allocation.mapped;
+                merged.peakMapped += allocation.peakMapped;
+                merged.growths += allocation.growths;
+                merged.copied += allocation.copied;
+                merged.slack += allocation.slack;
+                merged.remoteFrees += allocation.remoteFrees;
+                merged.pinned += allocation.pinned;
             }
+            ret.push_back(std::move(merged));
         }
         return ret;
     }
@@ -216,7 +344,7 @@ struct Printer final : public AccumulatedTraceData
         printIndent(out, indent);
 
         if (ip.frame.functionIndex) {
-            out << prettyFunction(stringify(ip.frame.functionIndex));
+            out << prettyFunction(ip.frame.functionIndex);
         } else {
             out << "0x" << hex << ip.instructionPointer << dec;
         }
@@ -233,7 +361,7 @@ struct Printer final : public AccumulatedTraceData
             }
             out << ';';
             for (const auto& inlined : ip.inlined) {
-                out << prettyFunction(stringify(inlined.functionIndex));
+                out << prettyFunction(inlined.functionIndex);
                 printFile(inlined.fileIndex);
                 out << ';';
             }
@@ -257,7 +385,7 @@ struct Printer final : public AccumulatedTraceData
 
         for (const auto& inlined : ip.inlined) {
             printIndent(out, indent);
-            out << prettyFunction(stringify(inlined.functionIndex)) << '\n';
+            out << prettyFunction(inlined.functionIndex) << '\n';
             printIndent(out, indent + 1);
             out << "at " << stringify(inlined.fileIndex) << ':' << inlined.line << '\n';
         }
@@ -296,92 +424,364 @@ struct Printer final : public AccumulatedTraceData
     }
 
     /**
-     * recursive top-down printer in the format
+     * Write the collapsed stacks of all allocations with at least @p minCost in the format
+     *
+     * func1;func2 (file);func2 (file); cost
      *
-     * func1;func2 (file);func2 (file);
+     * The stacks get written in the order of the trace tree, such that consecutive stacks share
+     * their prefixes. Only the prefix of the current stack is kept formatted, which bounds the
+     * memory to the depth of the tree, and every trace only gets formatted about once.
      */
-    void printFlamegraph(TraceNode node, ostream& out) const
+    void writeFlamegraph(ostream& out, CostType costType, int64_t minCost) const
     {
-        if (!node.ipIndex) {
-            return;
+        auto costOf = [costType](const Allocation& allocation) {
+            switch (costType) {
+            case Allocations:
+                return allocation.allocations;
+            case Temporary:
+                return allocation.temporary;
+            case Peak:
+                return allocation.peak;
+            case Leaked:
+                return allocation.leaked;
+            }
+            return int64_t(0);
+        };
+
+        // filter before anything gets formatted
+        vector<uint32_t> selected;
+        selected.reserve(allocations.size());
+        for (uint32_t i = 0; i < allocations.size(); ++i) {
+            if (!minCost || costOf(allocations[i]) >= minCost) {
+                selected.push_back(i);
+            }
+        }
+
+        // preorder of the trace tree, from the children of each trace in compressed form
+        const auto numTraces = traces.size() + 1;
+        vector<uint32_t> childrenBegin(numTraces + 1, 0);
+        for (size_t i = 0; i < traces.size(); ++i) {
+            ++childrenBegin[traces[i].parentIndex.index + 1];
+        }
+        for (size_t i = 1; i < childrenBegin.size(); ++i) {
+            childrenBegin[i] += childrenBegin[i - 1];
+        }
+        vector<uint32_t> children(traces.size());
+        {
+            auto fill = childrenBegin;
+            for (size_t i = 0; i < traces.size(); ++i) {
+                children[fill[traces[i].parentIndex.index]++] = i + 1;
+            }
+        }
+        vector<uint32_t> preorder(numTraces, 0);
+        {
+            uint32_t rank = 0;
+            vector<uint32_t> pending = {0};
+            while (!pending.empty()) {
+                const auto trace = pending.back();
+                pending.pop_back();
+                preorder[trace] = rank++;
+                for (auto child = childrenBegin[trace + 1]; child > childrenBegin[trace]; --child) {
+                    pending.push_back(children[child - 1]);
+                }
+            }
+        }
+        children = {};
+        childrenBegin = {};
+
+        stable_sort(selected.begin(), selected.end(), [this, &preorder](uint32_t lhs, uint32_t rhs) {
+            return preorder[allocations[lhs].traceIndex.index] < preorder[allocations[rhs].traceIndex.index];
+        });
+        preorder = {};
+
+        // the traces of the current prefix along with the length of their formatted prefix,
+        // stackPosition maps a trace to its position in there plus one
+        vector<pair<TraceIndex, size_t>> stack;
+        vector<uint32_t> stackPosition(numTraces, 0);
+        string prefix;
+        vector<TraceIndex> chain;
+        ostringstream frame;
+        for (const auto i : selected) {
+            const auto& allocation = allocations[i];
+            if (!allocation.traceIndex) {
+                out << "?? " << costOf(allocation) << '\n';
+                continue;
+            }
+
+            // find the part of the stack that needs to be formatted, up to the first stop frame
+            chain.clear();
+            size_t keep = 0;
+            for (auto index = allocation.traceIndex; index;) {
+                if (const auto position = stackPosition[index.index]) {
+                    keep = position;
+                    break;
+                }
+                chain.push_back(index);
+                const auto node = findTrace(index);
+                if (!node.ipIndex || isStopIndex(findIp(node.ipIndex).frame.functionIndex)) {
+                    break;
+                }
+                index = node.parentIndex;
+            }
+
+            while (stack.size() > keep) {
+                stackPosition[stack.back().first.index] = 0;
+                stack.pop_back();
+            }
+            prefix.resize(stack.empty() ? 0 : stack.back().second);
+            for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+                const auto node = findTrace(*it);
+                if (node.ipIndex) {
+                    frame.str({});
+                    printIp(findIp(node.ipIndex), frame, 0, true);
+                    prefix += frame.str();
+                }
+                stack.emplace_back(*it, prefix.size());
+                stackPosition[it->index] = stack.size();
+            }
+
+            out << prefix << ' ' << costOf(allocation) << '\n';
         }
+    }
+
+    /**
+     * @return the indices of the up to @p limit items with the largest absolute non-zero @p member,
+     *         sorted by it. Ties are broken by the index, such that the reports don't depend on each other.
+     */
+    template <typename Items, typename T>
+    static vector<uint32_t> topIndices(const Items& items, T AllocationData::*member, size_t limit)
+    {
+        vector<uint32_t> indices;
+        indices.reserve(items.size());
+        for (uint32_t i = 0; i < items.size(); ++i) {
+            if (items[i].*member) {
+                indices.push_back(i);
+            }
+        }
+        const auto top = min(limit, indices.size());
+        partial_sort(indices.begin(), indices.begin() + top, indices.end(),
+                     [&items, member](uint32_t lhs, uint32_t rhs) {
+                         const auto l = std::abs(items[lhs].*member);
+                         const auto r = std::abs(items[rhs].*member);
+                         return l > r || (l == r && lhs < rhs);
+                     });
+        indices.resize(top);
+        return indices;
+    }
+
+    /**
+     * Write the costs as a gzip'ed pprof profile, see
+     * https://github.com/google/pprof/blob/main/proto/profile.proto
+     *
+     * The messages get written as we go, the string table is the one of the data file.
+     */
+    bool writePprof(const string& outputFile) const
+    {
+        ofstream file(outputFile, ios_base::out | ios_base::binary | ios_base::trunc);
+        if (!file.is_open()) {
+            return false;
+        }
+        boost::iostreams::filtering_ostream out;
+        out.push(boost::iostreams::gzip_compressor());
+        out.push(file);
+
+        // the fields of Profile, Sample and friends
+        enum
+        {
+            SampleTypeField = 1,
+            SampleField = 2,
+            MappingField = 3,
+            LocationField = 4,
+            FunctionField = 5,
+            StringTableField = 6,
+            DurationNanosField = 10,
+            PeriodTypeField = 11,
+            PeriodField = 12,
+            DefaultSampleTypeField = 14,
+        };
+
+        ProtobufMessage profile;
+        ProtobufMessage message;
+        auto flush = [&]() {
+            out << profile;
+            profile.clear();
+        };
 
-        const auto& ip = findIp(node.ipIndex);
+        // index zero is the empty string in both tables
+        profile.string(StringTableField, {});
+        for (size_t i = 0; i < strings.size(); ++i) {
+            profile.string(StringTableField, strings[i]);
+            flush();
+        }
+        auto stringIndex = strings.size();
+        auto addString = [&](boost::string_view string) {
+            profile.string(StringTableField, string);
+            return ++stringIndex;
+        };
+        const auto countUnit = addString("count");
+        const auto bytesUnit = addString("bytes");
+        const pair<uint64_t, uint64_t> sampleTypes[] = {
+            {addString("allocations"), countUnit},
+            {addString("peak"), bytesUnit},
+            {addString("leaked"), bytesUnit},
+            {addString("temporary"), countUnit},
+        };
+        for (const auto& sampleType : sampleTypes) {
+            message.clear();
+            message.varint(1, sampleType.first);
+            message.varint(2, sampleType.second);
+            profile.message(SampleTypeField, message);
+        }
+        profile.varint(DefaultSampleTypeField, sampleTypes[1].first);
+        if (sampleInterval) {
+            message.clear();
+            message.varint(1, addString("space"));
+            message.varint(2, bytesUnit);
+            profile.message(PeriodTypeField, message);
+            profile.varint(PeriodField, sampleInterval);
+        }
+        profile.varint(DurationNanosField, totalTime * 1000000);
+        flush();
+
+        // one mapping per module, one location per instruction pointer and one function per name and file
+        tsl::robin_set<uint64_t> mappings;
+        tsl::robin_map<uint64_t, uint64_t> functions;
+        auto functionId = [&](const Frame& frame) {
+            // the function goes into the low bits, which the identity hash of the map relies upon
+            const auto key = (static_cast<uint64_t>(frame.fileIndex.index) << 32) | frame.functionIndex.index;
+            auto it = functions.find(key);
+            if (it != functions.end()) {
+                return it->second;
+            }
+            const auto id = functions.size() + 1;
+            functions.insert({key, id});
+            message.clear();
+            message.varint(1, id);
+            message.varint(2, frame.functionIndex.index);
+            message.varint(3, frame.functionIndex.index);
+            message.varint(4, frame.fileIndex.index);
+            profile.message(FunctionField, message);
+            return id;
+        };
+        ProtobufMessage line;
+        for (size_t i = 0; i < instructionPointers.size(); ++i) {
+            const auto ip = instructionPointers[i];
+            if (ip.moduleIndex && mappings.insert(ip.moduleIndex.index).second) {
+                message.clear();
+                message.varint(1, ip.moduleIndex.index);
+                message.varint(5, ip.moduleIndex.index);
+                // heaptrack_interpret symbolized everything already
+                for (int field = 7; field <= 10; ++field) {
+                    message.varint(field, 1);
+                }
+                profile.message(MappingField, message);
+            }
+
+            ProtobufMessage location;
+            location.varint(1, i + 1);
+            if (ip.moduleIndex) {
+                location.varint(2, ip.moduleIndex.index);
+            }
+            location.varint(3, ip.instructionPointer);
+            // the innermost frame comes first, like in pprof
+            auto addLine = [&](const Frame& frame) {
+                line.clear();
+                line.varint(1, functionId(frame));
+                line.varint(2, frame.line);
+                location.message(4, line);
+            };
+            if (ip.frame.functionIndex) {
+                addLine(ip.frame);
+                for (const auto& inlined : ip.inlined) {
+                    addLine(inlined);
+                }
+            }
+            profile.message(LocationField, location);
+            flush();
+        }
+
+        vector<uint64_t> locations;
+        vector<int64_t> values;
+        for (const auto& allocation : allocations) {
+            if (!allocation.allocations && !allocation.peak && !allocation.leaked && !allocation.temporary) {
+                continue;
+            }
+            locations.clear();
+            auto node = findTrace(allocation.traceIndex);
+            tsl::robin_set<TraceIndex> recursionGuard;
+            while (node.ipIndex) {
+                locations.push_back(node.ipIndex.index);
+                if (isStopIndex(findIp(node.ipIndex).frame.functionIndex)
+                    || !recursionGuard.insert(node.parentIndex).second) {
+                    break;
+                }
+                node = findTrace(node.parentIndex);
+            }
+            values = {allocation.allocations, allocation.peak, allocation.leaked, allocation.temporary};
 
-        if (!isStopIndex(ip.frame.functionIndex)) {
-            printFlamegraph(findTrace(node.parentIndex), out);
+            message.clear();
+            message.packed(1, locations);
+            message.packed(2, values);
+            profile.message(SampleField, message);
+            flush();
         }
-        printIp(ip, out, 0, true);
+
+        out.reset();
+        return static_cast<bool>(file);
     }
 
     template <typename T, typename LabelPrinter, typename SubLabelPrinter>
-    void printAllocations(T AllocationData::*member, LabelPrinter label, SubLabelPrinter sublabel)
+    void printAllocations(ostream& out, T AllocationData::*member, LabelPrinter label, SubLabelPrinter sublabel) const
     {
         if (mergeBacktraces) {
-            printMerged(member, label, sublabel);
+            printMerged(out, member, label, sublabel);
         } else {
-            printUnmerged(member, label);
+            printUnmerged(out, member, label);
         }
     }
 
     template <typename T, typename LabelPrinter, typename SubLabelPrinter>
-    void printMerged(T AllocationData::*member, LabelPrinter label, SubLabelPrinter sublabel)
+    void printMerged(ostream& out, T AllocationData::*member, LabelPrinter label, SubLabelPrinter sublabel) const
     {
-        auto sortOrder = [member](const AllocationData& l, const AllocationData& r) {
-            return std::abs(l.*member) > std::abs(r.*member);
-        };
-        sort(mergedAllocations.begin(), mergedAllocations.end(), sortOrder);
-        for (size_t i = 0; i < min(peakLimit, mergedAllocations.size()); ++i) {
-            auto& allocation = mergedAllocations[i];
-            if (!(allocation.*member)) {
-                break;
-            }
-            label(allocation);
-            printIp(allocation.ipIndex, cout);
+        for (const auto i : topIndices(mergedAllocations, member, peakLimit)) {
+            const auto& allocation = mergedAllocations[i];
+            label(out, allocation);
+            printIp(allocation.ipIndex, out);
 
             if (!allocation.ipIndex) {
                 continue;
             }
 
-            sort(allocation.traces.begin(), allocation.traces.end(), sortOrder);
             int64_t handled = 0;
-            for (size_t j = 0; j < min(subPeakLimit, allocation.traces.size()); ++j) {
+            for (const auto j : topIndices(allocation.traces, member, subPeakLimit)) {
                 const auto& trace = allocation.traces[j];
-                if (!(trace.*member)) {
-                    break;
-                }
-                sublabel(trace);
+                sublabel(out, trace);
                 handled += trace.*member;
-                printBacktrace(trace.traceIndex, cout, 2, true);
+                printBacktrace(trace.traceIndex, out, 2, true);
             }
             if (allocation.traces.size() > subPeakLimit) {
-                cout << "  and ";
+                out << "  and ";
                 if (member == &AllocationData::allocations) {
-                    cout << (allocation.*member - handled);
+                    out << (allocation.*member - handled);
                 } else {
-                    cout << formatBytes(allocation.*member - handled);
+                    out << formatBytes(allocation.*member - handled);
                 }
-                cout << " from " << (allocation.traces.size() - subPeakLimit) << " other places\n";
+                out << " from " << (allocation.traces.size() - subPeakLimit) << " other places\n";
             }
-            cout << '\n';
+            out << '\n';
         }
     }
 
     template <typename T, typename LabelPrinter>
-    void printUnmerged(T AllocationData::*member, LabelPrinter label)
+    void printUnmerged(ostream& out, T AllocationData::*member, LabelPrinter label) const
     {
-        sort(allocations.begin(), allocations.end(),
-             [member](const Allocation& l, const Allocation& r) { return std::abs(l.*member) > std::abs(r.*member); });
-        for (size_t i = 0; i < min(peakLimit, allocations.size()); ++i) {
+        for (const auto i : topIndices(allocations, member, peakLimit)) {
             const auto& allocation = allocations[i];
-            if (!(allocation.*member)) {
-                break;
-            }
-            label(allocation);
-            printBacktrace(allocation.traceIndex, cout, 1);
-            cout << '\n';
+            label(out, allocation);
+            printBacktrace(allocation.traceIndex, out, 1);
+            out << '\n';
         }
-        cout << endl;
+        out << '\n';
     }
 
     void writeMassifHeader(const char* command)
@@ -392,11 +792,23 @@ struct Printer final : public AccumulatedTraceData
                   << "time_unit: s\n";
     }
 
+    /// update massifAllocations to the current costs, by only copying the allocations that changed since
+    void syncMassifAllocations()
+    {
+        changedMassifAllocations.take([this](uint32_t index) {
+            if (index < massifAllocations.size()) {
+                massifAllocations[index] = allocations[index];
+            }
+        });
+        massifAllocations.insert(massifAllocations.end(), allocations.begin() + massifAllocations.size(),
+                                 allocations.end());
+    }
+
     void writeMassifSnapshot(size_t timeStamp, bool isLast)
     {
         if (!lastMassifPeak) {
             lastMassifPeak = totalCost.leaked;
-            massifAllocations = allocations;
+            syncMassifAllocations();
         }
         massifOut << "#-----------\n"
                   << "snapshot=" << massifSnapshotId << '\n'
@@ -409,7 +821,11 @@ struct Printer final : public AccumulatedTraceData
         if (massifDetailedFreq && (isLast || !(massifSnapshotId % massifDetailedFreq))) {
             massifOut << "heap_tree=detailed\n";
             const size_t threshold = double(lastMassifPeak) * massifThreshold * 0.01;
-            writeMassifBacktrace(massifAllocations, lastMassifPeak, threshold, IpIndex());
+            // allocations without cost cannot show up in the tree, skip them once for all of its levels
+            vector<Allocation> allocations;
+            copy_if(massifAllocations.begin(), massifAllocations.end(), back_inserter(allocations),
+                    [](const Allocation& allocation) { return allocation.leaked != 0; });
+            writeMassifBacktrace(allocations, lastMassifPeak, threshold, IpIndex());
         } else {
             massifOut << "heap_tree=empty\n";
         }
@@ -438,6 +854,9 @@ struct Printer final : public AccumulatedTraceData
                     // list is sorted, so we can bail out now - these entries are
                     // uninteresting for massif
                     break;
+                } else if (!merged.ipIndex) {
+                    // the root of backtraces that do not reach main, e.g. in threads
+                    continue;
                 }
 
                 // skip items below threshold
@@ -491,7 +910,7 @@ struct Printer final : public AccumulatedTraceData
 
         if (!shouldStop) {
             for (const auto& merged : mergedAllocations) {
-                if (merged.leaked > 0 && static_cast<size_t>(merged.leaked) >= threshold) {
+                if (merged.ipIndex && merged.leaked > 0 && static_cast<size_t>(merged.leaked) >= threshold) {
                     if (skippedLeaked > merged.leaked) {
                         // manually inject this entry to keep the output sorted
                         writeSkipped();
@@ -503,18 +922,207 @@ struct Printer final : public AccumulatedTraceData
         }
     }
 
-    void handleAllocation(const AllocationInfo& info, const AllocationInfoIndex /*index*/) override
+    void handleAllocation(const AllocationInfo& info, const AllocationInfoIndex index) override
+    {
+        handleAllocations(info, index, 1);
+    }
+
+    /// the uuids of the tracks of the Perfetto trace, the ones of the call sites follow
+    enum PerfettoTrack : uint64_t
+    {
+        PerfettoProcessTrack = 1,
+        PerfettoHeapTrack,
+        PerfettoRssTrack,
+        PerfettoAllocationRateTrack,
+        PerfettoOtherCallSitesTrack,
+        PerfettoFirstCallSiteTrack
+    };
+    /// see CounterDescriptor.Unit of Perfetto
+    enum PerfettoUnit
+    {
+        PerfettoNoUnit = 0,
+        PerfettoCount = 2,
+        PerfettoBytes = 3
+    };
+
+    /// write @p packet as the next one of the Perfetto trace, whose packets are its repeated field 1
+    void writePerfettoPacket(const ProtobufMessage& packet)
+    {
+        ProtobufMessage trace;
+        trace.message(1, packet);
+        perfettoOut << trace;
+    }
+
+    /// @return a packet with the time stamp of the recording at @p timeStamp milliseconds
+    ProtobufMessage perfettoPacket(int64_t timeStamp) const
+    {
+        enum
+        {
+            TimestampField = 8,
+            TrustedPacketSequenceIdField = 10
+        };
+        ProtobufMessage packet;
+        packet.varint(TimestampField, startTimeNs + timeStamp * 1000000);
+        packet.varint(TrustedPacketSequenceIdField, 1);
+        return packet;
+    }
+
+    /// write the descriptor of a counter track below the one of the process, or the latter without a @p unit
+    void writePerfettoTrack(uint64_t uuid, boost::string_view name, PerfettoUnit unit)
+    {
+        enum
+        {
+            TrackDescriptorField = 60,
+            UuidField = 1,
+            NameField = 2,
+            ParentUuidField = 5,
+            CounterField = 8,
+            UnitField = 3
+        };
+        ProtobufMessage track;
+        track.varint(UuidField, uuid);
+        track.string(NameField, name);
+        if (unit != PerfettoNoUnit) {
+            track.varint(ParentUuidField, PerfettoProcessTrack);
+            ProtobufMessage counter;
+            counter.varint(UnitField, unit);
+            track.message(CounterField, counter);
+        }
+        auto packet = perfettoPacket(0);
+        packet.message(TrackDescriptorField, track);
+        writePerfettoPacket(packet);
+    }
+
+    void writePerfettoCounter(uint64_t track, int64_t timeStamp, int64_t value)
+    {
+        enum
+        {
+            TrackEventField = 11,
+            TypeField = 9,
+            TypeCounter = 4,
+            TrackUuidField = 11,
+            CounterValueField = 30
+        };
+        ProtobufMessage event;
+        event.varint(TypeField, TypeCounter);
+        event.varint(TrackUuidField, track);
+        event.varint(CounterValueField, static_cast<uint64_t>(value));
+        auto packet = perfettoPacket(timeStamp);
+        packet.message(TrackEventField, event);
+        writePerfettoPacket(packet);
+    }
+
+    /// write the tracks that always exist, once the debuggee is known
+    void startPerfettoTrace()
+    {
+        if (perfettoStarted) {
+            return;
+        }
+        perfettoStarted = true;
+        writePerfettoTrack(PerfettoProcessTrack, "heaptrack " + debuggee, PerfettoNoUnit);
+        writePerfettoTrack(PerfettoHeapTrack, "heap memory consumption", PerfettoBytes);
+        writePerfettoTrack(PerfettoRssTrack, "RSS", PerfettoBytes);
+        writePerfettoTrack(PerfettoAllocationRateTrack, "allocations per second", PerfettoCount);
+        writePerfettoTrack(PerfettoOtherCallSitesTrack, "heap memory consumption of other call sites", PerfettoBytes);
+        perfettoCallSites.reserve(perfettoCallSiteLimit * 4);
+    }
+
+    std::string perfettoCallSiteName(IpIndex ipIndex) const
+    {
+        const auto ip = findIp(ipIndex);
+        if (ip.frame.functionIndex) {
+            return std::string(prettyFunction(ip.frame.functionIndex));
+        }
+        ostringstream name;
+        name << "0x" << hex << ip.instructionPointer;
+        return name.str();
+    }
+
+    /**
+     * Write the counters at @p timeStamp.
+     *
+     * The call sites get their own track once their leaked cost reached perfettoThreshold percent of the
+     * peak consumption so far, up to perfettoCallSiteLimit of them. The rest is summed up in another track.
+     */
+    void writePerfettoCounters(int64_t timeStamp)
+    {
+        startPerfettoTrace();
+
+        changedPerfettoAllocations.take([this](uint32_t index) {
+            if (index >= perfettoLeaked.size()) {
+                perfettoLeaked.resize(max<size_t>(index + 1, perfettoLeaked.size() * 2), 0);
+            }
+            const auto& allocation = allocations[index];
+            const auto ipIndex = findTrace(allocation.traceIndex).ipIndex;
+            auto& callSite = perfettoCallSites[ipIndex];
+            callSite.leaked += allocation.leaked - perfettoLeaked[index];
+            perfettoLeaked[index] = allocation.leaked;
+            if (!callSite.changed) {
+                callSite.changed = true;
+                changedPerfettoCallSites.push_back(ipIndex);
+            }
+        });
+
+        perfettoMaxLeaked = max(perfettoMaxLeaked, totalCost.leaked);
+        const auto threshold = static_cast<int64_t>(double(perfettoMaxLeaked) * perfettoThreshold * 0.01);
+        for (const auto ipIndex : changedPerfettoCallSites) {
+            auto& callSite = perfettoCallSites[ipIndex];
+            callSite.changed = false;
+            if (!callSite.track) {
+                if (perfettoNextTrack - PerfettoFirstCallSiteTrack >= perfettoCallSiteLimit || callSite.leaked <= 0
+                    || callSite.leaked < threshold) {
+                    continue;
+                }
+                callSite.track = perfettoNextTrack++;
+                writePerfettoTrack(callSite.track, perfettoCallSiteName(ipIndex), PerfettoBytes);
+            } else {
+                perfettoTrackedLeaked -= callSite.reportedLeaked;
+            }
+            perfettoTrackedLeaked += callSite.leaked;
+            callSite.reportedLeaked = callSite.leaked;
+            writePerfettoCounter(callSite.track, timeStamp, callSite.leaked);
+        }
+        changedPerfettoCallSites.clear();
+
+        const auto elapsed = max<int64_t>(1, timeStamp - perfettoTimeStamp);
+        writePerfettoCounter(PerfettoHeapTrack, timeStamp, totalCost.leaked);
+        writePerfettoCounter(PerfettoAllocationRateTrack, timeStamp,
+                             (totalCost.allocations - perfettoAllocations) * 1000 / elapsed);
+        writePerfettoCounter(PerfettoOtherCallSitesTrack, timeStamp, totalCost.leaked - perfettoTrackedLeaked);
+        perfettoTimeStamp = timeStamp;
+        perfettoAllocations = totalCost.allocations;
+    }
+
+    void handleAllocations(const AllocationInfo& info, const AllocationInfoIndex /*index*/, int64_t count) override
     {
         if (printHistogram) {
-            ++sizeHistogram[info.size];
+            sizeHistogram[info.size] += count;
         }
 
         if (totalCost.leaked > 0 && static_cast<size_t>(totalCost.leaked) > lastMassifPeak && massifOut.is_open()) {
-            massifAllocations = allocations;
+            syncMassifAllocations();
             lastMassifPeak = totalCost.leaked;
         }
     }
 
+    void handleDeallocation(const AllocationInfo& /*info*/, const AllocationInfoIndex /*index*/,
+                            int64_t lifetime) override
+    {
+        if (printLifetimeHistogram && lifetime >= 0) {
+            ++lifetimeHistogram[lifetimeBucket(static_cast<uint32_t>(lifetime))];
+        }
+    }
+
+    void handleLeakedChange(const AllocationIndex index) override
+    {
+        if (massifOut.is_open()) {
+            changedMassifAllocations.add(index.index);
+        }
+        if (perfettoOut.is_open()) {
+            changedPerfettoAllocations.add(index.index);
+        }
+    }
+
     void handleTimeStamp(int64_t /*oldStamp*/, int64_t newStamp, bool isFinalTimeStamp, ParsePass pass) override
     {
         if (pass != ParsePass::FirstPass) {
@@ -523,33 +1131,95 @@ struct Printer final : public AccumulatedTraceData
         if (massifOut.is_open()) {
             writeMassifSnapshot(newStamp, isFinalTimeStamp);
         }
+        if (perfettoOut.is_open()) {
+            writePerfettoCounters(newStamp);
+        }
+    }
+
+    void handleRss(int64_t rss) override
+    {
+        if (perfettoOut.is_open()) {
+            startPerfettoTrace();
+            writePerfettoCounter(PerfettoRssTrack, perfettoTimeStamp, rss * systemInfo.pageSize);
+        }
     }
 
     void handleDebuggee(const char* command) override
     {
+        debuggee = command;
+        if (quiet) {
+            return;
+        }
         cout << "Debuggee command was: " << command << endl;
         if (massifOut.is_open()) {
             writeMassifHeader(command);
         }
     }
 
+    void handleFollowUpdate() override
+    {
+        if (perfettoOut.is_open()) {
+            // let the data that got read so far show up
+            perfettoOut.flush();
+        }
+        if (followCallback) {
+            followCallback();
+        }
+    }
+
     bool printHistogram = false;
+    bool printLifetimeHistogram = false;
     bool mergeBacktraces = true;
+    // don't print the debuggee, used for the files that get merged into another one
+    bool quiet = false;
+    string debuggee;
 
     vector<MergedAllocation> mergedAllocations;
 
     std::map<uint64_t, uint64_t> sizeHistogram;
+    // the number of freed allocations per lifetimeBucket()
+    std::array<uint64_t, NumLifetimeBuckets> lifetimeHistogram = {};
 
     uint64_t massifSnapshotId = 0;
     uint64_t lastMassifPeak = 0;
+    // the allocations at the last peak, see syncMassifAllocations
     vector<Allocation> massifAllocations;
+    ChangedAllocations changedMassifAllocations;
     ofstream massifOut;
     double massifThreshold = 1;
     uint64_t massifDetailedFreq = 1;
 
+    struct PerfettoCallSite
+    {
+        int64_t leaked = 0;
+        /// the leaked cost that got written to its track last
+        int64_t reportedLeaked = 0;
+        /// zero until the call site got its own track
+        uint64_t track = 0;
+        bool changed = false;
+    };
+    ofstream perfettoOut;
+    bool perfettoStarted = false;
+    int64_t perfettoTimeStamp = 0;
+    int64_t perfettoAllocations = 0;
+    int64_t perfettoMaxLeaked = 0;
+    /// the leaked cost of the call sites that got their own track
+    int64_t perfettoTrackedLeaked = 0;
+    uint64_t perfettoNextTrack = PerfettoFirstCallSiteTrack;
+    /// the leaked cost of every allocation that got added to its call site already
+    vector<int64_t> perfettoLeaked;
+    ChangedAllocations changedPerfettoAllocations;
+    /// indexed by the instruction pointer that called the allocation function, like in the charts of the GUI
+    tsl::robin_map<IpIndex, PerfettoCallSite> perfettoCallSites;
+    vector<IpIndex> changedPerfettoCallSites;
+    size_t perfettoCallSiteLimit = 10;
+    double perfettoThreshold = 1;
+
     string filterBtFunction;
     size_t peakLimit = 10;
     size_t subPeakLimit = 5;
+
+    std::function<void()> followCallback;
 };
 }
 
@@ -562,16 +1232,41 @@ int main(int argc, char** argv)
             "The heaptrack data file to print.")
         ("diff,d", po::value<string>()->default_value({}),
             "Find the differences to this file.")
+        ("merge", po::value<vector<string>>()->multitoken(),
+            "Add the costs of these files, e.g. recordings of the same application on many hosts. The files "
+            "get read in parallel and their traces unified by symbols. Without --file, the first one is used.")
+        ("merge-output", po::value<string>()->default_value({}),
+            "Path to a heaptrack data file where the aggregated costs of --merge will be written to. Compressed "
+            "when it ends on .gz or .zst. It can be opened like any other data file, but has no timeline.")
         ("shorten-templates,t", po::value<bool>()->default_value(true)->implicit_value(true),
             "Shorten template identifiers.")
         ("merge-backtraces,m", po::value<bool>()->default_value(true)->implicit_value(true),
             "Merge backtraces.\nNOTE: the merged peak consumption is not correct.")
+        ("summary-only", po::value<bool>()->default_value(false)->implicit_value(true),
+            "Only print the total costs. This skips building the symbol, trace and per-trace cost tables, "
+            "which makes it much faster, but leaks cannot get suppressed then.")
         ("print-peaks,p", po::value<bool>()->default_value(true)->implicit_value(true),
             "Print backtraces to top allocators, sorted by peak consumption.")
         ("print-allocators,a", po::value<bool>()->default_value(true)->implicit_value(true),
             "Print backtraces to top allocators, sorted by number of calls to allocation functions.")
         ("print-temporary,T", po::value<bool>()->default_value(true)->implicit_value(true),
             "Print backtraces to top allocators, sorted by number of temporary allocations.")
+        ("print-growth,g", po::value<bool>()->default_value(true)->implicit_value(true),
+            "Print backtraces to buffers that grow step by step, sorted by the bytes that got copied. These are "
+            "allocations freed right after a larger allocation from the same backtrace, like when a std::vector "
+            "grows, and are a good place for a reserve() call.")
+        ("print-slack", po::value<bool>()->default_value(true)->implicit_value(true),
+            "Print backtraces to top allocators, sorted by the bytes the allocator reserved on top of the "
+            "requested sizes, together with the slack per size class. Only known when the data got recorded "
+            "with HEAPTRACK_USABLE_SIZE.")
+        ("print-remote-frees", po::value<bool>()->default_value(true)->implicit_value(true),
+            "Print backtraces to top allocators, sorted by the number of allocations that got freed by another "
+            "thread, which most allocators handle on a slower path. Only known when the data got recorded with "
+            "HEAPTRACK_TRACK_THREADS.")
+        ("print-pinned", po::value<bool>()->default_value(true)->implicit_value(true),
+            "Print backtraces to top allocators, sorted by the bytes of the sparsely occupied pages their allocations "
+            "keep from being returned to the system, at the time when the most pages were sparse. Only known when "
+            "the data got recorded with HEAPTRACK_INTERPRET_OCCUPANCY.")
         ("print-leaks,l", po::value<bool>()->default_value(false)->implicit_value(true),
             "Print backtraces to leaked memory allocations.")
         ("peak-limit,n", po::value<size_t>()->default_value(10)->implicit_value(10),
@@ -580,12 +1275,24 @@ int main(int argc, char** argv)
             "Limit the number of reported backtraces of merged peak locations.")
         ("print-histogram,H", po::value<string>()->default_value(string()),
             "Path to output file where an allocation size histogram will be written to.")
+        ("print-lifetime-histogram", po::value<string>()->default_value(string()),
+            "Path to output file where a histogram of the allocation lifetimes will be written to. Each line "
+            "holds the lower bound of a lifetime bucket in milliseconds and the number of freed allocations in it, "
+            "the buckets are spaced logarithmically.")
+        ("print-page-occupancy", po::value<string>()->default_value(string()),
+            "Path to output file where the page occupancy over time will be written to, e.g. to plot it as a "
+            "heatmap. Each line holds a time stamp in milliseconds and the number of pages per tenth of their "
+            "bytes that is occupied by live allocations. Only known when the data got recorded with "
+            "HEAPTRACK_INTERPRET_OCCUPANCY.")
         ("flamegraph-cost-type", po::value<CostType>()->default_value(Allocations),
             "The cost type to use when generating a flamegraph. Possible options are:\n"
             "  - allocations: number of allocations\n"
             "  - temporary: number of temporary allocations\n"
             "  - leaked: bytes not deallocated at the end\n"
             "  - peak: bytes consumed at highest total memory consumption")
+        ("flamegraph-min-cost", po::value<int64_t>()->default_value(0),
+            "Only write stacks with at least this cost of the --flamegraph-cost-type to the flamegraph. "
+            "Zero writes all of them.")
         ("print-flamegraph,F", po::value<string>()->default_value(string()),
             "Path to output file where a flame-graph compatible stack file will be written to.\n"
             "To visualize the resulting file, use flamegraph.pl from "
@@ -595,6 +1302,9 @@ int main(int argc, char** argv)
             "  flamegraph.pl --title \"heaptrack: allocations\" --colors mem \\\n"
             "    --countname allocations < stacks.txt > heaptrack.someapp.PID.svg\n"
             "  [firefox|chromium] heaptrack.someapp.PID.svg\n")
+        ("print-pprof", po::value<string>()->default_value(string()),
+            "Path to output file where a gzip compressed pprof profile will be written to, with the sample types "
+            "allocations, peak, leaked and temporary.")
         ("print-massif,M", po::value<string>()->default_value(string()),
             "Path to output file where a massif compatible data file will be written to.")
         ("massif-threshold", po::value<double>()->default_value(1.),
@@ -603,8 +1313,26 @@ int main(int argc, char** argv)
         ("massif-detailed-freq", po::value<size_t>()->default_value(2),
             "Frequency of detailed snapshots in the massif output file. Increase  this to reduce the file size.\n"
             "You can set the value to zero to disable detailed snapshots.\n")
+        ("print-perfetto", po::value<string>()->default_value(string()),
+            "Path to output file where a Perfetto trace will be written to while the data gets read, with counter "
+            "tracks for the heap memory consumption, the RSS, the allocations per second and the heap memory "
+            "consumption of the top call sites.")
+        ("perfetto-call-sites", po::value<size_t>()->default_value(10),
+            "Maximum number of call sites that get their own track in the Perfetto trace.")
+        ("perfetto-threshold", po::value<double>()->default_value(1.),
+            "Percentage of the peak memory usage so far, which the memory usage of a call site must reach "
+            "to get its own track in the Perfetto trace.")
         ("filter-bt-function", po::value<string>()->default_value(string()),
             "Only print allocations where the backtrace contains the given function.")
+        ("min-size", po::value<uint64_t>()->default_value(0),
+            "Only account for allocations of at least the given number of bytes.")
+        ("max-size", po::value<uint64_t>()->default_value(numeric_limits<uint64_t>::max()),
+            "Only account for allocations of at most the given number of bytes.")
+        ("min-lifetime", po::value<int64_t>()->default_value(0),
+            "Only account for allocations that stay alive for at least the given number of milliseconds. "
+            "The allocations then show up in the data once they reached that age.\n"
+            "The data recorded with HEAPTRACK_AGGREGATE cannot be filtered like this and gets ignored "
+            "with any of the size or lifetime filters.")
         ("suppressions", po::value<string>()->default_value(string()),
             "Load list of leak suppressions from the specified file. Specify one suppression per line, and start each line with 'leak:', i.e. use the LSAN suppression file format.")
         ("disable-embedded-suppressions",
@@ -616,6 +1344,18 @@ int main(int argc, char** argv)
             "known leaks from common system libraries.")
         ("print-suppressions", po::value<bool>()->default_value(false)->implicit_value(true),
             "Show statistics for matched suppressions.")
+        ("follow", po::value<double>()->implicit_value(5.),
+            "Keep reading the growing data file of a running recording, or a named pipe, and print the report "
+            "for the data seen so far every N seconds. Stop following by pressing Ctrl+C.")
+        ("segments", po::value<vector<string>>()->multitoken(),
+            "Continue reading with these segments of the same recording after the input file, which must be the "
+            "segment before the first of them. See HEAPTRACK_SEGMENT_OUTPUT of heaptrack_interpret.")
+        ("memory-budget", po::value<size_t>()->default_value(0),
+            "Limit the resident memory while reading to the given number of MiB. The tables that grow with the "
+            "number of allocations then get stored in scratch files which the kernel can page out as needed. "
+            "Zero means no limit.")
+        ("scratch-directory", po::value<string>()->default_value({}),
+            "Directory for the scratch files of --memory-budget, defaults to $TMPDIR or /tmp.")
         ("help,h", "Show this help message.")
         ("version,v", "Displays version information.");
     // clang-format on
@@ -645,6 +1385,13 @@ int main(int argc, char** argv)
         return 1;
     }
 
+    const bool merge = vm.count("merge");
+    auto mergeFiles = merge ? vm["merge"].as<vector<string>>() : vector<string>();
+    if (!vm.count("file") && !mergeFiles.empty()) {
+        vm.insert(make_pair("file", po::variable_value(mergeFiles.front(), false)));
+        mergeFiles.erase(mergeFiles.begin());
+    }
+
     if (!vm.count("file")) {
         // NOTE: stay backwards compatible to old boost 1.41 available in RHEL 6
         //       otherwise, we could simplify this by setting the file option
@@ -657,6 +1404,15 @@ int main(int argc, char** argv)
 
     const auto inputFile = vm["file"].as<string>();
     const auto diffFile = vm["diff"].as<string>();
+    const auto mergeOutput = vm["merge-output"].as<string>();
+    if (merge && !diffFile.empty()) {
+        cerr << "ERROR: --merge cannot be combined with --diff" << endl;
+        return 1;
+    }
+    if (!mergeOutput.empty() && !merge) {
+        cerr << "ERROR: --merge-output requires --merge" << endl;
+        return 1;
+    }
     data.shortenTemplates = vm["shorten-templates"].as<bool>();
     data.mergeBacktraces = vm["merge-backtraces"].as<bool>();
     data.filterBtFunction = vm["filter-bt-function"].as<string>();
@@ -664,10 +1420,19 @@ int main(int argc, char** argv)
     data.subPeakLimit = vm["sub-peak-limit"].as<size_t>();
     const string printHistogram = vm["print-histogram"].as<string>();
     data.printHistogram = !printHistogram.empty();
+    const string printLifetimeHistogram = vm["print-lifetime-histogram"].as<string>();
+    data.printLifetimeHistogram = !printLifetimeHistogram.empty();
+    const string printPageOccupancy = vm["print-page-occupancy"].as<string>();
     const string printFlamegraph = vm["print-flamegraph"].as<string>();
     const auto flamegraphCostType = vm["flamegraph-cost-type"].as<CostType>();
     const string printMassif = vm["print-massif"].as<string>();
+    const string printPprof = vm["print-pprof"].as<string>();
+    const string printPerfetto = vm["print-perfetto"].as<string>();
     if (!printMassif.empty()) {
+        if (merge) {
+            cerr << "ERROR: --print-massif cannot be combined with --merge" << endl;
+            return 1;
+        }
         data.massifOut.open(printMassif, ios_base::out);
         if (!data.massifOut.is_open()) {
             cerr << "Failed to open massif output file \"" << printMassif << "\"." << endl;
@@ -676,26 +1441,423 @@ int main(int argc, char** argv)
         data.massifThreshold = vm["massif-threshold"].as<double>();
         data.massifDetailedFreq = vm["massif-detailed-freq"].as<size_t>();
     }
-    const bool printLeaks = vm["print-leaks"].as<bool>();
-    const bool printPeaks = vm["print-peaks"].as<bool>();
-    const bool printAllocs = vm["print-allocators"].as<bool>();
-    const bool printTemporary = vm["print-temporary"].as<bool>();
+    if (!printPerfetto.empty()) {
+        if (merge) {
+            cerr << "ERROR: --print-perfetto cannot be combined with --merge" << endl;
+            return 1;
+        }
+        data.perfettoOut.open(printPerfetto, ios_base::out | ios_base::binary);
+        if (!data.perfettoOut.is_open()) {
+            cerr << "Failed to open Perfetto output file \"" << printPerfetto << "\"." << endl;
+            return 1;
+        }
+        data.perfettoCallSiteLimit = vm["perfetto-call-sites"].as<size_t>();
+        data.perfettoThreshold = vm["perfetto-threshold"].as<double>();
+    }
+    const bool summaryOnly = vm["summary-only"].as<bool>();
+    if (summaryOnly) {
+        if (!diffFile.empty() || !mergeOutput.empty() || !printFlamegraph.empty() || !printMassif.empty()
+            || !printPprof.empty() || !printPerfetto.empty()) {
+            cerr << "ERROR: --summary-only cannot be combined with --diff, --merge-output, --print-flamegraph, "
+                    "--print-massif, --print-pprof or --print-perfetto"
+                 << endl;
+            return 1;
+        }
+        data.materializedTables = 0;
+    }
+    const bool printLeaks = !summaryOnly && vm["print-leaks"].as<bool>();
+    const bool printPeaks = !summaryOnly && vm["print-peaks"].as<bool>();
+    const bool printAllocs = !summaryOnly && vm["print-allocators"].as<bool>();
+    const bool printTemporary = !summaryOnly && vm["print-temporary"].as<bool>();
+    const bool printGrowth = !summaryOnly && vm["print-growth"].as<bool>();
+    const bool printSlack = vm["print-slack"].as<bool>();
+    const bool printRemoteFrees = !summaryOnly && vm["print-remote-frees"].as<bool>();
+    const bool printPinned = !summaryOnly && vm["print-pinned"].as<bool>();
     const auto printSuppressions = vm["print-suppressions"].as<bool>();
     const auto suppressionsFile = vm["suppressions"].as<string>();
 
     data.filterParameters.disableEmbeddedSuppressions = vm.count("disable-embedded-suppressions");
     data.filterParameters.disableBuiltinSuppressions = vm.count("disable-builtin-suppressions");
+    data.filterParameters.minSize = vm["min-size"].as<uint64_t>();
+    data.filterParameters.maxSize = vm["max-size"].as<uint64_t>();
+    data.filterParameters.minLifetime = vm["min-lifetime"].as<int64_t>();
     bool suppressionsOk = false;
     data.filterParameters.suppressions = parseSuppressions(suppressionsFile, &suppressionsOk);
     if (!suppressionsOk) {
         return 1;
     }
 
+    if (vm.count("segments")) {
+        if (vm.count("follow")) {
+            cerr << "ERROR: --follow cannot be combined with --segments" << endl;
+            return 1;
+        }
+        data.segments = vm["segments"].as<vector<string>>();
+    }
+
+    data.memoryBudget = static_cast<int64_t>(vm["memory-budget"].as<size_t>()) * 1024 * 1024;
+    data.scratchDirectory = vm["scratch-directory"].as<string>();
+
     cout << "reading file \"" << inputFile << "\" - please wait, this might take some time..." << endl;
 
+    if (vm.count("follow")) {
+        if (!diffFile.empty()) {
+            cerr << "ERROR: --follow cannot be combined with --diff" << endl;
+            return 1;
+        }
+        if (merge) {
+            cerr << "ERROR: --follow cannot be combined with --merge" << endl;
+            return 1;
+        }
+        data.followInterval = static_cast<int64_t>(vm["follow"].as<double>() * 1000);
+        // interrupt blocking reads of pipes too, i.e. don't restart them
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = [](int) { AccumulatedTraceData::stopFollowing(); };
+        sigaction(SIGINT, &action, nullptr);
+    }
+
+    auto printReport = [&]() {
+        // the reports only read the data, so they get generated concurrently and printed in a fixed order
+        struct Report
+        {
+            string text;
+            // the formatting state of the stream, which gets applied to the summary below
+            ios_base::fmtflags flags;
+            streamsize precision;
+        };
+        vector<future<Report>> reports;
+        auto addReport = [&reports](std::function<void(ostream& out)> print) {
+            reports.push_back(async(launch::async, [print]() {
+                ostringstream out;
+                print(out);
+                out << '\n';
+                return Report {out.str(), out.flags(), out.precision()};
+            }));
+        };
+
+        if (printAllocs) {
+            // sort by amount of allocations
+            addReport([&data](ostream& out) {
+                out << "MOST CALLS TO ALLOCATION FUNCTIONS\n";
+                data.printAllocations(
+                    out, &AllocationData::allocations,
+                    [](ostream& out, const AllocationData& data) {
+                        out << data.allocations << " calls to allocation functions with " << formatBytes(data.peak)
+                            << " peak consumption from\n";
+                    },
+                    [](ostream& out, const AllocationData& data) {
+                        out << data.allocations << " calls with " << formatBytes(data.peak)
+                            << " peak consumption from:\n";
+                    });
+            });
+        }
+
+        if (printPeaks) {
+            addReport([&data](ostream& out) {
+                out << "PEAK MEMORY CONSUMERS\n";
+                data.printAllocations(
+                    out, &AllocationData::peak,
+                    [](ostream& out, const AllocationData& data) {
+                        out << formatBytes(data.peak) << " peak memory consumed over " << data.allocations
+                            << " calls from\n";
+                    },
+                    [](ostream& out, const AllocationData& data) {
+                        out << formatBytes(data.peak) << " consumed over " << data.allocations << " calls from:\n";
+                    });
+            });
+        }
+
+        if (printLeaks) {
+            // sort by amount of leaks
+            addReport([&data](ostream& out) {
+                out << "MEMORY LEAKS\n";
+                data.printAllocations(
+                    out, &AllocationData::leaked,
+                    [](ostream& out, const AllocationData& data) {
+                        out << formatBytes(data.leaked) << " leaked over " << data.allocations << " calls from\n";
+                    },
+                    [](ostream& out, const AllocationData& data) {
+                        out << formatBytes(data.leaked) << " leaked over " << data.allocations << " calls from:\n";
+                    });
+            });
+        }
+
+        if (printPeaks && data.totalCost.peakMapped) {
+            addReport([&data](ostream& out) {
+                out << "PEAK MAPPED MEMORY\n";
+                data.printAllocations(
+                    out, &AllocationData::peakMapped,
+                    [](ostream& out, const AllocationData& data) {
+                        out << formatBytes(data.peakMapped) << " peak memory mapped from\n";
+                    },
+                    [](ostream& out, const AllocationData& data) {
+                        out << formatBytes(data.peakMapped) << " mapped from:\n";
+                    });
+            });
+        }
+
+        if (printTemporary) {
+            // sort by amount of temporary allocations
+            addReport([&data](ostream& out) {
+                out << "MOST TEMPORARY ALLOCATIONS\n";
+                data.printAllocations(
+                    out, &AllocationData::temporary,
+                    [](ostream& out, const AllocationData& data) {
+                        out << data.temporary << " temporary allocations of " << data.allocations
+                            << " allocations in total (" << fixed << setprecision(2)
+                            << (float(data.temporary) * 100.f / data.allocations) << "%) from\n";
+                    },
+                    [](ostream& out, const AllocationData& data) {
+                        out << data.temporary << " temporary allocations of " << data.allocations
+                            << " allocations in total (" << fixed << setprecision(2)
+                            << (float(data.temporary) * 100.f / data.allocations) << "%) from:\n";
+                    });
+            });
+        }
+
+        if (printGrowth && data.totalCost.copied) {
+            // sort by amount of bytes copied when growing buffers
+            addReport([&data](ostream& out) {
+                out << "MOST BYTES COPIED BY GROWING ALLOCATIONS\n";
+                data.printAllocations(
+                    out, &AllocationData::copied,
+                    [](ostream& out, const AllocationData& data) {
+                        out << formatBytes(data.copied) << " copied over " << data.growths << " growth steps from\n";
+                    },
+                    [](ostream& out, const AllocationData& data) {
+                        out << formatBytes(data.copied) << " copied over " << data.growths << " growth steps from:\n";
+                    });
+            });
+        }
+
+        if (printSlack && !summaryOnly && data.totalCost.slack) {
+            // sort by the bytes wasted by the rounding of the allocator
+            addReport([&data](ostream& out) {
+                out << "MOST ALLOCATOR SLACK\n";
+                data.printAllocations(
+                    out, &AllocationData::slack,
+                    [](ostream& out, const AllocationData& data) {
+                        out << formatBytes(data.slack) << " slack over " << data.allocations << " calls from\n";
+                    },
+                    [](ostream& out, const AllocationData& data) {
+                        out << formatBytes(data.slack) << " slack over " << data.allocations << " calls from:\n";
+                    });
+            });
+        }
+
+        if (printRemoteFrees && data.totalCost.remoteFrees) {
+            // sort by the number of frees on another thread
+            addReport([&data](ostream& out) {
+                out << "MOST REMOTE FREES\n";
+                auto printRemoteFrees = [](ostream& out, const AllocationData& data) {
+                    out << data.remoteFrees << " of " << data.allocations << " calls freed by another thread ("
+                        << fixed << setprecision(2) << (100. * data.remoteFrees / max(data.allocations, int64_t(1)))
+                        << "%) from";
+                };
+                data.printAllocations(
+                    out, &AllocationData::remoteFrees,
+                    [printRemoteFrees](ostream& out, const AllocationData& data) {
+                        printRemoteFrees(out, data);
+                        out << '\n';
+                    },
+                    [printRemoteFrees](ostream& out, const AllocationData& data) {
+                        printRemoteFrees(out, data);
+                        out << ":\n";
+                    });
+            });
+        }
+
+        if (printPinned && data.totalCost.pinned) {
+            // sort by the bytes of the sparse pages that can't be returned to the system
+            addReport([&data](ostream& out) {
+                out << "MOST PINNED SPARSE PAGES\n";
+                data.printAllocations(
+                    out, &AllocationData::pinned,
+                    [](ostream& out, const AllocationData& data) {
+                        out << formatBytes(data.pinned) << " of sparse pages pinned by " << data.allocations
+                            << " calls from\n";
+                    },
+                    [](ostream& out, const AllocationData& data) {
+                        out << formatBytes(data.pinned) << " pinned by " << data.allocations << " calls from:\n";
+                    });
+            });
+        }
+
+        const auto defaultFlags = ostringstream().flags();
+        const auto defaultPrecision = ostringstream().precision();
+        for (auto& future : reports) {
+            const auto report = future.get();
+            cout << report.text << flush;
+            if (report.flags != defaultFlags || report.precision != defaultPrecision) {
+                cout.flags(report.flags);
+                cout.precision(report.precision);
+            }
+        }
+
+        const double totalTimeS = data.totalTime ? (1000. / data.totalTime) : 1.;
+        if (data.sampleInterval) {
+            cout << "allocations got sampled every " << formatBytes(data.sampleInterval)
+                 << " on average, all costs are estimated\n";
+        }
+        cout << "total runtime: " << fixed << (data.totalTime / 1000.) << "s.\n"
+             << "calls to allocation functions: " << data.totalCost.allocations << " ("
+             << int64_t(data.totalCost.allocations * totalTimeS) << "/s)\n"
+             << "temporary memory allocations: " << data.totalCost.temporary << " ("
+             << int64_t(data.totalCost.temporary * totalTimeS) << "/s)\n"
+             << "peak heap memory consumption: " << formatBytes(data.totalCost.peak) << '\n'
+             << "peak RSS (including heaptrack overhead): " << formatBytes(data.peakRSS * data.systemInfo.pageSize) << '\n'
+             << "total memory leaked: " << formatBytes(data.totalCost.leaked) << '\n';
+        if (data.stoppedAtExit) {
+            cout << "the recording stopped when the process started to exit, the leaks include the memory freed "
+                    "by the static destructors\n";
+        }
+        if (data.totalCost.slack) {
+            cout << "allocator slack: " << formatBytes(data.totalCost.slack) << " over all allocations, "
+                 << formatBytes(data.peakSlack) << " at the peak heap memory consumption\n";
+        }
+        if (data.totalCost.growths) {
+            cout << "allocations grown step by step: " << data.totalCost.growths << ", copying "
+                 << formatBytes(data.totalCost.copied) << '\n';
+        }
+        if (data.totalCost.remoteFrees) {
+            cout << "allocations freed by another thread: " << data.totalCost.remoteFrees << " ("
+                 << setprecision(2) << (100. * data.totalCost.remoteFrees / max(data.totalCost.allocations, int64_t(1)))
+                 << "%)\n";
+        }
+        if (!data.pageOccupancy.empty()) {
+            const auto& occupancy = *max_element(
+                data.pageOccupancy.begin(), data.pageOccupancy.end(),
+                [](const AccumulatedTraceData::PageOccupancy& lhs, const AccumulatedTraceData::PageOccupancy& rhs) {
+                    return lhs.sparsePages() < rhs.sparsePages();
+                });
+            const auto pages = accumulate(occupancy.pages.begin(), occupancy.pages.end(), int64_t(0));
+            cout << "most sparse pages: " << occupancy.sparsePages() << " of " << pages << " pages of "
+                 << formatBytes(data.occupancyPageSize) << " are less than " << (100 / occupancy.pages.size())
+                 << "% occupied at " << (occupancy.time / 1000.) << "s, pinning "
+                 << formatBytes(data.totalCost.pinned) << '\n';
+        }
+        if (data.tracerOverhead.events) {
+            const auto& overhead = data.tracerOverhead;
+            cout << "heaptrack overhead: " << overhead.events << " events, " << (overhead.unwindNs / 1e9)
+                 << "s unwinding, " << (overhead.lockWaitNs / 1e9) << "s waiting for the lock (" << overhead.lockSpins
+                 << " spins), " << overhead.flushes << " flushes of " << formatBytes(overhead.flushedBytes) << ", "
+                 << (overhead.blockedWriteNs / 1e9) << "s blocked in writes\n";
+        }
+        if (data.totalCost.peakMapped) {
+            cout << "peak memory in anonymous mappings: " << formatBytes(data.totalCost.peakMapped) << '\n'
+                 << "memory still mapped at exit: " << formatBytes(data.totalCost.mapped) << '\n';
+        }
+        if (!data.threads.empty()) {
+            auto threads = data.threads;
+            sort(threads.begin(), threads.end(), [](const ThreadInfo& lhs, const ThreadInfo& rhs) {
+                return lhs.cost.allocations > rhs.cost.allocations;
+            });
+            cout << "allocations per thread:\n";
+            cout << setw(16) << "allocations" << ' ' << setw(16) << "temporary" << ' ' << setw(16) << "peak" << ' '
+                 << setw(16) << "leaked" << ' ' << setw(16) << "remote frees"
+                 << " thread\n";
+            for (const auto& thread : threads) {
+                cout << setw(16) << thread.cost.allocations << ' ' << setw(16) << thread.cost.temporary << ' '
+                     << formatBytes(thread.cost.peak, 16) << ' ' << formatBytes(thread.cost.leaked, 16) << ' '
+                     << setw(16) << thread.cost.remoteFrees << ' ' << thread.tid << ' ' << data.stringify(thread.name) << '\n';
+            }
+        }
+        // size class i holds the allocations of [2^(i-1), 2^i) bytes, see AccumulatedTraceData::sizeClasses
+        auto printSizeClass = [](size_t i) {
+            if (i == 0) {
+                cout << "0B\n";
+            } else if (i < 63) {
+                cout << '[' << formatBytes(int64_t(1) << (i - 1)) << ", " << formatBytes(int64_t(1) << i) << ")\n";
+            } else {
+                // the bounds of the last size classes don't fit into int64_t
+                cout << ">= " << formatBytes(int64_t(1) << 62) << '\n';
+            }
+        };
+        if (printSlack && !data.slackSizeClasses.empty()) {
+            cout << "allocator slack per size class:\n";
+            cout << setw(16) << "allocations" << ' ' << setw(16) << "requested" << ' ' << setw(16) << "slack"
+                 << " size class\n";
+            for (size_t i = 0; i < data.slackSizeClasses.size(); ++i) {
+                const auto& sizeClass = data.slackSizeClasses[i];
+                if (!sizeClass.allocations) {
+                    continue;
+                }
+                cout << setw(16) << sizeClass.allocations << ' ' << formatBytes(sizeClass.requested, 16) << ' '
+                     << formatBytes(sizeClass.slack, 16) << ' ';
+                printSizeClass(i);
+            }
+        }
+        if (!data.sizeClasses.empty()) {
+            cout << "allocations per size class, " << data.countedFrees << " frees:\n";
+            cout << setw(16) << "allocations" << ' ' << setw(16) << "allocated"
+                 << " size class\n";
+            for (size_t i = 0; i < data.sizeClasses.size(); ++i) {
+                const auto& sizeClass = data.sizeClasses[i];
+                if (!sizeClass.allocations) {
+                    continue;
+                }
+                cout << setw(16) << sizeClass.allocations << ' ' << formatBytes(sizeClass.bytes, 16) << ' ';
+                printSizeClass(i);
+            }
+        }
+        if (!data.pools.empty()) {
+            auto pools = data.pools;
+            sort(pools.begin(), pools.end(), [](const PoolInfo& lhs, const PoolInfo& rhs) {
+                return lhs.cost.allocations > rhs.cost.allocations;
+            });
+            cout << "allocations per pool:\n";
+            cout << setw(16) << "allocations" << ' ' << setw(16) << "temporary" << ' ' << setw(16) << "peak" << ' '
+                 << setw(16) << "leaked"
+                 << " pool\n";
+            for (const auto& pool : pools) {
+                cout << setw(16) << pool.cost.allocations << ' ' << setw(16) << pool.cost.temporary << ' '
+                     << formatBytes(pool.cost.peak, 16) << ' ' << formatBytes(pool.cost.leaked, 16) << " 0x" << hex
+                     << pool.handle << dec << '\n';
+            }
+        }
+        if (data.totalLeakedSuppressed) {
+            cout << "suppressed leaks: " << formatBytes(data.totalLeakedSuppressed) << '\n';
+
+            if (printSuppressions) {
+                cout << "Suppressions used:\n";
+                cout << setw(16) << "matches" << ' ' << setw(16) << "leaked"
+                     << " pattern\n";
+                for (const auto& suppression : data.suppressions) {
+                    if (!suppression.matches) {
+                        continue;
+                    }
+                    cout << setw(16) << suppression.matches << ' ' << formatBytes(suppression.leaked, 16) << ' '
+                         << suppression.pattern << '\n';
+                }
+            }
+        }
+    };
+
+    if (data.followInterval) {
+        data.followCallback = [&]() {
+            // the report modifies the data, restore it afterwards to continue parsing
+            const vector<Allocation> allocations(data.allocations.begin(), data.allocations.end());
+            const auto totalCost = data.totalCost;
+            const auto suppressions = data.suppressions;
+
+            cout << "REPORT AFTER " << fixed << setprecision(2) << (data.totalTime / 1000.) << "s\n" << endl;
+            data.finalize();
+            printReport();
+            cout << endl;
+
+            data.allocations.assign(allocations.begin(), allocations.end());
+            data.totalCost = totalCost;
+            data.suppressions = suppressions;
+            data.mergedAllocations.clear();
+        };
+    }
+
     if (!diffFile.empty()) {
         cout << "reading diff file \"" << diffFile << "\" - please wait, this might take some time..." << endl;
         Printer diffData;
+        diffData.memoryBudget = data.memoryBudget;
+        diffData.scratchDirectory = data.scratchDirectory;
         auto diffRead = async(launch::async, [&diffData, diffFile]() { return diffData.read(diffFile, false); });
 
         if (!data.read(inputFile, false) || !diffRead.get()) {
@@ -703,6 +1865,58 @@ int main(int argc, char** argv)
         }
 
         data.diff(diffData);
+    } else if (merge) {
+        cout << "reading " << mergeFiles.size() << " files to merge - please wait, this might take some time..."
+             << endl;
+        vector<unique_ptr<Printer>> mergeData;
+        vector<future<bool>> mergeReads;
+        for (const auto& mergeFile : mergeFiles) {
+            mergeData.emplace_back(new Printer);
+            auto& printer = *mergeData.back();
+            printer.memoryBudget = data.memoryBudget;
+            printer.scratchDirectory = data.scratchDirectory;
+            printer.filterParameters = data.filterParameters;
+            printer.printHistogram = data.printHistogram;
+            printer.printLifetimeHistogram = data.printLifetimeHistogram;
+            printer.quiet = true;
+            printer.materializedTables = data.materializedTables;
+            mergeReads.push_back(
+                async(launch::async, [&printer, mergeFile]() { return printer.read(mergeFile, false); }));
+        }
+
+        bool ok = data.read(inputFile, false);
+        for (auto& read : mergeReads) {
+            ok = read.get() && ok;
+        }
+        if (!ok) {
+            return 1;
+        }
+
+        // merge pairwise in parallel, this halves the number of files in every round
+        while (mergeData.size() > 1) {
+            vector<future<void>> merges;
+            for (size_t i = 0; i + 1 < mergeData.size(); i += 2) {
+                merges.push_back(async(launch::async, [&mergeData, i]() {
+                    mergeData[i]->mergePrinter(*mergeData[i + 1]);
+                    mergeData[i + 1].reset();
+                }));
+            }
+            for (auto& merge : merges) {
+                merge.get();
+            }
+            mergeData.erase(remove(mergeData.begin(), mergeData.end(), nullptr), mergeData.end());
+        }
+        if (!mergeData.empty()) {
+            data.mergePrinter(*mergeData.front());
+            mergeData.clear();
+        }
+
+        if (!mergeOutput.empty()) {
+            cout << "writing merged data to \"" << mergeOutput << "\"" << endl;
+            if (!data.writeAggregated(mergeOutput, data.debuggee)) {
+                return 1;
+            }
+        }
     } else if (!data.read(inputFile, false)) {
         return 1;
     }
@@ -711,89 +1925,7 @@ int main(int argc, char** argv)
 
     cout << "finished reading file, now analyzing data:\n" << endl;
 
-    if (printAllocs) {
-        // sort by amount of allocations
-        cout << "MOST CALLS TO ALLOCATION FUNCTIONS\n";
-        data.printAllocations(
-            &AllocationData::allocations,
-            [](const AllocationData& data) {
-                cout << data.allocations << " calls to allocation functions with " << formatBytes(data.peak)
-                     << " peak consumption from\n";
-            },
-            [](const AllocationData& data) {
-                cout << data.allocations << " calls with " << formatBytes(data.peak) << " peak consumption from:\n";
-            });
-        cout << endl;
-    }
-
-    if (printPeaks) {
-        cout << "PEAK MEMORY CONSUMERS\n";
-        data.printAllocations(
-            &AllocationData::peak,
-            [](const AllocationData& data) {
-                cout << formatBytes(data.peak) << " peak memory consumed over " << data.allocations << " calls from\n";
-            },
-            [](const AllocationData& data) {
-                cout << formatBytes(data.peak) << " consumed over " << data.allocations << " calls from:\n";
-            });
-        cout << endl;
-    }
-
-    if (printLeaks) {
-        // sort by amount of leaks
-        cout << "MEMORY LEAKS\n";
-        data.printAllocations(
-            &AllocationData::leaked,
-            [](const AllocationData& data) {
-                cout << formatBytes(data.leaked) << " leaked over " << data.allocations << " calls from\n";
-            },
-            [](const AllocationData& data) {
-                cout << formatBytes(data.leaked) << " leaked over " << data.allocations << " calls from:\n";
-            });
-        cout << endl;
-    }
-
-    if (printTemporary) {
-        // sort by amount of temporary allocations
-        cout << "MOST TEMPORARY ALLOCATIONS\n";
-        data.printAllocations(
-            &AllocationData::temporary,
-            [](const AllocationData& data) {
-                cout << data.temporary << " temporary allocations of " << data.allocations << " allocations in total ("
-                     << fixed << setprecision(2) << (float(data.temporary) * 100.f / data.allocations) << "%) from\n";
-            },
-            [](const AllocationData& data) {
-                cout << data.temporary << " temporary allocations of " << data.allocations << " allocations in total ("
-                     << fixed << setprecision(2) << (float(data.temporary) * 100.f / data.allocations) << "%) from:\n";
-            });
-        cout << endl;
-    }
-
-    const double totalTimeS = data.totalTime ? (1000. / data.totalTime) : 1.;
-    cout << "total runtime: " << fixed << (data.totalTime / 1000.) << "s.\n"
-         << "calls to allocation functions: " << data.totalCost.allocations << " ("
-         << int64_t(data.totalCost.allocations * totalTimeS) << "/s)\n"
-         << "temporary memory allocations: " << data.totalCost.temporary << " ("
-         << int64_t(data.totalCost.temporary * totalTimeS) << "/s)\n"
-         << "peak heap memory consumption: " << formatBytes(data.totalCost.peak) << '\n'
-         << "peak RSS (including heaptrack overhead): " << formatBytes(data.peakRSS * data.systemInfo.pageSize) << '\n'
-         << "total memory leaked: " << formatBytes(data.totalCost.leaked) << '\n';
-    if (data.totalLeakedSuppressed) {
-        cout << "suppressed leaks: " << formatBytes(data.totalLeakedSuppressed) << '\n';
-
-        if (printSuppressions) {
-            cout << "Suppressions used:\n";
-            cout << setw(16) << "matches" << ' ' << setw(16) << "leaked"
-                 << " pattern\n";
-            for (const auto& suppression : data.suppressions) {
-                if (!suppression.matches) {
-                    continue;
-                }
-                cout << setw(16) << suppression.matches << ' ' << formatBytes(suppression.leaked, 16) << ' '
-                     << suppression.pattern << '\n';
-            }
-        }
-    }
+    printReport();
 
     if (!printHistogram.empty()) {
         ofstream histogram(printHistogram, ios_base::out);
@@ -806,34 +1938,45 @@ int main(int argc, char** argv)
         }
     }
 
+    if (!printLifetimeHistogram.empty()) {
+        ofstream histogram(printLifetimeHistogram, ios_base::out);
+        if (!histogram.is_open()) {
+            cerr << "Failed to open lifetime histogram output file \"" << printLifetimeHistogram << "\"." << endl;
+        } else {
+            for (uint32_t i = 0; i < data.lifetimeHistogram.size(); ++i) {
+                if (data.lifetimeHistogram[i]) {
+                    const uint64_t lowerBound = i ? (uint64_t(1) << (i - 1)) : 0;
+                    histogram << lowerBound << '\t' << data.lifetimeHistogram[i] << '\n';
+                }
+            }
+        }
+    }
+
+    if (!printPageOccupancy.empty()) {
+        ofstream occupancy(printPageOccupancy, ios_base::out);
+        if (!occupancy.is_open()) {
+            cerr << "Failed to open page occupancy output file \"" << printPageOccupancy << "\"." << endl;
+        } else {
+            for (const auto& snapshot : data.pageOccupancy) {
+                occupancy << snapshot.time;
+                for (const auto pages : snapshot.pages) {
+                    occupancy << '\t' << pages;
+                }
+                occupancy << '\n';
+            }
+        }
+    }
+
+    if (!printPprof.empty() && !data.writePprof(printPprof)) {
+        cerr << "Failed to write pprof output file \"" << printPprof << "\"." << endl;
+    }
+
     if (!printFlamegraph.empty()) {
         ofstream flamegraph(printFlamegraph, ios_base::out);
         if (!flamegraph.is_open()) {
             cerr << "Failed to open flamegraph output file \"" << printFlamegraph << "\"." << endl;
         } else {
-            for (const auto& allocation : data.allocations) {
-                if (!allocation.traceIndex) {
-                    flamegraph << "??";
-                } else {
-                    data.printFlamegraph(data.findTrace(allocation.traceIndex), flamegraph);
-                }
-                flamegraph << ' ';
-                switch (flamegraphCostType) {
-                case Allocations:
-                    flamegraph << allocation.allocations;
-                    break;
-                case Temporary:
-                    flamegraph << allocation.temporary;
-                    break;
-                case Peak:
-                    flamegraph << allocation.peak;
-                    break;
-                case Leaked:
-                    flamegraph << allocation.leaked;
-                    break;
-                }
-                flamegraph << '\n';
-            }
+            data.writeFlamegraph(flamegraph, flamegraphCostType, vm["flamegraph-min-cost"].as<int64_t>());
         }
     }
 
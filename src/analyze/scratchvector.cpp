@@ -0,0 +1,137 @@
+/*
+    SPDX-FileCopyrightText: 2026 Milian Wolff <mail@milianw.de>
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#include "scratchvector.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace {
+/// heap storage larger than this gets its own mapping, which can grow without copying its data
+constexpr size_t MAPPED_THRESHOLD = 1024 * 1024;
+
+size_t pageAligned(size_t bytes)
+{
+    static const size_t pageSize = sysconf(_SC_PAGESIZE);
+    return std::max(pageSize, (bytes + pageSize - 1) / pageSize * pageSize);
+}
+
+void* mapFile(int fd, size_t bytes)
+{
+    if (ftruncate(fd, bytes) != 0) {
+        return nullptr;
+    }
+    auto* data = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    return data == MAP_FAILED ? nullptr : data;
+}
+}
+
+ScratchStorage::~ScratchStorage()
+{
+    release();
+}
+
+void ScratchStorage::release()
+{
+    if (isSpilled()) {
+        munmap(m_data, m_bytes);
+        close(m_fd);
+    } else if (m_mapped) {
+        munmap(m_data, m_bytes);
+    } else {
+        free(m_data);
+    }
+}
+
+void ScratchStorage::resize(size_t bytes)
+{
+    if (!isSpilled() && !m_mapped && bytes <= MAPPED_THRESHOLD) {
+        auto* data = realloc(m_data, bytes);
+        if (!data && bytes) {
+            throw std::bad_alloc();
+        }
+        m_data = data;
+        m_bytes = bytes;
+        return;
+    }
+
+    if (!isSpilled()) {
+        bytes = pageAligned(bytes);
+        void* data = MAP_FAILED;
+        if (m_mapped) {
+            // the kernel moves the page table entries when needed, the data itself never gets copied
+            data = mremap(m_data, m_bytes, bytes, MREMAP_MAYMOVE);
+        } else {
+            data = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (data != MAP_FAILED && m_data) {
+                memcpy(data, m_data, std::min(bytes, m_bytes));
+                free(m_data);
+            }
+        }
+        if (data == MAP_FAILED) {
+            throw std::bad_alloc();
+        }
+        m_data = data;
+        m_bytes = bytes;
+        m_mapped = true;
+        return;
+    }
+
+    // the data stays in the file, so we only need to map it again
+    bytes = pageAligned(bytes);
+    munmap(m_data, m_bytes);
+    m_data = mapFile(m_fd, bytes);
+    if (!m_data) {
+        throw std::bad_alloc();
+    }
+    m_bytes = bytes;
+}
+
+bool ScratchStorage::spill(const std::string& directory, size_t usedBytes)
+{
+    if (isSpilled()) {
+        return true;
+    }
+
+    std::string pathTemplate = directory + "/heaptrack.scratch.XXXXXX";
+    std::vector<char> path(pathTemplate.begin(), pathTemplate.end());
+    path.push_back(0);
+    const auto fd = mkstemp(path.data());
+    if (fd == -1) {
+        return false;
+    }
+    // nobody else needs to see the file, and this way it gets cleaned up even when we crash
+    unlink(path.data());
+
+    const auto bytes = pageAligned(m_bytes);
+    auto* data = mapFile(fd, bytes);
+    if (!data) {
+        close(fd);
+        return false;
+    }
+    if (usedBytes) {
+        memcpy(data, m_data, usedBytes);
+    }
+    release();
+    m_mapped = false;
+    m_data = data;
+    m_bytes = bytes;
+    m_fd = fd;
+    return true;
+}
+
+void ScratchStorage::dropResidentPages()
+{
+    if (isSpilled()) {
+        // the data of shared file mappings survives this, it gets loaded again on the next access
+        madvise(m_data, m_bytes, MADV_DONTNEED);
+    }
+}
@@ -0,0 +1,239 @@
+/*
+    SPDX-FileCopyrightText: 2026 Milian Wolff <mail@milianw.de>
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#ifndef SCRATCHVECTOR_H
+#define SCRATCHVECTOR_H
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+/**
+ * Raw storage for ScratchVector, either on the heap or in an unlinked scratch file.
+ *
+ * Large heap storage lives in an anonymous mapping of its own, which grows by remapping
+ * its pages instead of copying the data into a new buffer twice the size.
+ */
+class ScratchStorage
+{
+public:
+    ScratchStorage() = default;
+    ~ScratchStorage();
+
+    ScratchStorage(const ScratchStorage&) = delete;
+    ScratchStorage& operator=(const ScratchStorage&) = delete;
+
+    ScratchStorage(ScratchStorage&& other) noexcept
+    {
+        swap(other);
+    }
+
+    ScratchStorage& operator=(ScratchStorage&& other) noexcept
+    {
+        swap(other);
+        return *this;
+    }
+
+    void swap(ScratchStorage& other) noexcept
+    {
+        std::swap(m_data, other.m_data);
+        std::swap(m_bytes, other.m_bytes);
+        std::swap(m_fd, other.m_fd);
+        std::swap(m_mapped, other.m_mapped);
+    }
+
+    void* data() const
+    {
+        return m_data;
+    }
+
+    /// grow the storage to @p bytes, keeping its data, throws std::bad_alloc on failure
+    void resize(size_t bytes);
+
+    /**
+     * Move the data into a new scratch file in @p directory and map it from there.
+     *
+     * @return false when the scratch file could not be created, the data then stays on the heap
+     */
+    bool spill(const std::string& directory, size_t usedBytes);
+
+    bool isSpilled() const
+    {
+        return m_fd != -1;
+    }
+
+    /// drop the resident pages of a spilled storage, they get paged in again from the file on access
+    void dropResidentPages();
+
+private:
+    void release();
+
+    void* m_data = nullptr;
+    size_t m_bytes = 0;
+    int m_fd = -1;
+    /// whether the heap storage is an anonymous mapping instead of a malloc'ed buffer
+    bool m_mapped = false;
+};
+
+/**
+ * A minimal vector for trivially copyable types whose data can be spilled to disk.
+ *
+ * Once spilled, the kernel can write back and evict cold pages like for any other file,
+ * and dropResidentPages() explicitly releases them to stay within a memory budget.
+ */
+template <typename T>
+class ScratchVector
+{
+    static_assert(std::is_trivially_copyable<T>::value, "scratch data gets copied bytewise");
+
+public:
+    using value_type = T;
+
+    ScratchVector() = default;
+
+    ScratchVector(ScratchVector&& other) noexcept
+    {
+        swap(other);
+    }
+
+    ScratchVector& operator=(ScratchVector&& other) noexcept
+    {
+        swap(other);
+        return *this;
+    }
+
+    void swap(ScratchVector& other) noexcept
+    {
+        m_storage.swap(other.m_storage);
+        std::swap(m_size, other.m_size);
+        std::swap(m_capacity, other.m_capacity);
+    }
+
+    size_t size() const
+    {
+        return m_size;
+    }
+
+    bool empty() const
+    {
+        return !m_size;
+    }
+
+    void reserve(size_t capacity)
+    {
+        if (capacity > m_capacity) {
+            m_storage.resize(capacity * sizeof(T));
+            m_capacity = capacity;
+        }
+    }
+
+    void push_back(const T& value)
+    {
+        if (m_size == m_capacity) {
+            reserve(std::max<size_t>(16, m_capacity * 2));
+        }
+        new (data() + m_size) T(value);
+        ++m_size;
+    }
+
+    template <typename It>
+    void assign(It first, It last)
+    {
+        clear();
+        reserve(std::distance(first, last));
+        for (; first != last; ++first) {
+            push_back(*first);
+        }
+    }
+
+    /// new elements get value initialized
+    void resize(size_t size)
+    {
+        if (size > m_capacity) {
+            reserve(std::max(size, m_capacity * 2));
+        }
+        std::fill(data() + std::min(size, m_size), data() + size, T());
+        m_size = size;
+    }
+
+    T* erase(T* first, T* last)
+    {
+        std::copy(last, end(), first);
+        m_size -= last - first;
+        return first;
+    }
+
+    void clear()
+    {
+        m_size = 0;
+    }
+
+    T& operator[](size_t index)
+    {
+        return data()[index];
+    }
+
+    const T& operator[](size_t index) const
+    {
+        return data()[index];
+    }
+
+    T& back()
+    {
+        return data()[m_size - 1];
+    }
+
+    const T& back() const
+    {
+        return data()[m_size - 1];
+    }
+
+    T* begin()
+    {
+        return data();
+    }
+
+    T* end()
+    {
+        return data() + m_size;
+    }
+
+    const T* begin() const
+    {
+        return data();
+    }
+
+    const T* end() const
+    {
+        return data() + m_size;
+    }
+
+    bool spill(const std::string& directory)
+    {
+        return m_storage.spill(directory, m_size * sizeof(T));
+    }
+
+    void dropResidentPages()
+    {
+        m_storage.dropResidentPages();
+    }
+
+private:
+    T* data() const
+    {
+        return static_cast<T*>(m_storage.data());
+    }
+
+    ScratchStorage m_storage;
+    size_t m_size = 0;
+    size_t m_capacity = 0;
+};
+
+#endif // SCRATCHVECTOR_H
@@ -0,0 +1,1024 @@
+/*
+    SPDX-FileCopyrightText: 2026 Milian Wolff <mail@milianw.de>
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+/**
+ * @file heaptrack_serve.cpp
+ *
+ * @brief Keep heaptrack data files loaded and answer queries about them over a local socket.
+ *
+ * Every request is a single line holding a flat JSON object, which gets answered with a single
+ * line of JSON. The data files only get parsed once at startup, such that reports that get drawn
+ * over and over from the same large recordings don't have to pay for that every time.
+ */
+
+#include <boost/program_options.hpp>
+
+#include "analyze/accumulatedtracedata.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <future>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <tsl/robin_map.h>
+#include <tsl/robin_set.h>
+
+#include "util/config.h"
+
+using namespace std;
+namespace po = boost::program_options;
+
+namespace {
+
+enum CostType
+{
+    Allocations,
+    Temporary,
+    Leaked,
+    Peak,
+    PeakMapped,
+    Copied,
+    Slack,
+    RemoteFrees,
+    Pinned
+};
+
+int64_t costOf(const AllocationData& data, CostType type)
+{
+    switch (type) {
+    case Allocations:
+        return data.allocations;
+    case Temporary:
+        return data.temporary;
+    case Leaked:
+        return data.leaked;
+    case Peak:
+        return data.peak;
+    case PeakMapped:
+        return data.peakMapped;
+    case Copied:
+        return data.copied;
+    case Slack:
+        return data.slack;
+    case RemoteFrees:
+        return data.remoteFrees;
+    case Pinned:
+        return data.pinned;
+    }
+    return 0;
+}
+
+/// a request that cannot be answered, its message gets sent back to the client
+struct QueryError
+{
+    string message;
+};
+
+/**
+ * Writes JSON with a single line, such that clients can split the responses at the newlines.
+ */
+class JsonWriter
+{
+public:
+    void beginObject(const char* key = nullptr)
+    {
+        open(key, '{');
+    }
+
+    void endObject()
+    {
+        close('}');
+    }
+
+    void beginArray(const char* key = nullptr)
+    {
+        open(key, '[');
+    }
+
+    void endArray()
+    {
+        close(']');
+    }
+
+    void number(const char* key, int64_t value)
+    {
+        this->key(key);
+        m_data += to_string(value);
+    }
+
+    void string(const char* key, boost::string_view value)
+    {
+        this->key(key);
+        quoted(value);
+    }
+
+    void boolean(const char* key, bool value)
+    {
+        this->key(key);
+        m_data += value ? "true" : "false";
+    }
+
+    std::string take()
+    {
+        m_data += '\n';
+        return std::move(m_data);
+    }
+
+private:
+    void key(const char* key)
+    {
+        if (m_needsComma) {
+            m_data += ',';
+        }
+        m_needsComma = true;
+        if (key) {
+            quoted(key);
+            m_data += ':';
+        }
+    }
+
+    void open(const char* key, char bracket)
+    {
+        this->key(key);
+        m_data += bracket;
+        m_needsComma = false;
+    }
+
+    void close(char bracket)
+    {
+        m_data += bracket;
+        m_needsComma = true;
+    }
+
+    void quoted(boost::string_view value)
+    {
+        m_data += '"';
+        for (const auto c : value) {
+            if (c == '"' || c == '\\') {
+                m_data += '\\';
+                m_data += c;
+            } else if (static_cast<unsigned char>(c) < 0x20) {
+                char escaped[8];
+                snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned>(c));
+                m_data += escaped;
+            } else {
+                m_data += c;
+            }
+        }
+        m_data += '"';
+    }
+
+    std::string m_data;
+    bool m_needsComma = false;
+};
+
+/**
+ * The members of a request, which must be a flat JSON object.
+ *
+ * Numbers and literals are kept in their textual form and get converted when they are used.
+ */
+class Request
+{
+public:
+    explicit Request(boost::string_view line)
+        : m_it(line.begin())
+        , m_end(line.end())
+    {
+        skipSpace();
+        expect('{');
+        skipSpace();
+        if (peek() == '}') {
+            ++m_it;
+        } else {
+            while (true) {
+                skipSpace();
+                auto key = parseString();
+                skipSpace();
+                expect(':');
+                skipSpace();
+                m_members[std::move(key)] = peek() == '"' ? parseString() : parseLiteral();
+                skipSpace();
+                if (peek() == '}') {
+                    ++m_it;
+                    break;
+                }
+                expect(',');
+            }
+        }
+        skipSpace();
+        if (m_it != m_end) {
+            throw QueryError {"unexpected data after the request object"};
+        }
+    }
+
+    string text(const char* key, const char* defaultValue = nullptr) const
+    {
+        const auto it = m_members.find(key);
+        if (it != m_members.end()) {
+            return it->second;
+        }
+        if (!defaultValue) {
+            throw QueryError {string("missing member \"") + key + '"'};
+        }
+        return defaultValue;
+    }
+
+    int64_t number(const char* key, int64_t defaultValue) const
+    {
+        const auto it = m_members.find(key);
+        if (it == m_members.end()) {
+            return defaultValue;
+        }
+        char* end = nullptr;
+        errno = 0;
+        const auto value = strtoll(it->second.c_str(), &end, 10);
+        if (errno || it->second.empty() || *end) {
+            throw QueryError {string("member \"") + key + "\" is no integer"};
+        }
+        return value;
+    }
+
+    CostType costType() const
+    {
+        const auto name = text("cost", "peak");
+        if (name == "allocations")
+            return Allocations;
+        else if (name == "temporary")
+            return Temporary;
+        else if (name == "leaked")
+            return Leaked;
+        else if (name == "peak")
+            return Peak;
+        else if (name == "peak-mapped")
+            return PeakMapped;
+        else if (name == "copied")
+            return Copied;
+        else if (name == "slack")
+            return Slack;
+        else if (name == "remote-frees")
+            return RemoteFrees;
+        else if (name == "pinned")
+            return Pinned;
+        throw QueryError {"unknown cost type \"" + name + '"'};
+    }
+
+private:
+    char peek() const
+    {
+        if (m_it == m_end) {
+            throw QueryError {"unexpected end of the request"};
+        }
+        return *m_it;
+    }
+
+    void expect(char c)
+    {
+        if (peek() != c) {
+            throw QueryError {string("expected '") + c + "' in the request"};
+        }
+        ++m_it;
+    }
+
+    void skipSpace()
+    {
+        while (m_it != m_end && (*m_it == ' ' || *m_it == '\t' || *m_it == '\r')) {
+            ++m_it;
+        }
+    }
+
+    string parseString()
+    {
+        expect('"');
+        string ret;
+        while (peek() != '"') {
+            auto c = *m_it++;
+            if (c != '\\') {
+                ret += c;
+                continue;
+            }
+            c = peek();
+            ++m_it;
+            switch (c) {
+            case 'b':
+                ret += '\b';
+                break;
+            case 'f':
+                ret += '\f';
+                break;
+            case 'n':
+                ret += '\n';
+                break;
+            case 'r':
+                ret += '\r';
+                break;
+            case 't':
+                ret += '\t';
+                break;
+            case 'u':
+                appendCodePoint(&ret);
+                break;
+            default:
+                // covers the quote, the backslash and the slash
+                ret += c;
+                break;
+            }
+        }
+        ++m_it;
+        return ret;
+    }
+
+    void appendCodePoint(string* out)
+    {
+        if (m_end - m_it < 4) {
+            throw QueryError {"incomplete \\u escape in the request"};
+        }
+        const string digits(m_it, m_it + 4);
+        m_it += 4;
+        char* end = nullptr;
+        const auto code = strtoul(digits.c_str(), &end, 16);
+        if (*end) {
+            throw QueryError {"invalid \\u escape in the request"};
+        }
+        // UTF-8 encoding of the basic multilingual plane, which is all that function names need
+        if (code < 0x80) {
+            *out += static_cast<char>(code);
+        } else if (code < 0x800) {
+            *out += static_cast<char>(0xc0 | (code >> 6));
+            *out += static_cast<char>(0x80 | (code & 0x3f));
+        } else {
+            *out += static_cast<char>(0xe0 | (code >> 12));
+            *out += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+            *out += static_cast<char>(0x80 | (code & 0x3f));
+        }
+    }
+
+    string parseLiteral()
+    {
+        const auto begin = m_it;
+        while (m_it != m_end && (isalnum(static_cast<unsigned char>(*m_it)) || *m_it == '-' || *m_it == '+'
+                                 || *m_it == '.')) {
+            ++m_it;
+        }
+        if (begin == m_it) {
+            throw QueryError {"only strings, numbers and literals are supported as request values"};
+        }
+        return string(begin, m_it);
+    }
+
+    boost::string_view::const_iterator m_it;
+    boost::string_view::const_iterator m_end;
+    map<string, string> m_members;
+};
+
+struct Recording final : public AccumulatedTraceData
+{
+    /// the allocations of all traces that end in the same code location, see heaptrack_print
+    struct Location
+    {
+        IpIndex ipIndex;
+        AllocationData cost;
+        // indices into allocations
+        vector<uint32_t> allocations;
+    };
+
+    /// the total costs at a time stamp record
+    struct TimelineSample
+    {
+        int64_t timeStamp;
+        int64_t allocations;
+        int64_t temporary;
+        int64_t consumed;
+    };
+
+    void handleTimeStamp(int64_t /*oldStamp*/, int64_t newStamp, bool /*isFinalTimeStamp*/, ParsePass pass) override
+    {
+        if (pass != ParsePass::FirstPass) {
+            return;
+        }
+        timeline.push_back({newStamp, totalCost.allocations, totalCost.temporary, totalCost.leaked});
+    }
+
+    void handleAllocation(const AllocationInfo& /*info*/, const AllocationInfoIndex /*index*/) override {}
+
+    void handleAllocations(const AllocationInfo& /*info*/, const AllocationInfoIndex /*index*/,
+                           int64_t /*count*/) override
+    {
+    }
+
+    void handleDebuggee(const char* command) override
+    {
+        debuggee = command;
+    }
+
+    /// prepare everything the queries need, such that they only have to sort and select
+    void finalize()
+    {
+        applyLeakSuppressions();
+
+        vector<pair<InstructionPointer, uint32_t>> sorted;
+        sorted.reserve(allocations.size());
+        for (uint32_t i = 0; i < allocations.size(); ++i) {
+            sorted.emplace_back(findIp(findTrace(allocations[i].traceIndex).ipIndex), i);
+        }
+        stable_sort(sorted.begin(), sorted.end(), [](const auto& lhs, const auto& rhs) {
+            return lhs.first.compareWithoutAddress(rhs.first);
+        });
+        for (auto it = sorted.begin(); it != sorted.end();) {
+            auto end = find_if(it + 1, sorted.end(),
+                               [it](const auto& entry) { return !entry.first.equalWithoutAddress(it->first); });
+            Location location;
+            location.ipIndex = findTrace(allocations[it->second].traceIndex).ipIndex;
+            location.allocations.reserve(distance(it, end));
+            for (; it != end; ++it) {
+                location.cost += allocations[it->second];
+                location.allocations.push_back(it->second);
+            }
+            locations.push_back(std::move(location));
+        }
+    }
+
+    /// identifies a location across recordings, ignoring the instruction pointer address
+    string locationKey(const Location& location) const
+    {
+        const auto ip = findIp(location.ipIndex);
+        string key;
+        for (const StringIndex index : {StringIndex(ip.moduleIndex), StringIndex(ip.frame.functionIndex),
+                                        StringIndex(ip.frame.fileIndex)}) {
+            const auto name = index ? stringify(index) : boost::string_view();
+            key.append(name.data(), name.size());
+            key += '\0';
+        }
+        key += to_string(ip.frame.line);
+        return key;
+    }
+
+    void writeFrame(JsonWriter& json, const Frame& frame, const InstructionPointer& ip, bool inlined) const
+    {
+        json.beginObject();
+        if (frame.functionIndex) {
+            json.string("function", prettyFunction(frame.functionIndex));
+        } else {
+            char address[32];
+            snprintf(address, sizeof(address), "0x%llx", static_cast<unsigned long long>(ip.instructionPointer));
+            json.string("function", address);
+        }
+        if (frame.fileIndex) {
+            json.string("file", stringify(frame.fileIndex));
+            json.number("line", frame.line);
+        }
+        json.string("module", ip.moduleIndex ? stringify(ip.moduleIndex) : "??");
+        if (inlined) {
+            json.boolean("inlined", true);
+        }
+        json.endObject();
+    }
+
+    /// write the frames of @p ip, i.e. its own one followed by the inlined ones
+    void writeFrames(JsonWriter& json, const InstructionPointer& ip) const
+    {
+        writeFrame(json, ip.frame, ip, false);
+        for (const auto& inlined : ip.inlined) {
+            writeFrame(json, inlined, ip, true);
+        }
+    }
+
+    void writeBacktrace(JsonWriter& json, TraceIndex traceIndex) const
+    {
+        json.beginArray("frames");
+        tsl::robin_set<TraceIndex> recursionGuard;
+        auto node = findTrace(traceIndex);
+        while (node.ipIndex) {
+            const auto ip = findIp(node.ipIndex);
+            writeFrames(json, ip);
+            if (isStopIndex(ip.frame.functionIndex) || !recursionGuard.insert(node.parentIndex).second) {
+                break;
+            }
+            node = findTrace(node.parentIndex);
+        }
+        json.endArray();
+    }
+
+    /// @return true when a frame of the backtrace of @p traceIndex calls one of @p functions
+    bool callsFunction(TraceIndex traceIndex, const tsl::robin_set<uint32_t>& functions) const
+    {
+        tsl::robin_set<TraceIndex> recursionGuard;
+        auto node = findTrace(traceIndex);
+        while (node.ipIndex) {
+            const auto ip = findIp(node.ipIndex);
+            if (functions.count(ip.frame.functionIndex.index)) {
+                return true;
+            }
+            for (const auto& inlined : ip.inlined) {
+                if (functions.count(inlined.functionIndex.index)) {
+                    return true;
+                }
+            }
+            if (isStopIndex(ip.frame.functionIndex) || !recursionGuard.insert(node.parentIndex).second) {
+                break;
+            }
+            node = findTrace(node.parentIndex);
+        }
+        return false;
+    }
+
+    string debuggee;
+    vector<Location> locations;
+    vector<TimelineSample> timeline;
+};
+
+void writeCost(JsonWriter& json, const AllocationData& cost)
+{
+    json.number("allocations", cost.allocations);
+    json.number("temporary", cost.temporary);
+    json.number("peak", cost.peak);
+    json.number("leaked", cost.leaked);
+    json.number("peakMapped", cost.peakMapped);
+    json.number("growths", cost.growths);
+    json.number("copied", cost.copied);
+    json.number("slack", cost.slack);
+    json.number("remoteFrees", cost.remoteFrees);
+    json.number("pinned", cost.pinned);
+}
+
+/// the indices of the @p limit entries with the highest @p cost, skipping the ones without any
+template <typename Cost>
+vector<size_t> topIndices(size_t count, size_t limit, Cost cost)
+{
+    vector<size_t> indices;
+    indices.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        if (cost(i)) {
+            indices.push_back(i);
+        }
+    }
+    limit = min(limit, indices.size());
+    partial_sort(indices.begin(), indices.begin() + limit, indices.end(),
+                 [&cost](size_t lhs, size_t rhs) { return cost(lhs) > cost(rhs); });
+    indices.resize(limit);
+    return indices;
+}
+
+class Server
+{
+public:
+    Server(vector<string> files, vector<unique_ptr<Recording>> recordings)
+        : m_files(std::move(files))
+        , m_recordings(std::move(recordings))
+    {
+    }
+
+    /// @return the response to the request in @p line
+    string handle(boost::string_view line) const
+    {
+        JsonWriter json;
+        json.beginObject();
+        try {
+            const Request request(line);
+            const auto query = request.text("query");
+            json.string("query", query);
+            if (query == "files") {
+                files(json);
+            } else if (query == "summary") {
+                summary(json, request);
+            } else if (query == "top") {
+                top(json, request);
+            } else if (query == "backtraces") {
+                backtraces(json, request);
+            } else if (query == "timeline") {
+                timeline(json, request);
+            } else if (query == "diff") {
+                diff(json, request);
+            } else {
+                throw QueryError {"unknown query \"" + query + '"'};
+            }
+        } catch (const QueryError& error) {
+            json = {};
+            json.beginObject();
+            json.string("error", error.message);
+        }
+        json.endObject();
+        return json.take();
+    }
+
+private:
+    const Recording& recording(const Request& request, const char* key = "file") const
+    {
+        const auto index = request.number(key, 0);
+        if (index < 0 || static_cast<size_t>(index) >= m_recordings.size()) {
+            throw QueryError {string("member \"") + key + "\" is no index of a loaded file"};
+        }
+        return *m_recordings[index];
+    }
+
+    static size_t limit(const Request& request)
+    {
+        return static_cast<size_t>(max<int64_t>(0, request.number("limit", 10)));
+    }
+
+    void files(JsonWriter& json) const
+    {
+        json.beginArray("files");
+        for (size_t i = 0; i < m_files.size(); ++i) {
+            json.beginObject();
+            json.number("file", i);
+            json.string("path", m_files[i]);
+            json.string("debuggee", m_recordings[i]->debuggee);
+            json.endObject();
+        }
+        json.endArray();
+    }
+
+    void summary(JsonWriter& json, const Request& request) const
+    {
+        const auto& data = recording(request);
+        json.string("debuggee", data.debuggee);
+        json.number("totalTime", data.totalTime);
+        json.number("peakTime", data.peakTime);
+        json.number("peakRSS", data.peakRSS * data.systemInfo.pageSize);
+        json.number("sampleInterval", data.sampleInterval);
+        json.number("suppressedLeaks", data.totalLeakedSuppressed);
+        json.beginObject("total");
+        writeCost(json, data.totalCost);
+        json.endObject();
+    }
+
+    void top(JsonWriter& json, const Request& request) const
+    {
+        const auto& data = recording(request);
+        const auto costType = request.costType();
+        const auto& locations = data.locations;
+        const auto indices = topIndices(locations.size(), limit(request),
+                                        [&](size_t i) { return costOf(locations[i].cost, costType); });
+        json.beginArray("locations");
+        for (const auto i : indices) {
+            const auto& location = locations[i];
+            json.beginObject();
+            writeCost(json, location.cost);
+            json.number("traces", location.allocations.size());
+            json.beginArray("frames");
+            data.writeFrames(json, data.findIp(location.ipIndex));
+            json.endArray();
+            json.endObject();
+        }
+        json.endArray();
+    }
+
+    void backtraces(JsonWriter& json, const Request& request) const
+    {
+        const auto& data = recording(request);
+        const auto costType = request.costType();
+        const auto function = request.text("function");
+
+        // match the strings once instead of every frame of every trace
+        tsl::robin_set<uint32_t> functions;
+        for (uint32_t i = 0; i < data.strings.size(); ++i) {
+            if (data.strings[i].find(function) != boost::string_view::npos) {
+                functions.insert(i + 1);
+            }
+        }
+
+        vector<uint32_t> matches;
+        if (!functions.empty()) {
+            for (uint32_t i = 0; i < data.allocations.size(); ++i) {
+                if (data.callsFunction(data.allocations[i].traceIndex, functions)) {
+                    matches.push_back(i);
+                }
+            }
+        }
+        const auto indices = topIndices(matches.size(), limit(request),
+                                        [&](size_t i) { return costOf(data.allocations[matches[i]], costType); });
+
+        json.number("matches", matches.size());
+        json.beginArray("backtraces");
+        for (const auto i : indices) {
+            const auto& allocation = data.allocations[matches[i]];
+            json.beginObject();
+            writeCost(json, allocation);
+            data.writeBacktrace(json, allocation.traceIndex);
+            json.endObject();
+        }
+        json.endArray();
+    }
+
+    void timeline(JsonWriter& json, const Request& request) const
+    {
+        const auto& data = recording(request);
+        const auto from = request.number("from", 0);
+        const auto to = request.number("to", data.totalTime);
+        if (to < from) {
+            throw QueryError {"the time window ends before it starts"};
+        }
+
+        // the costs at the last samples up to the start and the end of the window
+        const auto& samples = data.timeline;
+        auto sampleAt = [&samples](int64_t time) {
+            return upper_bound(samples.begin(), samples.end(), time,
+                               [](int64_t time, const Recording::TimelineSample& sample) {
+                                   return time < sample.timeStamp;
+                               });
+        };
+        const auto first = sampleAt(from);
+        const auto last = sampleAt(to);
+        const Recording::TimelineSample empty = {0, 0, 0, 0};
+        const auto& start = first == samples.begin() ? empty : *(first - 1);
+        const auto& end = last == samples.begin() ? empty : *(last - 1);
+        auto maxConsumed = start.consumed;
+        for (auto it = first; it != last; ++it) {
+            maxConsumed = max(maxConsumed, it->consumed);
+        }
+
+        json.number("from", from);
+        json.number("to", to);
+        json.number("allocations", end.allocations - start.allocations);
+        json.number("temporary", end.temporary - start.temporary);
+        json.number("consumedAtStart", start.consumed);
+        json.number("consumedAtEnd", end.consumed);
+        json.number("maxConsumed", maxConsumed);
+        json.number("samples", distance(first, last));
+    }
+
+    void diff(JsonWriter& json, const Request& request) const
+    {
+        const auto& data = recording(request);
+        const auto& base = recording(request, "base");
+        const auto costType = request.costType();
+
+        struct Delta
+        {
+            AllocationData cost;
+            const Recording* recording;
+            const Recording::Location* location;
+        };
+        vector<Delta> deltas;
+        deltas.reserve(data.locations.size());
+        tsl::robin_map<string, size_t> indices;
+        for (const auto& location : data.locations) {
+            indices.emplace(data.locationKey(location), deltas.size());
+            deltas.push_back({location.cost, &data, &location});
+        }
+        for (const auto& location : base.locations) {
+            const auto it = indices.find(base.locationKey(location));
+            if (it != indices.end()) {
+                deltas[it->second].cost -= location.cost;
+            } else {
+                deltas.push_back({AllocationData() - location.cost, &base, &location});
+            }
+        }
+
+        const auto top = topIndices(deltas.size(), limit(request),
+                                    [&](size_t i) { return abs(costOf(deltas[i].cost, costType)); });
+        json.beginObject("total");
+        writeCost(json, data.totalCost - base.totalCost);
+        json.endObject();
+        json.beginArray("locations");
+        for (const auto i : top) {
+            const auto& delta = deltas[i];
+            json.beginObject();
+            writeCost(json, delta.cost);
+            json.beginArray("frames");
+            delta.recording->writeFrames(json, delta.recording->findIp(delta.location->ipIndex));
+            json.endArray();
+            json.endObject();
+        }
+        json.endArray();
+    }
+
+    vector<string> m_files;
+    vector<unique_ptr<Recording>> m_recordings;
+};
+
+volatile sig_atomic_t s_stopServing = 0;
+
+int listenOn(const string& path)
+{
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        cerr << "socket path is too long: " << path << endl;
+        return -1;
+    }
+    memcpy(address.sun_path, path.c_str(), path.size());
+
+    // replace the socket of a previous instance, but nothing else
+    struct stat info;
+    if (lstat(path.c_str(), &info) == 0 && S_ISSOCK(info.st_mode)) {
+        unlink(path.c_str());
+    }
+
+    const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1 || bind(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0
+        || listen(fd, 16) != 0) {
+        cerr << "failed to listen on " << path << ": " << strerror(errno) << endl;
+        if (fd != -1) {
+            close(fd);
+        }
+        return -1;
+    }
+    return fd;
+}
+
+bool sendAll(int fd, const string& data)
+{
+    size_t sent = 0;
+    while (sent < data.size()) {
+        const auto ret = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        sent += ret;
+    }
+    return true;
+}
+
+/// answer the requests of all clients until we get interrupted
+void serve(const Server& server, int listenFd)
+{
+    // a request is never this large, drop clients that send garbage
+    const size_t maxRequestSize = 1024 * 1024;
+
+    struct Client
+    {
+        int fd;
+        string input;
+    };
+    vector<Client> clients;
+    vector<pollfd> fds;
+    while (!s_stopServing) {
+        fds.clear();
+        fds.push_back({listenFd, POLLIN, 0});
+        for (const auto& client : clients) {
+            fds.push_back({client.fd, POLLIN, 0});
+        }
+        if (poll(fds.data(), fds.size(), -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            cerr << "failed to wait for requests: " << strerror(errno) << endl;
+            break;
+        }
+
+        for (size_t i = 0; i < clients.size(); ++i) {
+            if (!fds[i + 1].revents) {
+                continue;
+            }
+            auto& client = clients[i];
+            char buffer[64 * 1024];
+            const auto size = read(client.fd, buffer, sizeof(buffer));
+            bool ok = size > 0 || (size < 0 && errno == EINTR);
+            if (size > 0) {
+                client.input.append(buffer, size);
+                size_t lineStart = 0;
+                size_t newline = 0;
+                while (ok && (newline = client.input.find('\n', lineStart)) != string::npos) {
+                    const boost::string_view line(client.input.data() + lineStart, newline - lineStart);
+                    if (line.find_first_not_of(" \t\r") != boost::string_view::npos) {
+                        ok = sendAll(client.fd, server.handle(line));
+                    }
+                    lineStart = newline + 1;
+                }
+                client.input.erase(0, lineStart);
+                ok = ok && client.input.size() < maxRequestSize;
+            }
+            if (!ok) {
+                close(client.fd);
+                client.fd = -1;
+            }
+        }
+        clients.erase(remove_if(clients.begin(), clients.end(), [](const Client& client) { return client.fd == -1; }),
+                      clients.end());
+
+        if (fds[0].revents & POLLIN) {
+            const int fd = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd != -1) {
+                clients.push_back({fd, {}});
+            }
+        }
+    }
+
+    for (const auto& client : clients) {
+        close(client.fd);
+    }
+}
+}
+
+int main(int argc, char** argv)
+{
+    po::options_description desc("Options", 120, 60);
+    // clang-format off
+    desc.add_options()
+        ("file,f", po::value<vector<string>>()->multitoken(),
+            "The heaptrack data files to load, they are referred to by their index in the requests.")
+        ("socket", po::value<string>(),
+            "Path of the local socket to listen on for requests.")
+        ("shorten-templates,t", po::value<bool>()->default_value(true)->implicit_value(true),
+            "Shorten template identifiers.")
+        ("memory-budget", po::value<size_t>()->default_value(0),
+            "Limit the resident memory of every loaded file to the given number of MiB, see heaptrack_print.")
+        ("scratch-directory", po::value<string>()->default_value({}),
+            "Directory for the scratch files of --memory-budget, defaults to $TMPDIR or /tmp.")
+        ("help,h", "Show this help message.")
+        ("version,v", "Displays version information.");
+    // clang-format on
+    po::positional_options_description p;
+    p.add("file", -1);
+
+    po::variables_map vm;
+    try {
+        po::store(po::command_line_parser(argc, argv).options(desc).positional(p).run(), vm);
+        if (vm.count("help")) {
+            cout << "heaptrack_serve - answer queries about heaptrack data files.\n"
+                 << "\n"
+                 << "The data files get loaded once, then every line sent to the socket is a request\n"
+                 << "in the form of a flat JSON object, which gets answered by a line of JSON:\n\n"
+                 << "  {\"query\": \"files\"}\n"
+                 << "  {\"query\": \"summary\", \"file\": 0}\n"
+                 << "  {\"query\": \"top\", \"file\": 0, \"cost\": \"peak\", \"limit\": 10}\n"
+                 << "  {\"query\": \"backtraces\", \"file\": 0, \"function\": \"parse\", \"cost\": \"leaked\"}\n"
+                 << "  {\"query\": \"timeline\", \"file\": 0, \"from\": 1000, \"to\": 5000}\n"
+                 << "  {\"query\": \"diff\", \"file\": 1, \"base\": 0, \"cost\": \"allocations\"}\n\n"
+                 << "The cost is one of allocations, temporary, leaked, peak, peak-mapped, copied, slack,\n"
+                 << "remote-frees or pinned, the times are given in milliseconds. Failed requests get answered with an\n"
+                 << "\"error\" member.\n\n"
+                 << desc << endl;
+            return 0;
+        } else if (vm.count("version")) {
+            cout << "heaptrack_serve " << HEAPTRACK_VERSION_STRING << endl;
+            return 0;
+        }
+        po::notify(vm);
+    } catch (const po::error& error) {
+        cerr << "ERROR: " << error.what() << endl << endl << desc << endl;
+        return 1;
+    }
+
+    if (!vm.count("file") || !vm.count("socket")) {
+        cerr << "ERROR: the options '--file' and '--socket' are required\n\n" << desc << endl;
+        return 1;
+    }
+    const auto files = vm["file"].as<vector<string>>();
+
+    cout << "reading " << files.size() << " files - please wait, this might take some time..." << endl;
+    vector<unique_ptr<Recording>> recordings;
+    vector<future<bool>> reads;
+    for (const auto& file : files) {
+        recordings.emplace_back(new Recording);
+        auto& recording = *recordings.back();
+        recording.shortenTemplates = vm["shorten-templates"].as<bool>();
+        recording.memoryBudget = static_cast<int64_t>(vm["memory-budget"].as<size_t>()) * 1024 * 1024;
+        recording.scratchDirectory = vm["scratch-directory"].as<string>();
+        reads.push_back(async(launch::async, [&recording, file]() {
+            if (!recording.read(file, false)) {
+                return false;
+            }
+            recording.finalize();
+            return true;
+        }));
+    }
+    bool ok = true;
+    for (auto& read : reads) {
+        ok = read.get() && ok;
+    }
+    if (!ok) {
+        return 1;
+    }
+
+    const auto socketPath = vm["socket"].as<string>();
+    const int listenFd = listenOn(socketPath);
+    if (listenFd == -1) {
+        return 1;
+    }
+
+    // interrupt the poll, i.e. don't restart it
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = [](int) { s_stopServing = 1; };
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+
+    cout << "listening on " << socketPath << endl;
+    serve(Server(files, std::move(recordings)), listenFd);
+
+    close(listenFd);
+    unlink(socketPath.c_str());
+    return 0;
+}
@@ -0,0 +1,101 @@
+/*
+    SPDX-FileCopyrightText: 2026 Milian Wolff <mail@milianw.de>
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#ifndef STRINGTABLE_H
+#define STRINGTABLE_H
+
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include <boost/utility/string_view.hpp>
+
+#include "util/indices.h"
+
+/**
+ * Stores the strings of a data file in a few large blocks instead of separate heap allocations.
+ *
+ * The strings never move once they got added, so the views into them stay valid for the
+ * lifetime of the table. All views are null-terminated.
+ */
+class StringTable
+{
+public:
+    void reserve(size_t count)
+    {
+        m_strings.reserve(count);
+    }
+
+    size_t size() const
+    {
+        return m_strings.size();
+    }
+
+    bool empty() const
+    {
+        return m_strings.empty();
+    }
+
+    /// copy @p string into the table and return its index
+    StringIndex add(boost::string_view string)
+    {
+        const auto size = string.size() + 1;
+        char* data = nullptr;
+        if (size > BLOCK_SIZE / 4) {
+            // large strings get a block of their own, keep filling the current one afterwards
+            m_blocks.emplace_back(new char[size]);
+            data = m_blocks.back().get();
+        } else {
+            if (m_blockFree < size) {
+                m_blocks.emplace_back(new char[BLOCK_SIZE]);
+                m_block = m_blocks.back().get();
+                m_blockFree = BLOCK_SIZE;
+            }
+            data = m_block;
+            m_block += size;
+            m_blockFree -= size;
+        }
+        std::memcpy(data, string.data(), string.size());
+        data[string.size()] = 0;
+        m_strings.emplace_back(data, string.size());
+
+        StringIndex index;
+        index.index = m_strings.size();
+        return index;
+    }
+
+    /// @p index is zero based, unlike StringIndex
+    boost::string_view operator[](size_t index) const
+    {
+        return m_strings[index];
+    }
+
+    boost::string_view back() const
+    {
+        return m_strings.back();
+    }
+
+    /// @return a deep copy, for consumers that must not see the strings that get added later on
+    StringTable copy() const
+    {
+        StringTable table;
+        table.reserve(size());
+        for (const auto& string : m_strings) {
+            table.add(string);
+        }
+        return table;
+    }
+
+private:
+    static constexpr size_t BLOCK_SIZE = 1024 * 1024;
+    std::vector<std::unique_ptr<char[]>> m_blocks;
+    // the free space in the block that small strings get added to
+    char* m_block = nullptr;
+    size_t m_blockFree = 0;
+    std::vector<boost::string_view> m_strings;
+};
+
+#endif // STRINGTABLE_H
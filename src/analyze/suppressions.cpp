@@ -6,11 +6,13 @@
 
 #include "suppressions.h"
 
+#include <algorithm>
 #include <cstring>
 #include <fstream>
 #include <iostream>
 
 #include <boost/algorithm/string/trim.hpp>
+#include <boost/functional/hash.hpp>
 
 namespace {
 std::vector<std::string> parseSuppressionsFile(std::istream& input)
@@ -131,3 +133,193 @@ std::vector<Suppression> builtinSuppressions()
         {"g_thread_self", 0, 0},
     };
 }
+
+namespace {
+constexpr uint32_t NO_SEGMENT = std::numeric_limits<uint32_t>::max();
+constexpr uint32_t NO_OCCURRENCE = std::numeric_limits<uint32_t>::max();
+}
+
+constexpr std::size_t SuppressionMatcher::NO_MATCH;
+
+std::size_t SuppressionMatcher::StringViewHash::operator()(boost::string_view string) const
+{
+    return boost::hash_range(string.begin(), string.end());
+}
+
+SuppressionMatcher::SuppressionMatcher(const std::vector<Suppression>& suppressions)
+    : m_nodes(1)
+{
+    m_patterns.reserve(suppressions.size());
+    m_exactMatches.reserve(suppressions.size());
+
+    // split the patterns into their literal segments, this follows the logic of TemplateMatch
+    for (std::size_t i = 0; i < suppressions.size(); ++i) {
+        const boost::string_view templ(suppressions[i].pattern.c_str());
+        m_exactMatches.emplace(templ.to_string(), i);
+
+        Pattern pattern;
+        size_t pos = 0;
+        bool start = false;
+        if (!templ.empty() && templ[0] == '^') {
+            start = true;
+            ++pos;
+        }
+        bool asterisk = false;
+        while (pos < templ.size()) {
+            if (templ[pos] == '*') {
+                ++pos;
+                start = false;
+                asterisk = true;
+                continue;
+            }
+            if (templ[pos] == '$') {
+                // anything after the first '$' gets ignored
+                pattern.endAnchor = true;
+                pattern.endAfterAsterisk = asterisk;
+                break;
+            }
+            const auto end = std::min(templ.find_first_of("*$", pos), templ.size());
+            pattern.segments.push_back({addSegment(templ.substr(pos, end - pos)), start});
+            pos = end;
+            start = false;
+            asterisk = false;
+        }
+        m_patterns.push_back(std::move(pattern));
+    }
+
+    // compute the fail and output links in breadth-first order
+    std::vector<uint32_t> queue;
+    queue.reserve(m_nodes.size());
+    for (const auto& child : m_nodes[0].children) {
+        queue.push_back(child.second);
+    }
+    for (size_t i = 0; i < queue.size(); ++i) {
+        const auto parent = queue[i];
+        for (const auto& child : m_nodes[parent].children) {
+            auto& node = m_nodes[child.second];
+            node.fail = next(m_nodes[parent].fail, child.first);
+            const auto& fail = m_nodes[node.fail];
+            node.output = fail.segment != NO_SEGMENT ? node.fail : fail.output;
+            queue.push_back(child.second);
+        }
+    }
+
+    m_firstOccurrence.assign(m_segmentLengths.size(), NO_OCCURRENCE);
+    m_lastOccurrence.assign(m_segmentLengths.size(), NO_OCCURRENCE);
+}
+
+uint32_t SuppressionMatcher::addSegment(boost::string_view segment)
+{
+    uint32_t node = 0;
+    for (const auto c : segment) {
+        auto next = child(node, c);
+        if (!next) {
+            next = m_nodes.size();
+            m_nodes.push_back({});
+            m_nodes[node].children.emplace_back(c, next);
+            if (!node) {
+                m_rootChildren[static_cast<unsigned char>(c)] = next;
+            }
+        }
+        node = next;
+    }
+    if (m_nodes[node].segment == NO_SEGMENT) {
+        m_nodes[node].segment = m_segmentLengths.size();
+        m_segmentLengths.push_back(segment.size());
+    }
+    return m_nodes[node].segment;
+}
+
+uint32_t SuppressionMatcher::child(uint32_t node, char c) const
+{
+    if (!node) {
+        return m_rootChildren[static_cast<unsigned char>(c)];
+    }
+    for (const auto& child : m_nodes[node].children) {
+        if (child.first == c) {
+            return child.second;
+        }
+    }
+    return 0;
+}
+
+uint32_t SuppressionMatcher::next(uint32_t node, char c) const
+{
+    while (true) {
+        if (const auto next = child(node, c)) {
+            return next;
+        } else if (!node) {
+            return 0;
+        }
+        node = m_nodes[node].fail;
+    }
+}
+
+bool SuppressionMatcher::matches(const Pattern& pattern, size_t size) const
+{
+    // like TemplateMatch, find the leftmost occurrence of every segment after the previous one
+    size_t pos = 0;
+    for (const auto& segment : pattern.segments) {
+        auto occurrence = m_firstOccurrence[segment.id];
+        while (occurrence != NO_OCCURRENCE && m_occurrences[occurrence].start < pos) {
+            occurrence = m_occurrences[occurrence].next;
+        }
+        if (occurrence == NO_OCCURRENCE) {
+            return false;
+        }
+        const auto start = m_occurrences[occurrence].start;
+        if (segment.anchored && start != 0) {
+            return false;
+        }
+        pos = start + m_segmentLengths[segment.id];
+    }
+    if (pattern.endAnchor) {
+        return pos == size || pattern.endAfterAsterisk;
+    }
+    return true;
+}
+
+std::size_t SuppressionMatcher::match(boost::string_view haystack)
+{
+    auto it = m_exactMatches.find(haystack);
+    const auto exactMatch = it == m_exactMatches.end() ? NO_MATCH : it->second;
+    if (haystack.empty() || exactMatch == 0) {
+        // TemplateMatch never matches empty strings, and nothing can precede the first suppression
+        return exactMatch;
+    }
+
+    // find all occurrences of all segments in a single pass
+    uint32_t node = 0;
+    for (uint32_t i = 0; i < haystack.size(); ++i) {
+        node = next(node, haystack[i]);
+        for (auto match = m_nodes[node].segment != NO_SEGMENT ? node : m_nodes[node].output; match;
+             match = m_nodes[match].output) {
+            const auto segment = m_nodes[match].segment;
+            const uint32_t occurrence = m_occurrences.size();
+            m_occurrences.push_back({i + 1 - m_segmentLengths[segment], NO_OCCURRENCE});
+            if (m_firstOccurrence[segment] == NO_OCCURRENCE) {
+                m_firstOccurrence[segment] = occurrence;
+                m_touchedSegments.push_back(segment);
+            } else {
+                m_occurrences[m_lastOccurrence[segment]].next = occurrence;
+            }
+            m_lastOccurrence[segment] = occurrence;
+        }
+    }
+
+    auto ret = exactMatch;
+    const auto numPatterns = std::min(exactMatch, m_patterns.size());
+    for (std::size_t i = 0; i < numPatterns; ++i) {
+        if (matches(m_patterns[i], haystack.size())) {
+            ret = i;
+            break;
+        }
+    }
+
+    for (const auto segment : m_touchedSegments) {
+        m_firstOccurrence[segment] = NO_OCCURRENCE;
+    }
+    m_touchedSegments.clear();
+    m_occurrences.clear();
+    return ret;
+}
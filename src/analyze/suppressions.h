@@ -7,9 +7,15 @@
 #ifndef SUPPRESSIONS_H
 #define SUPPRESSIONS_H
 
+#include <cstdint>
+#include <limits>
 #include <string>
 #include <vector>
 
+#include <boost/utility/string_view.hpp>
+
+#include <tsl/robin_map.h>
+
 std::string parseSuppression(std::string line);
 std::vector<std::string> parseSuppressions(const std::string& suppressionFile, bool* ok);
 bool matchesSuppression(const std::string& suppression, const std::string& haystack);
@@ -23,4 +29,87 @@ struct Suppression
 
 std::vector<Suppression> builtinSuppressions();
 
+/**
+ * Matches strings against many suppressions at once.
+ *
+ * The literal segments between the wildcards of all suppressions get compiled into a single
+ * Aho-Corasick automaton, such that every string only needs to be scanned once.
+ * The results are the same as checking matchesSuppression for every suppression in turn.
+ */
+class SuppressionMatcher
+{
+public:
+    static constexpr std::size_t NO_MATCH = std::numeric_limits<std::size_t>::max();
+
+    explicit SuppressionMatcher(const std::vector<Suppression>& suppressions);
+
+    /// @return the index of the first suppression that matches @p haystack, or NO_MATCH
+    std::size_t match(boost::string_view haystack);
+
+private:
+    struct Node
+    {
+        std::vector<std::pair<char, uint32_t>> children;
+        uint32_t fail = 0;
+        // the next node along the fail links that ends a segment
+        uint32_t output = 0;
+        // the segment that ends in this node, if any
+        uint32_t segment = std::numeric_limits<uint32_t>::max();
+    };
+
+    struct Segment
+    {
+        uint32_t id;
+        // the segment must start at the beginning of the string, i.e. it followed '^'
+        bool anchored;
+    };
+
+    struct Pattern
+    {
+        std::vector<Segment> segments;
+        // the pattern got terminated by a '$'
+        bool endAnchor = false;
+        // the '$' directly followed a '*'
+        bool endAfterAsterisk = false;
+    };
+
+    // allows looking up the exact matches without allocating a std::string
+    struct StringViewHash
+    {
+        using is_transparent = void;
+        std::size_t operator()(boost::string_view string) const;
+    };
+    struct StringViewEqual
+    {
+        using is_transparent = void;
+        bool operator()(boost::string_view lhs, boost::string_view rhs) const
+        {
+            return lhs == rhs;
+        }
+    };
+
+    uint32_t addSegment(boost::string_view segment);
+    uint32_t child(uint32_t node, char c) const;
+    uint32_t next(uint32_t node, char c) const;
+    bool matches(const Pattern& pattern, size_t size) const;
+
+    std::vector<Node> m_nodes;
+    // the children of the root node, most characters of a string get looked up there
+    uint32_t m_rootChildren[256] = {};
+    std::vector<uint32_t> m_segmentLengths;
+    std::vector<Pattern> m_patterns;
+    tsl::robin_map<std::string, std::size_t, StringViewHash, StringViewEqual> m_exactMatches;
+
+    // scratch space for match, occurrences of a segment form a linked list in increasing order
+    struct Occurrence
+    {
+        uint32_t start;
+        uint32_t next;
+    };
+    std::vector<Occurrence> m_occurrences;
+    std::vector<uint32_t> m_firstOccurrence;
+    std::vector<uint32_t> m_lastOccurrence;
+    std::vector<uint32_t> m_touchedSegments;
+};
+
 #endif // SUPPRESSIONS_H
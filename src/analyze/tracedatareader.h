@@ -0,0 +1,72 @@
+/*
+    SPDX-FileCopyrightText: 2026 Milian Wolff <mail@milianw.de>
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#ifndef TRACEDATAREADER_H
+#define TRACEDATAREADER_H
+
+#include <functional>
+
+#include "accumulatedtracedata.h"
+
+/**
+ * Reads heaptrack data files and forwards the parsing events to callbacks, such that custom
+ * tools don't need to subclass AccumulatedTraceData. This is the entry point of libheaptrack_analyze.
+ *
+ * A check that only needs the totals can look like this:
+ *
+ * @code
+ * TraceDataReader reader;
+ * reader.materializedTables = 0;
+ * reader.setRecordCallback('R', [](boost::string_view line) { ... });
+ * if (reader.read(file, false) && reader.totalCost.peak > limit) { ... }
+ * @endcode
+ */
+class TraceDataReader : public AccumulatedTraceData
+{
+public:
+    std::function<void(int64_t oldStamp, int64_t newStamp, bool isFinalTimeStamp, ParsePass pass)> onTimeStamp;
+    std::function<void(const AllocationInfo& info, AllocationInfoIndex index)> onAllocation;
+    std::function<void(const AllocationInfo& info, AllocationInfoIndex index, int64_t lifetime)> onDeallocation;
+    std::function<void(const char* command)> onDebuggee;
+    std::function<void()> onFollowUpdate;
+
+    void handleTimeStamp(int64_t oldStamp, int64_t newStamp, bool isFinalTimeStamp, const ParsePass pass) override
+    {
+        if (onTimeStamp) {
+            onTimeStamp(oldStamp, newStamp, isFinalTimeStamp, pass);
+        }
+    }
+
+    void handleAllocation(const AllocationInfo& info, const AllocationInfoIndex index) override
+    {
+        if (onAllocation) {
+            onAllocation(info, index);
+        }
+    }
+
+    void handleDeallocation(const AllocationInfo& info, const AllocationInfoIndex index, int64_t lifetime) override
+    {
+        if (onDeallocation) {
+            onDeallocation(info, index, lifetime);
+        }
+    }
+
+    void handleDebuggee(const char* command) override
+    {
+        if (onDebuggee) {
+            onDebuggee(command);
+        }
+    }
+
+    void handleFollowUpdate() override
+    {
+        if (onFollowUpdate) {
+            onFollowUpdate();
+        }
+    }
+};
+
+#endif // TRACEDATAREADER_H
@@ -0,0 +1,176 @@
+/*
+    SPDX-FileCopyrightText: 2026 Milian Wolff <mail@milianw.de>
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include "debuginfodfetcher.h"
+
+#include "symbolizer.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <thread>
+
+#include <dlfcn.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/// the parts of debuginfod.h we use, resolved at runtime
+struct DebuginfodFetcher::Api
+{
+    using Begin = void* (*)();
+    using FindDebuginfo = int (*)(void* client, const unsigned char* buildId, int buildIdLength, char** path);
+
+    /// @return nullptr unless debuginfod is configured and the library is available
+    static const Api* load();
+
+    Begin begin = nullptr;
+    FindDebuginfo findDebuginfo = nullptr;
+};
+
+const DebuginfodFetcher::Api* DebuginfodFetcher::Api::load()
+{
+    const auto urls = getenv("DEBUGINFOD_URLS");
+    if (!urls || !urls[0]) {
+        return nullptr;
+    }
+    auto library = dlopen("libdebuginfod.so.1", RTLD_NOW | RTLD_LOCAL);
+    if (!library) {
+        return nullptr;
+    }
+    auto api = new Api;
+    api->begin = reinterpret_cast<Begin>(dlsym(library, "debuginfod_begin"));
+    api->findDebuginfo = reinterpret_cast<FindDebuginfo>(dlsym(library, "debuginfod_find_debuginfo"));
+    if (!api->begin || !api->findDebuginfo) {
+        delete api;
+        dlclose(library);
+        return nullptr;
+    }
+    return api;
+}
+
+DebuginfodFetcher* DebuginfodFetcher::instance()
+{
+    // never destroyed, the downloads may still be running when we exit
+    static DebuginfodFetcher* fetcher = []() -> DebuginfodFetcher* {
+        const auto api = Api::load();
+        if (!api) {
+            return nullptr;
+        }
+        // the downloads mostly wait for the network, so use more threads than we have cores
+        unsigned numThreads = 4;
+        if (const auto threadsEnv = getenv("HEAPTRACK_DEBUGINFOD_THREADS")) {
+            numThreads = std::max(1ul, strtoul(threadsEnv, nullptr, 10));
+        }
+        return new DebuginfodFetcher(api, numThreads);
+    }();
+    return fetcher;
+}
+
+DebuginfodFetcher::DebuginfodFetcher(const Api* api, unsigned numThreads)
+    : m_api(api)
+{
+    for (unsigned i = 0; i < numThreads; ++i) {
+        std::thread(&DebuginfodFetcher::run, this).detach();
+    }
+}
+
+void DebuginfodFetcher::prefetch(const std::string& fileName, const std::string& buildId)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (buildId.empty()) {
+            // the thread that reads the build-id checks whether we know it already
+            m_requests.push_back({fileName, {}});
+        } else if (!m_results.count(buildId)) {
+            m_results[buildId] = {};
+            m_requests.push_back({fileName, buildId});
+        }
+    }
+    m_requestAvailable.notify_one();
+}
+
+std::string DebuginfodFetcher::debugFile(const std::string& buildId)
+{
+    if (buildId.empty()) {
+        return {};
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    // someone is waiting for this one now, so it goes first
+    auto queued = std::find_if(m_requests.begin(), m_requests.end(),
+                               [&buildId](const Request& request) { return request.buildId == buildId; });
+    if (queued != m_requests.end()) {
+        auto request = std::move(*queued);
+        m_requests.erase(queued);
+        m_requests.push_front(std::move(request));
+    } else if (!m_results.count(buildId)) {
+        m_results[buildId] = {};
+        m_requests.push_front({{}, buildId});
+        m_requestAvailable.notify_one();
+    }
+    // the results move when new ones get added, so look them up again after waiting
+    m_resultAvailable.wait(lock, [this, &buildId]() { return m_results.find(buildId)->second.done; });
+    return m_results.find(buildId)->second.path;
+}
+
+void DebuginfodFetcher::run()
+{
+    // the clients must not be shared between threads
+    auto client = m_api->begin();
+
+    while (true) {
+        Request request;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_requestAvailable.wait(lock, [this]() { return !m_requests.empty(); });
+            request = std::move(m_requests.front());
+            m_requests.pop_front();
+        }
+
+        // the requests with a build-id got a pending result when they were queued
+        if (request.buildId.empty()) {
+            request.buildId = elfBuildId(request.fileName);
+            if (request.buildId.empty()) {
+                continue;
+            }
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_results.count(request.buildId)) {
+                continue;
+            }
+            m_results[request.buildId] = {};
+        }
+
+        auto path = client ? fetch(request.buildId, client) : std::string();
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_results[request.buildId] = {true, std::move(path)};
+        }
+        m_resultAvailable.notify_all();
+    }
+}
+
+std::string DebuginfodFetcher::fetch(const std::string& buildId, void* client) const
+{
+    // prefer the debug information that is installed locally
+    if (buildId.size() > 2) {
+        const auto localFile = "/usr/lib/debug/.build-id/" + buildId.substr(0, 2) + '/' + buildId.substr(2) + ".debug";
+        struct stat info;
+        if (stat(localFile.c_str(), &info) == 0 && S_ISREG(info.st_mode)) {
+            return localFile;
+        }
+    }
+
+    char* path = nullptr;
+    // a length of zero means the build-id is hex encoded
+    const auto fd = m_api->findDebuginfo(client, reinterpret_cast<const unsigned char*>(buildId.c_str()), 0, &path);
+    if (fd < 0) {
+        return {};
+    }
+    close(fd);
+    std::string ret = path ? path : "";
+    free(path);
+    return ret;
+}
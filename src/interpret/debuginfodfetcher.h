@@ -0,0 +1,82 @@
+/*
+    SPDX-FileCopyrightText: 2026 Milian Wolff <mail@milianw.de>
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#ifndef DEBUGINFODFETCHER_H
+#define DEBUGINFODFETCHER_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+
+#include <tsl/robin_map.h>
+
+/**
+ * Downloads the debug information of modules from debuginfod servers in the background.
+ *
+ * The modules get queued as soon as we learn about them, and a few threads fetch them in
+ * parallel, such that a single slow download does not delay the others. libdebuginfod keeps
+ * the downloaded files in its own cache, see $DEBUGINFOD_CACHE_PATH, so later runs find them
+ * right away. The library is loaded at runtime, heaptrack does not depend on it.
+ */
+class DebuginfodFetcher
+{
+public:
+    /**
+     * @return the fetcher shared by all symbolizers, or nullptr unless $DEBUGINFOD_URLS is set
+     * and libdebuginfod is available
+     *
+     * The number of parallel downloads is taken from $HEAPTRACK_DEBUGINFOD_THREADS.
+     */
+    static DebuginfodFetcher* instance();
+
+    DebuginfodFetcher(const DebuginfodFetcher&) = delete;
+    DebuginfodFetcher& operator=(const DebuginfodFetcher&) = delete;
+
+    /**
+     * Start fetching the debug information of the module @p fileName in the background.
+     *
+     * The hex encoded @p buildId is read from the file when it is empty.
+     */
+    void prefetch(const std::string& fileName, const std::string& buildId);
+
+    /**
+     * Wait until the debug information for the hex encoded @p buildId got fetched.
+     *
+     * @return the path of the local file with it, or an empty string when none was found
+     */
+    std::string debugFile(const std::string& buildId);
+
+private:
+    struct Api;
+    /// the threads get detached, such that a hanging download doesn't block the exit
+    DebuginfodFetcher(const Api* api, unsigned numThreads);
+
+    struct Request
+    {
+        std::string fileName;
+        std::string buildId;
+    };
+    struct Result
+    {
+        bool done = false;
+        std::string path;
+    };
+
+    void run();
+    /// @return the path of the debug file for @p buildId
+    std::string fetch(const std::string& buildId, void* client) const;
+
+    const Api* m_api;
+    std::mutex m_mutex;
+    std::condition_variable m_requestAvailable;
+    std::condition_variable m_resultAvailable;
+    std::deque<Request> m_requests;
+    /// indexed by the build-id, the ones that are still being fetched are not done
+    tsl::robin_map<std::string, Result> m_results;
+};
+
+#endif // DEBUGINFODFETCHER_H
@@ -14,6 +14,7 @@
 #include <cxxabi.h>
 
 #include <cstring>
+#include <tuple>
 
 namespace {
 enum class WalkResult
@@ -217,8 +218,9 @@ std::string demangle(const std::string& mangledName)
     if (mangledName.length() < 3) {
         return mangledName;
     } else {
-        static size_t demangleBufferLength = 1024;
-        static char* demangleBuffer = reinterpret_cast<char*>(malloc(demangleBufferLength));
+        // thread local, as we may demangle from multiple symbolizer threads
+        static thread_local size_t demangleBufferLength = 1024;
+        static thread_local char* demangleBuffer = reinterpret_cast<char*>(malloc(demangleBufferLength));
 
         // Require GNU v3 ABI by the "_Z" prefix.
         if (mangledName[0] == '_' && mangledName[1] == 'Z') {
@@ -286,6 +288,45 @@ std::vector<Dwarf_Die> findInlineScopes(Dwarf_Die* subprogram, Dwarf_Addr offset
     return scopes;
 }
 
+void DwarfRangeIndex::add(DwarfRange range, uint32_t index)
+{
+    // empty ranges never contain any address
+    if (range.low < range.high)
+        m_entries.push_back({range.low, range.high, 0, index});
+    m_finalized = false;
+}
+
+void DwarfRangeIndex::finalize()
+{
+    std::sort(m_entries.begin(), m_entries.end(), [](const Entry& lhs, const Entry& rhs) {
+        return std::tie(lhs.low, lhs.index) < std::tie(rhs.low, rhs.index);
+    });
+    Dwarf_Addr maxHigh = 0;
+    for (auto& entry : m_entries) {
+        maxHigh = std::max(maxHigh, entry.high);
+        entry.maxHigh = maxHigh;
+    }
+    m_finalized = true;
+}
+
+uint32_t DwarfRangeIndex::find(Dwarf_Addr addr) const
+{
+    auto it = std::upper_bound(m_entries.begin(), m_entries.end(), addr,
+                               [](Dwarf_Addr addr, const Entry& entry) { return addr < entry.low; });
+
+    // usually the ranges don't overlap and the first entry we look at is the one we want
+    // otherwise continue with the preceding entries, as long as any of them reaches beyond addr
+    uint32_t ret = NOT_FOUND;
+    while (it != m_entries.begin()) {
+        --it;
+        if (it->maxHigh <= addr)
+            break;
+        if (addr < it->high)
+            ret = std::min(ret, it->index);
+    }
+    return ret;
+}
+
 SubProgramDie::SubProgramDie(Dwarf_Die die)
     : m_ranges {die, {}}
 {
@@ -297,6 +338,53 @@ SubProgramDie::SubProgramDie(Dwarf_Die die)
         &die);
 }
 
+uint32_t SubProgramDie::findInlineScope(Dwarf_Addr offset)
+{
+    if (!m_inlineScopeIndex.isFinalized()) {
+        m_inlineScopes.clear();
+        addInlineScopes(die(), DwarfRangeIndex::NOT_FOUND);
+        const auto count = static_cast<uint32_t>(m_inlineScopes.size());
+        for (uint32_t i = 0; i < count; ++i) {
+            // the scopes that contain an address form a chain, the innermost one is the last in pre-order
+            walkRanges(
+                [this, count, i](DwarfRange range) {
+                    m_inlineScopeIndex.add(range, count - 1 - i);
+                    return true;
+                },
+                &m_inlineScopes[i].die);
+        }
+        m_inlineScopeIndex.finalize();
+    }
+
+    const auto index = m_inlineScopeIndex.find(offset);
+    if (index == DwarfRangeIndex::NOT_FOUND)
+        return index;
+    return static_cast<uint32_t>(m_inlineScopes.size()) - 1 - index;
+}
+
+void SubProgramDie::addInlineScopes(Dwarf_Die* die, uint32_t parent)
+{
+    Dwarf_Die childDie;
+    if (dwarf_child(die, &childDie) != 0)
+        return;
+
+    while (true) {
+        if (mayHaveScopes(&childDie)) {
+            auto childParent = parent;
+            if (dwarf_tag(&childDie) == DW_TAG_inlined_subroutine) {
+                childParent = static_cast<uint32_t>(m_inlineScopes.size());
+                m_inlineScopes.push_back({childDie, parent});
+            }
+            addInlineScopes(&childDie, childParent);
+        }
+
+        Dwarf_Die siblingDie;
+        if (dwarf_siblingof(&childDie, &siblingDie) != 0)
+            break;
+        childDie = siblingDie;
+    }
+}
+
 CuDieRangeMapping::CuDieRangeMapping(Dwarf_Die cudie, Dwarf_Addr bias)
     : m_bias {bias}
     , m_cuDieRanges {cudie, {}}
@@ -309,17 +397,44 @@ CuDieRangeMapping::CuDieRangeMapping(Dwarf_Die cudie, Dwarf_Addr bias)
         &cudie);
 }
 
+CuDieRangeMapping::CuDieRangeMapping(Dwarf_Die cudie, Dwarf_Addr bias, const std::vector<DwarfRange>& ranges)
+    : m_bias {bias}
+    , m_cuDieRanges {cudie, {}}
+{
+    m_cuDieRanges.ranges.reserve(ranges.size());
+    for (const auto& range : ranges) {
+        m_cuDieRanges.ranges.push_back({range.low + bias, range.high + bias});
+    }
+}
+
+CuRanges CuDieRangeMapping::cuRanges()
+{
+    CuRanges ret {dwarf_dieoffset(cudie()), {}};
+    ret.ranges.reserve(m_cuDieRanges.ranges.size());
+    for (const auto& range : m_cuDieRanges.ranges) {
+        ret.ranges.push_back({range.low - m_bias, range.high - m_bias});
+    }
+    return ret;
+}
+
 SubProgramDie* CuDieRangeMapping::findSubprogramDie(Dwarf_Addr offset)
 {
     if (m_subPrograms.empty())
         addSubprograms();
 
-    auto it = std::find_if(m_subPrograms.begin(), m_subPrograms.end(),
-                           [offset](const SubProgramDie& program) { return program.contains(offset); });
-    if (it == m_subPrograms.end())
+    if (!m_subProgramIndex.isFinalized()) {
+        for (uint32_t i = 0, c = m_subPrograms.size(); i < c; ++i) {
+            for (const auto& range : m_subPrograms[i].ranges())
+                m_subProgramIndex.add(range, i);
+        }
+        m_subProgramIndex.finalize();
+    }
+
+    const auto index = m_subProgramIndex.find(offset);
+    if (index == DwarfRangeIndex::NOT_FOUND)
         return nullptr;
 
-    return &(*it);
+    return &m_subPrograms[index];
 }
 
 void CuDieRangeMapping::addSubprograms()
@@ -351,6 +466,35 @@ const std::string& CuDieRangeMapping::dieName(Dwarf_Die* die)
     return it->second;
 }
 
+const InlineChain* CuDieRangeMapping::inlineChain(SubProgramDie* subprogram, Dwarf_Addr offset)
+{
+    const auto innermost = subprogram->findInlineScope(offset);
+    if (innermost == DwarfRangeIndex::NOT_FOUND)
+        return nullptr;
+
+    const auto key = dwarf_dieoffset(&subprogram->inlineScope(innermost).die);
+    auto it = m_inlineChainCache.find(key);
+    if (it != m_inlineChainCache.end())
+        return &it->second;
+
+    InlineChain chain;
+    chain.function = dieName(&subprogram->inlineScope(innermost).die);
+
+    Dwarf_Files* files = nullptr;
+    dwarf_getsrcfiles(cudie(), &files, nullptr);
+
+    // the DW_AT_call_{file,line} of every scope points into the enclosing one
+    for (auto index = innermost; index != DwarfRangeIndex::NOT_FOUND;) {
+        auto& scope = subprogram->inlineScope(index);
+        auto* caller = scope.parent == DwarfRangeIndex::NOT_FOUND ? subprogram->die()
+                                                                   : &subprogram->inlineScope(scope.parent).die;
+        chain.calls.push_back({dieName(caller), callSourceLocation(&scope.die, files, cudie())});
+        index = scope.parent;
+    }
+
+    return &m_inlineChainCache.insert({key, std::move(chain)}).first->second;
+}
+
 DwarfDieCache::DwarfDieCache(Dwfl_Module* mod)
 {
     if (!mod)
@@ -365,12 +509,62 @@ DwarfDieCache::DwarfDieCache(Dwfl_Module* mod)
     }
 }
 
+bool DwarfDieCache::restore(Dwfl_Module* mod, const std::vector<CuRanges>& ranges)
+{
+    m_cuDieRanges.clear();
+    m_cuIndex.clear();
+
+    Dwarf_Addr bias = 0;
+    auto dwarf = dwfl_module_getdwarf(mod, &bias);
+    if (!dwarf)
+        return ranges.empty();
+
+    m_cuDieRanges.reserve(ranges.size());
+    for (const auto& cu : ranges) {
+        Dwarf_Die die;
+        if (!dwarf_offdie(dwarf, cu.dieOffset, &die)) {
+            m_cuDieRanges.clear();
+            return false;
+        }
+        const auto tag = dwarf_tag(&die);
+        if (tag != DW_TAG_compile_unit && tag != DW_TAG_partial_unit) {
+            m_cuDieRanges.clear();
+            return false;
+        }
+        m_cuDieRanges.emplace_back(die, bias, cu.ranges);
+    }
+    return true;
+}
+
+std::vector<CuRanges> DwarfDieCache::cuRanges()
+{
+    std::vector<CuRanges> ret;
+    ret.reserve(m_cuDieRanges.size());
+    for (auto& cuDieMapping : m_cuDieRanges) {
+        ret.push_back(cuDieMapping.cuRanges());
+    }
+    return ret;
+}
+
+void DwarfDieCache::buildIndex()
+{
+    if (m_cuIndex.isFinalized())
+        return;
+
+    for (uint32_t i = 0, c = m_cuDieRanges.size(); i < c; ++i) {
+        for (const auto& range : m_cuDieRanges[i].ranges())
+            m_cuIndex.add(range, i);
+    }
+    m_cuIndex.finalize();
+}
+
 CuDieRangeMapping* DwarfDieCache::findCuDie(Dwarf_Addr addr)
 {
-    auto it = std::find_if(m_cuDieRanges.begin(), m_cuDieRanges.end(),
-                           [addr](const CuDieRangeMapping& cuDieMapping) { return cuDieMapping.contains(addr); });
-    if (it == m_cuDieRanges.end())
+    buildIndex();
+
+    const auto index = m_cuIndex.find(addr);
+    if (index == DwarfRangeIndex::NOT_FOUND)
         return nullptr;
 
-    return &(*it);
+    return &m_cuDieRanges[index];
 }
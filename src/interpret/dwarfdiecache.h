@@ -15,6 +15,7 @@
 #include <tsl/robin_map.h>
 
 #include <algorithm>
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -44,6 +45,52 @@ struct DwarfRange
     }
 };
 
+/**
+ * Sorted interval index over the ranges of many DIEs
+ *
+ * This allows us to find the DIE containing an address with a binary search,
+ * instead of having to check the ranges of every DIE in turn.
+ */
+class DwarfRangeIndex
+{
+public:
+    enum : uint32_t
+    {
+        NOT_FOUND = UINT32_MAX
+    };
+
+    /// add @p range for the DIE at position @p index, call @c finalize afterwards
+    void add(DwarfRange range, uint32_t index);
+    /// sort the ranges, required before calling @c find
+    void finalize();
+
+    bool isFinalized() const
+    {
+        return m_finalized;
+    }
+
+    void clear()
+    {
+        m_entries.clear();
+        m_finalized = false;
+    }
+
+    /// @return the smallest index of the DIEs whose ranges contain @p addr, or NOT_FOUND
+    uint32_t find(Dwarf_Addr addr) const;
+
+private:
+    struct Entry
+    {
+        Dwarf_Addr low;
+        Dwarf_Addr high;
+        // the maximum high address of this and all preceding entries
+        Dwarf_Addr maxHigh;
+        uint32_t index;
+    };
+    std::vector<Entry> m_entries;
+    bool m_finalized = false;
+};
+
 /// cache of dwarf ranges for a given Dwarf_Die
 struct DieRanges
 {
@@ -63,6 +110,14 @@ class SubProgramDie
 public:
     SubProgramDie(Dwarf_Die die);
 
+    /// a DW_TAG_inlined_subroutine DIE within the sub program
+    struct InlineScope
+    {
+        Dwarf_Die die;
+        /// the index of the enclosing inlined scope, or NOT_FOUND when it is the sub program itself
+        uint32_t parent;
+    };
+
     bool isEmpty() const
     {
         return m_ranges.ranges.empty();
@@ -72,13 +127,55 @@ public:
     {
         return m_ranges.contains(offset);
     }
+    /// @return the bias-corrected ranges
+    const std::vector<DwarfRange>& ranges() const
+    {
+        return m_ranges.ranges;
+    }
     Dwarf_Die* die()
     {
         return &m_ranges.die;
     }
 
+    /// On first call this will visit the sub program DIE to cache all inlined scopes
+    /// @return the index of the innermost inlined scope that contains @p offset, or NOT_FOUND
+    /// @p offset a bias-corrected offset
+    uint32_t findInlineScope(Dwarf_Addr offset);
+    InlineScope& inlineScope(uint32_t index)
+    {
+        return m_inlineScopes[index];
+    }
+
 private:
+    void addInlineScopes(Dwarf_Die* die, uint32_t parent);
+
     DieRanges m_ranges;
+    /// in pre-order, i.e. the enclosing scopes come first
+    std::vector<InlineScope> m_inlineScopes;
+    /// indexes the inlined scopes in reverse order, such that the innermost one gets found
+    DwarfRangeIndex m_inlineScopeIndex;
+};
+
+/// the functions that got inlined at an address, see CuDieRangeMapping::inlineChain
+struct InlineChain
+{
+    struct Call
+    {
+        /// the function that contains the call
+        std::string function;
+        SourceLocation location;
+    };
+    /// the innermost inlined function, i.e. the one the address belongs to
+    std::string function;
+    /// the inlined calls from the innermost to the outermost one, which is made by the sub program
+    std::vector<Call> calls;
+};
+
+/// bias-free dwarf ranges of the CU DIE at @c dieOffset, see PersistentSymbolCache
+struct CuRanges
+{
+    Dwarf_Off dieOffset;
+    std::vector<DwarfRange> ranges;
 };
 
 /// cache of dwarf ranges for a CU DIE and child sub programs
@@ -86,6 +183,8 @@ class CuDieRangeMapping
 {
 public:
     CuDieRangeMapping(Dwarf_Die cudie, Dwarf_Addr bias);
+    /// @p ranges bias-free ranges previously returned via cuRanges()
+    CuDieRangeMapping(Dwarf_Die cudie, Dwarf_Addr bias, const std::vector<DwarfRange>& ranges);
 
     bool isEmpty() const
     {
@@ -95,6 +194,13 @@ public:
     {
         return m_cuDieRanges.contains(addr);
     }
+    /// @return the ranges of the CU DIE, including the bias
+    const std::vector<DwarfRange>& ranges() const
+    {
+        return m_cuDieRanges.ranges;
+    }
+    /// @return the bias-free ranges of the CU DIE
+    CuRanges cuRanges();
     Dwarf_Addr bias()
     {
         return m_bias;
@@ -112,13 +218,25 @@ public:
     /// @return a fully qualified, demangled symbol name for @p die
     const std::string& dieName(Dwarf_Die* die);
 
+    /**
+     * @return the inlined functions at @p offset within @p subprogram, or nullptr when nothing got
+     * inlined there
+     *
+     * The chain is only resolved once per inlined scope, all addresses within the same one share it.
+     * The pointer stays valid until the next call.
+     */
+    const InlineChain* inlineChain(SubProgramDie* subprogram, Dwarf_Addr offset);
+
 private:
     void addSubprograms();
 
     Dwarf_Addr m_bias = 0;
     DieRanges m_cuDieRanges;
     std::vector<SubProgramDie> m_subPrograms;
+    DwarfRangeIndex m_subProgramIndex;
     tsl::robin_map<Dwarf_Off, std::string> m_dieNameCache;
+    /// indexed by the offset of the innermost inlined scope DIE
+    tsl::robin_map<Dwarf_Off, InlineChain> m_inlineChainCache;
 };
 
 /**
@@ -137,11 +255,28 @@ class DwarfDieCache
 public:
     DwarfDieCache(Dwfl_Module* mod = nullptr);
 
+    /**
+     * Restore the cache for @p mod from the CU @p ranges returned previously by cuRanges().
+     *
+     * @return false when the ranges do not match the DWARF data of @p mod, the cache is empty then
+     */
+    bool restore(Dwfl_Module* mod, const std::vector<CuRanges>& ranges);
+
+    /// @return the bias-free ranges of all CU DIEs, to restore the cache later on
+    std::vector<CuRanges> cuRanges();
+
+    /// build the index of the CU DIE ranges, which otherwise happens on the first call to findCuDie
+    void buildIndex();
+
     /// @p addr absolute address, not bias-corrected
     CuDieRangeMapping* findCuDie(Dwarf_Addr addr);
 
 public:
     std::vector<CuDieRangeMapping> m_cuDieRanges;
+
+private:
+    /// built lazily on the first lookup
+    DwarfRangeIndex m_cuIndex;
 };
 
 #endif // DWARFDIECACHE_H
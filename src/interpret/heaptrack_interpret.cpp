@@ -11,100 +11,59 @@
  */
 
 #include <algorithm>
+#include <array>
+#include <cctype>
 #include <cinttypes>
+#include <cstring>
 #include <iostream>
 #include <sstream>
 #ifdef __linux__
 #include <stdio_ext.h>
 #endif
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <memory>
+#include <mutex>
+#include <thread>
 #include <tuple>
 #include <vector>
 
-#include "dwarfdiecache.h"
-#include "symbolcache.h"
+#include "debuginfodfetcher.h"
+#include "jitsymbols.h"
+#include "memorymappings.h"
+#include "persistentsymbolcache.h"
+#include "segmentedoutput.h"
+#include "symbolizer.h"
+#if ZSTD_FOUND
+#include "zstdcompressor.h"
+#endif
 
+#include "util/config.h"
 #include "util/linereader.h"
 #include "util/linewriter.h"
+#include "util/macroutils.h"
 #include "util/pointermap.h"
+#include "util/shmring.h"
+
+#include <tsl/robin_map.h>
 
 #include <dwarf.h>
 #include <elfutils/libdwelf.h>
 
 #include <csignal>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
 using namespace std;
 
 namespace {
-bool isArmArch()
-{
-#ifdef __arm__
-    return true;
-#else
-    return false;
-#endif
-}
-
 #define error_out cerr << __FILE__ << ':' << __LINE__ << " ERROR:"
 
-bool startsWith(const std::string& haystack, const char* needle)
-{
-    return haystack.compare(0, strlen(needle), needle) == 0;
-}
-
-static uint64_t alignedAddress(uint64_t addr, bool isArmArch)
-{
-    // Adjust addr back. The symtab entries are 1 off for all practical purposes.
-    return (isArmArch && (addr & 1)) ? addr - 1 : addr;
-}
-
-static SymbolCache::Symbols extractSymbols(Dwfl_Module* module, uint64_t elfStart, bool isArmArch)
-{
-    SymbolCache::Symbols symbols;
-
-    const auto numSymbols = dwfl_module_getsymtab(module);
-    if (numSymbols <= 0)
-        return symbols;
-
-    symbols.reserve(numSymbols);
-    for (int i = 0; i < numSymbols; ++i) {
-        GElf_Sym sym;
-        GElf_Addr symAddr;
-        const auto symbol = dwfl_module_getsym_info(module, i, &sym, &symAddr, nullptr, nullptr, nullptr);
-        if (symbol) {
-            const uint64_t start = alignedAddress(sym.st_value, isArmArch);
-            symbols.push_back({symAddr - elfStart, start, sym.st_size, symbol});
-        }
-    }
-    return symbols;
-}
-
-struct Frame
-{
-    Frame(string function = {}, string file = {}, int line = 0)
-        : function(function)
-        , file(file)
-        , line(line)
-    {
-    }
-
-    bool isValid() const
-    {
-        return !function.empty();
-    }
-
-    string function;
-    string file;
-    int line;
-};
-
-struct AddressInformation
-{
-    Frame frame;
-    vector<Frame> inlined;
-};
-
 struct ResolvedFrame
 {
     ResolvedFrame(size_t functionIndex = 0, size_t fileIndex = 0, int line = 0)
@@ -125,176 +84,293 @@ struct ResolvedIP
     vector<ResolvedFrame> inlined;
 };
 
-struct ModuleFragment
+struct Stats
 {
-    ModuleFragment(string fileName, uintptr_t addressStart, uintptr_t fragmentStart, uintptr_t fragmentEnd,
-                   size_t moduleIndex)
-        : fileName(fileName)
-        , addressStart(addressStart)
-        , fragmentStart(fragmentStart)
-        , fragmentEnd(fragmentEnd)
-        , moduleIndex(moduleIndex)
-    {
-    }
+    uint64_t allocations = 0;
+    uint64_t leakedAllocations = 0;
+    uint64_t temporaryAllocations = 0;
 
-    bool operator<(const ModuleFragment& module) const
-    {
-        return tie(addressStart, fragmentStart, fragmentEnd, moduleIndex)
-            < tie(module.addressStart, module.fragmentStart, module.fragmentEnd, module.moduleIndex);
-    }
+    /// the number of records per record type
+    uint64_t records[128] = {};
+    /// the instruction pointers we encountered for the first time, and the time it took to symbolize them,
+    /// including the time we waited for the symbolizers in the background
+    uint64_t newIps = 0;
+    chrono::steady_clock::duration symbolizationTime = {};
+    /// the size of the pointer map, as of the last time the stats got printed
+    uint64_t livePointers = 0;
+    uint64_t pointerPages = 0;
+    /// how far we fell behind the tracee, i.e. the time stamps it wrote and when we read them
+    chrono::milliseconds lag = {};
+    chrono::milliseconds maxLag = {};
+};
+/// per thread, as the daemon interprets every tracee on a thread of its own, see runDaemon
+thread_local Stats c_stats;
 
-    bool operator!=(const ModuleFragment& module) const
-    {
-        return tie(addressStart, fragmentStart, fragmentEnd, moduleIndex)
-            != tie(module.addressStart, module.fragmentStart, module.fragmentEnd, module.moduleIndex);
+/// the number of symbolizers, see HEAPTRACK_INTERPRET_THREADS
+unsigned symbolizerThreads()
+{
+    // by default, resolve the addresses with a few threads in the background
+    // but don't overdo it, as every thread keeps its own copy of the debug information in memory
+    unsigned numThreads = min(thread::hardware_concurrency(), 4u);
+    if (const auto threadsEnv = getenv("HEAPTRACK_INTERPRET_THREADS")) {
+        numThreads = strtoul(threadsEnv, nullptr, 10);
     }
+    return numThreads;
+}
 
-    string fileName;
-    uintptr_t addressStart;
-    uintptr_t fragmentStart;
-    uintptr_t fragmentEnd;
-    size_t moduleIndex;
-};
-
-struct Module
+/**
+ * Thread pool that resolves instruction pointers in the background.
+ *
+ * The jobs are processed in any order, the caller is responsible for
+ * writing the results in the order it submitted them.
+ *
+ * When idle, the symbolizers prepare the modules that got loaded, such that
+ * their symbols are usually ready once the first address within them shows up.
+ */
+class SymbolizerPool
 {
-    Module(string fileName, uintptr_t addressStart, Dwfl_Module* module, SymbolCache* symbolCache)
-        : fileName(std::move(fileName))
-        , addressStart(addressStart)
-        , module(module)
-        , dieCache(module)
-        , symbolCache(symbolCache)
+public:
+    struct Job
     {
-    }
+        Job(uintptr_t ip, const ModuleFragment& fragment, shared_ptr<const LoadedModules> loadedModules)
+            : ip(ip)
+            , fragment(fragment)
+            , loadedModules(std::move(loadedModules))
+        {
+        }
 
-    Module()
-        : Module({}, 0, nullptr, nullptr)
+        uintptr_t ip;
+        ModuleFragment fragment;
+        shared_ptr<const LoadedModules> loadedModules;
+        AddressInformation info;
+        std::atomic<bool> done {false};
+        /// output that was written after this job got submitted, see LineWriter::redirect
+        string trailer;
+    };
+
+    /// @p sharedModules lets the pool resolve the addresses of multiple tracees, see Symbolizer
+    SymbolizerPool(unsigned numThreads, const PersistentSymbolCache* persistentCache, bool sharedModules = false)
+        : SymbolizerPool(createSymbolizers(numThreads, persistentCache, sharedModules))
     {
     }
 
-    AddressInformation resolveAddress(uintptr_t address) const
+    /// continue with the symbolizers of another pool, see takeSymbolizers
+    explicit SymbolizerPool(vector<unique_ptr<Symbolizer>> symbolizers)
+        : m_symbolizers(std::move(symbolizers))
+        , m_preparations(m_symbolizers.size())
     {
-        AddressInformation info;
-
-        if (!module) {
-            return info;
+        for (size_t i = 0; i < m_symbolizers.size(); ++i) {
+            m_threads.emplace_back([this, i]() { run(m_symbolizers[i].get(), &m_preparations[i]); });
         }
+    }
 
-        if (!symbolCache->hasSymbols(fileName)) {
-            // cache all symbols in a sorted lookup table and demangle them on-demand
-            // note that the symbols within the symtab aren't necessarily sorted,
-            // which makes searching repeatedly via dwfl_module_addrinfo potentially very slow
-            symbolCache->setSymbols(fileName, extractSymbols(module, addressStart, isArmArch()));
+    ~SymbolizerPool()
+    {
+        {
+            lock_guard<mutex> lock(m_mutex);
+            m_stop = true;
         }
-
-        auto cachedAddrInfo = symbolCache->findSymbol(fileName, address - addressStart);
-        if (cachedAddrInfo.isValid()) {
-            info.frame.function = std::move(cachedAddrInfo.symname);
+        m_jobAvailable.notify_all();
+        for (auto& thread : m_threads) {
+            thread.join();
         }
+    }
 
-        auto cuDie = dieCache.findCuDie(address);
-        if (!cuDie) {
-            return info;
+    void submit(shared_ptr<Job> job)
+    {
+        {
+            lock_guard<mutex> lock(m_mutex);
+            m_jobs.push_back(std::move(job));
         }
+        m_jobAvailable.notify_one();
+    }
 
-        const auto offset = address - cuDie->bias();
-        auto srcloc = dwarf_getsrc_die(cuDie->cudie(), offset);
-        if (srcloc) {
-            const char* srcfile = dwarf_linesrc(srcloc, nullptr, nullptr);
-            if (srcfile) {
-                const auto file = std::string(srcfile);
-                info.frame.file = srcfile;
-                dwarf_lineno(srcloc, &info.frame.line);
+    /// let every symbolizer prepare the module of @p fragment once it has nothing else to do
+    void prepare(const ModuleFragment& fragment)
+    {
+        {
+            lock_guard<mutex> lock(m_mutex);
+            // every symbolizer has its own Dwfl, which needs to know the module
+            for (auto& preparations : m_preparations) {
+                preparations.push_back(fragment);
             }
         }
+        m_jobAvailable.notify_all();
+    }
 
-        auto* subprogram = cuDie->findSubprogramDie(offset);
-        if (!subprogram) {
-            return info;
+    /// drop the modules that wait to be prepared and wait for the ones that are being prepared
+    void cancelPreparations()
+    {
+        unique_lock<mutex> lock(m_mutex);
+        for (auto& preparations : m_preparations) {
+            preparations.clear();
         }
+        m_jobDone.wait(lock, [this]() { return !m_preparing; });
+    }
 
-        // resolve the inline chain if possible
-        auto scopes = findInlineScopes(subprogram->die(), offset);
-
-        if (scopes.empty()) {
-            // no inline frames, use subprogram name directly and return
-            info.frame.function = cuDie->dieName(subprogram->die());
-            return info;
+    void waitFor(const Job& job)
+    {
+        if (job.done.load(memory_order_acquire)) {
+            return;
         }
+        unique_lock<mutex> lock(m_mutex);
+        m_jobDone.wait(lock, [&job]() { return job.done.load(memory_order_acquire); });
+    }
 
-        // use name of the last inlined function as symbol
-        info.frame.function = cuDie->dieName(&scopes.back());
+    /**
+     * Take the symbolizers of this pool in a forked process, in which its threads don't exist.
+     *
+     * The pool itself must be leaked afterwards, its synchronization primitives may still be locked.
+     */
+    vector<unique_ptr<Symbolizer>> takeSymbolizers()
+    {
+        return std::move(m_symbolizers);
+    }
 
-        Dwarf_Files* files = nullptr;
-        dwarf_getsrcfiles(cuDie->cudie(), &files, nullptr);
+private:
+    static vector<unique_ptr<Symbolizer>>
+    createSymbolizers(unsigned numThreads, const PersistentSymbolCache* persistentCache, bool sharedModules)
+    {
+        vector<unique_ptr<Symbolizer>> symbolizers;
+        for (unsigned i = 0; i < numThreads; ++i) {
+            symbolizers.emplace_back(new Symbolizer(persistentCache, {}, sharedModules));
+        }
+        return symbolizers;
+    }
 
-        auto handleDie = [&](Dwarf_Die *scope, Dwarf_Die *prevScope) {
-            const auto tag = dwarf_tag(prevScope);
-            if (tag != DW_TAG_inlined_subroutine) {
-                error_out << "unexpected prev scope tag: " << std::hex << tag << '\n';
-                return;
+    void run(Symbolizer* symbolizer, deque<ModuleFragment>* preparations)
+    {
+        while (true) {
+            shared_ptr<Job> job;
+            {
+                unique_lock<mutex> lock(m_mutex);
+                m_jobAvailable.wait(lock, [this, preparations]() {
+                    return m_stop || !m_jobs.empty() || !preparations->empty();
+                });
+                if (m_jobs.empty()) {
+                    if (m_stop) {
+                        return;
+                    }
+                    // the output waits for the jobs, so only prepare modules when there are none
+                    auto fragment = std::move(preparations->front());
+                    preparations->pop_front();
+                    ++m_preparing;
+                    lock.unlock();
+
+                    symbolizer->prepare(fragment);
+
+                    lock.lock();
+                    --m_preparing;
+                    lock.unlock();
+                    m_jobDone.notify_all();
+                    continue;
+                }
+                job = std::move(m_jobs.front());
+                m_jobs.pop_front();
             }
 
-            auto call = callSourceLocation(prevScope, files, cuDie->cudie());
-            info.inlined.push_back({cuDie->dieName(scope), std::move(call.file), call.line});
-        };
+            job->info = symbolizer->resolve(job->fragment, job->ip, *job->loadedModules);
 
-        // iterate in reverse, to properly rebuild the inline stack
-        // note that we need to take the DW_AT_call_{file,line} from the previous scope DIE
-        const auto numScopes = scopes.size();
-        for (std::size_t scopeIndex = numScopes - 1; scopeIndex >= 1; --scopeIndex) {
-            handleDie(&scopes[scopeIndex - 1], &scopes[scopeIndex]);
+            {
+                lock_guard<mutex> lock(m_mutex);
+                job->done.store(true, memory_order_release);
+            }
+            m_jobDone.notify_all();
         }
-
-        // the very last frame is the one where all the code got inlined into
-        handleDie(subprogram->die(), &scopes.front());
-
-        return info;
     }
 
-    string fileName;
-    uintptr_t addressStart;
-    Dwfl_Module* module;
-    mutable DwarfDieCache dieCache;
-    SymbolCache* symbolCache;
+    mutex m_mutex;
+    condition_variable m_jobAvailable;
+    condition_variable m_jobDone;
+    deque<shared_ptr<Job>> m_jobs;
+    vector<unique_ptr<Symbolizer>> m_symbolizers;
+    /// the modules each of the symbolizers still has to prepare
+    vector<deque<ModuleFragment>> m_preparations;
+    /// the number of symbolizers that are preparing a module right now
+    unsigned m_preparing = 0;
+    vector<thread> m_threads;
+    bool m_stop = false;
 };
 
 struct AccumulatedTraceData
 {
-    AccumulatedTraceData()
+    /**
+     * When @p parent is set, we continue in a forked process with its symbolizers,
+     * which know most of the modules already. The parent must be leaked then.
+     */
+    explicit AccumulatedTraceData(AccumulatedTraceData* parent = nullptr)
         : out(fileno(stdout))
+        , m_persistentCache(parent ? parent->m_persistentCache.release() : PersistentSymbolCache::fromEnvironment())
     {
         m_moduleFragments.reserve(256);
         m_internedData.reserve(4096);
         m_encounteredIps.reserve(32768);
 
-        {
-            std::string debugPath(":.debug:/usr/lib/debug");
-            const auto length = debugPath.size() + 1;
-            m_debugPath = new char[length];
-            std::memcpy(m_debugPath, debugPath.data(), length);
+        // split the output into segment files, which get compressed by themselves
+        // forked children write to their own output file, see redirectToForkedChild
+        if (auto segments = parent ? nullptr : SegmentedOutput::fromEnvironment()) {
+            out.setSink(unique_ptr<LineWriter::Sink>(segments));
+        }
+#if ZSTD_FOUND
+        // compress the output ourselves instead of piping it through an external compressor
+        else if (auto compressor = ZstdCompressor::fromEnvironment(fileno(stdout))) {
+            out.setSink(unique_ptr<LineWriter::Sink>(compressor));
+        }
+#endif
+
+        // only record the modules of the instruction pointers, heaptrack_symbolize resolves them later on
+        const auto deferSymbols = getenv("HEAPTRACK_DEFER_SYMBOLS");
+        m_deferSymbols = deferSymbols && strcmp(deferSymbols, "0") != 0;
+        if (m_deferSymbols) {
+            return;
         }
 
-        m_callbacks = {
-            &dwfl_build_id_find_elf,
-            &dwfl_standard_find_debuginfo,
-            &dwfl_offline_section_address,
-            &m_debugPath,
-        };
+        if (parent) {
+            m_symbolizer = std::move(parent->m_symbolizer);
+            if (parent->m_pool) {
+                m_pool.reset(new SymbolizerPool(parent->m_pool->takeSymbolizers()));
+            }
+            return;
+        }
+
+        const auto numThreads = symbolizerThreads();
+        if (numThreads > 1) {
+            m_pool.reset(new SymbolizerPool(numThreads, m_persistentCache.get()));
+        } else {
+            m_symbolizer.reset(new Symbolizer(m_persistentCache.get()));
+        }
+    }
+
+    /**
+     * Interpret the data of a tracee of the daemon into @p outFd, with the symbolizers of @p pool
+     * that all of its tracees share, see runDaemon.
+     */
+    AccumulatedTraceData(int outFd, shared_ptr<SymbolizerPool> pool)
+        : out(outFd)
+        , m_sharedModules(true)
+        , m_pool(std::move(pool))
+    {
+        m_moduleFragments.reserve(256);
+        m_internedData.reserve(4096);
+        m_encounteredIps.reserve(32768);
 
-        m_dwfl = dwfl_begin(&m_callbacks);
+#if ZSTD_FOUND
+        // the daemon compresses the data of many tracees in parallel already
+        auto compressor = ZstdCompressor::fromEnvironment(outFd);
+        out.setSink(unique_ptr<LineWriter::Sink>(
+            compressor ? compressor : new ZstdCompressor(outFd, ZstdCompressor::DEFAULT_LEVEL, 0)));
+#endif
     }
 
     ~AccumulatedTraceData()
     {
+        finishPendingIps();
+
         out.write("# strings: %zu\n# ips: %zu\n", m_internedData.size(), m_encounteredIps.size());
         out.flush();
-
-        delete[] m_debugPath;
-        dwfl_end(m_dwfl);
     }
 
-    ResolvedIP resolve(const uintptr_t ip)
+    const ModuleFragment* findModuleFragment(const uintptr_t ip)
     {
         if (m_modulesDirty) {
             // sort by addresses, required for binary search below
@@ -321,35 +397,42 @@ struct AccumulatedTraceData
             }
 #endif
 
-            // reset dwfl state
-            m_modules.clear();
-
-            dwfl_report_begin(m_dwfl);
-            dwfl_report_end(m_dwfl, nullptr, nullptr);
-
+            updateLoadedModules();
             m_modulesDirty = false;
         }
 
-        auto resolveFrame = [this](const Frame& frame) {
-            return ResolvedFrame {intern(frame.function), intern(frame.file), frame.line};
-        };
-
-        ResolvedIP data;
         // find module for this instruction pointer
         auto fragment = lower_bound(
             m_moduleFragments.begin(), m_moduleFragments.end(), ip,
             [](const ModuleFragment& fragment, const uintptr_t ip) -> bool { return fragment.fragmentEnd < ip; });
         if (fragment != m_moduleFragments.end() && fragment->fragmentStart <= ip && fragment->fragmentEnd >= ip) {
-            data.moduleIndex = fragment->moduleIndex;
+            return &(*fragment);
+        }
+        return nullptr;
+    }
 
-            if (auto module = reportModule(*fragment)) {
-                const auto info = module->resolveAddress(ip);
-                data.frame = resolveFrame(info.frame);
-                std::transform(info.inlined.begin(), info.inlined.end(), std::back_inserter(data.inlined),
-                               resolveFrame);
-            }
+    /**
+     * Take a new snapshot of the loaded modules after the module list got changed.
+     *
+     * Only when modules got unloaded or moved, the symbolizers need to drop them, so
+     * the generation stays the same when modules got added only. That is the common
+     * case, as the module list gets sent anew whenever a library gets opened.
+     */
+    void updateLoadedModules()
+    {
+        auto loadedModules = make_shared<LoadedModules>();
+        loadedModules->modules.reserve(m_moduleFragments.size());
+        for (const auto& fragment : m_moduleFragments) {
+            loadedModules->modules.emplace_back(fragment.addressStart, fragment.fileName);
         }
-        return data;
+        auto& modules = loadedModules->modules;
+        sort(modules.begin(), modules.end());
+        modules.erase(unique(modules.begin(), modules.end()), modules.end());
+
+        const auto& previous = m_loadedModules->modules;
+        const bool unloaded = !includes(modules.begin(), modules.end(), previous.begin(), previous.end());
+        loadedModules->generation = m_loadedModules->generation + (unloaded ? 1 : 0);
+        m_loadedModules = std::move(loadedModules);
     }
 
     size_t intern(const string& str, const char** internedString = nullptr)
@@ -379,16 +462,73 @@ struct AccumulatedTraceData
     {
         m_moduleFragments.emplace_back(fileName, addressStart, fragmentStart, fragmentEnd, moduleIndex);
         m_modulesDirty = true;
+        if (m_sharedModules) {
+            // the same modules get loaded at other addresses in the other tracees
+            m_moduleFragments.back().buildId = fileBuildId(fileName);
+        }
+
+        if (m_deferSymbols) {
+            return;
+        }
+
+        // the whole module list gets sent again whenever a library gets opened, only prepare the new ones
+        auto it = m_preparedModules.find(addressStart);
+        if (it != m_preparedModules.end() && it->second == fileName) {
+            return;
+        }
+        m_preparedModules[addressStart] = fileName;
+
+        // start downloading the debug information before the symbolizers ask for it
+        if (auto fetcher = DebuginfodFetcher::instance()) {
+            auto buildId = m_buildIds.find(fileName);
+            fetcher->prefetch(fileName, buildId == m_buildIds.end() ? string() : buildId->second);
+        }
+        if (m_pool) {
+            m_pool->prepare(m_moduleFragments.back());
+        }
+    }
+
+    /// the symbolizers must be idle when we fork, see SymbolizerPool::cancelPreparations
+    void cancelModulePreparations()
+    {
+        if (m_pool) {
+            m_pool->cancelPreparations();
+        }
+    }
+
+    void removeModule(const uintptr_t addressStart)
+    {
+        m_moduleFragments.erase(remove_if(m_moduleFragments.begin(), m_moduleFragments.end(),
+                                          [addressStart](const ModuleFragment& fragment) {
+                                              return fragment.addressStart == addressStart;
+                                          }),
+                                m_moduleFragments.end());
+        m_modulesDirty = true;
     }
 
     void clearModules()
     {
-        // TODO: optimize this, reuse modules that are still valid
+        // the new module list gets compared to the old one in updateLoadedModules
         m_moduleFragments.clear();
         m_modulesDirty = true;
     }
 
-    size_t addIp(const uintptr_t instructionPointer)
+    /**
+     * Use @p buildId for the module @p fileName instead of reading it from the file,
+     * for data that got streamed from a different machine, see heaptrack_stream.
+     */
+    void setBuildId(const string& fileName, string buildId)
+    {
+        m_buildIds[fileName] = std::move(buildId);
+    }
+
+    /// look for the JIT compiled code of the tracee with the given @p pid, see JitSymbols
+    void setProcessId(pid_t pid)
+    {
+        m_jitSymbols.reset(new JitSymbols(pid));
+    }
+
+    HEAPTRACK_PERF_FUNCTION size_t addIp(const uintptr_t instructionPointer)
     {
         if (!instructionPointer) {
             return 0;
@@ -400,7 +540,85 @@ struct AccumulatedTraceData
             return inserted.first->second;
         }
 
-        const auto ip = resolve(instructionPointer);
+        ++c_stats.newIps;
+        const auto start = chrono::steady_clock::now();
+        const auto* fragment = findModuleFragment(instructionPointer);
+        if (instructionPointer == HEAPTRACK_TRUNCATED_TRACE_IP) {
+            // marker for traces that exceeded the maximum unwind depth, see Trace::setMaxDepth
+            writeIp(instructionPointer, 0, {Frame("[truncated]"), {}});
+        } else if (!fragment) {
+            writeJitIp(instructionPointer);
+        } else if (m_deferSymbols) {
+            writeModuleBuildId(*fragment);
+            writeIp(instructionPointer, fragment->moduleIndex, {});
+        } else if (!m_pool) {
+            writeIp(instructionPointer, fragment->moduleIndex,
+                    m_symbolizer->resolve(*fragment, instructionPointer, *m_loadedModules));
+        } else {
+            // resolve in the background, all output up to the point where we write the
+            // resolved data out is held back to keep it in order
+            auto job = make_shared<SymbolizerPool::Job>(instructionPointer, *fragment, m_loadedModules);
+            m_pool->submit(job);
+            holdOutput(std::move(job));
+        }
+        c_stats.symbolizationTime += chrono::steady_clock::now() - start;
+        return ipId;
+    }
+
+    /**
+     * Write out the data of all background jobs that finished already.
+     *
+     * When too much output is held back, this waits for the oldest job.
+     */
+    void writeResolvedIps()
+    {
+        while (!m_pendingIps.empty()) {
+            auto& job = *m_pendingIps.front();
+            if (!job.done.load(memory_order_acquire)) {
+                if (m_heldBytes + m_pendingIps.back()->trailer.size() < MAX_HELD_BYTES) {
+                    return;
+                }
+                waitFor(job);
+            }
+            writePendingIp();
+        }
+    }
+
+    /**
+     * Wait for all background jobs and write out their data.
+     *
+     * Must be called before interning strings, as the string indices must
+     * match the order in which we write them out.
+     */
+    void finishPendingIps()
+    {
+        while (!m_pendingIps.empty()) {
+            waitFor(*m_pendingIps.front());
+            writePendingIp();
+        }
+    }
+
+    LineWriter out;
+
+private:
+    void waitFor(const SymbolizerPool::Job& job)
+    {
+        const auto start = chrono::steady_clock::now();
+        m_pool->waitFor(job);
+        c_stats.symbolizationTime += chrono::steady_clock::now() - start;
+    }
+
+    void writeIp(uintptr_t instructionPointer, size_t moduleIndex, const AddressInformation& info)
+    {
+        auto resolveFrame = [this](const Frame& frame) {
+            return ResolvedFrame {intern(frame.function), intern(frame.file), frame.line};
+        };
+
+        ResolvedIP ip;
+        ip.moduleIndex = moduleIndex;
+        ip.frame = resolveFrame(info.frame);
+        std::transform(info.inlined.begin(), info.inlined.end(), std::back_inserter(ip.inlined), resolveFrame);
+
         out.write("i %zx %zx", instructionPointer, ip.moduleIndex);
         if (ip.frame.functionIndex || ip.frame.fileIndex) {
             out.write(" %zx", ip.frame.functionIndex);
@@ -412,115 +630,559 @@ struct AccumulatedTraceData
             }
         }
         out.write("\n");
-        return ipId;
     }
 
-    LineWriter out;
+    /// JIT compiled code is not part of any module, the file that announced it is used as module instead
+    void writeJitIp(uintptr_t instructionPointer)
+    {
+        const auto* symbol = m_jitSymbols ? m_jitSymbols->find(instructionPointer) : nullptr;
+        if (!symbol) {
+            writeIp(instructionPointer, 0, {});
+            return;
+        }
+        writeIp(instructionPointer, intern(*symbol->fileName), {Frame(symbol->name), {}});
+    }
 
-private:
-    Module* reportModule(const ModuleFragment& module)
+    /**
+     * Announce the load address and build-id of the module of @p fragment,
+     * unless that was done already. This is all heaptrack_symbolize needs to
+     * resolve the instruction pointers within the module.
+     */
+    void writeModuleBuildId(const ModuleFragment& fragment)
     {
-        if (startsWith(module.fileName, "linux-vdso.so")) {
-            return nullptr;
+        auto it = m_announcedModules.find(fragment.moduleIndex);
+        if (it != m_announcedModules.end() && it->second == fragment.addressStart) {
+            return;
         }
+        m_announcedModules[fragment.moduleIndex] = fragment.addressStart;
 
-        auto& ret = m_modules[module.fileName];
-        if (ret.module)
-            return &ret;
+        const auto& buildId = fileBuildId(fragment.fileName);
+        out.write("b %zx %zx", fragment.moduleIndex, fragment.addressStart);
+        if (!buildId.empty()) {
+            out.write(" ");
+            out.write(buildId);
+        }
+        out.write("\n");
+    }
 
-        auto dwflModule = dwfl_addrmodule(m_dwfl, module.addressStart);
-        if (!dwflModule) {
-            dwfl_report_begin_add(m_dwfl);
-            dwflModule = dwfl_report_elf(m_dwfl, module.fileName.c_str(), module.fileName.c_str(), -1,
-                                         module.addressStart, false);
-            dwfl_report_end(m_dwfl, nullptr, nullptr);
+    /// @return the build-id of the module @p fileName, which only gets read from the file once
+    const string& fileBuildId(const string& fileName)
+    {
+        auto buildId = m_buildIds.find(fileName);
+        if (buildId == m_buildIds.end()) {
+            buildId = m_buildIds.insert({fileName, elfBuildId(fileName)}).first;
+        }
+        return buildId->second;
+    }
 
-            if (!dwflModule) {
-                error_out << "Failed to report module for " << module.fileName << ": " << dwfl_errmsg(dwfl_errno())
-                          << endl;
-                return nullptr;
-            }
+    void holdOutput(shared_ptr<SymbolizerPool::Job> job)
+    {
+        if (!m_pendingIps.empty()) {
+            out.redirect(&m_pendingIps.back()->trailer);
+            m_heldBytes += m_pendingIps.back()->trailer.size();
         }
+        m_pendingIps.push_back(std::move(job));
+        out.redirect(&m_pendingIps.back()->trailer);
+    }
+
+    /// write out the oldest pending job, which must be done already
+    void writePendingIp()
+    {
+        auto job = std::move(m_pendingIps.front());
+        m_pendingIps.pop_front();
 
-        ret = Module(module.fileName, module.addressStart, dwflModule, &m_symbolCache);
-        return &ret;
+        // everything before this job was written already
+        out.redirect(nullptr);
+        writeIp(job->ip, job->fragment.moduleIndex, job->info);
+        out.writeRaw(job->trailer.data(), job->trailer.size());
+
+        if (!m_pendingIps.empty()) {
+            m_heldBytes -= job->trailer.size();
+            out.redirect(&m_pendingIps.back()->trailer);
+        } else {
+            m_heldBytes = 0;
+        }
     }
 
+    enum
+    {
+        // wait for the symbolizers when we would hold back more output than this
+        MAX_HELD_BYTES = 64 * 1024 * 1024
+    };
+
     vector<ModuleFragment> m_moduleFragments;
-    Dwfl* m_dwfl = nullptr;
-    char* m_debugPath = nullptr;
-    Dwfl_Callbacks m_callbacks;
-    SymbolCache m_symbolCache;
     bool m_modulesDirty = false;
+    /// immutable, a new snapshot gets shared with the symbolizers whenever the modules change
+    shared_ptr<const LoadedModules> m_loadedModules = make_shared<LoadedModules>();
+
+    bool m_deferSymbols = false;
+    /// the symbolizers are shared with other tracees, see runDaemon
+    bool m_sharedModules = false;
+    /// maps the module index to its load address that got announced last, see writeModuleBuildId
+    tsl::robin_map<size_t, uintptr_t> m_announcedModules;
+    tsl::robin_map<string, string> m_buildIds;
+
+    unique_ptr<PersistentSymbolCache> m_persistentCache;
+    unique_ptr<JitSymbols> m_jitSymbols;
+    unique_ptr<Symbolizer> m_symbolizer;
+    shared_ptr<SymbolizerPool> m_pool;
+    /// maps the load address to the module that got prepared for it, see SymbolizerPool::prepare and DebuginfodFetcher
+    tsl::robin_map<uintptr_t, string> m_preparedModules;
+    deque<shared_ptr<SymbolizerPool::Job>> m_pendingIps;
+    /// size of the trailers of all pending jobs but the last one
+    size_t m_heldBytes = 0;
 
     tsl::robin_map<string, size_t> m_internedData;
     tsl::robin_map<uintptr_t, size_t> m_encounteredIps;
-    tsl::robin_map<string, Module> m_modules;
 };
 
-struct Stats
+/**
+ * A live allocation, with the time stamp at which it got allocated to find its lifetime when it gets freed.
+ *
+ * The time stamps are truncated to 32bit, which still lets us measure lifetimes of up to 49 days.
+ */
+struct LiveAllocation
 {
-    uint64_t allocations = 0;
-    uint64_t leakedAllocations = 0;
-    uint64_t temporaryAllocations = 0;
-} c_stats;
+    AllocationInfoIndex index;
+    uint32_t timeStamp;
+};
 
-void exitHandler()
+enum : uint32_t
 {
-    fflush(stdout);
+    // the pages of the pointer map get grouped by tenths of their size alive, see HEAPTRACK_INTERPRET_OCCUPANCY
+    PAGE_OCCUPANCY_BUCKETS = 10,
+    // the number of allocation infos that get written per 'o' record, the ones pinning the most bytes come first
+    MAX_PINNING_INFOS = 256,
+};
+
+/// whose data the stats are about on this thread, i.e. a forked child of the tracee or a tracee of the daemon
+thread_local string c_statsSource;
+
+/// set by HEAPTRACK_INTERPRET_STATS to print the detailed stats, see printDetailedStats
+bool c_detailedStats = false;
+/// how often to print the detailed stats while interpreting, or zero to only print them at the end
+chrono::seconds c_statsInterval = {};
+/// set by SIGUSR1 to print the detailed stats once
+volatile sig_atomic_t c_statsRequested = 0;
+
+/**
+ * Print the throughput of the interpreter, to tell whether it is the bottleneck of the recording.
+ */
+void printDetailedStats()
+{
+    const auto symbolizationMs = chrono::duration_cast<chrono::milliseconds>(c_stats.symbolizationTime).count();
+    fprintf(stderr,
+            "heaptrack interpreter stats%s:\n"
+            "\tnew instruction pointers:\t%" PRIu64 " symbolized in %" PRId64 "ms\n"
+            "\tpointer map:             \t%" PRIu64 " live pointers in %" PRIu64 " pages\n"
+            "\tlag behind tracee:       \t%" PRId64 "ms, at most %" PRId64 "ms\n"
+            "\trecords:                 \t",
+            c_statsSource.empty() ? "" : (" of " + c_statsSource).c_str(), c_stats.newIps,
+            static_cast<int64_t>(symbolizationMs), c_stats.livePointers, c_stats.pointerPages,
+            static_cast<int64_t>(c_stats.lag.count()), static_cast<int64_t>(c_stats.maxLag.count()));
+    for (int mode = 0; mode < 128; ++mode) {
+        if (c_stats.records[mode]) {
+            fprintf(stderr, "%c: %" PRIu64 " ", isprint(mode) ? mode : '?', c_stats.records[mode]);
+        }
+    }
+    fprintf(stderr, "\n");
+}
+
+void printStats()
+{
+    if (c_statsSource.empty()) {
+        fprintf(stderr, "heaptrack stats:\n");
+    } else {
+        fprintf(stderr, "heaptrack stats of %s:\n", c_statsSource.c_str());
+    }
     fprintf(stderr,
-            "heaptrack stats:\n"
             "\tallocations:          \t%" PRIu64 "\n"
             "\tleaked allocations:   \t%" PRIu64 "\n"
             "\ttemporary allocations:\t%" PRIu64 "\n",
             c_stats.allocations, c_stats.leakedAllocations, c_stats.temporaryAllocations);
+    if (c_detailedStats) {
+        printDetailedStats();
+    }
 }
+
+void exitHandler()
+{
+    fflush(stdout);
+    printStats();
 }
 
-int main(int /*argc*/, char** /*argv*/)
+/**
+ * A child process that got forked by the tracee, which writes its data to its own pipe.
+ *
+ * See HEAPTRACK_FOLLOW_FORK in libheaptrack. We fork ourselves to interpret the data of
+ * such children concurrently, which lets them reuse the state of our symbolizers.
+ */
+struct ForkedChild
 {
-    [] {
-        // NOTE: we disable debuginfod by default as it can otherwise lead to
-        //       nasty delays otherwise which are highly unexpected to users
-        //       if desired, they can opt in to that via
-        //
-        //       export HEAPTRACK_ENABLE_DEBUGINFOD=1
-        if (!getenv("DEBUGINFOD_URLS")) {
-            return;
+    pid_t pid = 0;
+    string pipe;
+};
+
+/**
+ * Reads the data of a forked child or a tracee of the daemon from its pipe.
+ */
+class FdStreamBuf : public streambuf
+{
+public:
+    explicit FdStreamBuf(int fd)
+        : m_fd(fd)
+        , m_buffer(new char[BUFFER_SIZE])
+    {
+    }
+
+protected:
+    int_type underflow() override
+    {
+        ssize_t size = 0;
+        do {
+            size = ::read(m_fd, m_buffer.get(), BUFFER_SIZE);
+        } while (size < 0 && errno == EINTR);
+        if (size <= 0) {
+            return traits_type::eof();
         }
+        setg(m_buffer.get(), m_buffer.get(), m_buffer.get() + size);
+        return traits_type::to_int_type(*gptr());
+    }
 
-        auto enable = getenv("HEAPTRACK_ENABLE_DEBUGINFOD");
-        if (!enable || !atoi(enable)) {
-            fprintf(stderr,
-                    "NOTE: heaptrack detected DEBUGINFOD_URLS but will disable it to prevent \n"
-                    "unintended network delays during recording\n"
-                    "If you really want to use DEBUGINFOD, export HEAPTRACK_ENABLE_DEBUGINFOD=1\n");
-            unsetenv("DEBUGINFOD_URLS");
+private:
+    enum
+    {
+        BUFFER_SIZE = 256 * 1024
+    };
+    int m_fd;
+    unique_ptr<char[]> m_buffer;
+};
+
+/**
+ * Open the pipe of a forked child or a tracee of the daemon for reading, once it opened it for writing.
+ *
+ * @return the file descriptor or -1 when the tracee didn't show up in time
+ */
+int openTraceePipe(const string& pipe)
+{
+    // the child creates its pipe after it got forked, possibly only after we read its announcement
+    const auto deadline = chrono::steady_clock::now() + chrono::seconds(30);
+    int fd = -1;
+    while ((fd = open(pipe.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC)) == -1) {
+        if ((errno != ENOENT && errno != EINTR) || chrono::steady_clock::now() > deadline) {
+            return -1;
         }
-    }();
+        this_thread::sleep_for(chrono::milliseconds(1));
+    }
 
-    // optimize: we only have a single thread
-    ios_base::sync_with_stdio(false);
-#ifdef __linux__
-    __fsetlocking(stdout, FSETLOCKING_BYCALLER);
-    __fsetlocking(stdin, FSETLOCKING_BYCALLER);
-#endif
+    // no hangup is reported before a writer opened the pipe, so this waits for the child to write its header
+    pollfd pollFd = {fd, POLLIN, 0};
+    const auto timeout = chrono::duration_cast<chrono::milliseconds>(deadline - chrono::steady_clock::now());
+    if (poll(&pollFd, 1, max<int>(0, timeout.count())) != 1) {
+        close(fd);
+        return -1;
+    }
+    unlink(pipe.c_str());
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+    return fd;
+}
 
-    // output data at end, even when we get terminated
-    std::atexit(exitHandler);
+/**
+ * Redirect stdin and stdout for the interpretation of @p child in a forked interpreter.
+ *
+ * The output file is given by $HEAPTRACK_FORK_OUTPUT, where %p is replaced with the pid
+ * of the child. When $HEAPTRACK_FORK_COMPRESSOR is set, the output is piped through that
+ * command, which gets returned in @p compressor.
+ */
+bool redirectToForkedChild(const ForkedChild& child, FILE** compressor)
+{
+    const auto in = openTraceePipe(child.pipe);
+    if (in == -1) {
+        error_out << "failed to open pipe " << child.pipe << " of forked child " << child.pid << ": "
+                  << strerror(errno) << endl;
+        return false;
+    }
+    dup2(in, STDIN_FILENO);
+    close(in);
+
+    string fileName = getenv("HEAPTRACK_FORK_OUTPUT");
+    const auto pidPos = fileName.find("%p");
+    if (pidPos != string::npos) {
+        fileName.replace(pidPos, 2, to_string(child.pid));
+    }
+    const auto out = open(fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (out == -1) {
+        error_out << "failed to open output file " << fileName << ": " << strerror(errno) << endl;
+        return false;
+    }
+    // this also closes the output of our parent, which it inherited
+    dup2(out, STDOUT_FILENO);
+    close(out);
+    if (*compressor) {
+        // the compressor of our parent must see the end of its input
+        close(fileno(*compressor));
+        *compressor = nullptr;
+    }
+
+    if (const auto command = getenv("HEAPTRACK_FORK_COMPRESSOR")) {
+        // the command inherits our stdout, i.e. it writes to the output file
+        *compressor = popen(command, "w");
+        if (!*compressor) {
+            error_out << "failed to run " << command << ": " << strerror(errno) << endl;
+            return false;
+        }
+        dup2(fileno(*compressor), STDOUT_FILENO);
+    }
 
-    AccumulatedTraceData data;
+    cerr << "heaptrack output of forked child " << child.pid << " will be written to \"" << fileName << "\"" << endl;
+    return true;
+}
 
+/**
+ * Interpret the raw data of a single tracee from @p input.
+ *
+ * When the tracee announces a forked child, we fork ourselves. In our child,
+ * this returns right away with @p forkedChild filled in. Without @p forkedChild,
+ * the forked children get ignored.
+ *
+ * @p inFd is the file descriptor of @p in, to detect the end of a shared memory ring
+ */
+int interpret(AccumulatedTraceData& data, istream& in, int inFd, ForkedChild* forkedChild)
+{
     LineReader reader;
 
     string exe;
 
-    PointerMap ptrToIndex;
+    BasicPointerMap<LiveAllocation> ptrToIndex;
+    MemoryMappings mappings;
+    // the latest time stamp in milliseconds, see 'c'
+    uint64_t timeStamp = 0;
     uint64_t lastPtr = 0;
     AllocationInfoSet allocationInfos;
+    // the trace indices of the tracker restart whenever it clears its trace tree, see 'C'. from then on,
+    // they get mapped onto the trace nodes we wrote already, such that the output has one consistent tree
+    // this also merges the trace nodes that got recorded by multiple threads with HEAPTRACK_THREAD_BUFFERS
+    // the ip index and parent of every written trace node, indexed by the trace index - 1
+    vector<uint64_t> traceNodes;
+    // the written trace nodes by their key in traceNodes, only filled once the trace tree got cleared
+    tsl::robin_map<uint64_t, uint32_t> knownTraceNodes;
+    // the written trace index for every trace index of the tracker since it cleared its trace tree
+    vector<uint32_t> traceIndices;
+    bool mapTraceIndices = false;
+    auto mapTraceIndex = [&mapTraceIndices, &traceIndices](uint32_t* index) {
+        if (mapTraceIndices) {
+            *index = *index < traceIndices.size() ? traceIndices[*index] : 0;
+        }
+    };
+    // the thread that allocates or frees, see HEAPTRACK_TRACK_THREADS
+    uint32_t threadIndex = 0;
+    // the allocating thread of every allocation info, indexed by the allocation info index
+    vector<uint32_t> infoThreads;
+    // with HEAPTRACK_INTERPRET_OCCUPANCY, how full the pages of ptrToIndex are gets written every that many
+    // milliseconds, see writePageOccupancy
+    const auto occupancyEnv = getenv("HEAPTRACK_INTERPRET_OCCUPANCY");
+    const uint64_t occupancyInterval = occupancyEnv ? strtoull(occupancyEnv, nullptr, 10) : 0;
+    uint64_t nextOccupancy = 0;
+    // the size of every allocation info, indexed by the allocation info index, only kept for the occupancy
+    vector<uint64_t> infoSizes;
+    auto writeAllocationInfo = [&data, &threadIndex, &infoThreads, occupancyInterval,
+                                &infoSizes](uint64_t size, TraceIndex traceId, uint32_t poolIndex) {
+        // the allocation infos get consecutive indices
+        infoThreads.push_back(threadIndex);
+        if (occupancyInterval) {
+            infoSizes.push_back(size);
+        }
+        if (poolIndex) {
+            data.out.writeHexLine('a', size, traceId.index, threadIndex, poolIndex);
+        } else if (threadIndex) {
+            data.out.writeHexLine('a', size, traceId.index, threadIndex);
+        } else {
+            data.out.writeHexLine('a', size, traceId.index);
+        }
+    };
+    // the live allocations of the pools announced via 'Q', indexed by the pool index - 1
+    // these are kept apart from ptrToIndex, such that destroying a pool can free all of them at once
+    vector<tsl::robin_map<uint64_t, LiveAllocation>> pools;
+    auto findPool = [&pools](uint32_t poolIndex) -> tsl::robin_map<uint64_t, LiveAllocation>* {
+        if (!poolIndex || poolIndex > pools.size()) {
+            return nullptr;
+        }
+        return &pools[poolIndex - 1];
+    };
 
-    while (reader.getLine(cin)) {
-        if (reader.mode() == 'v') {
+    // with HEAPTRACK_INTERPRET_AGGREGATE, the allocations and deallocations get counted per allocation info
+    // and only written out as 'e' records once per time stamp, the live pointers are tracked nevertheless
+    struct IntervalCost
+    {
+        uint64_t allocations = 0;
+        uint64_t deallocations = 0;
+        uint64_t temporary = 0;
+        uint64_t remote = 0;
+    };
+    const auto aggregateEnv = getenv("HEAPTRACK_INTERPRET_AGGREGATE");
+    const bool aggregate = aggregateEnv && strcmp(aggregateEnv, "0") != 0;
+    vector<IntervalCost> intervalCosts;
+    // the allocation infos with a non-zero interval cost
+    vector<uint32_t> intervalInfos;
+    auto intervalCost = [&intervalCosts, &intervalInfos](AllocationInfoIndex index) -> IntervalCost& {
+        if (index.index >= intervalCosts.size()) {
+            intervalCosts.resize(index.index + 1);
+        }
+        auto& cost = intervalCosts[index.index];
+        if (!cost.allocations && !cost.deallocations) {
+            intervalInfos.push_back(index.index);
+        }
+        return cost;
+    };
+    // like the analysis of the individual records, count a deallocation as temporary when it directly
+    // follows an allocation of the same allocation info, see lastAllocationPtr in AccumulatedTraceData
+    uint32_t lastAllocation = 0;
+    // a free by another thread than the allocating one, which most allocators handle on a slower path
+    auto isRemoteFree = [&threadIndex, &infoThreads](AllocationInfoIndex index) {
+        const auto allocatingThread = index.index < infoThreads.size() ? infoThreads[index.index] : 0;
+        return threadIndex && allocatingThread && threadIndex != allocatingThread;
+    };
+    auto writeAllocation = [&](AllocationInfoIndex index) {
+        if (aggregate) {
+            ++intervalCost(index).allocations;
+            lastAllocation = index.index + 1;
+        } else {
+            data.out.writeHexLine('+', index.index);
+        }
+    };
+    auto writeDeallocation = [&](AllocationInfoIndex index, uint32_t lifetime) {
+        if (aggregate) {
+            auto& cost = intervalCost(index);
+            ++cost.deallocations;
+            cost.temporary += lastAllocation == index.index + 1;
+            cost.remote += isRemoteFree(index);
+            lastAllocation = 0;
+        } else if (isRemoteFree(index)) {
+            data.out.writeHexLine('-', index.index, lifetime, 1u);
+        } else {
+            data.out.writeHexLine('-', index.index, lifetime);
+        }
+    };
+    // a deallocation directly followed by an allocation, both get counted separately when aggregating
+    // @p moved tells whether the data had to be copied to a new address
+    auto writeReallocation = [&](AllocationInfoIndex index, AllocationInfoIndex freedIndex, uint32_t lifetime,
+                                 bool moved) {
+        if (aggregate) {
+            writeDeallocation(freedIndex, lifetime);
+            writeAllocation(index);
+        } else if (isRemoteFree(freedIndex)) {
+            data.out.writeHexLine('r', index.index, freedIndex.index, lifetime, static_cast<uint32_t>(moved), 1u);
+        } else {
+            data.out.writeHexLine('r', index.index, freedIndex.index, lifetime, static_cast<uint32_t>(moved));
+        }
+    };
+    auto writeIntervalCosts = [&]() {
+        for (const auto index : intervalInfos) {
+            auto& cost = intervalCosts[index];
+            if (cost.remote) {
+                data.out.writeHexLine('e', index, cost.allocations, cost.deallocations, cost.temporary, cost.remote);
+            } else {
+                data.out.writeHexLine('e', index, cost.allocations, cost.deallocations, cost.temporary);
+            }
+            cost = {};
+        }
+        intervalInfos.clear();
+    };
+
+    // the bytes of the sparse pages each allocation info keeps alive, reused for every 'o' record
+    tsl::robin_map<uint32_t, uint64_t> pinnedBytes;
+    vector<pair<uint32_t, uint64_t>> pinningInfos;
+    // the number of pages per tenth of their size that is alive, and the allocation infos that pin the pages of
+    // the first bucket: as long as a page holds any live allocation, the allocator cannot return it to the system
+    auto writePageOccupancy = [&]() {
+        array<uint64_t, PAGE_OCCUPANCY_BUCKETS> pages = {};
+        pinnedBytes.clear();
+        ptrToIndex.forEachPage([&](const vector<LiveAllocation>& allocations) {
+            uint64_t bytes = 0;
+            for (const auto& allocation : allocations) {
+                bytes += allocation.index.index < infoSizes.size() ? infoSizes[allocation.index.index] : 0;
+            }
+            // an allocation that starts on this page may extend into the next ones, which then count as full
+            const auto bucket = min<uint64_t>(bytes * PAGE_OCCUPANCY_BUCKETS / SplitPointer::PageSize,
+                                              PAGE_OCCUPANCY_BUCKETS - 1);
+            ++pages[bucket];
+            if (bucket == 0) {
+                // the page is pinned by all of its allocations alike
+                const uint64_t share = SplitPointer::PageSize / allocations.size();
+                for (const auto& allocation : allocations) {
+                    pinnedBytes[allocation.index.index] += share;
+                }
+            }
+        });
+
+        pinningInfos.assign(pinnedBytes.begin(), pinnedBytes.end());
+        const auto numPinningInfos = min(pinningInfos.size(), size_t(MAX_PINNING_INFOS));
+        partial_sort(pinningInfos.begin(), pinningInfos.begin() + numPinningInfos, pinningInfos.end(),
+                     [](const pair<uint32_t, uint64_t>& lhs, const pair<uint32_t, uint64_t>& rhs) {
+                         return lhs.second > rhs.second;
+                     });
+
+        data.out.write("o %x %x", static_cast<uint32_t>(SplitPointer::PageSize), PAGE_OCCUPANCY_BUCKETS);
+        for (const auto numPages : pages) {
+            data.out.write(" %" PRIx64, numPages);
+        }
+        for (size_t i = 0; i < numPinningInfos; ++i) {
+            data.out.write(" %x %" PRIx64, pinningInfos[i].first, pinningInfos[i].second);
+        }
+        data.out.write("\n");
+    };
+
+    // binary records delta encode their (instruction) pointers, see LineWriter::writeVarintRecord
+    uint64_t lastBinaryPtr = 0;
+    uint64_t lastBinaryIp = 0;
+    auto undoDelta = [](uint64_t value, uint64_t* last) {
+        *last += static_cast<uint64_t>(LineReader::unzigzag(value));
+        return *last;
+    };
+
+    // the difference between our clock and the time stamps of the tracee when we read the first one,
+    // we fall behind by as much as it grows afterwards
+    bool hasClockOffset = false;
+    chrono::steady_clock::duration clockOffset = {};
+    auto nextStats = chrono::steady_clock::now() + c_statsInterval;
+    auto updateStats = [&](chrono::steady_clock::time_point now) {
+        const auto offset = now.time_since_epoch() - chrono::milliseconds(timeStamp);
+        if (!hasClockOffset) {
+            clockOffset = offset;
+            hasClockOffset = true;
+        }
+        c_stats.lag = max(chrono::milliseconds(0), chrono::duration_cast<chrono::milliseconds>(offset - clockOffset));
+        c_stats.maxLag = max(c_stats.maxLag, c_stats.lag);
+        c_stats.livePointers = ptrToIndex.size();
+        c_stats.pointerPages = ptrToIndex.pages();
+    };
+
+    // the tracee may switch us over to a shared memory ring, stdin is then only used to detect its end
+    istream* input = &in;
+    unique_ptr<ShmRing> ring;
+    unique_ptr<ShmRingStreamBuf> ringBuffer;
+    unique_ptr<istream> ringStream;
+
+    while (reader.getRecord(*input)) {
+        ++c_stats.records[static_cast<unsigned char>(reader.mode()) % 128];
+        if (reader.mode() == '\0') {
+            // the unused rest of a memory mapped output, see HEAPTRACK_MMAP_OUTPUT, when the tracee crashed
+            break;
+        } else if (reader.mode() == 'M') {
+            if (ring) {
+                error_out << "received duplicate shared memory event" << endl;
+                return 1;
+            }
+            const auto name = reader.line().substr(2);
+            ring.reset(ShmRing::open(name));
+            if (!ring) {
+                error_out << "failed to open shared memory " << name << ": " << strerror(errno) << endl;
+                return 1;
+            }
+            ringBuffer.reset(new ShmRingStreamBuf(ring.get(), inFd));
+            ringStream.reset(new istream(ringBuffer.get()));
+            input = ringStream.get();
+        } else if (reader.mode() == 'v') {
             unsigned int heaptrackVersion = 0;
             reader >> heaptrackVersion;
             unsigned int fileVersion = 0;
@@ -528,16 +1190,57 @@ int main(int /*argc*/, char** /*argv*/)
             if (fileVersion >= 3) {
                 reader.setExpectedSizedStrings(true);
             }
-            data.out.write("%s\n", reader.line().c_str());
+            if (fileVersion >= HEAPTRACK_BINARY_FILE_FORMAT_VERSION) {
+                reader.setExpectBinaryRecords(true);
+            }
+            data.out.write("%s\n", reader.rawLine());
         } else if (reader.mode() == 'x') {
             if (!exe.empty()) {
-                error_out << "received duplicate exe event - child process tracking is not yet supported" << endl;
+                error_out << "received duplicate exe event" << endl;
                 return 1;
             }
             reader >> exe;
+        } else if (reader.mode() == 'p') {
+            uint64_t pid = 0;
+            if (!(reader >> pid)) {
+                error_out << "failed to parse line: " << reader.line() << endl;
+                continue;
+            }
+            data.setProcessId(static_cast<pid_t>(pid));
+        } else if (reader.mode() == 'F') {
+            uint64_t pid = 0;
+            ForkedChild child;
+            if (!(reader >> pid) || !(reader >> child.pipe)) {
+                error_out << "failed to parse line: " << reader.line() << endl;
+                continue;
+            }
+            child.pid = static_cast<pid_t>(pid);
+            if (!forkedChild) {
+                error_out << "ignoring forked child " << child.pid << ", the daemon cannot follow it" << endl;
+                continue;
+            } else if (!getenv("HEAPTRACK_FORK_OUTPUT")) {
+                error_out << "ignoring forked child " << child.pid << ", HEAPTRACK_FORK_OUTPUT is not set" << endl;
+                continue;
+            }
+            // our threads don't survive the fork, so the symbolizers must be idle
+            data.finishPendingIps();
+            data.cancelModulePreparations();
+            const auto ret = fork();
+            if (ret == 0) {
+                // the data of the shared memory ring is up to our parent
+                ring.release();
+                ringBuffer.release();
+                ringStream.release();
+                *forkedChild = std::move(child);
+                return 0;
+            } else if (ret < 0) {
+                error_out << "failed to fork for child " << child.pid << ": " << strerror(errno) << endl;
+            }
         } else if (reader.mode() == 'm') {
             string fileName;
             reader >> fileName;
+            // the module name gets interned below
+            data.finishPendingIps();
             if (fileName == "-") {
                 data.clearModules();
             } else {
@@ -558,6 +1261,24 @@ int main(int /*argc*/, char** /*argv*/)
                                    addressStart + vAddr + memSize);
                 }
             }
+        } else if (reader.mode() == 'B') {
+            // the build-id of a module that only exists on the traced machine
+            string fileName;
+            string buildId;
+            if (!(reader >> fileName) || !(reader >> buildId)) {
+                error_out << "failed to parse line: " << reader.line() << endl;
+                continue;
+            }
+            data.setBuildId(fileName, std::move(buildId));
+        } else if (reader.mode() == 'u') {
+            // the module loaded at the given address got unloaded
+            uintptr_t addressStart = 0;
+            if (!(reader >> addressStart)) {
+                error_out << "failed to parse line: " << reader.line() << endl;
+                return 1;
+            }
+            data.finishPendingIps();
+            data.removeModule(addressStart);
         } else if (reader.mode() == 't') {
             uintptr_t instructionPointer = 0;
             size_t parentIndex = 0;
@@ -565,10 +1286,37 @@ int main(int /*argc*/, char** /*argv*/)
                 error_out << "failed to parse line: " << reader.line() << endl;
                 return 1;
             }
+            if (reader.isBinary()) {
+                instructionPointer = undoDelta(instructionPointer, &lastBinaryIp);
+            }
             // ensure ip is encountered
             const auto ipId = data.addIp(instructionPointer);
+            uint32_t parent = parentIndex;
+            mapTraceIndex(&parent);
+            const auto key = (static_cast<uint64_t>(ipId) << 32) | parent;
+            if (mapTraceIndices) {
+                auto known = knownTraceNodes.find(key);
+                if (known != knownTraceNodes.end()) {
+                    traceIndices.push_back(known->second);
+                    continue;
+                }
+                knownTraceNodes.insert({key, traceNodes.size() + 1});
+                traceIndices.push_back(traceNodes.size() + 1);
+            }
+            traceNodes.push_back(key);
             // trace point, map current output index to parent index
-            data.out.writeHexLine('t', ipId, parentIndex);
+            data.out.writeHexLine('t', ipId, parent);
+        } else if (reader.mode() == 'C') {
+            // the tracker cleared its trace tree, see HEAPTRACK_TRACE_TREE_LIMIT, or announces that
+            // its threads index their traces separately, which can lead to duplicate trace nodes
+            if (!mapTraceIndices) {
+                mapTraceIndices = true;
+                knownTraceNodes.reserve(traceNodes.size());
+                for (uint32_t i = 0; i < traceNodes.size(); ++i) {
+                    knownTraceNodes.insert({traceNodes[i], i + 1});
+                }
+            }
+            traceIndices.assign(1, 0);
         } else if (reader.mode() == '+') {
             ++c_stats.allocations;
             ++c_stats.leakedAllocations;
@@ -579,35 +1327,449 @@ int main(int /*argc*/, char** /*argv*/)
                 error_out << "failed to parse line: " << reader.line() << endl;
                 continue;
             }
+            if (reader.isBinary()) {
+                ptr = undoDelta(ptr, &lastBinaryPtr);
+            }
+            mapTraceIndex(&traceId.index);
 
             AllocationInfoIndex index;
-            if (allocationInfos.add(size, traceId, &index)) {
-                data.out.writeHexLine('a', size, traceId.index);
+            if (allocationInfos.add(size, traceId, threadIndex, 0, &index)) {
+                writeAllocationInfo(size, traceId, 0);
             }
-            ptrToIndex.addPointer(ptr, index);
+            ptrToIndex.addPointer(ptr, {index, static_cast<uint32_t>(timeStamp)});
             lastPtr = ptr;
-            data.out.writeHexLine('+', index.index);
+            writeAllocation(index);
         } else if (reader.mode() == '-') {
             uint64_t ptr = 0;
             if (!(reader >> ptr)) {
                 error_out << "failed to parse line: " << reader.line() << endl;
                 continue;
             }
+            if (reader.isBinary()) {
+                ptr = undoDelta(ptr, &lastBinaryPtr);
+            }
             bool temporary = lastPtr == ptr;
             lastPtr = 0;
             auto allocation = ptrToIndex.takePointer(ptr);
             if (!allocation.second) {
                 continue;
             }
-            data.out.writeHexLine('-', allocation.first.index);
+            // the lifetime in milliseconds, the analysis also handles older files that don't contain it
+            const uint32_t lifetime = static_cast<uint32_t>(timeStamp) - allocation.first.timeStamp;
+            writeDeallocation(allocation.first.index, lifetime);
             if (temporary) {
                 ++c_stats.temporaryAllocations;
             }
             --c_stats.leakedAllocations;
+        } else if (reader.mode() == 'r') {
+            // a reallocation, the same as a '-' record for the old pointer followed by a '+' record
+            ++c_stats.allocations;
+            ++c_stats.leakedAllocations;
+            uint64_t size = 0;
+            TraceIndex traceId;
+            uint64_t oldPtr = 0;
+            uint64_t ptr = 0;
+            if (!(reader >> size) || !(reader >> traceId.index) || !(reader >> oldPtr) || !(reader >> ptr)) {
+                error_out << "failed to parse line: " << reader.line() << endl;
+                continue;
+            }
+            if (reader.isBinary()) {
+                oldPtr = undoDelta(oldPtr, &lastBinaryPtr);
+                ptr = undoDelta(ptr, &lastBinaryPtr);
+            }
+            mapTraceIndex(&traceId.index);
+
+            const bool temporary = lastPtr == oldPtr;
+            auto freed = ptrToIndex.takePointer(oldPtr);
+
+            AllocationInfoIndex index;
+            if (allocationInfos.add(size, traceId, threadIndex, 0, &index)) {
+                writeAllocationInfo(size, traceId, 0);
+            }
+            ptrToIndex.addPointer(ptr, {index, static_cast<uint32_t>(timeStamp)});
+            lastPtr = ptr;
+
+            if (freed.second) {
+                const uint32_t lifetime = static_cast<uint32_t>(timeStamp) - freed.first.timeStamp;
+                writeReallocation(index, freed.first.index, lifetime, ptr != oldPtr);
+                if (temporary) {
+                    ++c_stats.temporaryAllocations;
+                }
+                --c_stats.leakedAllocations;
+            } else {
+                writeAllocation(index);
+            }
+        } else if (reader.mode() == 'T') {
+            // an allocation that got freed right away, collapsed by HEAPTRACK_COLLAPSE_TEMPORARY
+            ++c_stats.allocations;
+            ++c_stats.temporaryAllocations;
+            uint64_t size = 0;
+            TraceIndex traceId;
+            if (!(reader >> size) || !(reader >> traceId.index)) {
+                error_out << "failed to parse line: " << reader.line() << endl;
+                continue;
+            }
+            mapTraceIndex(&traceId.index);
+
+            AllocationInfoIndex index;
+            if (allocationInfos.add(size, traceId, threadIndex, 0, &index)) {
+                writeAllocationInfo(size, traceId, 0);
+            }
+            lastPtr = 0;
+            writeAllocation(index);
+            writeDeallocation(index, 0);
+        } else if (reader.mode() == 'Q') {
+            // a new pool, which gets the next pool index, see heaptrack_pool_malloc
+            pools.emplace_back();
+            data.out.write("%s\n", reader.rawLine());
+        } else if (reader.mode() == 'y') {
+            // an allocation out of a pool
+            ++c_stats.allocations;
+            ++c_stats.leakedAllocations;
+            uint32_t poolIndex = 0;
+            uint64_t size = 0;
+            TraceIndex traceId;
+            uint64_t ptr = 0;
+            if (!(reader >> poolIndex) || !(reader >> size) || !(reader >> traceId.index) || !(reader >> ptr)) {
+                error_out << "failed to parse line: " << reader.line() << endl;
+                continue;
+            }
+            mapTraceIndex(&traceId.index);
+            auto pool = findPool(poolIndex);
+            if (!pool) {
+                error_out << "unknown pool in line: " << reader.line() << endl;
+                continue;
+            }
+
+            AllocationInfoIndex index;
+            if (allocationInfos.add(size, traceId, threadIndex, poolIndex, &index)) {
+                writeAllocationInfo(size, traceId, poolIndex);
+            }
+            (*pool)[ptr] = {index, static_cast<uint32_t>(timeStamp)};
+            lastPtr = ptr;
+            writeAllocation(index);
+        } else if (reader.mode() == 'Y') {
+            // a deallocation out of a pool
+            uint32_t poolIndex = 0;
+            uint64_t ptr = 0;
+            if (!(reader >> poolIndex) || !(reader >> ptr)) {
+                error_out << "failed to parse line: " << reader.line() << endl;
+                continue;
+            }
+            auto pool = findPool(poolIndex);
+            if (!pool) {
+                continue;
+            }
+            auto it = pool->find(ptr);
+            if (it == pool->end()) {
+                continue;
+            }
+            const bool temporary = lastPtr == ptr;
+            lastPtr = 0;
+            const uint32_t lifetime = static_cast<uint32_t>(timeStamp) - it->second.timeStamp;
+            writeDeallocation(it->second.index, lifetime);
+            pool->erase(it);
+            if (temporary) {
+                ++c_stats.temporaryAllocations;
+            }
+            --c_stats.leakedAllocations;
+        } else if (reader.mode() == 'z') {
+            // a pool got destroyed, which frees all of its live allocations
+            uint32_t poolIndex = 0;
+            if (!(reader >> poolIndex)) {
+                error_out << "failed to parse line: " << reader.line() << endl;
+                continue;
+            }
+            auto pool = findPool(poolIndex);
+            if (!pool) {
+                continue;
+            }
+            // the allocations of a pool tend to share few allocation infos, write one record for each of them
+            // the aggregated allocations must be known before they can get freed
+            writeIntervalCosts();
+            lastAllocation = 0;
+            tsl::robin_map<uint32_t, uint64_t> freed;
+            for (const auto& allocation : *pool) {
+                ++freed[allocation.second.index.index];
+            }
+            for (const auto& entry : freed) {
+                data.out.writeHexLine('z', entry.first, entry.second);
+            }
+            c_stats.leakedAllocations -= pool->size();
+            lastPtr = 0;
+            // the pool handle may get reused for a new pool, which starts out empty
+            tsl::robin_map<uint64_t, LiveAllocation>().swap(*pool);
+        } else if (reader.mode() == 'H') {
+            // a new thread, which gets the next thread index
+            uint64_t tid = 0;
+            string name;
+            if (!(reader >> tid) || !(reader >> name)) {
+                error_out << "failed to parse line: " << reader.line() << endl;
+                continue;
+            }
+            const auto nameIndex = data.intern(name);
+            data.out.writeHexLine('H', tid, nameIndex);
+        } else if (reader.mode() == 'h') {
+            // the following allocations belong to the given thread
+            if (!(reader >> threadIndex)) {
+                error_out << "failed to parse line: " << reader.line() << endl;
+                continue;
+            }
+        } else if (reader.mode() == 'k') {
+            // anonymous memory got mapped, see HEAPTRACK_TRACK_MMAP
+            uint64_t ptr = 0;
+            uint64_t size = 0;
+            uint32_t traceIndex = 0;
+            if (!(reader >> ptr) || !(reader >> size) || !(reader >> traceIndex)) {
+                error_out << "failed to parse line: " << reader.line() << endl;
+                continue;
+            }
+            mapTraceIndex(&traceIndex);
+            const auto unmapped = [&data](uint64_t size, uint32_t traceIndex) {
+                data.out.writeHexLine('K', size, traceIndex);
+            };
+            uint64_t oldPtr = 0;
+            uint64_t oldSize = 0;
+            if ((reader >> oldPtr) && (reader >> oldSize)) {
+                // moved or resized by mremap, which may be used on any other kind of mapping too
+                // the whole new mapping gets attributed to the trace of the mremap call
+                if (!mappings.unmap(oldPtr, oldSize, unmapped)) {
+                    continue;
+                }
+            }
+            mappings.map(ptr, size, traceIndex, unmapped);
+            data.out.writeHexLine('k', size, traceIndex);
+        } else if (reader.mode() == 'K') {
+            uint64_t ptr = 0;
+            uint64_t size = 0;
+            if (!(reader >> ptr) || !(reader >> size)) {
+                error_out << "failed to parse line: " << reader.line() << endl;
+                continue;
+            }
+            mappings.unmap(ptr, size, [&data](uint64_t size, uint32_t traceIndex) {
+                data.out.writeHexLine('K', size, traceIndex);
+            });
+        } else if (reader.mode() == 'c') {
+            if (!(reader >> timeStamp)) {
+                error_out << "failed to parse line: " << reader.line() << endl;
+            }
+            writeIntervalCosts();
+            data.out.write("%s\n", reader.rawLine());
+            if (occupancyInterval && timeStamp >= nextOccupancy) {
+                writePageOccupancy();
+                nextOccupancy = timeStamp + occupancyInterval;
+            }
+            const auto now = chrono::steady_clock::now();
+            updateStats(now);
+            if (c_statsRequested || (c_statsInterval.count() && now >= nextStats)) {
+                c_statsRequested = 0;
+                nextStats = now + c_statsInterval;
+                printDetailedStats();
+            }
+        } else if (reader.mode() == 'P') {
+            // the sampling interval got changed, allocations recorded from now on need separate allocation infos
+            allocationInfos.forget();
+            data.out.write("%s\n", reader.rawLine());
+        } else if (reader.mode() == 'd') {
+            // aggregated snapshot, see HEAPTRACK_AGGREGATE
+            uint64_t traceIndex = 0;
+            uint64_t allocations = 0;
+            uint64_t deallocations = 0;
+            uint64_t temporary = 0;
+            if (!(reader >> traceIndex) || !(reader >> allocations) || !(reader >> deallocations)
+                || !(reader >> temporary)) {
+                error_out << "failed to parse line: " << reader.line() << endl;
+                continue;
+            }
+            c_stats.allocations += allocations;
+            c_stats.leakedAllocations += allocations - deallocations;
+            c_stats.temporaryAllocations += temporary;
+            data.out.write("%s\n", reader.rawLine());
         } else {
-            data.out.write("%s\n", reader.line().c_str());
+            data.out.write("%s\n", reader.rawLine());
         }
+
+        data.writeResolvedIps();
     }
 
+    writeIntervalCosts();
+    data.finishPendingIps();
+    updateStats(chrono::steady_clock::now());
     return 0;
 }
+
+/**
+ * A tracee that got announced to the daemon by the heaptrack script, see runDaemon.
+ */
+struct DaemonRequest
+{
+    /// the named pipe the tracee writes its data to
+    string pipe;
+    string output;
+    /// the named pipe that gets opened and closed again once the output is complete
+    string done;
+};
+
+void interpretForDaemon(const DaemonRequest& request, shared_ptr<SymbolizerPool> pool)
+{
+    c_statsSource = request.output;
+
+    const auto in = openTraceePipe(request.pipe);
+    if (in == -1) {
+        error_out << "failed to open pipe " << request.pipe << ": " << strerror(errno) << endl;
+    } else {
+        const auto out = open(request.output.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (out == -1) {
+            error_out << "failed to open output file " << request.output << ": " << strerror(errno) << endl;
+        } else {
+            {
+                // the output gets closed along with the data
+                AccumulatedTraceData data(out, std::move(pool));
+                FdStreamBuf buffer(in);
+                istream input(&buffer);
+                interpret(data, input, in, nullptr);
+            }
+            printStats();
+        }
+        close(in);
+    }
+
+    // the heaptrack script waits for a writer to show up, it may be gone already
+    const auto done = open(request.done.c_str(), O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+    if (done != -1) {
+        close(done);
+    }
+}
+
+/**
+ * Interpret the data of all tracees that get announced through the named pipe @p requestPipe.
+ *
+ * Every request is a line with the pipe of the tracee, the output file and the pipe that signals
+ * that the output is complete, separated by tabs, see DaemonRequest. The tracees get interpreted
+ * on threads of their own, which share a single pool of symbolizers. Every module only gets loaded
+ * once for all of them, identified by its build-id, which saves a lot of memory and time when
+ * many processes of the same executable get traced at the same time.
+ */
+int runDaemon(const char* requestPipe)
+{
+#if ZSTD_FOUND
+    if (mkfifo(requestPipe, 0600) == -1 && errno != EEXIST) {
+        error_out << "failed to create pipe " << requestPipe << ": " << strerror(errno) << endl;
+        return 1;
+    }
+    // keep a writer around ourselves, such that we don't see the end whenever a heaptrack script closes it
+    const auto fd = open(requestPipe, O_RDWR | O_CLOEXEC);
+    if (fd == -1) {
+        error_out << "failed to open pipe " << requestPipe << ": " << strerror(errno) << endl;
+        return 1;
+    }
+
+    // the symbolizers refer to the cache for as long as we run
+    const auto persistentCache = PersistentSymbolCache::fromEnvironment();
+    auto pool = make_shared<SymbolizerPool>(max(symbolizerThreads(), 1u), persistentCache, true);
+
+    cerr << "heaptrack interpreter daemon waiting for tracees announced via " << requestPipe << endl;
+
+    FdStreamBuf buffer(fd);
+    istream requests(&buffer);
+    string line;
+    while (getline(requests, line)) {
+        DaemonRequest request;
+        const auto outputStart = line.find('\t');
+        const auto doneStart = outputStart == string::npos ? outputStart : line.find('\t', outputStart + 1);
+        if (doneStart == string::npos) {
+            error_out << "invalid request: " << line << endl;
+            continue;
+        }
+        request.pipe = line.substr(0, outputStart);
+        request.output = line.substr(outputStart + 1, doneStart - outputStart - 1);
+        request.done = line.substr(doneStart + 1);
+        cerr << "heaptrack output of " << request.pipe << " will be written to \"" << request.output << "\"" << endl;
+        thread(&interpretForDaemon, std::move(request), pool).detach();
+    }
+    return 0;
+#else
+    error_out << "the interpreter daemon for " << requestPipe << " requires zstd support" << endl;
+    return 1;
+#endif
+}
+}
+
+int main(int /*argc*/, char** /*argv*/)
+{
+    [] {
+        // NOTE: we disable debuginfod by default as it can otherwise lead to
+        //       nasty delays otherwise which are highly unexpected to users
+        //       if desired, they can opt in to that via
+        //
+        //       export HEAPTRACK_ENABLE_DEBUGINFOD=1
+        if (!getenv("DEBUGINFOD_URLS")) {
+            return;
+        }
+
+        auto enable = getenv("HEAPTRACK_ENABLE_DEBUGINFOD");
+        if (!enable || !atoi(enable)) {
+            fprintf(stderr,
+                    "NOTE: heaptrack detected DEBUGINFOD_URLS but will disable it to prevent \n"
+                    "unintended network delays during recording\n"
+                    "If you really want to use DEBUGINFOD, export HEAPTRACK_ENABLE_DEBUGINFOD=1\n");
+            unsetenv("DEBUGINFOD_URLS");
+        }
+    }();
+
+    // interpret the data of many tracees at once with HEAPTRACK_INTERPRET_DAEMON, see runDaemon
+    if (const auto daemonEnv = getenv("HEAPTRACK_INTERPRET_DAEMON")) {
+        return runDaemon(daemonEnv);
+    }
+
+    // optimize: we only have a single thread
+    ios_base::sync_with_stdio(false);
+#ifdef __linux__
+    __fsetlocking(stdout, FSETLOCKING_BYCALLER);
+    __fsetlocking(stdin, FSETLOCKING_BYCALLER);
+#endif
+
+    // output data at end, even when we get terminated
+    std::atexit(exitHandler);
+
+    // print the detailed stats every given number of seconds, and at the end
+    if (const auto statsEnv = getenv("HEAPTRACK_INTERPRET_STATS")) {
+        c_detailedStats = true;
+        c_statsInterval = chrono::seconds(max(0, atoi(statsEnv)));
+    }
+    // or print them once on request
+    signal(SIGUSR1, [](int) { c_statsRequested = 1; });
+
+    unique_ptr<AccumulatedTraceData> data(new AccumulatedTraceData);
+    ForkedChild forkedChild;
+    int ret = interpret(*data, cin, fileno(stdin), &forkedChild);
+
+    FILE* compressor = nullptr;
+    while (forkedChild.pid) {
+        // we got forked to interpret the data of a forked child of the tracee
+        if (!redirectToForkedChild(forkedChild, &compressor)) {
+            return 1;
+        }
+        // our parent's data must not be destroyed here, it would write to our new output
+        data.reset(new AccumulatedTraceData(data.release()));
+        data->setProcessId(forkedChild.pid);
+        c_stats = {};
+        c_statsSource = "forked child " + to_string(forkedChild.pid);
+
+        FdStreamBuf buffer(STDIN_FILENO);
+        istream input(&buffer);
+        forkedChild = {};
+        ret = interpret(*data, input, STDIN_FILENO, &forkedChild);
+    }
+
+    // write the remaining data and close the output
+    data.reset();
+    if (compressor) {
+        pclose(compressor);
+    }
+
+    // the heaptrack script waits for us, so we wait for the interpreters of the forked children
+    while (wait(nullptr) != -1 || errno == EINTR) {
+    }
+    return ret;
+}
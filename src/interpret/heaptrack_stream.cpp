@@ -0,0 +1,488 @@
+/*
+    SPDX-FileCopyrightText: 2026 Milian Wolff <mail@milianw.de>
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+/**
+ * @file heaptrack_stream.cpp
+ *
+ * @brief Stream the raw data of a traced process over TCP to a collector that interprets it.
+ *
+ * The sender reads the raw data from stdin, batches complete records and sends them as
+ * compressed frames. A frame never splits a record, so a dropped connection only truncates
+ * the data on the collector after the last complete frame. The sender also announces the
+ * build-ids of the modules in 'B' records, as the collector cannot read the module files.
+ *
+ * The receiver accepts a single connection and writes the uncompressed data to stdout,
+ * from where heaptrack_interpret reads it, see heaptrack --collect.
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <errno.h>
+#include <netdb.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <zstd.h>
+
+#include "symbolizer.h"
+
+#include "util/linereader.h"
+
+#include <tsl/robin_map.h>
+
+using namespace std;
+
+namespace {
+#define error_out cerr << __FILE__ << ':' << __LINE__ << " ERROR:"
+
+const char MAGIC[8] = {'H', 'T', 'S', 'T', 'R', 'M', '0', '1'};
+/// a batch gets sent once it reaches this size, or when it got older than MAX_BATCH_AGE
+const size_t BATCH_SIZE = 1024 * 1024;
+const auto MAX_BATCH_AGE = chrono::milliseconds(100);
+/// sanity check for the frames we receive, the sender never exceeds BATCH_SIZE by much
+const size_t MAX_FRAME_SIZE = 64 * 1024 * 1024;
+
+void usage(const char* name)
+{
+    cerr << "Usage: " << name << " --send HOST:PORT [--level LEVEL] < RAW_DATA\n"
+         << "or:    " << name << " --listen [HOST:]PORT > RAW_DATA\n"
+         << "\n"
+         << "Stream the raw data of heaptrack over TCP, see heaptrack --remote and heaptrack --collect.\n"
+         << "\n"
+         << "Options:\n"
+         << "  --send HOST:PORT       Read the raw data from stdin and send it to the collector.\n"
+         << "  --level LEVEL          The zstd compression level of the sender, defaults to 1.\n"
+         << "  --listen [HOST:]PORT   Accept a single connection and write the raw data to stdout.\n";
+}
+
+/// split HOST:PORT, where the host is optional when @p allowEmptyHost is set
+bool parseAddress(const string& address, bool allowEmptyHost, string* host, string* port)
+{
+    const auto colon = address.rfind(':');
+    if (colon == string::npos) {
+        if (!allowEmptyHost) {
+            return false;
+        }
+        *port = address;
+    } else {
+        *host = address.substr(0, colon);
+        *port = address.substr(colon + 1);
+    }
+    // allow [::1]:1234 for IPv6 addresses
+    if (host->size() > 1 && host->front() == '[' && host->back() == ']') {
+        *host = host->substr(1, host->size() - 2);
+    }
+    return !port->empty() && (allowEmptyHost || !host->empty());
+}
+
+/// @return a socket connected to, or listening on, @p host and @p port, or -1 on failure
+int openSocket(const string& host, const string& port, bool listening)
+{
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = listening ? AI_PASSIVE : 0;
+
+    addrinfo* addresses = nullptr;
+    const auto ret = getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &addresses);
+    if (ret != 0) {
+        error_out << "failed to resolve " << host << ':' << port << ": " << gai_strerror(ret) << endl;
+        return -1;
+    }
+
+    int fd = -1;
+    for (auto address = addresses; address; address = address->ai_next) {
+        fd = socket(address->ai_family, address->ai_socktype | SOCK_CLOEXEC, address->ai_protocol);
+        if (fd == -1) {
+            continue;
+        }
+        if (listening) {
+            const int enable = 1;
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+            if (bind(fd, address->ai_addr, address->ai_addrlen) == 0 && listen(fd, 1) == 0) {
+                break;
+            }
+        } else if (connect(fd, address->ai_addr, address->ai_addrlen) == 0) {
+            break;
+        }
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(addresses);
+
+    if (fd == -1) {
+        error_out << "failed to " << (listening ? "listen on " : "connect to ") << host << ':' << port << ": "
+                  << strerror(errno) << endl;
+    }
+    return fd;
+}
+
+bool writeAll(int fd, const char* data, size_t size)
+{
+    while (size) {
+        const auto ret = write(fd, data, size);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        } else if (ret <= 0) {
+            return false;
+        }
+        data += ret;
+        size -= ret;
+    }
+    return true;
+}
+
+/// @return the number of bytes read into @p data, which is less than @p size at the end of the stream
+size_t readAll(int fd, char* data, size_t size)
+{
+    size_t total = 0;
+    while (total < size) {
+        const auto ret = read(fd, data + total, size - total);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        } else if (ret <= 0) {
+            break;
+        }
+        total += ret;
+    }
+    return total;
+}
+
+void writeUint32(char* out, uint32_t value)
+{
+    for (int i = 0; i < 4; ++i) {
+        out[i] = static_cast<char>((value >> (8 * i)) & 0xff);
+    }
+}
+
+uint32_t readUint32(const char* in)
+{
+    uint32_t value = 0;
+    for (int i = 0; i < 4; ++i) {
+        value |= static_cast<uint32_t>(static_cast<unsigned char>(in[i])) << (8 * i);
+    }
+    return value;
+}
+
+/**
+ * Batches the complete records of the raw data and sends them as compressed frames.
+ *
+ * Every frame consists of the compressed and the uncompressed size as 32 bit little endian
+ * values, followed by a zstd frame with exactly one batch of complete records.
+ */
+class Sender
+{
+public:
+    Sender(int fd, int level)
+        : m_fd(fd)
+        , m_level(level)
+        , m_context(ZSTD_createCCtx())
+    {
+    }
+
+    ~Sender()
+    {
+        ZSTD_freeCCtx(m_context);
+    }
+
+    Sender(const Sender&) = delete;
+    Sender& operator=(const Sender&) = delete;
+
+    bool run(int in)
+    {
+        if (!writeAll(m_fd, MAGIC, sizeof(MAGIC))) {
+            error_out << "failed to send the header: " << strerror(errno) << endl;
+            return false;
+        }
+
+        vector<char> buffer(BATCH_SIZE);
+        while (true) {
+            int timeout = -1;
+            if (!m_batch.empty()) {
+                const auto age = chrono::steady_clock::now() - m_batchStart;
+                const auto remaining = chrono::duration_cast<chrono::milliseconds>(MAX_BATCH_AGE - age);
+                timeout = max(0, static_cast<int>(remaining.count()));
+            }
+            pollfd fds = {in, POLLIN, 0};
+            const auto polled = poll(&fds, 1, timeout);
+            if (polled < 0 && errno != EINTR) {
+                error_out << "failed to poll the input: " << strerror(errno) << endl;
+                return false;
+            } else if (polled <= 0) {
+                // the batch got too old
+                if (!sendBatch()) {
+                    return false;
+                }
+                continue;
+            }
+
+            const auto ret = read(in, buffer.data(), buffer.size());
+            if (ret < 0 && errno == EINTR) {
+                continue;
+            } else if (ret <= 0) {
+                break;
+            }
+            m_pending.insert(m_pending.end(), buffer.data(), buffer.data() + ret);
+            if (!takeRecords()) {
+                return false;
+            }
+        }
+
+        if (!m_pending.empty()) {
+            cerr << "WARNING: dropping a truncated record of " << m_pending.size() << " bytes at the end" << endl;
+        }
+        return sendBatch();
+    }
+
+private:
+    /// move the complete records from m_pending to m_batch, sending it whenever it is full
+    bool takeRecords()
+    {
+        size_t pos = 0;
+        const auto size = m_pending.size();
+        while (pos < size) {
+            const auto type = static_cast<unsigned char>(m_pending[pos]);
+            size_t end = 0;
+            if (type & 0x80) {
+                // binary record, see LineWriter::writeVarintRecord
+                if (size - pos < 2) {
+                    break;
+                }
+                end = pos + 2 + static_cast<unsigned char>(m_pending[pos + 1]);
+                if (end > size) {
+                    break;
+                }
+            } else {
+                const auto newline = static_cast<const char*>(memchr(m_pending.data() + pos, '\n', size - pos));
+                if (!newline) {
+                    break;
+                }
+                end = newline - m_pending.data() + 1;
+                if (!handleTextRecord(m_pending.data() + pos, end - pos)) {
+                    return false;
+                }
+            }
+
+            if (m_batch.empty()) {
+                m_batchStart = chrono::steady_clock::now();
+            }
+            m_batch.append(m_pending.data() + pos, end - pos);
+            pos = end;
+
+            if (m_batch.size() >= BATCH_SIZE && !sendBatch()) {
+                return false;
+            }
+        }
+        m_pending.erase(m_pending.begin(), m_pending.begin() + pos);
+        return true;
+    }
+
+    /// announce the build-id of new modules before their 'm' record
+    bool handleTextRecord(const char* record, size_t size)
+    {
+        const auto mode = record[0];
+        if (mode != 'x' && mode != 'm' && mode != 'M') {
+            return true;
+        } else if (mode == 'M') {
+            error_out << "the data got recorded through shared memory, set HEAPTRACK_SHM=0" << endl;
+            return false;
+        }
+
+        // the tracer always writes sized strings, see LineWriter::write
+        istringstream stream(string(record, size));
+        LineReader reader;
+        reader.setExpectedSizedStrings(true);
+        string fileName;
+        if (!reader.getLine(stream) || !(reader >> fileName)) {
+            return true;
+        }
+
+        if (mode == 'x') {
+            m_exe = fileName;
+            return true;
+        } else if (fileName == "-") {
+            return true;
+        } else if (fileName == "x") {
+            fileName = m_exe;
+        }
+
+        auto it = m_buildIds.find(fileName);
+        if (it != m_buildIds.end()) {
+            return true;
+        }
+        it = m_buildIds.insert({fileName, elfBuildId(fileName)}).first;
+        if (!it->second.empty()) {
+            m_batch += 'B';
+            appendSizedString(fileName);
+            appendSizedString(it->second);
+            m_batch += '\n';
+        }
+        return true;
+    }
+
+    /// append @p string with its size in hex, like LineWriter::write does it for strings
+    void appendSizedString(const string& string)
+    {
+        char size[32];
+        snprintf(size, sizeof(size), " %zx ", string.size());
+        m_batch += size;
+        m_batch += string;
+    }
+
+    bool sendBatch()
+    {
+        if (m_batch.empty()) {
+            return true;
+        }
+
+        m_frame.resize(8 + ZSTD_compressBound(m_batch.size()));
+        const auto compressed = ZSTD_compressCCtx(m_context, &m_frame[8], m_frame.size() - 8, m_batch.data(),
+                                                  m_batch.size(), m_level);
+        if (ZSTD_isError(compressed)) {
+            error_out << "failed to compress: " << ZSTD_getErrorName(compressed) << endl;
+            return false;
+        }
+        writeUint32(&m_frame[0], static_cast<uint32_t>(compressed));
+        writeUint32(&m_frame[4], static_cast<uint32_t>(m_batch.size()));
+        if (!writeAll(m_fd, m_frame.data(), 8 + compressed)) {
+            error_out << "connection lost: " << strerror(errno) << endl;
+            return false;
+        }
+        m_batch.clear();
+        return true;
+    }
+
+    int m_fd;
+    int m_level;
+    ZSTD_CCtx* m_context;
+    /// data that got read but does not end with a complete record yet
+    vector<char> m_pending;
+    /// complete records that did not get sent yet
+    string m_batch;
+    chrono::steady_clock::time_point m_batchStart;
+    vector<char> m_frame;
+    string m_exe;
+    /// the build-ids of the modules, empty when unknown
+    tsl::robin_map<string, string> m_buildIds;
+};
+
+bool receive(int fd, int out)
+{
+    char magic[sizeof(MAGIC)];
+    if (readAll(fd, magic, sizeof(magic)) != sizeof(magic) || memcmp(magic, MAGIC, sizeof(MAGIC)) != 0) {
+        error_out << "the peer is not a heaptrack_stream sender" << endl;
+        return false;
+    }
+
+    unique_ptr<ZSTD_DCtx, size_t (*)(ZSTD_DCtx*)> context(ZSTD_createDCtx(), &ZSTD_freeDCtx);
+    vector<char> compressed;
+    vector<char> decompressed;
+    uint64_t frames = 0;
+    while (true) {
+        char header[8];
+        const auto headerSize = readAll(fd, header, sizeof(header));
+        if (headerSize == 0) {
+            return true;
+        }
+        const auto compressedSize = readUint32(header);
+        const auto decompressedSize = readUint32(header + 4);
+        if (headerSize == sizeof(header)
+            && (decompressedSize > MAX_FRAME_SIZE || compressedSize > ZSTD_compressBound(MAX_FRAME_SIZE))) {
+            error_out << "received an invalid frame after " << frames << " frames" << endl;
+            return false;
+        }
+
+        compressed.resize(compressedSize);
+        if (headerSize != sizeof(header) || readAll(fd, compressed.data(), compressedSize) != compressedSize) {
+            cerr << "WARNING: connection lost, the data got truncated after " << frames << " frames" << endl;
+            return true;
+        }
+
+        decompressed.resize(decompressedSize);
+        const auto ret = ZSTD_decompressDCtx(context.get(), decompressed.data(), decompressedSize,
+                                             compressed.data(), compressedSize);
+        if (ZSTD_isError(ret) || ret != decompressedSize) {
+            error_out << "failed to decompress frame " << frames << endl;
+            return false;
+        }
+        if (!writeAll(out, decompressed.data(), decompressedSize)) {
+            error_out << "failed to write the output: " << strerror(errno) << endl;
+            return false;
+        }
+        ++frames;
+    }
+}
+}
+
+int main(int argc, char** argv)
+{
+    string sendAddress;
+    string listenAddress;
+    int level = 1;
+    for (int i = 1; i < argc; ++i) {
+        const auto arg = argv[i];
+        if (!strcmp(arg, "-h") || !strcmp(arg, "--help")) {
+            usage(argv[0]);
+            return 0;
+        } else if (!strcmp(arg, "--send") && i + 1 < argc) {
+            sendAddress = argv[++i];
+        } else if (!strcmp(arg, "--listen") && i + 1 < argc) {
+            listenAddress = argv[++i];
+        } else if (!strcmp(arg, "--level") && i + 1 < argc) {
+            level = atoi(argv[++i]);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    string host;
+    string port;
+    if (sendAddress.empty() == listenAddress.empty()
+        || !parseAddress(sendAddress.empty() ? listenAddress : sendAddress, sendAddress.empty(), &host, &port)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    // we report failed writes ourselves
+    signal(SIGPIPE, SIG_IGN);
+
+    if (!sendAddress.empty()) {
+        const auto fd = openSocket(host, port, false);
+        if (fd == -1) {
+            return 1;
+        }
+        Sender sender(fd, level);
+        const auto ret = sender.run(fileno(stdin));
+        close(fd);
+        return ret ? 0 : 1;
+    }
+
+    const auto listenSocket = openSocket(host, port, true);
+    if (listenSocket == -1) {
+        return 1;
+    }
+    const auto fd = accept(listenSocket, nullptr, nullptr);
+    close(listenSocket);
+    if (fd == -1) {
+        error_out << "failed to accept a connection: " << strerror(errno) << endl;
+        return 1;
+    }
+    const auto ret = receive(fd, fileno(stdout));
+    close(fd);
+    return ret ? 0 : 1;
+}
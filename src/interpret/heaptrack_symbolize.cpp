@@ -0,0 +1,411 @@
+/*
+    SPDX-FileCopyrightText: 2026 Milian Wolff <mail@milianw.de>
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+/**
+ * @file heaptrack_symbolize.cpp
+ *
+ * @brief Resolve the instruction pointers of heaptrack data that got recorded with deferred symbolization.
+ *
+ * With HEAPTRACK_DEFER_SYMBOLS, heaptrack_interpret only writes the module of every instruction pointer
+ * and announces the load address and build-id of the modules in 'b' records. This tool reads such
+ * data, potentially on a different machine that has the debug information available, and adds the
+ * function names and source locations. All other data is passed through as-is.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include "debuginfodfetcher.h"
+#include "persistentsymbolcache.h"
+#include "symbolizer.h"
+
+#include "util/linereader.h"
+#include "util/linewriter.h"
+
+#include <tsl/robin_map.h>
+
+using namespace std;
+
+namespace {
+#define error_out cerr << __FILE__ << ':' << __LINE__ << " ERROR:"
+
+void usage(const char* name)
+{
+    cerr << "Usage: " << name << " [--sysroot DIR] [--debug-paths PATHS] < INPUT > OUTPUT\n"
+         << "\n"
+         << "Resolve the instruction pointers of heaptrack data recorded with HEAPTRACK_DEFER_SYMBOLS=1.\n"
+         << "The data is read uncompressed from stdin and written uncompressed to stdout, e.g.:\n"
+         << "\n"
+         << "  zstd -dc heaptrack.foo.1234.zst | " << name << " | zstd > heaptrack.foo.1234.symbolized.zst\n"
+         << "\n"
+         << "Options:\n"
+         << "  --sysroot DIR        Look up the modules below DIR instead of the root directory.\n"
+         << "  --debug-paths PATHS  Colon separated list of additional directories containing debug\n"
+         << "                       information, which includes .build-id/xx/yyyy.debug lookups.\n";
+}
+
+bool fileExists(const string& path)
+{
+    struct stat info;
+    return stat(path.c_str(), &info) == 0 && S_ISREG(info.st_mode);
+}
+
+vector<string> splitPaths(const string& paths)
+{
+    vector<string> ret;
+    size_t start = 0;
+    while (start <= paths.size()) {
+        auto end = paths.find(':', start);
+        if (end == string::npos) {
+            end = paths.size();
+        }
+        if (end > start) {
+            ret.push_back(paths.substr(start, end - start));
+        }
+        start = end + 1;
+    }
+    return ret;
+}
+
+struct ModuleInfo
+{
+    uintptr_t addressStart = 0;
+    /// the file we resolve the addresses in, empty when none was found
+    string path;
+    /// set while debuginfod fetches the file for us, see DebuginfodFetcher
+    string pendingBuildId;
+};
+
+class Symbolize
+{
+public:
+    Symbolize(string sysroot, const string& debugPaths)
+        : out(fileno(stdout))
+        , m_sysroot(std::move(sysroot))
+        , m_debugPaths(splitPaths(debugPaths))
+        , m_persistentCache(PersistentSymbolCache::fromEnvironment())
+        , m_symbolizer(m_persistentCache.get(), debugPaths)
+    {
+        m_debugPaths.push_back(m_sysroot + "/usr/lib/debug");
+    }
+
+    ~Symbolize()
+    {
+        out.write("# strings: %zu\n# ips: %zu\n", m_internedData.size(), m_numIps);
+        out.flush();
+    }
+
+    bool run(istream& in)
+    {
+        LineReader reader;
+        while (reader.getLine(in)) {
+            switch (reader.mode()) {
+            case 'v': {
+                unsigned int heaptrackVersion = 0;
+                unsigned int fileVersion = 0;
+                reader >> heaptrackVersion;
+                reader >> fileVersion;
+                if (fileVersion >= 3) {
+                    reader.setExpectedSizedStrings(true);
+                    m_sizedStrings = true;
+                }
+                out.write("%s\n", reader.rawLine());
+                break;
+            }
+            case 's': {
+                string str;
+                if (m_sizedStrings) {
+                    reader >> str;
+                } else {
+                    str = reader.line().substr(2);
+                }
+                m_strings.push_back(str);
+                m_stringIndices.push_back(intern(str));
+                break;
+            }
+            case 'b':
+                if (!handleModule(reader)) {
+                    return false;
+                }
+                break;
+            case 'i':
+                if (!handleIp(reader)) {
+                    return false;
+                }
+                break;
+            case '#':
+                // we write our own statistics at the end
+                if (reader.line().compare(0, 10, "# strings:") != 0 && reader.line().compare(0, 6, "# ips:") != 0) {
+                    out.write("%s\n", reader.rawLine());
+                }
+                break;
+            default:
+                out.write("%s\n", reader.rawLine());
+                break;
+            }
+        }
+        return true;
+    }
+
+private:
+    size_t intern(const string& str)
+    {
+        if (str.empty()) {
+            return 0;
+        }
+
+        const size_t id = m_internedData.size() + 1;
+        auto inserted = m_internedData.insert({str, id});
+        if (!inserted.second) {
+            return inserted.first->second;
+        }
+
+        out.write("s ");
+        writeString(str);
+        out.write("\n");
+        return id;
+    }
+
+    void writeString(const string& str)
+    {
+        if (m_sizedStrings) {
+            out.write(str);
+        } else {
+            out.write(str.c_str());
+        }
+    }
+
+    /// @return the output string index for the input string index @p index
+    bool mapString(size_t* index) const
+    {
+        if (*index > m_stringIndices.size()) {
+            return false;
+        }
+        *index = *index ? m_stringIndices[*index - 1] : 0;
+        return true;
+    }
+
+    bool handleModule(LineReader& reader)
+    {
+        size_t moduleIndex = 0;
+        uintptr_t addressStart = 0;
+        if (!(reader >> moduleIndex) || !(reader >> addressStart) || !moduleIndex
+            || moduleIndex > m_strings.size()) {
+            error_out << "failed to parse line: " << reader.line() << endl;
+            return false;
+        }
+        string buildId;
+        reader >> buildId;
+
+        auto& module = m_modules[moduleIndex];
+        const bool moved = !module.path.empty();
+        module.addressStart = addressStart;
+        const auto& fileName = m_strings[moduleIndex - 1];
+        module.path = locateModule(fileName, buildId);
+        module.pendingBuildId.clear();
+        // the vdso isn't backed by a file, the symbolizer skips it anyway
+        if (fileName.compare(0, 10, "linux-vdso") != 0) {
+            auto fetcher = buildId.empty() ? nullptr : DebuginfodFetcher::instance();
+            if (fetcher) {
+                // the symbolizer asks for the debug information of the local files too,
+                // but only wait for it once we need to resolve an address in the module
+                fetcher->prefetch({}, buildId);
+                if (module.path.empty()) {
+                    module.pendingBuildId = buildId;
+                }
+            } else if (module.path.empty()) {
+                warnMissing(fileName, buildId);
+            }
+        }
+        if (moved) {
+            // a module got loaded at a different address, the symbolizer needs to drop its old state
+            auto loadedModules = LoadedModules();
+            loadedModules.generation = m_loadedModules.generation + 1;
+            for (const auto& entry : m_modules) {
+                if (!entry.second.path.empty()) {
+                    loadedModules.modules.emplace_back(entry.second.addressStart, entry.second.path);
+                }
+            }
+            sort(loadedModules.modules.begin(), loadedModules.modules.end());
+            m_loadedModules = std::move(loadedModules);
+        }
+
+        auto mappedIndex = moduleIndex;
+        mapString(&mappedIndex);
+        out.write("b %zx %zx", mappedIndex, addressStart);
+        if (!buildId.empty()) {
+            out.write(" ");
+            writeString(buildId);
+        }
+        out.write("\n");
+        return true;
+    }
+
+    /// @return the path to a file matching @p buildId for the module @p fileName, or an empty string
+    string locateModule(const string& fileName, const string& buildId)
+    {
+        if (fileName.compare(0, 10, "linux-vdso") == 0) {
+            return {};
+        }
+
+        auto matches = [&buildId](const string& path) {
+            return fileExists(path) && (buildId.empty() || elfBuildId(path) == buildId);
+        };
+
+        const auto path = m_sysroot + fileName;
+        if (matches(path)) {
+            return path;
+        }
+
+        if (buildId.size() > 2) {
+            // the separate debug information contains the symbol table too, which is all we need
+            for (const auto& debugPath : m_debugPaths) {
+                const auto debugFile = debugPath + "/.build-id/" + buildId.substr(0, 2) + '/' + buildId.substr(2) + ".debug";
+                if (matches(debugFile)) {
+                    return debugFile;
+                }
+            }
+        }
+
+        return {};
+    }
+
+    void warnMissing(const string& fileName, const string& buildId)
+    {
+        cerr << "WARNING: could not find " << fileName;
+        if (!buildId.empty()) {
+            cerr << " with build-id " << buildId;
+        }
+        cerr << ", its addresses stay unresolved" << endl;
+    }
+
+    bool handleIp(LineReader& reader)
+    {
+        ++m_numIps;
+
+        uintptr_t instructionPointer = 0;
+        size_t moduleIndex = 0;
+        if (!(reader >> instructionPointer) || !(reader >> moduleIndex)) {
+            error_out << "failed to parse line: " << reader.line() << endl;
+            return false;
+        }
+        auto mappedModuleIndex = moduleIndex;
+        if (!mapString(&mappedModuleIndex)) {
+            error_out << "invalid module index: " << reader.line() << endl;
+            return false;
+        }
+
+        size_t value = 0;
+        if (reader >> value) {
+            // resolved already, only map the string indices of the frames, i.e.
+            // function [file line [function file line]...]
+            out.write("i %zx %zx", instructionPointer, mappedModuleIndex);
+            size_t field = 0;
+            do {
+                const bool isLine = field % 3 == 2;
+                if (!isLine && !mapString(&value)) {
+                    error_out << "failed to parse line: " << reader.line() << endl;
+                    return false;
+                }
+                out.write(" %zx", value);
+                ++field;
+            } while (reader >> value);
+            out.write("\n");
+            return true;
+        }
+
+        AddressInformation info;
+        auto module = m_modules.find(moduleIndex);
+        if (module != m_modules.end() && !module->second.pendingBuildId.empty()) {
+            auto& info = module.value();
+            info.path = DebuginfodFetcher::instance()->debugFile(info.pendingBuildId);
+            if (info.path.empty()) {
+                warnMissing(m_strings[moduleIndex - 1], info.pendingBuildId);
+            }
+            info.pendingBuildId.clear();
+        }
+        if (module != m_modules.end() && !module->second.path.empty()) {
+            const ModuleFragment fragment(module->second.path, module->second.addressStart, 0, 0, moduleIndex);
+            info = m_symbolizer.resolve(fragment, instructionPointer, m_loadedModules);
+        }
+
+        // intern all strings before we write the ip
+        const auto functionId = intern(info.frame.function);
+        const auto fileId = intern(info.frame.file);
+        vector<size_t> inlinedIds;
+        inlinedIds.reserve(info.inlined.size() * 2);
+        for (const auto& inlined : info.inlined) {
+            inlinedIds.push_back(intern(inlined.function));
+            inlinedIds.push_back(intern(inlined.file));
+        }
+
+        out.write("i %zx %zx", instructionPointer, mappedModuleIndex);
+        if (functionId || fileId) {
+            out.write(" %zx", functionId);
+            if (fileId) {
+                out.write(" %zx %x", fileId, info.frame.line);
+                for (size_t i = 0; i < info.inlined.size(); ++i) {
+                    out.write(" %zx %zx %x", inlinedIds[2 * i], inlinedIds[2 * i + 1], info.inlined[i].line);
+                }
+            }
+        }
+        out.write("\n");
+        return true;
+    }
+
+    LineWriter out;
+
+    string m_sysroot;
+    vector<string> m_debugPaths;
+    unique_ptr<PersistentSymbolCache> m_persistentCache;
+    Symbolizer m_symbolizer;
+    /// only gets updated when modules move, additional modules get reported on demand
+    LoadedModules m_loadedModules;
+    bool m_sizedStrings = false;
+
+    /// the strings of the input file
+    vector<string> m_strings;
+    /// maps input string indices to output string indices
+    vector<size_t> m_stringIndices;
+    tsl::robin_map<string, size_t> m_internedData;
+    /// the announced modules by their input string index
+    tsl::robin_map<size_t, ModuleInfo> m_modules;
+    size_t m_numIps = 0;
+};
+}
+
+int main(int argc, char** argv)
+{
+    string sysroot;
+    string debugPaths;
+    for (int i = 1; i < argc; ++i) {
+        const auto arg = argv[i];
+        if (!strcmp(arg, "-h") || !strcmp(arg, "--help")) {
+            usage(argv[0]);
+            return 0;
+        } else if (!strcmp(arg, "--sysroot") && i + 1 < argc) {
+            sysroot = argv[++i];
+            while (!sysroot.empty() && sysroot.back() == '/') {
+                sysroot.pop_back();
+            }
+        } else if (!strcmp(arg, "--debug-paths") && i + 1 < argc) {
+            debugPaths = argv[++i];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    ios_base::sync_with_stdio(false);
+
+    Symbolize symbolize(sysroot, debugPaths);
+    return symbolize.run(cin) ? 0 : 1;
+}
@@ -0,0 +1,218 @@
+/*
+    SPDX-FileCopyrightText: 2026 Milian Wolff <mail@milianw.de>
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include "jitsymbols.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+// see tools/perf/Documentation/jitdump-specification.txt of the linux sources
+const uint32_t JITDUMP_MAGIC = 0x4A695444;
+enum JitdumpRecord : uint32_t
+{
+    JIT_CODE_LOAD = 0,
+    JIT_CODE_MOVE = 1,
+};
+// the id, total size and time stamp of every record
+const uint32_t JITDUMP_RECORD_PREFIX = 16;
+
+template <typename T>
+T readValue(const std::string& buffer, size_t offset)
+{
+    T value;
+    memcpy(&value, buffer.data() + offset, sizeof(T));
+    return value;
+}
+
+std::string jitdumpFile(pid_t pid)
+{
+    const auto directory = getenv("JITDUMPDIR");
+    return std::string(directory && directory[0] ? directory : ".") + "/jit-" + std::to_string(pid) + ".dump";
+}
+}
+
+JitSymbols::Source::~Source()
+{
+    if (fd != -1) {
+        close(fd);
+    }
+}
+
+bool JitSymbols::Source::readMore()
+{
+    if (fd == -1) {
+        // the JIT may create the file at any time
+        fd = open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
+            return false;
+        }
+    }
+
+    bool ret = false;
+    char chunk[64 * 1024];
+    while (true) {
+        const auto size = pread(fd, chunk, sizeof(chunk), offset);
+        if (size <= 0) {
+            break;
+        }
+        buffer.append(chunk, size);
+        offset += size;
+        ret = true;
+    }
+    return ret;
+}
+
+JitSymbols::JitSymbols(pid_t pid)
+    : JitSymbols("/tmp/perf-" + std::to_string(pid) + ".map", jitdumpFile(pid))
+{
+}
+
+JitSymbols::JitSymbols(std::string perfMapFile, std::string jitdumpFile)
+    : m_perfMap(std::move(perfMapFile))
+    , m_jitdump(std::move(jitdumpFile))
+{
+}
+
+const JitSymbols::Symbol* JitSymbols::find(uintptr_t address)
+{
+    if (auto symbol = lookup(address)) {
+        return symbol;
+    }
+    update();
+    return lookup(address);
+}
+
+const JitSymbols::Symbol* JitSymbols::lookup(uintptr_t address) const
+{
+    auto it = m_symbols.upper_bound(address);
+    if (it == m_symbols.begin()) {
+        return nullptr;
+    }
+    --it;
+    return address < it->second.end ? &it->second : nullptr;
+}
+
+void JitSymbols::update()
+{
+    if (m_perfMap.readMore()) {
+        parsePerfMap();
+    }
+    if (!m_jitdumpInvalid && m_jitdump.readMore()) {
+        parseJitdump();
+    }
+}
+
+void JitSymbols::parsePerfMap()
+{
+    // every line looks like "START SIZE name", where the numbers are hex encoded
+    auto& buffer = m_perfMap.buffer;
+    size_t lineStart = 0;
+    while (true) {
+        const auto lineEnd = buffer.find('\n', lineStart);
+        if (lineEnd == std::string::npos) {
+            break;
+        }
+        buffer[lineEnd] = '\0';
+        const char* line = buffer.c_str() + lineStart;
+        char* end = nullptr;
+        const auto start = strtoull(line, &end, 16);
+        if (end != line) {
+            line = end;
+            const auto size = strtoull(line, &end, 16);
+            if (end != line && *end == ' ') {
+                insert(start, size, end + 1, &m_perfMap.fileName);
+            }
+        }
+        lineStart = lineEnd + 1;
+    }
+    buffer.erase(0, lineStart);
+}
+
+void JitSymbols::parseJitdump()
+{
+    auto& buffer = m_jitdump.buffer;
+    if (!m_jitdumpHeaderSize) {
+        // the magic, version and size of the header
+        if (buffer.size() < 12) {
+            return;
+        }
+        const auto headerSize = readValue<uint32_t>(buffer, 8);
+        // files written with a different endianness than ours are not supported
+        if (readValue<uint32_t>(buffer, 0) != JITDUMP_MAGIC || headerSize < 12) {
+            m_jitdumpInvalid = true;
+            buffer.clear();
+            return;
+        }
+        if (buffer.size() < headerSize) {
+            return;
+        }
+        m_jitdumpHeaderSize = headerSize;
+        buffer.erase(0, headerSize);
+    }
+
+    size_t recordStart = 0;
+    while (buffer.size() - recordStart >= JITDUMP_RECORD_PREFIX) {
+        const auto id = readValue<uint32_t>(buffer, recordStart);
+        const auto recordSize = readValue<uint32_t>(buffer, recordStart + 4);
+        if (recordSize < JITDUMP_RECORD_PREFIX) {
+            m_jitdumpInvalid = true;
+            buffer.clear();
+            return;
+        }
+        if (buffer.size() - recordStart < recordSize) {
+            break;
+        }
+
+        // pid and tid, followed by vma, code_addr, code_size and code_index for both, then
+        // the name and code for JIT_CODE_LOAD and old_code_addr, new_code_addr, code_size
+        // and code_index for JIT_CODE_MOVE
+        const auto offset = recordStart + JITDUMP_RECORD_PREFIX + 8;
+        if (id == JIT_CODE_LOAD && recordSize > JITDUMP_RECORD_PREFIX + 40) {
+            const auto codeAddress = readValue<uint64_t>(buffer, offset + 8);
+            const auto codeSize = readValue<uint64_t>(buffer, offset + 16);
+            const auto nameStart = buffer.data() + offset + 32;
+            const auto nameSize = strnlen(nameStart, buffer.data() + recordStart + recordSize - nameStart);
+            insert(codeAddress, codeSize, std::string(nameStart, nameSize), &m_jitdump.fileName);
+        } else if (id == JIT_CODE_MOVE && recordSize >= JITDUMP_RECORD_PREFIX + 48) {
+            const auto oldAddress = readValue<uint64_t>(buffer, offset + 8);
+            const auto newAddress = readValue<uint64_t>(buffer, offset + 16);
+            const auto codeSize = readValue<uint64_t>(buffer, offset + 24);
+            auto it = m_symbols.find(oldAddress);
+            if (it != m_symbols.end()) {
+                auto name = std::move(it->second.name);
+                m_symbols.erase(it);
+                insert(newAddress, codeSize, std::move(name), &m_jitdump.fileName);
+            }
+        }
+        recordStart += recordSize;
+    }
+    buffer.erase(0, recordStart);
+}
+
+void JitSymbols::insert(uintptr_t start, uintptr_t size, std::string name, const std::string* fileName)
+{
+    if (!size) {
+        return;
+    }
+    const auto end = start + size;
+
+    auto it = m_symbols.lower_bound(start);
+    if (it != m_symbols.begin()) {
+        auto previous = std::prev(it);
+        if (previous->second.end > start) {
+            previous->second.end = start;
+        }
+    }
+    while (it != m_symbols.end() && it->first < end) {
+        it = m_symbols.erase(it);
+    }
+    m_symbols.emplace_hint(it, start, Symbol {end, std::move(name), fileName});
+}
@@ -0,0 +1,82 @@
+/*
+    SPDX-FileCopyrightText: 2026 Milian Wolff <mail@milianw.de>
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#ifndef JITSYMBOLS_H
+#define JITSYMBOLS_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+#include <sys/types.h>
+
+/**
+ * Resolves the addresses of JIT compiled code, which doesn't belong to any module.
+ *
+ * JIT compilers like LuaJIT or the JVM agents announce the code they generate in the perf map file
+ * /tmp/perf-<pid>.map or in the jitdump file jit-<pid>.dump, which is looked for in $JITDUMPDIR or
+ * otherwise the working directory. Both files only ever grow, so only their new parts get read
+ * whenever we fail to find an address.
+ */
+class JitSymbols
+{
+public:
+    struct Symbol
+    {
+        uintptr_t end = 0;
+        std::string name;
+        /// the file that announced the symbol, i.e. its pseudo module
+        const std::string* fileName = nullptr;
+    };
+
+    explicit JitSymbols(pid_t pid);
+    JitSymbols(std::string perfMapFile, std::string jitdumpFile);
+
+    JitSymbols(const JitSymbols&) = delete;
+    JitSymbols& operator=(const JitSymbols&) = delete;
+
+    /// @return the symbol that contains @p address, or nullptr
+    const Symbol* find(uintptr_t address);
+
+private:
+    struct Source
+    {
+        explicit Source(std::string fileName)
+            : fileName(std::move(fileName))
+        {
+        }
+        ~Source();
+
+        Source(const Source&) = delete;
+        Source& operator=(const Source&) = delete;
+
+        /// read the data that got appended since the last call into the buffer
+        bool readMore();
+
+        const std::string fileName;
+        int fd = -1;
+        off_t offset = 0;
+        /// the data that got read but not parsed yet, i.e. an incomplete line or record
+        std::string buffer;
+    };
+
+    const Symbol* lookup(uintptr_t address) const;
+    void update();
+    void parsePerfMap();
+    void parseJitdump();
+    /// newer code replaces all older code it overlaps with
+    void insert(uintptr_t start, uintptr_t size, std::string name, const std::string* fileName);
+
+    Source m_perfMap;
+    Source m_jitdump;
+    /// the size of the jitdump header, zero until it got read
+    uint32_t m_jitdumpHeaderSize = 0;
+    bool m_jitdumpInvalid = false;
+    /// indexed by the start address
+    std::map<uintptr_t, Symbol> m_symbols;
+};
+
+#endif // JITSYMBOLS_H
@@ -0,0 +1,100 @@
+/*
+    SPDX-FileCopyrightText: 2026 Milian Wolff <mail@milianw.de>
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#ifndef MEMORYMAPPINGS_H
+#define MEMORYMAPPINGS_H
+
+#include <cstdint>
+#include <iterator>
+#include <map>
+
+/**
+ * The anonymous memory mappings of the tracee, with the trace that mapped them.
+ *
+ * Mappings can be unmapped partially, so every part that gets unmapped is
+ * reported with the trace of the mapping it belonged to.
+ */
+class MemoryMappings
+{
+public:
+    /**
+     * Add a new mapping, which replaces any mapping that overlaps with it.
+     *
+     * @p unmapped gets called with the size and trace index of every replaced part.
+     */
+    template <typename Callback>
+    void map(uint64_t start, uint64_t size, uint32_t traceIndex, Callback unmapped)
+    {
+        unmap(start, size, unmapped);
+        m_mappings[start] = {start + size, traceIndex};
+    }
+
+    /**
+     * Remove the given range, which may cover any number of mappings partially.
+     *
+     * @p unmapped gets called with the size and trace index of every removed part.
+     * @return true when any mapped memory got removed
+     */
+    template <typename Callback>
+    bool unmap(uint64_t start, uint64_t size, Callback unmapped)
+    {
+        const auto end = start + size;
+        bool found = false;
+
+        auto it = m_mappings.upper_bound(start);
+        if (it != m_mappings.begin()) {
+            auto previous = std::prev(it);
+            if (previous->second.end > start) {
+                const auto mapping = previous->second;
+                if (previous->first < start) {
+                    // keep the head of the mapping that starts before the range
+                    previous->second.end = start;
+                } else {
+                    m_mappings.erase(previous);
+                }
+                if (mapping.end > end) {
+                    // the range is inside the mapping, keep its tail as well
+                    m_mappings[end] = mapping;
+                    unmapped(size, mapping.traceIndex);
+                    return true;
+                }
+                unmapped(mapping.end - start, mapping.traceIndex);
+                found = true;
+            }
+        }
+
+        while (it != m_mappings.end() && it->first < end) {
+            const auto mapping = it->second;
+            if (mapping.end > end) {
+                // keep the tail of the mapping that ends after the range
+                unmapped(end - it->first, mapping.traceIndex);
+                m_mappings.erase(it);
+                m_mappings[end] = mapping;
+                return true;
+            }
+            unmapped(mapping.end - it->first, mapping.traceIndex);
+            it = m_mappings.erase(it);
+            found = true;
+        }
+        return found;
+    }
+
+    size_t size() const
+    {
+        return m_mappings.size();
+    }
+
+private:
+    struct Mapping
+    {
+        uint64_t end;
+        uint32_t traceIndex;
+    };
+    // sorted by start address, no two mappings overlap
+    std::map<uint64_t, Mapping> m_mappings;
+};
+
+#endif // MEMORYMAPPINGS_H
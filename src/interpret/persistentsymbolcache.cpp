@@ -0,0 +1,289 @@
+/*
+    SPDX-FileCopyrightText: 2026 Milian Wolff <mail@milianw.de>
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include "persistentsymbolcache.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+enum : uint32_t
+{
+    SYMBOLS_MAGIC = 0x68747379, // "htsy"
+    CU_RANGES_MAGIC = 0x68746375, // "htcu"
+    // bump whenever the layout of the files or the contents of the symbols change
+    VERSION = 1,
+};
+
+struct FileHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t numEntries;
+    // size of the trailing string data or range table
+    uint64_t numExtra;
+};
+
+struct SymbolRecord
+{
+    uint64_t offset;
+    uint64_t value;
+    uint64_t size;
+    uint64_t nameOffset;
+    uint64_t nameSize;
+};
+
+struct CuRecord
+{
+    uint64_t dieOffset;
+    uint64_t firstRange;
+    uint64_t numRanges;
+};
+
+uint32_t version()
+{
+    // the symbol offsets are adjusted differently on ARM, don't mix them up
+#ifdef __arm__
+    return VERSION | (1u << 31);
+#else
+    return VERSION;
+#endif
+}
+
+/// read-only mapping of a cache file
+class MappedFile
+{
+public:
+    explicit MappedFile(const std::string& path)
+    {
+        const auto fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
+            return;
+        }
+        struct stat info;
+        if (fstat(fd, &info) == 0 && info.st_size >= static_cast<off_t>(sizeof(FileHeader))) {
+            auto mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping != MAP_FAILED) {
+                m_data = static_cast<const char*>(mapping);
+                m_size = info.st_size;
+            }
+        }
+        close(fd);
+    }
+
+    ~MappedFile()
+    {
+        if (m_data) {
+            munmap(const_cast<char*>(m_data), m_size);
+        }
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    /// @return the header when the file has the expected @p magic, otherwise nullptr
+    const FileHeader* header(uint32_t magic) const
+    {
+        if (!m_data) {
+            return nullptr;
+        }
+        auto ret = reinterpret_cast<const FileHeader*>(m_data);
+        if (ret->magic != magic || ret->version != version()) {
+            return nullptr;
+        }
+        return ret;
+    }
+
+    const char* data() const
+    {
+        return m_data;
+    }
+
+    uint64_t size() const
+    {
+        return m_size;
+    }
+
+private:
+    const char* m_data = nullptr;
+    uint64_t m_size = 0;
+};
+
+template <typename T>
+void append(std::string* contents, const T& value)
+{
+    contents->append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+bool createDirectories(const std::string& directory)
+{
+    for (auto pos = directory.find('/', 1); true; pos = directory.find('/', pos + 1)) {
+        const auto parent = directory.substr(0, pos);
+        if (mkdir(parent.c_str(), 0700) != 0 && errno != EEXIST) {
+            return false;
+        }
+        if (pos == std::string::npos) {
+            return true;
+        }
+    }
+}
+}
+
+PersistentSymbolCache::PersistentSymbolCache(std::string directory)
+    : m_directory(std::move(directory))
+{
+    while (m_directory.size() > 1 && m_directory.back() == '/') {
+        m_directory.pop_back();
+    }
+}
+
+PersistentSymbolCache* PersistentSymbolCache::fromEnvironment()
+{
+    const auto directory = getenv("HEAPTRACK_SYMBOL_CACHE_DIR");
+    if (!directory || !directory[0]) {
+        return nullptr;
+    }
+    return new PersistentSymbolCache(directory);
+}
+
+bool PersistentSymbolCache::loadSymbols(const std::string& buildId, SymbolCache::Symbols* symbols) const
+{
+    MappedFile file(path(buildId, ".symbols"));
+    const auto header = file.header(SYMBOLS_MAGIC);
+    if (!header) {
+        return false;
+    }
+
+    const auto recordsSize = header->numEntries * sizeof(SymbolRecord);
+    if (header->numEntries > file.size() / sizeof(SymbolRecord)
+        || file.size() != sizeof(FileHeader) + recordsSize + header->numExtra) {
+        return false;
+    }
+    const auto records = reinterpret_cast<const SymbolRecord*>(file.data() + sizeof(FileHeader));
+    const auto strings = file.data() + sizeof(FileHeader) + recordsSize;
+
+    symbols->clear();
+    symbols->reserve(header->numEntries);
+    for (uint64_t i = 0; i < header->numEntries; ++i) {
+        const auto& record = records[i];
+        if (record.nameOffset > header->numExtra || record.nameSize > header->numExtra - record.nameOffset) {
+            symbols->clear();
+            return false;
+        }
+        symbols->push_back({record.offset, record.value, record.size,
+                            std::string(strings + record.nameOffset, record.nameSize)});
+    }
+    return true;
+}
+
+void PersistentSymbolCache::storeSymbols(const std::string& buildId, const SymbolCache::Symbols& symbols) const
+{
+    uint64_t stringsSize = 0;
+    std::string contents;
+    contents.reserve(sizeof(FileHeader) + symbols.size() * sizeof(SymbolRecord));
+    append(&contents, FileHeader {SYMBOLS_MAGIC, version(), symbols.size(), 0});
+    for (const auto& symbol : symbols) {
+        append(&contents, SymbolRecord {symbol.offset, symbol.value, symbol.size, stringsSize, symbol.symname.size()});
+        stringsSize += symbol.symname.size();
+    }
+    reinterpret_cast<FileHeader*>(&contents[0])->numExtra = stringsSize;
+    for (const auto& symbol : symbols) {
+        contents.append(symbol.symname);
+    }
+    store(path(buildId, ".symbols"), contents);
+}
+
+bool PersistentSymbolCache::loadCuRanges(const std::string& buildId, std::vector<CuRanges>* ranges) const
+{
+    MappedFile file(path(buildId, ".cus"));
+    const auto header = file.header(CU_RANGES_MAGIC);
+    if (!header) {
+        return false;
+    }
+
+    const auto maxEntries = file.size() / sizeof(DwarfRange);
+    if (header->numEntries > maxEntries || header->numExtra > maxEntries
+        || file.size()
+            != sizeof(FileHeader) + header->numEntries * sizeof(CuRecord) + header->numExtra * sizeof(DwarfRange)) {
+        return false;
+    }
+    const auto records = reinterpret_cast<const CuRecord*>(file.data() + sizeof(FileHeader));
+    const auto dwarfRanges = reinterpret_cast<const DwarfRange*>(records + header->numEntries);
+
+    ranges->clear();
+    ranges->reserve(header->numEntries);
+    for (uint64_t i = 0; i < header->numEntries; ++i) {
+        const auto& record = records[i];
+        if (record.firstRange > header->numExtra || record.numRanges > header->numExtra - record.firstRange) {
+            ranges->clear();
+            return false;
+        }
+        const auto first = dwarfRanges + record.firstRange;
+        ranges->push_back({record.dieOffset, {first, first + record.numRanges}});
+    }
+    return true;
+}
+
+void PersistentSymbolCache::storeCuRanges(const std::string& buildId, const std::vector<CuRanges>& ranges) const
+{
+    uint64_t numRanges = 0;
+    std::string contents;
+    append(&contents, FileHeader {CU_RANGES_MAGIC, version(), ranges.size(), 0});
+    for (const auto& cu : ranges) {
+        append(&contents, CuRecord {cu.dieOffset, numRanges, cu.ranges.size()});
+        numRanges += cu.ranges.size();
+    }
+    reinterpret_cast<FileHeader*>(&contents[0])->numExtra = numRanges;
+    for (const auto& cu : ranges) {
+        for (const auto& range : cu.ranges) {
+            append(&contents, range);
+        }
+    }
+    store(path(buildId, ".cus"), contents);
+}
+
+std::string PersistentSymbolCache::path(const std::string& buildId, const char* suffix) const
+{
+    // group the files like the .build-id directories of debug info packages do
+    return m_directory + '/' + buildId.substr(0, 2) + '/' + buildId.substr(2) + suffix;
+}
+
+void PersistentSymbolCache::store(const std::string& filePath, const std::string& contents) const
+{
+    if (!createDirectories(filePath.substr(0, filePath.rfind('/')))) {
+        return;
+    }
+
+    // write to a temporary file first, other interpreters may read the cache concurrently
+    std::string tmpPath = filePath + ".XXXXXX";
+    const auto fd = mkostemp(&tmpPath[0], O_CLOEXEC);
+    if (fd == -1) {
+        return;
+    }
+
+    const char* data = contents.data();
+    auto size = contents.size();
+    while (size) {
+        const auto ret = write(fd, data, size);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        } else if (ret <= 0) {
+            break;
+        }
+        data += ret;
+        size -= ret;
+    }
+
+    if (close(fd) != 0 || size || rename(tmpPath.c_str(), filePath.c_str()) != 0) {
+        unlink(tmpPath.c_str());
+    }
+}
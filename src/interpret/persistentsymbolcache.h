@@ -0,0 +1,51 @@
+/*
+    SPDX-FileCopyrightText: 2026 Milian Wolff <mail@milianw.de>
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#ifndef PERSISTENTSYMBOLCACHE_H
+#define PERSISTENTSYMBOLCACHE_H
+
+#include "dwarfdiecache.h"
+#include "symbolcache.h"
+
+#include <string>
+#include <vector>
+
+/**
+ * On-disk cache for the symbol tables and CU ranges of ELF files, keyed by their build-id.
+ *
+ * Extracting and sorting the symbols and walking all CU DIEs is repeated for the same
+ * libraries in every run of heaptrack_interpret. With this cache, only the first run
+ * needs to do that, later runs read the results back from compact binary files.
+ *
+ * Files are written atomically, so multiple interpreters can share one cache directory.
+ * Invalid or truncated files are ignored and get rewritten.
+ */
+class PersistentSymbolCache
+{
+public:
+    explicit PersistentSymbolCache(std::string directory);
+
+    /// @return the cache in $HEAPTRACK_SYMBOL_CACHE_DIR or nullptr when that is not set
+    static PersistentSymbolCache* fromEnvironment();
+
+    /// load the sorted symbols of @p buildId into @p symbols
+    bool loadSymbols(const std::string& buildId, SymbolCache::Symbols* symbols) const;
+    /// store the sorted @p symbols of @p buildId
+    void storeSymbols(const std::string& buildId, const SymbolCache::Symbols& symbols) const;
+
+    /// load the bias-free CU ranges of @p buildId into @p ranges
+    bool loadCuRanges(const std::string& buildId, std::vector<CuRanges>* ranges) const;
+    /// store the bias-free CU @p ranges of @p buildId
+    void storeCuRanges(const std::string& buildId, const std::vector<CuRanges>& ranges) const;
+
+private:
+    std::string path(const std::string& buildId, const char* suffix) const;
+    void store(const std::string& filePath, const std::string& contents) const;
+
+    std::string m_directory;
+};
+
+#endif // PERSISTENTSYMBOLCACHE_H
@@ -0,0 +1,355 @@
+/*
+    SPDX-FileCopyrightText: 2026 Milian Wolff <mail@milianw.de>
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include "segmentedoutput.h"
+
+#if ZSTD_FOUND
+#include "zstdcompressor.h"
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+/// @return the hex number at the beginning of @p data, skipping a single leading space
+uint64_t readHex(const char* data, const char* end, const char** next)
+{
+    if (data != end && *data == ' ') {
+        ++data;
+    }
+    uint64_t value = 0;
+    for (; data != end; ++data) {
+        const auto c = *data;
+        if (c >= '0' && c <= '9') {
+            value = value * 16 + (c - '0');
+        } else if (c >= 'a' && c <= 'f') {
+            value = value * 16 + (c - 'a' + 10);
+        } else {
+            break;
+        }
+    }
+    *next = data;
+    return value;
+}
+
+/// @return true for the records that later records may refer to, and the ones that describe the whole recording
+bool isDictionaryRecord(char mode)
+{
+    switch (mode) {
+    case 'X':
+    case 'I':
+    case 'N':
+    case 'P':
+    case 'A':
+    case 'S':
+    case 's':
+    case 'i':
+    case 'b':
+    case 't':
+    case 'a':
+    case 'H':
+    case 'Q':
+    case 'U':
+        return true;
+    default:
+        return false;
+    }
+}
+}
+
+SegmentedOutput::SegmentedOutput(std::string pattern, uint64_t maxDuration, uint64_t maxSize, unsigned keep)
+    : m_pattern(std::move(pattern))
+    , m_maxDuration(maxDuration)
+    , m_maxSize(maxSize)
+    , m_keep(keep)
+{
+    m_failed = !openSegment();
+}
+
+SegmentedOutput::~SegmentedOutput()
+{
+    if (m_fd != -1) {
+        close(m_fd);
+    }
+}
+
+SegmentedOutput* SegmentedOutput::fromEnvironment()
+{
+    const auto pattern = getenv("HEAPTRACK_SEGMENT_OUTPUT");
+    if (!pattern || !pattern[0]) {
+        return nullptr;
+    }
+    auto number = [](const char* name) -> uint64_t {
+        const auto value = getenv(name);
+        return value ? strtoull(value, nullptr, 10) : 0;
+    };
+    auto output = new SegmentedOutput(pattern, number("HEAPTRACK_SEGMENT_SECONDS") * 1000,
+                                      number("HEAPTRACK_SEGMENT_SIZE") * 1024 * 1024,
+                                      static_cast<unsigned>(number("HEAPTRACK_SEGMENT_KEEP")));
+    if (output->m_failed) {
+        delete output;
+        return nullptr;
+    }
+    return output;
+}
+
+bool SegmentedOutput::write(const char* data, size_t size)
+{
+    if (!m_partialLine.empty()) {
+        // complete the line that started in the previous chunk
+        const auto newline = static_cast<const char*>(memchr(data, '\n', size));
+        if (!newline) {
+            m_partialLine.append(data, size);
+            return !m_failed;
+        }
+        const size_t length = newline + 1 - data;
+        m_partialLine.append(data, length);
+        if (!writeLines(m_partialLine.data(), m_partialLine.size())) {
+            return false;
+        }
+        m_partialLine.clear();
+        data += length;
+        size -= length;
+    }
+
+    // keep an incomplete last line for later, such that segments never split a line
+    const auto lastNewline = static_cast<const char*>(memrchr(data, '\n', size));
+    const size_t complete = lastNewline ? lastNewline + 1 - data : 0;
+    m_partialLine.assign(data + complete, size - complete);
+    return writeLines(data, complete);
+}
+
+bool SegmentedOutput::finish()
+{
+    if (!m_partialLine.empty() && !writeOut(m_partialLine.data(), m_partialLine.size())) {
+        return false;
+    }
+    m_partialLine.clear();
+    return closeSegment();
+}
+
+bool SegmentedOutput::writeLines(const char* data, size_t size)
+{
+    const auto end = data + size;
+    // the beginning of the data that was not handed on yet
+    auto pending = data;
+    auto line = data;
+    while (line != end) {
+        const auto newline = static_cast<const char*>(memchr(line, '\n', end - line));
+        const auto next = newline + 1;
+        const auto mode = *line;
+        const char* field = line + 1;
+        if (mode == 'c') {
+            const auto timeStamp = readHex(field, newline, &field);
+            const bool full = m_maxSize && m_segmentSize + (line - pending) >= m_maxSize;
+            const bool expired = m_maxDuration && timeStamp >= m_segmentStart + m_maxDuration;
+            if (full || expired) {
+                if (!writeOut(pending, line - pending) || !rotate()) {
+                    return false;
+                }
+                pending = line;
+                m_segmentStart = timeStamp;
+            }
+        } else if (mode == '+') {
+            const auto index = readHex(field, newline, &field);
+            if (index >= m_live.size()) {
+                m_live.resize(index + 1);
+            }
+            ++m_live[index];
+        } else if (mode == 'r') {
+            const auto index = readHex(field, newline, &field);
+            const auto freedIndex = readHex(field, newline, &field);
+            if (std::max(index, freedIndex) >= m_live.size()) {
+                m_live.resize(std::max(index, freedIndex) + 1);
+            }
+            m_live[freedIndex] -= std::min<uint64_t>(1, m_live[freedIndex]);
+            ++m_live[index];
+        } else if (mode == 'e') {
+            const auto index = readHex(field, newline, &field);
+            const auto allocations = readHex(field, newline, &field);
+            const auto deallocations = readHex(field, newline, &field);
+            if (index >= m_live.size()) {
+                m_live.resize(index + 1);
+            }
+            const auto live = m_live[index] + allocations;
+            m_live[index] = live - std::min(deallocations, live);
+        } else if (mode == '-' || mode == 'z') {
+            const auto index = readHex(field, newline, &field);
+            const auto count = mode == 'z' ? readHex(field, newline, &field) : 1;
+            if (index < m_live.size()) {
+                m_live[index] -= std::min(count, m_live[index]);
+            }
+        } else if (mode == 'd') {
+            const auto index = readHex(field, newline, &field);
+            readHex(field, newline, &field); // allocations
+            readHex(field, newline, &field); // deallocations
+            readHex(field, newline, &field); // temporary
+            const auto allocated = readHex(field, newline, &field);
+            const auto freed = readHex(field, newline, &field);
+            if (index >= m_liveAggregated.size()) {
+                m_liveAggregated.resize(index + 1);
+            }
+            m_liveAggregated[index] += static_cast<int64_t>(allocated - freed);
+        } else if (mode == 'k' || mode == 'K') {
+            const auto size = readHex(field, newline, &field);
+            const auto index = readHex(field, newline, &field);
+            if (index >= m_mapped.size()) {
+                m_mapped.resize(index + 1);
+            }
+            m_mapped[index] += mode == 'k' ? static_cast<int64_t>(size) : -static_cast<int64_t>(size);
+        } else if (mode == 'v') {
+            if (m_version.empty()) {
+                m_version.assign(line, next - line);
+            }
+        } else if (isDictionaryRecord(mode)) {
+            m_dictionary.append(line, next - line);
+        }
+        line = next;
+    }
+    return writeOut(pending, end - pending);
+}
+
+bool SegmentedOutput::writeOut(const char* data, size_t size)
+{
+    if (m_failed) {
+        return false;
+    }
+    m_segmentSize += size;
+    if (m_compressor) {
+        m_failed = !m_compressor->write(data, size);
+        return !m_failed;
+    }
+    while (size) {
+        const auto ret = ::write(m_fd, data, size);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            m_failed = true;
+            return false;
+        }
+        data += ret;
+        size -= ret;
+    }
+    return true;
+}
+
+std::string SegmentedOutput::segmentName(uint64_t segment) const
+{
+    auto name = m_pattern;
+    const auto pos = name.find("%n");
+    if (pos != std::string::npos) {
+        name.replace(pos, 2, std::to_string(segment));
+    } else {
+        name += '.' + std::to_string(segment);
+    }
+    return name;
+}
+
+bool SegmentedOutput::openSegment()
+{
+    const auto name = segmentName(m_segment);
+    m_fd = open(name.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (m_fd == -1) {
+        std::cerr << "failed to open output segment " << name << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+#if ZSTD_FOUND
+    m_compressor.reset(ZstdCompressor::fromEnvironment(m_fd));
+#endif
+    m_segmentSize = 0;
+
+    if (m_keep && m_segment >= m_keep) {
+        unlink(segmentName(m_segment - m_keep).c_str());
+    }
+    return true;
+}
+
+bool SegmentedOutput::closeSegment()
+{
+    if (m_compressor) {
+        if (!m_compressor->finish()) {
+            m_failed = true;
+        }
+        m_compressor.reset();
+    }
+    if (m_fd != -1) {
+        close(m_fd);
+        m_fd = -1;
+    }
+    return !m_failed;
+}
+
+bool SegmentedOutput::rotate()
+{
+    if (!closeSegment()) {
+        return false;
+    }
+    ++m_segment;
+    if (!openSegment()) {
+        m_failed = true;
+        return false;
+    }
+
+    char buffer[64];
+    auto length = snprintf(buffer, sizeof(buffer), "G %llx\n", static_cast<unsigned long long>(m_segment));
+    if (!writeOut(m_version.data(), m_version.size()) || !writeOut(buffer, length)
+        || !writeOut(m_dictionary.data(), m_dictionary.size())) {
+        return false;
+    }
+    for (uint64_t index = 0; index < m_live.size(); ++index) {
+        if (!m_live[index]) {
+            continue;
+        }
+        length = snprintf(buffer, sizeof(buffer), "L %llx %llx\n", static_cast<unsigned long long>(index),
+                          static_cast<unsigned long long>(m_live[index]));
+        if (!writeOut(buffer, length)) {
+            return false;
+        }
+    }
+    int64_t liveAggregated = 0;
+    for (uint64_t index = 0; index < m_liveAggregated.size(); ++index) {
+        if (m_liveAggregated[index] <= 0) {
+            continue;
+        }
+        liveAggregated += m_liveAggregated[index];
+        length = snprintf(buffer, sizeof(buffer), "d %llx 0 0 0 %llx 0\n", static_cast<unsigned long long>(index),
+                          static_cast<unsigned long long>(m_liveAggregated[index]));
+        if (!writeOut(buffer, length)) {
+            return false;
+        }
+    }
+    if (liveAggregated) {
+        // the peak of the segment is at least what is alive when it starts
+        length = snprintf(buffer, sizeof(buffer), "D %llx\n", static_cast<unsigned long long>(liveAggregated));
+        if (!writeOut(buffer, length)) {
+            return false;
+        }
+    }
+    for (uint64_t index = 0; index < m_mapped.size(); ++index) {
+        if (m_mapped[index] <= 0) {
+            continue;
+        }
+        length = snprintf(buffer, sizeof(buffer), "k %llx %llx\n", static_cast<unsigned long long>(m_mapped[index]),
+                          static_cast<unsigned long long>(index));
+        if (!writeOut(buffer, length)) {
+            return false;
+        }
+    }
+    if (!writeOut("g\n", 2)) {
+        return false;
+    }
+    // the prologue doesn't count towards the size limit, it would be exceeded right away otherwise
+    m_segmentSize = 0;
+    return true;
+}
@@ -0,0 +1,94 @@
+/*
+    SPDX-FileCopyrightText: 2026 Milian Wolff <mail@milianw.de>
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#ifndef SEGMENTEDOUTPUT_H
+#define SEGMENTEDOUTPUT_H
+
+#include "util/linewriter.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * Splits the output of heaptrack_interpret into segment files of bounded duration or size.
+ *
+ * Every segment can be analyzed on its own: it starts with a prologue that repeats all records
+ * which the later ones may refer to, i.e. the header, strings, instruction pointers, traces and
+ * allocation infos written so far, followed by an 'L' record for the allocations that are still
+ * alive. Likewise, a 'd' snapshot and a 'D' peak repeat the aggregated cost that is still alive
+ * per trace, and a 'k' record the anonymous memory that is still mapped per trace. The prologue
+ * is framed by a 'G' and a 'g' record, which lets the analyzer skip it when it continues with
+ * the next segment after reading the previous one.
+ *
+ * Segments only get rotated before a time stamp record, and the oldest ones can be deleted to
+ * bound the disk usage of long-running recordings.
+ */
+class SegmentedOutput : public LineWriter::Sink
+{
+public:
+    /**
+     * @p pattern is the file name of the segments, where %n gets replaced by the segment number.
+     * A new segment is started once the current one covers @p maxDuration milliseconds or
+     * @p maxSize uncompressed bytes, not counting its prologue. Zero disables the limit.
+     * When @p keep is not zero, only that many of the latest segments are kept.
+     */
+    SegmentedOutput(std::string pattern, uint64_t maxDuration, uint64_t maxSize, unsigned keep);
+    ~SegmentedOutput();
+
+    SegmentedOutput(const SegmentedOutput&) = delete;
+    SegmentedOutput& operator=(const SegmentedOutput&) = delete;
+
+    /**
+     * @return the segmented output when $HEAPTRACK_SEGMENT_OUTPUT is set, otherwise nullptr
+     *
+     * The limits are taken from $HEAPTRACK_SEGMENT_SECONDS and $HEAPTRACK_SEGMENT_SIZE, which is
+     * given in megabytes, and the number of segments to keep from $HEAPTRACK_SEGMENT_KEEP.
+     */
+    static SegmentedOutput* fromEnvironment();
+
+    bool write(const char* data, size_t size) override;
+    bool finish() override;
+
+private:
+    /// @p data must consist of complete lines
+    bool writeLines(const char* data, size_t size);
+    bool writeOut(const char* data, size_t size);
+    std::string segmentName(uint64_t segment) const;
+    bool openSegment();
+    bool closeSegment();
+    bool rotate();
+
+    std::string m_pattern;
+    uint64_t m_maxDuration;
+    uint64_t m_maxSize;
+    unsigned m_keep;
+
+    uint64_t m_segment = 0;
+    int m_fd = -1;
+    std::unique_ptr<LineWriter::Sink> m_compressor;
+    bool m_failed = false;
+
+    /// the time stamp of the 'c' record the current segment started with
+    uint64_t m_segmentStart = 0;
+    /// the uncompressed bytes written to the current segment after its prologue
+    uint64_t m_segmentSize = 0;
+
+    /// the beginning of a line whose end was not handed to write() yet
+    std::string m_partialLine;
+    /// the 'v' record and the other records that get repeated in the prologue of every segment
+    std::string m_version;
+    std::string m_dictionary;
+    /// the number of live allocations per allocation info index
+    std::vector<uint64_t> m_live;
+    /// the bytes of the 'd' snapshots that are still alive per trace index, see HEAPTRACK_AGGREGATE
+    std::vector<int64_t> m_liveAggregated;
+    /// the bytes of anonymous memory that are still mapped per trace index, see HEAPTRACK_TRACK_MMAP
+    std::vector<int64_t> m_mapped;
+};
+
+#endif // SEGMENTEDOUTPUT_H
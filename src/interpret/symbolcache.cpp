@@ -61,7 +61,7 @@ SymbolCache::SymbolCacheEntry SymbolCache::findSymbol(const std::string& filePat
     return {};
 }
 
-void SymbolCache::setSymbols(const std::string& filePath, Symbols symbols)
+const SymbolCache::Symbols& SymbolCache::setSymbols(const std::string& filePath, Symbols symbols)
 {
     /*
      * use stable_sort to produce results that are comparable to what addr2line would
@@ -77,5 +77,12 @@ void SymbolCache::setSymbols(const std::string& filePath, Symbols symbols)
 
     std::stable_sort(symbols.begin(), symbols.end());
     symbols.erase(std::unique(symbols.begin(), symbols.end()), symbols.end());
+    auto& ret = m_symbolCache[filePath];
+    ret = std::move(symbols);
+    return ret;
+}
+
+void SymbolCache::setSortedSymbols(const std::string& filePath, Symbols symbols)
+{
     m_symbolCache[filePath] = std::move(symbols);
 }
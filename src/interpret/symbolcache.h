@@ -46,7 +46,10 @@ public:
     /// check if @c setSymbolCache was called for @p filePath already
     bool hasSymbols(const std::string& filePath) const;
     /// take @p cache, sort it and use it for symbol lookups in @p filePath
-    void setSymbols(const std::string& filePath, Symbols symbols);
+    /// @return the sorted symbols, before any of them got demangled
+    const Symbols& setSymbols(const std::string& filePath, Symbols symbols);
+    /// like @c setSymbols, for @p symbols that were sorted by it already, e.g. in a previous run
+    void setSortedSymbols(const std::string& filePath, Symbols symbols);
     /// find the symbol that encompasses @p relAddr in @p filePath
     /// if the found symbol wasn't yet demangled, it will be demangled now
     SymbolCacheEntry findSymbol(const std::string& filePath, uint64_t relAddr);
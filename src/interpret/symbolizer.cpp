@@ -0,0 +1,393 @@
+/*
+    SPDX-FileCopyrightText: 2014-2026 Milian Wolff <mail@milianw.de>
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include "symbolizer.h"
+
+#include "debuginfodfetcher.h"
+
+#include <dwarf.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#include <fcntl.h>
+
+namespace {
+bool isArmArch()
+{
+#ifdef __arm__
+    return true;
+#else
+    return false;
+#endif
+}
+
+#define error_out std::cerr << __FILE__ << ':' << __LINE__ << " ERROR:"
+
+bool startsWith(const std::string& haystack, const char* needle)
+{
+    return haystack.compare(0, strlen(needle), needle) == 0;
+}
+
+uint64_t alignedAddress(uint64_t addr, bool isArmArch)
+{
+    // Adjust addr back. The symtab entries are 1 off for all practical purposes.
+    return (isArmArch && (addr & 1)) ? addr - 1 : addr;
+}
+
+SymbolCache::Symbols extractSymbols(Dwfl_Module* module, uint64_t elfStart, bool isArmArch)
+{
+    SymbolCache::Symbols symbols;
+
+    const auto numSymbols = dwfl_module_getsymtab(module);
+    if (numSymbols <= 0)
+        return symbols;
+
+    symbols.reserve(numSymbols);
+    for (int i = 0; i < numSymbols; ++i) {
+        GElf_Sym sym;
+        GElf_Addr symAddr;
+        const auto symbol = dwfl_module_getsym_info(module, i, &sym, &symAddr, nullptr, nullptr, nullptr);
+        if (symbol) {
+            const uint64_t start = alignedAddress(sym.st_value, isArmArch);
+            symbols.push_back({symAddr - elfStart, start, sym.st_size, symbol});
+        }
+    }
+    return symbols;
+}
+
+/// like dwfl_standard_find_debuginfo, but waits for the debug information that debuginfod fetches in the background
+int findDebuginfo(Dwfl_Module* module, void** userData, const char* moduleName, Dwarf_Addr base, const char* fileName,
+                  const char* debugLink, GElf_Word debugLinkCrc, char** debugFileName)
+{
+    if (auto fetcher = DebuginfodFetcher::instance()) {
+        const auto path = fetcher->debugFile(moduleBuildId(module));
+        if (!path.empty()) {
+            const auto fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd >= 0) {
+                *debugFileName = strdup(path.c_str());
+                return fd;
+            }
+        }
+    }
+    return dwfl_standard_find_debuginfo(module, userData, moduleName, base, fileName, debugLink, debugLinkCrc,
+                                        debugFileName);
+}
+}
+
+Module::Module(std::string fileName, uintptr_t addressStart, Dwfl_Module* module, SymbolCache* symbolCache,
+               const PersistentSymbolCache* persistentCache)
+    : fileName(std::move(fileName))
+    , addressStart(addressStart)
+    , module(module)
+    , symbolCache(symbolCache)
+    , persistentCache(persistentCache)
+{
+    if (module && persistentCache) {
+        buildId = moduleBuildId(module);
+    }
+
+    if (buildId.empty()) {
+        dieCache = DwarfDieCache(module);
+        return;
+    }
+
+    std::vector<CuRanges> cuRanges;
+    if (!persistentCache->loadCuRanges(buildId, &cuRanges) || !dieCache.restore(module, cuRanges)) {
+        dieCache = DwarfDieCache(module);
+        persistentCache->storeCuRanges(buildId, dieCache.cuRanges());
+    }
+}
+
+void Module::prepare() const
+{
+    if (!module) {
+        return;
+    }
+    loadSymbols();
+    dieCache.buildIndex();
+}
+
+void Module::loadSymbols() const
+{
+    if (!symbolCache->hasSymbols(fileName)) {
+        // cache all symbols in a sorted lookup table and demangle them on-demand
+        // note that the symbols within the symtab aren't necessarily sorted,
+        // which makes searching repeatedly via dwfl_module_addrinfo potentially very slow
+        SymbolCache::Symbols symbols;
+        if (!buildId.empty() && persistentCache->loadSymbols(buildId, &symbols)) {
+            symbolCache->setSortedSymbols(fileName, std::move(symbols));
+        } else {
+            const auto& sorted =
+                symbolCache->setSymbols(fileName, extractSymbols(module, addressStart, isArmArch()));
+            if (!buildId.empty()) {
+                persistentCache->storeSymbols(buildId, sorted);
+            }
+        }
+    }
+}
+
+AddressInformation Module::resolveAddress(uintptr_t address) const
+{
+    AddressInformation info;
+
+    if (!module) {
+        return info;
+    }
+
+    loadSymbols();
+
+    auto cachedAddrInfo = symbolCache->findSymbol(fileName, address - addressStart);
+    if (cachedAddrInfo.isValid()) {
+        info.frame.function = std::move(cachedAddrInfo.symname);
+    }
+
+    auto cuDie = dieCache.findCuDie(address);
+    if (!cuDie) {
+        return info;
+    }
+
+    const auto offset = address - cuDie->bias();
+    auto srcloc = dwarf_getsrc_die(cuDie->cudie(), offset);
+    if (srcloc) {
+        const char* srcfile = dwarf_linesrc(srcloc, nullptr, nullptr);
+        if (srcfile) {
+            const auto file = std::string(srcfile);
+            info.frame.file = srcfile;
+            dwarf_lineno(srcloc, &info.frame.line);
+        }
+    }
+
+    auto* subprogram = cuDie->findSubprogramDie(offset);
+    if (!subprogram) {
+        return info;
+    }
+
+    // resolve the inline chain if possible, this is cached for all addresses within the same inlined scope
+    const auto* chain = cuDie->inlineChain(subprogram, offset);
+    if (!chain) {
+        // no inline frames, use subprogram name directly and return
+        info.frame.function = cuDie->dieName(subprogram->die());
+        return info;
+    }
+
+    // use name of the last inlined function as symbol
+    info.frame.function = chain->function;
+    info.inlined.reserve(chain->calls.size());
+    for (const auto& call : chain->calls) {
+        info.inlined.push_back({call.function, call.location.file, call.location.line});
+    }
+
+    return info;
+}
+
+bool LoadedModules::contains(const std::string& fileName, uintptr_t addressStart) const
+{
+    return std::binary_search(modules.begin(), modules.end(), std::make_pair(addressStart, fileName));
+}
+
+Symbolizer::Symbolizer(const PersistentSymbolCache* persistentCache, const std::string& extraDebugPath,
+                       bool sharedModules)
+    : m_persistentCache(persistentCache)
+    , m_sharedModules(sharedModules)
+{
+    {
+        std::string debugPath(":.debug:/usr/lib/debug");
+        if (!extraDebugPath.empty()) {
+            debugPath += ':';
+            debugPath += extraDebugPath;
+        }
+        const auto length = debugPath.size() + 1;
+        m_debugPath = new char[length];
+        std::memcpy(m_debugPath, debugPath.data(), length);
+    }
+
+    m_callbacks = {
+        &dwfl_build_id_find_elf,
+        &findDebuginfo,
+        &dwfl_offline_section_address,
+        &m_debugPath,
+    };
+
+    m_dwfl = dwfl_begin(&m_callbacks);
+}
+
+Symbolizer::~Symbolizer()
+{
+    // the modules reference the dwfl state
+    m_modules.clear();
+    delete[] m_debugPath;
+    dwfl_end(m_dwfl);
+}
+
+AddressInformation Symbolizer::resolve(const ModuleFragment& fragment, uintptr_t ip, const LoadedModules& loadedModules)
+{
+    if (m_sharedModules) {
+        if (auto module = reportModule(fragment)) {
+            return module->resolveAddress(ip - fragment.addressStart + module->addressStart);
+        }
+        return {};
+    }
+
+    if (loadedModules.generation != m_modulesGeneration) {
+        dropUnloadedModules(loadedModules);
+        m_modulesGeneration = loadedModules.generation;
+    }
+
+    if (auto module = reportModule(fragment)) {
+        return module->resolveAddress(ip);
+    }
+    return {};
+}
+
+void Symbolizer::prepare(const ModuleFragment& fragment)
+{
+    // modules we know already got prepared on their first use, and when something else is loaded
+    // at the address, that is left to resolve() which first drops the modules that got unloaded
+    if (m_modules.count(moduleKey(fragment))
+        || (!m_sharedModules && dwfl_addrmodule(m_dwfl, fragment.addressStart))) {
+        return;
+    }
+    if (auto module = reportModule(fragment)) {
+        module->prepare();
+    }
+}
+
+Module* Symbolizer::reportModule(const ModuleFragment& module)
+{
+    if (startsWith(module.fileName, "linux-vdso.so")) {
+        return nullptr;
+    }
+
+    const auto& key = moduleKey(module);
+    auto& ret = m_modules[key];
+    if (ret.module)
+        return &ret;
+
+    if (m_sharedModules) {
+        Dwarf_Addr bias = 0;
+        if (auto dwflModule = reportSharedModule(module, &bias)) {
+            // the build-id keeps the symbols of different files with the same name apart
+            ret = Module(key, bias, dwflModule, &m_symbolCache, m_persistentCache);
+            return &ret;
+        }
+        return nullptr;
+    }
+
+    auto dwflModule = dwfl_addrmodule(m_dwfl, module.addressStart);
+    if (!dwflModule) {
+        dwfl_report_begin_add(m_dwfl);
+        dwflModule = dwfl_report_elf(m_dwfl, module.fileName.c_str(), module.fileName.c_str(), -1,
+                                     module.addressStart, false);
+        dwfl_report_end(m_dwfl, nullptr, nullptr);
+
+        if (!dwflModule) {
+            error_out << "Failed to report module for " << module.fileName << ": " << dwfl_errmsg(dwfl_errno())
+                      << std::endl;
+            return nullptr;
+        }
+    }
+
+    ret = Module(module.fileName, module.addressStart, dwflModule, &m_symbolCache, m_persistentCache);
+    return &ret;
+}
+
+Dwfl_Module* Symbolizer::reportSharedModule(const ModuleFragment& fragment, Dwarf_Addr* bias)
+{
+    dwfl_report_begin_add(m_dwfl);
+    auto dwflModule = dwfl_report_elf(m_dwfl, fragment.fileName.c_str(), fragment.fileName.c_str(), -1,
+                                      m_nextModuleAddress, false);
+    dwfl_report_end(m_dwfl, nullptr, nullptr);
+
+    if (!dwflModule || !dwfl_module_getelf(dwflModule, bias)) {
+        error_out << "Failed to report module for " << fragment.fileName << ": " << dwfl_errmsg(dwfl_errno())
+                  << std::endl;
+        return nullptr;
+    }
+
+    // executables that are not position independent ignore the address, they don't move anyway
+    Dwarf_Addr high = 0;
+    dwfl_module_info(dwflModule, nullptr, nullptr, &high, nullptr, nullptr, nullptr, nullptr);
+    const auto end = (high + SHARED_MODULE_ALIGNMENT - 1) & ~Dwarf_Addr(SHARED_MODULE_ALIGNMENT - 1);
+    m_nextModuleAddress = std::max(m_nextModuleAddress, end);
+    return dwflModule;
+}
+
+const std::string& Symbolizer::moduleKey(const ModuleFragment& fragment) const
+{
+    return m_sharedModules && !fragment.buildId.empty() ? fragment.buildId : fragment.fileName;
+}
+
+void Symbolizer::dropUnloadedModules(const LoadedModules& loadedModules)
+{
+    // dwfl removes all modules that don't get reported again, re-reporting a module
+    // with the same name and address range reuses it including its symbols and dwarf data
+    dwfl_report_begin(m_dwfl);
+    for (auto it = m_modules.begin(); it != m_modules.end();) {
+        const auto& module = it->second;
+        if (module.module && loadedModules.contains(module.fileName, module.addressStart)) {
+            Dwarf_Addr low = 0;
+            Dwarf_Addr high = 0;
+            const auto name = dwfl_module_info(module.module, nullptr, &low, &high, nullptr, nullptr, nullptr, nullptr);
+            if (dwfl_report_module(m_dwfl, name, low, high) == module.module) {
+                ++it;
+                continue;
+            }
+        }
+        it = m_modules.erase(it);
+    }
+    dwfl_report_end(m_dwfl, nullptr, nullptr);
+}
+
+namespace {
+std::string hexBuildId(const unsigned char* bits, int length)
+{
+    static const char hexChars[] = "0123456789abcdef";
+    std::string ret;
+    ret.reserve(length * 2);
+    for (int i = 0; i < length; ++i) {
+        ret.push_back(hexChars[bits[i] >> 4]);
+        ret.push_back(hexChars[bits[i] & 0xf]);
+    }
+    return ret;
+}
+}
+
+std::string moduleBuildId(Dwfl_Module* module)
+{
+    const unsigned char* bits = nullptr;
+    GElf_Addr vaddr = 0;
+    const auto length = dwfl_module_build_id(module, &bits, &vaddr);
+    if (length <= 0) {
+        return {};
+    }
+    return hexBuildId(bits, length);
+}
+
+std::string elfBuildId(const std::string& path)
+{
+    // reporting the module only reads the ELF headers, neither the symbols nor the debug information
+    static const Dwfl_Callbacks callbacks = {
+        &dwfl_build_id_find_elf,
+        &dwfl_standard_find_debuginfo,
+        &dwfl_offline_section_address,
+        nullptr,
+    };
+    auto dwfl = dwfl_begin(&callbacks);
+    if (!dwfl) {
+        return {};
+    }
+
+    std::string ret;
+    dwfl_report_begin(dwfl);
+    if (auto module = dwfl_report_elf(dwfl, path.c_str(), path.c_str(), -1, 0, false)) {
+        ret = moduleBuildId(module);
+    }
+    dwfl_report_end(dwfl, nullptr, nullptr);
+    dwfl_end(dwfl);
+    return ret;
+}
@@ -0,0 +1,198 @@
+/*
+    SPDX-FileCopyrightText: 2014-2026 Milian Wolff <mail@milianw.de>
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#ifndef SYMBOLIZER_H
+#define SYMBOLIZER_H
+
+#include "dwarfdiecache.h"
+#include "persistentsymbolcache.h"
+#include "symbolcache.h"
+
+#include <elfutils/libdwfl.h>
+
+#include <tsl/robin_map.h>
+
+#include <cstdint>
+#include <string>
+#include <tuple>
+#include <vector>
+
+struct Frame
+{
+    Frame(std::string function = {}, std::string file = {}, int line = 0)
+        : function(function)
+        , file(file)
+        , line(line)
+    {
+    }
+
+    bool isValid() const
+    {
+        return !function.empty();
+    }
+
+    std::string function;
+    std::string file;
+    int line;
+};
+
+struct AddressInformation
+{
+    Frame frame;
+    std::vector<Frame> inlined;
+};
+
+struct ModuleFragment
+{
+    ModuleFragment(std::string fileName, uintptr_t addressStart, uintptr_t fragmentStart, uintptr_t fragmentEnd,
+                   size_t moduleIndex)
+        : fileName(fileName)
+        , addressStart(addressStart)
+        , fragmentStart(fragmentStart)
+        , fragmentEnd(fragmentEnd)
+        , moduleIndex(moduleIndex)
+    {
+    }
+
+    bool operator<(const ModuleFragment& module) const
+    {
+        return std::tie(addressStart, fragmentStart, fragmentEnd, moduleIndex)
+            < std::tie(module.addressStart, module.fragmentStart, module.fragmentEnd, module.moduleIndex);
+    }
+
+    bool operator!=(const ModuleFragment& module) const
+    {
+        return std::tie(addressStart, fragmentStart, fragmentEnd, moduleIndex)
+            != std::tie(module.addressStart, module.fragmentStart, module.fragmentEnd, module.moduleIndex);
+    }
+
+    std::string fileName;
+    uintptr_t addressStart;
+    uintptr_t fragmentStart;
+    uintptr_t fragmentEnd;
+    size_t moduleIndex;
+    /// hex encoded, only required by symbolizers with shared modules
+    std::string buildId;
+};
+
+struct Module
+{
+    Module(std::string fileName, uintptr_t addressStart, Dwfl_Module* module, SymbolCache* symbolCache,
+           const PersistentSymbolCache* persistentCache);
+
+    Module()
+        : Module({}, 0, nullptr, nullptr, nullptr)
+    {
+    }
+
+    AddressInformation resolveAddress(uintptr_t address) const;
+    /// load the symbols and index the debug information, which otherwise happens on the first resolveAddress
+    void prepare() const;
+
+    std::string fileName;
+    uintptr_t addressStart;
+    Dwfl_Module* module;
+    mutable DwarfDieCache dieCache;
+    SymbolCache* symbolCache;
+    const PersistentSymbolCache* persistentCache;
+    /// hex encoded, only set when the persistent cache is used
+    std::string buildId;
+
+private:
+    void loadSymbols() const;
+};
+
+/**
+ * Snapshot of the modules that are loaded, identified by their file name and load address.
+ *
+ * The generation only changes when modules got unloaded or moved, additional modules
+ * get reported to the symbolizers on demand without invalidating anything.
+ */
+struct LoadedModules
+{
+    bool contains(const std::string& fileName, uintptr_t addressStart) const;
+
+    uint64_t generation = 0;
+    /// sorted by address
+    std::vector<std::pair<uintptr_t, std::string>> modules;
+};
+
+/**
+ * Resolves instruction pointers to symbols and source locations via its own Dwfl instance.
+ *
+ * libdw is not thread-safe, so every thread that resolves addresses needs its own symbolizer.
+ *
+ * With shared modules, a symbolizer resolves the addresses of multiple processes, in which the
+ * same modules are loaded at different addresses. The modules are then identified by their
+ * build-id and only reported once, at an address of our choosing, and the addresses within
+ * them get translated to that. They are never dropped again.
+ */
+class Symbolizer
+{
+public:
+    /**
+     * @p persistentCache optional on-disk cache for the symbols, shared between all symbolizers
+     * @p extraDebugPath colon separated list of additional directories to look for debug information in
+     * @p sharedModules identify the modules by their build-id, see above
+     */
+    explicit Symbolizer(const PersistentSymbolCache* persistentCache, const std::string& extraDebugPath = {},
+                        bool sharedModules = false);
+    ~Symbolizer();
+
+    Symbolizer(const Symbolizer&) = delete;
+    Symbolizer& operator=(const Symbolizer&) = delete;
+
+    /**
+     * Resolve @p ip within @p fragment.
+     *
+     * Whenever the generation of @p loadedModules changes, the previously reported modules that are
+     * not part of it anymore are dropped. All others keep their symbols and debug information.
+     */
+    AddressInformation resolve(const ModuleFragment& fragment, uintptr_t ip, const LoadedModules& loadedModules);
+
+    /**
+     * Report the module of @p fragment and load its symbols and debug information ahead of time,
+     * such that resolving its addresses later on is fast.
+     *
+     * This does nothing when the module was reported already or something else is still loaded
+     * at its address, which only resolve() can sort out.
+     */
+    void prepare(const ModuleFragment& fragment);
+
+private:
+    Module* reportModule(const ModuleFragment& module);
+    /// report the module of @p fragment once for all processes, see sharedModules
+    Dwfl_Module* reportSharedModule(const ModuleFragment& fragment, Dwarf_Addr* bias);
+    void dropUnloadedModules(const LoadedModules& loadedModules);
+    const std::string& moduleKey(const ModuleFragment& fragment) const;
+
+    Dwfl* m_dwfl = nullptr;
+    char* m_debugPath = nullptr;
+    Dwfl_Callbacks m_callbacks;
+    SymbolCache m_symbolCache;
+    const PersistentSymbolCache* m_persistentCache;
+    uint64_t m_modulesGeneration = 0;
+    const bool m_sharedModules;
+    /// where the next shared module gets reported
+    Dwarf_Addr m_nextModuleAddress = FIRST_SHARED_MODULE_ADDRESS;
+    /// indexed by the file name, or the build-id for shared modules
+    tsl::robin_map<std::string, Module> m_modules;
+
+    enum : Dwarf_Addr
+    {
+        // well above the addresses that executables which are not position independent get linked to
+        FIRST_SHARED_MODULE_ADDRESS = 1ull << 44,
+        SHARED_MODULE_ALIGNMENT = 1024 * 1024
+    };
+};
+
+/// @return the hex encoded build-id of @p module or an empty string when it has none
+std::string moduleBuildId(Dwfl_Module* module);
+
+/// @return the hex encoded build-id of the ELF file at @p path or an empty string when it has none
+std::string elfBuildId(const std::string& path);
+
+#endif // SYMBOLIZER_H
@@ -0,0 +1,161 @@
+/*
+    SPDX-FileCopyrightText: 2026 Milian Wolff <mail@milianw.de>
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include "zstdcompressor.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+
+#include <unistd.h>
+
+namespace {
+enum : uint32_t
+{
+    // see zstd's contrib/seekable_format/zstd_seekable_compression_format.md
+    SKIPPABLE_MAGIC = 0x184D2A5E,
+    SEEKABLE_MAGIC = 0x8F92EAB1,
+    SEEK_TABLE_FOOTER_SIZE = 9,
+    // smallest job size accepted by zstd's multithreaded compression
+    MIN_JOB_SIZE = 512 * 1024,
+};
+
+void appendLittleEndian(std::vector<char>* buffer, uint32_t value)
+{
+    for (int i = 0; i < 4; ++i) {
+        buffer->push_back(static_cast<char>(value >> (8 * i)));
+    }
+}
+}
+
+ZstdCompressor::ZstdCompressor(int fd, int level, unsigned workers)
+    : m_fd(fd)
+    , m_context(ZSTD_createCCtx())
+    , m_output(ZSTD_CStreamOutSize())
+{
+    ZSTD_CCtx_setParameter(m_context, ZSTD_c_compressionLevel, level);
+    ZSTD_CCtx_setParameter(m_context, ZSTD_c_checksumFlag, 1);
+    if (workers > 0) {
+        // fails when zstd got built without threading support, we then compress in this thread instead
+        if (!ZSTD_isError(ZSTD_CCtx_setParameter(m_context, ZSTD_c_nbWorkers, workers))) {
+            // split every frame into at least one job per worker
+            const auto jobSize = std::max<size_t>(FRAME_SIZE / workers, MIN_JOB_SIZE);
+            ZSTD_CCtx_setParameter(m_context, ZSTD_c_jobSize, jobSize);
+        }
+    }
+}
+
+ZstdCompressor::~ZstdCompressor()
+{
+    ZSTD_freeCCtx(m_context);
+}
+
+ZstdCompressor* ZstdCompressor::fromEnvironment(int fd)
+{
+    const auto levelEnv = getenv("HEAPTRACK_ZSTD_LEVEL");
+    if (!levelEnv || !levelEnv[0]) {
+        return nullptr;
+    }
+    const int level = atoi(levelEnv);
+
+    // the interpreter and the symbolizers need some CPU time too
+    unsigned workers = std::min(std::thread::hardware_concurrency(), 4u);
+    if (const auto workersEnv = getenv("HEAPTRACK_ZSTD_WORKERS")) {
+        workers = strtoul(workersEnv, nullptr, 10);
+    }
+    return new ZstdCompressor(fd, level ? level : DEFAULT_LEVEL, workers);
+}
+
+bool ZstdCompressor::write(const char* data, size_t size)
+{
+    while (size && !m_failed) {
+        const auto chunkSize = std::min<size_t>(size, FRAME_SIZE - m_frameInput);
+        ZSTD_inBuffer input = {data, chunkSize, 0};
+        if (!compress(&input, ZSTD_e_continue)) {
+            return false;
+        }
+        m_frameInput += chunkSize;
+        data += chunkSize;
+        size -= chunkSize;
+
+        if (m_frameInput == FRAME_SIZE && !endFrame()) {
+            return false;
+        }
+    }
+    return !m_failed;
+}
+
+bool ZstdCompressor::finish()
+{
+    if (m_frameInput && !endFrame()) {
+        return false;
+    }
+
+    std::vector<char> seekTable;
+    const auto tableSize = m_seekTable.size() * sizeof(SeekTableEntry) + SEEK_TABLE_FOOTER_SIZE;
+    seekTable.reserve(tableSize + 8);
+    appendLittleEndian(&seekTable, SKIPPABLE_MAGIC);
+    appendLittleEndian(&seekTable, static_cast<uint32_t>(tableSize));
+    for (const auto& entry : m_seekTable) {
+        appendLittleEndian(&seekTable, entry.compressedSize);
+        appendLittleEndian(&seekTable, entry.decompressedSize);
+    }
+    appendLittleEndian(&seekTable, static_cast<uint32_t>(m_seekTable.size()));
+    // descriptor: no checksums in the seek table, the frames have their own
+    seekTable.push_back(0);
+    appendLittleEndian(&seekTable, SEEKABLE_MAGIC);
+    return writeAll(seekTable.data(), seekTable.size());
+}
+
+bool ZstdCompressor::compress(ZSTD_inBuffer* input, ZSTD_EndDirective directive)
+{
+    size_t remaining = 0;
+    do {
+        ZSTD_outBuffer output = {m_output.data(), m_output.size(), 0};
+        remaining = ZSTD_compressStream2(m_context, &output, input, directive);
+        if (ZSTD_isError(remaining)) {
+            std::cerr << "failed to compress output: " << ZSTD_getErrorName(remaining) << std::endl;
+            m_failed = true;
+            return false;
+        }
+        m_frameOutput += output.pos;
+        if (!writeAll(m_output.data(), output.pos)) {
+            return false;
+        }
+    } while (directive == ZSTD_e_continue ? input->pos < input->size : remaining != 0);
+    return true;
+}
+
+bool ZstdCompressor::endFrame()
+{
+    ZSTD_inBuffer input = {nullptr, 0, 0};
+    if (!compress(&input, ZSTD_e_end)) {
+        return false;
+    }
+    m_seekTable.push_back({static_cast<uint32_t>(m_frameOutput), static_cast<uint32_t>(m_frameInput)});
+    m_frameInput = 0;
+    m_frameOutput = 0;
+    return true;
+}
+
+bool ZstdCompressor::writeAll(const char* data, size_t size)
+{
+    while (size) {
+        const auto ret = ::write(m_fd, data, size);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            m_failed = true;
+            return false;
+        }
+        data += ret;
+        size -= ret;
+    }
+    return true;
+}
@@ -0,0 +1,79 @@
+/*
+    SPDX-FileCopyrightText: 2026 Milian Wolff <mail@milianw.de>
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#ifndef ZSTDCOMPRESSOR_H
+#define ZSTDCOMPRESSOR_H
+
+#include "util/linewriter.h"
+
+#include <cstdint>
+#include <vector>
+
+#include <zstd.h>
+
+/**
+ * Compresses the output of a LineWriter with zstd and writes it to a file descriptor.
+ *
+ * This replaces the external compressor that the output of heaptrack_interpret used
+ * to be piped through, which saves a copy and lets zstd compress on multiple threads.
+ *
+ * The data is split into independent frames of FRAME_SIZE uncompressed bytes and
+ * a seek table in the zstd seekable format gets appended at the end. Regular zstd
+ * decompressors skip that table, but it allows readers to find the frames and
+ * decompress them in parallel.
+ */
+class ZstdCompressor : public LineWriter::Sink
+{
+public:
+    enum
+    {
+        DEFAULT_LEVEL = 3,
+        FRAME_SIZE = 16 * 1024 * 1024
+    };
+
+    /**
+     * @p level is the zstd compression level and @p workers the number of
+     * threads compressing in the background, 0 compresses in the calling thread
+     */
+    ZstdCompressor(int fd, int level, unsigned workers);
+    ~ZstdCompressor();
+
+    ZstdCompressor(const ZstdCompressor&) = delete;
+    ZstdCompressor& operator=(const ZstdCompressor&) = delete;
+
+    /**
+     * @return a compressor for @p fd when $HEAPTRACK_ZSTD_LEVEL is set, otherwise nullptr
+     *
+     * The number of workers can be overridden via $HEAPTRACK_ZSTD_WORKERS.
+     */
+    static ZstdCompressor* fromEnvironment(int fd);
+
+    bool write(const char* data, size_t size) override;
+    bool finish() override;
+
+private:
+    bool compress(ZSTD_inBuffer* input, ZSTD_EndDirective directive);
+    bool endFrame();
+    bool writeAll(const char* data, size_t size);
+
+    int m_fd;
+    ZSTD_CCtx* m_context;
+    std::vector<char> m_output;
+    bool m_failed = false;
+
+    /// number of uncompressed and compressed bytes of the current frame
+    size_t m_frameInput = 0;
+    size_t m_frameOutput = 0;
+
+    struct SeekTableEntry
+    {
+        uint32_t compressedSize;
+        uint32_t decompressedSize;
+    };
+    std::vector<SeekTableEntry> m_seekTable;
+};
+
+#endif // ZSTDCOMPRESSOR_H
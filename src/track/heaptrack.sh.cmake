@@ -10,6 +10,7 @@ usage() {
     echo "Usage: $0 [--debug|-d] [--use-inject] [--record-only] DEBUGGEE [ARGUMENT]..."
     echo "or:    $0 [--debug|-d] -p PID"
     echo "or:    $0 -a FILE"
+    echo "or:    $0 [-o FILE] --collect [HOST:]PORT"
     echo
     echo "A heap memory usage profiler. It uses LD_PRELOAD to track all"
     echo "calls to the core memory allocation functions and logs these"
@@ -36,12 +37,29 @@ usage() {
     echo
     echo "Optional arguments to heaptrack:"
     echo "  -r, --raw      Only record raw data, do not interpret it."
+    echo " --mmap          Let the debuggee write the raw data into a memory mapped file by itself, without"
+    echo "                 compressing it. No helper processes are needed then, which gives the lowest overhead."
+    echo "                 Implies --raw."
     echo "  -d, --debug    Run the debuggee in GDB and heaptrack."
     echo " --use-inject    Use the same heaptrack_inject symbol interception mechanism instead of relying on"
     echo "                 the dynamic linker and LD_PRELOAD. This is an experimental flag for now."
     echo " --asan          Enables running heaptrack on binaries built with gcc's address sanitizer enabled."
     echo "                 Implies --use-inject."
     echo " --record-only   Only record and interpret the data, do not attempt to analyze it."
+    echo " --defer-symbols Do not resolve symbols while recording, which reduces the CPU usage."
+    echo "                 Run heaptrack_symbolize on the data afterwards, possibly on a different machine."
+    echo "                 Implies --record-only."
+    echo " --follow-fork   Also trace the child processes forked by the debuggee, each into its own"
+    echo "                 output file named after the pid of the child."
+    echo " --remote HOST:PORT"
+    echo "                 Stream the raw data to a collector started via --collect on HOST instead of"
+    echo "                 interpreting it locally, which saves the CPU time and disk I/O of the interpreter."
+    echo " --daemon PIPE   Let the interpreter daemon that was started via HEAPTRACK_INTERPRET_DAEMON=PIPE interpret"
+    echo "                 the data. It shares the symbols and debug information of the modules between all the"
+    echo "                 processes it interprets at the same time, e.g. many worker processes of one executable."
+    echo " --perf          Profile the debuggee and the interpreter with perf record, to find out where heaptrack"
+    echo "                 itself spends its time. The profiles get written next to the output file."
+    echo "                 Custom arguments for perf record can be passed via HEAPTRACK_PERF_ARGS."
     echo "  ARGUMENT       Any number of arguments that will be passed verbatim"
     echo "                 to the debuggee."
     echo "  -h, --help     Show this help message and exit."
@@ -54,6 +72,10 @@ usage() {
     echo "                   ./%h/%p/outdat will be translated into ./<hostname>/<pid>/outdat."
     echo "                   The directory ./<hostname>/<pid> will be created if it doesn't exist."
     echo
+    echo "Alternatively, to collect the data streamed by heaptrack --remote:"
+    echo "  --collect [HOST:]PORT Wait for a connection on PORT and interpret the data, the symbols"
+    echo "                        are resolved afterwards via heaptrack_symbolize, see --defer-symbols."
+    echo
     echo "Alternatively, to analyze a recorded heaptrack data file:"
     echo "  -a, --analyze FILE    Open the heaptrack data file in heaptrack_gui, if available,"
     echo "                        or fallback to heaptrack_print otherwise."
@@ -68,6 +90,12 @@ client=
 use_inject_lib=
 write_raw_data=
 record_only=
+defer_symbols=
+follow_fork=
+remote=
+collect=
+daemon=
+perf=
 asan=
 asan_ld_preload=
 
@@ -104,6 +132,11 @@ while true; do
             write_raw_data=1
             shift 1
             ;;
+        "--mmap")
+            write_raw_data=1
+            mmap_output=1
+            shift 1
+            ;;
         "--asan")
             asan=1
             use_inject_lib=1
@@ -113,6 +146,47 @@ while true; do
             record_only=1
             shift 1
             ;;
+        "--defer-symbols")
+            defer_symbols=1
+            record_only=1
+            shift 1
+            ;;
+        "--follow-fork")
+            follow_fork=1
+            shift 1
+            ;;
+        "--remote")
+            if [ -z "$2" ]; then
+                echo "Missing collector address argument."
+                exit 1
+            fi
+            remote=$2
+            shift 2
+            ;;
+        "--collect")
+            if [ -z "$2" ]; then
+                echo "Missing port argument."
+                exit 1
+            fi
+            collect=$2
+            break
+            ;;
+        "--daemon")
+            if [ ! -p "$2" ]; then
+                echo "Missing pipe of the interpreter daemon, see HEAPTRACK_INTERPRET_DAEMON."
+                exit 1
+            fi
+            daemon=$2
+            shift 2
+            ;;
+        "--perf")
+            if [ -z "$(command -v perf 2> /dev/null)" ]; then
+                echo "perf is not installed, cannot profile heaptrack."
+                exit 1
+            fi
+            perf=1
+            shift 1
+            ;;
         "-h" | "--help")
             usage
             exit 0
@@ -134,10 +208,6 @@ while true; do
             shift 2
             ;;
         "-p" | "--pid")
-            if [ -z "$(command -v gdb 2> /dev/null)" ]; then
-                echo "GDB is not installed, cannot attach to running process."
-                exit 1
-            fi
             if [ -f "/proc/sys/kernel/yama/ptrace_scope"  ] && [ "$(cat "/proc/sys/kernel/yama/ptrace_scope")" -gt "0" ]; then
                 echo "Cannot runtime-attach, you need to set /proc/sys/kernel/yama/ptrace_scope to 0"
                 exit 1
@@ -208,7 +278,9 @@ while true; do
 done
 
 # put output into current pwd
-if [ -z "$output" ]; then
+if [ -z "$output" ] && [ ! -z "$collect" ]; then
+    output=$(pwd)/heaptrack.remote.$$
+elif [ -z "$output" ]; then
     output=$(pwd)/heaptrack.$(basename "$client").$$
 fi
 
@@ -223,6 +295,18 @@ if [ ! -f "$ENVCHECKER" ]; then
 fi
 ENVCHECKER=$(readlink -f "$ENVCHECKER")
 
+# attach without GDB when possible, which only stops the process for a few milliseconds
+ATTACHER="$EXE_PATH/$LIBEXEC_REL_PATH/heaptrack_attach"
+if [ ! -z "$pid" ] && [ -z "$debug" ] && [ -x "$ATTACHER" ]; then
+    ATTACHER=$(readlink -f "$ATTACHER")
+else
+    ATTACHER=
+    if [ ! -z "$pid" ] && [ -z "$(command -v gdb 2> /dev/null)" ]; then
+        echo "GDB is not installed, cannot attach to running process."
+        exit 1
+    fi
+fi
+
 INTERPRETER="$EXE_PATH/$LIBEXEC_REL_PATH/heaptrack_interpret"
 if [ -z "$write_raw_data" ] && [ ! -f "$INTERPRETER" ]; then
     echo "Could not find heaptrack interpreter executable: $INTERPRETER"
@@ -248,6 +332,12 @@ if [ ! -f "$LIBHEAPTRACK_INJECT" ]; then
 fi
 LIBHEAPTRACK_INJECT=$(readlink -f "$LIBHEAPTRACK_INJECT")
 
+STREAMER="$EXE_PATH/heaptrack_stream"
+if { [ ! -z "$remote" ] || [ ! -z "$collect" ]; } && [ ! -x "$STREAMER" ]; then
+    echo "Could not find heaptrack_stream executable: $STREAMER"
+    exit 1
+fi
+
 if [ -n "$asan" ]; then
   asan_ld_preload=$(ldd $client | grep libasan | sed -e 's/.*=> //;s/ (.*//')
   if [ -z "$asan_ld_preload" ]; then
@@ -258,13 +348,20 @@ if [ -n "$asan" ]; then
   asan_ld_preload="$asan_ld_preload:"
 fi
 
+if [ ! -z "$remote" ] && [ ! -z "$write_raw_data" ]; then
+    echo "The raw data cannot be recorded locally when streaming it to a collector."
+    exit 1
+fi
+
 # setup named pipe to read data from
 pipe=/tmp/heaptrack_fifo$$
-mkfifo $pipe
+if [ -z "$collect" ] && [ -z "$mmap_output" ]; then
+    mkfifo $pipe
+fi
 
 # if root is profiling a process for non root
 # give profiled process write access to the pipe
-if [ ! -z "$pid" ]; then
+if [ ! -z "$pid" ] && [ -z "$mmap_output" ]; then
   case $(uname) in
     Linux*)
       pid_user=$(stat -c %U "/proc/$pid")
@@ -287,25 +384,147 @@ if [ "@ZSTD_FOUND@" = "TRUE" ] && [ ! -z "$(command -v zstd 2> /dev/null)" ]; th
     output_suffix="zst"
     COMPRESSOR="zstd -c"
     UNCOMPRESSOR="zstd -dc"
+    # the interpreter compresses its output on multiple threads by itself
+    # tune that via HEAPTRACK_ZSTD_LEVEL and HEAPTRACK_ZSTD_WORKERS, or set an empty level to disable it
+    HEAPTRACK_ZSTD_LEVEL="${HEAPTRACK_ZSTD_LEVEL-3}"
+    if [ ! -z "$HEAPTRACK_ZSTD_LEVEL" ]; then
+        export HEAPTRACK_ZSTD_LEVEL
+        interpreter_compresses=1
+    fi
 fi
 
 output_non_raw="$output.$output_suffix"
+output_symbolized="$output.symbolized.$output_suffix"
+
+# the modules of the remote process are not available here, so only record their build-ids
+if [ ! -z "$collect" ]; then
+    output="$output.$output_suffix"
+    echo "heaptrack output will be written to \"$output\""
+    echo "waiting for heaptrack --remote to connect to $collect..."
+    if [ ! -z "$interpreter_compresses" ]; then
+        "$STREAMER" --listen "$collect" | HEAPTRACK_DEFER_SYMBOLS=1 "$INTERPRETER" > "$output"
+    else
+        "$STREAMER" --listen "$collect" | HEAPTRACK_DEFER_SYMBOLS=1 "$INTERPRETER" | $COMPRESSOR > "$output"
+    fi
+    echo "Heaptrack finished! Now resolve the symbols, e.g. with the debug information of the remote"
+    echo "modules below DIR, and investigate the data:"
+    echo
+    echo "  $UNCOMPRESSOR < \"$output\" | heaptrack_symbolize --debug-paths DIR | $COMPRESSOR > \"$output_symbolized\""
+    echo "  heaptrack --analyze \"$output_symbolized\""
+    exit
+fi
 
-if [ ! -z "$write_raw_data" ]; then
+if [ ! -z "$mmap_output" ]; then
+    output_suffix="raw"
+elif [ ! -z "$write_raw_data" ]; then
     output_suffix="raw.$output_suffix"
 fi
 
+# the daemon writes a zstd compressed output file for every process it interprets
+if [ ! -z "$daemon" ]; then
+    if [ ! -z "$write_raw_data$remote$follow_fork$perf$HEAPTRACK_SEGMENT_SECONDS$HEAPTRACK_SEGMENT_SIZE" ]; then
+        echo "The interpreter daemon cannot be combined with --raw, --remote, --follow-fork, --perf or segments."
+        exit 1
+    fi
+    if [ "$output_suffix" != "zst" ]; then
+        echo "The interpreter daemon requires zstd support."
+        exit 1
+    fi
+fi
+
+# let the profiled process transfer its data to the interpreter via shared memory
+# it falls back to the pipe when shared memory is not available, set HEAPTRACK_SHM=0 to force that
+if [ -z "$write_raw_data" ] && [ -z "$remote" ]; then
+    HEAPTRACK_SHM="${HEAPTRACK_SHM-1}"
+else
+    HEAPTRACK_SHM=0
+fi
+export HEAPTRACK_SHM
+
+if [ ! -z "$defer_symbols" ]; then
+    export HEAPTRACK_DEFER_SYMBOLS=1
+fi
+
+# the tracer of a forked child announces it in the output of its parent, the interpreter then forks
+# itself to interpret the data of the child with the symbolizers of the parent
+if [ ! -z "$follow_fork" ]; then
+    if [ ! -z "$write_raw_data" ] || [ ! -z "$remote" ]; then
+        echo "Forked child processes cannot be followed when only recording raw data."
+        exit 1
+    fi
+    export HEAPTRACK_FOLLOW_FORK=1
+    fork_output_prefix="$output"
+    export HEAPTRACK_FORK_OUTPUT="$output.%p.$output_suffix"
+    if [ -z "$interpreter_compresses" ]; then
+        export HEAPTRACK_FORK_COMPRESSOR="$COMPRESSOR"
+    fi
+fi
+
+# profile heaptrack itself, build it with HEAPTRACK_PERF_ANNOTATIONS to see its hot functions separately
+if [ ! -z "$perf" ]; then
+    if [ ! -z "$pid" ] || [ ! -z "$debug" ]; then
+        echo "Only a debuggee started by heaptrack can be profiled with perf."
+        exit 1
+    fi
+    PERF_ARGS="${HEAPTRACK_PERF_ARGS---call-graph dwarf}"
+    perf_tracee="$output.tracee.perf.data"
+    perf_interpret="$output.interpret.perf.data"
+fi
+
+profileInterpreter() {
+    if [ -z "$perf" ]; then
+        "$INTERPRETER"
+    else
+        perf record $PERF_ARGS -o "$perf_interpret" -- "$INTERPRETER"
+    fi
+}
+
 # interpret the data and compress the output on the fly
 output="$output.$output_suffix"
-if [ -z "$write_raw_data" ]; then
-    "$INTERPRETER" < $pipe | $COMPRESSOR > "$output" &
+interpreter_output="$output"
+
+# split the output of long-running recordings into segments, which the interpreter writes by itself
+if [ ! -z "$HEAPTRACK_SEGMENT_SECONDS$HEAPTRACK_SEGMENT_SIZE" ] && [ -z "$write_raw_data" ] && [ -z "$remote" ]; then
+    if [ -z "$interpreter_compresses" ]; then
+        echo "Segmented output requires the interpreter to compress its output, see HEAPTRACK_ZSTD_LEVEL."
+        exit 1
+    fi
+    segment_prefix="${output%.$output_suffix}"
+    export HEAPTRACK_SEGMENT_OUTPUT="$segment_prefix.%n.$output_suffix"
+    output="$segment_prefix.0.$output_suffix"
+    interpreter_output=/dev/null
+fi
+
+debuggee=
+if [ ! -z "$mmap_output" ]; then
+    # the debuggee writes the output file by itself instead of the pipe
+    export HEAPTRACK_MMAP_OUTPUT=1
+    pipe="$output"
+elif [ ! -z "$remote" ]; then
+    "$STREAMER" --send "$remote" < $pipe &
+elif [ ! -z "$daemon" ]; then
+    # the daemon opens our pipe once we announced it, and the done pipe once it wrote the output
+    mkfifo "$pipe.done"
+    cat "$pipe.done" > /dev/null &
+    printf '%s\t%s\t%s\n' "$pipe" "$output" "$pipe.done" > "$daemon"
+elif [ -z "$write_raw_data" ]; then
+    if [ ! -z "$interpreter_compresses" ]; then
+        profileInterpreter < $pipe > "$interpreter_output" &
+    else
+        profileInterpreter < $pipe | $COMPRESSOR > "$output" &
+    fi
 else
     $COMPRESSOR < $pipe > "$output" &
 fi
-debuggee=$!
+if [ -z "$mmap_output" ]; then
+    debuggee=$!
+fi
 
 cleanup() {
-    if [ ! -z "$pid" ] && [ -d "/proc/$pid" ]; then
+    if [ ! -z "$pid" ] && [ -d "/proc/$pid" ] && [ ! -z "$ATTACHER" ]; then
+        echo "removing heaptrack injection..."
+        "$ATTACHER" $pid "$LIBHEAPTRACK_INJECT" heaptrack_stop
+    elif [ ! -z "$pid" ] && [ -d "/proc/$pid" ]; then
         echo "removing heaptrack injection via GDB, this might take some time..."
         gdb --batch-silent -n -iex="set auto-solib-add off" \
             -iex="set language c" -p $pid \
@@ -315,24 +534,65 @@ cleanup() {
         # NOTE: we do not call dlclose here, as that has the tendency to trigger
         #       crashes in the debuggee. So instead, we keep heaptrack loaded.
     fi
-    rm -f "$pipe"
+    if [ -z "$mmap_output" ]; then
+        rm -f "$pipe"
+    fi
+    rm -f "$pipe.done"
     case $(uname) in
         FreeBSD*)
             rm -f "$pipe.lock"
         ;;
     esac
-    kill "$debuggee" 2> /dev/null
+    if [ ! -z "$debuggee" ]; then
+        kill "$debuggee" 2> /dev/null
+    fi
 
     echo "Heaptrack finished! Now run the following to investigate the data:"
     echo
 
-    if [ ! -z "$write_raw_data" ]; then
+    if [ ! -z "$remote" ]; then
+        echo "  the data got streamed to the collector at $remote"
+    elif [ ! -z "$mmap_output" ]; then
+        echo "  $INTERPRETER < \"$output\" | $COMPRESSOR > \"$output_non_raw\""
+    elif [ ! -z "$write_raw_data" ]; then
         echo "  $UNCOMPRESSOR < \"$output\" | $INTERPRETER | $COMPRESSOR > \"$output_non_raw\""
+    elif [ ! -z "$defer_symbols" ]; then
+        echo "  $UNCOMPRESSOR < \"$output\" | heaptrack_symbolize | $COMPRESSOR > \"$output_symbolized\""
+        echo "  heaptrack --analyze \"$output_symbolized\""
+    elif [ ! -z "$segment_prefix" ]; then
+        # the oldest segments may have been deleted already, see HEAPTRACK_SEGMENT_KEEP
+        segments=$(ls -tr "$segment_prefix".*."$output_suffix" 2> /dev/null)
+        output=$(echo "$segments" | head -n 1)
+        echo "$segments" | while read -r segment; do
+            echo "  heaptrack --analyze \"$segment\""
+        done
+        echo
+        echo "Each segment can be analyzed on its own, or together with the segments following it:"
+        echo
+        echo "  heaptrack_print \"$output\" --segments <the following segments>"
     else
         echo "  heaptrack --analyze \"$output\""
     fi
 
-    if [ -z "$record_only" ] && [ -z "$write_raw_data" ] && [ -x "$EXE_PATH/heaptrack_gui" ]; then
+    if [ ! -z "$perf" ]; then
+        echo
+        echo "To investigate where heaptrack spent its time, run:"
+        echo
+        echo "  perf report --no-children -i \"$perf_tracee\""
+        if [ -z "$write_raw_data" ] && [ -z "$remote" ]; then
+            echo "  perf report --no-children -i \"$perf_interpret\""
+        fi
+    fi
+
+    if [ ! -z "$follow_fork" ]; then
+        for child_output in "$fork_output_prefix".*."$output_suffix"; do
+            if [ -f "$child_output" ]; then
+                echo "  heaptrack --analyze \"$child_output\""
+            fi
+        done
+    fi
+
+    if [ -z "$record_only" ] && [ -z "$write_raw_data" ] && [ -z "$remote" ] && [ -x "$EXE_PATH/heaptrack_gui" ]; then
         echo ""
         echo "heaptrack_gui detected, automatically opening the file..."
         "$EXE_PATH/heaptrack_gui" "$output"
@@ -344,7 +604,14 @@ echo "heaptrack output will be written to \"$output\""
 
 if [ -z "$debug" ] && [ -z "$pid" ]; then
   echo "starting application, this might take some time..."
-  LD_PRELOAD="$asan_ld_preload$LIBHEAPTRACK_PRELOAD${LD_PRELOAD:+:$LD_PRELOAD}" DUMP_HEAPTRACK_OUTPUT="$pipe" "$client" "$@"
+  if [ -z "$perf" ]; then
+    LD_PRELOAD="$asan_ld_preload$LIBHEAPTRACK_PRELOAD${LD_PRELOAD:+:$LD_PRELOAD}" DUMP_HEAPTRACK_OUTPUT="$pipe" "$client" "$@"
+  else
+    # don't preload heaptrack into perf itself
+    perf record $PERF_ARGS -o "$perf_tracee" -- env \
+        LD_PRELOAD="$asan_ld_preload$LIBHEAPTRACK_PRELOAD${LD_PRELOAD:+:$LD_PRELOAD}" DUMP_HEAPTRACK_OUTPUT="$pipe" \
+        "$client" "$@"
+  fi
   EXIT_CODE=$?
 else
   if [ -z "$pid" ]; then
@@ -354,6 +621,11 @@ else
         --eval-command="set startup-with-shell off" \
         --eval-command="run" --args "$client" "$@"
     EXIT_CODE=$?
+  elif [ ! -z "$ATTACHER" ]; then
+    echo "injecting heaptrack into application..."
+    "$ATTACHER" $pid "$LIBHEAPTRACK_INJECT" heaptrack_inject "$pipe"
+    EXIT_CODE=$?
+    echo "injection finished"
   else
     echo "injecting heaptrack into application via GDB, this might take some time..."
     dlopen=$($ENVCHECKER dlopen "$LIBHEAPTRACK_INJECT")
@@ -379,7 +651,9 @@ else
   fi
 fi
 
-wait $debuggee
+if [ ! -z "$debuggee" ]; then
+    wait $debuggee
+fi
 exit $EXIT_CODE
 
 # kate: hl Bash
@@ -16,6 +16,26 @@
  * Once you run your code within heaptrack though, this information will be
  * picked up and included in the heap profile data.
  *
+ * Pool allocators that hand out many objects at once should use
+ * @c heaptrack_report_alloc_batch and @c heaptrack_report_free_batch instead,
+ * which take the lock of heaptrack and unwind the stack only once per batch:
+ *
+ * @code
+ *   heaptrack_allocation_t allocations[64];
+ *   for (int i = 0; i < 64; ++i) {
+ *       allocations[i].ptr = pool + i * objectSize;
+ *       allocations[i].size = objectSize;
+ *   }
+ *   heaptrack_report_alloc_batch(allocations, 64);
+ * @endcode
+ *
+ * Allocators that manage separate pools or arenas can report their allocations
+ * with @c heaptrack_report_pool_alloc and @c heaptrack_report_pool_free instead,
+ * passing any pointer that identifies the pool. heaptrack then groups the costs
+ * per pool, and @c heaptrack_report_pool_destroy frees all allocations of a pool
+ * that are still alive at once. With an older heaptrack that doesn't know pools,
+ * the pool allocations get reported like the ones of @c heaptrack_report_alloc.
+ *
  * Note: If you use static linking, or have a custom allocator in your main
  * executable, then you must define HEAPTRACK_API_DLSYM before including
  * this header and link against libdl to make this work properly. The other,
@@ -29,6 +49,18 @@
 
 #include <stdlib.h>
 
+#ifndef HEAPTRACK_ALLOCATION_DEFINED
+#define HEAPTRACK_ALLOCATION_DEFINED
+/**
+ * An allocation reported via @c heaptrack_report_alloc_batch.
+ */
+typedef struct heaptrack_allocation_t
+{
+    void* ptr;
+    size_t size;
+} heaptrack_allocation_t;
+#endif
+
 #ifndef HEAPTRACK_API_DLSYM
 
 /**
@@ -48,6 +80,11 @@ extern "C" {
 __attribute__((weak)) void heaptrack_malloc(void* ptr, size_t size);
 __attribute__((weak)) void heaptrack_realloc(void* ptr_in, size_t size, void* ptr_out);
 __attribute__((weak)) void heaptrack_free(void* ptr);
+__attribute__((weak)) void heaptrack_malloc_batch(const heaptrack_allocation_t* allocations, size_t count);
+__attribute__((weak)) void heaptrack_free_batch(void* const* ptrs, size_t count);
+__attribute__((weak)) void heaptrack_pool_malloc(void* pool, void* ptr, size_t size);
+__attribute__((weak)) void heaptrack_pool_free(void* pool, void* ptr);
+__attribute__((weak)) void heaptrack_pool_destroy(void* pool);
 
 #ifdef __cplusplus
 }
@@ -65,6 +102,34 @@ __attribute__((weak)) void heaptrack_free(void* ptr);
     if (heaptrack_free)                                                                                                \
     heaptrack_free(ptr)
 
+#define heaptrack_report_alloc_batch(allocations, count)                                                               \
+    if (heaptrack_malloc_batch)                                                                                        \
+    heaptrack_malloc_batch(allocations, count)
+
+#define heaptrack_report_free_batch(ptrs, count)                                                                       \
+    if (heaptrack_free_batch)                                                                                          \
+    heaptrack_free_batch(ptrs, count)
+
+#define heaptrack_report_pool_alloc(pool, ptr, size)                                                                   \
+    do {                                                                                                               \
+        if (heaptrack_pool_malloc)                                                                                     \
+            heaptrack_pool_malloc(pool, ptr, size);                                                                    \
+        else if (heaptrack_malloc)                                                                                     \
+            heaptrack_malloc(ptr, size);                                                                               \
+    } while (0)
+
+#define heaptrack_report_pool_free(pool, ptr)                                                                          \
+    do {                                                                                                               \
+        if (heaptrack_pool_free)                                                                                       \
+            heaptrack_pool_free(pool, ptr);                                                                            \
+        else if (heaptrack_free)                                                                                       \
+            heaptrack_free(ptr);                                                                                       \
+    } while (0)
+
+#define heaptrack_report_pool_destroy(pool)                                                                            \
+    if (heaptrack_pool_destroy)                                                                                        \
+    heaptrack_pool_destroy(pool)
+
 #else // HEAPTRACK_API_DLSYM
 
 /**
@@ -91,8 +156,13 @@ struct heaptrack_api_t
     void (*malloc)(void*, size_t);
     void (*free)(void*);
     void (*realloc)(void*, size_t, void*);
+    void (*malloc_batch)(const heaptrack_allocation_t*, size_t);
+    void (*free_batch)(void* const*, size_t);
+    void (*pool_malloc)(void*, void*, size_t);
+    void (*pool_free)(void*, void*);
+    void (*pool_destroy)(void*);
 };
-static struct heaptrack_api_t heaptrack_api = {0, 0, 0};
+static struct heaptrack_api_t heaptrack_api = {0, 0, 0, 0, 0, 0, 0, 0};
 
 void heaptrack_init_api()
 {
@@ -110,6 +180,26 @@ void heaptrack_init_api()
         if (sym)
             heaptrack_api.free = (void (*)(void*))sym;
 
+        sym = dlsym(RTLD_NEXT, "heaptrack_malloc_batch");
+        if (sym)
+            heaptrack_api.malloc_batch = (void (*)(const heaptrack_allocation_t*, size_t))sym;
+
+        sym = dlsym(RTLD_NEXT, "heaptrack_free_batch");
+        if (sym)
+            heaptrack_api.free_batch = (void (*)(void* const*, size_t))sym;
+
+        sym = dlsym(RTLD_NEXT, "heaptrack_pool_malloc");
+        if (sym)
+            heaptrack_api.pool_malloc = (void (*)(void*, void*, size_t))sym;
+
+        sym = dlsym(RTLD_NEXT, "heaptrack_pool_free");
+        if (sym)
+            heaptrack_api.pool_free = (void (*)(void*, void*))sym;
+
+        sym = dlsym(RTLD_NEXT, "heaptrack_pool_destroy");
+        if (sym)
+            heaptrack_api.pool_destroy = (void (*)(void*))sym;
+
         initialized = 1;
     }
 }
@@ -135,6 +225,45 @@ void heaptrack_init_api()
             heaptrack_api.free(ptr);                                                                                   \
     } while (0)
 
+#define heaptrack_report_alloc_batch(allocations, count)                                                               \
+    do {                                                                                                               \
+        heaptrack_init_api();                                                                                          \
+        if (heaptrack_api.malloc_batch)                                                                                \
+            heaptrack_api.malloc_batch(allocations, count);                                                            \
+    } while (0)
+
+#define heaptrack_report_free_batch(ptrs, count)                                                                       \
+    do {                                                                                                               \
+        heaptrack_init_api();                                                                                          \
+        if (heaptrack_api.free_batch)                                                                                  \
+            heaptrack_api.free_batch(ptrs, count);                                                                     \
+    } while (0)
+
+#define heaptrack_report_pool_alloc(pool, ptr, size)                                                                   \
+    do {                                                                                                               \
+        heaptrack_init_api();                                                                                          \
+        if (heaptrack_api.pool_malloc)                                                                                 \
+            heaptrack_api.pool_malloc(pool, ptr, size);                                                                \
+        else if (heaptrack_api.malloc)                                                                                 \
+            heaptrack_api.malloc(ptr, size);                                                                           \
+    } while (0)
+
+#define heaptrack_report_pool_free(pool, ptr)                                                                          \
+    do {                                                                                                               \
+        heaptrack_init_api();                                                                                          \
+        if (heaptrack_api.pool_free)                                                                                   \
+            heaptrack_api.pool_free(pool, ptr);                                                                        \
+        else if (heaptrack_api.free)                                                                                   \
+            heaptrack_api.free(ptr);                                                                                   \
+    } while (0)
+
+#define heaptrack_report_pool_destroy(pool)                                                                            \
+    do {                                                                                                               \
+        heaptrack_init_api();                                                                                          \
+        if (heaptrack_api.pool_destroy)                                                                                \
+            heaptrack_api.pool_destroy(pool);                                                                          \
+    } while (0)
+
 #endif // HEAPTRACK_API_DLSYM
 
 /**
@@ -148,11 +277,11 @@ void heaptrack_init_api()
 #define VALGRIND_DISABLE_ERROR_REPORTING
 #define VALGRIND_ENABLE_ERROR_REPORTING
 #define VALGRIND_CREATE_MEMPOOL(...)
-#define VALGRIND_DESTROY_MEMPOOL(...)
+#define VALGRIND_DESTROY_MEMPOOL(pool) heaptrack_report_pool_destroy((void*)(pool))
 #define VALGRIND_MAKE_MEM_NOACCESS(...)
 
-#define VALGRIND_MEMPOOL_ALLOC(pool, ptr, size) heaptrack_report_alloc(ptr, size)
-#define VALGRIND_MEMPOOL_FREE(pool, ptr) heaptrack_report_free(ptr)
+#define VALGRIND_MEMPOOL_ALLOC(pool, ptr, size) heaptrack_report_pool_alloc((void*)(pool), ptr, size)
+#define VALGRIND_MEMPOOL_FREE(pool, ptr) heaptrack_report_pool_free((void*)(pool), ptr)
 
 #endif
 
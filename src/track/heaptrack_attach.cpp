@@ -0,0 +1,564 @@
+/*
+    SPDX-FileCopyrightText: 2026 Milian Wolff <mail@milianw.de>
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+/**
+ * Load a library into a running process and call a function therein, e.g.:
+ *
+ *   heaptrack_attach PID libheaptrack_inject.so heaptrack_inject /path/to/fifo
+ *   heaptrack_attach PID libheaptrack_inject.so heaptrack_stop
+ *
+ * This uses ptrace to run dlopen and the given function on the main thread
+ * of the process. Contrary to GDB, no debug information needs to be loaded
+ * and only the main thread gets stopped, and only for the duration of the calls.
+ */
+
+#include <cerrno>
+#include <climits>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <dlfcn.h>
+#include <elf.h>
+#include <fcntl.h>
+#include <link.h>
+#include <sys/mman.h>
+#include <sys/ptrace.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/uio.h>
+#include <sys/user.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+#if defined(__x86_64__)
+uintptr_t programCounter(const user_regs_struct& regs)
+{
+    return regs.rip;
+}
+
+uintptr_t stackPointer(const user_regs_struct& regs)
+{
+    return regs.rsp;
+}
+
+void setStackPointer(user_regs_struct& regs, uintptr_t sp)
+{
+    regs.rsp = sp;
+}
+
+uintptr_t returnValue(const user_regs_struct& regs)
+{
+    return regs.rax;
+}
+
+/// x86_64 has no link register, the return address gets pushed onto the stack instead
+constexpr bool returnAddressOnStack = true;
+/// the area below the stack pointer that may be used by leaf functions
+constexpr uintptr_t redZone = 128;
+
+void setupCall(user_regs_struct& regs, uintptr_t function, uintptr_t arg0, uintptr_t arg1)
+{
+    regs.rip = function;
+    regs.rdi = arg0;
+    regs.rsi = arg1;
+    // number of vector registers used for variadic functions
+    regs.rax = 0;
+    // don't let the kernel restart an interrupted system call in our function
+    regs.orig_rax = -1;
+}
+#elif defined(__aarch64__)
+uintptr_t programCounter(const user_regs_struct& regs)
+{
+    return regs.pc;
+}
+
+uintptr_t stackPointer(const user_regs_struct& regs)
+{
+    return regs.sp;
+}
+
+void setStackPointer(user_regs_struct& regs, uintptr_t sp)
+{
+    regs.sp = sp;
+}
+
+uintptr_t returnValue(const user_regs_struct& regs)
+{
+    return regs.regs[0];
+}
+
+constexpr bool returnAddressOnStack = false;
+constexpr uintptr_t redZone = 0;
+
+void setupCall(user_regs_struct& regs, uintptr_t function, uintptr_t arg0, uintptr_t arg1)
+{
+    regs.pc = function;
+    regs.regs[0] = arg0;
+    regs.regs[1] = arg1;
+    // the link register
+    regs.regs[30] = 0;
+}
+#else
+#error port me
+#endif
+
+struct Mapping
+{
+    uintptr_t start = 0;
+    uintptr_t offset = 0;
+    dev_t device = 0;
+    ino_t inode = 0;
+    std::string path;
+};
+
+std::vector<Mapping> readMappings(pid_t pid)
+{
+    std::vector<Mapping> mappings;
+
+    const auto path = "/proc/" + std::to_string(pid) + "/maps";
+    auto file = fopen(path.c_str(), "r");
+    if (!file) {
+        fprintf(stderr, "failed to open %s: %s\n", path.c_str(), strerror(errno));
+        return mappings;
+    }
+
+    char line[4096];
+    while (fgets(line, sizeof(line), file)) {
+        Mapping mapping;
+        unsigned long start = 0;
+        unsigned long end = 0;
+        unsigned long offset = 0;
+        unsigned int major = 0;
+        unsigned int minor = 0;
+        unsigned long inode = 0;
+        int pathStart = 0;
+        if (sscanf(line, "%lx-%lx %*s %lx %x:%x %lu %n", &start, &end, &offset, &major, &minor, &inode, &pathStart)
+                < 6
+            || !inode) {
+            continue;
+        }
+        mapping.start = start;
+        mapping.offset = offset;
+        mapping.device = makedev(major, minor);
+        mapping.inode = inode;
+        mapping.path = line + pathStart;
+        if (!mapping.path.empty() && mapping.path.back() == '\n') {
+            mapping.path.pop_back();
+        }
+        mappings.push_back(std::move(mapping));
+    }
+
+    fclose(file);
+    return mappings;
+}
+
+/**
+ * The dynamic symbols of an ELF file, to find addresses within the traced process.
+ */
+class ElfFile
+{
+public:
+    explicit ElfFile(const std::string& path)
+    {
+        auto fd = open(path.c_str(), O_RDONLY);
+        if (fd == -1) {
+            fprintf(stderr, "failed to open %s: %s\n", path.c_str(), strerror(errno));
+            return;
+        }
+        struct stat info;
+        if (fstat(fd, &info) == 0 && static_cast<size_t>(info.st_size) >= sizeof(ElfW(Ehdr))) {
+            m_size = info.st_size;
+            m_data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (m_data == MAP_FAILED) {
+                m_data = nullptr;
+            }
+        }
+        close(fd);
+        if (m_data && memcmp(m_data, ELFMAG, SELFMAG) != 0) {
+            fprintf(stderr, "not an ELF file: %s\n", path.c_str());
+            munmap(m_data, m_size);
+            m_data = nullptr;
+        }
+    }
+
+    ~ElfFile()
+    {
+        if (m_data) {
+            munmap(m_data, m_size);
+        }
+    }
+
+    ElfFile(const ElfFile&) = delete;
+    ElfFile& operator=(const ElfFile&) = delete;
+
+    /// @return the address of the ELF header when loaded at @p mapping, which maps the file at offset 0
+    uintptr_t loadBias(const Mapping& mapping) const
+    {
+        const auto ehdr = header();
+        const auto phdrs = reinterpret_cast<const ElfW(Phdr)*>(base() + ehdr->e_phoff);
+        for (ElfW(Half) i = 0; i < ehdr->e_phnum; ++i) {
+            if (phdrs[i].p_type == PT_LOAD) {
+                const auto pageMask = ~static_cast<uintptr_t>(sysconf(_SC_PAGESIZE) - 1);
+                return mapping.start - (phdrs[i].p_vaddr & pageMask);
+            }
+        }
+        return mapping.start;
+    }
+
+    /// @return the address of the defined function @p name relative to the load bias, or zero when not found
+    uintptr_t symbol(const char* name) const
+    {
+        if (!m_data) {
+            return 0;
+        }
+
+        const auto ehdr = header();
+        const auto shdrs = reinterpret_cast<const ElfW(Shdr)*>(base() + ehdr->e_shoff);
+        for (ElfW(Half) i = 0; i < ehdr->e_shnum; ++i) {
+            if (shdrs[i].sh_type != SHT_DYNSYM || shdrs[i].sh_link >= ehdr->e_shnum) {
+                continue;
+            }
+            const auto strings = reinterpret_cast<const char*>(base() + shdrs[shdrs[i].sh_link].sh_offset);
+            const auto symbols = reinterpret_cast<const ElfW(Sym)*>(base() + shdrs[i].sh_offset);
+            const auto numSymbols = shdrs[i].sh_size / sizeof(ElfW(Sym));
+            for (size_t j = 0; j < numSymbols; ++j) {
+                const auto& sym = symbols[j];
+                if (sym.st_shndx != SHN_UNDEF && ELF64_ST_TYPE(sym.st_info) == STT_FUNC
+                    && !strcmp(strings + sym.st_name, name)) {
+                    return sym.st_value;
+                }
+            }
+        }
+        return 0;
+    }
+
+    explicit operator bool() const
+    {
+        return m_data;
+    }
+
+private:
+    uintptr_t base() const
+    {
+        return reinterpret_cast<uintptr_t>(m_data);
+    }
+
+    const ElfW(Ehdr) * header() const
+    {
+        return reinterpret_cast<const ElfW(Ehdr)*>(m_data);
+    }
+
+    void* m_data = nullptr;
+    size_t m_size = 0;
+};
+
+/// @return the address of @p name in the module mapped at @p mapping within the traced process, or zero
+uintptr_t remoteSymbol(const Mapping& mapping, const char* name)
+{
+    ElfFile elf(mapping.path);
+    if (!elf) {
+        return 0;
+    }
+    const auto address = elf.symbol(name);
+    return address ? elf.loadBias(mapping) + address : 0;
+}
+
+template <typename Predicate>
+const Mapping* findModule(const std::vector<Mapping>& mappings, Predicate predicate)
+{
+    for (const auto& mapping : mappings) {
+        if (mapping.offset == 0 && predicate(mapping)) {
+            return &mapping;
+        }
+    }
+    return nullptr;
+}
+
+bool isLibc(const Mapping& mapping)
+{
+    const auto slash = mapping.path.rfind('/');
+    const auto name = mapping.path.c_str() + (slash == std::string::npos ? 0 : slash + 1);
+    return !strncmp(name, "libc.so", 7) || !strncmp(name, "libc-", 5) || !strncmp(name, "ld-musl", 7);
+}
+
+/**
+ * Runs functions on the main thread of a process, which is stopped while this object exists.
+ */
+class Tracee
+{
+public:
+    explicit Tracee(pid_t pid)
+        : m_pid(pid)
+    {
+    }
+
+    ~Tracee()
+    {
+        if (m_memory != -1) {
+            close(m_memory);
+        }
+        if (!m_attached) {
+            return;
+        }
+        setRegisters(m_savedRegs);
+#if defined(__aarch64__)
+        setSyscall(m_savedSyscall);
+#endif
+        ptrace(PTRACE_DETACH, m_pid, nullptr, reinterpret_cast<void*>(static_cast<uintptr_t>(m_pendingSignal)));
+    }
+
+    Tracee(const Tracee&) = delete;
+    Tracee& operator=(const Tracee&) = delete;
+
+    bool attach()
+    {
+        if (ptrace(PTRACE_SEIZE, m_pid, nullptr, nullptr) == -1) {
+            fprintf(stderr, "failed to attach to %d: %s\n", m_pid, strerror(errno));
+            return false;
+        }
+        if (ptrace(PTRACE_INTERRUPT, m_pid, nullptr, nullptr) == -1) {
+            fprintf(stderr, "failed to interrupt %d: %s\n", m_pid, strerror(errno));
+            ptrace(PTRACE_DETACH, m_pid, nullptr, nullptr);
+            return false;
+        }
+
+        int status = 0;
+        if (waitpid(m_pid, &status, __WALL) == -1 || !WIFSTOPPED(status)) {
+            fprintf(stderr, "failed to stop %d\n", m_pid);
+            return false;
+        }
+        m_attached = true;
+        if (status >> 16 != PTRACE_EVENT_STOP) {
+            // we got a signal first, remember it to deliver it on detach
+            m_pendingSignal = WSTOPSIG(status);
+        }
+
+        const auto memory = "/proc/" + std::to_string(m_pid) + "/mem";
+        m_memory = open(memory.c_str(), O_RDWR);
+        if (m_memory == -1) {
+            fprintf(stderr, "failed to open %s: %s\n", memory.c_str(), strerror(errno));
+            return false;
+        }
+
+#if defined(__aarch64__)
+        if (!getSyscall(&m_savedSyscall)) {
+            return false;
+        }
+#endif
+        return getRegisters(&m_savedRegs);
+    }
+
+    /**
+     * Call @p function with the two arguments, where @p string, if any, gets copied
+     * into the process and replaces the first argument.
+     *
+     * @return true on success, then @p result holds the return value
+     */
+    bool call(uintptr_t function, const char* string, uintptr_t arg0, uintptr_t arg1, uintptr_t* result)
+    {
+        auto regs = m_savedRegs;
+        auto sp = stackPointer(regs) - redZone;
+
+        if (string) {
+            const auto size = strlen(string) + 1;
+            sp -= size;
+            if (pwrite(m_memory, string, size, sp) != static_cast<ssize_t>(size)) {
+                fprintf(stderr, "failed to write into the process memory: %s\n", strerror(errno));
+                return false;
+            }
+            arg0 = sp;
+        }
+
+        sp &= ~static_cast<uintptr_t>(15);
+        if (returnAddressOnStack) {
+            // return to the invalid address zero, which gets us back control afterwards
+            const uintptr_t returnAddress = 0;
+            sp -= sizeof(returnAddress);
+            if (pwrite(m_memory, &returnAddress, sizeof(returnAddress), sp) != sizeof(returnAddress)) {
+                fprintf(stderr, "failed to write into the process memory: %s\n", strerror(errno));
+                return false;
+            }
+        }
+        setStackPointer(regs, sp);
+        setupCall(regs, function, arg0, arg1);
+
+#if defined(__aarch64__)
+        // don't let the kernel restart an interrupted system call in our function
+        if (!setSyscall(-1)) {
+            return false;
+        }
+#endif
+        if (!setRegisters(regs)) {
+            return false;
+        }
+
+        int signal = 0;
+        while (true) {
+            if (ptrace(PTRACE_CONT, m_pid, nullptr, reinterpret_cast<void*>(static_cast<uintptr_t>(signal))) == -1) {
+                fprintf(stderr, "failed to continue %d: %s\n", m_pid, strerror(errno));
+                return false;
+            }
+
+            int status = 0;
+            if (waitpid(m_pid, &status, __WALL) == -1) {
+                fprintf(stderr, "failed to wait for %d: %s\n", m_pid, strerror(errno));
+                return false;
+            } else if (WIFEXITED(status) || WIFSIGNALED(status)) {
+                fprintf(stderr, "process %d terminated\n", m_pid);
+                m_attached = false;
+                return false;
+            } else if (!WIFSTOPPED(status)) {
+                continue;
+            }
+
+            signal = 0;
+            if (status >> 16 == PTRACE_EVENT_STOP) {
+                continue;
+            }
+
+            const auto stopSignal = WSTOPSIG(status);
+            if (stopSignal == SIGSEGV && getRegisters(&regs) && programCounter(regs) == 0) {
+                *result = returnValue(regs);
+                return true;
+            } else if (stopSignal == SIGSEGV || stopSignal == SIGBUS || stopSignal == SIGILL) {
+                fprintf(stderr, "process %d crashed in the called function\n", m_pid);
+                return false;
+            }
+            // pass through all other signals
+            signal = stopSignal;
+        }
+    }
+
+private:
+    bool getRegisters(user_regs_struct* regs)
+    {
+        iovec io = {regs, sizeof(*regs)};
+        if (ptrace(PTRACE_GETREGSET, m_pid, reinterpret_cast<void*>(NT_PRSTATUS), &io) == -1) {
+            fprintf(stderr, "failed to get registers of %d: %s\n", m_pid, strerror(errno));
+            return false;
+        }
+        return true;
+    }
+
+    bool setRegisters(user_regs_struct regs)
+    {
+        iovec io = {&regs, sizeof(regs)};
+        if (ptrace(PTRACE_SETREGSET, m_pid, reinterpret_cast<void*>(NT_PRSTATUS), &io) == -1) {
+            fprintf(stderr, "failed to set registers of %d: %s\n", m_pid, strerror(errno));
+            return false;
+        }
+        return true;
+    }
+
+#if defined(__aarch64__)
+    bool getSyscall(int* syscall)
+    {
+        iovec io = {syscall, sizeof(*syscall)};
+        return ptrace(PTRACE_GETREGSET, m_pid, reinterpret_cast<void*>(NT_ARM_SYSTEM_CALL), &io) != -1;
+    }
+
+    bool setSyscall(int syscall)
+    {
+        iovec io = {&syscall, sizeof(syscall)};
+        return ptrace(PTRACE_SETREGSET, m_pid, reinterpret_cast<void*>(NT_ARM_SYSTEM_CALL), &io) != -1;
+    }
+
+    int m_savedSyscall = -1;
+#endif
+
+    pid_t m_pid;
+    bool m_attached = false;
+    int m_pendingSignal = 0;
+    int m_memory = -1;
+    user_regs_struct m_savedRegs;
+};
+
+/// @return the address of the function to load libraries within the traced process and its flags
+bool findDlopen(const std::vector<Mapping>& mappings, uintptr_t* dlopen, uintptr_t* flags)
+{
+    for (const auto& mapping : mappings) {
+        if (mapping.offset != 0 || !isLibc(mapping)) {
+            continue;
+        }
+        // dlopen is part of libc since glibc 2.34, and always was for musl
+        if ((*dlopen = remoteSymbol(mapping, "dlopen"))) {
+            *flags = RTLD_NOW;
+            return true;
+        }
+        // older glibc versions have __libc_dlopen_mode, which requires the internal __RTLD_DLOPEN flag
+        if ((*dlopen = remoteSymbol(mapping, "__libc_dlopen_mode"))) {
+            *flags = 0x80000000 | RTLD_NOW;
+            return true;
+        }
+    }
+    fprintf(stderr, "failed to find dlopen in the process\n");
+    return false;
+}
+}
+
+int main(int argc, char** argv)
+{
+    if (argc != 4 && argc != 5) {
+        fprintf(stderr, "usage: %s PID LIBRARY FUNCTION [STRING_ARGUMENT]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    const auto pid = static_cast<pid_t>(atoi(argv[1]));
+    const auto library = argv[2];
+    const auto function = argv[3];
+    const auto argument = argc == 5 ? argv[4] : nullptr;
+
+    struct stat libraryInfo;
+    if (stat(library, &libraryInfo) != 0) {
+        fprintf(stderr, "failed to stat %s: %s\n", library, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    char libraryPath[PATH_MAX];
+    if (!realpath(library, libraryPath)) {
+        fprintf(stderr, "failed to resolve %s: %s\n", library, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    auto isLibrary = [&libraryInfo, &libraryPath](const Mapping& mapping) {
+        // overlay file systems may report different devices in the mappings, so fall back to the path
+        return (mapping.inode == libraryInfo.st_ino && mapping.device == libraryInfo.st_dev)
+            || mapping.path == libraryPath;
+    };
+
+    Tracee tracee(pid);
+    if (!tracee.attach()) {
+        return EXIT_FAILURE;
+    }
+
+    auto mappings = readMappings(pid);
+    if (!findModule(mappings, isLibrary)) {
+        uintptr_t dlopen = 0;
+        uintptr_t flags = 0;
+        uintptr_t handle = 0;
+        if (!findDlopen(mappings, &dlopen, &flags) || !tracee.call(dlopen, library, 0, flags, &handle)) {
+            return EXIT_FAILURE;
+        } else if (!handle) {
+            fprintf(stderr, "failed to load %s into %d\n", library, pid);
+            return EXIT_FAILURE;
+        }
+        mappings = readMappings(pid);
+    }
+
+    const auto module = findModule(mappings, isLibrary);
+    const auto address = module ? remoteSymbol(*module, function) : 0;
+    if (!address) {
+        fprintf(stderr, "failed to find %s in %s\n", function, library);
+        return EXIT_FAILURE;
+    }
+
+    uintptr_t result = 0;
+    return tracee.call(address, argument, 0, 0, &result) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
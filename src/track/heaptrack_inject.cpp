@@ -9,7 +9,10 @@
 #include "util/linewriter.h"
 
 #include <tsl/robin_map.h>
+#include <tsl/robin_set.h>
 
+#include <cstdarg>
+#include <cstddef>
 #include <cstdlib>
 #include <cstring>
 
@@ -23,6 +26,9 @@
 #include <sys/mman.h>
 #include <sys/stat.h>
 
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <type_traits>
 
 /**
@@ -72,6 +78,18 @@ __attribute__((weak)) void* mi_malloc(size_t size) LIBC_FUN_ATTRS;
 __attribute__((weak)) void* mi_calloc(size_t count, size_t size) LIBC_FUN_ATTRS;
 __attribute__((weak)) void* mi_realloc(void* p, size_t newsize) LIBC_FUN_ATTRS;
 __attribute__((weak)) void mi_free(void* p) LIBC_FUN_ATTRS;
+
+#if !HAVE_FREE_SIZED
+// C23 functions, which are not declared by older C libraries
+__attribute__((weak)) void free_sized(void* ptr, size_t size) LIBC_FUN_ATTRS;
+__attribute__((weak)) void free_aligned_sized(void* ptr, size_t alignment, size_t size) LIBC_FUN_ATTRS;
+#endif
+
+// Foward declare the non-standard jemalloc (https://jemalloc.net) functions, these don't call malloc and free.
+__attribute__((weak)) void* mallocx(size_t size, int flags) LIBC_FUN_ATTRS;
+__attribute__((weak)) void* rallocx(void* ptr, size_t size, int flags) LIBC_FUN_ATTRS;
+__attribute__((weak)) void dallocx(void* ptr, int flags) LIBC_FUN_ATTRS;
+__attribute__((weak)) void sdallocx(void* ptr, size_t size, int flags) LIBC_FUN_ATTRS;
 }
 
 namespace {
@@ -101,6 +119,22 @@ using Xword = uint64_t;
 
 void overwrite_symbols() noexcept;
 
+/**
+ * Defines how the GOT entries of the hooked functions get written.
+ */
+enum class PatchMode
+{
+    /// redirect all hooked functions to our hooks
+    Overwrite,
+    /// restore the allocation functions, but keep the hooks that track the loaded modules and forks
+    Pause,
+    /// restore all original functions
+    Restore,
+};
+
+/// true while the allocation functions are unhooked due to heaptrack_pause
+std::atomic<bool> s_paused {false};
+
 namespace hooks {
 
 struct malloc
@@ -180,7 +214,10 @@ struct dlopen
         auto ret = original(filename, flag);
         if (ret) {
             heaptrack_invalidate_module_cache();
-            overwrite_symbols();
+            if (!s_paused) {
+                // otherwise the new module gets patched on resume
+                overwrite_symbols();
+            }
         }
         return ret;
     }
@@ -201,6 +238,127 @@ struct dlclose
     }
 };
 
+struct fork
+{
+    static constexpr auto name = "fork";
+    static constexpr auto original = &::fork;
+
+    static pid_t hook() noexcept
+    {
+        heaptrack_prepare_fork();
+        auto ret = original();
+        if (ret != 0) {
+            heaptrack_forked(ret);
+        }
+        return ret;
+    }
+};
+
+// memory mappings, only anonymous ones get recorded
+struct mmap
+{
+    static constexpr auto name = "mmap";
+    static constexpr auto original = &::mmap;
+
+    static void* hook(void* addr, size_t length, int prot, int flags, int fd, off_t offset) noexcept
+    {
+        auto ret = original(addr, length, prot, flags, fd, offset);
+        if (ret != MAP_FAILED) {
+            if (flags & MAP_ANONYMOUS) {
+                heaptrack_mmap(ret, length);
+            } else if (flags & MAP_FIXED) {
+                heaptrack_munmap(ret, length);
+            }
+        }
+        return ret;
+    }
+};
+
+struct munmap
+{
+    static constexpr auto name = "munmap";
+    static constexpr auto original = &::munmap;
+
+    static int hook(void* addr, size_t length) noexcept
+    {
+        auto ret = original(addr, length);
+        if (!ret) {
+            heaptrack_munmap(addr, length);
+        }
+        return ret;
+    }
+};
+
+#ifdef __linux__
+struct mremap
+{
+    static constexpr auto name = "mremap";
+    static constexpr auto original = &::mremap;
+
+    static void* hook(void* oldAddr, size_t oldLength, size_t newLength, int flags, ...) noexcept
+    {
+        void* newAddr = nullptr;
+        if (flags & MREMAP_FIXED) {
+            va_list args;
+            va_start(args, flags);
+            newAddr = va_arg(args, void*);
+            va_end(args);
+        }
+        auto ret = original(oldAddr, oldLength, newLength, flags, newAddr);
+        if (ret != MAP_FAILED) {
+#ifdef MREMAP_DONTUNMAP
+            if (flags & MREMAP_DONTUNMAP) {
+                heaptrack_mmap(ret, newLength);
+                return ret;
+            }
+#endif
+            heaptrack_mremap(oldAddr, oldLength, ret, newLength);
+        }
+        return ret;
+    }
+};
+
+struct brk
+{
+    static constexpr auto name = "brk";
+    static constexpr auto original = &::brk;
+
+    static int hook(void* addr) noexcept
+    {
+        auto oldBreak = static_cast<char*>(::sbrk(0));
+        auto ret = original(addr);
+        if (!ret && oldBreak != reinterpret_cast<char*>(-1)) {
+            auto newBreak = static_cast<char*>(addr);
+            if (newBreak > oldBreak) {
+                heaptrack_mmap(oldBreak, newBreak - oldBreak);
+            } else if (newBreak < oldBreak) {
+                heaptrack_munmap(newBreak, oldBreak - newBreak);
+            }
+        }
+        return ret;
+    }
+};
+
+struct sbrk
+{
+    static constexpr auto name = "sbrk";
+    static constexpr auto original = &::sbrk;
+
+    static void* hook(intptr_t increment) noexcept
+    {
+        auto ret = original(increment);
+        if (ret != reinterpret_cast<void*>(-1)) {
+            if (increment > 0) {
+                heaptrack_mmap(ret, increment);
+            } else if (increment < 0) {
+                heaptrack_munmap(static_cast<char*>(ret) + increment, -increment);
+            }
+        }
+        return ret;
+    }
+};
+#endif
+
 struct posix_memalign
 {
     static constexpr auto name = "posix_memalign";
@@ -268,6 +426,83 @@ struct mi_calloc
     }
 };
 
+// sized deallocation functions
+struct free_sized
+{
+    static constexpr auto name = "free_sized";
+    static constexpr auto original = &::free_sized;
+
+    static void hook(void* ptr, size_t size) noexcept
+    {
+        heaptrack_free(ptr);
+        original(ptr, size);
+    }
+};
+
+struct free_aligned_sized
+{
+    static constexpr auto name = "free_aligned_sized";
+    static constexpr auto original = &::free_aligned_sized;
+
+    static void hook(void* ptr, size_t alignment, size_t size) noexcept
+    {
+        heaptrack_free(ptr);
+        original(ptr, alignment, size);
+    }
+};
+
+// jemalloc functions
+struct mallocx
+{
+    static constexpr auto name = "mallocx";
+    static constexpr auto original = &::mallocx;
+
+    static void* hook(size_t size, int flags) noexcept
+    {
+        auto ptr = original(size, flags);
+        heaptrack_malloc(ptr, size);
+        return ptr;
+    }
+};
+
+struct rallocx
+{
+    static constexpr auto name = "rallocx";
+    static constexpr auto original = &::rallocx;
+
+    static void* hook(void* ptr, size_t size, int flags) noexcept
+    {
+        auto inPtr = reinterpret_cast<uintptr_t>(ptr);
+        auto ret = original(ptr, size, flags);
+        heaptrack_realloc2(inPtr, size, reinterpret_cast<uintptr_t>(ret));
+        return ret;
+    }
+};
+
+struct dallocx
+{
+    static constexpr auto name = "dallocx";
+    static constexpr auto original = &::dallocx;
+
+    static void hook(void* ptr, int flags) noexcept
+    {
+        heaptrack_free(ptr);
+        original(ptr, flags);
+    }
+};
+
+struct sdallocx
+{
+    static constexpr auto name = "sdallocx";
+    static constexpr auto original = &::sdallocx;
+
+    static void hook(void* ptr, size_t size, int flags) noexcept
+    {
+        heaptrack_free(ptr);
+        original(ptr, size, flags);
+    }
+};
+
 template <typename Hook>
 bool hook(const char* symname, Elf::Addr addr, bool restore)
 {
@@ -286,7 +521,7 @@ bool hook(const char* symname, Elf::Addr addr, bool restore)
     // now write to the address
     auto typedAddr = reinterpret_cast<typename std::remove_const<decltype(Hook::original)>::type*>(addr);
     if (restore) {
-        // restore the original address on shutdown
+        // restore the original address on shutdown or while paused
         *typedAddr = Hook::original;
     } else {
         // now actually inject our hook
@@ -296,19 +531,66 @@ bool hook(const char* symname, Elf::Addr addr, bool restore)
     return true;
 }
 
-void apply(const char* symname, Elf::Addr addr, bool restore)
+/// the hash function of DT_GNU_HASH, cheap to compute and good at keeping symbol names apart
+uint32_t gnuHash(const char* name) noexcept
 {
-    // TODO: use std::apply once we can rely on C++17
-    hook<malloc>(symname, addr, restore) || hook<free>(symname, addr, restore) || hook<realloc>(symname, addr, restore)
-        || hook<calloc>(symname, addr, restore)
+    uint32_t hash = 5381;
+    for (; *name; ++name) {
+        hash = hash * 33 + static_cast<unsigned char>(*name);
+    }
+    return hash;
+}
+
+template <typename... Hooks>
+struct HookList
+{
+    static bool apply(const char* symname, Elf::Addr addr, bool restore)
+    {
+        // TODO: use a fold expression once we can rely on C++17
+        bool found = false;
+        using expand = int[];
+        (void)expand {0, (found = found || hook<Hooks>(symname, addr, restore), 0)...};
+        return found;
+    }
+
+    /// @return true when @p hash may belong to one of the hooked symbol names
+    static bool contains(uint32_t hash)
+    {
+        static const auto hashes = []() {
+            std::array<uint32_t, sizeof...(Hooks)> hashes = {gnuHash(Hooks::name)...};
+            std::sort(hashes.begin(), hashes.end());
+            return hashes;
+        }();
+        return std::binary_search(hashes.begin(), hashes.end(), hash);
+    }
+};
+
+using AllocationHooks = HookList<malloc, free, realloc, calloc,
 #if HAVE_CFREE
-        || hook<cfree>(symname, addr, restore)
+                                 cfree,
+#endif
+                                 posix_memalign,
+                                 // memory mappings
+                                 mmap, munmap,
+#ifdef __linux__
+                                 mremap, brk, sbrk,
 #endif
-        || hook<posix_memalign>(symname, addr, restore) || hook<dlopen>(symname, addr, restore)
-        || hook<dlclose>(symname, addr, restore)
-        // mimalloc functions
-        || hook<mi_malloc>(symname, addr, restore) || hook<mi_free>(symname, addr, restore)
-        || hook<mi_realloc>(symname, addr, restore) || hook<mi_calloc>(symname, addr, restore);
+                                 // mimalloc functions
+                                 mi_malloc, mi_free, mi_realloc, mi_calloc,
+                                 // sized deallocation functions
+                                 free_sized, free_aligned_sized,
+                                 // jemalloc functions
+                                 mallocx, rallocx, dallocx, sdallocx>;
+
+/// these hooks don't track allocations, and need to stay in place while paused
+using ControlHooks = HookList<dlopen, dlclose, fork>;
+
+void apply(const char* symname, Elf::Addr addr, PatchMode mode)
+{
+    // most relocations refer to other symbols, so skip the string comparisons for them
+    const auto hash = gnuHash(symname);
+    (AllocationHooks::contains(hash) && AllocationHooks::apply(symname, addr, mode != PatchMode::Overwrite))
+        || (ControlHooks::contains(hash) && ControlHooks::apply(symname, addr, mode == PatchMode::Restore));
 }
 }
 
@@ -355,7 +637,7 @@ using elf_symbol_table = elftable<const Elf::Sym, DT_SYMTAB, DT_SYMENT>;
 
 template <typename Table>
 void try_overwrite_elftable(const Table& jumps, const elf_string_table& strings, const elf_symbol_table& symbols,
-                            const Elf::Addr base, const bool restore, const Elf::Xword symtabSize) noexcept
+                            const Elf::Addr base, const PatchMode mode, const Elf::Xword symtabSize) noexcept
 {
     Elf::Addr tableOffset =
 #ifdef __linux__
@@ -391,11 +673,11 @@ void try_overwrite_elftable(const Table& jumps, const elf_string_table& strings,
         const char* symname = str_start + str_index;
 
         auto addr = rela->r_offset + base;
-        hooks::apply(symname, addr, restore);
+        hooks::apply(symname, addr, mode);
     }
 }
 
-void try_overwrite_symbols(const Elf::Dyn* dyn, const Elf::Addr base, const bool restore,
+void try_overwrite_symbols(const Elf::Dyn* dyn, const Elf::Addr base, const PatchMode mode,
                            const Elf::Xword symtabSize) noexcept
 {
     elf_symbol_table symbols;
@@ -415,15 +697,15 @@ void try_overwrite_symbols(const Elf::Dyn* dyn, const Elf::Addr base, const bool
 
     // find symbols to overwrite
     if (rels) {
-        try_overwrite_elftable(rels, strings, symbols, base, restore, symtabSize);
+        try_overwrite_elftable(rels, strings, symbols, base, mode, symtabSize);
     }
 
     if (relas) {
-        try_overwrite_elftable(relas, strings, symbols, base, restore, symtabSize);
+        try_overwrite_elftable(relas, strings, symbols, base, mode, symtabSize);
     }
 
     if (jmprels) {
-        try_overwrite_elftable(jmprels, strings, symbols, base, restore, symtabSize);
+        try_overwrite_elftable(jmprels, strings, symbols, base, mode, symtabSize);
     }
 }
 
@@ -497,8 +779,37 @@ Elf::Xword cachedSymtabSize(const char* path)
     return it->second;
 }
 
-int iterate_phdrs(dl_phdr_info* info, size_t /*size*/, void* data) noexcept
+/// the load addresses of the modules whose symbols got overwritten already
+tsl::robin_set<Elf::Addr> s_patchedModules;
+/// the number of unloaded modules when s_patchedModules was last valid
+unsigned long long s_patchedSubs = 0;
+
+/**
+ * @return true when the symbols of the module in @p info were overwritten before,
+ *         and thus don't need to be processed again
+ */
+bool isPatched(const dl_phdr_info* info, size_t size, PatchMode mode)
 {
+    // only newer versions of the loader tell us when modules got unloaded,
+    // without this info a new module could reuse the address of an unloaded one
+    const bool hasSubs = size >= offsetof(dl_phdr_info, dlpi_subs) + sizeof(info->dlpi_subs);
+    if (mode != PatchMode::Overwrite || !hasSubs) {
+        s_patchedModules.clear();
+        return false;
+    }
+
+    if (info->dlpi_subs != s_patchedSubs) {
+        s_patchedModules.clear();
+        s_patchedSubs = info->dlpi_subs;
+    }
+    return !s_patchedModules.insert(info->dlpi_addr).second;
+}
+
+int iterate_phdrs(dl_phdr_info* info, size_t size, void* data) noexcept
+{
+    // note: dl_iterate_phdr serializes the calls to this function, which protects s_patchedModules
+    const auto mode = *static_cast<const PatchMode*>(data);
+
     if (strstr(info->dlpi_name, "/libheaptrack_inject.so")) {
         // prevent infinite recursion: do not overwrite our own symbols
         return 0;
@@ -509,27 +820,57 @@ int iterate_phdrs(dl_phdr_info* info, size_t /*size*/, void* data) noexcept
     } else if (strstr(info->dlpi_name, "linux-vdso.so")) {
         // don't overwrite anything within linux-vdso
         return 0;
+    } else if (isPatched(info, size, mode)) {
+        // only process new modules after dlopen
+        return 0;
     }
 
     const auto symtabSize = cachedSymtabSize(info->dlpi_name);
     for (auto phdr = info->dlpi_phdr, end = phdr + info->dlpi_phnum; phdr != end; ++phdr) {
         if (phdr->p_type == PT_DYNAMIC) {
-            try_overwrite_symbols(reinterpret_cast<const Elf::Dyn*>(phdr->p_vaddr + info->dlpi_addr), info->dlpi_addr,
-                                  data != nullptr, symtabSize);
+            try_overwrite_symbols(reinterpret_cast<const Elf::Dyn*>(phdr->p_vaddr + info->dlpi_addr), info->dlpi_addr, mode,
+                                  symtabSize);
         }
     }
     return 0;
 }
 
+void patch_symbols(PatchMode mode) noexcept
+{
+    dl_iterate_phdr(&iterate_phdrs, &mode);
+}
+
 void overwrite_symbols() noexcept
 {
-    dl_iterate_phdr(&iterate_phdrs, nullptr);
+    patch_symbols(PatchMode::Overwrite);
 }
 
+/// true once heaptrack got stopped and all hooks were removed for good
+std::atomic<bool> s_restored {false};
+
 void restore_symbols() noexcept
 {
-    bool do_shutdown = true;
-    dl_iterate_phdr(&iterate_phdrs, &do_shutdown);
+    s_restored = true;
+    patch_symbols(PatchMode::Restore);
+}
+
+/**
+ * Unhook the allocation functions while paused, such that the application
+ * runs at full speed until the recording gets resumed.
+ */
+void pause_symbols(int paused) noexcept
+{
+    if (s_restored) {
+        return;
+    }
+    s_paused = paused;
+    patch_symbols(paused ? PatchMode::Pause : PatchMode::Overwrite);
+}
+
+void init_symbols() noexcept
+{
+    overwrite_symbols();
+    heaptrack_set_pause_callback(&pause_symbols);
 }
 }
 
@@ -538,7 +879,7 @@ extern "C" {
 void heaptrack_inject(const char* outputFileName) noexcept
 {
     heaptrack_init(
-        outputFileName, &overwrite_symbols, [](LineWriter& out) { out.write("A\n"); }, &restore_symbols);
+        outputFileName, &init_symbols, [](LineWriter& out) { out.write("A\n"); }, &restore_symbols);
 }
 }
 
@@ -553,7 +894,7 @@ struct HeaptrackInjectPreloadInitialization
             // when the env var wasn't set, then this means we got runtime injected, don't do anything here
             return;
         }
-        heaptrack_init(outputFileName, &overwrite_symbols, nullptr, &restore_symbols);
+        heaptrack_init(outputFileName, &init_symbols, nullptr, &restore_symbols);
     }
 };
 
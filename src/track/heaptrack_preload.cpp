@@ -7,13 +7,18 @@
 #include "libheaptrack.h"
 #include "util/config.h"
 
+#include <cerrno>
+#include <cstdarg>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <dlfcn.h>
+#include <sys/mman.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <atomic>
+#include <cstddef>
 #include <type_traits>
 
 using namespace std;
@@ -39,6 +44,24 @@ void* mi_malloc(size_t size) LIBC_FUN_ATTRS;
 void* mi_calloc(size_t count, size_t size) LIBC_FUN_ATTRS;
 void* mi_realloc(void* p, size_t newsize) LIBC_FUN_ATTRS;
 void mi_free(void* p) LIBC_FUN_ATTRS;
+
+#if !HAVE_FREE_SIZED
+// C23 functions, which are not declared by older C libraries
+void free_sized(void* ptr, size_t size) LIBC_FUN_ATTRS;
+void free_aligned_sized(void* ptr, size_t alignment, size_t size) LIBC_FUN_ATTRS;
+#endif
+
+// Foward declare the non-standard jemalloc (https://jemalloc.net) functions, these don't call malloc and free.
+void* mallocx(size_t size, int flags) LIBC_FUN_ATTRS;
+void* rallocx(void* ptr, size_t size, int flags) LIBC_FUN_ATTRS;
+void dallocx(void* ptr, int flags) LIBC_FUN_ATTRS;
+void sdallocx(void* ptr, size_t size, int flags) LIBC_FUN_ATTRS;
+
+#ifdef __GLIBC__
+// calls main and then exit, which is not interposable from within the C library
+int __libc_start_main(int (*main)(int, char**, char**), int argc, char** argv, void (*init)(), void (*fini)(),
+                      void (*rtldFini)(), void* stackEnd);
+#endif
 }
 
 namespace {
@@ -51,10 +74,22 @@ enum class HookType
     Optional
 };
 
-template <typename Signature, typename Base, HookType Type>
+void init();
+
+// the allocation functions start out with these, see BootstrapArena
+void* bootstrap_malloc(size_t size) noexcept;
+void bootstrap_free(void* ptr) noexcept;
+void* bootstrap_calloc(size_t num, size_t size) noexcept;
+void* bootstrap_realloc(void* ptr, size_t size) noexcept;
+
+/**
+ * @p Bootstrap is what the hook calls until init() found the original function,
+ * which spares the hot allocation functions the check whether that happened already.
+ */
+template <typename Signature, typename Base, HookType Type, Signature Bootstrap = nullptr>
 struct hook
 {
-    Signature original = nullptr;
+    Signature original = Bootstrap;
 
     void init() noexcept
     {
@@ -87,16 +122,22 @@ struct hook
         static constexpr const char* identifier = #name;                                                               \
     } name
 
+#define BOOTSTRAP_HOOK(name)                                                                                           \
+    struct name##_t : public hook<decltype(&::name), name##_t, HookType::Required, &bootstrap_##name>                  \
+    {                                                                                                                  \
+        static constexpr const char* identifier = #name;                                                               \
+    } name
+
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wignored-attributes"
 
-HOOK(malloc, HookType::Required);
-HOOK(free, HookType::Required);
-HOOK(calloc, HookType::Required);
+BOOTSTRAP_HOOK(malloc);
+BOOTSTRAP_HOOK(free);
+BOOTSTRAP_HOOK(calloc);
 #if HAVE_CFREE
 HOOK(cfree, HookType::Optional);
 #endif
-HOOK(realloc, HookType::Required);
+BOOTSTRAP_HOOK(realloc);
 HOOK(posix_memalign, HookType::Optional);
 #if HAVE_VALLOC
 HOOK(valloc, HookType::Optional);
@@ -106,6 +147,22 @@ HOOK(aligned_alloc, HookType::Optional);
 #endif
 HOOK(dlopen, HookType::Required);
 HOOK(dlclose, HookType::Required);
+HOOK(fork, HookType::Required);
+
+// the start of the exit, see heaptrack_exit
+HOOK(exit, HookType::Required);
+#ifdef __GLIBC__
+HOOK(__libc_start_main, HookType::Required);
+#endif
+
+// memory mappings
+HOOK(mmap, HookType::Required);
+HOOK(munmap, HookType::Required);
+#ifdef __linux__
+HOOK(mremap, HookType::Optional);
+HOOK(brk, HookType::Optional);
+HOOK(sbrk, HookType::Optional);
+#endif
 
 // mimalloc functions
 HOOK(mi_malloc, HookType::Optional);
@@ -113,70 +170,145 @@ HOOK(mi_calloc, HookType::Optional);
 HOOK(mi_realloc, HookType::Optional);
 HOOK(mi_free, HookType::Optional);
 
+// sized deallocation functions
+HOOK(free_sized, HookType::Optional);
+HOOK(free_aligned_sized, HookType::Optional);
+
+// jemalloc functions
+HOOK(mallocx, HookType::Optional);
+HOOK(rallocx, HookType::Optional);
+HOOK(dallocx, HookType::Optional);
+HOOK(sdallocx, HookType::Optional);
+
 #pragma GCC diagnostic pop
 #undef HOOK
+#undef BOOTSTRAP_HOOK
 
 /**
- * Dummy implementation, since the call to dlsym from findReal triggers a call
- * to calloc.
+ * Static bump arena for the allocations done while the hooks get initialized,
+ * most notably by dlsym. Its memory never gets freed.
  *
- * This is only called at startup and will eventually be replaced by the
- * "proper" calloc implementation.
+ * This is zero-initialized static data, which is usable before any constructor ran.
+ * Multiple threads may allocate from it at the same time.
  */
-struct DummyPool
+struct BootstrapArena
 {
-    static const constexpr size_t MAX_SIZE = 1024;
-    char buf[MAX_SIZE] = {0};
-    size_t offset = 0;
+    static const constexpr size_t MAX_SIZE = 4096;
+    alignas(std::max_align_t) char buf[MAX_SIZE];
+    std::atomic<size_t> offset;
 
-    bool isDummyAllocation(void* ptr) noexcept
+    bool contains(void* ptr) const noexcept
     {
-        return ptr >= buf && ptr < buf + MAX_SIZE;
+        return reinterpret_cast<uintptr_t>(ptr) - reinterpret_cast<uintptr_t>(buf) < MAX_SIZE;
     }
 
-    void* alloc(size_t num, size_t size) noexcept
+    /// the number of bytes from @p ptr to the end of the arena, an upper bound for the size of its block
+    size_t remaining(void* ptr) const noexcept
     {
-        size_t oldOffset = offset;
-        offset += num * size;
-        if (offset >= MAX_SIZE) {
-            fprintf(stderr,
-                    "failed to initialize, dummy calloc buf size exhausted: "
-                    "%zu requested, %zu available\n",
-                    offset, MAX_SIZE);
-            abort();
+        return MAX_SIZE - (reinterpret_cast<uintptr_t>(ptr) - reinterpret_cast<uintptr_t>(buf));
+    }
+
+    void* alloc(size_t size) noexcept
+    {
+        const auto alignedSize = (size + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1);
+        if (alignedSize >= size && alignedSize <= MAX_SIZE) {
+            const auto start = offset.fetch_add(alignedSize, std::memory_order_relaxed);
+            if (start <= MAX_SIZE - alignedSize) {
+                return buf + start;
+            }
         }
-        return buf + oldOffset;
+        const auto used = offset.load(std::memory_order_relaxed);
+        fprintf(stderr,
+                "failed to initialize, bootstrap arena exhausted: "
+                "%zu requested, %zu available\n",
+                size, used < MAX_SIZE ? MAX_SIZE - used : 0);
+        abort();
     }
 };
 
-DummyPool& dummyPool()
+BootstrapArena bootstrapArena;
+
+/// set once init() got called, the allocations are served from the bootstrap arena from then on until
+/// the original functions are known
+std::atomic<bool> initStarted;
+
+void* bootstrap_malloc(size_t size) noexcept
+{
+    if (initStarted) {
+        return bootstrapArena.alloc(size);
+    }
+    init();
+    return hooks::malloc(size);
+}
+
+void bootstrap_free(void* ptr) noexcept
 {
-    static DummyPool pool;
-    return pool;
+    if (initStarted) {
+        // either from the bootstrap arena, or leaked as the original free is unknown yet
+        return;
+    }
+    init();
+    hooks::free(ptr);
 }
 
-void* dummy_calloc(size_t num, size_t size) noexcept
+void* bootstrap_calloc(size_t num, size_t size) noexcept
 {
-    return dummyPool().alloc(num, size);
+    if (initStarted) {
+        if (size && num > SIZE_MAX / size) {
+            return nullptr;
+        }
+        // the arena memory is zeroed and never reused
+        return bootstrapArena.alloc(num * size);
+    }
+    init();
+    return hooks::calloc(num, size);
+}
+
+void* bootstrap_realloc(void* ptr, size_t size) noexcept
+{
+    if (initStarted) {
+        if (ptr && !bootstrapArena.contains(ptr)) {
+            fprintf(stderr, "failed to initialize, cannot realloc %p from the bootstrap arena\n", ptr);
+            abort();
+        }
+        auto ret = bootstrapArena.alloc(size);
+        if (ptr) {
+            // the size of the old block is unknown, the copy may overlap with the new one
+            memmove(ret, ptr, std::min(size, bootstrapArena.remaining(ptr)));
+        }
+        return ret;
+    }
+    init();
+    return hooks::realloc(ptr, size);
 }
 
 void init()
 {
-    // heaptrack_init itself calls calloc via std::mutex/_libpthread_init on FreeBSD
-    hooks::calloc.original = &dummy_calloc;
+    if (initStarted.exchange(true)) {
+        return;
+    }
+    // dlsym allocates, as does heaptrack_init itself via std::mutex/_libpthread_init on FreeBSD
+    // until the original functions are found, these allocations get served by the bootstrap arena
+    hooks::malloc.init();
+    hooks::free.init();
     hooks::calloc.init();
+    hooks::realloc.init();
     heaptrack_init(
         getenv("DUMP_HEAPTRACK_OUTPUT"),
         [] {
             hooks::dlopen.init();
             hooks::dlclose.init();
-            hooks::malloc.init();
-            hooks::free.init();
-            hooks::calloc.init();
+            hooks::fork.init();
+            hooks::mmap.init();
+            hooks::munmap.init();
+#ifdef __linux__
+            hooks::mremap.init();
+            hooks::brk.init();
+            hooks::sbrk.init();
+#endif
 #if HAVE_CFREE
             hooks::cfree.init();
 #endif
-            hooks::realloc.init();
             hooks::posix_memalign.init();
 #if HAVE_VALLOC
             hooks::valloc.init();
@@ -191,12 +323,28 @@ void init()
             hooks::mi_realloc.init();
             hooks::mi_free.init();
 
+            // sized deallocation functions
+            hooks::free_sized.init();
+            hooks::free_aligned_sized.init();
+
+            // jemalloc functions
+            hooks::mallocx.init();
+            hooks::rallocx.init();
+            hooks::dallocx.init();
+            hooks::sdallocx.init();
+
             // cleanup environment to prevent tracing of child apps
             unsetenv("LD_PRELOAD");
             unsetenv("DUMP_HEAPTRACK_OUTPUT");
         },
         nullptr, nullptr);
 }
+
+/// initialize eagerly, allocations done before this by the constructors of other libraries initialize lazily
+__attribute__((constructor)) void initAtLoad()
+{
+    init();
+}
 }
 }
 
@@ -206,10 +354,6 @@ extern "C" {
 
 void* malloc(size_t size) LIBC_FUN_ATTRS
 {
-    if (!hooks::malloc) {
-        hooks::init();
-    }
-
     void* ptr = hooks::malloc(size);
     heaptrack_malloc(ptr, size);
     return ptr;
@@ -217,11 +361,7 @@ void* malloc(size_t size) LIBC_FUN_ATTRS
 
 void free(void* ptr) LIBC_FUN_ATTRS
 {
-    if (!hooks::free) {
-        hooks::init();
-    }
-
-    if (hooks::dummyPool().isDummyAllocation(ptr)) {
+    if (hooks::bootstrapArena.contains(ptr)) {
         return;
     }
 
@@ -235,8 +375,14 @@ void free(void* ptr) LIBC_FUN_ATTRS
 
 void* realloc(void* ptr, size_t size) LIBC_FUN_ATTRS
 {
-    if (!hooks::realloc) {
-        hooks::init();
+    if (hooks::bootstrapArena.contains(ptr)) {
+        // the original realloc doesn't know this block, and it never gets freed anyways
+        void* ret = malloc(size);
+        if (ret) {
+            // the new block may come from the arena too while we initialize
+            memmove(ret, ptr, std::min(size, hooks::bootstrapArena.remaining(ptr)));
+        }
+        return ret;
     }
 
     void* ret = hooks::realloc(ptr, size);
@@ -250,10 +396,6 @@ void* realloc(void* ptr, size_t size) LIBC_FUN_ATTRS
 
 void* calloc(size_t num, size_t size) LIBC_FUN_ATTRS
 {
-    if (!hooks::calloc) {
-        hooks::init();
-    }
-
     void* ret = hooks::calloc(num, size);
 
     if (ret) {
@@ -372,6 +514,140 @@ int dlclose(void* handle) LIBC_FUN_ATTRS
     return ret;
 }
 
+pid_t fork() LIBC_FUN_ATTRS
+{
+    if (!hooks::fork) {
+        hooks::init();
+    }
+
+    heaptrack_prepare_fork();
+    const auto pid = hooks::fork();
+    if (pid != 0) {
+        heaptrack_forked(pid);
+    }
+
+    return pid;
+}
+
+// memory mappings, only anonymous ones get recorded
+void* mmap(void* addr, size_t length, int prot, int flags, int fd, off_t offset) LIBC_FUN_ATTRS
+{
+    if (!hooks::mmap) {
+        hooks::init();
+    }
+
+    void* ret = hooks::mmap(addr, length, prot, flags, fd, offset);
+
+    if (ret != MAP_FAILED) {
+        if (flags & MAP_ANONYMOUS) {
+            heaptrack_mmap(ret, length);
+        } else if (flags & MAP_FIXED) {
+            // this replaces any anonymous memory that was mapped there before
+            heaptrack_munmap(ret, length);
+        }
+    }
+
+    return ret;
+}
+
+int munmap(void* addr, size_t length) LIBC_FUN_ATTRS
+{
+    if (!hooks::munmap) {
+        hooks::init();
+    }
+
+    int ret = hooks::munmap(addr, length);
+
+    if (!ret) {
+        heaptrack_munmap(addr, length);
+    }
+
+    return ret;
+}
+
+#ifdef __linux__
+void* mremap(void* oldAddr, size_t oldLength, size_t newLength, int flags, ...) LIBC_FUN_ATTRS
+{
+    if (!hooks::mremap) {
+        hooks::init();
+    }
+
+    void* newAddr = nullptr;
+    if (flags & MREMAP_FIXED) {
+        va_list args;
+        va_start(args, flags);
+        newAddr = va_arg(args, void*);
+        va_end(args);
+    }
+
+    void* ret = hooks::mremap(oldAddr, oldLength, newLength, flags, newAddr);
+
+    if (ret != MAP_FAILED) {
+#ifdef MREMAP_DONTUNMAP
+        if (flags & MREMAP_DONTUNMAP) {
+            // only allowed for anonymous memory, the old mapping stays around
+            heaptrack_mmap(ret, newLength);
+            return ret;
+        }
+#endif
+        heaptrack_mremap(oldAddr, oldLength, ret, newLength);
+    }
+
+    return ret;
+}
+
+// the C library calls its internal variants of these for malloc, so we only see other users
+int brk(void* addr) LIBC_FUN_ATTRS
+{
+    if (!hooks::brk) {
+        hooks::init();
+        if (!hooks::brk) {
+            // while the hooks get initialized in another thread, or when the libc has no brk at all
+            errno = ENOMEM;
+            return -1;
+        }
+    }
+
+    // sbrk is optional and gets initialized along with brk, skip the accounting without it
+    auto oldBreak = hooks::sbrk ? static_cast<char*>(hooks::sbrk(0)) : reinterpret_cast<char*>(-1);
+    int ret = hooks::brk(addr);
+
+    if (!ret && oldBreak != reinterpret_cast<char*>(-1)) {
+        auto newBreak = static_cast<char*>(addr);
+        if (newBreak > oldBreak) {
+            heaptrack_mmap(oldBreak, newBreak - oldBreak);
+        } else if (newBreak < oldBreak) {
+            heaptrack_munmap(newBreak, oldBreak - newBreak);
+        }
+    }
+
+    return ret;
+}
+
+void* sbrk(intptr_t increment) LIBC_FUN_ATTRS
+{
+    if (!hooks::sbrk) {
+        hooks::init();
+        if (!hooks::sbrk) {
+            errno = ENOMEM;
+            return reinterpret_cast<void*>(-1);
+        }
+    }
+
+    void* ret = hooks::sbrk(increment);
+
+    if (ret != reinterpret_cast<void*>(-1)) {
+        if (increment > 0) {
+            heaptrack_mmap(ret, increment);
+        } else if (increment < 0) {
+            heaptrack_munmap(static_cast<char*>(ret) + increment, -increment);
+        }
+    }
+
+    return ret;
+}
+#endif
+
 // mimalloc functions, implementations just copied from above and names changed
 void* mi_malloc(size_t size) LIBC_FUN_ATTRS
 {
@@ -420,7 +696,7 @@ void mi_free(void* ptr) LIBC_FUN_ATTRS
         hooks::init();
     }
 
-    if (hooks::dummyPool().isDummyAllocation(ptr)) {
+    if (hooks::bootstrapArena.contains(ptr)) {
         return;
     }
 
@@ -431,4 +707,122 @@ void mi_free(void* ptr) LIBC_FUN_ATTRS
 
     hooks::mi_free(ptr);
 }
+
+// sized deallocation functions, these don't go through free in the C library
+void free_sized(void* ptr, size_t size) LIBC_FUN_ATTRS
+{
+    if (!hooks::free_sized) {
+        hooks::init();
+    }
+
+    if (hooks::bootstrapArena.contains(ptr)) {
+        return;
+    }
+
+    heaptrack_free(ptr);
+
+    hooks::free_sized(ptr, size);
+}
+
+void free_aligned_sized(void* ptr, size_t alignment, size_t size) LIBC_FUN_ATTRS
+{
+    if (!hooks::free_aligned_sized) {
+        hooks::init();
+    }
+
+    heaptrack_free(ptr);
+
+    hooks::free_aligned_sized(ptr, alignment, size);
+}
+
+// jemalloc functions
+void* mallocx(size_t size, int flags) LIBC_FUN_ATTRS
+{
+    if (!hooks::mallocx) {
+        hooks::init();
+    }
+
+    void* ptr = hooks::mallocx(size, flags);
+
+    if (ptr) {
+        heaptrack_malloc(ptr, size);
+    }
+
+    return ptr;
+}
+
+void* rallocx(void* ptr, size_t size, int flags) LIBC_FUN_ATTRS
+{
+    if (!hooks::rallocx) {
+        hooks::init();
+    }
+
+    void* ret = hooks::rallocx(ptr, size, flags);
+
+    if (ret) {
+        heaptrack_realloc(ptr, size, ret);
+    }
+
+    return ret;
+}
+
+void dallocx(void* ptr, int flags) LIBC_FUN_ATTRS
+{
+    if (!hooks::dallocx) {
+        hooks::init();
+    }
+
+    heaptrack_free(ptr);
+
+    hooks::dallocx(ptr, flags);
+}
+
+void sdallocx(void* ptr, size_t size, int flags) LIBC_FUN_ATTRS
+{
+    if (!hooks::sdallocx) {
+        hooks::init();
+    }
+
+    heaptrack_free(ptr);
+
+    hooks::sdallocx(ptr, size, flags);
+}
+
+// the exit hooks don't start the recording, unlike the others
+void exit(int status) LIBC_FUN_ATTRS
+{
+    if (!hooks::exit) {
+        hooks::exit.init();
+    }
+
+    heaptrack_exit();
+
+    hooks::exit(status);
+    __builtin_unreachable();
+}
+
+#ifdef __GLIBC__
+namespace {
+int (*originalMain)(int, char**, char**) = nullptr;
+
+int heaptrackMain(int argc, char** argv, char** envp)
+{
+    const auto ret = originalMain(argc, argv, envp);
+    heaptrack_exit();
+    return ret;
+}
+}
+
+// returning from main calls exit from within the C library, so wrap main itself
+int __libc_start_main(int (*main)(int, char**, char**), int argc, char** argv, void (*init)(), void (*fini)(),
+                      void (*rtldFini)(), void* stackEnd)
+{
+    if (!hooks::__libc_start_main) {
+        hooks::__libc_start_main.init();
+    }
+
+    originalMain = main;
+    return hooks::__libc_start_main(&heaptrackMain, argc, argv, init, fini, rtldFini, stackEnd);
+}
+#endif
 }
@@ -29,21 +29,38 @@
 #include <sys/types.h>
 #include <sys/user.h>
 #endif
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#include <poll.h>
 #include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
 
+#include <algorithm>
 #include <atomic>
 #include <cinttypes>
+#include <cmath>
+#include <cstring>
 #include <memory>
 #include <mutex>
 #include <sstream>
 #include <string>
 #include <thread>
+#include <vector>
 
 #include "tracetree.h"
 #include "util/config.h"
 #include "util/libunwind_config.h"
 #include "util/linewriter.h"
 #include "util/macroutils.h"
+#include "util/mappedfile.h"
 
 extern "C" {
 // see upstream "documentation" at:
@@ -65,6 +82,8 @@ __attribute__((weak)) extern void __freeres();
 #include <tsl/robin_set.h>
 #endif
 
+#include <tsl/robin_map.h>
+
 using namespace std;
 
 namespace {
@@ -108,10 +127,308 @@ struct RecursionGuard
     }
 
     const bool wasLocked;
-    static thread_local bool isActive;
+    static thread_local bool isActive HEAPTRACK_INITIAL_EXEC_TLS;
+};
+
+HEAPTRACK_INITIAL_EXEC_TLS thread_local bool RecursionGuard::isActive = false;
+
+/**
+ * An allocation event that got recorded without holding the global lock.
+ *
+ * The sequence number is taken from a global counter and is used to restore
+ * the original order of events across threads before they get written out.
+ */
+struct ThreadEvent
+{
+    uint64_t sequence;
+    uintptr_t ptr;
+    size_t size;
+    uint32_t traceIndex;
+    /// see HeapTrack::threadIndex
+    uint32_t threadIndex;
+    char type;
+};
+
+/**
+ * Lock-free single-producer/single-consumer ring buffer of allocation events.
+ *
+ * Each thread owns one buffer while it is alive, the timer thread drains all
+ * buffers into the output stream. Buffers are never freed, instead they get
+ * reused by new threads once their previous owner has finished.
+ */
+struct ThreadBuffer
+{
+    static constexpr const uint64_t CAPACITY = 4096;
+    static constexpr const uint64_t NO_EVENT = UINT64_MAX;
+
+    /// lower bound for the sequence number of the event that is currently being pushed
+    atomic<uint64_t> inFlight {NO_EVENT};
+    atomic<uint64_t> writeIndex {0};
+    char producerPadding[64 - 2 * sizeof(atomic<uint64_t>)];
+    atomic<uint64_t> readIndex {0};
+    atomic<bool> inUse {true};
+    ThreadBuffer* next = nullptr;
+    ThreadEvent events[CAPACITY];
+    /// the traces of the owning thread, valid while tracesGeneration matches s_threadGeneration
+    TraceShard traces;
+    uint32_t tracesGeneration = 0;
+};
+
+/// all buffers ever allocated, new ones get prepended
+atomic<ThreadBuffer*> s_threadBuffers {nullptr};
+/// the global sequence counter for ThreadEvent::sequence
+atomic<uint64_t> s_eventSequence {0};
+
+/// the compact index of the current thread, valid while t_threadGeneration matches s_threadGeneration
+HEAPTRACK_INITIAL_EXEC_TLS thread_local uint32_t t_threadIndex = 0;
+HEAPTRACK_INITIAL_EXEC_TLS thread_local uint32_t t_threadGeneration = 0;
+/// incremented for every new output, which invalidates all thread indices
+atomic<uint32_t> s_threadGeneration {0};
+
+HEAPTRACK_INITIAL_EXEC_TLS thread_local ThreadBuffer* t_threadBuffer = nullptr;
+/// set when the thread is shutting down, after that we don't use a thread buffer anymore
+HEAPTRACK_INITIAL_EXEC_TLS thread_local bool t_threadBufferReleased = false;
+pthread_key_t s_threadBufferKey;
+
+/// set by the fork hooks, such that we only follow the forks that get announced to the interpreter
+HEAPTRACK_INITIAL_EXEC_TLS thread_local bool t_forkAnnounced = false;
+
+void releaseThreadBuffer(void* data)
+{
+    auto buffer = reinterpret_cast<ThreadBuffer*>(data);
+    t_threadBuffer = nullptr;
+    t_threadBufferReleased = true;
+    buffer->inUse.store(false, memory_order_release);
+}
+
+ThreadBuffer* threadBuffer()
+{
+    if (t_threadBuffer || t_threadBufferReleased) {
+        return t_threadBuffer;
+    }
+
+    // try to reuse a buffer from a thread that has finished already
+    ThreadBuffer* buffer = s_threadBuffers.load();
+    for (; buffer; buffer = buffer->next) {
+        bool inUse = false;
+        if (buffer->inUse.compare_exchange_strong(inUse, true)) {
+            break;
+        }
+    }
+
+    if (!buffer) {
+        buffer = new ThreadBuffer;
+        buffer->next = s_threadBuffers.load();
+        while (!s_threadBuffers.compare_exchange_weak(buffer->next, buffer)) {
+        }
+    }
+
+    if (pthread_setspecific(s_threadBufferKey, buffer) != 0) {
+        // we cannot detect when this thread finishes, so don't use a buffer at all
+        buffer->inUse.store(false, memory_order_release);
+        t_threadBufferReleased = true;
+        return nullptr;
+    }
+
+    t_threadBuffer = buffer;
+    return buffer;
+}
+
+/**
+ * Push @p event into the buffer of the current thread.
+ *
+ * @return false when the buffer is full or unavailable, the caller then has
+ * to fall back to the locked path.
+ */
+bool pushThreadEvent(ThreadEvent event)
+{
+    auto buffer = threadBuffer();
+    if (!buffer) {
+        return false;
+    }
+
+    const auto writeIndex = buffer->writeIndex.load(memory_order_relaxed);
+    if (writeIndex - buffer->readIndex.load(memory_order_acquire) >= ThreadBuffer::CAPACITY) {
+        return false;
+    }
+
+    // announce the event before taking the sequence number, this way the drainer
+    // never writes out events that got a higher sequence number than ours
+    buffer->inFlight.store(s_eventSequence.load());
+    event.sequence = s_eventSequence.fetch_add(1);
+    buffer->events[writeIndex % ThreadBuffer::CAPACITY] = event;
+    buffer->writeIndex.store(writeIndex + 1, memory_order_release);
+    buffer->inFlight.store(ThreadBuffer::NO_EVENT);
+    return true;
+}
+
+/// the shard of the current thread in OverheadCounters plus one, or zero before its first use
+HEAPTRACK_INITIAL_EXEC_TLS thread_local unsigned t_overheadShard = 0;
+
+/**
+ * Cheap counters for the work done by heaptrack itself, to tell why it slows down the debuggee.
+ *
+ * Every thread adds to a cache line of its own, the timer thread sums them up and writes them
+ * out periodically, see HeapTrack::writeOverhead. Durations are accumulated in cycles of the
+ * time stamp counter where available, and in nanoseconds otherwise.
+ */
+struct OverheadCounters
+{
+    enum Counter
+    {
+        Events,
+        UnwindCycles,
+        LockSpins,
+        LockWaitCycles,
+        NumCounters
+    };
+
+    static uint64_t cycles()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return chrono::duration_cast<chrono::nanoseconds>(clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    void add(Counter counter, uint64_t value)
+    {
+        if (!t_overheadShard) {
+            t_overheadShard = nextShard.fetch_add(1, memory_order_relaxed) % NUM_SHARDS + 1;
+        }
+        shards[t_overheadShard - 1].counters[counter].fetch_add(value, memory_order_relaxed);
+    }
+
+    void addCyclesSince(Counter counter, uint64_t start)
+    {
+        add(counter, cycles() - start);
+    }
+
+    uint64_t sum(Counter counter) const
+    {
+        uint64_t sum = 0;
+        for (const auto& shard : shards) {
+            sum += shard.counters[counter].load(memory_order_relaxed);
+        }
+        return sum;
+    }
+
+    void reset()
+    {
+        for (auto& shard : shards) {
+            for (auto& counter : shard.counters) {
+                counter.store(0, memory_order_relaxed);
+            }
+        }
+    }
+
+private:
+    struct alignas(64) Shard
+    {
+        atomic<uint64_t> counters[NumCounters];
+    };
+
+    static constexpr const unsigned NUM_SHARDS = 64;
+    Shard shards[NUM_SHARDS];
+    atomic<unsigned> nextShard {0};
+};
+
+OverheadCounters s_overhead;
+
+/// the shard of the current thread in SizeClassCounters plus one, or zero before its first use
+HEAPTRACK_INITIAL_EXEC_TLS thread_local unsigned t_sizeClassShard = 0;
+
+/**
+ * The allocations per size class, recorded instead of the individual allocations with HEAPTRACK_COUNT_ONLY.
+ *
+ * Size class i holds the allocations of [2^(i-1), 2^i) bytes, size class zero the empty ones. The
+ * size of a freed allocation is unknown, so only the frees get counted. Like for OverheadCounters,
+ * every thread adds to a cache line of its own and the timer thread sums them up, see
+ * HeapTrack::writeSizeClasses.
+ */
+struct SizeClassCounters
+{
+    static constexpr const unsigned NUM_CLASSES = 65;
+
+    static unsigned sizeClass(size_t size)
+    {
+        return size ? 64 - __builtin_clzll(static_cast<unsigned long long>(size)) : 0;
+    }
+
+    void allocate(size_t size)
+    {
+        auto& shard = currentShard();
+        const auto index = sizeClass(size);
+        shard.allocations[index].fetch_add(1, memory_order_relaxed);
+        shard.bytes[index].fetch_add(size, memory_order_relaxed);
+    }
+
+    void free()
+    {
+        currentShard().frees.fetch_add(1, memory_order_relaxed);
+    }
+
+    uint64_t allocations(unsigned sizeClass) const
+    {
+        uint64_t sum = 0;
+        for (const auto& shard : shards) {
+            sum += shard.allocations[sizeClass].load(memory_order_relaxed);
+        }
+        return sum;
+    }
+
+    uint64_t bytes(unsigned sizeClass) const
+    {
+        uint64_t sum = 0;
+        for (const auto& shard : shards) {
+            sum += shard.bytes[sizeClass].load(memory_order_relaxed);
+        }
+        return sum;
+    }
+
+    uint64_t frees() const
+    {
+        uint64_t sum = 0;
+        for (const auto& shard : shards) {
+            sum += shard.frees.load(memory_order_relaxed);
+        }
+        return sum;
+    }
+
+    void reset()
+    {
+        for (auto& shard : shards) {
+            for (unsigned i = 0; i < NUM_CLASSES; ++i) {
+                shard.allocations[i].store(0, memory_order_relaxed);
+                shard.bytes[i].store(0, memory_order_relaxed);
+            }
+            shard.frees.store(0, memory_order_relaxed);
+        }
+    }
+
+private:
+    struct alignas(64) Shard
+    {
+        atomic<uint64_t> allocations[NUM_CLASSES];
+        atomic<uint64_t> bytes[NUM_CLASSES];
+        atomic<uint64_t> frees;
+    };
+
+    Shard& currentShard()
+    {
+        if (!t_sizeClassShard) {
+            t_sizeClassShard = nextShard.fetch_add(1, memory_order_relaxed) % NUM_SHARDS + 1;
+        }
+        return shards[t_sizeClassShard - 1];
+    }
+
+    static constexpr const unsigned NUM_SHARDS = 64;
+    Shard shards[NUM_SHARDS];
+    atomic<unsigned> nextShard {0};
 };
 
-thread_local bool RecursionGuard::isActive = false;
+SizeClassCounters s_sizeClasses;
 
 enum DebugVerbosity
 {
@@ -179,6 +496,12 @@ atomic<bool> s_atexit {false};
  */
 atomic<bool> s_forceCleanup {false};
 
+/**
+ * Set with HEAPTRACK_FAST_EXIT, then the recording ends as soon as the process starts to exit,
+ * see heaptrack_exit. Cleared once that happened.
+ */
+atomic<bool> s_fastExit {false};
+
 // based on: https://stackoverflow.com/a/24315631/35250
 void replaceAll(string& str, const string& search, const string& replace)
 {
@@ -200,6 +523,13 @@ static int lockFile(int fd)
     return ret;
 }
 
+/// whether HEAPTRACK_MMAP_OUTPUT asks to write the output through a memory mapping, see MappedFileSink
+bool mappedOutputRequested()
+{
+    const auto mmapOutputEnv = getenv("HEAPTRACK_MMAP_OUTPUT");
+    return mmapOutputEnv && strcmp(mmapOutputEnv, "0") != 0;
+}
+
 int createFile(const char* fileName)
 {
     string outputFileName;
@@ -222,7 +552,9 @@ int createFile(const char* fileName)
 
     replaceAll(outputFileName, "$$", to_string(getpid()));
 
-    auto out = open(outputFileName.c_str(), O_CREAT | O_WRONLY | O_CLOEXEC, 0644);
+    // a shared mapping of the file requires read access too
+    const auto accessMode = mappedOutputRequested() ? O_RDWR : O_WRONLY;
+    auto out = open(outputFileName.c_str(), O_CREAT | accessMode | O_CLOEXEC, 0644);
     debugLog<VerboseOutput>("will write to %s/%p\n", outputFileName.c_str(), out);
     // we do our own locking, this speeds up the writing significantly
     if (out == -1) {
@@ -248,332 +580,1870 @@ int createFile(const char* fileName)
     return out;
 }
 
+bool isFifo(int fd)
+{
+    struct stat info;
+    return fstat(fd, &info) == 0 && S_ISFIFO(info.st_mode);
+}
+
 /**
- * Thread-Safe heaptrack API
+ * @return the output file name of the forked child process @p pid when its parent
+ *         writes to @p fileName, or an empty string when it cannot be traced
+ */
+string childOutputFileName(string fileName, pid_t pid)
+{
+    if (fileName == "-" || fileName == "stdout" || fileName == "stderr") {
+        return {};
+    }
+    if (fileName.empty()) {
+        // like createFile does it
+        fileName = "heaptrack.$$";
+    }
+
+    const auto pidString = to_string(pid);
+    if (fileName.find("$$") != string::npos) {
+        replaceAll(fileName, "$$", pidString);
+    } else {
+        fileName += '.';
+        fileName += pidString;
+    }
+    return fileName;
+}
+
+/**
+ * Open the output of a forked child process, see childOutputFileName.
  *
- * The only critical section in libheaptrack is the output of the data,
- * dl_iterate_phdr calls, as well as initialization and shutdown.
+ * When the parent writes to a named pipe, the child creates its own one. It then waits for
+ * heaptrack_interpret to open it for reading, which happens once the parent announced the
+ * child via heaptrack_forked. When that doesn't happen in time, -1 is returned.
  */
-class HeapTrack
+int openChildOutput(const string& fileName, bool fifo)
 {
-public:
-    template <typename Op>
-    static bool op(const RecursionGuard& /*recursionGuard*/, const Op& op)
-    {
-        debugLog<VeryVerboseOutput>("%s", "acquiring lock");
+    if (!fifo) {
+        return createFile(fileName.c_str());
+    }
 
-        auto locked = tryLock([]() { return s_forceCleanup.load(); });
-        if (!locked) {
-            return false;
+    if (mkfifo(fileName.c_str(), 0600) != 0 && errno != EEXIST) {
+        fprintf(stderr, "WARNING: failed to create heaptrack output pipe %s for forked child %d: %s\n",
+                fileName.c_str(), getpid(), strerror(errno));
+        return -1;
+    }
+
+    const auto deadline = clock::now() + chrono::seconds(30);
+    do {
+        // opening a pipe for writing fails with ENXIO without blocking as long as nobody reads from it
+        const auto out = open(fileName.c_str(), O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+        if (out != -1) {
+            fcntl(out, F_SETFL, fcntl(out, F_GETFL) & ~O_NONBLOCK);
+            return out;
         }
+        if (errno != ENXIO && errno != EINTR) {
+            break;
+        }
+        this_thread::sleep_for(chrono::milliseconds(1));
+    } while (clock::now() < deadline);
 
-        debugLog<VeryVerboseOutput>("%s", "lock acquired");
+    fprintf(stderr, "WARNING: failed to open heaptrack output pipe %s for forked child %d: %s\n", fileName.c_str(),
+            getpid(), strerror(errno));
+    unlink(fileName.c_str());
+    return -1;
+}
 
-        HeapTrack heaptrack(locked);
-        op(heaptrack);
+/**
+ * Lock-free set of the pointers that got sampled.
+ *
+ * This allows us to skip the frees of allocations that never got recorded.
+ * When the set overflows, we fall back to recording all frees, which is
+ * fine since heaptrack_interpret ignores frees of unknown pointers.
+ */
+struct SampledPointers
+{
+    static constexpr const uint64_t SIZE_BITS = 18;
+    static constexpr const uint64_t SIZE = 1ull << SIZE_BITS;
+    static constexpr const uint64_t MAX_PROBES = 64;
+    static constexpr const uintptr_t EMPTY = 0;
+    static constexpr const uintptr_t TOMBSTONE = 1;
 
-        return true;
+    static uint64_t slot(uintptr_t ptr)
+    {
+        // fibonacci hashing, ignore the lower bits which are zero due to alignment
+        return (static_cast<uint64_t>(ptr >> 4) * 0x9E3779B97F4A7C15ull) >> (64 - SIZE_BITS);
     }
 
-    ~HeapTrack()
+    /**
+     * Forget all pointers. When @p recordAllFrees is set, the set starts out overflowed,
+     * which is required when allocations got recorded before without sampling them.
+     */
+    void clear(bool recordAllFrees = false)
     {
-        debugLog<VeryVerboseOutput>("%s", "releasing lock");
-
-        s_lock.unlock();
+        for (auto& slot : slots) {
+            slot.store(EMPTY, memory_order_relaxed);
+        }
+        overflow.store(recordAllFrees);
     }
 
-    void initialize(const char* fileName, heaptrack_callback_t initBeforeCallback,
-                    heaptrack_callback_initialized_t initAfterCallback, heaptrack_callback_t stopCallback)
+    void insert(uintptr_t ptr)
     {
-        debugLog<MinimalOutput>("initializing: %s", fileName);
-        if (s_data) {
-            debugLog<MinimalOutput>("%s", "already initialized");
-            return;
+        auto index = slot(ptr);
+        for (uint64_t probe = 0; probe < MAX_PROBES; ++probe, index = (index + 1) & (SIZE - 1)) {
+            auto current = slots[index].load(memory_order_relaxed);
+            while (current == EMPTY || current == TOMBSTONE) {
+                if (slots[index].compare_exchange_weak(current, ptr)) {
+                    return;
+                }
+            }
         }
+        overflow.store(true, memory_order_relaxed);
+    }
 
-        if (initBeforeCallback) {
-            debugLog<MinimalOutput>("%s", "calling initBeforeCallback");
-            initBeforeCallback();
-            debugLog<MinimalOutput>("%s", "done calling initBeforeCallback");
+    /**
+     * @return true when @p ptr got sampled, or when we cannot know for sure
+     */
+    bool take(uintptr_t ptr)
+    {
+        auto index = slot(ptr);
+        for (uint64_t probe = 0; probe < MAX_PROBES; ++probe, index = (index + 1) & (SIZE - 1)) {
+            auto current = slots[index].load(memory_order_relaxed);
+            if (current == ptr) {
+                return slots[index].compare_exchange_strong(current, TOMBSTONE) || overflow.load();
+            } else if (current == EMPTY) {
+                break;
+            }
         }
+        return overflow.load(memory_order_relaxed);
+    }
 
-        // do some once-only initializations
-        static once_flag once;
-        call_once(once, [] {
-            debugLog<MinimalOutput>("%s", "doing once-only initialization");
+    atomic<uintptr_t> slots[SIZE];
+    atomic<bool> overflow {false};
+};
 
-            Trace::setup();
+SampledPointers s_sampledPointers;
 
-            // do not trace forked child processes
-            // TODO: make this configurable
-            pthread_atfork(&prepare_fork, &parent_fork, &child_fork);
+/// remaining bytes in the current thread before the next allocation gets sampled
+HEAPTRACK_INITIAL_EXEC_TLS thread_local int64_t t_bytesUntilSample = 0;
+/// xorshift state for the sampling intervals, zero while not yet seeded
+HEAPTRACK_INITIAL_EXEC_TLS thread_local uint64_t t_sampleRandomState = 0;
 
-            atexit([]() {
-                if (s_forceCleanup) {
-                    return;
-                }
-                debugLog<MinimalOutput>("%s", "atexit()");
+/**
+ * Draw the number of bytes until the next sample from an exponential
+ * distribution with a mean of @p sampleInterval.
+ *
+ * This turns our sampling into a Poisson process over the allocated bytes,
+ * i.e. bigger allocations are more likely to get sampled.
+ */
+int64_t nextSampleDistance(uint64_t sampleInterval)
+{
+    if (!t_sampleRandomState) {
+        const auto now = static_cast<uint64_t>(clock::now().time_since_epoch().count());
+        t_sampleRandomState = ((static_cast<uint64_t>(gettid()) << 32) ^ now) | 1;
+    }
+    auto& x = t_sampleRandomState;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    const auto random = (x * 0x2545F4914F6CDD1Dull) >> 11;
+    const auto uniform = static_cast<double>(random) / static_cast<double>(1ull << 53);
+    return static_cast<int64_t>(-std::log1p(-uniform) * sampleInterval) + 1;
+}
 
-                // free internal libstdc++ resources
-                // see also Valgrind's `--run-cxx-freeres` option
-                if (&__gnu_cxx::__freeres) {
-                    __gnu_cxx::__freeres();
-                }
+/**
+ * Thread-local cache from a call site fingerprint to the trace index of its full backtrace.
+ *
+ * Hot call sites produce the same backtrace over and over again, a hit in this
+ * cache allows us to skip both the unwinding and the TraceTree lookup. The cache
+ * is direct-mapped and allocated via mmap, to keep it out of the recorded data.
+ */
+struct UnwindCache
+{
+    static constexpr const uint64_t SIZE_BITS = 10;
+    static constexpr const uint64_t SIZE = 1ull << SIZE_BITS;
 
-                s_atexit.store(true);
-                heaptrack_stop();
-            });
-        });
+    struct Entry
+    {
+        Trace::CallSite callSite;
+        uint32_t traceIndex;
+        /// the s_unwindCacheGeneration this entry is valid for, zero for empty entries
+        uint32_t generation;
+    };
 
-        const auto out = createFile(fileName);
+    Entry* entry(const Trace::CallSite& callSite)
+    {
+        const auto hash = static_cast<uint64_t>(callSite.returnAddress ^ (callSite.stackPointer << 20))
+            ^ callSite.depthHash;
+        return &entries[(hash * 0x9E3779B97F4A7C15ull) >> (64 - SIZE_BITS)];
+    }
 
-        if (out == -1) {
-            if (stopCallback) {
-                stopCallback();
-            }
-            return;
-        }
+    Entry entries[SIZE];
+};
 
-        s_data = new LockedData(out, stopCallback);
+/// zero while the unwind cache is disabled, otherwise it gets bumped whenever cached trace indices become invalid
+atomic<uint32_t> s_unwindCacheGeneration {0};
+HEAPTRACK_INITIAL_EXEC_TLS thread_local UnwindCache* t_unwindCache = nullptr;
+/// set when the thread is shutting down or the cache could not be allocated
+HEAPTRACK_INITIAL_EXEC_TLS thread_local bool t_unwindCacheReleased = false;
+pthread_key_t s_unwindCacheKey;
 
-        writeVersion();
-        writeExe();
-        writeCommandLine();
-        writeSystemInfo();
-        writeSuppressions();
+void releaseUnwindCache(void* data)
+{
+    t_unwindCache = nullptr;
+    t_unwindCacheReleased = true;
+    munmap(data, sizeof(UnwindCache));
+}
 
-        if (initAfterCallback) {
-            debugLog<MinimalOutput>("%s", "calling initAfterCallback");
-            initAfterCallback(s_data->out);
-            debugLog<MinimalOutput>("%s", "calling initAfterCallback done");
-        }
+UnwindCache* unwindCache()
+{
+    if (t_unwindCache || t_unwindCacheReleased) {
+        return t_unwindCache;
+    }
 
-        debugLog<MinimalOutput>("%s", "initialization done");
+    // anonymous mappings are zero-initialized, i.e. all entries start out empty
+    auto cache = mmap(nullptr, sizeof(UnwindCache), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (cache == MAP_FAILED) {
+        t_unwindCacheReleased = true;
+        return nullptr;
+    }
+    if (pthread_setspecific(s_unwindCacheKey, cache) != 0) {
+        munmap(cache, sizeof(UnwindCache));
+        t_unwindCacheReleased = true;
+        return nullptr;
     }
 
-    void shutdown()
-    {
-        if (!s_data) {
+    t_unwindCache = static_cast<UnwindCache*>(cache);
+    return t_unwindCache;
+}
+
+/**
+ * Look up the current call site in the UnwindCache of this thread.
+ */
+class UnwindCacheLookup
+{
+public:
+    explicit UnwindCacheLookup(int skip)
+    {
+        m_generation = s_unwindCacheGeneration.load(memory_order_acquire);
+        if (!m_generation) {
+            return;
+        }
+        auto cache = unwindCache();
+        if (cache && Trace::callSite(skip, &m_callSite)) {
+            m_entry = cache->entry(m_callSite);
+        }
+    }
+
+    bool hit() const
+    {
+        return m_entry && m_entry->generation == m_generation
+            && m_entry->callSite.returnAddress == m_callSite.returnAddress
+            && m_entry->callSite.stackPointer == m_callSite.stackPointer
+            && m_entry->callSite.depthHash == m_callSite.depthHash;
+    }
+
+    uint32_t traceIndex() const
+    {
+        return m_entry->traceIndex;
+    }
+
+    uint32_t generation() const
+    {
+        return m_generation;
+    }
+
+    /// remember @p traceIndex for this call site after unwinding it
+    void store(uint32_t traceIndex)
+    {
+        if (m_entry) {
+            *m_entry = {m_callSite, traceIndex, m_generation};
+        }
+    }
+
+private:
+    Trace::CallSite m_callSite;
+    UnwindCache::Entry* m_entry = nullptr;
+    uint32_t m_generation = 0;
+};
+
+/**
+ * Per-trace allocation counters for HEAPTRACK_AGGREGATE.
+ *
+ * Instead of writing every allocation and deallocation event, we only remember
+ * the live allocations and accumulate their cost per trace index. The changes
+ * since the previous snapshot are then written out regularly via 'd' records.
+ */
+struct TraceAggregation
+{
+    struct Counters
+    {
+        uint64_t allocations = 0;
+        uint64_t deallocations = 0;
+        uint64_t temporary = 0;
+        uint64_t allocated = 0;
+        uint64_t freed = 0;
+        bool dirty = false;
+    };
+
+    struct LiveAllocation
+    {
+        uint64_t size;
+        uint64_t allocations;
+        uint32_t traceIndex;
+    };
+
+    void allocate(uintptr_t ptr, uint64_t size, uint32_t traceIndex, uint64_t sampleInterval)
+    {
+        // weigh samples the same way AccumulatedTraceData does it for '+' records
+        LiveAllocation allocation = {size, 1, traceIndex};
+        if (sampleInterval && size) {
+            const auto weight = -1. / std::expm1(-static_cast<double>(size) / sampleInterval);
+            allocation.allocations = static_cast<uint64_t>(std::llround(weight));
+            allocation.size = static_cast<uint64_t>(std::llround(weight * size));
+        }
+
+        auto& counters = countersFor(traceIndex);
+        counters.allocations += allocation.allocations;
+        counters.allocated += allocation.size;
+
+        live += allocation.size;
+        peak = max(peak, live);
+
+        liveAllocations[ptr] = allocation;
+        lastPointer = ptr;
+    }
+
+    void free(uintptr_t ptr)
+    {
+        const bool temporary = lastPointer == ptr;
+        lastPointer = 0;
+
+        auto it = liveAllocations.find(ptr);
+        if (it == liveAllocations.end()) {
+            return;
+        }
+        const auto allocation = it->second;
+        liveAllocations.erase(it);
+
+        auto& counters = countersFor(allocation.traceIndex);
+        counters.deallocations += allocation.allocations;
+        counters.freed += allocation.size;
+        if (temporary) {
+            counters.temporary += allocation.allocations;
+        }
+        live -= allocation.size;
+    }
+
+    Counters& countersFor(uint32_t traceIndex)
+    {
+        if (traceIndex >= counters.size()) {
+            counters.resize(traceIndex + 1);
+        }
+        auto& ret = counters[traceIndex];
+        if (!ret.dirty) {
+            ret.dirty = true;
+            dirty.push_back(traceIndex);
+        }
+        return ret;
+    }
+
+    tsl::robin_map<uintptr_t, LiveAllocation> liveAllocations;
+    /// indexed by trace index
+    vector<Counters> counters;
+    /// trace indices whose counters changed since the last snapshot
+    vector<uint32_t> dirty;
+    uint64_t live = 0;
+    uint64_t peak = 0;
+    uint64_t lastWrittenPeak = 0;
+    uintptr_t lastPointer = 0;
+};
+
+/**
+ * Thread-Safe heaptrack API
+ *
+ * The only critical section in libheaptrack is the output of the data,
+ * dl_iterate_phdr calls, as well as initialization and shutdown.
+ *
+ * When HEAPTRACK_THREAD_BUFFERS is set, allocation events are pushed into
+ * per-thread buffers instead and the lock is only taken to index the trace.
+ * The timer thread then regularly drains the buffers into the output stream.
+ *
+ * When HEAPTRACK_ASYNC_FLUSH is set, the timer thread furthermore writes out
+ * the full output buffers, such that the lock is not held during the writes.
+ *
+ * When HEAPTRACK_MMAP_OUTPUT is set, the output file gets memory mapped and
+ * the full buffers are only copied into it, see MappedFileSink.
+ */
+class HeapTrack
+{
+public:
+    template <typename Op>
+    static bool op(const RecursionGuard& /*recursionGuard*/, const Op& op)
+    {
+        debugLog<VeryVerboseOutput>("%s", "acquiring lock");
+
+        auto locked = tryLock([]() { return s_forceCleanup.load(); });
+        if (!locked) {
+            return false;
+        }
+
+        debugLog<VeryVerboseOutput>("%s", "lock acquired");
+
+        HeapTrack heaptrack(locked);
+        op(heaptrack);
+
+        return true;
+    }
+
+    ~HeapTrack()
+    {
+        debugLog<VeryVerboseOutput>("%s", "releasing lock");
+
+        s_lock.unlock();
+    }
+
+    void initialize(const char* fileName, heaptrack_callback_t initBeforeCallback,
+                    heaptrack_callback_initialized_t initAfterCallback, heaptrack_callback_t stopCallback)
+    {
+        debugLog<MinimalOutput>("initializing: %s", fileName);
+        if (s_data) {
+            debugLog<MinimalOutput>("%s", "already initialized");
+            return;
+        }
+
+        if (initBeforeCallback) {
+            debugLog<MinimalOutput>("%s", "calling initBeforeCallback");
+            initBeforeCallback();
+            debugLog<MinimalOutput>("%s", "done calling initBeforeCallback");
+        }
+
+        // do some once-only initializations
+        static once_flag once;
+        call_once(once, [] {
+            debugLog<MinimalOutput>("%s", "doing once-only initialization");
+
+            Trace::setup();
+
+            const auto unwinderEnv = getenv("HEAPTRACK_UNWINDER");
+            if (unwinderEnv && !Trace::selectUnwinder(unwinderEnv)) {
+                fprintf(stderr, "WARNING: Unsupported unwinder \"%s\", using the default one instead.\n",
+                        unwinderEnv);
+            }
+
+            if (const auto depthEnv = getenv("HEAPTRACK_UNWIND_DEPTH")) {
+                Trace::setMaxDepth(atoi(depthEnv));
+            }
+
+            pthread_key_create(&s_threadBufferKey, &releaseThreadBuffer);
+            pthread_key_create(&s_unwindCacheKey, &releaseUnwindCache);
+
+            // forked child processes are only traced when HEAPTRACK_FOLLOW_FORK is set, see child_fork
+            const auto followForkEnv = getenv("HEAPTRACK_FOLLOW_FORK");
+            s_followFork = followForkEnv && strcmp(followForkEnv, "0") != 0;
+            pthread_atfork(&prepare_fork, &parent_fork, &child_fork);
+
+            atexit([]() {
+                // with HEAPTRACK_FAST_EXIT, heaptrack_exit may have finished the recording already
+                if (s_forceCleanup || s_atexit) {
+                    return;
+                }
+                debugLog<MinimalOutput>("%s", "atexit()");
+
+                if (s_fastExit) {
+                    // nobody is interested in the frees that follow
+                    heaptrack_exit();
+                    return;
+                }
+
+                // free internal libstdc++ resources
+                // see also Valgrind's `--run-cxx-freeres` option
+                if (&__gnu_cxx::__freeres) {
+                    __gnu_cxx::__freeres();
+                }
+
+                s_atexit.store(true);
+                heaptrack_stop();
+            });
+        });
+
+        const auto out = createFile(fileName);
+
+        if (out == -1) {
+            if (stopCallback) {
+                stopCallback();
+            }
+            return;
+        }
+
+        s_data = new LockedData(out, stopCallback);
+        s_data->outputFileName = fileName ? fileName : "";
+        s_data->outputIsFifo = isFifo(out);
+        startRecording();
+
+        const auto controlSocketEnv = getenv("HEAPTRACK_CONTROL_SOCKET");
+        if (controlSocketEnv && controlSocketEnv[0]) {
+            s_data->startControlThread(controlSocketEnv);
+        }
+
+        const auto crashFlushEnv = getenv("HEAPTRACK_CRASH_FLUSH");
+        if (crashFlushEnv && strcmp(crashFlushEnv, "0") != 0) {
+            installFatalSignalHandlers();
+        }
+
+        const auto fastExitEnv = getenv("HEAPTRACK_FAST_EXIT");
+        s_fastExit = fastExitEnv && strcmp(fastExitEnv, "0") != 0;
+
+        if (initAfterCallback) {
+            debugLog<MinimalOutput>("%s", "calling initAfterCallback");
+            initAfterCallback(s_data->out);
+            debugLog<MinimalOutput>("%s", "calling initAfterCallback done");
+        }
+
+        debugLog<MinimalOutput>("%s", "initialization done");
+    }
+
+    /**
+     * Write the header of a new output, shared between initialize and followFork.
+     */
+    void startRecording()
+    {
+        // before the thread buffers get enabled, which may only use the trace shards of this output
+        ++s_threadGeneration;
+        if (s_data->threadBuffers) {
+            // discard anything left over from a previous run
+            for (auto buffer = s_threadBuffers.load(); buffer; buffer = buffer->next) {
+                buffer->readIndex.store(buffer->writeIndex.load(memory_order_acquire), memory_order_release);
+            }
+            s_threadBuffersEnabled = true;
+        }
+        if (s_data->unwindCache) {
+            invalidateUnwindCache();
+        }
+        s_trackMappings = s_data->trackMappings;
+        s_trackThreads = s_data->trackThreads;
+        s_overhead.reset();
+        s_sizeClasses.reset();
+        s_countOnly = s_data->countOnly;
+        s_data->overheadStart = {clock::now(), OverheadCounters::cycles()};
+        s_data->triggered = false;
+
+        writeVersion();
+        if (s_data->shardedTraces) {
+            // the shards may have the same trace nodes, let heaptrack_interpret merge them
+            s_data->out.write("C\n");
+        }
+        writeExe();
+        writeProcessId();
+        writeCommandLine();
+        writeSystemInfo();
+        writeStartTime();
+        writeSuppressions();
+        writeSampleInterval();
+    }
+
+    /**
+     * Write the final records and close the output.
+     *
+     * With @p atExit, an 'E' record tells the analyzers that the process was exiting and the frees
+     * that follow don't get recorded, see heaptrack_exit.
+     */
+    void shutdown(bool atExit = false)
+    {
+        if (!s_data) {
             return;
         }
 
         debugLog<MinimalOutput>("%s", "shutdown()");
 
+        if (s_data->threadBuffers) {
+            s_threadBuffersEnabled = false;
+            drainThreadBuffers(true);
+        }
+        s_sampleInterval = 0;
+        s_unwindCacheGeneration = 0;
+        s_trackMappings = false;
+        s_trackThreads = false;
+        s_countOnly = false;
+        s_data->stopControlThread();
+
+        writeSnapshot();
         writeTimestamp();
         writeRSS();
+        writeOverhead();
+        writeSizeClasses();
+        if (atExit) {
+            s_data->out.write("E\n");
+        }
+
+        s_data->out.flush();
+        s_data->out.close();
+
+        // NOTE: we leak heaptrack data on exit, intentionally
+        // This way, we can be sure to get all static deallocations.
+        if (!s_atexit || s_forceCleanup) {
+            delete s_data;
+            s_data = nullptr;
+        }
+
+        debugLog<MinimalOutput>("%s", "shutdown() done");
+    }
+
+    /**
+     * Let heaptrack_interpret know about a forked child process that writes to its own pipe.
+     */
+    void announceChild(pid_t pid)
+    {
+        if (!s_followFork || !s_data || !s_data->outputIsFifo || !s_data->out.canWrite()) {
+            return;
+        }
+        const auto fileName = childOutputFileName(s_data->outputFileName, pid);
+        if (fileName.empty()) {
+            return;
+        }
+        // flush right away, the child waits for the interpreter to open its pipe
+        s_data->out.write("F %x %x %s\n", pid, fileName.size(), fileName.c_str());
+        s_data->out.flush();
+    }
+
+    void invalidateModuleCache()
+    {
+        if (!s_data) {
+            return;
+        }
+        s_data->moduleCacheDirty = true;
+        if (s_data->unwindCache) {
+            invalidateUnwindCache();
+        }
+    }
+
+    /**
+     * Invalidate all entries in the thread-local unwind caches.
+     */
+    static void invalidateUnwindCache()
+    {
+        // only ever called with the lock held
+        static uint32_t generation = 0;
+        if (!++generation) {
+            ++generation;
+        }
+        s_unwindCacheGeneration.store(generation, memory_order_release);
+    }
+
+    /**
+     * Write the changes of the per-trace counters since the last snapshot.
+     *
+     * Only used when HEAPTRACK_AGGREGATE is set, in which case we do not write
+     * individual allocation events.
+     */
+    void writeSnapshot()
+    {
+        if (!s_data || !s_data->aggregate || !s_data->out.canWrite()) {
+            return;
+        }
+
+        auto& aggregation = s_data->aggregation;
+        debugLog<VeryVerboseOutput>("writeSnapshot(%zu)", aggregation.dirty.size());
+
+        for (auto traceIndex : aggregation.dirty) {
+            auto& counters = aggregation.counters[traceIndex];
+            s_data->out.writeHexLine('d', traceIndex, counters.allocations, counters.deallocations, counters.temporary,
+                                     counters.allocated, counters.freed);
+            counters = {};
+        }
+        aggregation.dirty.clear();
+
+        if (aggregation.peak != aggregation.lastWrittenPeak) {
+            s_data->out.writeHexLine('D', aggregation.peak);
+            aggregation.lastWrittenPeak = aggregation.peak;
+        }
+    }
+
+    void writeTimestamp()
+    {
+        if (!s_data || !s_data->out.canWrite()) {
+            return;
+        }
+
+        auto elapsed = elapsedTime();
+
+        debugLog<VeryVerboseOutput>("writeTimestamp(%" PRIx64 ")", elapsed.count());
+
+        // don't move an allocation event past the time stamp, also ensures it gets written before we shut down
+        writePendingAllocation();
+
+        s_data->out.writeHexLine('c', static_cast<size_t>(elapsed.count()));
+    }
+
+    void writeRSS()
+    {
+        if (!s_data || !s_data->out.canWrite()) {
+            return;
+        }
+        writeRSS(s_data->readRSS());
+    }
+
+    /// @p rss in pages as returned by LockedData::readRSS, nothing gets written when it is unknown
+    void writeRSS(size_t rss)
+    {
+        if (!s_data || !s_data->out.canWrite() || !rss) {
+            return;
+        }
+
+        // TODO: compare to rusage.ru_maxrss (getrusage) to find "real" peak?
+        // TODO: use custom allocators with known page sizes to prevent tainting
+        //       the RSS numbers with heaptrack-internal data
+
+        s_data->out.writeHexLine('R', rss);
+        s_data->rss = rss;
+    }
+
+    /**
+     * @return the memory that is currently allocated on the heap of glibc, zero when unknown
+     *
+     * This takes the locks of the malloc arenas, so don't call it with our lock held.
+     */
+    static uint64_t mallocHeapSize()
+    {
+#ifdef __GLIBC__
+#if __GLIBC_PREREQ(2, 33)
+        const auto info = mallinfo2();
+        return info.uordblks + info.hblkhd;
+#else
+        const auto info = mallinfo();
+        return static_cast<unsigned>(info.uordblks) + static_cast<unsigned>(info.hblkhd);
+#endif
+#else
+        return 0;
+#endif
+    }
+
+    /**
+     * Record all allocations while the RSS or the heap size exceed the thresholds of
+     * HEAPTRACK_TRIGGER_RSS and HEAPTRACK_TRIGGER_HEAP, see LockedData::triggerRss.
+     *
+     * When crossing a threshold, sampling gets disabled and the snapshot gets flushed right away.
+     * The previous sampling interval gets restored once we are below 90% of the thresholds again,
+     * which keeps us from flipping back and forth around a threshold.
+     *
+     * @p mallocHeap is the result of mallocHeapSize, it's only used when not aggregating.
+     */
+    void checkWatermarks(uint64_t mallocHeap)
+    {
+        if (!s_data || !s_data->out.canWrite() || (!s_data->triggerRss && !s_data->triggerHeap)) {
+            return;
+        }
+
+        const auto rss = s_data->rss * s_data->pageSize;
+        const auto heap = s_data->aggregate ? s_data->aggregation.live : mallocHeap;
+        auto exceeds = [](uint64_t value, uint64_t threshold) { return threshold && value >= threshold; };
+        auto fallsBelow = [](uint64_t value, uint64_t threshold) { return !threshold || value < threshold / 10 * 9; };
+
+        if (!s_data->triggered) {
+            if (!exceeds(rss, s_data->triggerRss) && !exceeds(heap, s_data->triggerHeap)) {
+                return;
+            }
+            debugLog<MinimalOutput>("watermark exceeded: rss %" PRIu64 ", heap %" PRIu64, rss, heap);
+            s_data->triggered = true;
+            s_data->untriggeredSampleInterval = s_sampleInterval.load();
+            setSampleInterval(0, true);
+            writeSnapshot();
+            s_data->out.flush();
+        } else if (fallsBelow(rss, s_data->triggerRss) && fallsBelow(heap, s_data->triggerHeap)) {
+            debugLog<MinimalOutput>("watermark no longer exceeded: rss %" PRIu64 ", heap %" PRIu64, rss, heap);
+            s_data->triggered = false;
+            setSampleInterval(s_data->untriggeredSampleInterval, true);
+        }
+    }
+
+    /**
+     * Write the overhead of heaptrack so far, see OverheadCounters and LineWriter::WriteStats.
+     */
+    void writeOverhead()
+    {
+        if (!s_data || !s_data->out.canWrite()) {
+            return;
+        }
+
+        // convert the cycles to nanoseconds by relating them to the time that passed since we started
+        const auto elapsedNs =
+            chrono::duration_cast<chrono::nanoseconds>(clock::now() - s_data->overheadStart.time).count();
+        const auto elapsedCycles = OverheadCounters::cycles() - s_data->overheadStart.cycles;
+        const auto nsPerCycle = elapsedCycles ? static_cast<double>(elapsedNs) / elapsedCycles : 1.;
+        auto toNs = [nsPerCycle](uint64_t cycles) { return static_cast<uint64_t>(cycles * nsPerCycle); };
+
+        const auto& writeStats = s_data->out.writeStats();
+        s_data->out.writeHexLine('O', s_overhead.sum(OverheadCounters::Events),
+                                 toNs(s_overhead.sum(OverheadCounters::UnwindCycles)),
+                                 s_overhead.sum(OverheadCounters::LockSpins),
+                                 toNs(s_overhead.sum(OverheadCounters::LockWaitCycles)),
+                                 writeStats.flushes.load(memory_order_relaxed),
+                                 writeStats.bytes.load(memory_order_relaxed),
+                                 writeStats.blockedNs.load(memory_order_relaxed));
+    }
+
+    /**
+     * Write the totals of the size classes so far, see HEAPTRACK_COUNT_ONLY.
+     *
+     * Only the size classes that got used are written, as triplets of the size class,
+     * its number of allocations and their size in bytes.
+     */
+    void writeSizeClasses()
+    {
+        if (!s_data || !s_data->countOnly || !s_data->out.canWrite()) {
+            return;
+        }
+
+        s_data->out.write("Z %" PRIx64, s_sizeClasses.frees());
+        for (unsigned i = 0; i < SizeClassCounters::NUM_CLASSES; ++i) {
+            if (const auto allocations = s_sizeClasses.allocations(i)) {
+                s_data->out.write(" %x %" PRIx64 " %" PRIx64, i, allocations, s_sizeClasses.bytes(i));
+            }
+        }
+        s_data->out.write("\n");
+    }
+
+    void writeVersion()
+    {
+        // the text format is still available as a fallback, e.g. for debugging purposes
+        const auto fileVersion =
+            s_data->binaryRecords ? HEAPTRACK_FILE_FORMAT_VERSION : (HEAPTRACK_BINARY_FILE_FORMAT_VERSION - 1);
+        s_data->out.writeHexLine('v', static_cast<size_t>(HEAPTRACK_VERSION), static_cast<size_t>(fileVersion));
+    }
+
+    /// lets heaptrack_interpret find the perf map files of JIT compilers
+    void writeProcessId()
+    {
+        s_data->out.writeHexLine('p', static_cast<size_t>(getpid()));
+    }
+
+    void writeExe()
+    {
+        const int BUF_SIZE = 1023;
+        char buf[BUF_SIZE + 1];
+
+#ifdef __linux__
+        ssize_t size = readlink("/proc/self/exe", buf, BUF_SIZE);
+#elif defined(__FreeBSD__)
+        int mib[4] = {CTL_KERN, KERN_PROC, KERN_PROC_PATHNAME, -1};
+        size_t size = BUF_SIZE;
+        sysctl(mib, 4, buf, &size, NULL, 0);
+#endif
+
+        if (size > 0 && size < BUF_SIZE) {
+            buf[size] = 0;
+            s_data->out.write("x %x %s\n", size, buf);
+        }
+    }
+
+    void writeCommandLine()
+    {
+        s_data->out.write("X");
+        const int BUF_SIZE = 4096;
+        char buf[BUF_SIZE + 1] = {0};
+
+#ifdef __linux__
+        auto fd = open("/proc/self/cmdline", O_RDONLY);
+        int bytesRead = read(fd, buf, BUF_SIZE);
+        close(fd);
+#elif defined(__FreeBSD__)
+        int mib[4] = {CTL_KERN, KERN_PROC, KERN_PROC_ARGS, getpid()};
+        size_t bytesRead = BUF_SIZE;
+        sysctl(mib, 4, buf, &bytesRead, NULL, 0);
+#endif
+
+        char* end = buf + bytesRead;
+        for (char* p = buf; p < end;) {
+            s_data->out.write(" %s", p);
+            while (*p++)
+                ; // skip until start of next 0-terminated section
+        }
+
+        s_data->out.write("\n");
+    }
+
+    void writeSystemInfo()
+    {
+        s_data->out.writeHexLine('I', static_cast<size_t>(sysconf(_SC_PAGESIZE)),
+                                 static_cast<size_t>(sysconf(_SC_PHYS_PAGES)));
+    }
+
+    /// lets the analyzers line up our time stamps with other traces, e.g. the ones of Perfetto
+    void writeStartTime()
+    {
+#ifdef CLOCK_BOOTTIME
+        timespec now;
+        if (clock_gettime(CLOCK_BOOTTIME, &now) != 0) {
+            return;
+        }
+        const auto sinceStart = chrono::duration_cast<chrono::nanoseconds>(clock::now() - startTime());
+        const auto start = chrono::seconds(now.tv_sec) + chrono::nanoseconds(now.tv_nsec) - sinceStart;
+        s_data->out.writeHexLine('N', static_cast<uint64_t>(start.count()));
+#endif
+    }
+
+    void writeSampleInterval()
+    {
+        const auto sampleIntervalEnv = getenv("HEAPTRACK_SAMPLE_INTERVAL");
+        const auto sampleInterval = sampleIntervalEnv ? strtoull(sampleIntervalEnv, nullptr, 10) : 0;
+        if (!sampleInterval) {
+            return;
+        }
+        setSampleInterval(sampleInterval, false);
+    }
+
+    /**
+     * Change the sampling interval, zero disables sampling.
+     *
+     * @p recordedBefore has to be set when allocations got recorded already, their frees
+     * then have to be recorded when sampling gets enabled.
+     */
+    void setSampleInterval(uint64_t sampleInterval, bool recordedBefore)
+    {
+        const auto previousInterval = s_sampleInterval.load();
+        if (!s_data || !s_data->out.canWrite() || sampleInterval == previousInterval) {
+            return;
+        }
+
+        debugLog<MinimalOutput>("sampling allocations every %" PRIu64 " bytes", sampleInterval);
+        if (!previousInterval) {
+            s_sampledPointers.clear(recordedBefore);
+        }
+        s_sampleInterval = sampleInterval;
+        s_data->out.writeHexLine('P', static_cast<size_t>(sampleInterval));
+    }
+
+    void writeSuppressions()
+    {
+        if (!__lsan_default_suppressions)
+            return;
+
+        const char* suppressions = __lsan_default_suppressions();
+        if (!suppressions)
+            return;
+
+        std::istringstream stream(suppressions);
+        std::string line;
+        while (std::getline(stream, line)) {
+            // not write(line), that one would prefix the pattern with its size
+            s_data->out.write("S %s\n", line.c_str());
+        }
+    }
+
+    bool handleMalloc(void* ptr, size_t size, const Trace& trace, uint32_t* index)
+    {
+        if (!indexTrace(trace, index)) {
+            return false;
+        }
+
+        writeMalloc(ptr, size, *index);
+        return true;
+    }
+
+    void handleMalloc(void* ptr, size_t size, uint32_t index)
+    {
+        if (!s_data || !s_data->out.canWrite()) {
+            return;
+        }
+
+        writeMalloc(ptr, size, index);
+    }
+
+    /// record that @p ptrIn got reallocated to @p ptrOut, in a single event unless that conflicts with the output mode
+    bool handleRealloc(void* ptrIn, void* ptrOut, size_t size, const Trace& trace, uint32_t* index)
+    {
+        if (!indexTrace(trace, index)) {
+            return false;
+        }
+
+#ifdef DEBUG_MALLOC_PTRS
+        auto it = s_data->known.find(ptrIn);
+        assert(it != s_data->known.end());
+        s_data->known.erase(it);
+        assert(s_data->known.find(ptrOut) == s_data->known.end());
+        s_data->known.insert(ptrOut);
+#endif
+
+        if (s_data->recordUsableSizes) {
+            writeUsableSize(ptrOut, size);
+        }
+        writeReallocation(reinterpret_cast<uintptr_t>(ptrIn), size, *index, reinterpret_cast<uintptr_t>(ptrOut),
+                          threadIndex());
+        return true;
+    }
+
+    void writeMalloc(void* ptr, size_t size, uint32_t index)
+    {
+#ifdef DEBUG_MALLOC_PTRS
+        auto it = s_data->known.find(ptr);
+        assert(it == s_data->known.end());
+        s_data->known.insert(ptr);
+#endif
+
+        if (s_data->recordUsableSizes) {
+            writeUsableSize(ptr, size);
+        }
+        writeAllocation(size, index, reinterpret_cast<uintptr_t>(ptr), threadIndex());
+    }
+
+    /**
+     * Record how many bytes the allocator reserved for @p ptr, the first time @p size bytes got requested.
+     *
+     * Allocators round up the same requested size in the same way every time, so one 'U' record per size
+     * suffices. Nothing gets written when there is no slack. The events of the thread buffers are not
+     * covered, as their pointers may be freed already when they get written.
+     */
+    static void writeUsableSize(void* ptr, size_t size)
+    {
+#ifdef __GLIBC__
+        if (!ptr) {
+            return;
+        }
+        auto& usableSizes = s_data->usableSizes;
+        if (usableSizes.find(size) != usableSizes.end()) {
+            return;
+        }
+        // this resolves to the allocator in use, e.g. jemalloc or tcmalloc when they replace the one of glibc
+        const auto usableSize = malloc_usable_size(ptr);
+        usableSizes.insert({size, usableSize});
+        if (usableSize > size) {
+            s_data->out.writeHexLine('U', size, usableSize);
+        }
+#else
+        (void)ptr;
+        (void)size;
+#endif
+    }
+
+    /**
+     * @return the compact index of the calling thread, starting at one, or zero when
+     *         HEAPTRACK_TRACK_THREADS is not set
+     *
+     * New threads get announced with their id and name on first use.
+     */
+    uint32_t threadIndex()
+    {
+        if (!s_data || !s_data->trackThreads) {
+            return 0;
+        }
+        const auto generation = s_threadGeneration.load(memory_order_relaxed);
+        if (t_threadGeneration == generation) {
+            return t_threadIndex;
+        }
+        if (!s_data->out.canWrite()) {
+            return 0;
+        }
+
+        char name[64] = {0};
+#ifdef __linux__
+        pthread_getname_np(pthread_self(), name, sizeof(name));
+#endif
+        s_data->out.write("H %x %zx %s\n", gettid(), strlen(name), name);
+        t_threadIndex = ++s_data->numThreads;
+        t_threadGeneration = generation;
+        return t_threadIndex;
+    }
+
+    /**
+     * Write a new mapping of anonymous memory. When @p oldPtr is set, the mapping
+     * got moved or resized from there by mremap.
+     */
+    void handleMapping(void* ptr, size_t length, const Trace& trace, void* oldPtr, size_t oldLength)
+    {
+        uint32_t index = 0;
+        if (!indexTrace(trace, &index)) {
+            return;
+        }
+        if (oldPtr) {
+            s_data->out.writeHexLine('k', reinterpret_cast<uintptr_t>(ptr), length, index,
+                                     reinterpret_cast<uintptr_t>(oldPtr), oldLength);
+        } else {
+            s_data->out.writeHexLine('k', reinterpret_cast<uintptr_t>(ptr), length, index);
+        }
+    }
+
+    void handleUnmapping(void* ptr, size_t length)
+    {
+        if (!s_data || !s_data->out.canWrite()) {
+            return;
+        }
+        s_data->out.writeHexLine('K', reinterpret_cast<uintptr_t>(ptr), length);
+    }
+
+    void handleFree(void* ptr)
+    {
+        if (!s_data || !s_data->out.canWrite()) {
+            return;
+        }
+
+#ifdef DEBUG_MALLOC_PTRS
+        auto it = s_data->known.find(ptr);
+        assert(it != s_data->known.end());
+        s_data->known.erase(it);
+#endif
+
+        writeFree(reinterpret_cast<uintptr_t>(ptr), threadIndex());
+    }
+
+    /**
+     * Record an allocation out of @p pool, which keeps it apart from the allocations of malloc
+     * and frees it implicitly once the pool gets destroyed, see handlePoolDestroy.
+     *
+     * With HEAPTRACK_AGGREGATE, the pool is ignored and this is a plain allocation.
+     */
+    void handlePoolMalloc(void* pool, void* ptr, size_t size, const Trace& trace)
+    {
+        uint32_t index = 0;
+        if (!indexTrace(trace, &index)) {
+            return;
+        }
+        if (s_data->aggregate) {
+            writeMalloc(ptr, size, index);
+            return;
+        }
+        const auto thread = threadIndex();
+        if (!writePendingAllocation() || !writeThreadSwitch(thread)) {
+            return;
+        }
+        s_data->out.writeHexLine('y', poolIndex(pool), size, index, reinterpret_cast<uintptr_t>(ptr));
+    }
+
+    void handlePoolFree(void* pool, void* ptr)
+    {
+        if (!s_data || !s_data->out.canWrite()) {
+            return;
+        }
+        if (s_data->aggregate) {
+            writeFree(reinterpret_cast<uintptr_t>(ptr), 0);
+            return;
+        }
+        const auto it = s_data->pools.find(pool);
+        if (it == s_data->pools.end() || !writePendingAllocation() || !writeThreadSwitch(threadIndex())) {
+            return;
+        }
+        s_data->out.writeHexLine('Y', it->second, reinterpret_cast<uintptr_t>(ptr));
+    }
+
+    /**
+     * Free all allocations of @p pool with a single record, the interpreter knows which ones are still alive.
+     *
+     * With HEAPTRACK_AGGREGATE, they are not known and thus stay leaked. When sampling, the sampled
+     * pointers of the pool stay in s_sampledPointers, their next allocation reuses the entry.
+     */
+    void handlePoolDestroy(void* pool)
+    {
+        if (!s_data || !s_data->out.canWrite() || s_data->aggregate) {
+            return;
+        }
+        const auto it = s_data->pools.find(pool);
+        if (it == s_data->pools.end() || !writePendingAllocation()) {
+            return;
+        }
+        s_data->out.writeHexLine('z', it->second);
+    }
+
+    /**
+     * @return the compact index of @p pool, starting at one
+     *
+     * New pools get announced with their handle on first use.
+     */
+    uint32_t poolIndex(void* pool)
+    {
+        auto& pools = s_data->pools;
+        const auto it = pools.find(pool);
+        if (it != pools.end()) {
+            return it->second;
+        }
+        const auto index = static_cast<uint32_t>(pools.size() + 1);
+        s_data->out.writeHexLine('Q', reinterpret_cast<uintptr_t>(pool));
+        pools.insert({pool, index});
+        return index;
+    }
+
+    /**
+     * Start over with an empty trace tree once it outgrew HEAPTRACK_TRACE_TREE_LIMIT.
+     *
+     * The trace indices restart after the 'C' record, heaptrack_interpret maps the new ones onto the
+     * indices it wrote already. The held back allocation still has an old trace index, so it gets written
+     * out before. With HEAPTRACK_THREAD_BUFFERS, the traces are sharded instead, see traceShard.
+     */
+    bool clearTraceTree()
+    {
+        debugLog<MinimalOutput>("clearing the trace tree, which grew to %zu bytes", s_data->traceTree.memoryUsage());
+        if (!writePendingAllocation()) {
+            return false;
+        }
+        if (!s_data->out.write("C\n")) {
+            return false;
+        }
+        s_data->traceTree.clear();
+        if (s_data->unwindCache) {
+            invalidateUnwindCache();
+        }
+        return true;
+    }
+
+    /**
+     * Index @p trace and write out any new trace nodes.
+     *
+     * @return false when no data can be written at the moment.
+     */
+    bool indexTrace(const Trace& trace, uint32_t* index)
+    {
+        if (!s_data || !s_data->out.canWrite()) {
+            return false;
+        }
+        auto writeNode = [this](uintptr_t ip, uint32_t parentIndex) {
+            // only new instruction pointers need to know their module, so a burst of dlopen calls
+            // costs a single module update when the next unknown instruction pointer shows up
+            updateModuleCache();
+
+            // decrement addresses by one - otherwise we misattribute the cost to the wrong instruction
+            // for some reason, it seems like we always get the instruction _after_ the one we are interested in
+            // see also: https://github.com/libunwind/libunwind/issues/287
+            // and https://bugs.kde.org/show_bug.cgi?id=439897
+            --ip;
+
+            return writeTraceNode(ip, parentIndex);
+        };
+
+        if (s_data->shardedTraces) {
+            // the trace nodes get consecutive indices in the order they are written, whichever shard they belong to
+            *index = traceShard()->index(trace, [&writeNode](uintptr_t ip, uint32_t parentIndex) -> uint32_t {
+                return writeNode(ip, parentIndex) ? ++s_data->numTraceNodes : 0;
+            });
+            return true;
+        }
+
+        if (s_data->traceTreeLimit && s_data->traceTree.memoryUsage() > s_data->traceTreeLimit && !clearTraceTree()) {
+            return false;
+        }
+        *index = s_data->traceTree.index(trace, writeNode);
+        return true;
+    }
+
+    /**
+     * The trace shard of the current thread, see HEAPTRACK_THREAD_BUFFERS.
+     *
+     * Once it outgrew HEAPTRACK_TRACE_TREE_LIMIT, the shard simply starts over. Unlike clearing the
+     * shared trace tree, that doesn't need a 'C' record, the indices it handed out stay valid.
+     */
+    TraceShard* traceShard()
+    {
+        auto buffer = threadBuffer();
+        auto shard = buffer ? &buffer->traces : &s_data->sharedTraces;
+        const auto generation = s_threadGeneration.load(memory_order_relaxed);
+        if ((buffer && buffer->tracesGeneration != generation)
+            || (s_data->traceTreeLimit && shard->memoryUsage() > s_data->traceTreeLimit)) {
+            shard->clear();
+        }
+        if (buffer) {
+            buffer->tracesGeneration = generation;
+        }
+        return shard;
+    }
+
+    /**
+     * Find @p trace in the trace shard of the current thread without taking the lock.
+     *
+     * @return false when parts of the trace or the index of the current thread are not known yet
+     */
+    static bool findTrace(const Trace& trace, uint32_t* index, uint32_t* thread)
+    {
+        const auto generation = s_threadGeneration.load(memory_order_acquire);
+        auto buffer = t_threadBuffer;
+        if (!buffer || buffer->tracesGeneration != generation) {
+            return false;
+        }
+        *thread = 0;
+        if (s_trackThreads.load(memory_order_relaxed)) {
+            if (t_threadGeneration != generation) {
+                return false;
+            }
+            *thread = t_threadIndex;
+        }
+        *index = buffer->traces.find(trace);
+        return *index != 0;
+    }
+
+    /**
+     * Locked fallback for events that could not be pushed into a thread buffer.
+     */
+    void handleThreadEvent(ThreadEvent event)
+    {
+        if (!s_data || !s_data->threadBuffers) {
+            return;
+        }
+        event.sequence = s_eventSequence.fetch_add(1);
+        s_data->pendingEvents.push_back(event);
+    }
+
+    /**
+     * Write out all buffered events in the order of their sequence numbers.
+     *
+     * Events that may have been preceded by an event which is still being pushed
+     * by another thread are kept back, unless @p flushAll is set.
+     */
+    void drainThreadBuffers(bool flushAll = false)
+    {
+        if (!s_data || !s_data->threadBuffers) {
+            return;
+        }
+
+        auto limit = s_eventSequence.load();
+        if (!flushAll) {
+            for (auto buffer = s_threadBuffers.load(); buffer; buffer = buffer->next) {
+                limit = min(limit, buffer->inFlight.load());
+            }
+        }
+
+        auto& pending = s_data->pendingEvents;
+        for (auto buffer = s_threadBuffers.load(); buffer; buffer = buffer->next) {
+            auto readIndex = buffer->readIndex.load(memory_order_relaxed);
+            const auto writeIndex = buffer->writeIndex.load(memory_order_acquire);
+            for (; readIndex != writeIndex; ++readIndex) {
+                const auto& event = buffer->events[readIndex % ThreadBuffer::CAPACITY];
+                if (event.sequence >= limit) {
+                    break;
+                }
+                pending.push_back(event);
+            }
+            buffer->readIndex.store(readIndex, memory_order_release);
+        }
+
+        if (pending.empty()) {
+            return;
+        }
+
+        sort(pending.begin(), pending.end(),
+             [](const ThreadEvent& lhs, const ThreadEvent& rhs) { return lhs.sequence < rhs.sequence; });
+
+        auto it = pending.begin();
+        for (; it != pending.end() && it->sequence < limit; ++it) {
+            if (!s_data->out.canWrite()) {
+                continue;
+            }
+            if (it->type == '+') {
+                writeAllocation(it->size, it->traceIndex, it->ptr, it->threadIndex);
+            } else {
+                writeFree(it->ptr, it->threadIndex);
+            }
+        }
+        pending.erase(pending.begin(), it);
+    }
+
+    static bool hasThreadBuffers()
+    {
+        return s_threadBuffersEnabled.load(memory_order_relaxed);
+    }
+
+    /**
+     * Record a malloc, either directly or via the thread buffers.
+     */
+    static void recordMalloc(const RecursionGuard& guard, void* ptr, size_t size, const Trace& trace,
+                             UnwindCacheLookup* cacheLookup = nullptr)
+    {
+        uint32_t index = 0;
+        bool indexed = false;
+        if (!hasThreadBuffers()) {
+            op(guard, [&](HeapTrack& heaptrack) { indexed = heaptrack.handleMalloc(ptr, size, trace, &index); });
+        } else {
+            uint32_t thread = 0;
+            indexed = findTrace(trace, &index, &thread);
+            if (!indexed) {
+                op(guard, [&](HeapTrack& heaptrack) {
+                    indexed = heaptrack.indexTrace(trace, &index);
+                    thread = heaptrack.threadIndex();
+                });
+            }
+            if (indexed) {
+                recordThreadEvent(guard, {0, reinterpret_cast<uintptr_t>(ptr), size, index, thread, '+'});
+            }
+        }
+        if (indexed && cacheLookup) {
+            cacheLookup->store(index);
+        }
+    }
+
+    /**
+     * Record a malloc for the trace index found in the unwind cache.
+     *
+     * @return false when the cached trace index got invalidated in the meantime,
+     * the caller then has to unwind and call the other overload.
+     */
+    static bool recordMalloc(const RecursionGuard& guard, void* ptr, size_t size,
+                             const UnwindCacheLookup& cacheLookup)
+    {
+        const auto index = cacheLookup.traceIndex();
+        if (hasThreadBuffers()) {
+            if (s_unwindCacheGeneration.load(memory_order_acquire) != cacheLookup.generation()) {
+                return false;
+            }
+            uint32_t thread = 0;
+            if (s_trackThreads.load(memory_order_relaxed)) {
+                if (t_threadGeneration != s_threadGeneration.load(memory_order_relaxed)) {
+                    // the new thread gets announced via the locked path
+                    return false;
+                }
+                thread = t_threadIndex;
+            }
+            recordThreadEvent(guard, {0, reinterpret_cast<uintptr_t>(ptr), size, index, thread, '+'});
+            return true;
+        }
+
+        bool valid = true;
+        op(guard, [&](HeapTrack& heaptrack) {
+            valid = s_unwindCacheGeneration.load(memory_order_relaxed) == cacheLookup.generation();
+            if (valid) {
+                heaptrack.handleMalloc(ptr, size, index);
+            }
+        });
+        return valid;
+    }
+
+    /**
+     * Record the allocations of a batch that share @p trace, taking the lock only once.
+     */
+    static void recordMallocBatch(const RecursionGuard& guard, const heaptrack_allocation_t* allocations,
+                                  size_t count, const Trace& trace)
+    {
+        auto isRecorded = [](const heaptrack_allocation_t& allocation) {
+            return allocation.ptr && sampleAllocation(allocation.ptr, allocation.size);
+        };
+
+        if (!hasThreadBuffers()) {
+            op(guard, [&](HeapTrack& heaptrack) {
+                uint32_t index = 0;
+                if (!heaptrack.indexTrace(trace, &index)) {
+                    return;
+                }
+                for (size_t i = 0; i < count; ++i) {
+                    if (isRecorded(allocations[i])) {
+                        heaptrack.writeMalloc(allocations[i].ptr, allocations[i].size, index);
+                    }
+                }
+            });
+            return;
+        }
+
+        uint32_t index = 0;
+        uint32_t thread = 0;
+        bool indexed = findTrace(trace, &index, &thread);
+        if (!indexed) {
+            op(guard, [&](HeapTrack& heaptrack) {
+                indexed = heaptrack.indexTrace(trace, &index);
+                thread = heaptrack.threadIndex();
+            });
+        }
+        if (!indexed) {
+            return;
+        }
+        // the events must go through the thread buffer too, to stay in order with the other events
+        for (size_t i = 0; i < count; ++i) {
+            const auto& allocation = allocations[i];
+            if (isRecorded(allocation)) {
+                const auto ptr = reinterpret_cast<uintptr_t>(allocation.ptr);
+                recordThreadEvent(guard, {0, ptr, allocation.size, index, thread, '+'});
+            }
+        }
+    }
+
+    /**
+     * Record the frees of a batch, taking the lock only once.
+     */
+    static void recordFreeBatch(const RecursionGuard& guard, void* const* ptrs, size_t count)
+    {
+        auto isRecorded = [](void* ptr) { return ptr && takeSampledPointer(ptr); };
+
+        if (!hasThreadBuffers()) {
+            op(guard, [&](HeapTrack& heaptrack) {
+                for (size_t i = 0; i < count; ++i) {
+                    if (isRecorded(ptrs[i])) {
+                        heaptrack.handleFree(ptrs[i]);
+                    }
+                }
+            });
+            return;
+        }
+
+        const auto thread = bufferedThreadIndex(guard);
+        for (size_t i = 0; i < count; ++i) {
+            if (isRecorded(ptrs[i])) {
+                recordThreadEvent(guard, {0, reinterpret_cast<uintptr_t>(ptrs[i]), 0, 0, thread, '-'});
+            }
+        }
+    }
+
+    /**
+     * Record a free, either directly or via the thread buffers.
+     */
+    static void recordFree(const RecursionGuard& guard, void* ptr)
+    {
+        if (!hasThreadBuffers()) {
+            op(guard, [&](HeapTrack& heaptrack) { heaptrack.handleFree(ptr); });
+            return;
+        }
+
+        recordThreadEvent(guard, {0, reinterpret_cast<uintptr_t>(ptr), 0, 0, bufferedThreadIndex(guard), '-'});
+    }
+
+    /**
+     * The thread index for an event that goes through the thread buffers, see threadIndex.
+     *
+     * Only the first event of a thread takes the lock, which announces the new thread.
+     */
+    static uint32_t bufferedThreadIndex(const RecursionGuard& guard)
+    {
+        if (!s_trackThreads.load(memory_order_relaxed)) {
+            return 0;
+        }
+        if (t_threadGeneration == s_threadGeneration.load(memory_order_relaxed)) {
+            return t_threadIndex;
+        }
+        uint32_t thread = 0;
+        op(guard, [&](HeapTrack& heaptrack) { thread = heaptrack.threadIndex(); });
+        return thread;
+    }
+
+    static bool isPaused()
+    {
+        return s_paused;
+    }
+
+    static bool tracksMappings()
+    {
+        return s_trackMappings.load(memory_order_relaxed);
+    }
 
-        s_data->out.flush();
-        s_data->out.close();
+    /// true with HEAPTRACK_COUNT_ONLY, then allocations only get counted per size class, see SizeClassCounters
+    static bool countsOnly()
+    {
+        return s_countOnly.load(memory_order_relaxed);
+    }
 
-        // NOTE: we leak heaptrack data on exit, intentionally
-        // This way, we can be sure to get all static deallocations.
-        if (!s_atexit || s_forceCleanup) {
-            delete s_data;
-            s_data = nullptr;
+    /**
+     * Decide whether the allocation of @p size bytes at @p ptr should be recorded.
+     *
+     * Without HEAPTRACK_SAMPLE_INTERVAL, all allocations get recorded.
+     */
+    static bool sampleAllocation(void* ptr, size_t size)
+    {
+        const auto sampleInterval = s_sampleInterval.load(memory_order_relaxed);
+        if (!sampleInterval) {
+            return true;
         }
-
-        debugLog<MinimalOutput>("%s", "shutdown() done");
+        if (!t_sampleRandomState) {
+            t_bytesUntilSample = nextSampleDistance(sampleInterval);
+        }
+        t_bytesUntilSample -= size;
+        if (t_bytesUntilSample > 0) {
+            return false;
+        }
+        t_bytesUntilSample = nextSampleDistance(sampleInterval);
+        s_sampledPointers.insert(reinterpret_cast<uintptr_t>(ptr));
+        return true;
     }
 
-    void invalidateModuleCache()
+    /**
+     * @return true when the free of @p ptr should be recorded.
+     */
+    static bool takeSampledPointer(void* ptr)
     {
-        if (!s_data) {
-            return;
+        if (!s_sampleInterval.load(memory_order_relaxed)) {
+            return true;
         }
-        s_data->moduleCacheDirty = true;
+        return s_sampledPointers.take(reinterpret_cast<uintptr_t>(ptr));
     }
 
-    void writeTimestamp()
+    static void setPaused(bool state)
     {
-        if (!s_data || !s_data->out.canWrite()) {
+        // serialize the state changes, to keep the callbacks in the same order as the states
+        lock_guard<mutex> guard(s_pauseLock);
+        if (s_paused.exchange(state) == state) {
             return;
         }
+        if (auto callback = s_pauseCallback.load()) {
+            callback(state);
+        }
+    }
 
-        auto elapsed = elapsedTime();
+    static void setPauseCallback(heaptrack_pause_callback_t callback)
+    {
+        s_pauseCallback = callback;
+    }
 
-        debugLog<VeryVerboseOutput>("writeTimestamp(%" PRIx64 ")", elapsed.count());
+private:
+    struct LockedData;
 
-        s_data->out.writeHexLine('c', static_cast<size_t>(elapsed.count()));
-    }
+    /// the signals that usually terminate a crashing process, see handleFatalSignal
+    static constexpr const int FATAL_SIGNALS[] = {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT};
+    static constexpr const size_t NUM_FATAL_SIGNALS = sizeof(FATAL_SIGNALS) / sizeof(FATAL_SIGNALS[0]);
 
-    void writeRSS()
+    /**
+     * Install handleFatalSignal for the FATAL_SIGNALS, once per process.
+     *
+     * The handlers that were installed before get restored when a signal arrives.
+     */
+    static void installFatalSignalHandlers()
     {
-        if (!s_data || !s_data->out.canWrite()) {
+        static bool installed = false;
+        if (installed) {
             return;
         }
+        installed = true;
+
+        // a stack overflow can only be handled on an alternate stack, which we set up for the initializing thread
+        static char alternateStack[64 * 1024];
+        stack_t previousStack;
+        if (sigaltstack(nullptr, &previousStack) == 0 && (previousStack.ss_flags & SS_DISABLE)) {
+            stack_t stack;
+            stack.ss_sp = alternateStack;
+            stack.ss_size = sizeof(alternateStack);
+            stack.ss_flags = 0;
+            sigaltstack(&stack, nullptr);
+        }
+
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_sigaction = &handleFatalSignal;
+        action.sa_flags = SA_SIGINFO | SA_ONSTACK | SA_RESETHAND;
+        sigemptyset(&action.sa_mask);
+        for (size_t i = 0; i < NUM_FATAL_SIGNALS; ++i) {
+            if (sigaction(FATAL_SIGNALS[i], &action, &s_previousSignalActions[i]) != 0) {
+                debugLog<MinimalOutput>("failed to install the handler for signal %d", FATAL_SIGNALS[i]);
+            }
+        }
+    }
 
-        size_t rss = 0;
+    /**
+     * Write out the buffered data when the process crashes, see HEAPTRACK_CRASH_FLUSH.
+     *
+     * This must be async-signal-safe. The crashing thread may hold the lock itself,
+     * so we only try to take it for a while and lose the buffered data otherwise.
+     * The events still sitting in the thread buffers are lost too, as draining them may allocate.
+     * With HEAPTRACK_ASYNC_FLUSH, the final records get skipped, as filling the buffer would
+     * queue it up for the timer thread. The queued buffers only get written when the timer
+     * thread doesn't hold the lock for draining them, which it may do in the crashing thread.
+     */
+    static void handleFatalSignal(int signal, siginfo_t* info, void* /*context*/)
+    {
+        const auto savedErrno = errno;
+        RecursionGuard::isActive = true;
 
-#ifdef __linux__
-        if (s_data->procStatm == -1) {
-            return;
+        for (int attempt = 0; attempt < 100; ++attempt) {
+            if (s_lock.try_lock()) {
+                HeapTrack heaptrack(LockStatus(true));
+                heaptrack.writeFinalRecords();
+                break;
+            }
+            const timespec delay = {0, 1000000};
+            nanosleep(&delay, nullptr);
         }
-        // read RSS in pages from statm, then rewind for next read
-        // NOTE: don't use fscanf here, it could potentially deadlock us
-        const int BUF_SIZE = 512;
-        char buf[BUF_SIZE + 1];
-        if (read(s_data->procStatm, buf, BUF_SIZE) <= 0) {
-            fprintf(stderr, "WARNING: Failed to read RSS value from /proc/self/statm.\n");
-            close(s_data->procStatm);
-            s_data->procStatm = -1;
-            return;
+
+        for (size_t i = 0; i < NUM_FATAL_SIGNALS; ++i) {
+            if (FATAL_SIGNALS[i] == signal) {
+                sigaction(signal, &s_previousSignalActions[i], nullptr);
+            }
         }
-        lseek(s_data->procStatm, 0, SEEK_SET);
+        errno = savedErrno;
 
-        if (sscanf(buf, "%*u %zu", &rss) != 1) {
-            fprintf(stderr, "WARNING: Failed to read RSS value from /proc/self/statm.\n");
-            close(s_data->procStatm);
-            s_data->procStatm = -1;
-            return;
+        // a fault repeats once we return and then reaches the previous handler with the proper signal info
+        // signals sent by kill or abort have to be raised again
+        if (!info || info->si_code <= 0) {
+            raise(signal);
         }
-#elif defined(__FreeBSD__)
-        auto proc_info = kinfo_getproc(getpid());
-        if (proc_info == nullptr) {
+    }
+
+    void writeFinalRecords()
+    {
+        if (!s_data || !s_data->out.canWrite()) {
             return;
         }
+        if (!s_data->out.isAsync()) {
+            writeSnapshot();
+            writeTimestamp();
+            writeRSS();
+            writeSizeClasses();
+        }
+        s_data->out.flushFromSignalHandler();
+    }
 
-        rss = proc_info->ki_rssize;
-
-        free(proc_info);
-#endif
-
-        // TODO: compare to rusage.ru_maxrss (getrusage) to find "real" peak?
-        // TODO: use custom allocators with known page sizes to prevent tainting
-        //       the RSS numbers with heaptrack-internal data
+    static struct sigaction s_previousSignalActions[NUM_FATAL_SIGNALS];
 
-        s_data->out.writeHexLine('R', rss);
+    /**
+     * Pointers and instruction pointers are delta encoded against the previous
+     * value in binary records, this yields much smaller varints.
+     */
+    static uint64_t delta(uintptr_t value, uintptr_t* last)
+    {
+        const auto ret = LineWriter::zigzag(static_cast<int64_t>(value - *last));
+        *last = value;
+        return ret;
     }
 
-    void writeVersion()
+    static bool writeAllocation(size_t size, uint32_t traceIndex, uintptr_t ptr, uint32_t threadIndex)
     {
-        s_data->out.writeHexLine('v', static_cast<size_t>(HEAPTRACK_VERSION),
-                                 static_cast<size_t>(HEAPTRACK_FILE_FORMAT_VERSION));
+        if (s_data->aggregate) {
+            s_data->aggregation.allocate(ptr, size, traceIndex, s_sampleInterval.load(memory_order_relaxed));
+            return true;
+        }
+        if (s_data->collapseTemporary) {
+            if (!writePendingAllocation()) {
+                return false;
+            }
+            s_data->pendingAllocation = {ptr, size, traceIndex, threadIndex};
+            return true;
+        }
+        return writeAllocationRecord(size, traceIndex, ptr, threadIndex);
     }
 
-    void writeExe()
+    /**
+     * Write a free of @p ptrIn followed by the allocation of @p ptrOut as one 'r' record.
+     *
+     * The aggregation and the collapsing of temporary allocations need the separate events.
+     */
+    static bool writeReallocation(uintptr_t ptrIn, size_t size, uint32_t traceIndex, uintptr_t ptrOut,
+                                  uint32_t threadIndex)
     {
-        const int BUF_SIZE = 1023;
-        char buf[BUF_SIZE + 1];
-
-#ifdef __linux__
-        ssize_t size = readlink("/proc/self/exe", buf, BUF_SIZE);
-#elif defined(__FreeBSD__)
-        int mib[4] = {CTL_KERN, KERN_PROC, KERN_PROC_PATHNAME, -1};
-        size_t size = BUF_SIZE;
-        sysctl(mib, 4, buf, &size, NULL, 0);
-#endif
-
-        if (size > 0 && size < BUF_SIZE) {
-            buf[size] = 0;
-            s_data->out.write("x %x %s\n", size, buf);
+        if (s_data->aggregate || s_data->collapseTemporary) {
+            return writeFree(ptrIn, threadIndex) && writeAllocation(size, traceIndex, ptrOut, threadIndex);
+        }
+        if (!writeThreadSwitch(threadIndex)) {
+            return false;
         }
+        if (s_data->binaryRecords) {
+            // the new pointer is relative to the old one, which makes in-place reallocations cheap
+            const auto ptrInDelta = delta(ptrIn, &s_data->lastPointer);
+            const auto ptrOutDelta = delta(ptrOut, &s_data->lastPointer);
+            return s_data->out.writeVarintRecord('r', size, traceIndex, ptrInDelta, ptrOutDelta);
+        }
+        return s_data->out.writeHexLine('r', size, traceIndex, ptrIn, ptrOut);
     }
 
-    void writeCommandLine()
+    /**
+     * Allocation events are attributed to the thread of the last thread switch record before them.
+     */
+    static bool writeThreadSwitch(uint32_t threadIndex)
     {
-        s_data->out.write("X");
-        const int BUF_SIZE = 4096;
-        char buf[BUF_SIZE + 1] = {0};
-
-#ifdef __linux__
-        auto fd = open("/proc/self/cmdline", O_RDONLY);
-        int bytesRead = read(fd, buf, BUF_SIZE);
-        close(fd);
-#elif defined(__FreeBSD__)
-        int mib[4] = {CTL_KERN, KERN_PROC, KERN_PROC_ARGS, getpid()};
-        size_t bytesRead = BUF_SIZE;
-        sysctl(mib, 4, buf, &bytesRead, NULL, 0);
-#endif
-
-        char* end = buf + bytesRead;
-        for (char* p = buf; p < end;) {
-            s_data->out.write(" %s", p);
-            while (*p++)
-                ; // skip until start of next 0-terminated section
+        if (threadIndex == s_data->lastThreadIndex) {
+            return true;
         }
-
-        s_data->out.write("\n");
+        s_data->lastThreadIndex = threadIndex;
+        if (s_data->binaryRecords) {
+            return s_data->out.writeVarintRecord('h', threadIndex);
+        }
+        return s_data->out.writeHexLine('h', threadIndex);
     }
 
-    void writeSystemInfo()
+    static bool writeAllocationRecord(size_t size, uint32_t traceIndex, uintptr_t ptr, uint32_t threadIndex)
     {
-        s_data->out.writeHexLine('I', static_cast<size_t>(sysconf(_SC_PAGESIZE)),
-                                 static_cast<size_t>(sysconf(_SC_PHYS_PAGES)));
+        if (!writeThreadSwitch(threadIndex)) {
+            return false;
+        }
+        if (s_data->binaryRecords) {
+            return s_data->out.writeVarintRecord('+', size, traceIndex, delta(ptr, &s_data->lastPointer));
+        }
+        return s_data->out.writeHexLine('+', size, traceIndex, ptr);
     }
 
-    void writeSuppressions()
+    /**
+     * Frees get attributed to the freeing thread too, such that the interpreter can tell which allocations
+     * got freed by another thread than the one that allocated them.
+     */
+    static bool writeFree(uintptr_t ptr, uint32_t threadIndex)
     {
-        if (!__lsan_default_suppressions)
-            return;
-
-        const char* suppressions = __lsan_default_suppressions();
-        if (!suppressions)
-            return;
-
-        std::istringstream stream(suppressions);
-        std::string line;
-        while (std::getline(stream, line)) {
-            s_data->out.write("S ");
-            s_data->out.write(line);
-            s_data->out.write("\n");
+        if (s_data->aggregate) {
+            s_data->aggregation.free(ptr);
+            return true;
+        }
+        if (s_data->collapseTemporary) {
+            auto& pending = s_data->pendingAllocation;
+            if (pending.ptr == ptr) {
+                // a temporary allocation, neither the pointer nor the separate free are of any interest
+                pending.ptr = 0;
+                if (!writeThreadSwitch(pending.threadIndex)) {
+                    return false;
+                }
+                if (s_data->binaryRecords) {
+                    return s_data->out.writeVarintRecord('T', pending.size, pending.traceIndex);
+                }
+                return s_data->out.writeHexLine('T', pending.size, pending.traceIndex);
+            }
+            if (!writePendingAllocation()) {
+                return false;
+            }
+        }
+        if (!writeThreadSwitch(threadIndex)) {
+            return false;
+        }
+        if (s_data->binaryRecords) {
+            return s_data->out.writeVarintRecord('-', delta(ptr, &s_data->lastPointer));
         }
+        return s_data->out.writeHexLine('-', ptr);
     }
 
-    void handleMalloc(void* ptr, size_t size, const Trace& trace)
+    /**
+     * Write out the allocation event held back by writeAllocation, if any.
+     */
+    static bool writePendingAllocation()
     {
-        if (!s_data || !s_data->out.canWrite()) {
-            return;
+        auto& pending = s_data->pendingAllocation;
+        if (!pending.ptr) {
+            return true;
         }
-        updateModuleCache();
-
-        const auto index = s_data->traceTree.index(trace, [](uintptr_t ip, uint32_t index) {
-            // decrement addresses by one - otherwise we misattribute the cost to the wrong instruction
-            // for some reason, it seems like we always get the instruction _after_ the one we are interested in
-            // see also: https://github.com/libunwind/libunwind/issues/287
-            // and https://bugs.kde.org/show_bug.cgi?id=439897
-            --ip;
-
-            return s_data->out.writeHexLine('t', ip, index);
-        });
-
-#ifdef DEBUG_MALLOC_PTRS
-        auto it = s_data->known.find(ptr);
-        assert(it == s_data->known.end());
-        s_data->known.insert(ptr);
-#endif
-
-        s_data->out.writeHexLine('+', size, index, reinterpret_cast<uintptr_t>(ptr));
+        const auto ptr = pending.ptr;
+        pending.ptr = 0;
+        return writeAllocationRecord(pending.size, pending.traceIndex, ptr, pending.threadIndex);
     }
 
-    void handleFree(void* ptr)
+    static bool writeTraceNode(uintptr_t ip, uint32_t parentIndex)
     {
-        if (!s_data || !s_data->out.canWrite()) {
-            return;
+        if (s_data->binaryRecords) {
+            return s_data->out.writeVarintRecord('t', delta(ip, &s_data->lastInstructionPointer), parentIndex);
         }
-
-#ifdef DEBUG_MALLOC_PTRS
-        auto it = s_data->known.find(ptr);
-        assert(it != s_data->known.end());
-        s_data->known.erase(it);
-#endif
-
-        s_data->out.writeHexLine('-', reinterpret_cast<uintptr_t>(ptr));
+        return s_data->out.writeHexLine('t', ip, parentIndex);
     }
 
-    static bool isPaused()
+    static void recordThreadEvent(const RecursionGuard& guard, const ThreadEvent& event)
     {
-        return s_paused;
+        if (!pushThreadEvent(event)) {
+            op(guard, [&](HeapTrack& heaptrack) { heaptrack.handleThreadEvent(event); });
+        }
     }
 
-    static void setPaused(bool state)
+    /// identifies a loaded module by its load address and a hash of its file name
+    using ModuleKey = std::pair<uintptr_t, uint64_t>;
+
+    static ModuleKey moduleKey(const struct dl_phdr_info* info)
     {
-        s_paused = state;
+        // FNV-1a, we only need to recognize modules we reported already
+        uint64_t hash = 14695981039346656037ull;
+        for (auto c = info->dlpi_name; c && *c; ++c) {
+            hash = (hash ^ static_cast<unsigned char>(*c)) * 1099511628211ull;
+        }
+        return {info->dlpi_addr, hash};
     }
 
-private:
+    struct ModuleUpdate
+    {
+        HeapTrack* heaptrack;
+        std::vector<ModuleKey>* modules;
+    };
+
     static int dl_iterate_phdr_callback(struct dl_phdr_info* info, size_t /*size*/, void* data)
     {
-        auto heaptrack = reinterpret_cast<HeapTrack*>(data);
+        auto update = reinterpret_cast<ModuleUpdate*>(data);
+        auto heaptrack = update->heaptrack;
+        const auto key = moduleKey(info);
+        update->modules->push_back(key);
+
+        const auto& reported = heaptrack->s_data->reportedModules;
+        const auto it = std::lower_bound(reported.begin(), reported.end(), ModuleKey(key.first, 0));
+        if (it != reported.end() && it->first == key.first) {
+            if (std::binary_search(it, reported.end(), key)) {
+                return 0;
+            }
+            // a different module got loaded at the same address, unload the old one first
+            if (!heaptrack->s_data->out.writeHexLine('u', key.first)) {
+                return 1;
+            }
+        }
+
         const char* fileName = info->dlpi_name;
         if (!fileName || !fileName[0]) {
             fileName = "x";
@@ -606,11 +2476,18 @@ private:
         debugLog<MinimalOutput>("%s", "prepare_fork()");
         // don't do any custom malloc handling while inside fork
         RecursionGuard::isActive = true;
+        if (s_followFork) {
+            // no other thread may modify our data while it gets copied into the child
+            s_lock.lock();
+        }
     }
 
     static void parent_fork()
     {
         debugLog<MinimalOutput>("%s", "parent_fork()");
+        if (s_followFork) {
+            s_lock.unlock();
+        }
         // the parent process can now continue its custom malloc tracking
         RecursionGuard::isActive = false;
     }
@@ -620,20 +2497,100 @@ private:
         debugLog<MinimalOutput>("%s", "child_fork()");
         // but the forked child process cleans up itself
         // this is important to prevent two processes writing to the same file
+        auto parentData = s_data;
         s_data = nullptr;
+        // the forking thread is the only one that exists in the child
+        const auto forkAnnounced = t_forkAnnounced;
+        t_forkAnnounced = false;
+        s_threadBuffersEnabled = false;
+        s_sampleInterval = 0;
+        s_unwindCacheGeneration = 0;
+        s_trackMappings = false;
+        s_trackThreads = false;
+        s_countOnly = false;
         RecursionGuard::isActive = true;
+
+        if (s_followFork) {
+            // we hold the lock that got taken in prepare_fork, this releases it again
+            HeapTrack heaptrack(LockStatus(true));
+            if (parentData && !forkAnnounced) {
+                // e.g. the fork within daemon(), nobody would ever read the output of this child
+                parentData->out.abandon();
+            } else if (parentData && heaptrack.followFork(parentData)) {
+                RecursionGuard::isActive = false;
+            }
+        }
+    }
+
+    /**
+     * Continue tracing in a forked child process, with its own output.
+     *
+     * The data of the parent, including its trace tree, gets leaked: The new output has
+     * to be self-contained and the parent state may reference threads that don't exist
+     * in the child.
+     */
+    bool followFork(LockedData* parentData)
+    {
+        // the parent output stays open in the child otherwise, which would keep its interpreter alive
+        parentData->out.abandon();
+        if (parentData->procStatm != -1) {
+            close(parentData->procStatm);
+        }
+
+        const auto fileName = childOutputFileName(parentData->outputFileName, getpid());
+        if (fileName.empty()) {
+            return false;
+        }
+        const auto out = openChildOutput(fileName, parentData->outputIsFifo);
+        if (out == -1) {
+            return false;
+        }
+
+        debugLog<MinimalOutput>("following forked child: %s", fileName.c_str());
+        s_data = new LockedData(out, parentData->stopCallback);
+        s_data->outputFileName = fileName;
+        s_data->outputIsFifo = parentData->outputIsFifo;
+        startRecording();
+        // the interpreter waits for our header, see openForkedChildPipe
+        s_data->out.flush();
+        return true;
     }
 
+
     void updateModuleCache()
     {
         if (!s_data || !s_data->out.canWrite() || !s_data->moduleCacheDirty) {
             return;
         }
         debugLog<MinimalOutput>("%s", "updateModuleCache()");
-        if (!s_data->out.write("m 1 -\n")) {
+
+        auto& reported = s_data->reportedModules;
+        if (reported.empty() && !s_data->out.write("m 1 -\n")) {
             return;
         }
-        dl_iterate_phdr(&dl_iterate_phdr_callback, this);
+
+        // only the modules that are not in the reported list get written
+        // the list is reused across updates, to not allocate every time a library gets loaded
+        auto& modules = s_data->loadedModules;
+        modules.clear();
+        ModuleUpdate update = {this, &modules};
+        dl_iterate_phdr(&dl_iterate_phdr_callback, &update);
+        std::sort(modules.begin(), modules.end());
+
+        for (const auto& module : reported) {
+            if (std::binary_search(modules.begin(), modules.end(), module)) {
+                continue;
+            }
+            const auto it = std::lower_bound(modules.begin(), modules.end(), ModuleKey(module.first, 0));
+            if (it != modules.end() && it->first == module.first) {
+                // got replaced by a new module already, see dl_iterate_phdr_callback
+                continue;
+            }
+            if (!s_data->out.writeHexLine('u', module.first)) {
+                return;
+            }
+        }
+        std::swap(reported, modules);
         s_data->moduleCacheDirty = false;
     }
 
@@ -666,17 +2623,32 @@ private:
      * TODO: c++17 return std::optional<HeapTrack>
      */
     template <typename StopLockCheck>
-    static LockStatus tryLock(StopLockCheck stopLockCheck)
+    HEAPTRACK_PERF_FUNCTION static LockStatus tryLock(StopLockCheck stopLockCheck)
     {
         debugLog<VeryVerboseOutput>("%s", "trying to acquire lock");
-        while (!s_lock.try_lock()) {
+        if (s_lock.try_lock()) {
+            debugLog<VeryVerboseOutput>("%s", "lock acquired");
+            return true;
+        }
+
+        // only measure the contended case, which is slow anyways
+        const auto waitStart = OverheadCounters::cycles();
+        uint64_t spins = 0;
+        bool locked = true;
+        do {
             if (stopLockCheck()) {
-                return false;
+                locked = false;
+                break;
             }
+            ++spins;
             this_thread::sleep_for(chrono::microseconds(1));
+        } while (!s_lock.try_lock());
+        s_overhead.add(OverheadCounters::LockSpins, spins);
+        s_overhead.addCyclesSince(OverheadCounters::LockWaitCycles, waitStart);
+        if (locked) {
+            debugLog<VeryVerboseOutput>("%s", "lock acquired");
         }
-        debugLog<VeryVerboseOutput>("%s", "lock acquired");
-        return true;
+        return locked;
     }
 
     /**
@@ -687,14 +2659,90 @@ private:
         assert(lockStatus);
     }
 
-    struct LockedData
-    {
-        LockedData(int out, heaptrack_callback_t stopCallback)
-            : out(out)
-            , stopCallback(stopCallback)
-        {
+    struct LockedData
+    {
+        LockedData(int out, heaptrack_callback_t stopCallback)
+            : out(out)
+            , stopCallback(stopCallback)
+        {
+
+            debugLog<MinimalOutput>("%s", "constructing LockedData");
+
+            const auto textOutputEnv = getenv("HEAPTRACK_TEXT_OUTPUT");
+            binaryRecords = !textOutputEnv || strcmp(textOutputEnv, "0") == 0;
+
+            const auto shmEnv = getenv("HEAPTRACK_SHM");
+            if (shmEnv && strcmp(shmEnv, "0") != 0) {
+                const auto name = "/heaptrack." + to_string(getpid()) + '.'
+                    + to_string(clock::now().time_since_epoch().count());
+                if (!this->out.enableSharedMemory(name)) {
+                    debugLog<MinimalOutput>("failed to create shared memory %s, writing to the output file instead",
+                                            name.c_str());
+                }
+            }
+
+            bool mappedOutput = false;
+            if (mappedOutputRequested() && !this->out.isSharedMemory()) {
+                if (auto sink = MappedFileSink::create(out)) {
+                    mappedOutput = this->out.setSink(std::unique_ptr<LineWriter::Sink>(sink));
+                } else {
+                    fprintf(stderr, "WARNING: Failed to memory map the heaptrack output file, writing to it instead.\n");
+                }
+            }
+
+            // the writes into the mapping never block, so there is nothing to gain from the timer thread
+            const auto asyncFlushEnv = getenv("HEAPTRACK_ASYNC_FLUSH");
+            const bool asyncFlush = !mappedOutput && asyncFlushEnv && strcmp(asyncFlushEnv, "0") != 0;
+
+            const auto aggregateEnv = getenv("HEAPTRACK_AGGREGATE");
+            aggregate = aggregateEnv && strcmp(aggregateEnv, "0") != 0;
+
+            const auto unwindCacheEnv = getenv("HEAPTRACK_UNWIND_CACHE");
+            unwindCache = unwindCacheEnv && strcmp(unwindCacheEnv, "0") != 0;
+
+            const auto collapseTemporaryEnv = getenv("HEAPTRACK_COLLAPSE_TEMPORARY");
+            collapseTemporary = collapseTemporaryEnv && strcmp(collapseTemporaryEnv, "0") != 0;
+
+            const auto usableSizeEnv = getenv("HEAPTRACK_USABLE_SIZE");
+            recordUsableSizes = usableSizeEnv && strcmp(usableSizeEnv, "0") != 0;
+
+            const auto trackMappingsEnv = getenv("HEAPTRACK_TRACK_MMAP");
+            trackMappings = trackMappingsEnv && strcmp(trackMappingsEnv, "0") != 0;
 
-            debugLog<MinimalOutput>("%s", "constructing LockedData");
+            const auto countOnlyEnv = getenv("HEAPTRACK_COUNT_ONLY");
+            countOnly = countOnlyEnv && strcmp(countOnlyEnv, "0") != 0;
+
+            const auto trackThreadsEnv = getenv("HEAPTRACK_TRACK_THREADS");
+            trackThreads = trackThreadsEnv && strcmp(trackThreadsEnv, "0") != 0;
+
+            const auto threadBuffersEnv = getenv("HEAPTRACK_THREAD_BUFFERS");
+            threadBuffers = threadBuffersEnv && strcmp(threadBuffersEnv, "0") != 0;
+            if (threadBuffers) {
+                pendingEvents.reserve(ThreadBuffer::CAPACITY);
+            }
+            shardedTraces = threadBuffers;
+
+            // the aggregation keeps the counters per trace index, which must not change
+            const auto traceTreeLimitEnv = getenv("HEAPTRACK_TRACE_TREE_LIMIT");
+            if (traceTreeLimitEnv && !aggregate) {
+                traceTreeLimit = strtoull(traceTreeLimitEnv, nullptr, 10);
+            }
+
+            if (const auto triggerRssEnv = getenv("HEAPTRACK_TRIGGER_RSS")) {
+                triggerRss = strtoull(triggerRssEnv, nullptr, 10);
+            }
+            if (const auto triggerHeapEnv = getenv("HEAPTRACK_TRIGGER_HEAP")) {
+                triggerHeap = strtoull(triggerHeapEnv, nullptr, 10);
+            }
+            if (const auto timerIntervalEnv = getenv("HEAPTRACK_TIMER_INTERVAL")) {
+                timerInterval = chrono::milliseconds(max(1ull, strtoull(timerIntervalEnv, nullptr, 10)));
+            }
+            maxTimerInterval = STABLE_INTERVAL_FACTOR * timerInterval;
+            if (const auto maxTimerIntervalEnv = getenv("HEAPTRACK_MAX_TIMER_INTERVAL")) {
+                maxTimerInterval = chrono::milliseconds(strtoull(maxTimerIntervalEnv, nullptr, 10));
+            }
+            maxTimerInterval = max(maxTimerInterval, timerInterval);
+            pageSize = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
 #ifdef __linux__
             procStatm = open("/proc/self/statm", O_RDONLY);
             if (procStatm == -1) {
@@ -715,24 +2763,80 @@ private:
                 return;
             }
 
+            // the timer thread drains the buffers of the writer, the application threads only fill them
+            if (asyncFlush) {
+                this->out.enableAsyncFlushing();
+            }
+
             // the mask we set above will be inherited by the thread that we spawn below
             timerThread = std::thread([&]() {
                 RecursionGuard::isActive = true;
                 debugLog<MinimalOutput>("%s", "timer thread started");
 
+                // when thread buffers are used, we drain them every millisecond to keep them from filling up
+                const auto drainInterval = chrono::milliseconds(1);
+                // the time stamps get written less often while the RSS doesn't change
+                auto timestampInterval = timerInterval;
+                auto nextTimestamp = chrono::steady_clock::now() + timestampInterval;
+                size_t lastRss = 0;
+                uint32_t stableTimestamps = 0;
+
                 // now loop and repeatedly print the timestamp and RSS usage to the data stream
                 while (!stopTimerThread) {
-                    // TODO: make interval customizable
-                    this_thread::sleep_for(chrono::milliseconds(10));
+                    const auto deadline =
+                        threadBuffers ? min(chrono::steady_clock::now() + drainInterval, nextTimestamp) : nextTimestamp;
+                    if (this->out.isAsync()) {
+                        while (!stopTimerThread && this->out.waitForData(deadline)) {
+                            this->out.drain();
+                        }
+                    } else {
+                        this_thread::sleep_until(deadline);
+                    }
+
+                    const auto now = chrono::steady_clock::now();
+                    const bool timestampDue = now >= nextTimestamp;
+                    if (!threadBuffers && !timestampDue) {
+                        continue;
+                    }
+
+                    // query the heap size of glibc before we lock, as it locks the malloc arenas
+                    // and read the RSS before too, such that we hold the lock as briefly as possible
+                    const uint64_t mallocHeap = (triggerHeap && !aggregate && timestampDue) ? mallocHeapSize() : 0;
+                    const size_t rss = timestampDue ? readRSS() : 0;
 
-                    const auto locked = tryLock([&] { return stopTimerThread.load(); });
+                    // the buffers must be drained and the time stamps must not fall behind too much, but otherwise
+                    // we don't compete with the allocating threads for the lock and rather try again a bit later
+                    const bool mayWait = threadBuffers || now - nextTimestamp >= timestampInterval;
+                    const auto locked =
+                        mayWait ? tryLock([&] { return stopTimerThread.load(); }) : LockStatus(s_lock.try_lock());
                     if (!locked) {
-                        break;
+                        if (mayWait) {
+                            break;
+                        }
+                        this_thread::sleep_for(drainInterval);
+                        continue;
                     }
 
                     HeapTrack heaptrack(locked);
-                    heaptrack.writeTimestamp();
-                    heaptrack.writeRSS();
+                    heaptrack.drainThreadBuffers();
+                    if (timestampDue) {
+                        heaptrack.writeSnapshot();
+                        heaptrack.writeTimestamp();
+                        heaptrack.writeRSS(rss);
+                        heaptrack.writeOverhead();
+                        heaptrack.writeSizeClasses();
+                        heaptrack.checkWatermarks(mallocHeap);
+
+                        if (rss != lastRss) {
+                            timestampInterval = timerInterval;
+                            stableTimestamps = 0;
+                        } else if (++stableTimestamps == STABLE_TIMESTAMPS) {
+                            timestampInterval = min(2 * timestampInterval, maxTimerInterval);
+                            stableTimestamps = 0;
+                        }
+                        lastRss = rss;
+                        nextTimestamp = now + timestampInterval;
+                    }
                 }
             });
 
@@ -742,9 +2846,191 @@ private:
             }
         }
 
+        /**
+         * Listen for commands on the UNIX socket at @p path, see HEAPTRACK_CONTROL_SOCKET.
+         *
+         * Every command is a single line that gets answered by "ok" or an error message.
+         */
+        void startControlThread(string path)
+        {
+            replaceAll(path, "$$", to_string(getpid()));
+
+            sockaddr_un address;
+            memset(&address, 0, sizeof(address));
+            address.sun_family = AF_UNIX;
+            if (path.size() >= sizeof(address.sun_path)) {
+                fprintf(stderr, "WARNING: Control socket path is too long: %s.\n", path.c_str());
+                return;
+            }
+            memcpy(address.sun_path, path.c_str(), path.size());
+
+            const auto listenSocket = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (listenSocket == -1
+                || bind(listenSocket, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0
+                || listen(listenSocket, 1) != 0) {
+                fprintf(stderr, "WARNING: Failed to listen on control socket %s: %s.\n", path.c_str(),
+                        strerror(errno));
+                if (listenSocket != -1) {
+                    close(listenSocket);
+                }
+                return;
+            }
+            controlSocketPath = path;
+
+            // like the timer thread, the control thread must not handle any signals
+            sigset_t previousMask;
+            sigset_t newMask;
+            sigfillset(&newMask);
+            pthread_sigmask(SIG_SETMASK, &newMask, &previousMask);
+            controlThread = std::thread([this, listenSocket]() { runControlThread(listenSocket); });
+            pthread_sigmask(SIG_SETMASK, &previousMask, nullptr);
+        }
+
+        void runControlThread(int listenSocket)
+        {
+            RecursionGuard::isActive = true;
+            debugLog<MinimalOutput>("%s", "control thread started");
+
+            // only one client is served at a time, a new connection replaces the previous one
+            int client = -1;
+            char buffer[256];
+            size_t bufferSize = 0;
+            while (!stopControl) {
+                pollfd fds[2] = {{listenSocket, POLLIN, 0}, {client, POLLIN, 0}};
+                if (poll(fds, client == -1 ? 1 : 2, 100) <= 0) {
+                    continue;
+                }
+
+                if (fds[0].revents & POLLIN) {
+                    const auto accepted = accept(listenSocket, nullptr, nullptr);
+                    if (accepted != -1) {
+                        if (client != -1) {
+                            close(client);
+                        }
+                        client = accepted;
+                        bufferSize = 0;
+                    }
+                    continue;
+                }
+                if (client == -1 || !fds[1].revents) {
+                    continue;
+                }
+
+                const auto ret = read(client, buffer + bufferSize, sizeof(buffer) - bufferSize);
+                if (ret <= 0) {
+                    close(client);
+                    client = -1;
+                    continue;
+                }
+                bufferSize += ret;
+
+                auto begin = buffer;
+                const auto end = buffer + bufferSize;
+                while (auto newline = static_cast<char*>(memchr(begin, '\n', end - begin))) {
+                    *newline = 0;
+                    if (newline != begin && newline[-1] == '\r') {
+                        newline[-1] = 0;
+                    }
+                    sendReply(client, handleControlCommand(begin));
+                    begin = newline + 1;
+                }
+                bufferSize = end - begin;
+                if (bufferSize == sizeof(buffer)) {
+                    sendReply(client, "error: command too long");
+                    bufferSize = 0;
+                }
+                memmove(buffer, begin, bufferSize);
+            }
+
+            if (client != -1) {
+                close(client);
+            }
+            close(listenSocket);
+            debugLog<MinimalOutput>("%s", "control thread stopped");
+        }
+
+        static void sendReply(int client, const char* reply)
+        {
+            // don't raise SIGPIPE when the client is gone already
+            send(client, reply, strlen(reply), MSG_NOSIGNAL);
+            send(client, "\n", 1, MSG_NOSIGNAL);
+        }
+
+        /**
+         * @return the reply to @p command, which is one of:
+         *
+         * - pause, resume: same as heaptrack_pause and heaptrack_resume
+         * - flush: write out all data recorded so far
+         * - snapshot: like flush, but also write the current aggregation snapshot, time stamp and RSS
+         * - sample BYTES: change the sampling interval, zero records all allocations
+         */
+        const char* handleControlCommand(const char* command)
+        {
+            debugLog<MinimalOutput>("control command: %s", command);
+
+            if (!strcmp(command, "pause")) {
+                HeapTrack::setPaused(true);
+                return "ok";
+            } else if (!strcmp(command, "resume")) {
+                HeapTrack::setPaused(false);
+                return "ok";
+            }
+
+            const bool isSnapshot = !strcmp(command, "snapshot");
+            const bool isSample = !strncmp(command, "sample ", 7);
+            uint64_t sampleInterval = 0;
+            if (isSample) {
+                char* end = nullptr;
+                sampleInterval = strtoull(command + 7, &end, 10);
+                if (end == command + 7 || *end) {
+                    return "error: invalid sampling interval";
+                }
+            } else if (!isSnapshot && strcmp(command, "flush")) {
+                return "error: unknown command";
+            }
+
+            const auto locked = tryLock([this] { return stopControl.load(); });
+            if (!locked) {
+                return "error: shutting down";
+            }
+            HeapTrack heaptrack(locked);
+            if (!out.canWrite()) {
+                return "error: output is closed";
+            }
+            if (isSample) {
+                heaptrack.setSampleInterval(sampleInterval, true);
+                return "ok";
+            }
+            heaptrack.drainThreadBuffers();
+            if (isSnapshot) {
+                heaptrack.writeSnapshot();
+            }
+            heaptrack.writeTimestamp();
+            if (isSnapshot) {
+                heaptrack.writeRSS();
+            }
+            return out.flush() ? "ok" : "error: failed to write output";
+        }
+
+        void stopControlThread()
+        {
+            stopControl = true;
+            if (controlThread.joinable()) {
+                try {
+                    controlThread.join();
+                } catch (const std::system_error&) {
+                }
+            }
+            if (!controlSocketPath.empty()) {
+                unlink(controlSocketPath.c_str());
+                controlSocketPath.clear();
+            }
+        }
+
         ~LockedData()
         {
             debugLog<MinimalOutput>("%s", "destroying LockedData");
+            stopControlThread();
             stopTimerThread = true;
             if (timerThread.joinable()) {
                 try {
@@ -767,23 +3053,172 @@ private:
 
         LineWriter out;
 
+        /// when we started to count the overhead, see writeOverhead
+        struct OverheadStart
+        {
+            chrono::time_point<clock> time;
+            uint64_t cycles;
+        };
+        OverheadStart overheadStart = {clock::now(), OverheadCounters::cycles()};
+
+        /**
+         * @return the RSS in pages, or zero when it is unknown
+         *
+         * This doesn't need the lock, the file stays open and gets read with pread.
+         */
+        size_t readRSS()
+        {
+            size_t rss = 0;
+#ifdef __linux__
+            if (procStatm == -1 || rssUnavailable) {
+                return 0;
+            }
+            // NOTE: don't use fscanf here, it could potentially deadlock us
+            const int BUF_SIZE = 512;
+            char buf[BUF_SIZE + 1];
+            const auto size = pread(procStatm, buf, BUF_SIZE, 0);
+            if (size > 0) {
+                buf[size] = '\0';
+            }
+            if (size <= 0 || sscanf(buf, "%*u %zu", &rss) != 1) {
+                if (!rssUnavailable.exchange(true)) {
+                    fprintf(stderr, "WARNING: Failed to read RSS value from /proc/self/statm.\n");
+                }
+                return 0;
+            }
+#elif defined(__FreeBSD__)
+            auto proc_info = kinfo_getproc(getpid());
+            if (proc_info == nullptr) {
+                return 0;
+            }
+
+            rss = proc_info->ki_rssize;
+
+            free(proc_info);
+#endif
+            return rss;
+        }
+
         /// /proc/self/statm file descriptor to read RSS value from
         int procStatm = -1;
+        /// set once reading procStatm failed, then we stop trying
+        atomic<bool> rssUnavailable {false};
+        /// the RSS in pages that got written last, see writeRSS
+        uint64_t rss = 0;
+        uint64_t pageSize = 0;
+
+        /// how often the timer thread writes the time stamps, from HEAPTRACK_TIMER_INTERVAL in milliseconds
+        chrono::milliseconds timerInterval {10};
+        /// while the RSS doesn't change over STABLE_TIMESTAMPS time stamps, the interval gets doubled up to
+        /// this, from HEAPTRACK_MAX_TIMER_INTERVAL in milliseconds, by default STABLE_INTERVAL_FACTOR times
+        /// the timerInterval
+        chrono::milliseconds maxTimerInterval {0};
+        enum : uint32_t
+        {
+            STABLE_TIMESTAMPS = 10,
+            STABLE_INTERVAL_FACTOR = 10,
+        };
+
+        /// thresholds in bytes from HEAPTRACK_TRIGGER_RSS and HEAPTRACK_TRIGGER_HEAP, zero when disabled
+        /// the heap size is the aggregated one when HEAPTRACK_AGGREGATE is set, or otherwise the one of glibc
+        uint64_t triggerRss = 0;
+        uint64_t triggerHeap = 0;
+        /// true while a threshold is exceeded, see checkWatermarks
+        bool triggered = false;
+        /// the sampling interval to restore once the thresholds are not exceeded anymore
+        uint64_t untriggeredSampleInterval = 0;
 
         /**
          * Calls to dlopen/dlclose mark the cache as dirty.
          * When this happened, all modules and their section addresses
          * must be found again via dl_iterate_phdr before we output the
          * next instruction pointer. Otherwise, heaptrack_interpret might
-         * encounter IPs of an unknown/invalid module.
+         * encounter IPs of an unknown/invalid module. Allocations from
+         * known traces don't need that, see indexTrace.
          */
         bool moduleCacheDirty = true;
 
+        /// sorted list of the modules that got reported to heaptrack_interpret already
+        std::vector<ModuleKey> reportedModules;
+        /// scratch list of the currently loaded modules, see updateModuleCache
+        std::vector<ModuleKey> loadedModules;
+
+        /// as passed to heaptrack_init, used to name the output of forked children
+        string outputFileName;
+        /// true when writing to a named pipe, i.e. when heaptrack_interpret reads from it
+        bool outputIsFifo = false;
+
         TraceTree traceTree;
+        /// true with HEAPTRACK_THREAD_BUFFERS, then every thread indexes its traces in the TraceShard of its
+        /// ThreadBuffer instead of traceTree, see indexTrace
+        bool shardedTraces = false;
+        /// the shard of the threads without a ThreadBuffer
+        TraceShard sharedTraces;
+        /// the number of trace nodes written by all shards
+        uint32_t numTraceNodes = 0;
+        /// the number of bytes after which the trace tree gets cleared from HEAPTRACK_TRACE_TREE_LIMIT,
+        /// zero when it may grow indefinitely
+        size_t traceTreeLimit = 0;
+
+        /// false when HEAPTRACK_TEXT_OUTPUT is set, then we fall back to a pure text output
+        bool binaryRecords = true;
+        /// last values written in binary records, used for delta encoding
+        uintptr_t lastPointer = 0;
+        uintptr_t lastInstructionPointer = 0;
+
+        /// true when HEAPTRACK_AGGREGATE is set, then only periodic snapshots of the aggregation get written
+        bool aggregate = false;
+        TraceAggregation aggregation;
+
+        /// true when HEAPTRACK_UNWIND_CACHE is set, then hot call sites skip unwinding via UnwindCache
+        bool unwindCache = false;
+
+        /// true when HEAPTRACK_COLLAPSE_TEMPORARY is set, then the last allocation event is held back
+        /// so that it can be merged with an immediately following free, see writeAllocation
+        bool collapseTemporary = false;
+        struct PendingAllocation
+        {
+            uintptr_t ptr = 0;
+            size_t size = 0;
+            uint32_t traceIndex = 0;
+            uint32_t threadIndex = 0;
+        };
+        /// the held back allocation event, if ptr is set
+        PendingAllocation pendingAllocation;
+
+        /// true when allocation events are recorded via the per-thread buffers
+        bool threadBuffers = false;
+
+        /// true when HEAPTRACK_TRACK_MMAP is set, then anonymous memory mappings get recorded too
+        bool trackMappings = false;
+
+        /// true when HEAPTRACK_USABLE_SIZE is set, then the slack of the allocator gets recorded, see writeUsableSize
+        bool recordUsableSizes = false;
+        /// the usable size per requested size that got encountered so far
+        tsl::robin_map<size_t, size_t> usableSizes;
+
+        /// true when HEAPTRACK_COUNT_ONLY is set, then no backtraces get recorded, see SizeClassCounters
+        bool countOnly = false;
+
+        /// true when HEAPTRACK_TRACK_THREADS is set, then allocations get attributed to their threads
+        bool trackThreads = false;
+        /// the number of threads announced so far, see threadIndex
+        uint32_t numThreads = 0;
+        /// the thread of the last allocation event, see writeThreadSwitch
+        uint32_t lastThreadIndex = 0;
+        /// the pools that got used so far, mapping their handle to the pool index, see poolIndex
+        tsl::robin_map<void*, uint32_t> pools;
+        /// events taken from the thread buffers that cannot be written out yet
+        vector<ThreadEvent> pendingEvents;
 
         atomic<bool> stopTimerThread {false};
         std::thread timerThread;
 
+        /// set when HEAPTRACK_CONTROL_SOCKET is set, see startControlThread
+        string controlSocketPath;
+        atomic<bool> stopControl {false};
+        std::thread controlThread;
+
         heaptrack_callback_t stopCallback = nullptr;
 
 #ifdef DEBUG_MALLOC_PTRS
@@ -796,11 +3231,33 @@ private:
 
 private:
     static std::atomic<bool> s_paused;
+    static std::mutex s_pauseLock;
+    static std::atomic<heaptrack_pause_callback_t> s_pauseCallback;
+    static std::atomic<bool> s_threadBuffersEnabled;
+    /// mean number of bytes between two sampled allocations, zero when not sampling
+    static std::atomic<uint64_t> s_sampleInterval;
+    /// true when HEAPTRACK_FOLLOW_FORK is set, then forked children get traced into their own output
+    static bool s_followFork;
+    /// mirrors LockedData::trackMappings, to skip the unwinding when mappings are not recorded
+    static std::atomic<bool> s_trackMappings;
+    static std::atomic<bool> s_countOnly;
+    /// mirrors LockedData::trackThreads, for the lock-free paths
+    static std::atomic<bool> s_trackThreads;
 };
 
 std::mutex HeapTrack::s_lock;
 HeapTrack::LockedData* HeapTrack::s_data {nullptr};
 std::atomic<bool> HeapTrack::s_paused {false};
+std::mutex HeapTrack::s_pauseLock;
+std::atomic<heaptrack_pause_callback_t> HeapTrack::s_pauseCallback {nullptr};
+std::atomic<bool> HeapTrack::s_threadBuffersEnabled {false};
+std::atomic<uint64_t> HeapTrack::s_sampleInterval {0};
+bool HeapTrack::s_followFork = false;
+std::atomic<bool> HeapTrack::s_trackMappings {false};
+std::atomic<bool> HeapTrack::s_countOnly {false};
+std::atomic<bool> HeapTrack::s_trackThreads {false};
+constexpr const int HeapTrack::FATAL_SIGNALS[];
+struct sigaction HeapTrack::s_previousSignalActions[HeapTrack::NUM_FATAL_SIGNALS];
 }
 
 static void heaptrack_realloc_impl(void* ptr_in, size_t size, void* ptr_out)
@@ -810,14 +3267,44 @@ static void heaptrack_realloc_impl(void* ptr_in, size_t size, void* ptr_out)
 
         debugLog<VeryVerboseOutput>("heaptrack_realloc(%p, %zu, %p)", ptr_in, size, ptr_out);
 
+        s_overhead.add(OverheadCounters::Events, 1);
+
+        if (HeapTrack::countsOnly()) {
+            if (ptr_in) {
+                s_sizeClasses.free();
+            }
+            s_sizeClasses.allocate(size);
+            return;
+        }
+
+        const bool recordFree = ptr_in && HeapTrack::takeSampledPointer(ptr_in);
+        if (!HeapTrack::sampleAllocation(ptr_out, size)) {
+            if (recordFree) {
+                HeapTrack::recordFree(guard, ptr_in);
+            }
+            return;
+        }
+
         Trace trace;
+        const auto unwindStart = OverheadCounters::cycles();
         trace.fill(2 + HEAPTRACK_DEBUG_BUILD * 3);
+        s_overhead.addCyclesSince(OverheadCounters::UnwindCycles, unwindStart);
+
+        if (HeapTrack::hasThreadBuffers()) {
+            if (recordFree) {
+                HeapTrack::recordFree(guard, ptr_in);
+            }
+            HeapTrack::recordMalloc(guard, ptr_out, size, trace);
+            return;
+        }
 
         HeapTrack::op(guard, [&](HeapTrack& heaptrack) {
-            if (ptr_in) {
-                heaptrack.handleFree(ptr_in);
+            uint32_t index = 0;
+            if (recordFree) {
+                heaptrack.handleRealloc(ptr_in, ptr_out, size, trace, &index);
+            } else {
+                heaptrack.handleMalloc(ptr_out, size, trace, &index);
             }
-            heaptrack.handleMalloc(ptr_out, size, trace);
         });
     }
 }
@@ -857,6 +3344,26 @@ void heaptrack_stop()
     assert(ret);
 }
 
+void heaptrack_exit()
+{
+    if (!s_fastExit.exchange(false) || RecursionGuard::isActive) {
+        return;
+    }
+
+    RecursionGuard guard;
+
+    debugLog<MinimalOutput>("%s", "heaptrack_exit()");
+
+    // neither the static destructors nor __freeres need to be recorded, the allocations that are
+    // still alive now get reported as leaked, so let them run at full speed
+    HeapTrack::setPaused(true);
+    HeapTrack::op(guard, [&](HeapTrack& heaptrack) {
+        // keep the data around, other threads may still allocate
+        s_atexit.store(true);
+        heaptrack.shutdown(true);
+    });
+}
+
 void heaptrack_pause()
 {
     HeapTrack::setPaused(true);
@@ -867,6 +3374,11 @@ void heaptrack_resume()
     HeapTrack::setPaused(false);
 }
 
+void heaptrack_set_pause_callback(heaptrack_pause_callback_t callback)
+{
+    HeapTrack::setPauseCallback(callback);
+}
+
 void heaptrack_malloc(void* ptr, size_t size)
 {
     if (!HeapTrack::isPaused() && ptr && !RecursionGuard::isActive) {
@@ -874,10 +3386,28 @@ void heaptrack_malloc(void* ptr, size_t size)
 
         debugLog<VeryVerboseOutput>("heaptrack_malloc(%p, %zu)", ptr, size);
 
+        s_overhead.add(OverheadCounters::Events, 1);
+
+        if (HeapTrack::countsOnly()) {
+            s_sizeClasses.allocate(size);
+            return;
+        }
+
+        if (!HeapTrack::sampleAllocation(ptr, size)) {
+            return;
+        }
+
+        UnwindCacheLookup cacheLookup(2);
+        if (cacheLookup.hit() && HeapTrack::recordMalloc(guard, ptr, size, cacheLookup)) {
+            return;
+        }
+
         Trace trace;
+        const auto unwindStart = OverheadCounters::cycles();
         trace.fill(2 + HEAPTRACK_DEBUG_BUILD * 2);
+        s_overhead.addCyclesSince(OverheadCounters::UnwindCycles, unwindStart);
 
-        HeapTrack::op(guard, [&](HeapTrack& heaptrack) { heaptrack.handleMalloc(ptr, size, trace); });
+        HeapTrack::recordMalloc(guard, ptr, size, trace, &cacheLookup);
     }
 }
 
@@ -888,10 +3418,174 @@ void heaptrack_free(void* ptr)
 
         debugLog<VeryVerboseOutput>("heaptrack_free(%p)", ptr);
 
-        HeapTrack::op(guard, [&](HeapTrack& heaptrack) { heaptrack.handleFree(ptr); });
+        s_overhead.add(OverheadCounters::Events, 1);
+
+        if (HeapTrack::countsOnly()) {
+            s_sizeClasses.free();
+            return;
+        }
+
+        if (!HeapTrack::takeSampledPointer(ptr)) {
+            return;
+        }
+
+        HeapTrack::recordFree(guard, ptr);
+    }
+}
+
+void heaptrack_malloc_batch(const heaptrack_allocation_t* allocations, size_t count)
+{
+    if (!HeapTrack::isPaused() && allocations && count && !RecursionGuard::isActive) {
+        RecursionGuard guard;
+
+        debugLog<VeryVerboseOutput>("heaptrack_malloc_batch(%p, %zu)", allocations, count);
+
+        s_overhead.add(OverheadCounters::Events, count);
+
+        if (HeapTrack::countsOnly()) {
+            for (size_t i = 0; i < count; ++i) {
+                if (allocations[i].ptr) {
+                    s_sizeClasses.allocate(allocations[i].size);
+                }
+            }
+            return;
+        }
+
+        Trace trace;
+        const auto unwindStart = OverheadCounters::cycles();
+        trace.fill(2 + HEAPTRACK_DEBUG_BUILD * 2);
+        s_overhead.addCyclesSince(OverheadCounters::UnwindCycles, unwindStart);
+
+        HeapTrack::recordMallocBatch(guard, allocations, count, trace);
+    }
+}
+
+void heaptrack_free_batch(void* const* ptrs, size_t count)
+{
+    if (!HeapTrack::isPaused() && ptrs && count && !RecursionGuard::isActive) {
+        RecursionGuard guard;
+
+        debugLog<VeryVerboseOutput>("heaptrack_free_batch(%p, %zu)", ptrs, count);
+
+        s_overhead.add(OverheadCounters::Events, count);
+
+        if (HeapTrack::countsOnly()) {
+            for (size_t i = 0; i < count; ++i) {
+                if (ptrs[i]) {
+                    s_sizeClasses.free();
+                }
+            }
+            return;
+        }
+
+        HeapTrack::recordFreeBatch(guard, ptrs, count);
+    }
+}
+
+void heaptrack_pool_malloc(void* pool, void* ptr, size_t size)
+{
+    if (!HeapTrack::isPaused() && ptr && !RecursionGuard::isActive) {
+        RecursionGuard guard;
+
+        debugLog<VeryVerboseOutput>("heaptrack_pool_malloc(%p, %p, %zu)", pool, ptr, size);
+
+        s_overhead.add(OverheadCounters::Events, 1);
+
+        if (HeapTrack::countsOnly()) {
+            s_sizeClasses.allocate(size);
+            return;
+        }
+
+        if (!HeapTrack::sampleAllocation(ptr, size)) {
+            return;
+        }
+
+        Trace trace;
+        const auto unwindStart = OverheadCounters::cycles();
+        trace.fill(2 + HEAPTRACK_DEBUG_BUILD * 2);
+        s_overhead.addCyclesSince(OverheadCounters::UnwindCycles, unwindStart);
+
+        HeapTrack::op(guard, [&](HeapTrack& heaptrack) { heaptrack.handlePoolMalloc(pool, ptr, size, trace); });
+    }
+}
+
+void heaptrack_pool_free(void* pool, void* ptr)
+{
+    if (!HeapTrack::isPaused() && ptr && !RecursionGuard::isActive) {
+        RecursionGuard guard;
+
+        debugLog<VeryVerboseOutput>("heaptrack_pool_free(%p, %p)", pool, ptr);
+
+        s_overhead.add(OverheadCounters::Events, 1);
+
+        if (HeapTrack::countsOnly()) {
+            s_sizeClasses.free();
+            return;
+        }
+
+        if (!HeapTrack::takeSampledPointer(ptr)) {
+            return;
+        }
+
+        HeapTrack::op(guard, [&](HeapTrack& heaptrack) { heaptrack.handlePoolFree(pool, ptr); });
+    }
+}
+
+void heaptrack_pool_destroy(void* pool)
+{
+    if (!HeapTrack::isPaused() && !RecursionGuard::isActive) {
+        RecursionGuard guard;
+
+        debugLog<VeryVerboseOutput>("heaptrack_pool_destroy(%p)", pool);
+
+        s_overhead.add(OverheadCounters::Events, 1);
+
+        HeapTrack::op(guard, [&](HeapTrack& heaptrack) { heaptrack.handlePoolDestroy(pool); });
+    }
+}
+
+static void heaptrack_mapping_impl(void* ptr, size_t length, void* oldPtr, size_t oldLength)
+{
+    if (!HeapTrack::isPaused() && HeapTrack::tracksMappings() && ptr && length && !RecursionGuard::isActive) {
+        RecursionGuard guard;
+
+        debugLog<VeryVerboseOutput>("heaptrack_mmap(%p, %zu, %p, %zu)", ptr, length, oldPtr, oldLength);
+
+        s_overhead.add(OverheadCounters::Events, 1);
+
+        Trace trace;
+        const auto unwindStart = OverheadCounters::cycles();
+        trace.fill(2 + HEAPTRACK_DEBUG_BUILD * 3);
+        s_overhead.addCyclesSince(OverheadCounters::UnwindCycles, unwindStart);
+
+        HeapTrack::op(guard,
+                      [&](HeapTrack& heaptrack) { heaptrack.handleMapping(ptr, length, trace, oldPtr, oldLength); });
+    }
+}
+
+void heaptrack_mmap(void* ptr, size_t length)
+{
+    heaptrack_mapping_impl(ptr, length, nullptr, 0);
+}
+
+void heaptrack_munmap(void* ptr, size_t length)
+{
+    if (!HeapTrack::isPaused() && HeapTrack::tracksMappings() && ptr && length && !RecursionGuard::isActive) {
+        RecursionGuard guard;
+
+        debugLog<VeryVerboseOutput>("heaptrack_munmap(%p, %zu)", ptr, length);
+
+        s_overhead.add(OverheadCounters::Events, 1);
+
+        HeapTrack::op(guard, [&](HeapTrack& heaptrack) { heaptrack.handleUnmapping(ptr, length); });
     }
 }
 
+void heaptrack_mremap(void* oldPtr, size_t oldLength, void* newPtr, size_t newLength)
+{
+    heaptrack_mapping_impl(newPtr, newLength, oldPtr, oldLength);
+}
+
 void heaptrack_realloc(void* ptr_in, size_t size, void* ptr_out)
 {
     heaptrack_realloc_impl(ptr_in, size, ptr_out);
@@ -911,6 +3605,24 @@ void heaptrack_invalidate_module_cache()
     HeapTrack::op(guard, [&](HeapTrack& heaptrack) { heaptrack.invalidateModuleCache(); });
 }
 
+void heaptrack_prepare_fork()
+{
+    t_forkAnnounced = true;
+}
+
+void heaptrack_forked(pid_t pid)
+{
+    t_forkAnnounced = false;
+    if (pid <= 0 || RecursionGuard::isActive) {
+        return;
+    }
+    RecursionGuard guard;
+
+    debugLog<VerboseOutput>("heaptrack_forked(%d)", pid);
+
+    HeapTrack::op(guard, [&](HeapTrack& heaptrack) { heaptrack.announceChild(pid); });
+}
+
 void heaptrack_warning(heaptrack_warning_callback_t callback)
 {
     RecursionGuard guard;
@@ -7,6 +7,7 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <sys/types.h>
 
 #ifdef __cplusplus
 typedef class LineWriter linewriter_t;
@@ -23,10 +24,17 @@ void heaptrack_init(const char* outputFileName, heaptrack_callback_t initCallbac
 
 void heaptrack_stop();
 
+/// finish the recording when the process starts to exit, only does something with HEAPTRACK_FAST_EXIT
+void heaptrack_exit();
+
 void heaptrack_pause();
 
 void heaptrack_resume();
 
+typedef void (*heaptrack_pause_callback_t)(int paused);
+/// @p callback gets invoked whenever the recording gets paused or resumed, e.g. to unhook the allocation functions
+void heaptrack_set_pause_callback(heaptrack_pause_callback_t callback);
+
 void heaptrack_malloc(void* ptr, size_t size);
 
 void heaptrack_free(void* ptr);
@@ -34,8 +42,40 @@ void heaptrack_free(void* ptr);
 void heaptrack_realloc(void* ptr_in, size_t size, void* ptr_out);
 void heaptrack_realloc2(uintptr_t ptr_in, size_t size, uintptr_t ptr_out);
 
+#ifndef HEAPTRACK_ALLOCATION_DEFINED
+#define HEAPTRACK_ALLOCATION_DEFINED
+/// same layout as in heaptrack_api.h
+typedef struct heaptrack_allocation_t
+{
+    void* ptr;
+    size_t size;
+} heaptrack_allocation_t;
+#endif
+
+/// @p count allocations that share a single backtrace, e.g. when a pool carves out many objects at once
+void heaptrack_malloc_batch(const heaptrack_allocation_t* allocations, size_t count);
+/// @p count deallocations, e.g. when a pool releases all of its objects at once
+void heaptrack_free_batch(void* const* ptrs, size_t count);
+
+/// allocations out of a custom memory pool, identified by the opaque @p pool handle
+/// their costs get grouped per pool in the analysis
+void heaptrack_pool_malloc(void* pool, void* ptr, size_t size);
+void heaptrack_pool_free(void* pool, void* ptr);
+/// frees all allocations of @p pool that are still alive with a single event
+void heaptrack_pool_destroy(void* pool);
+
+/// anonymous memory mappings, only recorded when HEAPTRACK_TRACK_MMAP is set
+void heaptrack_mmap(void* ptr, size_t length);
+void heaptrack_munmap(void* ptr, size_t length);
+void heaptrack_mremap(void* oldPtr, size_t oldLength, void* newPtr, size_t newLength);
+
 void heaptrack_invalidate_module_cache();
 
+/// to be called by the fork hooks right before they fork, only such children get followed
+void heaptrack_prepare_fork();
+/// to be called in the parent process after fork returned @p pid, also when it failed
+void heaptrack_forked(pid_t pid);
+
 typedef void (*heaptrack_warning_callback_t)(FILE*);
 void heaptrack_warning(heaptrack_warning_callback_t callback);
 
@@ -10,6 +10,8 @@
 #include <cassert>
 #include <cstdint>
 
+#include "util/config.h"
+
 /**
  * @brief Backtrace interface.
  */
@@ -19,7 +21,10 @@ struct Trace
 
     enum : int
     {
-        MAX_SIZE = 64
+        // capacity of a trace, i.e. the upper bound for setMaxDepth()
+        MAX_SIZE = 256,
+        // number of frames recorded per trace unless configured otherwise
+        DEFAULT_DEPTH = 64
     };
 
     const ip_t* begin() const
@@ -42,14 +47,43 @@ struct Trace
         return m_size;
     }
 
+    /// true when fill() stopped unwinding at the maximum depth, see setMaxDepth()
+    bool isTruncated() const
+    {
+        return m_truncated;
+    }
+
     bool fill(int skip)
     {
-        int size = unwind(m_data);
+        // the skipped frames do not count towards the maximum depth
+        const int maxSize = skip + s_maxDepth < MAX_SIZE ? skip + s_maxDepth : MAX_SIZE;
+        // unwind one more frame, which tells us whether the trace is deeper than the maximum
+        int size = 0;
+        switch (s_unwinder) {
+        case Unwinder::FramePointers:
+            size = unwindFramePointers(m_data, maxSize + 1);
+            break;
+        case Unwinder::ShadowStack:
+            size = unwindShadowStack(m_data, maxSize + 1);
+            break;
+        case Unwinder::Native:
+            size = unwind(m_data, maxSize + 1);
+            break;
+        }
         // filter bogus frames at the end, which sometimes get returned by tracer backend
         // cf.: https://bugs.kde.org/show_bug.cgi?id=379082
         while (size > 0 && !m_data[size - 1]) {
             --size;
         }
+        m_truncated = size > maxSize;
+        if (m_truncated) {
+            size = maxSize;
+        }
+        if (m_truncated && size > skip) {
+            // the tracker decrements every instruction pointer to point into the call instruction,
+            // compensate that for the marker which is recognized by the interpreter
+            m_data[size++] = reinterpret_cast<ip_t>(static_cast<uintptr_t>(HEAPTRACK_TRUNCATED_TRACE_IP) + 1);
+        }
         m_size = size > skip ? size - skip : 0;
         m_skip = skip;
         return m_size > 0;
@@ -65,19 +99,104 @@ struct Trace
 
         m_size = n + 1;
         m_skip = 0;
+        m_truncated = false;
+    }
+
+    void fillTestData(const uint64_t* ips, int n)
+    {
+        assert(n <= MAX_SIZE);
+        for (int i = 0; i < n; ++i) {
+            m_data[i] = reinterpret_cast<ip_t>(static_cast<uintptr_t>(ips[i]));
+        }
+
+        m_size = n;
+        m_skip = 0;
+        m_truncated = false;
     }
 
     static void setup();
 
+    /**
+     * Limit the number of frames recorded by fill(), not counting the skipped ones.
+     *
+     * Unwinding stops early once @p depth frames got collected and the trace gets terminated
+     * by an outermost HEAPTRACK_TRUNCATED_TRACE_IP frame. The depth is clamped to MAX_SIZE.
+     */
+    static void setMaxDepth(int depth)
+    {
+        s_maxDepth = depth < 1 ? 1 : (depth > MAX_SIZE ? MAX_SIZE : depth);
+    }
+
+    static int maxDepth()
+    {
+        return s_maxDepth;
+    }
+
     static void print();
 
+    /**
+     * Select the unwinder used by fill() at runtime.
+     *
+     * @p name is either "frame-pointers", "shadow-stack" or "native", the latter referring to
+     * the libunwind or unwind-tables backend chosen at build time.
+     *
+     * The shadow stack unwinder reads the return addresses from the hardware shadow stack of
+     * x86-64 CPUs with control-flow enforcement (CET), which only exists when the process runs
+     * with user space shadow stacks enabled.
+     *
+     * @return false when the requested unwinder is not supported on this platform or process.
+     */
+    static bool selectUnwinder(const char* name);
+
+    /**
+     * Cheap fingerprint of the current call stack, used to cache the result of fill().
+     */
+    struct CallSite
+    {
+        enum : int
+        {
+            // number of return addresses that get hashed into depthHash
+            DEPTH = 8
+        };
+
+        uintptr_t returnAddress = 0;
+        uintptr_t stackPointer = 0;
+        uint64_t depthHash = 0;
+    };
+
+    /**
+     * Fingerprint the call site @p skip frames up the stack by following the frame
+     * pointer chain for at most `skip + CallSite::DEPTH` frames.
+     *
+     * This only works when at least the first @p skip frames have frame pointers,
+     * which is the case for heaptrack's own code.
+     *
+     * @return false when the frame pointer chain cannot be followed that far.
+     */
+    static bool callSite(int skip, CallSite* site);
+
 private:
-    static int unwind(void** data);
+    enum class Unwinder
+    {
+        Native,
+        FramePointers,
+        ShadowStack
+    };
+
+    static int unwind(void** data, int maxSize);
+    static int unwindFramePointers(void** data, int maxSize);
+    static int unwindShadowStack(void** data, int maxSize);
+    static bool hasShadowStack();
+
+    static Unwinder s_unwinder;
+    static int s_maxDepth;
 
 private:
     int m_size = 0;
     int m_skip = 0;
-    ip_t m_data[MAX_SIZE];
+    bool m_truncated = false;
+    // one more slot for the frame that detects the truncation, which the marker replaces
+    ip_t m_data[MAX_SIZE + 1];
 };
 
 #endif // TRACE_H
@@ -0,0 +1,175 @@
+/*
+    SPDX-FileCopyrightText: 2026 Milian Wolff <mail@milianw.de>
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+/**
+ * @brief A frame-pointer based backtrace.
+ *
+ * This walks the chain of saved frame pointers, which is only reliable for code
+ * compiled with -fno-omit-frame-pointer, but is much cheaper than interpreting
+ * unwind tables. Every frame is validated against the bounds of the current
+ * thread's stack, so a broken chain terminates the backtrace instead of crashing.
+ */
+
+#include "trace.h"
+
+#include "util/config.h"
+#include "util/macroutils.h"
+
+#include <cstring>
+
+#include <pthread.h>
+#ifdef __FreeBSD__
+#include <pthread_np.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__) || defined(__aarch64__)
+#define HEAPTRACK_HAVE_FRAME_POINTER_UNWINDING 1
+#else
+#define HEAPTRACK_HAVE_FRAME_POINTER_UNWINDING 0
+#endif
+
+Trace::Unwinder Trace::s_unwinder = HEAPTRACK_USE_FRAME_POINTERS && HEAPTRACK_HAVE_FRAME_POINTER_UNWINDING
+    ? Trace::Unwinder::FramePointers
+    : Trace::Unwinder::Native;
+int Trace::s_maxDepth = Trace::DEFAULT_DEPTH;
+
+namespace {
+
+struct StackBounds
+{
+    uintptr_t low = 0;
+    uintptr_t high = 0;
+    bool initialized = false;
+};
+
+HEAPTRACK_INITIAL_EXEC_TLS thread_local StackBounds t_stackBounds;
+
+const StackBounds& stackBounds()
+{
+    auto& bounds = t_stackBounds;
+    if (bounds.initialized) {
+        return bounds;
+    }
+    bounds.initialized = true;
+
+    pthread_attr_t attr;
+#ifdef __FreeBSD__
+    pthread_attr_init(&attr);
+    const auto ret = pthread_attr_get_np(pthread_self(), &attr);
+#else
+    const auto ret = pthread_getattr_np(pthread_self(), &attr);
+#endif
+    if (ret != 0) {
+        return bounds;
+    }
+
+    void* stackAddr = nullptr;
+    size_t stackSize = 0;
+    if (pthread_attr_getstack(&attr, &stackAddr, &stackSize) == 0) {
+        bounds.low = reinterpret_cast<uintptr_t>(stackAddr);
+        bounds.high = bounds.low + stackSize;
+    }
+    pthread_attr_destroy(&attr);
+    return bounds;
+}
+}
+
+bool Trace::selectUnwinder(const char* name)
+{
+    if (strcmp(name, "native") == 0) {
+        s_unwinder = Unwinder::Native;
+        return true;
+    } else if (strcmp(name, "frame-pointers") == 0) {
+        if (!HEAPTRACK_HAVE_FRAME_POINTER_UNWINDING) {
+            return false;
+        }
+        s_unwinder = Unwinder::FramePointers;
+        return true;
+    } else if (strcmp(name, "shadow-stack") == 0) {
+        if (!hasShadowStack()) {
+            return false;
+        }
+        s_unwinder = Unwinder::ShadowStack;
+        return true;
+    }
+    return false;
+}
+
+__attribute__((noinline)) bool Trace::callSite(int skip, CallSite* site)
+{
+#if HEAPTRACK_HAVE_FRAME_POINTER_UNWINDING
+    const auto& bounds = stackBounds();
+    if (!bounds.high) {
+        return false;
+    }
+    const auto frameRecordSize = 2 * sizeof(uintptr_t);
+    auto frame = reinterpret_cast<uintptr_t>(__builtin_frame_address(0));
+
+    uint64_t hash = 0;
+    const int maxDepth = skip + CallSite::DEPTH;
+    for (int depth = 0; depth < maxDepth; ++depth) {
+        if (frame < bounds.low || frame > bounds.high - frameRecordSize || frame % sizeof(uintptr_t)) {
+            return depth > skip;
+        }
+        const auto record = reinterpret_cast<const uintptr_t*>(frame);
+        const auto ip = record[1];
+        if (depth == skip) {
+            site->returnAddress = ip;
+            site->stackPointer = frame;
+        }
+        hash = (hash ^ ip) * 0x100000001b3ull;
+        site->depthHash = hash;
+
+        const auto next = record[0];
+        if (!ip || next <= frame) {
+            return depth >= skip;
+        }
+        frame = next;
+    }
+    return true;
+#else
+    (void)skip;
+    (void)site;
+    return false;
+#endif
+}
+
+__attribute__((noinline)) int Trace::unwindFramePointers(void** data, int maxSize)
+{
+#if HEAPTRACK_HAVE_FRAME_POINTER_UNWINDING
+    const auto& bounds = stackBounds();
+    auto frame = reinterpret_cast<uintptr_t>(__builtin_frame_address(0));
+    if (frame < bounds.low || frame >= bounds.high) {
+        // we are running on an alternate stack, e.g. a signal stack or a user-space fiber
+        return unwind(data, maxSize);
+    }
+
+    // every frame record consists of the caller's frame pointer followed by the return address
+    const auto frameRecordSize = 2 * sizeof(uintptr_t);
+    // like the other backends, the first frame points into the unwinder itself
+    data[0] = reinterpret_cast<void*>(&Trace::unwindFramePointers);
+    int size = 1;
+    while (size < maxSize && frame >= bounds.low && frame <= bounds.high - frameRecordSize
+           && frame % sizeof(uintptr_t) == 0) {
+        const auto record = reinterpret_cast<void* const*>(frame);
+        const auto ip = record[1];
+        if (!ip) {
+            break;
+        }
+        data[size++] = ip;
+
+        // the stack grows downwards, the chain must move strictly towards its top
+        const auto next = reinterpret_cast<uintptr_t>(record[0]);
+        if (next <= frame) {
+            break;
+        }
+        frame = next;
+    }
+    return size;
+#else
+    return unwind(data, maxSize);
+#endif
+}
@@ -62,7 +62,7 @@ void Trace::setup()
 #endif
 }
 
-int Trace::unwind(void** data)
+int Trace::unwind(void** data, int maxSize)
 {
-    return unw_backtrace(data, MAX_SIZE);
+    return unw_backtrace(data, maxSize);
 }
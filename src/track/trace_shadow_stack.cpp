@@ -0,0 +1,185 @@
+/*
+    SPDX-FileCopyrightText: 2026 Milian Wolff <mail@milianw.de>
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+/**
+ * @brief A backtrace read from the hardware shadow stack.
+ *
+ * With control-flow enforcement (CET), x86-64 CPUs push every return address onto a second,
+ * hardware-protected stack next to the regular one. That stack holds nothing but the return
+ * addresses, so reading it yields the complete backtrace without interpreting any unwind
+ * tables and independent of frame pointers.
+ *
+ * It only exists when the kernel and the C library enabled user space shadow stacks for
+ * the process, e.g. via GLIBC_TUNABLES=glibc.cpu.x86_shstk=on for binaries built with
+ * -fcf-protection. Otherwise, or when we are not on the shadow stack of the thread, the
+ * native unwinder is used instead.
+ */
+
+#include "trace.h"
+
+#include "util/macroutils.h"
+
+#if defined(__x86_64__) && defined(__linux__)
+#define HEAPTRACK_HAVE_SHADOW_STACK_UNWINDING 1
+#else
+#define HEAPTRACK_HAVE_SHADOW_STACK_UNWINDING 0
+#endif
+
+#if HEAPTRACK_HAVE_SHADOW_STACK_UNWINDING
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// from asm/prctl.h, which older kernel headers lack
+#ifndef ARCH_SHSTK_STATUS
+#define ARCH_SHSTK_STATUS 0x5005
+#endif
+#ifndef ARCH_SHSTK_SHSTK
+#define ARCH_SHSTK_SHSTK (1ULL << 0)
+#endif
+
+namespace {
+
+struct ShadowStackBounds
+{
+    uintptr_t low = 0;
+    uintptr_t high = 0;
+    bool initialized = false;
+};
+
+HEAPTRACK_INITIAL_EXEC_TLS thread_local ShadowStackBounds t_shadowStackBounds;
+
+/// @return the shadow stack pointer, or zero when the shadow stack is disabled
+__attribute__((always_inline)) inline uintptr_t shadowStackPointer()
+{
+    uintptr_t ssp = 0;
+    // this is a nop without an active shadow stack, which leaves ssp untouched
+    asm volatile("rdsspq %0" : "+r"(ssp));
+    return ssp;
+}
+
+/**
+ * Find the mapping that contains @p address in /proc/self/maps.
+ *
+ * We may be called from within malloc, so this only uses plain syscalls and a buffer on the stack.
+ */
+bool findMapping(uintptr_t address, uintptr_t* low, uintptr_t* high)
+{
+    const int fd = open("/proc/self/maps", O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+
+    // each line starts with "<start>-<end> ", everything after that gets skipped
+    enum
+    {
+        Start,
+        End,
+        Skip
+    } state = Start;
+    uintptr_t start = 0;
+    uintptr_t end = 0;
+    bool found = false;
+
+    char buffer[4096];
+    ssize_t size = 0;
+    while (!found && (size = read(fd, buffer, sizeof(buffer))) > 0) {
+        for (ssize_t i = 0; i < size && !found; ++i) {
+            const auto c = buffer[i];
+            if (state == Skip) {
+                if (c == '\n') {
+                    state = Start;
+                    start = 0;
+                    end = 0;
+                }
+                continue;
+            }
+            auto& value = state == Start ? start : end;
+            if (c >= '0' && c <= '9') {
+                value = value * 16 + (c - '0');
+            } else if (c >= 'a' && c <= 'f') {
+                value = value * 16 + (c - 'a' + 10);
+            } else if (state == Start && c == '-') {
+                state = End;
+            } else {
+                found = state == End && start <= address && address < end;
+                state = Skip;
+            }
+        }
+    }
+    close(fd);
+
+    if (found) {
+        *low = start;
+        *high = end;
+    }
+    return found;
+}
+
+const ShadowStackBounds& shadowStackBounds(uintptr_t ssp)
+{
+    auto& bounds = t_shadowStackBounds;
+    if (!bounds.initialized) {
+        // the shadow stack of a thread never moves, so looking it up once is enough
+        bounds.initialized = true;
+        findMapping(ssp, &bounds.low, &bounds.high);
+    }
+    return bounds;
+}
+}
+#endif
+
+bool Trace::hasShadowStack()
+{
+#if HEAPTRACK_HAVE_SHADOW_STACK_UNWINDING
+    unsigned long long features = 0;
+    if (syscall(SYS_arch_prctl, ARCH_SHSTK_STATUS, &features) != 0) {
+        return false;
+    }
+    return (features & ARCH_SHSTK_SHSTK) && shadowStackPointer();
+#else
+    return false;
+#endif
+}
+
+__attribute__((noinline)) int Trace::unwindShadowStack(void** data, int maxSize)
+{
+#if HEAPTRACK_HAVE_SHADOW_STACK_UNWINDING
+    const auto ssp = shadowStackPointer();
+    if (!ssp) {
+        return unwind(data, maxSize);
+    }
+    const auto& bounds = shadowStackBounds(ssp);
+    if (ssp < bounds.low || ssp >= bounds.high) {
+        // we are running on a different shadow stack, e.g. one of a ucontext
+        return unwind(data, maxSize);
+    }
+
+    // like the other backends, the first frame points into the unwinder itself
+    data[0] = reinterpret_cast<void*>(&Trace::unwindShadowStack);
+    int size = 1;
+    // the shadow stack grows downwards, the most recent return address is the one at ssp
+    for (auto entry = reinterpret_cast<const uintptr_t*>(ssp);
+         size < maxSize && reinterpret_cast<uintptr_t>(entry + 1) <= bounds.high; ++entry) {
+        const auto ip = *entry;
+        if (!ip) {
+            break;
+        }
+        if (ip >> 63) {
+            // the kernel marks the signal frames with the highest bit, they are no return addresses
+            continue;
+        }
+        if ((ip & 1) && ip - 1 >= bounds.low && ip - 1 < bounds.high) {
+            // a restore token left behind when switching the shadow stack, it points into the stack itself
+            continue;
+        }
+        data[size++] = reinterpret_cast<void*>(ip);
+    }
+    return size;
+#else
+    return unwind(data, maxSize);
+#endif
+}
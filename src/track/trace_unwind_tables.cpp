@@ -28,11 +28,12 @@ _Unwind_Reason_Code unwind_backtrace_callback(struct _Unwind_Context* context, v
     backtrace* trace = static_cast<backtrace*>(arg);
 
     uintptr_t pc = _Unwind_GetIP(context);
-    if (pc && trace->ctr < trace->max_size - 1) {
+    if (pc && trace->ctr < trace->max_size) {
         trace->data[trace->ctr++] = (void*)(pc);
     }
 
-    return _URC_NO_REASON;
+    // stop unwinding early once the maximum depth is reached
+    return trace->ctr < trace->max_size ? _URC_NO_REASON : _URC_END_OF_STACK;
 }
 
 }
@@ -50,11 +51,11 @@ void Trace::print()
     }
 }
 
-int Trace::unwind(void** data)
+int Trace::unwind(void** data, int maxSize)
 {
     backtrace trace;
     trace.data = data;
-    trace.max_size = MAX_SIZE;
+    trace.max_size = maxSize;
 
     _Unwind_Backtrace(unwind_backtrace_callback, &trace);
     return trace.ctr;
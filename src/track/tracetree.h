@@ -13,6 +13,7 @@
  */
 
 #include <algorithm>
+#include <utility>
 #include <vector>
 
 #include "trace.h"
@@ -20,12 +21,10 @@
 struct TraceEdge
 {
     Trace::ip_t instructionPointer;
-    // index associated to the backtrace up to this instruction pointer
-    // the evaluation process can then reverse-map the index to the parent ip
-    // to rebuild the backtrace from the bottom-up
-    uint32_t index;
-    // sorted list of children, assumed to be small
-    std::vector<TraceEdge> children;
+    // index of the first child in the arena, possibly or'ed with TraceTree::WIDE
+    uint32_t firstChild;
+    // index of the next child of the same parent in the arena
+    uint32_t nextSibling;
 };
 
 /**
@@ -33,14 +32,28 @@ struct TraceEdge
  *
  * This is supposed to be a memory efficient storage of all instruction pointers
  * ever encountered in any backtrace.
+ *
+ * All edges are stored in one arena, where the position of an edge is the index
+ * associated to the backtrace up to its instruction pointer. The evaluation process
+ * can then reverse-map the index to the parent ip to rebuild the backtrace from
+ * the bottom-up. Children are linked through the arena so that a chain of
+ * edges created by a single backtrace is laid out contiguously. Nodes with many
+ * children additionally get their children put into an open-addressing hash
+ * keyed by (parent index, ip), so lookups stay O(1) for wide nodes.
  */
 class TraceTree
 {
 public:
+    TraceTree()
+    {
+        clear();
+    }
+
     void clear()
     {
-        m_root.children.clear();
-        m_index = 1;
+        std::vector<TraceEdge>(1, TraceEdge {nullptr, 0, 0}).swap(m_edges);
+        std::vector<WideChild>().swap(m_wideChildren);
+        m_numWideChildren = 0;
     }
 
     /**
@@ -53,31 +66,215 @@ public:
     uint32_t index(const Trace& trace, Fun callback)
     {
         uint32_t index = 0;
-        TraceEdge* parent = &m_root;
         for (int i = trace.size() - 1; i >= 0; --i) {
             const auto ip = trace[i];
             if (!ip) {
                 continue;
             }
-            auto it =
-                std::lower_bound(parent->children.begin(), parent->children.end(), ip,
-                                 [](const TraceEdge& l, const Trace::ip_t ip) { return l.instructionPointer < ip; });
-            if (it == parent->children.end() || it->instructionPointer != ip) {
-                index = m_index++;
-                it = parent->children.insert(it, {ip, index, {}});
-                if (!callback(reinterpret_cast<uintptr_t>(ip), parent->index)) {
+            const auto parent = index;
+            index = findChild(parent, ip);
+            if (!index) {
+                index = insertChild(parent, ip);
+                if (!callback(reinterpret_cast<uintptr_t>(ip), parent)) {
                     return 0;
                 }
             }
-            index = it->index;
-            parent = &(*it);
         }
         return index;
     }
 
+    /// @return the index of @p trace, or zero when parts of it are not known yet
+    uint32_t find(const Trace& trace) const
+    {
+        uint32_t index = 0;
+        for (int i = trace.size() - 1; i >= 0; --i) {
+            const auto ip = trace[i];
+            if (!ip) {
+                continue;
+            }
+            index = findChild(index, ip);
+            if (!index) {
+                return 0;
+            }
+        }
+        return index;
+    }
+
+    /// @return the number of bytes allocated for the tree, see HEAPTRACK_TRACE_TREE_LIMIT
+    size_t memoryUsage() const
+    {
+        return m_edges.capacity() * sizeof(TraceEdge) + m_wideChildren.capacity() * sizeof(WideChild);
+    }
+
+    enum : uint32_t
+    {
+        // flags a node whose children are found via the wide children hash
+        WIDE = 1u << 31,
+        // nodes with more children than this get converted to wide nodes
+        MAX_LINKED_CHILDREN = 8,
+    };
+
+private:
+    struct WideChild
+    {
+        uint32_t parent;
+        // zero marks an empty slot
+        uint32_t index;
+    };
+
+    uint32_t findChild(uint32_t parent, Trace::ip_t ip) const
+    {
+        const auto firstChild = m_edges[parent].firstChild;
+        if (firstChild & WIDE) {
+            return m_wideChildren[wideSlot(parent, ip)].index;
+        }
+        for (auto child = firstChild; child; child = m_edges[child].nextSibling) {
+            if (m_edges[child].instructionPointer == ip) {
+                return child;
+            }
+        }
+        return 0;
+    }
+
+    uint32_t insertChild(uint32_t parent, Trace::ip_t ip)
+    {
+        const auto index = static_cast<uint32_t>(m_edges.size());
+        const auto firstChild = m_edges[parent].firstChild;
+        if (firstChild & WIDE) {
+            m_edges.push_back({ip, 0, 0});
+            insertWideChild(parent, index);
+            return index;
+        }
+
+        m_edges.push_back({ip, 0, firstChild});
+        m_edges[parent].firstChild = index;
+
+        uint32_t numChildren = 0;
+        for (auto child = index; child; child = m_edges[child].nextSibling) {
+            ++numChildren;
+        }
+        if (numChildren > MAX_LINKED_CHILDREN) {
+            for (auto child = index; child; child = m_edges[child].nextSibling) {
+                insertWideChild(parent, child);
+            }
+            m_edges[parent].firstChild = WIDE;
+        }
+        return index;
+    }
+
+    static uint64_t hash(uint32_t parent, Trace::ip_t ip)
+    {
+        // combine both keys, then apply the murmur3 finalizer to spread them over all bits
+        auto h = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(ip)) * 0x9e3779b97f4a7c15ull + parent;
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdull;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ull;
+        h ^= h >> 33;
+        return h;
+    }
+
+    /**
+     * @return the slot of the child of @p parent for @p ip, or the empty slot where it should get inserted
+     */
+    size_t wideSlot(uint32_t parent, Trace::ip_t ip) const
+    {
+        const auto mask = m_wideChildren.size() - 1;
+        auto slot = hash(parent, ip) & mask;
+        while (true) {
+            const auto& child = m_wideChildren[slot];
+            if (!child.index || (child.parent == parent && m_edges[child.index].instructionPointer == ip)) {
+                return slot;
+            }
+            slot = (slot + 1) & mask;
+        }
+    }
+
+    void insertWideChild(uint32_t parent, uint32_t index)
+    {
+        if (2 * (m_numWideChildren + 1) > m_wideChildren.size()) {
+            std::vector<WideChild> children(std::max<size_t>(INITIAL_WIDE_CAPACITY, m_wideChildren.size() * 2));
+            std::swap(children, m_wideChildren);
+            for (const auto& child : children) {
+                if (child.index) {
+                    m_wideChildren[wideSlot(child.parent, m_edges[child.index].instructionPointer)] = child;
+                }
+            }
+        }
+        m_wideChildren[wideSlot(parent, m_edges[index].instructionPointer)] = {parent, index};
+        ++m_numWideChildren;
+    }
+
+    enum : size_t
+    {
+        // must be a power of two
+        INITIAL_WIDE_CAPACITY = 1024
+    };
+
+    // the edge at position zero is the root, all others are indexed by their position
+    std::vector<TraceEdge> m_edges;
+    std::vector<WideChild> m_wideChildren;
+    size_t m_numWideChildren = 0;
+};
+
+/**
+ * A TraceTree whose nodes get indices out of an index space that is shared with other shards.
+ *
+ * This allows every thread to have its own tree, which is only ever accessed by that thread,
+ * such that known traces can be found without any synchronization. The same trace node may
+ * be part of multiple shards, with different indices.
+ */
+class TraceShard
+{
+public:
+    TraceShard()
+        : m_indices(1, 0)
+    {
+    }
+
+    void clear()
+    {
+        m_tree.clear();
+        std::vector<uint32_t>(1, 0).swap(m_indices);
+    }
+
+    /// @return the shared index of @p trace, or zero when parts of it are not known yet
+    uint32_t find(const Trace& trace) const
+    {
+        return m_indices[m_tree.find(trace)];
+    }
+
+    /**
+     * Like TraceTree::index, but the @p callback gets the shared index of the parent and returns
+     * the shared index for the new node, or zero when that failed.
+     */
+    template <typename Fun>
+    uint32_t index(const Trace& trace, Fun callback)
+    {
+        bool failed = false;
+        const auto index = m_tree.index(trace, [&](uintptr_t ip, uint32_t parent) {
+            const auto sharedIndex = callback(ip, m_indices[parent]);
+            m_indices.push_back(sharedIndex);
+            failed = !sharedIndex;
+            return !failed;
+        });
+        if (failed) {
+            // the new nodes would stay unknown to the other side forever
+            clear();
+            return 0;
+        }
+        return m_indices[index];
+    }
+
+    size_t memoryUsage() const
+    {
+        return m_tree.memoryUsage() + m_indices.capacity() * sizeof(uint32_t);
+    }
+
 private:
-    TraceEdge m_root = {0, 0, {}};
-    uint32_t m_index = 1;
+    TraceTree m_tree;
+    // the shared index for every index of m_tree
+    std::vector<uint32_t> m_indices;
 };
 
 #endif // TRACETREE_H
@@ -14,12 +14,20 @@
 #define HEAPTRACK_VERSION ((HEAPTRACK_VERSION_MAJOR<<16)|(HEAPTRACK_VERSION_MINOR<<8)|(HEAPTRACK_VERSION_PATCH))
 
 #define HEAPTRACK_FILE_FORMAT_VERSION @HEAPTRACK_FILE_FORMAT_VERSION@
+// starting with this version, the raw tracker output encodes the +, - and t records in binary
+#define HEAPTRACK_BINARY_FILE_FORMAT_VERSION 4
+
+// the outermost instruction pointer of traces that got truncated at the maximum unwind depth
+#define HEAPTRACK_TRUNCATED_TRACE_IP (~static_cast<uintptr_t>(0) - 1)
 
 #define HEAPTRACK_DEBUG_BUILD @HEAPTRACK_DEBUG_BUILD@
 
+#cmakedefine01 HEAPTRACK_USE_FRAME_POINTERS
+
 // cfree() does not exist in glibc 2.26+.
 // See: https://bugs.kde.org/show_bug.cgi?id=383889
 #cmakedefine01 HAVE_CFREE
 #cmakedefine01 HAVE_VALLOC
+#cmakedefine01 HAVE_FREE_SIZED
 
 #endif // HEAPTRACK_CONFIG_H
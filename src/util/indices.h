@@ -86,6 +86,12 @@ struct AllocationIndex : public Index<AllocationIndex>
 struct AllocationInfoIndex : public Index<AllocationInfoIndex>
 {
 };
+struct ThreadIndex : public Index<ThreadIndex>
+{
+};
+struct PoolIndex : public Index<PoolIndex>
+{
+};
 
 struct IndexHasher
 {
@@ -7,55 +7,197 @@
 #ifndef LINEREADER_H
 #define LINEREADER_H
 
+#include <algorithm>
 #include <cstdint>
+#include <cstdio>
+#include <cstring>
 #include <istream>
+#include <memory>
 #include <string>
 
+#include "macroutils.h"
+
 /**
  * Optimized class to speed up reading of the potentially big data files.
  *
  * sscanf or istream are just slow when reading plain hex numbers. The
  * below does all we need and thus far less than what the generic functions
  * are capable of. We are not locale aware e.g.
+ *
+ * The data is read from the stream in large blocks, the lines are then found
+ * with memchr and parsed in place without copying them. The reader only blocks
+ * for more data when it has no complete line buffered anymore, which keeps it
+ * usable for pipes that get written to by a live process.
+ *
+ * Data that got buffered from one stream is discarded when the reader gets
+ * passed another stream.
  */
 class LineReader
 {
 public:
     LineReader()
+        : m_buffer(new char[BUFFER_SIZE + 1])
+        , m_capacity(BUFFER_SIZE)
     {
-        m_line.reserve(1024);
     }
 
     bool getLine(std::istream& in)
     {
-        if (!in.good()) {
+        setStream(in);
+        m_isBinary = false;
+
+        size_t searched = 0;
+        size_t newline = 0;
+        while (true) {
+            const auto begin = m_buffer.get() + m_pos;
+            if (auto found = static_cast<const char*>(memchr(begin + searched, '\n', m_end - m_pos - searched))) {
+                newline = m_pos + (found - begin);
+                break;
+            }
+            searched = m_end - m_pos;
+            if (!fill(in)) {
+                if (m_pos == m_end) {
+                    return false;
+                }
+                // the last line lacks a trailing newline, the buffer has room for the terminator
+                newline = m_end;
+                break;
+            }
+        }
+
+        setLine(m_buffer.get() + m_pos, m_buffer.get() + newline);
+        m_pos = std::min(newline + 1, m_end);
+        return true;
+    }
+
+    /**
+     * Read the next record, which is either a text line or, when enabled via
+     * setExpectBinaryRecords, a binary record as written by LineWriter::writeVarintRecord.
+     *
+     * The fields of binary records can be read with the same operators as the
+     * hex numbers of text lines.
+     */
+    HEAPTRACK_PERF_FUNCTION bool getRecord(std::istream& in)
+    {
+        if (!m_expectBinaryRecords) {
+            return getLine(in);
+        }
+
+        setStream(in);
+        if (!ensureBuffered(in, 1)) {
             return false;
         }
-        std::getline(in, m_line);
-        m_it = m_line.cbegin();
-        if (m_line.length() > 2) {
-            m_it += 2;
-        } else {
-            m_it = m_line.cend();
+        const auto type = static_cast<unsigned char>(m_buffer[m_pos]);
+        if (!(type & 0x80)) {
+            return getLine(in);
+        }
+
+        const bool hasSize = ensureBuffered(in, 2);
+        const int size = hasSize ? static_cast<unsigned char>(m_buffer[m_pos + 1]) : 0;
+        if (!hasSize || size > MAX_BINARY_RECORD_SIZE || !ensureBuffered(in, 2 + size)) {
+            in.setstate(std::ios_base::eofbit | std::ios_base::failbit);
+            m_pos = m_end;
+            return false;
+        }
+        const auto* data = m_buffer.get() + m_pos + 2;
+        m_pos += 2 + size;
+
+        m_isBinary = true;
+        m_binaryMode[0] = static_cast<char>(type & 0x7f);
+        setLine(m_binaryMode, m_binaryMode + 1);
+        m_numFields = 0;
+        m_fieldIndex = 0;
+        uint64_t value = 0;
+        unsigned shift = 0;
+        for (int i = 0; i < size; ++i) {
+            const auto byte = static_cast<unsigned char>(data[i]);
+            value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if (byte & 0x80) {
+                shift += 7;
+                continue;
+            }
+            if (m_numFields < MAX_BINARY_FIELDS) {
+                m_fields[m_numFields] = value;
+            }
+            ++m_numFields;
+            value = 0;
+            shift = 0;
+        }
+        if (shift || m_numFields > MAX_BINARY_FIELDS) {
+            fprintf(stderr, "malformed binary record of type %c\n", m_binaryMode[0]);
+            m_numFields = 0;
         }
         return true;
     }
 
+    void setExpectBinaryRecords(bool expectBinaryRecords)
+    {
+        m_expectBinaryRecords = expectBinaryRecords;
+    }
+
+    /**
+     * @return true when the current record was binary encoded
+     */
+    bool isBinary() const
+    {
+        return m_isBinary;
+    }
+
+    /**
+     * inverse of LineWriter::zigzag
+     */
+    static int64_t unzigzag(uint64_t value)
+    {
+        return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+    }
+
     char mode() const
     {
-        return m_line.empty() ? '#' : m_line[0];
+        return m_lineBegin == m_lineEnd ? '#' : *m_lineBegin;
     }
 
+    /**
+     * @return a copy of the current line, prefer rawLine() in hot code
+     */
     const std::string& line() const
     {
+        if (!m_lineCopied) {
+            m_line.assign(m_lineBegin, m_lineEnd);
+            m_lineCopied = true;
+        }
         return m_line;
     }
 
+    /**
+     * @return the null-terminated current line, which stays valid until the next line gets read
+     */
+    const char* rawLine() const
+    {
+        return m_lineBegin;
+    }
+
+    /**
+     * @return the offset of the current text line from the start of the stream
+     */
+    uint64_t lineOffset() const
+    {
+        return m_streamBytes - m_end + static_cast<uint64_t>(m_lineBegin - m_buffer.get());
+    }
+
     template <typename T>
-    bool readHex(T& in)
+    HEAPTRACK_PERF_FUNCTION bool readHex(T& in)
     {
+        if (m_isBinary) {
+            if (m_fieldIndex >= m_numFields) {
+                return false;
+            }
+            in = static_cast<T>(m_fields[m_fieldIndex]);
+            ++m_fieldIndex;
+            return true;
+        }
+
         auto it = m_it;
-        const auto end = m_line.cend();
+        const auto end = m_lineEnd;
         if (it == end) {
             return false;
         }
@@ -73,7 +215,7 @@ public:
                 ++it;
                 break;
             } else {
-                fprintf(stderr, "unexpected non-hex char: %d %zx\n", c, std::distance(m_line.cbegin(), it));
+                fprintf(stderr, "unexpected non-hex char: %d %zx\n", c, it - m_lineBegin);
                 return false;
             }
             ++it;
@@ -113,13 +255,13 @@ public:
     {
         if (m_expectSizedStrings) {
             uint64_t size = 0;
-            if (!(*this >> size) || size > static_cast<uint64_t>(std::distance(m_it, m_line.cend()))) {
+            if (!(*this >> size) || size > static_cast<uint64_t>(m_lineEnd - m_it)) {
                 return false;
             }
             auto start = m_it;
             m_it += size;
             str.assign(start, m_it);
-            if (m_it != m_line.cend()) {
+            if (m_it != m_lineEnd) {
                 // eat trailing whitespace
                 ++m_it;
             }
@@ -127,13 +269,13 @@ public:
         }
 
         auto it = m_it;
-        const auto end = m_line.cend();
+        const auto end = m_lineEnd;
         while (it != end && *it != ' ') {
             ++it;
         }
         if (it != m_it) {
-            str = std::string(m_it, it);
-            if (*it == ' ') {
+            str.assign(m_it, it);
+            if (it != end) {
                 ++it;
             }
             m_it = it;
@@ -145,7 +287,7 @@ public:
 
     bool operator>>(bool& flag)
     {
-        if (m_it != m_line.cend()) {
+        if (m_it != m_lineEnd) {
             flag = *m_it;
             m_it++;
             if (*m_it == ' ') {
@@ -158,9 +300,121 @@ public:
     }
 
 private:
+    enum
+    {
+        MAX_BINARY_FIELDS = 8,
+        MAX_BINARY_RECORD_SIZE = 127,
+        BUFFER_SIZE = 256 * 1024
+    };
+
+    void setStream(std::istream& in)
+    {
+        if (m_stream != &in) {
+            m_stream = &in;
+            m_pos = 0;
+            m_end = 0;
+            m_streamBytes = 0;
+        }
+    }
+
+    void setLine(char* begin, char* end)
+    {
+        // we always have room for the terminator, either in place of the newline or behind the data
+        *end = '\0';
+        m_lineBegin = begin;
+        m_lineEnd = end;
+        m_lineCopied = false;
+        m_it = (end - begin > 2) ? begin + 2 : end;
+    }
+
+    /// read until at least @p size bytes are buffered, @return false when the stream ends before that
+    bool ensureBuffered(std::istream& in, size_t size)
+    {
+        while (m_end - m_pos < size) {
+            if (!fill(in)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Append more data from @p in to the buffer, moving the unread data to its front first.
+     *
+     * We read as much as the stream has available right away, and only block for
+     * more data when nothing is available at all.
+     *
+     * @return false when the stream has no more data
+     */
+    bool fill(std::istream& in)
+    {
+        if (m_pos) {
+            memmove(m_buffer.get(), m_buffer.get() + m_pos, m_end - m_pos);
+            m_end -= m_pos;
+            m_pos = 0;
+        }
+        if (m_end == m_capacity) {
+            // a single line doesn't fit into the buffer
+            std::unique_ptr<char[]> buffer(new char[m_capacity * 2 + 1]);
+            memcpy(buffer.get(), m_buffer.get(), m_end);
+            m_buffer = std::move(buffer);
+            m_capacity *= 2;
+        }
+
+        auto* streamBuffer = in.rdbuf();
+        if (!streamBuffer || !in.good()) {
+            return false;
+        }
+        size_t numRead = 0;
+        while (m_end < m_capacity) {
+            auto available = streamBuffer->in_avail();
+            if (available <= 0) {
+                if (numRead) {
+                    break;
+                } else if (streamBuffer->sgetc() == std::char_traits<char>::eof()) {
+                    in.setstate(std::ios_base::eofbit);
+                    return false;
+                }
+                available = std::max<std::streamsize>(streamBuffer->in_avail(), 1);
+            }
+            const auto size = std::min<std::streamsize>(available, m_capacity - m_end);
+            const auto ret = streamBuffer->sgetn(m_buffer.get() + m_end, size);
+            if (ret <= 0) {
+                break;
+            }
+            m_end += ret;
+            numRead += ret;
+        }
+        m_streamBytes += numRead;
+        return numRead > 0;
+    }
+
     bool m_expectSizedStrings = false;
-    std::string m_line;
-    std::string::const_iterator m_it;
+    bool m_expectBinaryRecords = false;
+    bool m_isBinary = false;
+    int m_numFields = 0;
+    int m_fieldIndex = 0;
+    uint64_t m_fields[MAX_BINARY_FIELDS];
+    char m_binaryMode[2] = {};
+
+    /// the data read from m_stream, holding one more byte than m_capacity for a terminator
+    std::unique_ptr<char[]> m_buffer;
+    size_t m_capacity = 0;
+    /// the unread data is in [m_pos, m_end)
+    size_t m_pos = 0;
+    size_t m_end = 0;
+    const std::istream* m_stream = nullptr;
+    /// number of bytes read from m_stream so far
+    uint64_t m_streamBytes = 0;
+
+    /// the current line, which is null-terminated
+    char* m_lineBegin = m_binaryMode;
+    char* m_lineEnd = m_binaryMode;
+    const char* m_it = m_binaryMode;
+
+    /// lazily filled copy of the current line, see line()
+    mutable std::string m_line;
+    mutable bool m_lineCopied = false;
 };
 
 #endif // LINEREADER_H
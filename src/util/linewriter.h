@@ -8,34 +8,80 @@
 #define LINEWRITER_H
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <iterator>
 #include <memory>
+#include <mutex>
 #include <type_traits>
 
 #include <cassert>
 #include <climits>
 #include <cmath>
+#include <cstdint>
 #include <cstring>
 #include <string>
 
 #include <errno.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
+#include "macroutils.h"
+#include "shmring.h"
+
 /**
  * Custom buffered I/O writer for high performance and signal safety
  * See e.g.: https://bugs.kde.org/show_bug.cgi?id=393387
+ *
+ * When asynchronous flushing is enabled, full buffers are only queued up
+ * and another thread is responsible for writing them out via drain().
+ *
+ * When shared memory is enabled, the data is written into a ShmRing instead
+ * of the file descriptor.
+ *
+ * When a Sink is set, the data is handed to it instead, e.g. to compress it
+ * before it gets written to the file descriptor.
  */
 class LineWriter
 {
 public:
+    /**
+     * Receives the buffered data of a LineWriter, see setSink().
+     */
+    class Sink
+    {
+    public:
+        virtual ~Sink() = default;
+        /// handle the next @p size bytes of @p data
+        virtual bool write(const char* data, size_t size) = 0;
+        /// called once when the writer gets closed, after all data was written
+        virtual bool finish() = 0;
+    };
+
+    /**
+     * Counters of the data that got written out, can be read from any thread.
+     */
+    struct WriteStats
+    {
+        /// number of buffers that got written out
+        std::atomic<uint64_t> flushes {0};
+        std::atomic<uint64_t> bytes {0};
+        /// time spent in the calls that write the data, e.g. while the pipe is full
+        std::atomic<uint64_t> blockedNs {0};
+    };
+
     enum
     {
-        BUFFER_CAPACITY = PIPE_BUF
+        BUFFER_CAPACITY = PIPE_BUF,
+        // number of buffers used when flushing asynchronously, this bounds the memory we use
+        ASYNC_BUFFERS = 16
     };
 
     LineWriter(int fd)
         : fd(fd)
         , buffer(new char[BUFFER_CAPACITY])
+        , current(buffer.get())
     {
         memset(buffer.get(), 0, BUFFER_CAPACITY);
     }
@@ -122,11 +168,12 @@ public:
                 return false;
             }
             if (availableSpace() < length) {
-                int ret = 0;
-                do {
-                    ret = ::write(fd, line.data(), length);
-                } while (ret < 0 && errno == EINTR);
-                return ret >= 0;
+                if (!async) {
+                    return writeOut(line.data(), length);
+                }
+                // all queued buffers must be written before the string
+                std::lock_guard<std::mutex> lock(async->drainMutex);
+                return writeQueuedBuffers() && writeOut(line.data(), length);
             }
         }
         memcpy(out(), line.data(), length);
@@ -176,6 +223,81 @@ public:
         return true;
     }
 
+    /**
+     * write one of the hot heaptrack records in the binary encoding
+     *
+     * @arg type char that identifies the type of the record, written with its high bit set
+     * @arg args are all written as unsigned LEB128 varints, prefixed by their total size in bytes
+     *
+     * This is only used for the raw tracker output and requires file format version 4 or higher.
+     * Signed values, such as deltas, should be passed through zigzag() first.
+     */
+    template <typename... T>
+    bool writeVarintRecord(const char type, T... args)
+    {
+        constexpr const int numArgs = sizeof...(T);
+        constexpr const int maxBytesPerArg = 10; // 64 / 7, rounded up
+        constexpr const int maxBytesForArgs = numArgs * maxBytesPerArg;
+        constexpr const int otherBytes = 2; // type and size
+        constexpr const int totalMaxBytes = otherBytes + maxBytesForArgs;
+        static_assert(maxBytesForArgs < 128, "binary record payload size must fit into a single varint byte");
+        static_assert(totalMaxBytes < BUFFER_CAPACITY, "cannot write record larger than buffer capacity");
+
+        if (totalMaxBytes > availableSpace() && !flush()) {
+            return false;
+        }
+
+        auto* buffer = out();
+        const auto* start = buffer;
+
+        *buffer = static_cast<char>(type | 0x80);
+        ++buffer;
+
+        auto* size = buffer;
+        ++buffer;
+
+        buffer = writeVarints(buffer, args...);
+        *size = static_cast<char>(buffer - size - 1);
+
+        bufferSize += buffer - start;
+
+        return true;
+    }
+
+    /**
+     * map signed values to unsigned ones, such that small absolute values yield small varints
+     */
+    static uint64_t zigzag(int64_t value)
+    {
+        return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+    }
+
+    template <typename V>
+    static char* writeVarint(char* buffer, V value)
+    {
+        static_assert(std::is_unsigned<V>::value, "can only write unsigned numbers as varints");
+        while (value >= 0x80) {
+            *buffer = static_cast<char>(value | 0x80);
+            ++buffer;
+            value >>= 7;
+        }
+        *buffer = static_cast<char>(value);
+        return buffer + 1;
+    }
+
+    template <typename V>
+    static char* writeVarints(char* buffer, V value)
+    {
+        return writeVarint(buffer, value);
+    }
+
+    template <typename V, typename... T>
+    static char* writeVarints(char* buffer, V value, T... args)
+    {
+        buffer = writeVarint(buffer, value);
+        return writeVarints(buffer, args...);
+    }
+
     inline static unsigned clz(unsigned V)
     {
         return __builtin_clz(V);
@@ -191,6 +313,35 @@ public:
         return __builtin_clzll(V);
     }
 
+    /// expand the eight nibbles of @p value into eight bytes, the most significant one becoming the highest byte
+    inline static uint64_t spreadNibbles(uint32_t value)
+    {
+        uint64_t v = value;
+        v = ((v & 0xffff0000ull) << 16) | (v & 0x0000ffffull);
+        v = ((v & 0x0000ff000000ff00ull) << 8) | (v & 0x000000ff000000ffull);
+        v = ((v & 0x00f000f000f000f0ull) << 4) | (v & 0x000f000f000f000full);
+        return v;
+    }
+
+    /// convert the eight nibble bytes of @p nibbles into eight hex chars in memory order
+    inline static uint64_t nibblesToHexChars(uint64_t nibbles)
+    {
+        // every byte is below 16, so adding 6 carries into its fifth bit exactly for the letters
+        const auto letters = ((nibbles + 0x0606060606060606ull) >> 4) & 0x0101010101010101ull;
+        const auto chars = nibbles + 0x3030303030303030ull + letters * ('a' - '0' - 10);
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        return __builtin_bswap64(chars);
+#else
+        return chars;
+#endif
+    }
+
+    /**
+     * Write @p value as a hex number without leading zeros.
+     *
+     * This always stores 16 chars, so there must be space for them even when the number is shorter.
+     * The chars after the returned end are garbage, which the next write overwrites.
+     */
     template <typename V>
     static char* writeHexNumber(char* buffer, V value)
     {
@@ -199,32 +350,18 @@ public:
         constexpr const unsigned numBits = sizeof(value) * 8;
         static_assert(numBits <= 64, "only up to 64bit of input are supported");
 
-        // clz is undefined for 0, so handle that manually
-        const unsigned zeroBits = value ? clz(value) : numBits;
-        assert(zeroBits <= numBits);
-
-        const unsigned usedBits = numBits - zeroBits;
-        // 2^(usedBits) = 16^(requiredBufSize) = 2^(4 * requiredBufSize)
-        // usedBits = 4 * requiredBufSize
-        // requiredBufSize = usedBits / 4
-        // but we need to round up, so actually use (usedBits + 3) / 4
-        // and for 0 input, we still need one char, so use at least 1
-        const unsigned requiredBufSize = std::max(1u, (usedBits + 3) / 4);
-        assert(requiredBufSize <= 16);
-
-        constexpr const char hexChars[16] = {'0', '1', '2', '3', '4', '5', '6', '7',
-                                             '8', '9', 'a', 'b', 'c', 'd', 'e', 'f'};
-
-        char* out = buffer + requiredBufSize - 1;
-        while (value >= 16) {
-            const auto rest = value % 16;
-            value /= 16;
-
-            *out = hexChars[rest];
-            --out;
-        }
-        *out = hexChars[value];
-        assert(out == buffer);
+        uint64_t bits = value;
+        // clz is undefined for 0, so handle that manually, we still need one char for it
+        const unsigned zeroNibbles = bits ? clz(bits) / 4 : 15;
+        const unsigned requiredBufSize = 16 - zeroNibbles;
+        assert(requiredBufSize >= 1 && requiredBufSize <= 16);
+
+        // align the used nibbles to the front, then expand all of them at once without branching on them
+        bits <<= zeroNibbles * 4;
+        const auto high = nibblesToHexChars(spreadNibbles(static_cast<uint32_t>(bits >> 32)));
+        const auto low = nibblesToHexChars(spreadNibbles(static_cast<uint32_t>(bits)));
+        memcpy(buffer, &high, sizeof(high));
+        memcpy(buffer + sizeof(high), &low, sizeof(low));
 
         return buffer + requiredBufSize;
     }
@@ -244,34 +381,391 @@ public:
         return writeHexNumbers(buffer, args...);
     }
 
+    /**
+     * Write out the current buffer.
+     *
+     * When flushing asynchronously, the buffer only gets queued up for drain().
+     * If all buffers are queued already, we drain them in the calling thread.
+     */
     bool flush()
     {
         if (!canWrite()) {
             return false;
         } else if (!bufferSize) {
             return true;
+        } else if (!async) {
+            if (!writeOut(buffer.get(), bufferSize)) {
+                return false;
+            }
+            bufferSize = 0;
+            return true;
+        } else if (async->failed.load(std::memory_order_relaxed)) {
+            return false;
         }
 
-        int ret = 0;
-        do {
-            ret = ::write(fd, buffer.get(), bufferSize);
-        } while (ret < 0 && errno == EINTR);
+        const auto filled = async->filled.load(std::memory_order_relaxed);
+        async->sizes[filled % ASYNC_BUFFERS] = bufferSize;
+        async->filled.store(filled + 1, std::memory_order_release);
+        {
+            // synchronize with waitForData to not lose the wakeup
+            std::lock_guard<std::mutex> lock(async->waitMutex);
+        }
+        async->dataAvailable.notify_one();
 
-        if (ret < 0) {
+        bufferSize = 0;
+        if (filled + 1 - async->drained.load(std::memory_order_acquire) >= ASYNC_BUFFERS && !drain()) {
+            // the flusher fell behind and the next buffer is still queued
             return false;
         }
+        current = async->buffers[(filled + 1) % ASYNC_BUFFERS];
+        return true;
+    }
 
-        bufferSize = 0;
+    /**
+     * Only queue up full buffers from now on, instead of writing them out directly.
+     *
+     * Another thread should then call waitForData() and drain() regularly. This
+     * must be called before any other thread accesses this writer.
+     */
+    void enableAsyncFlushing()
+    {
+        if (async) {
+            return;
+        }
+        async.reset(new AsyncBuffers);
+        memcpy(async->buffers[0], buffer.get(), bufferSize);
+        current = async->buffers[0];
+    }
+
+    bool isAsync() const
+    {
+        return async != nullptr;
+    }
+
+    /**
+     * Write all data into a new ShmRing named @p name from now on.
+     *
+     * The name of the ring gets announced via an 'M' line on the file descriptor,
+     * which must be kept open for the reader to notice when we are gone.
+     * This must be called before enableAsyncFlushing.
+     *
+     * @return false when shared memory is not available, we keep writing to the file descriptor then
+     */
+    bool enableSharedMemory(const std::string& name)
+    {
+        assert(!async);
+        if (ring || !flush()) {
+            return false;
+        }
+        ring.reset(ShmRing::create(name));
+        if (!ring) {
+            return false;
+        }
+        const auto announcement = "M " + name + '\n';
+        if (!writeAll(fd, announcement.data(), announcement.size())) {
+            ring.reset();
+            return false;
+        }
+        return true;
+    }
+
+    bool isSharedMemory() const
+    {
+        return ring != nullptr;
+    }
+
+    /**
+     * Pass all data to @p sink from now on, which takes ownership of it.
+     *
+     * Data that is buffered already gets written to the file descriptor first.
+     * This must not be combined with asynchronous flushing or shared memory.
+     */
+    bool setSink(std::unique_ptr<Sink> newSink)
+    {
+        assert(!async && !ring);
+        if (!flush()) {
+            return false;
+        }
+        sink = std::move(newSink);
+        return true;
+    }
+
+    /**
+     * Write into @p target instead of the file descriptor from now on, pass nullptr to undo this.
+     *
+     * Data that is buffered already gets written to the previous target first.
+     */
+    bool redirect(std::string* target)
+    {
+        assert(!async);
+        if (!flush()) {
+            return false;
+        }
+        capture = target;
+        return true;
+    }
 
+    /**
+     * write @p size bytes of @p data verbatim
+     */
+    bool writeRaw(const char* data, size_t size)
+    {
+        if (size > availableSpace()) {
+            if (!flush()) {
+                return false;
+            }
+            if (size > availableSpace()) {
+                return writeOut(data, size);
+            }
+        }
+        memcpy(out(), data, size);
+        bufferSize += size;
         return true;
     }
 
+    /**
+     * Wait until a buffer got queued or @p deadline is reached.
+     *
+     * @return true when there are buffers to drain
+     */
+    template <typename Clock, typename Duration>
+    bool waitForData(const std::chrono::time_point<Clock, Duration>& deadline)
+    {
+        if (!async) {
+            return false;
+        }
+        std::unique_lock<std::mutex> lock(async->waitMutex);
+        return async->dataAvailable.wait_until(lock, deadline, [this]() { return hasQueuedBuffers(); });
+    }
+
+    /**
+     * Write out all queued buffers, can be called from any thread.
+     */
+    bool drain()
+    {
+        if (!async) {
+            return true;
+        }
+        std::lock_guard<std::mutex> lock(async->drainMutex);
+        return writeQueuedBuffers();
+    }
+
+    /**
+     * Write out the queued and the current buffer from a signal handler.
+     *
+     * Unlike flush() and drain(), this neither waits for a lock nor wakes up the thread that drains
+     * the asynchronous buffers. When that thread is busy writing, we give up instead. The writer
+     * must not be used for anything but close() or abandon() afterwards.
+     */
+    bool flushFromSignalHandler()
+    {
+        if (!canWrite()) {
+            return false;
+        }
+        if (async) {
+            if (!async->drainMutex.try_lock()) {
+                return false;
+            }
+            std::lock_guard<std::mutex> lock(async->drainMutex, std::adopt_lock);
+            if (!writeQueuedBuffers()) {
+                return false;
+            }
+        }
+        if (!bufferSize) {
+            return true;
+        }
+        const auto ret = writeOut(current, bufferSize);
+        bufferSize = 0;
+        return ret;
+    }
+
     bool canWrite() const
     {
         return fd != -1;
     }
 
+    const WriteStats& writeStats() const
+    {
+        return stats;
+    }
+
     void close()
+    {
+        if (async) {
+            flush();
+            std::lock_guard<std::mutex> lock(async->drainMutex);
+            writeQueuedBuffers();
+            closeRing();
+            closeFd();
+        } else {
+            if (ring) {
+                flush();
+                closeRing();
+            }
+            if (sink) {
+                flush();
+                sink->finish();
+                sink.reset();
+            }
+            closeFd();
+        }
+    }
+
+    /**
+     * Close the file descriptor without writing out anything.
+     *
+     * This is meant for forked child processes, which must neither write the buffered
+     * data of their parent nor touch its shared memory ring or asynchronous buffers.
+     * That state gets leaked intentionally, as it may be locked by threads that don't
+     * exist in the child.
+     */
+    void abandon()
+    {
+        bufferSize = 0;
+        current = buffer.get();
+        capture = nullptr;
+        async.release();
+        ring.release();
+        sink.release();
+        closeFd();
+    }
+
+private:
+    struct AsyncBuffers
+    {
+        char buffers[ASYNC_BUFFERS][BUFFER_CAPACITY];
+        unsigned sizes[ASYNC_BUFFERS];
+        /// total number of buffers queued up by flush()
+        std::atomic<unsigned> filled {0};
+        /// total number of buffers written out by drain()
+        std::atomic<unsigned> drained {0};
+        /// set when writing failed, after which no more data gets queued
+        std::atomic<bool> failed {false};
+        /// serializes the writes to the file descriptor
+        std::mutex drainMutex;
+        std::mutex waitMutex;
+        std::condition_variable dataAvailable;
+    };
+
+    static bool writeAll(int fd, const char* data, size_t size)
+    {
+        while (size) {
+            const auto ret = ::write(fd, data, size);
+            if (ret < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            data += ret;
+            size -= ret;
+        }
+        return true;
+    }
+
+    HEAPTRACK_PERF_FUNCTION bool writeOut(const char* data, size_t size)
+    {
+        if (capture) {
+            capture->append(data, size);
+            return true;
+        }
+        const auto start = std::chrono::steady_clock::now();
+        bool ret = false;
+        if (ring) {
+            ret = ring->write(data, size, fd);
+        } else if (sink) {
+            ret = sink->write(data, size);
+        } else {
+            ret = writeAll(fd, data, size);
+        }
+        countWrite(1, size, start);
+        return ret;
+    }
+
+    void countWrite(unsigned flushes, size_t size, std::chrono::steady_clock::time_point start)
+    {
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+        stats.flushes.fetch_add(flushes, std::memory_order_relaxed);
+        stats.bytes.fetch_add(size, std::memory_order_relaxed);
+        stats.blockedNs.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count(),
+                                  std::memory_order_relaxed);
+    }
+
+    bool hasQueuedBuffers() const
+    {
+        return async->drained.load(std::memory_order_relaxed) != async->filled.load(std::memory_order_acquire);
+    }
+
+    /// only call this with the drainMutex held
+    HEAPTRACK_PERF_FUNCTION bool writeQueuedBuffers()
+    {
+        auto drained = async->drained.load(std::memory_order_relaxed);
+        const auto filled = async->filled.load(std::memory_order_acquire);
+        if (drained == filled) {
+            return !async->failed.load(std::memory_order_relaxed);
+        } else if (fd == -1) {
+            return false;
+        }
+
+        iovec iov[ASYNC_BUFFERS];
+        int count = 0;
+        size_t size = 0;
+        for (auto i = drained; i != filled; ++i) {
+            iov[count].iov_base = async->buffers[i % ASYNC_BUFFERS];
+            iov[count].iov_len = async->sizes[i % ASYNC_BUFFERS];
+            size += iov[count].iov_len;
+            ++count;
+        }
+        const auto flushes = count;
+        const auto start = std::chrono::steady_clock::now();
+
+        auto* pending = iov;
+        if (ring) {
+            for (int i = 0; i < count; ++i) {
+                if (!ring->write(static_cast<const char*>(iov[i].iov_base), iov[i].iov_len, fd)) {
+                    async->failed.store(true, std::memory_order_relaxed);
+                    break;
+                }
+            }
+            count = 0;
+        }
+        while (count) {
+            auto ret = ::writev(fd, pending, count);
+            if (ret < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                async->failed.store(true, std::memory_order_relaxed);
+                break;
+            }
+            // handle partial writes
+            while (count && static_cast<size_t>(ret) >= pending->iov_len) {
+                ret -= pending->iov_len;
+                ++pending;
+                --count;
+            }
+            if (count) {
+                pending->iov_base = static_cast<char*>(pending->iov_base) + ret;
+                pending->iov_len -= ret;
+            }
+        }
+
+        countWrite(flushes, size, start);
+
+        // also release the buffers after a failure, to not block the writer forever
+        async->drained.store(filled, std::memory_order_release);
+        return !async->failed.load(std::memory_order_relaxed);
+    }
+
+    void closeRing()
+    {
+        if (ring) {
+            ring->closeWriter(fd);
+            ring.reset();
+        }
+    }
+
+    void closeFd()
     {
         if (fd != -1) {
             ::close(fd);
@@ -279,7 +773,6 @@ public:
         }
     }
 
-private:
     size_t availableSpace() const
     {
         return BUFFER_CAPACITY - bufferSize;
@@ -287,12 +780,20 @@ private:
 
     char* out()
     {
-        return buffer.get() + bufferSize;
+        return current + bufferSize;
     }
 
     int fd = -1;
     unsigned bufferSize = 0;
     std::unique_ptr<char[]> buffer;
+    /// the buffer we are currently writing into, either buffer or one of the async buffers
+    char* current = nullptr;
+    std::unique_ptr<AsyncBuffers> async;
+    std::unique_ptr<ShmRing> ring;
+    std::unique_ptr<Sink> sink;
+    /// when set, we write into this string instead, see redirect()
+    std::string* capture = nullptr;
+    WriteStats stats;
 };
 
 #endif
@@ -12,3 +12,20 @@
 #else
 #define POTENTIALLY_UNUSED
 #endif
+
+// Use the initial-exec TLS model, which turns every access into a plain offset from the thread pointer
+// instead of a call to __tls_get_addr. Only use this for small variables, as the libraries that get
+// dlopen'ed at runtime (i.e. libheaptrack_inject.so) have to fit into the static TLS surplus of glibc.
+#ifdef __GNUC__
+#define HEAPTRACK_INITIAL_EXEC_TLS __attribute__((tls_model("initial-exec")))
+#else
+#define HEAPTRACK_INITIAL_EXEC_TLS
+#endif
+
+// Keep the hot functions of heaptrack itself out of line when building with HEAPTRACK_PERF_ANNOTATIONS,
+// such that `heaptrack --perf` attributes their costs to them instead of to their callers.
+#if defined(__GNUC__) && defined(HEAPTRACK_PERF_ANNOTATIONS)
+#define HEAPTRACK_PERF_FUNCTION __attribute__((noinline))
+#else
+#define HEAPTRACK_PERF_FUNCTION
+#endif
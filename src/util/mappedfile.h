@@ -0,0 +1,158 @@
+/*
+    SPDX-FileCopyrightText: 2026 Milian Wolff <mail@milianw.de>
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <algorithm>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "linewriter.h"
+
+/**
+ * Writes the data of a LineWriter straight into a shared memory mapping of a regular file.
+ *
+ * Instead of one syscall per buffer, the data only gets copied into the page cache, which
+ * the kernel writes back to the disk by itself. This even keeps the data when the process
+ * crashes. The file grows in large chunks and gets truncated to the size of the data once
+ * the writer is closed, after a crash it ends with the zeros of the unused part of the last
+ * chunk instead.
+ *
+ * Every chunk gets reserved on the disk before it is mapped. Otherwise, writing into the
+ * mapping of a sparse file on a full file system would raise SIGBUS instead of failing.
+ *
+ * The file descriptor must be opened for reading and writing and stays owned by the writer.
+ */
+class MappedFileSink : public LineWriter::Sink
+{
+public:
+    enum : size_t
+    {
+        DEFAULT_CHUNK_SIZE = 64 * 1024 * 1024
+    };
+
+    /**
+     * Map the file @p fd, the data gets appended at its current offset.
+     *
+     * @return nullptr when the file cannot be mapped, e.g. because it is a pipe
+     */
+    static MappedFileSink* create(int fd, size_t chunkSize = DEFAULT_CHUNK_SIZE)
+    {
+        struct stat info;
+        if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+            return nullptr;
+        }
+        const auto offset = lseek(fd, 0, SEEK_CUR);
+        if (offset < 0) {
+            return nullptr;
+        }
+        const auto pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        chunkSize = std::max(pageSize, chunkSize / pageSize * pageSize);
+        auto sink = new MappedFileSink(fd, chunkSize, static_cast<size_t>(offset));
+        if (!sink->grow(sink->m_size + 1)) {
+            delete sink;
+            // don't leave the zeros behind that we may have added already
+            const auto ret = ftruncate(fd, offset);
+            (void)ret;
+            return nullptr;
+        }
+        return sink;
+    }
+
+    ~MappedFileSink() override
+    {
+        unmap();
+    }
+
+    MappedFileSink(const MappedFileSink&) = delete;
+    MappedFileSink& operator=(const MappedFileSink&) = delete;
+
+    bool write(const char* data, size_t size) override
+    {
+        if (m_size + size > m_capacity && !grow(m_size + size)) {
+            return false;
+        }
+        memcpy(m_data + m_size, data, size);
+        m_size += size;
+        return true;
+    }
+
+    bool finish() override
+    {
+        unmap();
+        // drop the unused part of the last chunk, and leave the offset behind the data for whoever writes next
+        return ftruncate(m_fd, static_cast<off_t>(m_size)) == 0
+            && lseek(m_fd, static_cast<off_t>(m_size), SEEK_SET) >= 0;
+    }
+
+    /// the size of the data in the file, including what it contained before
+    size_t size() const
+    {
+        return m_size;
+    }
+
+private:
+    MappedFileSink(int fd, size_t chunkSize, size_t size)
+        : m_fd(fd)
+        , m_chunkSize(chunkSize)
+        , m_size(size)
+    {
+    }
+
+    /// enlarge the file and its mapping such that at least @p minCapacity bytes fit in
+    bool grow(size_t minCapacity)
+    {
+        // grow linearly, which bounds the zeros left behind by a crash
+        auto capacity = m_capacity + m_chunkSize;
+        while (capacity < minCapacity) {
+            capacity += m_chunkSize;
+        }
+        // this also enlarges the file, and fails when the disk is full
+        if (posix_fallocate(m_fd, static_cast<off_t>(m_capacity), static_cast<off_t>(capacity - m_capacity)) != 0) {
+            return false;
+        }
+
+        void* data = MAP_FAILED;
+#ifdef __linux__
+        if (m_data) {
+            data = mremap(m_data, m_capacity, capacity, MREMAP_MAYMOVE);
+        } else
+#endif
+        {
+            unmap();
+            data = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+        }
+        if (data == MAP_FAILED) {
+            // a failed mremap keeps the previous mapping
+            return false;
+        }
+        m_data = static_cast<char*>(data);
+        m_capacity = capacity;
+        return true;
+    }
+
+    void unmap()
+    {
+        if (m_data) {
+            munmap(m_data, m_capacity);
+            m_data = nullptr;
+            m_capacity = 0;
+        }
+    }
+
+    const int m_fd;
+    const size_t m_chunkSize;
+    char* m_data = nullptr;
+    size_t m_capacity = 0;
+    size_t m_size = 0;
+};
+
+#endif // MAPPEDFILE_H
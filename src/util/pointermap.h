@@ -12,6 +12,10 @@
 #include <limits>
 #include <vector>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include <tsl/robin_map.h>
 #include <tsl/robin_set.h>
 
@@ -26,10 +30,13 @@ struct IndexedAllocationInfo
 {
     uint64_t size;
     TraceIndex traceIndex;
+    uint32_t threadIndex;
+    uint32_t poolIndex;
     AllocationInfoIndex allocationIndex;
     bool operator==(const IndexedAllocationInfo& rhs) const
     {
-        return rhs.traceIndex == traceIndex && rhs.size == size;
+        return rhs.traceIndex == traceIndex && rhs.size == size && rhs.threadIndex == threadIndex
+            && rhs.poolIndex == poolIndex;
         // allocationInfoIndex not compared to allow to look it up
     }
 };
@@ -43,33 +50,124 @@ struct hash<IndexedAllocationInfo>
         std::size_t seed = 0;
         boost::hash_combine(seed, info.size);
         boost::hash_combine(seed, info.traceIndex.index);
+        boost::hash_combine(seed, info.threadIndex);
+        boost::hash_combine(seed, info.poolIndex);
         // allocationInfoIndex not hashed to allow to look it up
         return seed;
     }
 };
 }
 
-struct AllocationInfoSet
+/**
+ * Deduplicates the (size, trace) pairs of allocations and assigns consecutive indices to them.
+ *
+ * The pairs are stored as compact 64bit keys in a vector indexed by the allocation info index,
+ * such that the hash set only needs to hold the 32bit indices into it. Sizes that fit into 32bit
+ * get combined with the trace index into a single key, the rare larger allocations are deduplicated
+ * in a separate set, as are the allocations attributed to a thread or pool. All containers grow on demand.
+ */
+class AllocationInfoSet
 {
+public:
     AllocationInfoSet()
+        : set(0, KeyHash {&keys}, KeyEqual {&keys})
     {
-        set.reserve(625000);
     }
 
+    // the hash set references the keys
+    AllocationInfoSet(const AllocationInfoSet&) = delete;
+    AllocationInfoSet& operator=(const AllocationInfoSet&) = delete;
+
     bool add(uint64_t size, TraceIndex traceIndex, AllocationInfoIndex* allocationIndex)
     {
-        allocationIndex->index = set.size();
-        IndexedAllocationInfo info = {size, traceIndex, *allocationIndex};
-        auto it = set.find(info);
-        if (it != set.end()) {
-            *allocationIndex = it->allocationIndex;
-            return false;
-        } else {
-            set.insert(it, info);
+        return add(size, traceIndex, 0, 0, allocationIndex);
+    }
+
+    /// @p threadIndex identifies the allocating thread, see HEAPTRACK_TRACK_THREADS, or is zero
+    /// @p poolIndex identifies the pool the allocation belongs to, see heaptrack_pool_malloc, or is zero
+    bool add(uint64_t size, TraceIndex traceIndex, uint32_t threadIndex, uint32_t poolIndex,
+             AllocationInfoIndex* allocationIndex)
+    {
+        allocationIndex->index = keys.size();
+
+        if (size > std::numeric_limits<uint32_t>::max() || threadIndex || poolIndex) {
+            auto inserted = largeSet.insert({size, traceIndex, threadIndex, poolIndex, *allocationIndex});
+            if (!inserted.second) {
+                *allocationIndex = inserted.first->allocationIndex;
+                return false;
+            }
+            // keep the indices consecutive, this key is never looked up
+            keys.push_back(std::numeric_limits<uint64_t>::max());
             return true;
         }
+
+        // speculatively add the new key, such that the set can hash and compare it
+        keys.push_back((size << 32) | traceIndex.index);
+        auto inserted = set.insert(allocationIndex->index);
+        if (!inserted.second) {
+            keys.pop_back();
+            allocationIndex->index = *inserted.first;
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * Forget all known pairs, new ones get the next consecutive indices nevertheless.
+     *
+     * Used when the sampling interval changes, as the cost an allocation info stands for changes with it.
+     */
+    void forget()
+    {
+        set.clear();
+        largeSet.clear();
+    }
+
+private:
+    struct KeyHash
+    {
+        const std::vector<uint64_t>* keys;
+        std::size_t operator()(uint32_t index) const
+        {
+            const auto key = (*keys)[index];
+            std::size_t seed = 0;
+            boost::hash_combine(seed, key >> 32);
+            boost::hash_combine(seed, static_cast<uint32_t>(key));
+            return seed;
+        }
+    };
+
+    struct KeyEqual
+    {
+        const std::vector<uint64_t>* keys;
+        bool operator()(uint32_t lhs, uint32_t rhs) const
+        {
+            return (*keys)[lhs] == (*keys)[rhs];
+        }
+    };
+
+    std::vector<uint64_t> keys;
+    tsl::robin_set<uint32_t, KeyHash, KeyEqual> set;
+    tsl::robin_set<IndexedAllocationInfo> largeSet;
+};
+
+/**
+ * A 64bit address split into its page (the big part) and the 16bit offset into
+ * that page (the small part), see SortedPointerMap.
+ */
+struct SplitPointer
+{
+    enum
+    {
+        PageSize = std::numeric_limits<uint16_t>::max() / 4
+    };
+    SplitPointer(uint64_t ptr)
+        : big(ptr / PageSize)
+        , small(ptr % PageSize)
+    {
     }
-    tsl::robin_set<IndexedAllocationInfo> set;
+    uint64_t big;
+    uint16_t small;
 };
 
 /**
@@ -78,33 +176,18 @@ struct AllocationInfoSet
  *
  * We leverage the fact that pointers are allocated in pages, i.e. close to each
  * other. We split the 64bit address into a common large part and an individual
- * 16bit small part by dividing the address by some number (PageSize below) and
+ * 16bit small part by dividing the address by some number (see SplitPointer) and
  * keeping the result as the big part and the residue as the small part.
  *
  * The big part of the address is used for a hash map to lookup the Indices
- * structure where we aggregate common pointers in two memory-efficient vectors,
- * one for the 16bit small pointer pairs, and one for the 32bit allocation
- * indices.
+ * structure where we aggregate common pointers in two memory-efficient sorted
+ * vectors, one for the 16bit small pointer pairs, and one for the 32bit
+ * allocation indices.
  */
-class PointerMap
+class SortedPointerMap
 {
-    struct SplitPointer
-    {
-        enum
-        {
-            PageSize = std::numeric_limits<uint16_t>::max() / 4
-        };
-        SplitPointer(uint64_t ptr)
-            : big(ptr / PageSize)
-            , small(ptr % PageSize)
-        {
-        }
-        uint64_t big;
-        uint16_t small;
-    };
-
 public:
-    PointerMap()
+    SortedPointerMap()
     {
         map.reserve(1024);
     }
@@ -160,4 +243,138 @@ private:
     tsl::robin_map<uint64_t, Indices> map;
 };
 
+/**
+ * Variant of SortedPointerMap that keeps the small pointer parts of a page unsorted.
+ *
+ * Adding a pointer appends it to the page and taking it moves the last entry of the page into the gap,
+ * which avoids shifting all the entries behind it like the sorted vectors need to. Instead, the small
+ * parts get searched linearly, which is done with SIMD compares of eight parts at once. The memory
+ * overhead is the same as for SortedPointerMap.
+ *
+ * The @p Value stored per pointer is the allocation info index in PointerMap, but can carry more
+ * data for the live allocations, like the time at which they got allocated.
+ */
+template <typename Value>
+class BasicPointerMap
+{
+public:
+    BasicPointerMap()
+    {
+        map.reserve(1024);
+    }
+
+    void addPointer(const uint64_t ptr, const Value allocationIndex)
+    {
+        const SplitPointer pointer(ptr);
+
+        auto mapIt = map.find(pointer.big);
+        if (mapIt == map.end()) {
+            mapIt = map.insert(mapIt, std::make_pair(pointer.big, Indices()));
+        }
+        auto& indices = mapIt.value();
+        const auto pos = findSmallPtrPart(indices.smallPtrParts, pointer.small);
+        if (pos == indices.smallPtrParts.size()) {
+            indices.smallPtrParts.push_back(pointer.small);
+            indices.allocationIndices.push_back(allocationIndex);
+            ++count;
+        } else {
+            indices.allocationIndices[pos] = allocationIndex;
+        }
+    }
+
+    std::pair<Value, bool> takePointer(const uint64_t ptr)
+    {
+        const SplitPointer pointer(ptr);
+
+        auto mapIt = map.find(pointer.big);
+        if (mapIt == map.end()) {
+            return {{}, false};
+        }
+        auto& indices = mapIt.value();
+        const auto pos = findSmallPtrPart(indices.smallPtrParts, pointer.small);
+        if (pos == indices.smallPtrParts.size()) {
+            return {{}, false};
+        }
+        const auto index = indices.allocationIndices[pos];
+        --count;
+        if (indices.smallPtrParts.size() == 1) {
+            map.erase(mapIt);
+        } else {
+            indices.smallPtrParts[pos] = indices.smallPtrParts.back();
+            indices.smallPtrParts.pop_back();
+            indices.allocationIndices[pos] = indices.allocationIndices.back();
+            indices.allocationIndices.pop_back();
+        }
+        return {index, true};
+    }
+
+    /// the number of pointers in the map
+    std::size_t size() const
+    {
+        return count;
+    }
+
+    /// the number of pages the pointers are grouped in, see SplitPointer
+    std::size_t pages() const
+    {
+        return map.size();
+    }
+
+    /// call @p callback with the values of the pointers of every page, the pages come in no particular order
+    template <typename Callback>
+    void forEachPage(Callback callback) const
+    {
+        for (const auto& page : map) {
+            callback(page.second.allocationIndices);
+        }
+    }
+
+private:
+    /// @return the position of @p small in @p parts, or the size of @p parts when it wasn't found
+    static std::size_t findSmallPtrPart(const std::vector<uint16_t>& parts, const uint16_t small)
+    {
+        const auto size = parts.size();
+        const auto data = parts.data();
+        std::size_t i = 0;
+#ifdef __SSE2__
+        const auto needle = _mm_set1_epi16(static_cast<short>(small));
+        auto matches = [data, needle](std::size_t offset) {
+            const auto chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + offset));
+            return _mm_movemask_epi8(_mm_cmpeq_epi16(chunk, needle));
+        };
+        for (; i + 32 <= size; i += 32) {
+            const auto mask0 = matches(i);
+            const auto mask1 = matches(i + 8);
+            const auto mask2 = matches(i + 16);
+            const auto mask3 = matches(i + 24);
+            if (mask0 | mask1 | mask2 | mask3) {
+                break;
+            }
+        }
+        for (; i + 8 <= size; i += 8) {
+            if (const auto mask = matches(i)) {
+                // every matching 16bit part sets two bits in the mask
+                return i + __builtin_ctz(static_cast<unsigned>(mask)) / 2;
+            }
+        }
+#endif
+        for (; i < size; ++i) {
+            if (data[i] == small) {
+                return i;
+            }
+        }
+        return size;
+    }
+
+    struct Indices
+    {
+        std::vector<uint16_t> smallPtrParts;
+        std::vector<Value> allocationIndices;
+    };
+    tsl::robin_map<uint64_t, Indices> map;
+    std::size_t count = 0;
+};
+
+using PointerMap = BasicPointerMap<AllocationInfoIndex>;
+
 #endif // POINTERMAP_H
@@ -0,0 +1,370 @@
+/*
+    SPDX-FileCopyrightText: 2026 Milian Wolff <mail@milianw.de>
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#ifndef SHMRING_H
+#define SHMRING_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <streambuf>
+#include <string>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#endif
+
+/**
+ * Single-producer single-consumer byte ring in shared memory.
+ *
+ * This is an alternative transport to the FIFO between libheaptrack and
+ * heaptrack_interpret. The tracee creates the ring and announces its name
+ * on the FIFO, after which all data is written into the ring. The FIFO is
+ * kept open, the interpreter notices the end of the tracee through it.
+ *
+ * The reader polls the ring regularly, the writer only wakes it up via a
+ * futex when the ring is getting full. Vice versa, the reader wakes the
+ * writer when it waits for free space.
+ */
+class ShmRing
+{
+public:
+    enum : uint32_t
+    {
+        MAGIC = 0x68747368, // "htsh"
+        // must be a power of two
+        CAPACITY = 1u << 22,
+        // milliseconds to wait before we check the ring again
+        POLL_INTERVAL = 10
+    };
+
+    ~ShmRing()
+    {
+        munmap(m_header, mappingSize());
+    }
+
+    /**
+     * Create a new ring with the unique shm object @p name for writing.
+     *
+     * @return nullptr when shared memory is not available, the FIFO should be used then
+     */
+    static ShmRing* create(const std::string& name)
+    {
+#ifdef __linux__
+        const auto fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0600);
+        if (fd == -1) {
+            return nullptr;
+        }
+        if (ftruncate(fd, mappingSize()) != 0) {
+            ::close(fd);
+            shm_unlink(name.c_str());
+            return nullptr;
+        }
+        auto ring = map(fd);
+        if (!ring) {
+            shm_unlink(name.c_str());
+            return nullptr;
+        }
+        ring->m_name = name;
+        ring->m_header->capacity = CAPACITY;
+        ring->m_header->magic = MAGIC;
+        return ring;
+#else
+        (void)name;
+        return nullptr;
+#endif
+    }
+
+    /**
+     * Open the existing ring @p name for reading and remove its name.
+     */
+    static ShmRing* open(const std::string& name)
+    {
+#ifdef __linux__
+        const auto fd = shm_open(name.c_str(), O_RDWR | O_CLOEXEC, 0);
+        if (fd == -1) {
+            return nullptr;
+        }
+        // both sides have it mapped now, we do not want to leak it
+        shm_unlink(name.c_str());
+        auto ring = map(fd);
+        if (ring && (ring->m_header->magic != MAGIC || ring->m_header->capacity != CAPACITY)) {
+            delete ring;
+            return nullptr;
+        }
+        if (ring) {
+            ring->m_header->readerAttached.store(1, std::memory_order_seq_cst);
+            wake(&ring->m_header->readerAttached);
+        }
+        return ring;
+#else
+        (void)name;
+        return nullptr;
+#endif
+    }
+
+    const std::string& name() const
+    {
+        return m_name;
+    }
+
+    /**
+     * Copy @p size bytes of @p bytes into the ring, blocks while the ring is full.
+     *
+     * @return false when the reader is gone, which is detected either through
+     *         closeReader or when nobody reads from @p controlFd anymore.
+     */
+    bool write(const char* bytes, size_t size, int controlFd)
+    {
+        auto& header = *m_header;
+        while (size) {
+            const auto writePos = header.writePos.load(std::memory_order_relaxed);
+            const auto readPos = header.readPos.load(std::memory_order_acquire);
+            const auto available = CAPACITY - (writePos - readPos);
+            if (!available) {
+                if (header.readerClosed.load(std::memory_order_relaxed)) {
+                    return false;
+                }
+                header.writerWaiting.store(1, std::memory_order_seq_cst);
+                if (header.readPos.load(std::memory_order_seq_cst) == readPos) {
+                    wait(&header.readPos, readPos);
+                }
+                header.writerWaiting.store(0, std::memory_order_relaxed);
+
+                if (controlFd != -1 && header.readPos.load(std::memory_order_acquire) == readPos) {
+                    pollfd fd = {controlFd, POLLOUT, 0};
+                    if (poll(&fd, 1, 0) == 1 && (fd.revents & POLLERR)) {
+                        return false;
+                    }
+                }
+                continue;
+            }
+
+            const auto offset = writePos & (CAPACITY - 1);
+            const auto chunk = std::min<size_t>({size, available, CAPACITY - offset});
+            memcpy(data() + offset, bytes, chunk);
+            header.writePos.store(writePos + chunk, std::memory_order_seq_cst);
+            bytes += chunk;
+            size -= chunk;
+
+            // only wake the reader once the ring is nearly full, it polls otherwise
+            if (header.readerWaiting.load(std::memory_order_seq_cst)
+                && writePos + chunk - readPos >= CAPACITY / 2) {
+                wake(&header.writePos);
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Notify the reader that no more data will be written.
+     *
+     * When the reader did not open the ring yet, we wait for it as long as
+     * somebody reads from @p controlFd, otherwise the data would get lost.
+     */
+    void closeWriter(int controlFd)
+    {
+        auto& header = *m_header;
+        header.writerClosed.store(1, std::memory_order_seq_cst);
+        wake(&header.writePos);
+
+        while (controlFd != -1 && !header.readerAttached.load(std::memory_order_seq_cst)) {
+            wait(&header.readerAttached, 0);
+            pollfd fd = {controlFd, POLLOUT, 0};
+            if (poll(&fd, 1, 0) == 1 && (fd.revents & POLLERR)) {
+                break;
+            }
+        }
+        // the reader removes the name when it opens the ring, but it may never do that
+        shm_unlink(m_name.c_str());
+    }
+
+    /**
+     * Wait for data to read.
+     *
+     * The end of the writer is detected either through closeWriter or when
+     * @p controlFd, i.e. the FIFO the writer keeps open, got closed.
+     *
+     * @return a pointer to the available contiguous data and its size in @p size,
+     *         or nullptr when the writer is gone and all data was read already.
+     */
+    const char* read(size_t* size, int controlFd)
+    {
+        auto& header = *m_header;
+        while (true) {
+            const auto readPos = header.readPos.load(std::memory_order_relaxed);
+            const auto writePos = header.writePos.load(std::memory_order_acquire);
+            if (writePos != readPos) {
+                const auto offset = readPos & (CAPACITY - 1);
+                *size = std::min<size_t>(writePos - readPos, CAPACITY - offset);
+                return data() + offset;
+            } else if (header.writerClosed.load(std::memory_order_acquire) || m_writerGone) {
+                if (header.writePos.load(std::memory_order_acquire) == readPos) {
+                    return nullptr;
+                }
+                continue;
+            }
+
+            header.readerWaiting.store(1, std::memory_order_seq_cst);
+            if (header.writePos.load(std::memory_order_seq_cst) == writePos) {
+                wait(&header.writePos, writePos);
+            }
+            header.readerWaiting.store(0, std::memory_order_relaxed);
+
+            if (controlFd != -1 && header.writePos.load(std::memory_order_acquire) == writePos) {
+                pollfd fd = {controlFd, POLLIN, 0};
+                if (poll(&fd, 1, 0) == 1 && (fd.revents & (POLLHUP | POLLERR))) {
+                    m_writerGone = true;
+                }
+            }
+        }
+    }
+
+    /**
+     * Mark @p size bytes returned by read() as consumed.
+     */
+    void consume(size_t size)
+    {
+        auto& header = *m_header;
+        header.readPos.store(header.readPos.load(std::memory_order_relaxed) + size, std::memory_order_seq_cst);
+        if (header.writerWaiting.load(std::memory_order_seq_cst)) {
+            wake(&header.readPos);
+        }
+    }
+
+    /**
+     * Notify the writer that no more data will be read.
+     */
+    void closeReader()
+    {
+        m_header->readerClosed.store(1, std::memory_order_seq_cst);
+        wake(&m_header->readPos);
+    }
+
+private:
+    struct Header
+    {
+        uint32_t magic;
+        uint32_t capacity;
+        // the positions wrap around, which is fine as the capacity is a power of two
+        alignas(64) std::atomic<uint32_t> writePos;
+        std::atomic<uint32_t> readerWaiting;
+        std::atomic<uint32_t> writerClosed;
+        alignas(64) std::atomic<uint32_t> readPos;
+        std::atomic<uint32_t> writerWaiting;
+        std::atomic<uint32_t> readerClosed;
+        std::atomic<uint32_t> readerAttached;
+    };
+
+    static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futexes require plain 32bit words");
+
+    explicit ShmRing(Header* header)
+        : m_header(header)
+    {
+    }
+
+    static size_t mappingSize()
+    {
+        return sizeof(Header) + CAPACITY;
+    }
+
+    static ShmRing* map(int fd)
+    {
+        auto mapping = mmap(nullptr, mappingSize(), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (mapping == MAP_FAILED) {
+            return nullptr;
+        }
+        // a fresh mapping is zero-initialized, which is a valid empty ring
+        return new ShmRing(static_cast<Header*>(mapping));
+    }
+
+    char* data() const
+    {
+        return reinterpret_cast<char*>(m_header + 1);
+    }
+
+    static void wait(std::atomic<uint32_t>* word, uint32_t expected)
+    {
+#ifdef __linux__
+        const timespec timeout = {0, POLL_INTERVAL * 1000000};
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT, expected, &timeout, nullptr, 0);
+#else
+        (void)word;
+        (void)expected;
+#endif
+    }
+
+    static void wake(std::atomic<uint32_t>* word)
+    {
+#ifdef __linux__
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE, 1, nullptr, nullptr, 0);
+#else
+        (void)word;
+#endif
+    }
+
+    Header* m_header = nullptr;
+    /// only set for the writer
+    std::string m_name;
+    bool m_writerGone = false;
+};
+
+/**
+ * Adapter to read the contents of a ShmRing through an std::istream.
+ *
+ * The data is not copied, the get area points directly into the ring.
+ */
+class ShmRingStreamBuf : public std::streambuf
+{
+public:
+    ShmRingStreamBuf(ShmRing* ring, int controlFd)
+        : m_ring(ring)
+        , m_controlFd(controlFd)
+    {
+    }
+
+    ~ShmRingStreamBuf()
+    {
+        m_ring->closeReader();
+    }
+
+protected:
+    int_type underflow() override
+    {
+        if (gptr() < egptr()) {
+            return traits_type::to_int_type(*gptr());
+        }
+        m_ring->consume(m_consumable);
+        m_consumable = 0;
+
+        size_t size = 0;
+        auto data = const_cast<char*>(m_ring->read(&size, m_controlFd));
+        if (!data) {
+            setg(nullptr, nullptr, nullptr);
+            return traits_type::eof();
+        }
+        m_consumable = size;
+        setg(data, data, data + size);
+        return traits_type::to_int_type(*gptr());
+    }
+
+private:
+    ShmRing* m_ring;
+    int m_controlFd;
+    size_t m_consumable = 0;
+};
+
+#endif
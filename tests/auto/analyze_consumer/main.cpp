@@ -0,0 +1,25 @@
+/*
+    SPDX-FileCopyrightText: 2026 Milian Wolff <mail@milianw.de>
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#include <analyze/tracedatareader.h>
+
+#include <iostream>
+
+int main(int argc, char** argv)
+{
+    if (argc != 2) {
+        std::cerr << "usage: analyze_consumer FILE\n";
+        return 1;
+    }
+
+    TraceDataReader reader;
+    reader.materializedTables = 0;
+    if (!reader.read(argv[1], false)) {
+        return 1;
+    }
+    std::cout << "peak: " << reader.totalCost.peak << '\n';
+    return reader.totalCost.peak > 0 ? 0 : 1;
+}
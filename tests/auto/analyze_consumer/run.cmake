@@ -0,0 +1,11 @@
+# install heaptrack into a scratch prefix, then build and run the consumer against it
+foreach(step
+        "${CMAKE_COMMAND};--install;${HEAPTRACK_BINARY_DIR};--prefix;${WORK_DIR}/prefix"
+        "${CMAKE_COMMAND};-S;${SOURCE_DIR};-B;${WORK_DIR}/build;-DCMAKE_PREFIX_PATH=${WORK_DIR}/prefix"
+        "${CMAKE_COMMAND};--build;${WORK_DIR}/build"
+        "${WORK_DIR}/build/analyze_consumer;${DATA_FILE}")
+    execute_process(COMMAND ${step} RESULT_VARIABLE result)
+    if (NOT result EQUAL 0)
+        message(FATAL_ERROR "failed: ${step}")
+    endif()
+endforeach()
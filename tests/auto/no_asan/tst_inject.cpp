@@ -71,8 +71,9 @@ void runInjectTest(Load load, Unload unload)
     const auto contents = file.readContents();
     REQUIRE(!contents.empty());
     REQUIRE(contents.find("\nA\n") != std::string::npos);
-    REQUIRE(contents.find("\n+") != std::string::npos);
-    REQUIRE(contents.find("\n-") != std::string::npos);
+    // allocation events are binary encoded, with the high bit of the type set
+    REQUIRE(contents.find(static_cast<char>('+' | 0x80)) != std::string::npos);
+    REQUIRE(contents.find(static_cast<char>('-' | 0x80)) != std::string::npos);
 }
 }
 
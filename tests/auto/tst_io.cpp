@@ -9,10 +9,14 @@
 
 #include "util/linereader.h"
 #include "util/linewriter.h"
+#include "util/mappedfile.h"
 
 #include "tempfile.h"
 
+#include <atomic>
+#include <chrono>
 #include <limits>
+#include <thread>
 
 using namespace std;
 
@@ -21,6 +25,13 @@ constexpr uint64_t operator"" _u64(unsigned long long v)
     return static_cast<uint64_t>(v);
 }
 
+string toHex(size_t value)
+{
+    ostringstream stream;
+    stream << std::hex << value;
+    return stream.str();
+}
+
 TEST_CASE ("write data") {
     TempFile file;
     REQUIRE(file.open());
@@ -116,6 +127,185 @@ TEST_CASE ("write flush") {
     REQUIRE(file.readContents() == data1 + data2);
 }
 
+TEST_CASE ("async flush") {
+    TempFile file;
+    REQUIRE(file.open());
+
+    LineWriter writer(file.fd);
+    REQUIRE(writer.write("v 1\n"));
+    writer.enableAsyncFlushing();
+    REQUIRE(writer.isAsync());
+
+    atomic<bool> stop {false};
+    thread flusher([&]() {
+        while (!stop) {
+            if (writer.waitForData(chrono::steady_clock::now() + chrono::milliseconds(1))) {
+                REQUIRE(writer.drain());
+            }
+        }
+    });
+
+    string expectedContents = "v 1\n";
+    for (unsigned i = 0; i < 100000; ++i) {
+        REQUIRE(writer.writeHexLine('t', i, 0x456u));
+        expectedContents += "t " + toHex(i) + " 456\n";
+        if (i % 10000 == 0) {
+            const string longString(LineWriter::BUFFER_CAPACITY * 2, '*');
+            REQUIRE(writer.write(longString));
+            expectedContents += toHex(longString.size()) + ' ' + longString;
+        }
+    }
+    stop = true;
+    flusher.join();
+
+    // without the flusher thread, the writer drains the buffers itself once they are all queued up
+    for (unsigned i = 0; i < 100000; ++i) {
+        REQUIRE(writer.writeHexLine('c', i));
+        expectedContents += "c " + toHex(i) + "\n";
+    }
+
+    REQUIRE(writer.flush());
+    REQUIRE(writer.drain());
+    REQUIRE(file.readContents() == expectedContents);
+}
+
+TEST_CASE ("async flush from signal handler") {
+    TempFile file;
+    REQUIRE(file.open());
+
+    LineWriter writer(file.fd);
+    writer.enableAsyncFlushing();
+
+    // queue up some buffers, which nobody drains, and leave a partially filled one behind
+    string expectedContents;
+    for (unsigned i = 0; i < 10000; ++i) {
+        REQUIRE(writer.writeHexLine('t', i));
+        expectedContents += "t " + toHex(i) + "\n";
+    }
+    REQUIRE(file.readContents().size() < expectedContents.size());
+
+    REQUIRE(writer.flushFromSignalHandler());
+    REQUIRE(file.readContents() == expectedContents);
+}
+
+TEST_CASE ("sink") {
+    struct StringSink : LineWriter::Sink
+    {
+        bool write(const char* data, size_t size) override
+        {
+            contents->append(data, size);
+            return true;
+        }
+        bool finish() override
+        {
+            contents->append("finished");
+            return true;
+        }
+        string* contents = nullptr;
+    };
+
+    TempFile file;
+    REQUIRE(file.open());
+
+    string contents;
+    {
+        LineWriter writer(file.fd);
+        REQUIRE(writer.write("v 1\n"));
+
+        unique_ptr<StringSink> sink(new StringSink);
+        sink->contents = &contents;
+        REQUIRE(writer.setSink(std::move(sink)));
+        // data that was buffered before goes to the file descriptor
+        REQUIRE(file.readContents() == "v 1\n");
+
+        REQUIRE(writer.writeHexLine('t', 0x123u, 0x456u));
+        REQUIRE(contents.empty());
+        REQUIRE(writer.flush());
+        REQUIRE(contents == "t 123 456\n");
+
+        const string longString(LineWriter::BUFFER_CAPACITY * 2, '*');
+        REQUIRE(writer.write(longString));
+        REQUIRE(writer.writeHexLine('c', 0x1u));
+    }
+
+    REQUIRE(contents == "t 123 456\n" + toHex(LineWriter::BUFFER_CAPACITY * 2) + ' '
+                + string(LineWriter::BUFFER_CAPACITY * 2, '*') + "c 1\nfinished");
+    REQUIRE(file.readContents() == "v 1\n");
+}
+
+TEST_CASE ("mapped file") {
+    TempFile file;
+    REQUIRE(file.open());
+    REQUIRE(write(file.fd, "v 1\n", 4) == 4);
+
+    int fds[2];
+    REQUIRE(pipe(fds) == 0);
+    REQUIRE(!MappedFileSink::create(fds[1]));
+    close(fds[0]);
+    close(fds[1]);
+
+    string expectedContents = "v 1\n";
+    {
+        LineWriter writer(file.fd);
+        // a single page per chunk, such that the mapping has to grow a few times
+        unique_ptr<MappedFileSink> sink(MappedFileSink::create(file.fd, 1));
+        REQUIRE(sink);
+        REQUIRE(writer.setSink(std::move(sink)));
+        for (unsigned i = 0; i < 10000; ++i) {
+            REQUIRE(writer.writeHexLine('t', i, 0x456u));
+            expectedContents += "t " + toHex(i) + " 456\n";
+        }
+        REQUIRE(writer.flush());
+
+        // the data can be read while writing, followed by the zeros of the unused part of the last chunk
+        const auto contents = file.readContents();
+        REQUIRE(contents.size() >= expectedContents.size());
+        REQUIRE(contents.compare(0, expectedContents.size(), expectedContents) == 0);
+        REQUIRE(contents.find_first_not_of('\0', expectedContents.size()) == string::npos);
+    }
+    REQUIRE(file.readContents() == expectedContents);
+}
+
+TEST_CASE ("shared memory") {
+    int fds[2];
+    REQUIRE(pipe(fds) == 0);
+
+    const auto name = "/heaptrack.tst_io." + to_string(getpid());
+    istringstream announcement;
+    string expectedContents;
+    {
+        LineWriter writer(fds[1]);
+        REQUIRE(writer.enableSharedMemory(name));
+        REQUIRE(writer.isSharedMemory());
+
+        char line[128] = {};
+        REQUIRE(read(fds[0], line, sizeof(line)) > 0);
+        REQUIRE(string(line) == "M " + name + '\n');
+
+        unique_ptr<ShmRing> ring(ShmRing::open(name));
+        REQUIRE(ring);
+
+        // write more than fits into the ring at once
+        thread producer([&]() {
+            for (unsigned i = 0; i < 500000; ++i) {
+                writer.writeHexLine('t', i, 0x456u);
+            }
+            writer.close();
+        });
+        for (unsigned i = 0; i < 500000; ++i) {
+            expectedContents += "t " + toHex(i) + " 456\n";
+        }
+        REQUIRE(expectedContents.size() > ShmRing::CAPACITY);
+
+        ShmRingStreamBuf buffer(ring.get(), fds[0]);
+        istream stream(&buffer);
+        const string contents {istreambuf_iterator<char>(stream), istreambuf_iterator<char>()};
+        producer.join();
+        REQUIRE(contents == expectedContents);
+    }
+    close(fds[0]);
+}
+
 TEST_CASE ("read line 64bit") {
     const string contents =
         "m /tmp/KDevelop-5.2.1-x86_64/usr/lib/libKF5Completion.so.5 7f48beedc00 0 36854 236858 2700\n";
@@ -176,3 +366,77 @@ TEST_CASE ("read line 32bit") {
     REQUIRE(idx == 0x0);
     REQUIRE(!(reader >> idx));
 }
+
+TEST_CASE ("read long lines") {
+    // longer than the internal buffer of the reader, and without a trailing newline at the end
+    const string longString(1024 * 1024, 'x');
+    const string contents = "s " + toHex(longString.size()) + ' ' + longString + "\nt 1 2\n\n+ 3";
+    stringstream stream(contents);
+    LineReader reader;
+    reader.setExpectedSizedStrings(true);
+
+    REQUIRE(reader.getLine(stream));
+    REQUIRE(reader.mode() == 's');
+    string str;
+    REQUIRE((reader >> str));
+    REQUIRE(str == longString);
+
+    REQUIRE(reader.getLine(stream));
+    REQUIRE(reader.line() == "t 1 2");
+    REQUIRE(string(reader.rawLine()) == "t 1 2");
+
+    REQUIRE(reader.getLine(stream));
+    REQUIRE(reader.mode() == '#');
+
+    REQUIRE(reader.getLine(stream));
+    REQUIRE(reader.mode() == '+');
+    uint32_t idx = 0;
+    REQUIRE((reader >> idx));
+    REQUIRE(idx == 0x3);
+
+    REQUIRE(!reader.getLine(stream));
+}
+
+TEST_CASE ("binary records") {
+    TempFile file;
+    REQUIRE(file.open());
+
+    LineWriter writer(file.fd);
+    REQUIRE(writer.canWrite());
+    for (unsigned i = 0; i < 1000; ++i) {
+        REQUIRE(writer.writeHexLine('c', i));
+        REQUIRE(writer.writeVarintRecord('+', 0x7fu, i, std::numeric_limits<uint64_t>::max()));
+        REQUIRE(writer.writeVarintRecord('-', LineWriter::zigzag(-1)));
+    }
+    REQUIRE(writer.flush());
+
+    stringstream stream(file.readContents());
+    LineReader reader;
+    reader.setExpectBinaryRecords(true);
+    for (unsigned i = 0; i < 1000; ++i) {
+        REQUIRE(reader.getRecord(stream));
+        REQUIRE(!reader.isBinary());
+        REQUIRE(reader.mode() == 'c');
+        unsigned timestamp = 0;
+        REQUIRE((reader >> timestamp));
+        REQUIRE(timestamp == i);
+
+        REQUIRE(reader.getRecord(stream));
+        REQUIRE(reader.isBinary());
+        REQUIRE(reader.mode() == '+');
+        uint64_t value = 0;
+        REQUIRE((reader >> value));
+        REQUIRE(value == 0x7f);
+        REQUIRE((reader >> value));
+        REQUIRE(value == i);
+        REQUIRE((reader >> value));
+        REQUIRE(value == std::numeric_limits<uint64_t>::max());
+        REQUIRE(!(reader >> value));
+
+        REQUIRE(reader.getRecord(stream));
+        REQUIRE(reader.isBinary());
+        REQUIRE(reader.mode() == '-');
+        REQUIRE((reader >> value));
+        REQUIRE(LineReader::unzigzag(value) == -1);
+    }
+}
@@ -8,16 +8,28 @@
 #include "3rdparty/doctest.h"
 
 #include "track/libheaptrack.h"
+#include "util/config.h"
+#include "util/linereader.h"
 #include "util/linewriter.h"
 
 #include <cmath>
 #include <cstdio>
 
+#include <cstdlib>
+#include <cstring>
 #include <future>
 #include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
 #include <thread>
 #include <vector>
 
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
 #include "tempfile.h"
 
 bool initBeforeCalled = false;
@@ -26,6 +38,97 @@ bool stopCalled = false;
 
 using namespace std;
 
+/**
+ * Call @p callback for every record of the raw tracker output, the reader is set up according to the 'v' record
+ */
+template <typename Callback>
+void forEachRecord(const string& contents, Callback callback)
+{
+    istringstream stream(contents);
+    LineReader reader;
+    while (reader.getRecord(stream)) {
+        if (reader.mode() == 'v') {
+            unsigned int heaptrackVersion = 0;
+            unsigned int fileVersion = 0;
+            REQUIRE((reader >> heaptrackVersion));
+            REQUIRE((reader >> fileVersion));
+            reader.setExpectedSizedStrings(fileVersion >= 3);
+            reader.setExpectBinaryRecords(fileVersion >= HEAPTRACK_BINARY_FILE_FORMAT_VERSION);
+        }
+        callback(reader);
+    }
+}
+
+struct RawEvent
+{
+    char type;
+    uint64_t ptr;
+    uint32_t traceIndex;
+    // the pool index of the pool events, see heaptrack_pool_malloc
+    uint32_t pool = 0;
+};
+
+/**
+ * Parse the allocation events from the raw tracker output
+ */
+vector<RawEvent> parseEvents(const string& contents)
+{
+    vector<RawEvent> events;
+    uint64_t lastPtr = 0;
+    forEachRecord(contents, [&](LineReader& reader) {
+        if (reader.mode() == '+' || reader.mode() == '-') {
+            uint64_t ptr = 0;
+            uint32_t traceIndex = 0;
+            if (reader.mode() == '+') {
+                uint64_t size = 0;
+                REQUIRE((reader >> size));
+                REQUIRE((reader >> traceIndex));
+            }
+            REQUIRE((reader >> ptr));
+            if (reader.isBinary()) {
+                lastPtr += LineReader::unzigzag(ptr);
+                ptr = lastPtr;
+            }
+            events.push_back({reader.mode(), ptr, traceIndex});
+        } else if (reader.mode() == 'r') {
+            // a reallocation is recorded as a single event, split it up again
+            uint64_t size = 0;
+            uint32_t traceIndex = 0;
+            uint64_t oldPtr = 0;
+            uint64_t ptr = 0;
+            REQUIRE((reader >> size));
+            REQUIRE((reader >> traceIndex));
+            REQUIRE((reader >> oldPtr));
+            REQUIRE((reader >> ptr));
+            if (reader.isBinary()) {
+                lastPtr += LineReader::unzigzag(oldPtr);
+                oldPtr = lastPtr;
+                lastPtr += LineReader::unzigzag(ptr);
+                ptr = lastPtr;
+            }
+            events.push_back({'-', oldPtr, 0});
+            events.push_back({'+', ptr, traceIndex});
+        } else if (reader.mode() == 'Q') {
+            uint64_t handle = 0;
+            REQUIRE((reader >> handle));
+            events.push_back({'Q', handle, 0});
+        } else if (reader.mode() == 'y' || reader.mode() == 'Y' || reader.mode() == 'z') {
+            RawEvent event = {reader.mode(), 0, 0};
+            REQUIRE((reader >> event.pool));
+            if (reader.mode() == 'y') {
+                uint64_t size = 0;
+                REQUIRE((reader >> size));
+                REQUIRE((reader >> event.traceIndex));
+            }
+            if (reader.mode() != 'z') {
+                REQUIRE((reader >> event.ptr));
+            }
+            events.push_back(event);
+        }
+    });
+    return events;
+}
+
 TEST_CASE ("api") {
     TempFile tmp; // opened/closed by heaptrack_init
 
@@ -120,3 +223,821 @@ TEST_CASE ("api") {
         }
     }
 }
+
+TEST_CASE ("thread buffers") {
+    TempFile tmp; // opened/closed by heaptrack_init
+
+    setenv("HEAPTRACK_THREAD_BUFFERS", "1", 1);
+    heaptrack_init(tmp.fileName.c_str(), nullptr, nullptr, nullptr);
+    unsetenv("HEAPTRACK_THREAD_BUFFERS");
+
+    const auto numThreads = max(4u, thread::hardware_concurrency());
+    const int numAllocations = 10000;
+    // one slot per thread, the pointers get passed around between the threads
+    vector<char> data(numThreads);
+    {
+        vector<future<void>> futures;
+        for (unsigned i = 0; i < numThreads; ++i) {
+            futures.emplace_back(async(launch::async, [&data, i, numThreads]() {
+                for (int j = 0; j < numAllocations; ++j) {
+                    auto ptr = &data[(i + j) % numThreads];
+                    heaptrack_malloc(ptr, j + 1);
+                    heaptrack_realloc(ptr, j + 2, ptr);
+                    heaptrack_free(ptr);
+                    if (j % 1000 == 0) {
+                        heaptrack_invalidate_module_cache();
+                    }
+                }
+            }));
+        }
+    }
+    heaptrack_stop();
+
+    // every free must come after a malloc of the same pointer
+    map<uint64_t, int> live;
+    unsigned numMallocs = 0;
+    unsigned numFrees = 0;
+    for (const auto& event : parseEvents(tmp.readContents())) {
+        if (event.type == '+') {
+            ++numMallocs;
+            // multiple threads may use the same slot, but not at the same time
+            ++live[event.ptr];
+        } else {
+            ++numFrees;
+            REQUIRE(live[event.ptr] > 0);
+            --live[event.ptr];
+        }
+    }
+    REQUIRE(numMallocs == 2 * numThreads * numAllocations);
+    REQUIRE(numFrees == 2 * numThreads * numAllocations);
+}
+
+TEST_CASE ("batched reporting") {
+    for (const bool threadBuffers : {false, true}) {
+        CAPTURE(threadBuffers);
+        TempFile tmp; // opened/closed by heaptrack_init
+
+        if (threadBuffers) {
+            setenv("HEAPTRACK_THREAD_BUFFERS", "1", 1);
+        }
+        heaptrack_init(tmp.fileName.c_str(), nullptr, nullptr, nullptr);
+        unsetenv("HEAPTRACK_THREAD_BUFFERS");
+
+        const int numAllocations = 1000;
+        vector<char> pool(numAllocations);
+        vector<heaptrack_allocation_t> allocations(numAllocations);
+        vector<void*> ptrs(numAllocations);
+        for (int i = 0; i < numAllocations; ++i) {
+            allocations[i] = {&pool[i], 16};
+            ptrs[i] = &pool[i];
+        }
+        // null pointers get skipped, like for heaptrack_malloc and heaptrack_free
+        allocations.push_back({nullptr, 16});
+        ptrs.push_back(nullptr);
+
+        heaptrack_malloc_batch(allocations.data(), allocations.size());
+        heaptrack_free_batch(ptrs.data(), ptrs.size());
+        heaptrack_stop();
+
+        const auto events = parseEvents(tmp.readContents());
+        REQUIRE(events.size() == 2 * numAllocations);
+        for (int i = 0; i < numAllocations; ++i) {
+            REQUIRE(events[i].type == '+');
+            REQUIRE(events[i].ptr == reinterpret_cast<uint64_t>(&pool[i]));
+            // all allocations of the batch share the same trace
+            REQUIRE(events[i].traceIndex == events[0].traceIndex);
+            REQUIRE(events[numAllocations + i].type == '-');
+            REQUIRE(events[numAllocations + i].ptr == reinterpret_cast<uint64_t>(&pool[i]));
+        }
+    }
+}
+
+TEST_CASE ("memory pools") {
+    TempFile tmp; // opened/closed by heaptrack_init
+
+    heaptrack_init(tmp.fileName.c_str(), nullptr, nullptr, nullptr);
+
+    const int numAllocations = 100;
+    vector<char> first(numAllocations);
+    vector<char> second(numAllocations);
+    for (int i = 0; i < numAllocations; ++i) {
+        heaptrack_pool_malloc(first.data(), &first[i], 16);
+        heaptrack_pool_malloc(second.data(), &second[i], 16);
+    }
+    heaptrack_pool_free(second.data(), &second[0]);
+    heaptrack_pool_destroy(first.data());
+    // unknown pools get ignored
+    heaptrack_pool_free(&first[1], &first[1]);
+    heaptrack_pool_destroy(&first[1]);
+    heaptrack_stop();
+
+    const auto events = parseEvents(tmp.readContents());
+    // two pool announcements, the allocations, one free and one destroy event
+    REQUIRE(events.size() == 2 + 2 * numAllocations + 2);
+    REQUIRE(events[0].type == 'Q');
+    REQUIRE(events[0].ptr == reinterpret_cast<uint64_t>(first.data()));
+    REQUIRE(events[1].type == 'y');
+    REQUIRE(events[1].pool == 1);
+    REQUIRE(events[1].ptr == reinterpret_cast<uint64_t>(&first[0]));
+    REQUIRE(events[2].type == 'Q');
+    REQUIRE(events[2].ptr == reinterpret_cast<uint64_t>(second.data()));
+    for (int i = 0; i < numAllocations; ++i) {
+        const auto& event = events[3 + 2 * i];
+        REQUIRE(event.type == 'y');
+        REQUIRE(event.pool == 2);
+        REQUIRE(event.ptr == reinterpret_cast<uint64_t>(&second[i]));
+    }
+    const auto& free = events[events.size() - 2];
+    REQUIRE(free.type == 'Y');
+    REQUIRE(free.pool == 2);
+    REQUIRE(free.ptr == reinterpret_cast<uint64_t>(&second[0]));
+    REQUIRE(events.back().type == 'z');
+    REQUIRE(events.back().pool == 1);
+}
+
+TEST_CASE ("sampling") {
+    TempFile tmp; // opened/closed by heaptrack_init
+
+    setenv("HEAPTRACK_SAMPLE_INTERVAL", "4096", 1);
+    heaptrack_init(tmp.fileName.c_str(), nullptr, nullptr, nullptr);
+    unsetenv("HEAPTRACK_SAMPLE_INTERVAL");
+
+    const int numAllocations = 10000;
+    vector<char> data(numAllocations);
+    for (auto& ptr : data) {
+        heaptrack_malloc(&ptr, 64);
+    }
+    for (auto& ptr : data) {
+        heaptrack_free(&ptr);
+    }
+    heaptrack_stop();
+
+    const auto contents = tmp.readContents();
+    REQUIRE(contents.find("\nP 1000\n") != string::npos);
+
+    int numMallocs = 0;
+    int numFrees = 0;
+    for (const auto& event : parseEvents(contents)) {
+        if (event.type == '+') {
+            ++numMallocs;
+        } else {
+            ++numFrees;
+        }
+    }
+    // we expect one sample every 64 allocations on average
+    REQUIRE(numMallocs > numAllocations / 64 / 4);
+    REQUIRE(numMallocs < numAllocations / 64 * 4);
+    // only the frees of sampled allocations get recorded
+    REQUIRE(numFrees == numMallocs);
+}
+
+TEST_CASE ("watermark triggers") {
+    TempFile tmp; // opened/closed by heaptrack_init
+
+    // any RSS exceeds the threshold, so the timer thread disables sampling soon after starting
+    setenv("HEAPTRACK_SAMPLE_INTERVAL", "4096", 1);
+    setenv("HEAPTRACK_TRIGGER_RSS", "1", 1);
+    heaptrack_init(tmp.fileName.c_str(), nullptr, nullptr, nullptr);
+    unsetenv("HEAPTRACK_SAMPLE_INTERVAL");
+    unsetenv("HEAPTRACK_TRIGGER_RSS");
+    this_thread::sleep_for(chrono::milliseconds(200));
+
+    const int numAllocations = 1000;
+    vector<char> data(numAllocations);
+    for (auto& ptr : data) {
+        heaptrack_malloc(&ptr, 64);
+    }
+    for (auto& ptr : data) {
+        heaptrack_free(&ptr);
+    }
+    heaptrack_stop();
+
+    const auto contents = tmp.readContents();
+    const auto sampling = contents.find("\nP 1000\n");
+    const auto triggered = contents.find("\nP 0\n");
+    REQUIRE(sampling != string::npos);
+    REQUIRE(triggered != string::npos);
+    REQUIRE(sampling < triggered);
+    REQUIRE(parseEvents(contents).size() == 2 * numAllocations);
+}
+
+TEST_CASE ("overhead counters") {
+    TempFile tmp; // opened/closed by heaptrack_init
+
+    heaptrack_init(tmp.fileName.c_str(), nullptr, nullptr, nullptr);
+
+    const int numAllocations = 10000;
+    vector<char> data(numAllocations);
+    for (auto& ptr : data) {
+        heaptrack_malloc(&ptr, 1);
+    }
+    for (auto& ptr : data) {
+        heaptrack_free(&ptr);
+    }
+    heaptrack_stop();
+
+    // the final record holds the totals
+    const auto contents = tmp.readContents();
+    const auto pos = contents.rfind("\nO ");
+    REQUIRE(pos != string::npos);
+    istringstream stream(contents.substr(pos + 1));
+    LineReader reader;
+    REQUIRE(reader.getLine(stream));
+    uint64_t events = 0;
+    uint64_t unwindNs = 0;
+    uint64_t lockSpins = 0;
+    uint64_t lockWaitNs = 0;
+    uint64_t flushes = 0;
+    uint64_t flushedBytes = 0;
+    uint64_t blockedWriteNs = 0;
+    REQUIRE((reader >> events));
+    REQUIRE((reader >> unwindNs));
+    REQUIRE((reader >> lockSpins));
+    REQUIRE((reader >> lockWaitNs));
+    REQUIRE((reader >> flushes));
+    REQUIRE((reader >> flushedBytes));
+    REQUIRE((reader >> blockedWriteNs));
+    REQUIRE(events == 2 * numAllocations);
+    REQUIRE(unwindNs > 0);
+    REQUIRE(flushes > 0);
+    REQUIRE(flushedBytes > 0);
+    REQUIRE(flushedBytes < contents.size());
+}
+
+namespace {
+__attribute__((noinline)) void mallocFromFirstSite(char* ptr)
+{
+    heaptrack_malloc(ptr, 1);
+}
+
+__attribute__((noinline)) void mallocFromSecondSite(char* ptr)
+{
+    heaptrack_malloc(ptr, 1);
+}
+}
+
+TEST_CASE ("unwind cache") {
+    TempFile tmp; // opened/closed by heaptrack_init
+
+    setenv("HEAPTRACK_UNWIND_CACHE", "1", 1);
+    heaptrack_init(tmp.fileName.c_str(), nullptr, nullptr, nullptr);
+    unsetenv("HEAPTRACK_UNWIND_CACHE");
+
+    const int numAllocations = 100;
+    vector<char> data(2 * numAllocations);
+    for (int i = 0; i < numAllocations; ++i) {
+        mallocFromFirstSite(&data[2 * i]);
+        mallocFromSecondSite(&data[2 * i + 1]);
+        if (i == numAllocations / 2) {
+            heaptrack_invalidate_module_cache();
+        }
+    }
+    for (auto& ptr : data) {
+        heaptrack_free(&ptr);
+    }
+    heaptrack_stop();
+
+    uint32_t firstIndex = 0;
+    uint32_t secondIndex = 0;
+    int numMallocs = 0;
+    for (const auto& event : parseEvents(tmp.readContents())) {
+        if (event.type != '+') {
+            continue;
+        }
+        const auto offset = reinterpret_cast<char*>(event.ptr) - data.data();
+        auto& index = offset % 2 ? secondIndex : firstIndex;
+        if (!index) {
+            index = event.traceIndex;
+        }
+        REQUIRE(event.traceIndex == index);
+        ++numMallocs;
+    }
+    REQUIRE(numMallocs == 2 * numAllocations);
+    REQUIRE(firstIndex);
+    REQUIRE(secondIndex);
+    REQUIRE(firstIndex != secondIndex);
+}
+
+TEST_CASE ("sharded traces") {
+    TempFile tmp; // opened/closed by heaptrack_init
+
+    setenv("HEAPTRACK_THREAD_BUFFERS", "1", 1);
+    heaptrack_init(tmp.fileName.c_str(), nullptr, nullptr, nullptr);
+    unsetenv("HEAPTRACK_THREAD_BUFFERS");
+
+    const unsigned numThreads = 4;
+    const int numAllocations = 100;
+    vector<char> data(numThreads * numAllocations);
+    {
+        vector<thread> threads;
+        for (unsigned i = 0; i < numThreads; ++i) {
+            threads.emplace_back([&data, i]() {
+                for (int j = 0; j < numAllocations; ++j) {
+                    mallocFromFirstSite(&data[i * numAllocations + j]);
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+    heaptrack_stop();
+
+    const auto contents = tmp.readContents();
+    bool mapped = false;
+    uint32_t numTraceNodes = 0;
+    set<uint32_t> traceIndices;
+    int numMallocs = 0;
+    forEachRecord(contents, [&](LineReader& reader) {
+        if (reader.mode() == 'C') {
+            // the shards get announced before any trace node
+            REQUIRE(!numTraceNodes);
+            mapped = true;
+        } else if (reader.mode() == 't') {
+            uint64_t ip = 0;
+            uint32_t parentIndex = 0;
+            REQUIRE((reader >> ip));
+            REQUIRE((reader >> parentIndex));
+            REQUIRE(parentIndex <= numTraceNodes);
+            ++numTraceNodes;
+        } else if (reader.mode() == '+') {
+            uint64_t size = 0;
+            uint32_t traceIndex = 0;
+            REQUIRE((reader >> size));
+            REQUIRE((reader >> traceIndex));
+            REQUIRE(traceIndex);
+            REQUIRE(traceIndex <= numTraceNodes);
+            traceIndices.insert(traceIndex);
+            ++numMallocs;
+        }
+    });
+    REQUIRE(mapped);
+    REQUIRE(numMallocs == static_cast<int>(numThreads * numAllocations));
+    // every thread finds its trace in its own shard after the first allocation
+    REQUIRE(traceIndices.size() <= numThreads);
+}
+
+TEST_CASE ("trace tree limit") {
+    TempFile tmp; // opened/closed by heaptrack_init
+
+    // every trace exceeds the limit, so the tree gets cleared before each allocation
+    setenv("HEAPTRACK_TRACE_TREE_LIMIT", "1", 1);
+    heaptrack_init(tmp.fileName.c_str(), nullptr, nullptr, nullptr);
+    unsetenv("HEAPTRACK_TRACE_TREE_LIMIT");
+
+    char data[4] = {0};
+    mallocFromFirstSite(&data[0]);
+    mallocFromSecondSite(&data[1]);
+    mallocFromFirstSite(&data[2]);
+    mallocFromSecondSite(&data[3]);
+    heaptrack_stop();
+
+    const auto contents = tmp.readContents();
+    int numClears = 0;
+    uint32_t numTraceNodes = 0;
+    int numMallocs = 0;
+    forEachRecord(contents, [&](LineReader& reader) {
+        if (reader.mode() == 'C') {
+            ++numClears;
+            numTraceNodes = 0;
+        } else if (reader.mode() == 't') {
+            uint64_t ip = 0;
+            uint32_t parentIndex = 0;
+            REQUIRE((reader >> ip));
+            REQUIRE((reader >> parentIndex));
+            // the trace indices restart after clearing the tree
+            REQUIRE(parentIndex <= numTraceNodes);
+            ++numTraceNodes;
+        } else if (reader.mode() == '+') {
+            uint64_t size = 0;
+            uint32_t traceIndex = 0;
+            REQUIRE((reader >> size));
+            REQUIRE((reader >> traceIndex));
+            REQUIRE(traceIndex);
+            REQUIRE(traceIndex <= numTraceNodes);
+            ++numMallocs;
+        }
+    });
+    REQUIRE(numMallocs == 4);
+    REQUIRE(numClears >= 3);
+}
+
+TEST_CASE ("aggregation") {
+    TempFile tmp; // opened/closed by heaptrack_init
+
+    setenv("HEAPTRACK_AGGREGATE", "1", 1);
+    heaptrack_init(tmp.fileName.c_str(), nullptr, nullptr, nullptr);
+    unsetenv("HEAPTRACK_AGGREGATE");
+
+    const int numAllocations = 100;
+    vector<char> data(numAllocations);
+    for (auto& ptr : data) {
+        heaptrack_malloc(&ptr, 10);
+    }
+    // the last allocation is a temporary one, the first half leaks
+    for (int i = numAllocations - 1; i >= numAllocations / 2; --i) {
+        heaptrack_free(&data[i]);
+    }
+    heaptrack_stop();
+
+    const auto contents = tmp.readContents();
+    REQUIRE(parseEvents(contents).empty());
+
+    int64_t allocations = 0;
+    int64_t deallocations = 0;
+    int64_t temporary = 0;
+    int64_t leaked = 0;
+    int64_t peak = 0;
+    forEachRecord(contents, [&](LineReader& reader) {
+        if (reader.mode() == 'd') {
+            uint32_t traceIndex = 0;
+            int64_t numAllocations = 0;
+            int64_t numDeallocations = 0;
+            int64_t numTemporary = 0;
+            int64_t allocated = 0;
+            int64_t freed = 0;
+            REQUIRE((reader >> traceIndex));
+            REQUIRE((reader >> numAllocations));
+            REQUIRE((reader >> numDeallocations));
+            REQUIRE((reader >> numTemporary));
+            REQUIRE((reader >> allocated));
+            REQUIRE((reader >> freed));
+            allocations += numAllocations;
+            deallocations += numDeallocations;
+            temporary += numTemporary;
+            leaked += allocated - freed;
+        } else if (reader.mode() == 'D') {
+            REQUIRE((reader >> peak));
+        }
+    });
+    REQUIRE(allocations == numAllocations);
+    REQUIRE(deallocations == numAllocations / 2);
+    REQUIRE(temporary == 1);
+    REQUIRE(leaked == 10 * numAllocations / 2);
+    REQUIRE(peak == 10 * numAllocations);
+}
+
+TEST_CASE ("memory mappings") {
+    TempFile tmp; // opened/closed by heaptrack_init
+
+    setenv("HEAPTRACK_TRACK_MMAP", "1", 1);
+    heaptrack_init(tmp.fileName.c_str(), nullptr, nullptr, nullptr);
+    unsetenv("HEAPTRACK_TRACK_MMAP");
+
+    char data[4] = {0};
+    heaptrack_mmap(data, 4096);
+    heaptrack_mremap(data, 4096, data + 1, 8192);
+    heaptrack_munmap(data + 1, 8192);
+    heaptrack_stop();
+
+    const auto contents = tmp.readContents();
+    // the mappings don't show up as heap allocations
+    REQUIRE(parseEvents(contents).empty());
+
+    vector<vector<uint64_t>> mappings;
+    vector<vector<uint64_t>> unmappings;
+    forEachRecord(contents, [&](LineReader& reader) {
+        if (reader.mode() == 'k' || reader.mode() == 'K') {
+            vector<uint64_t> args;
+            uint64_t arg = 0;
+            while (reader.readHex(arg)) {
+                args.push_back(arg);
+            }
+            (reader.mode() == 'k' ? mappings : unmappings).push_back(args);
+        }
+    });
+    const auto ptr = reinterpret_cast<uint64_t>(data);
+    REQUIRE(mappings.size() == 2);
+    REQUIRE(mappings[0].size() == 3);
+    REQUIRE(mappings[0][0] == ptr);
+    REQUIRE(mappings[0][1] == 4096);
+    REQUIRE(mappings[1].size() == 5);
+    REQUIRE(mappings[1][0] == ptr + 1);
+    REQUIRE(mappings[1][1] == 8192);
+    REQUIRE(mappings[1][3] == ptr);
+    REQUIRE(mappings[1][4] == 4096);
+    REQUIRE(unmappings.size() == 1);
+    REQUIRE(unmappings[0] == vector<uint64_t> {ptr + 1, 8192});
+}
+
+#ifdef __GLIBC__
+TEST_CASE ("usable size") {
+    TempFile tmp; // opened/closed by heaptrack_init
+
+    setenv("HEAPTRACK_USABLE_SIZE", "1", 1);
+    heaptrack_init(tmp.fileName.c_str(), nullptr, nullptr, nullptr);
+    unsetenv("HEAPTRACK_USABLE_SIZE");
+
+    // the usable size of a glibc allocation is always more than what got requested for this size
+    const size_t size = 25;
+    auto ptr1 = malloc(size);
+    auto ptr2 = malloc(size);
+    heaptrack_malloc(ptr1, size);
+    heaptrack_malloc(ptr2, size);
+    heaptrack_free(ptr2);
+    heaptrack_free(ptr1);
+    heaptrack_stop();
+    free(ptr2);
+    free(ptr1);
+
+    const auto contents = tmp.readContents();
+    REQUIRE(parseEvents(contents).size() == 4);
+
+    vector<vector<uint64_t>> usableSizes;
+    forEachRecord(contents, [&](LineReader& reader) {
+        if (reader.mode() == 'U') {
+            uint64_t requested = 0;
+            uint64_t usable = 0;
+            REQUIRE((reader >> requested));
+            REQUIRE((reader >> usable));
+            usableSizes.push_back({requested, usable});
+        }
+    });
+    // only the first allocation of a size gets a record
+    REQUIRE(usableSizes.size() == 1);
+    REQUIRE(usableSizes[0][0] == size);
+    REQUIRE(usableSizes[0][1] > size);
+}
+#endif
+
+TEST_CASE ("collapse temporary") {
+    TempFile tmp; // opened/closed by heaptrack_init
+
+    setenv("HEAPTRACK_COLLAPSE_TEMPORARY", "1", 1);
+    heaptrack_init(tmp.fileName.c_str(), nullptr, nullptr, nullptr);
+    unsetenv("HEAPTRACK_COLLAPSE_TEMPORARY");
+
+    const int numAllocations = 100;
+    char data[2] = {0};
+    for (int i = 0; i < numAllocations; ++i) {
+        heaptrack_malloc(&data[0], 10);
+        heaptrack_free(&data[0]);
+    }
+    // these are not temporary and have to be kept
+    heaptrack_malloc(&data[0], 10);
+    heaptrack_malloc(&data[1], 10);
+    heaptrack_free(&data[0]);
+    // the pending allocation must not get lost
+    heaptrack_malloc(&data[0], 10);
+    heaptrack_stop();
+
+    const auto contents = tmp.readContents();
+    const auto events = parseEvents(contents);
+    REQUIRE(events.size() == 4);
+    REQUIRE(events[0].type == '+');
+    REQUIRE(events[1].type == '+');
+    REQUIRE(events[2].type == '-');
+    REQUIRE(events[2].ptr == events[0].ptr);
+    REQUIRE(events[3].type == '+');
+
+    int numTemporary = 0;
+    forEachRecord(contents, [&](LineReader& reader) {
+        if (reader.mode() == 'T') {
+            uint64_t size = 0;
+            uint32_t traceIndex = 0;
+            REQUIRE((reader >> size));
+            REQUIRE((reader >> traceIndex));
+            REQUIRE(size == 10);
+            REQUIRE(traceIndex);
+            ++numTemporary;
+        }
+    });
+    REQUIRE(numTemporary == numAllocations);
+}
+
+TEST_CASE ("track threads") {
+    TempFile tmp; // opened/closed by heaptrack_init
+
+    setenv("HEAPTRACK_TRACK_THREADS", "1", 1);
+    heaptrack_init(tmp.fileName.c_str(), nullptr, nullptr, nullptr);
+    unsetenv("HEAPTRACK_TRACK_THREADS");
+
+    char data[3] = {0};
+    heaptrack_malloc(&data[0], 10);
+    thread worker([&data]() {
+        pthread_setname_np(pthread_self(), "worker");
+        heaptrack_malloc(&data[1], 20);
+        heaptrack_free(&data[1]);
+        // freed by another thread than the allocating one
+        heaptrack_free(&data[0]);
+    });
+    worker.join();
+    heaptrack_malloc(&data[2], 30);
+    heaptrack_free(&data[2]);
+    heaptrack_stop();
+
+    const auto contents = tmp.readContents();
+    vector<string> threadNames;
+    uint32_t currentThread = 0;
+    map<uint64_t, uint32_t> threadOfSize;
+    map<uint32_t, int> freesOfThread;
+    forEachRecord(contents, [&](LineReader& reader) {
+        if (reader.mode() == 'H') {
+            uint64_t tid = 0;
+            string name;
+            REQUIRE((reader >> tid));
+            REQUIRE((reader >> name));
+            REQUIRE(tid);
+            threadNames.push_back(name);
+        } else if (reader.mode() == 'h') {
+            REQUIRE((reader >> currentThread));
+            REQUIRE(currentThread);
+            REQUIRE(currentThread <= threadNames.size());
+        } else if (reader.mode() == '+') {
+            uint64_t size = 0;
+            REQUIRE((reader >> size));
+            threadOfSize[size] = currentThread;
+        } else if (reader.mode() == '-') {
+            ++freesOfThread[currentThread];
+        }
+    });
+
+    REQUIRE(threadNames.size() == 2);
+    REQUIRE(threadNames[1] == "worker");
+    REQUIRE(threadOfSize.size() == 3);
+    REQUIRE(threadOfSize[10] == 1);
+    REQUIRE(threadOfSize[20] == 2);
+    REQUIRE(threadOfSize[30] == 1);
+    REQUIRE(freesOfThread.size() == 2);
+    REQUIRE(freesOfThread[1] == 1);
+    REQUIRE(freesOfThread[2] == 2);
+}
+
+namespace {
+string sendCommand(int socket, const string& command)
+{
+    const auto line = command + '\n';
+    REQUIRE(write(socket, line.c_str(), line.size()) == static_cast<ssize_t>(line.size()));
+    string reply;
+    char c = 0;
+    while (read(socket, &c, 1) == 1 && c != '\n') {
+        reply += c;
+    }
+    return reply;
+}
+}
+
+TEST_CASE ("control socket") {
+    TempFile tmp; // opened/closed by heaptrack_init
+    const auto socketPath = tmp.fileName + ".sock";
+
+    setenv("HEAPTRACK_CONTROL_SOCKET", socketPath.c_str(), 1);
+    heaptrack_init(tmp.fileName.c_str(), nullptr, nullptr, nullptr);
+    unsetenv("HEAPTRACK_CONTROL_SOCKET");
+
+    const auto client = socket(AF_UNIX, SOCK_STREAM, 0);
+    REQUIRE(client != -1);
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, socketPath.c_str());
+    REQUIRE(connect(client, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0);
+
+    char data[2] = {0};
+    REQUIRE(sendCommand(client, "pause") == "ok");
+    heaptrack_malloc(&data[0], 10);
+    REQUIRE(sendCommand(client, "resume") == "ok");
+    heaptrack_malloc(&data[1], 10);
+    REQUIRE(sendCommand(client, "flush") == "ok");
+    REQUIRE(sendCommand(client, "snapshot") == "ok");
+    REQUIRE(sendCommand(client, "sample 4096") == "ok");
+    REQUIRE(sendCommand(client, "sample") == "error: unknown command");
+    REQUIRE(sendCommand(client, "foo") == "error: unknown command");
+    close(client);
+    heaptrack_stop();
+
+    // the socket gets removed again
+    REQUIRE(access(socketPath.c_str(), F_OK) != 0);
+
+    const auto contents = tmp.readContents();
+    const auto events = parseEvents(contents);
+    REQUIRE(events.size() == 1);
+    REQUIRE(events[0].ptr == reinterpret_cast<uint64_t>(&data[1]));
+    REQUIRE(contents.find("\nP 1000\n") != string::npos);
+}
+
+TEST_CASE ("counting only") {
+    TempFile tmp; // opened/closed by heaptrack_init
+
+    setenv("HEAPTRACK_COUNT_ONLY", "1", 1);
+    heaptrack_init(tmp.fileName.c_str(), nullptr, nullptr, nullptr);
+    unsetenv("HEAPTRACK_COUNT_ONLY");
+
+    vector<char> data(110);
+    for (int i = 0; i < 100; ++i) {
+        heaptrack_malloc(&data[i], 16);
+    }
+    for (int i = 100; i < 110; ++i) {
+        heaptrack_malloc(&data[i], 1000);
+    }
+    for (int i = 0; i < 50; ++i) {
+        heaptrack_free(&data[i]);
+    }
+    heaptrack_stop();
+
+    const auto contents = tmp.readContents();
+    // neither the individual allocations nor their backtraces get recorded
+    REQUIRE(parseEvents(contents).empty());
+
+    uint64_t frees = 0;
+    map<uint32_t, pair<uint64_t, uint64_t>> sizeClasses;
+    forEachRecord(contents, [&](LineReader& reader) {
+        REQUIRE(reader.mode() != 't');
+        if (reader.mode() == 'Z') {
+            // the totals so far, the last record wins
+            sizeClasses.clear();
+            REQUIRE((reader >> frees));
+            uint32_t sizeClass = 0;
+            uint64_t allocations = 0;
+            uint64_t bytes = 0;
+            while ((reader >> sizeClass) && (reader >> allocations) && (reader >> bytes)) {
+                sizeClasses[sizeClass] = {allocations, bytes};
+            }
+        }
+    });
+    REQUIRE(frees == 50);
+    REQUIRE(sizeClasses.size() == 2);
+    // [16, 32) and [512, 1024)
+    REQUIRE(sizeClasses[5] == make_pair(uint64_t(100), uint64_t(1600)));
+    REQUIRE(sizeClasses[10] == make_pair(uint64_t(10), uint64_t(10000)));
+}
+
+TEST_CASE ("crash flush") {
+    TempFile tmp; // opened/closed by heaptrack_init
+
+    const int numAllocations = 100;
+    const auto pid = fork();
+    REQUIRE(pid != -1);
+    if (pid == 0) {
+        // the fork handlers disable recording in the forking thread of the child, a new thread starts out clean
+        thread([&]() {
+            // don't let the crash handler of doctest report the abort of the child
+            signal(SIGABRT, SIG_DFL);
+            setenv("HEAPTRACK_CRASH_FLUSH", "1", 1);
+            heaptrack_init(tmp.fileName.c_str(), nullptr, nullptr, nullptr);
+            vector<char> data(numAllocations);
+            for (auto& ptr : data) {
+                heaptrack_malloc(&ptr, 16);
+            }
+            abort();
+        }).join();
+        _exit(0);
+    }
+
+    int status = 0;
+    REQUIRE(waitpid(pid, &status, 0) == pid);
+    REQUIRE(WIFSIGNALED(status));
+    REQUIRE(WTERMSIG(status) == SIGABRT);
+
+    // the events never filled the buffer, they only got written by the signal handler
+    const auto contents = tmp.readContents();
+    REQUIRE(parseEvents(contents).size() == numAllocations);
+
+    // followed by the final time stamp and RSS
+    string modes;
+    forEachRecord(contents, [&](LineReader& reader) {
+        modes += reader.mode();
+    });
+    REQUIRE(modes.substr(modes.size() - 2) == "cR");
+}
+
+TEST_CASE ("fast exit") {
+    TempFile tmp; // opened/closed by heaptrack_init
+
+    const int numAllocations = 100;
+    const auto pid = fork();
+    REQUIRE(pid != -1);
+    if (pid == 0) {
+        // the fork handlers disable recording in the forking thread of the child, a new thread starts out clean
+        thread([&]() {
+            setenv("HEAPTRACK_FAST_EXIT", "1", 1);
+            heaptrack_init(tmp.fileName.c_str(), nullptr, nullptr, nullptr);
+            vector<char> data(numAllocations);
+            for (auto& ptr : data) {
+                heaptrack_malloc(&ptr, 16);
+            }
+            heaptrack_free(&data[0]);
+            heaptrack_exit();
+            // like the static destructors, these don't get recorded anymore
+            for (auto& ptr : data) {
+                heaptrack_free(&ptr);
+            }
+        }).join();
+        _exit(0);
+    }
+
+    int status = 0;
+    REQUIRE(waitpid(pid, &status, 0) == pid);
+    REQUIRE(WIFEXITED(status));
+
+    const auto contents = tmp.readContents();
+    REQUIRE(parseEvents(contents).size() == numAllocations + 1);
+
+    // the final time stamp and RSS, followed by the marker for the analyzers
+    string modes;
+    forEachRecord(contents, [&](LineReader& reader) {
+        modes += reader.mode();
+    });
+    REQUIRE(modes.find("cR") != string::npos);
+    REQUIRE(modes.back() == 'E');
+}
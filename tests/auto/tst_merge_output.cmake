@@ -0,0 +1,40 @@
+# writes DATA_FILE through --merge-output and compares the reports of both files, see tst_merge_output
+file(MAKE_DIRECTORY ${WORK_DIR})
+set(mergedFile ${WORK_DIR}/merged.gz)
+file(REMOVE ${mergedFile})
+
+execute_process(COMMAND ${HEAPTRACK_PRINT} --merge ${DATA_FILE} --merge-output ${mergedFile}
+                RESULT_VARIABLE result OUTPUT_QUIET)
+if (NOT result EQUAL 0)
+    message(FATAL_ERROR "failed to write the merged data of ${DATA_FILE}")
+endif()
+
+foreach(input original merged)
+    if (input STREQUAL "original")
+        set(file ${DATA_FILE})
+    else()
+        set(file ${mergedFile})
+    endif()
+    execute_process(COMMAND ${HEAPTRACK_PRINT} ${file} RESULT_VARIABLE result OUTPUT_VARIABLE report)
+    if (NOT result EQUAL 0)
+        message(FATAL_ERROR "failed to print ${file}")
+    endif()
+    # the file name differs, and the threads are not part of the merged data
+    string(REGEX REPLACE "^reading file [^\n]*\n" "" report "${report}")
+    string(REGEX REPLACE "allocations per thread:\n( [^\n]*\n)+" "" report "${report}")
+    set(${input} "${report}")
+endforeach()
+
+foreach(section "PEAK MAPPED MEMORY" "MOST BYTES COPIED BY GROWING ALLOCATIONS" "MOST ALLOCATOR SLACK"
+                "MOST REMOTE FREES" "MOST PINNED SPARSE PAGES" "allocator slack per size class")
+    string(FIND "${original}" "${section}" found)
+    if (found EQUAL -1)
+        message(FATAL_ERROR "the report of ${DATA_FILE} lacks the section: ${section}")
+    endif()
+endforeach()
+
+if (NOT original STREQUAL merged)
+    file(WRITE ${WORK_DIR}/original.txt "${original}")
+    file(WRITE ${WORK_DIR}/merged.txt "${merged}")
+    message(FATAL_ERROR "the reports differ, see ${WORK_DIR}/original.txt and ${WORK_DIR}/merged.txt")
+endif()
@@ -16,7 +16,9 @@
 #include <KLocalizedString>
 
 #include <QDebug>
+#include <QFile>
 #include <QSignalSpy>
+#include <QTemporaryDir>
 
 std::ostream& operator<<(std::ostream& os, const QString& value)
 {
@@ -92,12 +94,18 @@ struct TestParser
         return topDownData;
     }
 
-    SummaryData awaitSummary()
+    SummaryData awaitSummary(int index = 0)
     {
-        if (spySummary.isEmpty())
+        while (spySummary.size() <= index)
             REQUIRE(spySummary.wait(20000));
 
-        return spySummary.at(0).at(0).value<SummaryData>();
+        return spySummary.at(index).at(0).value<SummaryData>();
+    }
+
+    void awaitFinished(int count = 1)
+    {
+        while (spyFinished.size() < count)
+            REQUIRE(spyFinished.wait(20000));
     }
 
     Parser parser;
@@ -109,7 +117,7 @@ struct TestParser
         return resultData->string(sym.functionId) + '|' + Util::basename(module) + '|' + module;
     }
 
-    QList<Symbol> sortedSymbols(const CallerCalleeResults& ccr) const
+    QVector<Symbol> sortedSymbols(const CallerCalleeResults& ccr) const
     {
         auto ccrSymbolList = ccr.entries.keys();
         std::sort(ccrSymbolList.begin(), ccrSymbolList.end(), [&](const Symbol& lhs, const Symbol& rhs) {
@@ -205,6 +213,29 @@ TEST_CASE ("heaptrack.david.18594.gz") {
     REQUIRE(summary.fromAttached == false);
 }
 
+TEST_CASE ("heaptrack.david.18594.gz size histogram buckets") {
+    TestParser parser;
+    QSignalSpy spySizeHistogram(&parser.parser, &Parser::sizeHistogramDataAvailable);
+
+    parser.parser.setSizeHistogramBuckets({16, 1024});
+    parser.parser.parse(SRC_DIR "/heaptrack.david.18594.gz", QString(), {});
+
+    const auto summary = parser.awaitSummary();
+    if (spySizeHistogram.isEmpty())
+        REQUIRE(spySizeHistogram.wait(20000));
+    const auto histogram = spySizeHistogram.at(0).at(0).value<HistogramData>();
+    REQUIRE(histogram.rows.size() == 3);
+    REQUIRE(histogram.rows.at(0).size == 16);
+    REQUIRE(histogram.rows.at(1).size == 1024);
+    qint64 allocations = 0;
+    for (const auto& row : histogram.rows) {
+        allocations += row.columns[0].allocations;
+        REQUIRE(row.columns[1].allocations <= row.columns[0].allocations);
+        REQUIRE(row.columns[2].allocations <= row.columns[1].allocations);
+    }
+    REQUIRE(allocations == summary.cost.allocations);
+}
+
 TEST_CASE ("heaptrack.embedded_lsan_suppressions.84207.zst") {
     TestParser parser;
 
@@ -234,6 +265,30 @@ TEST_CASE ("heaptrack.embedded_lsan_suppressions.84207.zst without suppressions"
     REQUIRE(summary.totalLeakedSuppressed == 0);
 }
 
+TEST_CASE ("heaptrack.embedded_lsan_suppressions.84207.zst toggling suppressions") {
+    TestParser parser;
+
+    parser.parser.parse(SRC_DIR "/heaptrack.embedded_lsan_suppressions.84207.zst", QString(), {});
+    REQUIRE(parser.awaitSummary().totalLeakedSuppressed == 5);
+    parser.awaitFinished();
+
+    FilterParameters params;
+    params.disableEmbeddedSuppressions = true;
+    parser.parser.reparse(params);
+    auto summary = parser.awaitSummary(1);
+    REQUIRE(summary.cost.allocations == 5);
+    REQUIRE(summary.cost.leaked == 10);
+    REQUIRE(summary.totalLeakedSuppressed == 0);
+    parser.awaitFinished(2);
+
+    params.disableEmbeddedSuppressions = false;
+    parser.parser.reparse(params);
+    summary = parser.awaitSummary(2);
+    REQUIRE(summary.cost.leaked == 5);
+    REQUIRE(summary.totalLeakedSuppressed == 5);
+    parser.awaitFinished(3);
+}
+
 TEST_CASE ("heaptrack.heaptrack_gui.99454.zst") {
     TestParser parser;
 
@@ -296,6 +351,57 @@ TEST_CASE ("heaptrack.heaptrack_gui.99529.zst") {
     CHECK(cost.selfCost.peak == 68952);
 }
 
+TEST_CASE ("heaptrack.heaptrack_gui.99454.zst result cache") {
+    QTemporaryDir dir;
+    const auto path = dir.filePath(QStringLiteral("heaptrack.heaptrack_gui.99454.zst"));
+    REQUIRE(QFile::copy(SRC_DIR "/heaptrack.heaptrack_gui.99454.zst", path));
+
+    FilterParameters params;
+    params.disableBuiltinSuppressions = true;
+
+    struct Results
+    {
+        SummaryData summary;
+        int numBottomUpRows = 0;
+        int numCallerCalleeEntries = 0;
+        QString symbol;
+        AllocationData cost;
+    };
+    auto parse = [&]() {
+        TestParser parser;
+        parser.parser.setResultCacheEnabled(true);
+        parser.parser.parse(path, QString(), params);
+
+        Results results;
+        results.summary = parser.awaitSummary();
+        const auto bottomUp = parser.awaitBottomUp();
+        results.numBottomUpRows = bottomUp.rows.size();
+        REQUIRE(!bottomUp.rows.isEmpty());
+        for (const auto& child : bottomUp.rows.first().children) {
+            REQUIRE(child.parent == &bottomUp.rows.first());
+        }
+        const auto ccr = parser.awaitCallerCallee();
+        results.numCallerCalleeEntries = ccr.entries.size();
+        const auto& sym = parser.sortedSymbols(ccr)[994];
+        results.symbol = parser.symbolToString(sym);
+        results.cost = ccr.entries[sym].inclusiveCost;
+        return results;
+    };
+
+    const auto parsed = parse();
+    REQUIRE(QFile::exists(path + QStringLiteral(".cache")));
+    const auto cached = parse();
+
+    REQUIRE(cached.summary.debuggee == parsed.summary.debuggee);
+    REQUIRE(cached.summary.cost == parsed.summary.cost);
+    REQUIRE(cached.summary.totalTime == parsed.summary.totalTime);
+    REQUIRE(cached.numBottomUpRows == parsed.numBottomUpRows);
+    REQUIRE(cached.numCallerCalleeEntries == parsed.numCallerCalleeEntries);
+    REQUIRE(cached.symbol == "QHashData::allocateNode(int)|libQt5Core.so.5|/usr/lib/libQt5Core.so.5");
+    REQUIRE(cached.symbol == parsed.symbol);
+    REQUIRE(cached.cost == parsed.cost);
+}
+
 TEST_CASE ("heaptrack.heaptrack_gui.{99454,99529}.zst diff") {
     TestParser parser;
 
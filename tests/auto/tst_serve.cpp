@@ -0,0 +1,174 @@
+/*
+    SPDX-FileCopyrightText: 2026 Milian Wolff <mail@milianw.de>
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "3rdparty/doctest.h"
+
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "tempfile.h"
+#include "tst_config.h"
+
+using namespace std;
+
+namespace {
+/**
+ * Runs heaptrack_serve on the given data file until it gets destroyed
+ */
+struct Server
+{
+    explicit Server(const string& dataFile)
+    {
+        pid = fork();
+        REQUIRE(pid != -1);
+        if (pid == 0) {
+            const int null = ::open("/dev/null", O_WRONLY);
+            dup2(null, STDOUT_FILENO);
+            execl(HEAPTRACK_BIN_DIR "/heaptrack_serve", "heaptrack_serve", "--file", dataFile.c_str(), "--socket",
+                  socketFile.fileName.c_str(), nullptr);
+            _exit(127);
+        }
+    }
+
+    ~Server()
+    {
+        if (client != -1) {
+            close(client);
+        }
+        kill(pid, SIGTERM);
+        int status = 0;
+        CHECK(waitpid(pid, &status, 0) == pid);
+        CHECK(WIFEXITED(status));
+        CHECK(WEXITSTATUS(status) == 0);
+        // the socket gets removed again
+        CHECK(access(socketFile.fileName.c_str(), F_OK) != 0);
+    }
+
+    /// the socket only gets created once the data file got loaded, so retry until then
+    void connect()
+    {
+        sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        REQUIRE(socketFile.fileName.size() < sizeof(address.sun_path));
+        strcpy(address.sun_path, socketFile.fileName.c_str());
+        for (int attempt = 0; attempt < 1200; ++attempt) {
+            client = socket(AF_UNIX, SOCK_STREAM, 0);
+            REQUIRE(client != -1);
+            if (::connect(client, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0) {
+                return;
+            }
+            close(client);
+            client = -1;
+            int status = 0;
+            REQUIRE(waitpid(pid, &status, WNOHANG) == 0);
+            usleep(50000);
+        }
+        FAIL("heaptrack_serve did not start listening");
+    }
+
+    /// @return the response to @p request, without the trailing newline
+    string query(const string& request)
+    {
+        const auto line = request + '\n';
+        REQUIRE(write(client, line.c_str(), line.size()) == static_cast<ssize_t>(line.size()));
+        string response;
+        char c = 0;
+        while (read(client, &c, 1) == 1 && c != '\n') {
+            response += c;
+        }
+        return response;
+    }
+
+    TempFile socketFile;
+    pid_t pid = -1;
+    int client = -1;
+};
+
+/// @return the first number of @p key in the JSON @p response
+int64_t numberOf(const string& response, const string& key)
+{
+    const auto needle = '"' + key + "\":";
+    const auto pos = response.find(needle);
+    REQUIRE(pos != string::npos);
+    return strtoll(response.c_str() + pos + needle.size(), nullptr, 10);
+}
+
+bool contains(const string& response, const string& text)
+{
+    return response.find(text) != string::npos;
+}
+}
+
+TEST_CASE ("heaptrack.heaptrack_gui.99529.zst") {
+    Server server(SRC_DIR "/heaptrack.heaptrack_gui.99529.zst");
+    server.connect();
+
+    const auto files = server.query(R"({"query": "files"})");
+    REQUIRE(contains(files, R"("debuggee":"heaptrack_gui heaptrack.test_c.78689.zst")"));
+    REQUIRE(numberOf(files, "file") == 0);
+
+    // the totals that heaptrack_print reports for this file, with the builtin suppressions
+    const auto summary = server.query(R"({"query": "summary", "file": 0})");
+    REQUIRE(contains(summary, R"("query":"summary")"));
+    REQUIRE(numberOf(summary, "totalTime") == 3688);
+    REQUIRE(numberOf(summary, "suppressedLeaks") == 556289);
+    REQUIRE(numberOf(summary, "allocations") == 315255);
+    REQUIRE(numberOf(summary, "temporary") == 40771);
+    REQUIRE(numberOf(summary, "peak") == 64840134);
+    REQUIRE(numberOf(summary, "leaked") == 490088);
+    REQUIRE(numberOf(summary, "growths") == 792);
+    REQUIRE(numberOf(summary, "copied") == 1192045);
+
+    const auto top = server.query(R"({"query": "top", "file": 0, "cost": "peak", "limit": 2})");
+    REQUIRE(contains(top, R"("query":"top")"));
+    REQUIRE(numberOf(top, "peak") == 50331648);
+    REQUIRE(contains(top, "\"function\":\"std::vector<>::vector(unsigned long, std::allocator<> const&)\""));
+    // the locations come with the number of their traces
+    REQUIRE(numberOf(top, "traces") == 3);
+
+    const auto backtraces =
+        server.query(R"({"query": "backtraces", "file": 0, "function": "QHashData::allocateNode", "limit": 1})");
+    REQUIRE(numberOf(backtraces, "matches") == 1476);
+    REQUIRE(contains(backtraces, "\"function\":\"QHashData::allocateNode(int)\""));
+
+    // the whole time range covers all allocations, ending with what is still alive before the suppressions
+    const auto timeline = server.query(R"({"query": "timeline", "file": 0})");
+    REQUIRE(numberOf(timeline, "to") == 3688);
+    REQUIRE(numberOf(timeline, "allocations") == 315255);
+    REQUIRE(numberOf(timeline, "temporary") == 40771);
+    REQUIRE(numberOf(timeline, "consumedAtStart") == 0);
+    REQUIRE(numberOf(timeline, "consumedAtEnd") == 490088 + 556289);
+    REQUIRE(numberOf(timeline, "maxConsumed") <= 64840134);
+
+    const auto window = server.query(R"({"query": "timeline", "file": 0, "from": 2000, "to": 1000})");
+    REQUIRE(contains(window, R"("error":"the time window ends before it starts")"));
+
+    // a file has no difference to itself
+    const auto diff = server.query(R"({"query": "diff", "file": 0, "base": 0, "cost": "allocations"})");
+    REQUIRE(contains(diff, R"("query":"diff")"));
+    REQUIRE(numberOf(diff, "allocations") == 0);
+    REQUIRE(numberOf(diff, "peak") == 0);
+    REQUIRE(contains(diff, R"("locations":[])"));
+
+    // invalid requests get answered with an error, and the connection stays usable
+    REQUIRE(contains(server.query(R"({"query": )"), R"("error":)"));
+    REQUIRE(contains(server.query("garbage"), R"("error":)"));
+    REQUIRE(server.query(R"({"query": "foo"})") == R"({"error":"unknown query \"foo\""})");
+    REQUIRE(contains(server.query(R"({"query": "summary", "file": 1})"), R"("error":)"));
+    REQUIRE(contains(server.query(R"({"query": "top", "cost": "bar"})"), R"("error":)"));
+    REQUIRE(numberOf(server.query(R"({"query": "summary"})"), "allocations") == 315255);
+}
@@ -11,14 +11,19 @@
 #include "track/tracetree.h"
 
 #include "interpret/dwarfdiecache.h"
+#include "interpret/jitsymbols.h"
+#include "interpret/symbolizer.h"
 
 #include <elfutils/libdwelf.h>
 
 #include <algorithm>
+#include <cstring>
+#include <fstream>
 #include <future>
 #include <thread>
 
 #include <link.h>
+#include <unistd.h>
 
 using namespace std;
 
@@ -81,9 +86,11 @@ TEST_CASE ("getting backtrace traces") {
         SUBCASE("fill with skipping")
         {
             for (auto skip : {0, 1, 2}) {
-                for (int i = 0; i < 2 * Trace::MAX_SIZE; ++i) {
+                for (int i = 0; i < 2 * Trace::maxDepth(); ++i) {
                     REQUIRE(fill(trace, i, skip));
-                    const auto expectedSize = min(i + offset + 1 - skip, static_cast<int>(Trace::MAX_SIZE) - skip);
+                    const auto truncated = i + offset + 1 - skip > Trace::maxDepth();
+                    const auto expectedSize = truncated ? Trace::maxDepth() + 1 : i + offset + 1 - skip;
+                    REQUIRE(trace.isTruncated() == truncated);
                     validateTrace(trace, expectedSize);
                 }
             }
@@ -91,6 +98,61 @@ TEST_CASE ("getting backtrace traces") {
     }
 }
 
+TEST_CASE ("getting frame pointer traces") {
+    REQUIRE(Trace::selectUnwinder("frame-pointers"));
+
+    Trace trace;
+    REQUIRE(trace.fill(0));
+    const auto offset = trace.size();
+    REQUIRE(offset > 1);
+    validateTrace(trace, offset);
+
+    for (int i = 0; i < 2 * Trace::maxDepth(); ++i) {
+        REQUIRE(fill(trace, i, 0));
+        const auto truncated = i + offset + 1 > Trace::maxDepth();
+        const auto expectedSize = truncated ? Trace::maxDepth() + 1 : i + offset + 1;
+        REQUIRE(trace.isTruncated() == truncated);
+        validateTrace(trace, expectedSize);
+    }
+
+    SUBCASE("limit the unwind depth")
+    {
+        Trace::setMaxDepth(4);
+        REQUIRE(fill(trace, 16, 0));
+        REQUIRE(trace.isTruncated());
+        validateTrace(trace, 5);
+        REQUIRE(reinterpret_cast<uintptr_t>(trace[4]) == HEAPTRACK_TRUNCATED_TRACE_IP + 1);
+        Trace::setMaxDepth(Trace::DEFAULT_DEPTH);
+    }
+
+    REQUIRE(!Trace::selectUnwinder("does-not-exist"));
+    REQUIRE(Trace::selectUnwinder("native"));
+}
+
+TEST_CASE ("getting shadow stack traces") {
+    if (!Trace::selectUnwinder("shadow-stack")) {
+        // most processes run without a shadow stack, then the unwinder must not be selectable
+        MESSAGE("shadow stacks are not enabled for this process");
+        return;
+    }
+
+    Trace trace;
+    REQUIRE(trace.fill(0));
+    const auto offset = trace.size();
+    REQUIRE(offset > 1);
+    validateTrace(trace, offset);
+
+    for (int i = 0; i < 2 * Trace::maxDepth(); ++i) {
+        REQUIRE(fill(trace, i, 0));
+        const auto truncated = i + offset + 1 > Trace::maxDepth();
+        const auto expectedSize = truncated ? Trace::maxDepth() + 1 : i + offset + 1;
+        REQUIRE(trace.isTruncated() == truncated);
+        validateTrace(trace, expectedSize);
+    }
+
+    REQUIRE(Trace::selectUnwinder("native"));
+}
+
 TEST_CASE ("tracetree indexing") {
     TraceTree tree;
 
@@ -175,6 +237,33 @@ TEST_CASE ("tracetree indexing") {
     }
 }
 
+TEST_CASE ("tracetree wide nodes") {
+    TraceTree tree;
+
+    // enough children of a single parent to switch it to the wide children hash
+    const uintptr_t numChildren = 4 * TraceTree::MAX_LINKED_CHILDREN;
+    std::vector<uint32_t> indices;
+    Trace trace;
+    for (int k = 0; k < 2; ++k) {
+        for (uintptr_t leaf = 100; leaf < 100 + numChildren; ++leaf) {
+            trace.fillTestData(3, leaf);
+            auto index = tree.index(trace, [k](uintptr_t, uint32_t) {
+                REQUIRE(k == 0);
+                return true;
+            });
+            REQUIRE(index > 0);
+            if (k == 0) {
+                indices.push_back(index);
+            } else {
+                REQUIRE(index == indices[leaf - 100]);
+            }
+        }
+    }
+
+    std::sort(indices.begin(), indices.end());
+    REQUIRE(std::unique(indices.begin(), indices.end()) == indices.end());
+}
+
 struct CallbackData
 {
     Dwfl* dwfl = nullptr;
@@ -228,7 +317,7 @@ TEST_CASE ("symbolizing") {
         REQUIRE(die);
 
         auto dieName = cuDie->dieName(die->die());
-        auto isDebugBuild = i == 0 && dieName == "Trace::unwind(void**)";
+        auto isDebugBuild = i == 0 && dieName == "Trace::unwind(void**, int)";
         if (i == 0 + j) {
             if (!isDebugBuild)
                 REQUIRE(dieName == "Trace::fill(int)");
@@ -237,9 +326,21 @@ TEST_CASE ("symbolizing") {
         }
 
         auto scopes = findInlineScopes(die->die(), offset);
+        auto chain = cuDie->inlineChain(die, offset);
         if (i <= 1 + j) {
             REQUIRE(scopes.size() == 0);
+            REQUIRE(!chain);
         } else {
+            // the cached chain goes from the innermost scope outwards
+            REQUIRE(chain);
+            REQUIRE(chain->function == "asdf");
+            REQUIRE(chain->calls.size() == 2);
+            REQUIRE(chain->calls[0].function == "foo");
+            REQUIRE(chain->calls[0].location.line == 49);
+            REQUIRE(chain->calls[1].function == "bar");
+            REQUIRE(chain->calls[1].location.line == 57);
+            REQUIRE(cuDie->inlineChain(die, offset) == cuDie->inlineChain(die, offset));
+
             REQUIRE(scopes.size() == 2);
 
             Dwarf_Files* files = nullptr;
@@ -249,12 +350,12 @@ TEST_CASE ("symbolizing") {
             REQUIRE(cuDie->dieName(&scopes[0]) == "foo");
             auto loc = callSourceLocation(&scopes[0], files, cuDie->cudie());
             // called from bar
-            REQUIRE(loc.line == 52);
+            REQUIRE(loc.line == 57);
 
             REQUIRE(cuDie->dieName(&scopes[1]) == "asdf");
             loc = callSourceLocation(&scopes[1], files, cuDie->cudie());
             // called from foo
-            REQUIRE(loc.line == 44);
+            REQUIRE(loc.line == 49);
         }
 
         if (isDebugBuild) {
@@ -262,3 +363,174 @@ TEST_CASE ("symbolizing") {
         }
     }
 }
+
+TEST_CASE ("persistent symbol cache") {
+    Dwfl_Callbacks callbacks = {
+        &dwfl_build_id_find_elf,
+        &dwfl_standard_find_debuginfo,
+        &dwfl_offline_section_address,
+        nullptr,
+    };
+
+    auto dwfl = std::unique_ptr<Dwfl, void (*)(Dwfl*)>(dwfl_begin(&callbacks), &dwfl_end);
+    REQUIRE(dwfl);
+
+    dwfl_report_begin(dwfl.get());
+    CallbackData data = { dwfl.get(), nullptr };
+    dl_iterate_phdr(&dl_iterate_phdr_dwfl_report_callback, &data);
+    dwfl_report_end(dwfl.get(), nullptr, nullptr);
+    REQUIRE(data.mod);
+
+    const auto buildId = moduleBuildId(data.mod);
+    if (buildId.empty()) {
+        // the test binary was linked without a build-id
+        return;
+    }
+
+    char directory[] = "/tmp/tst_trace.XXXXXX";
+    REQUIRE(mkdtemp(directory));
+    const auto cacheDirectory = std::string(directory) + "/cache";
+    const auto basePath = cacheDirectory + '/' + buildId.substr(0, 2) + '/' + buildId.substr(2);
+    PersistentSymbolCache cache(cacheDirectory);
+
+    SUBCASE ("cu ranges") {
+        std::vector<CuRanges> ranges;
+        REQUIRE(!cache.loadCuRanges(buildId, &ranges));
+
+        DwarfDieCache original(data.mod);
+        REQUIRE(!original.m_cuDieRanges.empty());
+        cache.storeCuRanges(buildId, original.cuRanges());
+        REQUIRE(cache.loadCuRanges(buildId, &ranges));
+        REQUIRE(ranges.size() == original.m_cuDieRanges.size());
+
+        DwarfDieCache restored;
+        REQUIRE(restored.restore(data.mod, ranges));
+
+        Trace trace;
+        REQUIRE(bar(trace, 5));
+        for (int i = 0; i < trace.size(); ++i) {
+            auto addr = reinterpret_cast<Dwarf_Addr>(trace[i]);
+            auto originalCuDie = original.findCuDie(addr);
+            auto restoredCuDie = restored.findCuDie(addr);
+            REQUIRE(!originalCuDie == !restoredCuDie);
+            if (originalCuDie) {
+                REQUIRE(dwarf_dieoffset(originalCuDie->cudie()) == dwarf_dieoffset(restoredCuDie->cudie()));
+                REQUIRE(originalCuDie->bias() == restoredCuDie->bias());
+            }
+        }
+
+        const auto path = basePath + ".cus";
+        REQUIRE(truncate(path.c_str(), 20) == 0);
+        REQUIRE(!cache.loadCuRanges(buildId, &ranges));
+        REQUIRE(unlink(path.c_str()) == 0);
+    }
+
+    SUBCASE ("symbols") {
+        SymbolCache::Symbols symbols;
+        REQUIRE(!cache.loadSymbols(buildId, &symbols));
+
+        const SymbolCache::Symbols original = {
+            {0x10, 0x1010, 8, "_Z3foov"}, {0x20, 0x1020, 0, "bar"}, {0x28, 0x1028, 4, {}}};
+        cache.storeSymbols(buildId, original);
+        REQUIRE(cache.loadSymbols(buildId, &symbols));
+        REQUIRE(symbols.size() == original.size());
+        for (size_t i = 0; i < symbols.size(); ++i) {
+            REQUIRE(symbols[i].offset == original[i].offset);
+            REQUIRE(symbols[i].value == original[i].value);
+            REQUIRE(symbols[i].size == original[i].size);
+            REQUIRE(symbols[i].symname == original[i].symname);
+            REQUIRE(!symbols[i].demangled);
+        }
+
+        const auto path = basePath + ".symbols";
+        REQUIRE(truncate(path.c_str(), 30) == 0);
+        REQUIRE(!cache.loadSymbols(buildId, &symbols));
+        REQUIRE(unlink(path.c_str()) == 0);
+    }
+
+    rmdir((cacheDirectory + '/' + buildId.substr(0, 2)).c_str());
+    rmdir(cacheDirectory.c_str());
+    REQUIRE(rmdir(directory) == 0);
+}
+
+TEST_CASE ("jit symbols") {
+    char directory[] = "/tmp/tst_trace.XXXXXX";
+    REQUIRE(mkdtemp(directory));
+    const auto perfMap = std::string(directory) + "/perf.map";
+    const auto jitdump = std::string(directory) + "/jit.dump";
+    JitSymbols symbols(perfMap, jitdump);
+    REQUIRE(!symbols.find(0x1000));
+
+    SUBCASE ("perf map") {
+        std::ofstream out(perfMap);
+        out << "1000 20 LuaJIT trace 1\n0x2000 0x10 bar" << std::flush;
+        REQUIRE(symbols.find(0x1000));
+        REQUIRE(symbols.find(0x101f)->name == "LuaJIT trace 1");
+        REQUIRE(*symbols.find(0x1010)->fileName == perfMap);
+        REQUIRE(!symbols.find(0x1020));
+        // the incomplete line gets parsed once it is complete
+        REQUIRE(!symbols.find(0x2000));
+        out << "\n1010 8 baz\n" << std::flush;
+        REQUIRE(symbols.find(0x2000)->name == "bar");
+        REQUIRE(symbols.find(0x1014)->name == "baz");
+        REQUIRE(symbols.find(0x1008)->name == "LuaJIT trace 1");
+        REQUIRE(!symbols.find(0x1018));
+    }
+
+    SUBCASE ("jitdump") {
+        std::ofstream out(jitdump, std::ios::binary);
+        auto write = [&out](auto value) { out.write(reinterpret_cast<const char*>(&value), sizeof(value)); };
+        // magic, version, header size, elf_mach, pad1, pid, timestamp and flags
+        write(uint32_t(0x4A695444));
+        write(uint32_t(1));
+        write(uint32_t(40));
+        write(uint32_t(62));
+        write(uint32_t(0));
+        write(uint32_t(42));
+        write(uint64_t(0));
+        write(uint64_t(0));
+        auto load = [&](uint64_t address, uint64_t size, const char* name) {
+            const auto nameSize = strlen(name) + 1;
+            write(uint32_t(0));
+            write(uint32_t(56 + nameSize + size));
+            write(uint64_t(0));
+            write(uint32_t(42));
+            write(uint32_t(42));
+            write(address);
+            write(address);
+            write(size);
+            write(uint64_t(0));
+            out.write(name, nameSize);
+            out << std::string(size, '\x90');
+        };
+        load(0x3000, 0x40, "Interpreter");
+        out << std::flush;
+        REQUIRE(symbols.find(0x3020)->name == "Interpreter");
+        REQUIRE(*symbols.find(0x3020)->fileName == jitdump);
+
+        // move the code, unknown record types get skipped
+        write(uint32_t(1));
+        write(uint32_t(64));
+        write(uint64_t(0));
+        write(uint32_t(42));
+        write(uint32_t(42));
+        write(uint64_t(0x5000));
+        write(uint64_t(0x3000));
+        write(uint64_t(0x5000));
+        write(uint64_t(0x40));
+        write(uint64_t(0));
+        write(uint32_t(4));
+        write(uint32_t(20));
+        write(uint64_t(0));
+        write(uint32_t(0));
+        load(0x4000, 0x10, "java.lang.String::hashCode");
+        out << std::flush;
+        REQUIRE(symbols.find(0x4008)->name == "java.lang.String::hashCode");
+        REQUIRE(!symbols.find(0x3020));
+        REQUIRE(symbols.find(0x503f)->name == "Interpreter");
+    }
+
+    unlink(perfMap.c_str());
+    unlink(jitdump.c_str());
+    REQUIRE(rmdir(directory) == 0);
+}
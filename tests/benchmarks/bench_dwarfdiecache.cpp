@@ -0,0 +1,86 @@
+/*
+    SPDX-FileCopyrightText: 2026 Milian Wolff <mail@milianw.de>
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+/**
+ * Benchmark the CU and subprogram lookups of DwarfDieCache.
+ *
+ * Pass the path to a binary with debug information, ideally one with many
+ * compilation units or fragmented LTO ranges. The addresses that get looked
+ * up are spread over all CU ranges, similar to the instruction pointers that
+ * heaptrack_interpret would see for such a binary.
+ */
+
+#include <src/interpret/dwarfdiecache.h>
+
+#include "benchutil.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+int main(int argc, char** argv)
+{
+    const char* path = argc > 1 ? argv[1] : "/proc/self/exe";
+    const int repetitions = argc > 2 ? atoi(argv[2]) : 10;
+
+    Dwfl_Callbacks callbacks = {
+        &dwfl_build_id_find_elf,
+        &dwfl_standard_find_debuginfo,
+        &dwfl_offline_section_address,
+        nullptr,
+    };
+    auto dwfl = std::unique_ptr<Dwfl, void (*)(Dwfl*)>(dwfl_begin(&callbacks), &dwfl_end);
+    dwfl_report_begin(dwfl.get());
+    auto mod = dwfl_report_elf(dwfl.get(), path, path, -1, 0, false);
+    dwfl_report_end(dwfl.get(), nullptr, nullptr);
+    if (!mod) {
+        std::cerr << "failed to report " << path << ": " << dwfl_errmsg(dwfl_errno()) << '\n';
+        return 1;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    DwarfDieCache cache(mod);
+    const auto cached = std::chrono::steady_clock::now();
+
+    std::vector<Dwarf_Addr> addresses;
+    for (const auto& cu : cache.m_cuDieRanges) {
+        for (const auto& range : cu.ranges()) {
+            const auto step = std::max<Dwarf_Addr>(1, (range.high - range.low) / 4);
+            for (auto addr = range.low; addr < range.high; addr += step) {
+                addresses.push_back(addr);
+            }
+        }
+    }
+
+    uint64_t numCuDies = 0;
+    uint64_t numSubprograms = 0;
+    for (int i = 0; i < repetitions; ++i) {
+        for (auto addr : addresses) {
+            auto cuDie = cache.findCuDie(addr);
+            escape(cuDie);
+            if (!cuDie) {
+                continue;
+            }
+            ++numCuDies;
+            auto subprogram = cuDie->findSubprogramDie(addr - cuDie->bias());
+            escape(subprogram);
+            if (subprogram) {
+                ++numSubprograms;
+            }
+        }
+    }
+    const auto end = std::chrono::steady_clock::now();
+
+    auto ms = [](std::chrono::steady_clock::duration duration) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(duration).count();
+    };
+    std::cout << "CUs: " << cache.m_cuDieRanges.size() << ", lookups: " << addresses.size() * repetitions
+              << ", found CUs: " << numCuDies << ", found subprograms: " << numSubprograms << '\n'
+              << "building the cache: " << ms(cached - start) << "ms, lookups: " << ms(end - cached) << "ms\n";
+    return 0;
+}
@@ -4,13 +4,37 @@
     SPDX-License-Identifier: LGPL-2.1-or-later
 */
 
+/**
+ * Benchmark the LineReader.
+ *
+ * Without arguments, synthetic data gets parsed. Otherwise pass uncompressed
+ * heaptrack data files, or - to read from stdin, e.g.:
+ *
+ *   zcat tests/auto/heaptrack.david.18594.gz | bench_linereader -
+ */
+
 #include <src/util/linereader.h>
 
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <iterator>
 #include <sstream>
 #include <string>
 
-int main()
+namespace {
+std::string readContents(const char* path)
+{
+    if (!strcmp(path, "-")) {
+        return {std::istreambuf_iterator<char>(std::cin), std::istreambuf_iterator<char>()};
+    }
+    std::ifstream file(path, std::ios_base::in | std::ios_base::binary);
+    return {std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+}
+
+std::string syntheticContents()
 {
     std::string contents;
     contents.reserve(5400000);
@@ -19,19 +43,53 @@ int main()
         contents.append("102 345 678 9ab\n");
         contents.append("102345 6789ab cdef01 23456789\n");
     }
+    return contents;
+}
 
+void bench(const std::string& name, const std::string& contents, int repetitions)
+{
     uint64_t ret = 0;
-    for (int i = 0; i < 1000; ++i) {
+    uint64_t numLines = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < repetitions; ++i) {
         std::istringstream in(contents);
         LineReader reader;
         while (reader.getLine(in)) {
+            ++numLines;
+            switch (reader.mode()) {
+            case 's':
+            case 'm':
+            case 'x':
+            case 'X':
+            case 'S':
+            case '#':
+                // skip the lines containing strings
+                continue;
+            }
             uint64_t hex;
             while (reader.readHex(hex)) {
                 ret += hex;
             }
         }
     }
+    const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << name << ": " << numLines << " lines in " << elapsed * 1000 << "ms, "
+              << (contents.size() * repetitions / elapsed / 1024 / 1024) << "MB/s (" << ret << ")\n";
+}
+}
 
-    std::cout << ret << '\n';
+int main(int argc, char** argv)
+{
+    if (argc < 2) {
+        bench("synthetic", syntheticContents(), 1000);
+        return 0;
+    }
+
+    for (int i = 1; i < argc; ++i) {
+        const auto contents = readContents(argv[i]);
+        // parse roughly as much data per file as for the synthetic data
+        const auto repetitions = std::max<int>(1, 5400000000ull / std::max<size_t>(contents.size(), 1));
+        bench(argv[i], contents, std::min(repetitions, 1000));
+    }
     return 0;
 }
@@ -11,6 +11,10 @@
 #include <QCommandLineParser>
 #include <QCoreApplication>
 #include <QDebug>
+#include <QElapsedTimer>
+#include <QTextStream>
+
+#include <sys/resource.h>
 
 int main(int argc, char** argv)
 {
@@ -21,8 +25,12 @@ int main(int argc, char** argv)
         QStringLiteral("stop parsing after the given stage, possible values are: Summary, BottomUp, SizeHistogram, "
                        "TopDownAndCallerCallee, Finished"),
         QStringLiteral("stage"), QStringLiteral("Finished"));
+    QCommandLineOption csvOption(QStringLiteral("csv"),
+                                 QStringLiteral("print the file, the stage, the wall time in ms and the peak RSS in kB "
+                                                "as a line of comma separated values, see bench_parser.sh"));
     QCommandLineParser commandLineParser;
     commandLineParser.addOption(stopAfterOption);
+    commandLineParser.addOption(csvOption);
     commandLineParser.addPositionalArgument(QStringLiteral("file"), QStringLiteral("heaptrack data files to parse"));
     commandLineParser.addHelpOption();
 
@@ -35,8 +43,22 @@ int main(int argc, char** argv)
     qRegisterMetaType<CallerCalleeResults>();
     qRegisterMetaType<TreeData>();
 
+    // e.g. run this on tests/auto/heaptrack.heaptrack_gui.99454.zst, which contains lots of
+    // traces from many threads that arrive out of order
+    QElapsedTimer timer;
     Parser parser;
-    QObject::connect(&parser, &Parser::finished, &app, &QCoreApplication::quit);
+    QObject::connect(&parser, &Parser::finished, &app, [&]() {
+        const auto elapsed = timer.elapsed();
+        if (commandLineParser.isSet(csvOption)) {
+            rusage usage;
+            getrusage(RUSAGE_SELF, &usage);
+            QTextStream(stdout) << files.value(0) << ',' << commandLineParser.value(stopAfterOption) << ','
+                                << elapsed << ',' << usage.ru_maxrss << '\n';
+        } else {
+            qInfo() << "parsing took" << elapsed << "ms";
+        }
+        app.quit();
+    });
     QObject::connect(&parser, &Parser::failedToOpen, &app, [&](const QString& path) {
         qWarning() << "failed to open" << path;
         app.exit(1);
@@ -69,6 +91,7 @@ int main(int argc, char** argv)
             return 1;
     }
 
+    timer.start();
     parser.parse(files.value(0), files.value(1), params, stopAfter);
 
     return app.exec();
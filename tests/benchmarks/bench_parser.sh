@@ -0,0 +1,51 @@
+#!/bin/bash
+
+#
+# SPDX-FileCopyrightText: 2026 Milian Wolff <mail@milianw.de>
+#
+# SPDX-License-Identifier: LGPL-2.1-or-later
+#
+
+# Parse the sample recordings, and optionally further ones, with bench_parser and report the wall
+# time and peak RSS after every stage of the parser as comma separated values:
+#
+#   bench_parser.sh <bench_parser> <sample dir> [<file>...]
+#
+# Every stage runs in a process of its own, such that the peak RSS only covers that stage and the
+# ones before it. Set BENCH_REPETITIONS to run every stage more than once. When BENCH_OUTPUT is set,
+# the results get appended to that file instead, to track how they change over time. The revision
+# column identifies the source tree the results got measured for.
+
+if [ $# -lt 2 ]; then
+    echo "usage: $0 <bench_parser> <sample dir> [<file>...]"
+    exit 1
+fi
+
+bench_parser=$(readlink -f "$1")
+sample_dir=$(readlink -f "$2")
+shift 2
+repetitions=${BENCH_REPETITIONS:-1}
+output=${BENCH_OUTPUT:-/dev/stdout}
+
+revision=$(git -C "$sample_dir" describe --always --dirty 2> /dev/null || echo unknown)
+timestamp=$(date -u +%Y-%m-%dT%H:%M:%SZ)
+
+if [ "$output" = /dev/stdout ] || [ ! -s "$output" ]; then
+    echo "timestamp,revision,file,stage,run,wall_ms,peak_rss_kb" >> "$output"
+fi
+
+for file in "$sample_dir"/*.zst "$@"; do
+    for stage in Summary BottomUp SizeHistogram TopDownAndCallerCallee Finished; do
+        for run in $(seq "$repetitions"); do
+            # i.e. "file,stage,wall,rss", where the file name may contain commas itself
+            if ! result=$("$bench_parser" --csv --stop-after "$stage" "$file" 2> /dev/null); then
+                echo "failed to parse $file" >&2
+                continue 3
+            fi
+            rss=${result##*,}
+            result=${result%,*}
+            wall=${result##*,}
+            echo "$timestamp,$revision,$(basename "$file"),$stage,$run,$wall,$rss" >> "$output"
+        done
+    done
+done
@@ -0,0 +1,94 @@
+#!/bin/bash
+
+#
+# SPDX-FileCopyrightText: 2026 Milian Wolff <mail@milianw.de>
+#
+# SPDX-License-Identifier: LGPL-2.1-or-later
+#
+
+# Run synthetic allocation workloads through the whole pipeline, i.e. the preloaded tracer, the
+# interpreter, the compressor and the analysis, and report the costs of every stage:
+#
+#   bench_pipeline.sh <bin dir> <heaptrack_interpret> <bench_workload> <bench_workload_module>
+#
+# The slowdown compares the run under heaptrack with the run without it. The interpreter and the
+# compressor replay the raw data of a separate run, such that their CPU time can be told apart.
+# The bytes per event relate the raw and the compressed output to the allocations and deallocations.
+# Set BENCH_SCALE to multiply the size of the workloads, e.g. for more stable numbers.
+
+if [ $# -ne 4 ]; then
+    echo "usage: $0 <bin dir> <heaptrack_interpret> <bench_workload> <bench_workload_module>"
+    exit 1
+fi
+
+bin_dir=$(readlink -f "$1")
+interpreter=$(readlink -f "$2")
+workload=$(readlink -f "$3")
+module=$(readlink -f "$4")
+scale=${BENCH_SCALE:-1}
+
+work_dir=$(mktemp -d /tmp/heaptrack_bench_pipeline.XXXXXX)
+trap 'rm -rf "$work_dir"' EXIT
+
+if command -v zstd > /dev/null 2>&1; then
+    compressor="zstd -c"
+    uncompressor="zstd -dcq"
+else
+    compressor="gzip -c"
+    uncompressor="gzip -dc"
+fi
+
+# print the wall, the user and the system time in seconds of running the given command
+measure() {
+    local TIMEFORMAT="%R %U %S"
+    { time "$@" > /dev/null 2>&1; } 2>&1
+}
+
+cpu() {
+    echo "$1" | awk '{ printf "%.3f", $2 + $3 }'
+}
+
+wall() {
+    echo "$1" | awk '{ printf "%.3f", $1 }'
+}
+
+run() {
+    local name=$1
+    shift
+
+    local native traced interpret compress analyze
+    native=$(measure "$workload" "$@")
+    traced=$(measure "$bin_dir/heaptrack" --record-only -o "$work_dir/$name" "$workload" "$@")
+    local output
+    output=$(ls "$work_dir/$name".{zst,gz} 2> /dev/null | head -n1)
+    if [ -z "$output" ]; then
+        echo "$name: heaptrack did not produce any output"
+        return 1
+    fi
+
+    HEAPTRACK_ZSTD_LEVEL= "$bin_dir/heaptrack" --raw -o "$work_dir/$name" "$workload" "$@" > /dev/null 2>&1
+    $uncompressor < "$(ls "$work_dir/$name".raw.* | head -n1)" > "$work_dir/$name.raw"
+    interpret=$(HEAPTRACK_ZSTD_LEVEL= measure sh -c "'$interpreter' < '$work_dir/$name.raw' > '$work_dir/$name.txt'")
+    compress=$(measure sh -c "$compressor < '$work_dir/$name.txt' > '$work_dir/$name.compressed'")
+    analyze=$(measure "$bin_dir/heaptrack_print" -f "$output")
+
+    local events raw_size output_size
+    events=$(grep -c '^[+-]' "$work_dir/$name.txt")
+    raw_size=$(stat -c %s "$work_dir/$name.raw")
+    output_size=$(stat -c %s "$output")
+
+    printf "%-10s %9s %9s %8s %10s %10s %10s %10s %11s %10s\n" "$name" "$(wall "$native")" "$(wall "$traced")" \
+        "$(awk -v n="$(wall "$native")" -v t="$(wall "$traced")" 'BEGIN { printf "%.1fx", (n > 0 ? t / n : 0) }')" \
+        "$(cpu "$interpret")" "$(cpu "$compress")" "$events" \
+        "$(awk -v s="$raw_size" -v e="$events" 'BEGIN { printf "%.1f", (e > 0 ? s / e : 0) }')" \
+        "$(awk -v s="$output_size" -v e="$events" 'BEGIN { printf "%.2f", (e > 0 ? s / e : 0) }')" \
+        "$(wall "$analyze")"
+    rm -f "$work_dir/$name".*
+}
+
+printf "%-10s %9s %9s %8s %10s %10s %10s %10s %11s %10s\n" "workload" "native[s]" "traced[s]" "slowdown" \
+    "interp[s]" "compr[s]" "events" "raw[B/ev]" "output[B/ev]" "analyze[s]"
+run churn churn $((1000000 * scale))
+run threads threads 8 $((200000 * scale))
+run recursion recursion 64 $((200000 * scale))
+run dlopen dlopen "$module" $((2000 * scale))
@@ -0,0 +1,203 @@
+/*
+    SPDX-FileCopyrightText: 2026 Milian Wolff <mail@milianw.de>
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+/**
+ * Replay the allocations and deallocations of a raw recording against the pointer maps.
+ *
+ * Unlike the synthetic pointers of bench_pointers.h, this measures the maps on the address
+ * distribution and reuse of a real allocator. Pass an uncompressed raw data file, or - to
+ * read from stdin, e.g.:
+ *
+ *   heaptrack -r some_application
+ *   zstd -dc heaptrack.some_application.1234.raw.zst | bench_pointerreplay -
+ */
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+#include "bench_pointers.h"
+#include "src/util/linereader.h"
+#include "src/util/pointermap.h"
+#include "util/config.h"
+
+namespace {
+struct Operation
+{
+    uint64_t ptr;
+    AllocationInfoIndex index;
+    bool isAllocation;
+};
+
+/// @return the allocations and deallocations in @p in, with the same allocation indices the interpreter assigns
+std::vector<Operation> readOperations(std::istream& in)
+{
+    std::vector<Operation> operations;
+    AllocationInfoSet allocationInfos;
+    // binary records delta encode their pointers, see LineWriter::writeVarintRecord
+    uint64_t lastPtr = 0;
+    auto undoDelta = [&lastPtr](uint64_t value) {
+        lastPtr += static_cast<uint64_t>(LineReader::unzigzag(value));
+        return lastPtr;
+    };
+
+    LineReader reader;
+    while (reader.getRecord(in)) {
+        if (reader.mode() == 'v') {
+            unsigned int heaptrackVersion = 0;
+            unsigned int fileVersion = 0;
+            if ((reader >> heaptrackVersion) && (reader >> fileVersion)) {
+                reader.setExpectedSizedStrings(fileVersion >= 3);
+                reader.setExpectBinaryRecords(fileVersion >= HEAPTRACK_BINARY_FILE_FORMAT_VERSION);
+            }
+        } else if (reader.mode() == 'M') {
+            std::cerr << "the data got recorded through shared memory, record it with heaptrack -r instead\n";
+            return {};
+        } else if (reader.mode() == '+') {
+            uint64_t size = 0;
+            TraceIndex traceId;
+            uint64_t ptr = 0;
+            if (!(reader >> size) || !(reader >> traceId.index) || !(reader >> ptr)) {
+                continue;
+            }
+            if (reader.isBinary()) {
+                ptr = undoDelta(ptr);
+            }
+            AllocationInfoIndex index;
+            allocationInfos.add(size, traceId, &index);
+            operations.push_back({ptr, index, true});
+        } else if (reader.mode() == '-') {
+            uint64_t ptr = 0;
+            if (!(reader >> ptr)) {
+                continue;
+            }
+            if (reader.isBinary()) {
+                ptr = undoDelta(ptr);
+            }
+            operations.push_back({ptr, {}, false});
+        } else if (reader.mode() == 'r') {
+            uint64_t size = 0;
+            TraceIndex traceId;
+            uint64_t oldPtr = 0;
+            uint64_t ptr = 0;
+            if (!(reader >> size) || !(reader >> traceId.index) || !(reader >> oldPtr) || !(reader >> ptr)) {
+                continue;
+            }
+            if (reader.isBinary()) {
+                oldPtr = undoDelta(oldPtr);
+                ptr = undoDelta(ptr);
+            }
+            AllocationInfoIndex index;
+            allocationInfos.add(size, traceId, &index);
+            operations.push_back({oldPtr, {}, false});
+            operations.push_back({ptr, index, true});
+        }
+    }
+    return operations;
+}
+
+/// @return the position in @p operations after which the most pointers are alive at the same time
+size_t peakPosition(const std::vector<Operation>& operations, size_t* peakPointers)
+{
+    PointerHashMap live;
+    size_t peak = 0;
+    *peakPointers = 0;
+    for (size_t i = 0; i < operations.size(); ++i) {
+        const auto& operation = operations[i];
+        if (operation.isAllocation) {
+            live.addPointer(operation.ptr, operation.index);
+        } else {
+            live.takePointer(operation.ptr);
+        }
+        if (live.map.size() > *peakPointers) {
+            *peakPointers = live.map.size();
+            peak = i;
+        }
+    }
+    return peak;
+}
+
+template <typename Map>
+void replay(const char* name, const std::vector<Operation>& operations, size_t peak, size_t peakPointers)
+{
+    // run a few times and report the fastest one, the memory usage is the same for all of them
+    const int repetitions = 3;
+    auto best = std::numeric_limits<double>::max();
+    size_t peakMemory = 0;
+    uint64_t matches = 0;
+    for (int repetition = 0; repetition < repetitions; ++repetition) {
+        malloc_trim(0);
+        const auto baseline = mallinfo2().uordblks;
+        matches = 0;
+        double elapsed = 0;
+        {
+            Map map;
+            auto start = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < operations.size(); ++i) {
+                const auto& operation = operations[i];
+                if (operation.isAllocation) {
+                    map.addPointer(operation.ptr, operation.index);
+                } else {
+                    const auto allocation = map.takePointer(operation.ptr);
+                    if (allocation.second) {
+                        ++matches;
+                    }
+                }
+                if (i == peak) {
+                    // don't count the time it takes to query the memory usage
+                    elapsed += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start)
+                                   .count();
+                    peakMemory = mallinfo2().uordblks - baseline;
+                    start = std::chrono::steady_clock::now();
+                }
+            }
+            elapsed += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        }
+        best = std::min(best, elapsed);
+    }
+
+    std::cout << name << "\t|\t" << best << "\t|\t" << (operations.size() * 1000. / best) << "\t|\t"
+              << peakMemory << "\t|\t" << (peakPointers ? double(peakMemory) / peakPointers : 0.) << "\t|\t"
+              << matches << '\n';
+}
+}
+
+int main(int argc, char** argv)
+{
+    if (argc != 2) {
+        std::cerr << "usage: " << argv[0] << " <uncompressed raw data file, or - for stdin>\n";
+        return 1;
+    }
+
+    std::vector<Operation> operations;
+    if (!strcmp(argv[1], "-")) {
+        operations = readOperations(std::cin);
+    } else {
+        std::ifstream file(argv[1], std::ios_base::in | std::ios_base::binary);
+        if (!file.is_open()) {
+            std::cerr << "failed to open " << argv[1] << '\n';
+            return 1;
+        }
+        operations = readOperations(file);
+    }
+    if (operations.empty()) {
+        std::cerr << "no allocations found in " << argv[1] << '\n';
+        return 1;
+    }
+
+    size_t peakPointers = 0;
+    const auto peak = peakPosition(operations, &peakPointers);
+    std::cout << operations.size() << " operations, at most " << peakPointers << " live pointers\n\n";
+
+    std::cout << "map\t\t|\tms\t|\toperations/s\t|\tpeak bytes\t|\tbytes/pointer\t|\tmatched frees\n";
+    replay<PointerMap>("PointerMap", operations, peak, peakPointers);
+    replay<SortedPointerMap>("SortedPointerMap", operations, peak, peakPointers);
+    replay<PointerHashMap>("PointerHashMap", operations, peak, peakPointers);
+    return 0;
+}
@@ -8,6 +8,7 @@
 #define BENCH_POINTERS
 
 #include <algorithm>
+#include <chrono>
 #include <cstdint>
 #include <iostream>
 #include <random>
@@ -15,8 +16,39 @@
 
 #include <malloc.h>
 
+#include <tsl/robin_map.h>
+
 #include "src/util/indices.h"
 
+/**
+ * The straight-forward alternative to PointerMap, which stores every pointer in a hash map.
+ */
+struct PointerHashMap
+{
+    PointerHashMap()
+    {
+        map.reserve(65536);
+    }
+
+    void addPointer(const uint64_t ptr, const AllocationInfoIndex index)
+    {
+        map[ptr] = index;
+    }
+
+    std::pair<AllocationInfoIndex, bool> takePointer(const uint64_t ptr)
+    {
+        auto it = map.find(ptr);
+        if (it == map.end()) {
+            return {{}, false};
+        }
+        auto ret = std::make_pair(it->second, true);
+        map.erase(it);
+        return ret;
+    }
+
+    tsl::robin_map<uint64_t, AllocationInfoIndex> map;
+};
+
 template <typename Map>
 void benchPointers()
 {
@@ -42,19 +74,27 @@ void benchPointers()
         malloc_trim(0);
         std::cerr << "begin actual benchmark:  \t" << (mallinfo2().uordblks - baseline) << std::endl;
 
+        auto elapsedMs = [](std::chrono::steady_clock::time_point start) {
+            return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start)
+                .count();
+        };
+
         {
             Map map;
+            auto start = std::chrono::steady_clock::now();
             for (auto ptr : pointers) {
                 AllocationInfoIndex index;
                 index.index = static_cast<uint32_t>(ptr);
                 map.addPointer(ptr, index);
             }
 
+            const auto addTime = elapsedMs(start);
             const auto added = mallinfo2().uordblks - baseline;
             std::cerr << "pointers added:          \t" << added << " (" << (float(added) * 100.f / allocated)
-                      << "% overhead)" << std::endl;
+                      << "% overhead) in " << addTime << "ms" << std::endl;
 
             std::shuffle(pointers.begin(), pointers.end(), randGenerator);
+            start = std::chrono::steady_clock::now();
             for (auto ptr : pointers) {
                 AllocationInfoIndex index;
                 index.index = static_cast<uint32_t>(ptr);
@@ -64,7 +104,8 @@ void benchPointers()
                 }
             }
 
-            std::cerr << "pointers removed:        \t" << mallinfo2().uordblks << std::endl;
+            const auto takeTime = elapsedMs(start);
+            std::cerr << "pointers removed:        \t" << mallinfo2().uordblks << " in " << takeTime << "ms" << std::endl;
             malloc_trim(0);
             std::cerr << "trimmed:                 \t" << mallinfo2().uordblks << std::endl;
         }
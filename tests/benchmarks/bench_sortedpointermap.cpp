@@ -0,0 +1,14 @@
+/*
+    SPDX-FileCopyrightText: 2026 Milian Wolff <mail@milianw.de>
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#include "bench_pointers.h"
+#include "src/util/pointermap.h"
+
+int main()
+{
+    benchPointers<SortedPointerMap>();
+    return 0;
+}
@@ -20,37 +20,56 @@
 #include <boost/container/slist.hpp>
 
 #include "../../src/analyze/allocationdata.h"
+#include "../../src/track/tracetree.h"
 
 constexpr uint64_t MAX_TREE_DEPTH = 64;
 constexpr uint64_t NO_BRANCH_DEPTH = 4;
 constexpr uint64_t BRANCH_WIDTH = 8;
+constexpr uint64_t WIDE_BRANCH_LEVEL = 2;
+constexpr uint64_t WIDE_BRANCH_WIDTH = 16384;
 constexpr uint64_t NUM_TRACES = 1000000;
 
-using Trace = std::array<uint64_t, MAX_TREE_DEPTH>;
+using IpTrace = std::array<uint64_t, MAX_TREE_DEPTH>;
 
-uint64_t generateIp(uint64_t level)
+enum class Shape
 {
+    // branch into a few children every couple of levels
+    Deep,
+    // branch into very many children on a single level
+    Wide,
+};
+
+uint64_t generateIp(uint64_t level, Shape shape)
+{
+    static std::mt19937_64 engine(0);
+    if (shape == Shape::Wide) {
+        if (level != WIDE_BRANCH_LEVEL) {
+            return level;
+        }
+        static std::uniform_int_distribution<uint64_t> dist(0, WIDE_BRANCH_WIDTH - 1);
+        return dist(engine);
+    }
+
     if (level % NO_BRANCH_DEPTH) {
         return level;
     }
-    static std::mt19937_64 engine(0);
     static std::uniform_int_distribution<uint64_t> dist(0, BRANCH_WIDTH - 1);
     return dist(engine);
 }
 
-Trace generateTrace()
+IpTrace generateTrace(Shape shape)
 {
-    Trace trace;
+    IpTrace trace;
     for (uint64_t i = 0; i < MAX_TREE_DEPTH; ++i) {
-        trace[i] = generateIp(i);
+        trace[i] = generateIp(i, shape);
     }
     return trace;
 }
 
-std::vector<Trace> generateTraces()
+std::vector<IpTrace> generateTraces(Shape shape)
 {
-    std::vector<Trace> traces(NUM_TRACES);
-    std::generate(traces.begin(), traces.end(), generateTrace);
+    std::vector<IpTrace> traces(NUM_TRACES);
+    std::generate(traces.begin(), traces.end(), [shape]() { return generateTrace(shape); });
     return traces;
 }
 
@@ -100,7 +119,7 @@ void setParents(boost::container::pmr::slist<Node<boost::container::pmr::slist>>
 }
 
 template <template <typename...> class Container, typename... Allocator>
-Container<Node<Container>> buildTree(const std::vector<Trace>& traces, const Allocator&... allocator)
+Container<Node<Container>> buildTree(const std::vector<IpTrace>& traces, const Allocator&... allocator)
 {
     auto findNode = [&](Container<Node<Container>>* nodes, uint64_t ip, const Node<Container>* parent) {
         auto it =
@@ -142,14 +161,14 @@ uint64_t numNodes(const Container<Node<Container>>& tree)
 }
 
 template <template <typename...> class Container>
-std::pair<uint64_t, uint64_t> run(const std::vector<Trace>& traces)
+std::pair<uint64_t, uint64_t> run(const std::vector<IpTrace>& traces)
 {
     const auto tree = buildTree<Container>(traces);
     return {tree.size(), numNodes(tree)};
 }
 
 template <>
-std::pair<uint64_t, uint64_t> run<boost::container::pmr::slist>(const std::vector<Trace>& traces)
+std::pair<uint64_t, uint64_t> run<boost::container::pmr::slist>(const std::vector<IpTrace>& traces)
 {
     boost::container::pmr::monotonic_buffer_resource mbr;
     const auto tree = buildTree<boost::container::pmr::slist>(traces, &mbr);
@@ -157,6 +176,69 @@ std::pair<uint64_t, uint64_t> run<boost::container::pmr::slist>(const std::vecto
 }
 }
 
+namespace TrackerTree {
+// the sorted per-node children vectors that TraceTree used before switching to a flat hash table
+class LegacyTraceTree
+{
+public:
+    template <typename Fun>
+    uint32_t index(const Trace& trace, Fun callback)
+    {
+        uint32_t index = 0;
+        Edge* parent = &m_root;
+        for (int i = trace.size() - 1; i >= 0; --i) {
+            const auto ip = trace[i];
+            if (!ip) {
+                continue;
+            }
+            auto it = std::lower_bound(parent->children.begin(), parent->children.end(), ip,
+                                       [](const Edge& l, const Trace::ip_t ip) { return l.instructionPointer < ip; });
+            if (it == parent->children.end() || it->instructionPointer != ip) {
+                index = m_index++;
+                it = parent->children.insert(it, {ip, index, {}});
+                if (!callback(reinterpret_cast<uintptr_t>(ip), parent->index)) {
+                    return 0;
+                }
+            }
+            index = it->index;
+            parent = &(*it);
+        }
+        return index;
+    }
+
+private:
+    struct Edge
+    {
+        Trace::ip_t instructionPointer;
+        uint32_t index;
+        std::vector<Edge> children;
+    };
+
+    Edge m_root = {0, 0, {}};
+    uint32_t m_index = 1;
+};
+
+template <typename Tree>
+std::pair<uint64_t, uint64_t> run(const std::vector<IpTrace>& traces)
+{
+    Tree tree;
+    uint64_t numNodes = 0;
+    uint64_t checksum = 0;
+    Trace trace;
+    for (const auto& ips : traces) {
+        // TraceTree expects the leaf first and skips null instruction pointers
+        IpTrace leafFirst;
+        std::transform(ips.rbegin(), ips.rend(), leafFirst.begin(), [](uint64_t ip) { return ip + 1; });
+        trace.fillTestData(leafFirst.data(), leafFirst.size());
+        checksum += tree.index(trace, [&numNodes](uintptr_t, uint32_t) {
+            ++numNodes;
+            return true;
+        });
+    }
+    return {checksum, numNodes};
+}
+}
+
 enum class Tag
 {
     QVector,
@@ -164,9 +246,11 @@ enum class Tag
     StdList,
     BoostSlist,
     BoostPmrSlist,
+    TraceTree,
+    LegacyTraceTree,
 };
 
-std::pair<uint64_t, uint64_t> run(const std::vector<Trace>& traces, Tag tag)
+std::pair<uint64_t, uint64_t> run(const std::vector<IpTrace>& traces, Tag tag)
 {
     switch (tag) {
     case Tag::QVector:
@@ -179,14 +263,19 @@ std::pair<uint64_t, uint64_t> run(const std::vector<Trace>& traces, Tag tag)
         return Tree::run<boost::container::slist>(traces);
     case Tag::BoostPmrSlist:
         return Tree::run<boost::container::pmr::slist>(traces);
+    case Tag::TraceTree:
+        return TrackerTree::run<::TraceTree>(traces);
+    case Tag::LegacyTraceTree:
+        return TrackerTree::run<TrackerTree::LegacyTraceTree>(traces);
     }
     Q_UNREACHABLE();
 }
 
 int main(int argc, char** argv)
 {
-    if (argc != 2) {
-        std::cerr << "usage: bench_tree [QVector|std::vector|std::list|boost::slist|boost::pmr::slist]\n";
+    if (argc != 2 && argc != 3) {
+        std::cerr << "usage: bench_tree [QVector|std::vector|std::list|boost::slist|boost::pmr::slist|TraceTree|"
+                     "LegacyTraceTree] [deep|wide]\n";
         return 1;
     }
 
@@ -202,11 +291,27 @@ int main(int argc, char** argv)
             return Tag::BoostSlist;
         if (t == "boost::pmr::slist")
             return Tag::BoostPmrSlist;
+        if (t == "TraceTree")
+            return Tag::TraceTree;
+        if (t == "LegacyTraceTree")
+            return Tag::LegacyTraceTree;
         std::cerr << "unhandled tag: " << t << "\n";
         exit(1);
     }();
 
-    const auto traces = generateTraces();
+    const auto shape = [&]() {
+        if (argc < 3)
+            return Shape::Deep;
+        auto s = std::string(argv[2]);
+        if (s == "deep")
+            return Shape::Deep;
+        if (s == "wide")
+            return Shape::Wide;
+        std::cerr << "unhandled shape: " << s << "\n";
+        exit(1);
+    }();
+
+    const auto traces = generateTraces(shape);
     const auto result = run(traces, tag);
     std::cout << result.first << ", " << result.second << std::endl;
     return 0;
@@ -0,0 +1,121 @@
+/*
+    SPDX-FileCopyrightText: 2026 Milian Wolff <mail@milianw.de>
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+/**
+ * Synthetic allocation workloads for the end-to-end benchmark, see bench_pipeline.sh:
+ *
+ *   bench_workload churn <allocations>
+ *   bench_workload threads <threads> <allocations per thread>
+ *   bench_workload recursion <depth> <allocations>
+ *   bench_workload dlopen <module> <iterations>
+ */
+
+#include <dlfcn.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+// keep a few allocations alive for a while, such that not every allocation is temporary
+const size_t NUM_SLOTS = 1024;
+
+void escape(void* ptr)
+{
+    asm volatile("" : : "g"(ptr) : "memory");
+}
+
+void churn(size_t allocations, unsigned seed)
+{
+    std::vector<void*> slots(NUM_SLOTS, nullptr);
+    for (size_t i = 0; i < allocations; ++i) {
+        seed = seed * 1103515245 + 12345;
+        const auto size = 1 + (seed >> 8) % 512;
+        auto& slot = slots[(seed >> 20) % NUM_SLOTS];
+        free(slot);
+        slot = malloc(size);
+        escape(slot);
+    }
+    for (auto slot : slots) {
+        free(slot);
+    }
+}
+
+__attribute__((noinline)) void recurse(unsigned depth, size_t allocations, unsigned seed)
+{
+    if (depth) {
+        // branch on the seed, such that we don't only record a single backtrace
+        if (seed & 1) {
+            recurse(depth - 1, allocations, (seed >> 1) | (seed << 31));
+        } else {
+            recurse(depth - 1, allocations, seed >> 1);
+        }
+        escape(&depth);
+        return;
+    }
+    churn(allocations, seed);
+}
+
+int dlopenStorm(const char* module, size_t iterations)
+{
+    for (size_t i = 0; i < iterations; ++i) {
+        auto handle = dlopen(module, RTLD_NOW | RTLD_LOCAL);
+        if (!handle) {
+            fprintf(stderr, "failed to load %s: %s\n", module, dlerror());
+            return 1;
+        }
+        auto allocate = reinterpret_cast<void* (*)(size_t)>(dlsym(handle, "bench_module_allocate"));
+        if (!allocate) {
+            fprintf(stderr, "failed to resolve bench_module_allocate: %s\n", dlerror());
+            return 1;
+        }
+        free(allocate(i % 256 + 1));
+        dlclose(handle);
+    }
+    return 0;
+}
+
+size_t toCount(const char* arg)
+{
+    return strtoull(arg, nullptr, 10);
+}
+}
+
+int main(int argc, char** argv)
+{
+    const std::string mode = argc > 1 ? argv[1] : "";
+    if (mode == "churn" && argc == 3) {
+        churn(toCount(argv[2]), 1);
+    } else if (mode == "threads" && argc == 4) {
+        std::vector<std::thread> threads;
+        const auto allocations = toCount(argv[3]);
+        for (size_t i = 0, c = toCount(argv[2]); i < c; ++i) {
+            threads.emplace_back(churn, allocations, i + 1);
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    } else if (mode == "recursion" && argc == 4) {
+        // split the allocations over many leaves of the recursion
+        const auto allocations = toCount(argv[3]);
+        const size_t numLeaves = 64;
+        for (size_t i = 0; i < numLeaves; ++i) {
+            recurse(toCount(argv[2]), allocations / numLeaves, i * 2654435761u);
+        }
+    } else if (mode == "dlopen" && argc == 4) {
+        return dlopenStorm(argv[2], toCount(argv[3]));
+    } else {
+        fprintf(stderr,
+                "usage: %s churn <allocations> | threads <threads> <allocations> | recursion <depth> <allocations> "
+                "| dlopen <module> <iterations>\n",
+                argv[0]);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,13 @@
+/*
+    SPDX-FileCopyrightText: 2026 Milian Wolff <mail@milianw.de>
+
+    SPDX-License-Identifier: LGPL-2.1-or-later
+*/
+
+#include <cstdlib>
+
+// loaded and unloaded over and over again by bench_workload dlopen
+extern "C" void* bench_module_allocate(size_t size)
+{
+    return malloc(size);
+}
@@ -0,0 +1,61 @@
+#!/bin/bash
+
+#
+# SPDX-FileCopyrightText: 2026 Milian Wolff <mail@milianw.de>
+#
+# SPDX-License-Identifier: LGPL-2.1-or-later
+#
+
+# Run the multi-threaded scenarios of measure_malloc_overhead without and with heaptrack and
+# break the overhead per allocation down into unwinding, lock wait and writing:
+#
+#   measure_contention.sh <bin dir> <measure_malloc_overhead> [<max threads> [<allocations per thread>]]
+#
+# The break down compares runs with different configurations of heaptrack:
+#  - unwind: the default run minus a run that only unwinds a single frame (HEAPTRACK_UNWIND_DEPTH=1)
+#  - lock: the default run minus a run with per-thread buffers (HEAPTRACK_THREAD_BUFFERS=1),
+#    which only takes the global lock once per batch of events
+#  - write: the run with both of the above minus the run without heaptrack, i.e. what remains
+#    for formatting and writing the records and the bookkeeping around it
+# These are approximations, i.e. the parts do not necessarily add up to the total overhead.
+
+if [ $# -lt 2 ]; then
+    echo "usage: $0 <bin dir> <measure_malloc_overhead> [<max threads> [<allocations per thread>]]"
+    exit 1
+fi
+
+bin_dir=$(readlink -f "$1")
+benchmark=$(readlink -f "$2")
+threads=${3:-8}
+allocations=${4:-200000}
+
+work_dir=$(mktemp -d /tmp/heaptrack_measure_contention.XXXXXX)
+trap 'rm -rf "$work_dir"' EXIT
+
+# print "<scenario> <threads> <ns/allocation>" per line
+scenarios() {
+    awk -F'|' '/^(uniform|crossthread|bursty)[ \t]*\|/ { gsub(/[ \t]/, ""); print $1, $2, $3 }'
+}
+
+run() {
+    local name=$1
+    shift
+    env "$@" "$bin_dir/heaptrack" --record-only -o "$work_dir/$name" "$benchmark" contention "$threads" "$allocations" \
+        2> /dev/null | scenarios > "$work_dir/$name.txt"
+    rm -f "$work_dir/$name".{zst,gz}
+}
+
+"$benchmark" contention "$threads" "$allocations" | scenarios > "$work_dir/native.txt"
+run traced
+run shallow HEAPTRACK_UNWIND_DEPTH=1
+run buffered HEAPTRACK_THREAD_BUFFERS=1
+run unlocked HEAPTRACK_UNWIND_DEPTH=1 HEAPTRACK_THREAD_BUFFERS=1
+
+printf "%-12s %7s %10s %10s %10s %10s %10s\n" "scenario" "threads" "native[ns]" "traced[ns]" "unwind[ns]" \
+    "lock[ns]" "write[ns]"
+paste -d' ' "$work_dir"/{native,traced,shallow,buffered,unlocked}.txt | awk '
+{
+    native = $3; traced = $6; shallow = $9; buffered = $12; unlocked = $15
+    printf "%-12s %7s %10.1f %10.1f %10.1f %10.1f %10.1f\n", $1, $2, native, traced, traced - shallow, \
+        traced - buffered, unlocked - native
+}'
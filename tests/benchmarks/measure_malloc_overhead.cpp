@@ -4,16 +4,357 @@
     SPDX-License-Identifier: LGPL-2.1-or-later
 */
 
+/**
+ * Measure the memory overhead of malloc for different allocation sizes.
+ *
+ * Afterwards, the runtime cost of malloc/free pairs is measured. Where available,
+ * this uses the hardware performance counters, which makes the numbers comparable
+ * between runs with and without heaptrack, e.g.:
+ *
+ *   measure_malloc_overhead
+ *   heaptrack measure_malloc_overhead
+ *
+ * Finally, multiple threads allocate concurrently to show the contention in heaptrack:
+ * uniform small allocations, allocations that get freed by another thread and synchronized
+ * bursts of allocations. Pass "contention" to only run these scenarios, optionally followed by
+ * the maximum number of threads and the allocations per thread. See measure_contention.sh for
+ * the break down of the costs into unwinding, lock wait and writing.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
 #include <malloc.h>
 #include <unistd.h>
 
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
 #include <benchutil.h>
 
 using namespace std;
 
-int main()
+namespace {
+/**
+ * Counts an event of the hardware performance counters for the current thread,
+ * excluding the kernel.
+ */
+class PerfCounter
+{
+public:
+    explicit PerfCounter(uint64_t config)
+    {
+#ifdef __linux__
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        m_fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+        (void)config;
+#endif
+    }
+
+    ~PerfCounter()
+    {
+        if (m_fd != -1) {
+            close(m_fd);
+        }
+    }
+
+    PerfCounter(const PerfCounter&) = delete;
+    PerfCounter& operator=(const PerfCounter&) = delete;
+
+    /// false when the counter is not available, e.g. due to perf_event_paranoid
+    bool isValid() const
+    {
+        return m_fd != -1;
+    }
+
+    void start()
+    {
+#ifdef __linux__
+        if (m_fd != -1) {
+            ioctl(m_fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(m_fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+
+    uint64_t stop()
+    {
+        uint64_t count = 0;
+#ifdef __linux__
+        if (m_fd != -1) {
+            ioctl(m_fd, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(m_fd, &count, sizeof(count)) != sizeof(count)) {
+                count = 0;
+            }
+        }
+#endif
+        return count;
+    }
+
+private:
+    int m_fd = -1;
+};
+
+void measureRuntime()
+{
+    const int repetitions = 100000;
+    const int sizes[] = {16, 256, 4096};
+
+#ifdef __linux__
+    PerfCounter cycles(PERF_COUNT_HW_CPU_CYCLES);
+    PerfCounter instructions(PERF_COUNT_HW_INSTRUCTIONS);
+#else
+    PerfCounter cycles(0);
+    PerfCounter instructions(0);
+#endif
+    const bool hasCounters = cycles.isValid() && instructions.isValid();
+    if (!hasCounters) {
+        cout << "\nperformance counters are not available, only measuring the wall time\n";
+    }
+
+    cout << "\nsize\t|\tns/pair\t|\tcycles/pair\t|\tinstructions/pair\n";
+    for (const auto size : sizes) {
+        // warm up, i.e. let heaptrack see the call site and the allocator populate its caches
+        for (int i = 0; i < 100; ++i) {
+            auto ptr = malloc(size);
+            escape(ptr);
+            free(ptr);
+        }
+
+        const auto start = chrono::steady_clock::now();
+        cycles.start();
+        instructions.start();
+        for (int i = 0; i < repetitions; ++i) {
+            auto ptr = malloc(size);
+            escape(ptr);
+            free(ptr);
+        }
+        const auto numInstructions = instructions.stop();
+        const auto numCycles = cycles.stop();
+        const auto elapsed = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+
+        cout << size << "\t|\t" << (elapsed / repetitions) << "\t|\t";
+        if (hasCounters) {
+            cout << (double(numCycles) / repetitions) << "\t\t|\t" << (double(numInstructions) / repetitions) << '\n';
+        } else {
+            cout << "-\t\t|\t-\n";
+        }
+    }
+}
+
+/**
+ * Lets the threads start their work at the same time, such that they actually contend.
+ */
+class Barrier
 {
+public:
+    explicit Barrier(unsigned count)
+        : m_count(count)
+    {
+    }
+
+    void wait()
+    {
+        unique_lock<mutex> lock(m_mutex);
+        const auto generation = m_generation;
+        if (++m_waiting == m_count) {
+            m_waiting = 0;
+            ++m_generation;
+            m_condition.notify_all();
+        } else {
+            m_condition.wait(lock, [&]() { return generation != m_generation; });
+        }
+    }
+
+private:
+    mutex m_mutex;
+    condition_variable m_condition;
+    const unsigned m_count;
+    unsigned m_waiting = 0;
+    unsigned m_generation = 0;
+};
+
+/**
+ * A bounded single-producer single-consumer queue for handing allocations over to another thread.
+ */
+class PointerQueue
+{
+public:
+    bool push(void* ptr)
+    {
+        const auto tail = m_tail.load(memory_order_relaxed);
+        if (tail - m_head.load(memory_order_acquire) == CAPACITY) {
+            return false;
+        }
+        m_slots[tail % CAPACITY] = ptr;
+        m_tail.store(tail + 1, memory_order_release);
+        return true;
+    }
+
+    void* pop()
+    {
+        const auto head = m_head.load(memory_order_relaxed);
+        if (head == m_tail.load(memory_order_acquire)) {
+            return nullptr;
+        }
+        auto ptr = m_slots[head % CAPACITY];
+        m_head.store(head + 1, memory_order_release);
+        return ptr;
+    }
+
+private:
+    static const size_t CAPACITY = 1024;
+    void* m_slots[CAPACITY];
+    alignas(64) atomic<size_t> m_head{0};
+    alignas(64) atomic<size_t> m_tail{0};
+};
+
+size_t allocationSize(unsigned* seed)
+{
+    *seed = *seed * 1103515245 + 12345;
+    return 16 + (*seed >> 8) % 240;
+}
+
+// every thread keeps a few allocations alive and replaces one of them per iteration
+void uniform(unsigned thread, unsigned, size_t allocations)
+{
+    const size_t numSlots = 64;
+    void* slots[numSlots] = {};
+    unsigned seed = thread;
+    for (size_t i = 0; i < allocations; ++i) {
+        auto& slot = slots[i % numSlots];
+        free(slot);
+        slot = malloc(allocationSize(&seed));
+        escape(slot);
+    }
+    for (auto slot : slots) {
+        free(slot);
+    }
+}
+
+// even threads allocate and odd threads free what their neighbor allocated
+void crossThread(unsigned thread, size_t allocations, vector<PointerQueue>* queues)
+{
+    auto& queue = (*queues)[thread / 2];
+    unsigned seed = thread;
+    if (thread % 2 == 0) {
+        for (size_t i = 0; i < allocations; ++i) {
+            auto ptr = malloc(allocationSize(&seed));
+            escape(ptr);
+            while (!queue.push(ptr)) {
+                this_thread::yield();
+            }
+        }
+    } else {
+        for (size_t i = 0; i < allocations;) {
+            if (auto ptr = queue.pop()) {
+                free(ptr);
+                ++i;
+            } else {
+                this_thread::yield();
+            }
+        }
+    }
+}
+
+// all threads allocate a burst at the same time, then free it all again
+void bursty(unsigned thread, size_t allocations, Barrier* barrier)
+{
+    const size_t burstSize = 512;
+    void* burst[burstSize];
+    unsigned seed = thread;
+    for (size_t i = 0; i < allocations; i += burstSize) {
+        barrier->wait();
+        for (auto& ptr : burst) {
+            ptr = malloc(allocationSize(&seed));
+            escape(ptr);
+        }
+        for (auto ptr : burst) {
+            free(ptr);
+        }
+    }
+}
+
+/// @return the wall time in nanoseconds per allocation and thread when running @p job on @p threads threads
+template <typename Job>
+double measureThreads(unsigned threads, size_t allocations, Job job)
+{
+    Barrier start(threads + 1);
+    vector<thread> workers;
+    workers.reserve(threads);
+    for (unsigned i = 0; i < threads; ++i) {
+        workers.emplace_back([&, i]() {
+            start.wait();
+            job(i, threads, allocations);
+        });
+    }
+
+    const auto begin = chrono::steady_clock::now();
+    start.wait();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    return chrono::duration<double, nano>(chrono::steady_clock::now() - begin).count() / allocations;
+}
+
+void measureContention(unsigned maxThreads, size_t allocations)
+{
+    cout << "\nscenario\t|\tthreads\t|\tns/allocation\n";
+    for (unsigned threads = 1; threads <= maxThreads; threads *= 2) {
+        cout << "uniform\t\t|\t" << threads << "\t|\t" << measureThreads(threads, allocations, uniform) << '\n';
+    }
+    // the cross-thread scenario needs pairs of threads
+    for (unsigned threads = 2; threads <= maxThreads; threads *= 2) {
+        vector<PointerQueue> queues(threads / 2);
+        const auto ns = measureThreads(threads, allocations, [&](unsigned thread, unsigned, size_t count) {
+            crossThread(thread, count, &queues);
+        });
+        cout << "crossthread\t|\t" << threads << "\t|\t" << ns << '\n';
+    }
+    for (unsigned threads = 1; threads <= maxThreads; threads *= 2) {
+        Barrier barrier(threads);
+        const auto ns = measureThreads(threads, allocations, [&](unsigned thread, unsigned, size_t count) {
+            bursty(thread, count, &barrier);
+        });
+        cout << "bursty\t\t|\t" << threads << "\t|\t" << ns << '\n';
+    }
+}
+}
+
+int main(int argc, char** argv)
+{
+    unsigned maxThreads = 8;
+    size_t allocations = 200000;
+    const bool onlyContention = argc > 1 && strcmp(argv[1], "contention") == 0;
+    if (onlyContention) {
+        if (argc > 2) {
+            maxThreads = max(1, atoi(argv[2]));
+        }
+        if (argc > 3) {
+            allocations = max(1, atoi(argv[3]));
+        }
+        measureContention(maxThreads, allocations);
+        return 0;
+    }
+
     const auto log2_max = 17;
     const auto max_steps = log2_max * 2 + 1;
     size_t cost[max_steps];
@@ -38,5 +379,8 @@ int main()
         const auto actual = (cost[i] - baseline);
         cout << sizes[i] << "\t\t|\t" << actual << "\t|\t" << (actual - sizes[i]) << '\n';
     }
+
+    measureRuntime();
+    measureContention(maxThreads, allocations);
     return 0;
 }
@@ -0,0 +1,63 @@
+#!/bin/bash
+
+#
+# SPDX-FileCopyrightText: 2026 Milian Wolff <mail@milianw.de>
+#
+# SPDX-License-Identifier: LGPL-2.1-or-later
+#
+
+# Break the self costs of the profiles recorded by heaptrack --perf down into the stages of heaptrack:
+#
+#   perf_stages.sh <perf.data>...
+#
+# The stages get matched by symbol name, so build heaptrack with -DHEAPTRACK_PERF_ANNOTATIONS=ON
+# to keep its hot functions out of line. Otherwise their costs are attributed to their callers and
+# end up in the "other" stage:
+#  - unwind: Trace::unwind and the unwinders below it, i.e. libunwind or the frame pointer walk
+#  - lock: waiting for the global lock of the tracer, see HeapTrack::tryLock
+#  - write: formatting and writing out the records, in the tracer as well as the interpreter
+#  - readHex: reading and parsing the records in the interpreter, see LineReader
+#  - addIp: looking up new instruction pointers in the interpreter, including the symbolization
+#  - other: the costs of the application itself and everything else
+
+if [ $# -lt 1 ]; then
+    echo "usage: $0 <perf.data>..."
+    exit 1
+fi
+
+if [ -z "$(command -v perf 2> /dev/null)" ]; then
+    echo "perf is not installed."
+    exit 1
+fi
+
+for data in "$@"; do
+    echo "$data:"
+    perf report -i "$data" --no-children --sort sym --stdio --quiet 2> /dev/null | awk '
+        function stage(symbol) {
+            if (symbol ~ /Trace::unwind|unw_|_ULx86|_Ux86|_Unwind_|unwindFramePointers/)
+                return "unwind"
+            if (symbol ~ /tryLock|pthread_mutex_|__lll_lock|futex/)
+                return "lock"
+            if (symbol ~ /LineWriter::|ShmRing::write|__libc_write|__GI___libc_write|writev|^write$/)
+                return "write"
+            if (symbol ~ /LineReader::|ShmRing::read/)
+                return "readHex"
+            if (symbol ~ /addIp|Symbolizer|dwfl_|dwarf_|__libdw|elf_|cplus_demangle|__cxa_demangle/)
+                return "addIp"
+            return "other"
+        }
+        $1 ~ /%$/ {
+            percent = $1
+            sub(/%$/, "", percent)
+            # skip the percentage and the [.] or [k] marker
+            symbol = $0
+            sub(/^[ \t]*[0-9.]+%[ \t]+\[[^]]*\][ \t]+/, "", symbol)
+            costs[stage(symbol)] += percent
+        }
+        END {
+            split("unwind lock write readHex addIp other", stages, " ")
+            for (i = 1; i <= 6; ++i) {
+                printf("  %-8s %6.2f%%\n", stages[i], costs[stages[i]])
+            }
+        }'
+done